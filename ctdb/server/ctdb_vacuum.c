@@ -1338,8 +1338,31 @@ static int ctdb_vacuum_and_repack_db(struct ctdb_db_context *ctdb_db,
 	/*
 	 * decide if a repack is necessary
 	 */
-	if ((repack_limit == 0 || (uint32_t)freelist_size < repack_limit))
-	{
+	if (repack_limit == 0 || freelist_size == 0) {
+		return 0;
+	}
+
+	if ((uint32_t)freelist_size < repack_limit) {
+		/*
+		 * Below the limit a full repack is not worth blocking
+		 * the database, but we can still move records down
+		 * and shrink the file chain by chain.
+		 */
+		struct tdb_repack_stats stats;
+
+		ret = tdb_repack_online(ctdb_db->ltdb->tdb, &stats);
+		if (ret != 0) {
+			DEBUG(DEBUG_ERR,(__location__ " Failed to repack "
+					 "'%s' online\n", name));
+			return -1;
+		}
+
+		DEBUG(DEBUG_INFO, ("Online repack of %s: moved %zu records "
+				   "(%zu bytes), reclaimed %zu bytes, locks "
+				   "held for %llu us (longest %llu us)\n",
+				   name, stats.records_moved,
+				   stats.bytes_moved, stats.bytes_reclaimed,
+				   stats.lock_usecs, stats.lock_usecs_max));
 		return 0;
 	}
 
@@ -337,6 +337,36 @@ static int skel_fstat(vfs_handle_struct *handle, files_struct *fsp,
 	return -1;
 }
 
+static struct tevent_req *skel_fstat_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp,
+					  SMB_STRUCT_STAT *sbuf)
+{
+	return NULL;
+}
+
+static int skel_fstat_recv(struct tevent_req *req, int *err)
+{
+	*err = ENOSYS;
+	return -1;
+}
+
+static struct tevent_req *skel_stat_send(struct vfs_handle_struct *handle,
+					 TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 const struct smb_filename *smb_fname,
+					 SMB_STRUCT_STAT *sbuf)
+{
+	return NULL;
+}
+
+static int skel_stat_recv(struct tevent_req *req, int *err)
+{
+	*err = ENOSYS;
+	return -1;
+}
+
 static int skel_lstat(vfs_handle_struct *handle,
 		      struct smb_filename *smb_fname)
 {
@@ -755,6 +785,22 @@ static ssize_t skel_getxattr(vfs_handle_struct *handle, const char *path,
 	return -1;
 }
 
+static struct tevent_req *skel_getxattr_send(struct vfs_handle_struct *handle,
+					     TALLOC_CTX *mem_ctx,
+					     struct tevent_context *ev,
+					     const char *path,
+					     const char *name,
+					     void *value, size_t size)
+{
+	return NULL;
+}
+
+static ssize_t skel_getxattr_recv(struct tevent_req *req, int *err)
+{
+	*err = ENOSYS;
+	return -1;
+}
+
 static ssize_t skel_fgetxattr(vfs_handle_struct *handle,
 			      struct files_struct *fsp, const char *name,
 			      void *value, size_t size)
@@ -884,6 +930,10 @@ struct vfs_fn_pointers skel_opaque_fns = {
 	.fsync_recv_fn = skel_fsync_recv,
 	.stat_fn = skel_stat,
 	.fstat_fn = skel_fstat,
+	.fstat_send_fn = skel_fstat_send,
+	.fstat_recv_fn = skel_fstat_recv,
+	.stat_send_fn = skel_stat_send,
+	.stat_recv_fn = skel_stat_recv,
 	.lstat_fn = skel_lstat,
 	.get_alloc_size_fn = skel_get_alloc_size,
 	.unlink_fn = skel_unlink,
@@ -946,6 +996,8 @@ struct vfs_fn_pointers skel_opaque_fns = {
 
 	/* EA operations. */
 	.getxattr_fn = skel_getxattr,
+	.getxattr_send_fn = skel_getxattr_send,
+	.getxattr_recv_fn = skel_getxattr_recv,
 	.fgetxattr_fn = skel_fgetxattr,
 	.listxattr_fn = skel_listxattr,
 	.flistxattr_fn = skel_flistxattr,
@@ -448,6 +448,110 @@ static int skel_fstat(vfs_handle_struct *handle, files_struct *fsp,
 	return SMB_VFS_NEXT_FSTAT(handle, fsp, sbuf);
 }
 
+struct skel_fstat_state {
+	int ret;
+	int err;
+};
+
+static void skel_fstat_done(struct tevent_req *subreq);
+
+static struct tevent_req *skel_fstat_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  struct files_struct *fsp,
+					  SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct skel_fstat_state *state;
+
+	req = tevent_req_create(mem_ctx, &state, struct skel_fstat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	subreq = SMB_VFS_NEXT_FSTAT_SEND(state, ev, handle, fsp, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, skel_fstat_done, req);
+	return req;
+}
+
+static void skel_fstat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+	    tevent_req_callback_data(subreq, struct tevent_req);
+	struct skel_fstat_state *state =
+	    tevent_req_data(req, struct skel_fstat_state);
+
+	state->ret = SMB_VFS_FSTAT_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static int skel_fstat_recv(struct tevent_req *req, int *err)
+{
+	struct skel_fstat_state *state =
+	    tevent_req_data(req, struct skel_fstat_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
+struct skel_stat_state {
+	int ret;
+	int err;
+};
+
+static void skel_stat_done(struct tevent_req *subreq);
+
+static struct tevent_req *skel_stat_send(struct vfs_handle_struct *handle,
+					 TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 const struct smb_filename *smb_fname,
+					 SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct skel_stat_state *state;
+
+	req = tevent_req_create(mem_ctx, &state, struct skel_stat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	subreq = SMB_VFS_NEXT_STAT_SEND(state, ev, handle, smb_fname, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, skel_stat_done, req);
+	return req;
+}
+
+static void skel_stat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+	    tevent_req_callback_data(subreq, struct tevent_req);
+	struct skel_stat_state *state =
+	    tevent_req_data(req, struct skel_stat_state);
+
+	state->ret = SMB_VFS_STAT_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static int skel_stat_recv(struct tevent_req *req, int *err)
+{
+	struct skel_stat_state *state =
+	    tevent_req_data(req, struct skel_stat_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
 static int skel_lstat(vfs_handle_struct *handle,
 		      struct smb_filename *smb_fname)
 {
@@ -875,6 +979,60 @@ static ssize_t skel_getxattr(vfs_handle_struct *handle, const char *path,
 	return SMB_VFS_NEXT_GETXATTR(handle, path, name, value, size);
 }
 
+struct skel_getxattr_state {
+	ssize_t ret;
+	int err;
+};
+
+static void skel_getxattr_done(struct tevent_req *subreq);
+
+static struct tevent_req *skel_getxattr_send(struct vfs_handle_struct *handle,
+					     TALLOC_CTX *mem_ctx,
+					     struct tevent_context *ev,
+					     const char *path,
+					     const char *name,
+					     void *value, size_t size)
+{
+	struct tevent_req *req, *subreq;
+	struct skel_getxattr_state *state;
+
+	req = tevent_req_create(mem_ctx, &state, struct skel_getxattr_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	subreq = SMB_VFS_NEXT_GETXATTR_SEND(state, ev, handle, path, name,
+					    value, size);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, skel_getxattr_done, req);
+	return req;
+}
+
+static void skel_getxattr_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+	    tevent_req_callback_data(subreq, struct tevent_req);
+	struct skel_getxattr_state *state =
+	    tevent_req_data(req, struct skel_getxattr_state);
+
+	state->ret = SMB_VFS_GETXATTR_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static ssize_t skel_getxattr_recv(struct tevent_req *req, int *err)
+{
+	struct skel_getxattr_state *state =
+	    tevent_req_data(req, struct skel_getxattr_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
 static ssize_t skel_fgetxattr(vfs_handle_struct *handle,
 			      struct files_struct *fsp, const char *name,
 			      void *value, size_t size)
@@ -993,6 +1151,10 @@ struct vfs_fn_pointers skel_transparent_fns = {
 	.fsync_recv_fn = skel_fsync_recv,
 	.stat_fn = skel_stat,
 	.fstat_fn = skel_fstat,
+	.fstat_send_fn = skel_fstat_send,
+	.fstat_recv_fn = skel_fstat_recv,
+	.stat_send_fn = skel_stat_send,
+	.stat_recv_fn = skel_stat_recv,
 	.lstat_fn = skel_lstat,
 	.get_alloc_size_fn = skel_get_alloc_size,
 	.unlink_fn = skel_unlink,
@@ -1055,6 +1217,8 @@ struct vfs_fn_pointers skel_transparent_fns = {
 
 	/* EA operations. */
 	.getxattr_fn = skel_getxattr,
+	.getxattr_send_fn = skel_getxattr_send,
+	.getxattr_recv_fn = skel_getxattr_recv,
 	.fgetxattr_fn = skel_fgetxattr,
 	.listxattr_fn = skel_listxattr,
 	.flistxattr_fn = skel_flistxattr,
@@ -35,36 +35,30 @@
 #include "aes.h"
 
 #ifdef SAMBA_RIJNDAEL
-#include "rijndael-alg-fst.h"
+#include "aes_backend.h"
 
 int
 AES_set_encrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
 {
-    key->rounds = rijndaelKeySetupEnc(key->key, userkey, bits);
-    if (key->rounds == 0)
-	return -1;
-    return 0;
+    return samba_aes_backend()->set_encrypt_key(userkey, bits, key);
 }
 
 int
 AES_set_decrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
 {
-    key->rounds = rijndaelKeySetupDec(key->key, userkey, bits);
-    if (key->rounds == 0)
-	return -1;
-    return 0;
+    return samba_aes_backend()->set_decrypt_key(userkey, bits, key);
 }
 
 void
 AES_encrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
 {
-    rijndaelEncrypt(key->key, key->rounds, in, out);
+    samba_aes_backend()->encrypt(in, out, key);
 }
 
 void
 AES_decrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
 {
-    rijndaelDecrypt(key->key, key->rounds, in, out);
+    samba_aes_backend()->decrypt(in, out, key);
 }
 #endif /* SAMBA_RIJNDAEL */
 
@@ -0,0 +1,291 @@
+/*
+   AES backend dispatch
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
+#include "../lib/crypto/rijndael-alg-fst.h"
+#include "lib/util/byteorder.h"
+
+static bool aes_c_available(void)
+{
+	return true;
+}
+
+static int aes_c_set_encrypt_key(const unsigned char *userkey,
+				 const int bits, AES_KEY *key)
+{
+	key->rounds = rijndaelKeySetupEnc(key->key, userkey, bits);
+	if (key->rounds == 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int aes_c_set_decrypt_key(const unsigned char *userkey,
+				 const int bits, AES_KEY *key)
+{
+	key->rounds = rijndaelKeySetupDec(key->key, userkey, bits);
+	if (key->rounds == 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static void aes_c_encrypt(const unsigned char *in, unsigned char *out,
+			  const AES_KEY *key)
+{
+	rijndaelEncrypt(key->key, key->rounds, in, out);
+}
+
+static void aes_c_decrypt(const unsigned char *in, unsigned char *out,
+			  const AES_KEY *key)
+{
+	rijndaelDecrypt(key->key, key->rounds, in, out);
+}
+
+static void aes_c_ctr32_encrypt_blocks(const AES_KEY *key,
+				       uint8_t ctr[AES_BLOCK_SIZE],
+				       const uint8_t *in, uint8_t *out,
+				       size_t num_blocks)
+{
+	uint8_t S[AES_BLOCK_SIZE];
+	uint32_t c;
+
+	c = RIVAL(ctr, AES_BLOCK_SIZE - 4);
+
+	while (num_blocks > 0) {
+		c += 1;
+		RSIVAL(ctr, AES_BLOCK_SIZE - 4, c);
+		rijndaelEncrypt(key->key, key->rounds, ctr, S);
+		aes_block_xor(in, S, out);
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	ZERO_STRUCT(S);
+}
+
+static void aes_c_cbc_mac_blocks(const AES_KEY *key,
+				 uint8_t X[AES_BLOCK_SIZE],
+				 const uint8_t *in,
+				 size_t num_blocks)
+{
+	uint8_t B[AES_BLOCK_SIZE];
+
+	while (num_blocks > 0) {
+		aes_block_xor(X, in, B);
+		rijndaelEncrypt(key->key, key->rounds, B, X);
+		in += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	ZERO_STRUCT(B);
+}
+
+static void aes_c_cbc_mac_blocks_multi(struct aes_cbc_mac_lane *lanes,
+				       size_t num_lanes,
+				       size_t num_blocks)
+{
+	size_t i;
+
+	for (i = 0; i < num_lanes; i++) {
+		struct aes_cbc_mac_lane *l = &lanes[i];
+
+		aes_c_cbc_mac_blocks(l->key, l->X, l->in, num_blocks);
+		l->in += num_blocks * AES_BLOCK_SIZE;
+	}
+}
+
+static inline void aes_c_gcm_mul(const uint8_t x[AES_BLOCK_SIZE],
+				 const uint8_t y[AES_BLOCK_SIZE],
+				 uint8_t v[AES_BLOCK_SIZE],
+				 uint8_t z[AES_BLOCK_SIZE])
+{
+	uint8_t i;
+	/* 11100001 || 0^120 */
+	static const uint8_t r[AES_BLOCK_SIZE] = {
+		0xE1, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00,
+	};
+
+	memset(z, 0, AES_BLOCK_SIZE);
+	memcpy(v, y, AES_BLOCK_SIZE);
+
+	for (i = 0; i < AES_BLOCK_SIZE; i++) {
+		uint8_t mask;
+		for (mask = 0x80; mask != 0 ; mask >>= 1) {
+			uint8_t v_lsb = v[AES_BLOCK_SIZE-1] & 1;
+			if (x[i] & mask) {
+				aes_block_xor(z, v, z);
+			}
+
+			aes_block_rshift(v, v);
+			if (v_lsb != 0) {
+				aes_block_xor(v, r, v);
+			}
+		}
+	}
+}
+
+static void aes_c_ghash_blocks(const uint8_t H[AES_BLOCK_SIZE],
+			       uint8_t Y[AES_BLOCK_SIZE],
+			       const uint8_t *in,
+			       size_t num_blocks)
+{
+	/*
+	 * The uint64_t members keep the blocks 8 byte aligned,
+	 * which lets aes_block_xor() use the fast path.
+	 */
+	union {
+		uint64_t __align[2];
+		uint8_t block[AES_BLOCK_SIZE];
+	} v, y;
+
+	while (num_blocks > 0) {
+		aes_block_xor(Y, in, y.block);
+		aes_c_gcm_mul(y.block, H, v.block, Y);
+		in += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	ZERO_STRUCT(v);
+	ZERO_STRUCT(y);
+}
+
+const struct aes_backend_ops aes_backend_c = {
+	.name			= "c",
+	.available		= aes_c_available,
+	.set_encrypt_key	= aes_c_set_encrypt_key,
+	.set_decrypt_key	= aes_c_set_decrypt_key,
+	.encrypt		= aes_c_encrypt,
+	.decrypt		= aes_c_decrypt,
+	.ctr32_encrypt_blocks	= aes_c_ctr32_encrypt_blocks,
+	.cbc_mac_blocks		= aes_c_cbc_mac_blocks,
+	.cbc_mac_blocks_multi	= aes_c_cbc_mac_blocks_multi,
+	.ghash_blocks		= aes_c_ghash_blocks,
+};
+
+/*
+ * The rijndael key schedule holds the round keys as
+ * big endian words, convert them into byte strings.
+ */
+static void aes_backend_key_to_bytes(AES_KEY *key)
+{
+	uint8_t *p = (uint8_t *)key->key;
+	int i;
+
+	for (i = 0; i < (key->rounds + 1) * 4; i++) {
+		uint32_t w = key->key[i];
+
+		RSIVAL(p, i * 4, w);
+	}
+}
+
+int aes_backend_bytes_set_encrypt_key(const unsigned char *userkey,
+				      const int bits, AES_KEY *key)
+{
+	int ret;
+
+	ret = aes_c_set_encrypt_key(userkey, bits, key);
+	if (ret != 0) {
+		return ret;
+	}
+
+	aes_backend_key_to_bytes(key);
+	return 0;
+}
+
+int aes_backend_bytes_set_decrypt_key(const unsigned char *userkey,
+				      const int bits, AES_KEY *key)
+{
+	int ret;
+
+	ret = aes_c_set_decrypt_key(userkey, bits, key);
+	if (ret != 0) {
+		return ret;
+	}
+
+	aes_backend_key_to_bytes(key);
+	return 0;
+}
+
+/*
+ * Ordered by preference.
+ */
+static const struct aes_backend_ops * const aes_backends[] = {
+#ifdef HAVE_AES_ACCEL_X86
+	&aes_backend_x86,
+#endif
+#ifdef HAVE_AES_ACCEL_ARMV8
+	&aes_backend_armv8,
+#endif
+	&aes_backend_c,
+	NULL
+};
+
+static const struct aes_backend_ops *aes_backend_active;
+
+const struct aes_backend_ops *samba_aes_backend(void)
+{
+	size_t i;
+
+	if (likely(aes_backend_active != NULL)) {
+		return aes_backend_active;
+	}
+
+	/*
+	 * This is racy if called from multiple threads, but
+	 * all of them will come to the same result.
+	 */
+	for (i = 0; aes_backends[i] != NULL; i++) {
+		if (aes_backends[i]->available()) {
+			aes_backend_active = aes_backends[i];
+			break;
+		}
+	}
+
+	return aes_backend_active;
+}
+
+const struct aes_backend_ops * const *samba_aes_backend_list(void)
+{
+	return aes_backends;
+}
+
+bool samba_aes_backend_select(const char *name)
+{
+	size_t i;
+
+	for (i = 0; aes_backends[i] != NULL; i++) {
+		if (strcmp(aes_backends[i]->name, name) != 0) {
+			continue;
+		}
+		if (!aes_backends[i]->available()) {
+			return false;
+		}
+		aes_backend_active = aes_backends[i];
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,137 @@
+/*
+   AES backend dispatch
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_CRYPTO_AES_BACKEND_H
+#define LIB_CRYPTO_AES_BACKEND_H
+
+/*
+ * An AES backend provides the block cipher and the
+ * bulk helpers used by the AES-CMAC/CCM/GCM-128 modes.
+ *
+ * The layout of the AES_KEY schedule is private to
+ * a backend, so a key must only be used with the
+ * backend that was active when it was set up.
+ */
+/*
+ * The maximum number of independent lanes for
+ * the *_multi() operations.
+ */
+#define AES_BACKEND_MAX_LANES 4
+
+struct aes_cbc_mac_lane {
+	const AES_KEY *key;
+	uint8_t *X;
+	const uint8_t *in;
+};
+
+struct aes_backend_ops {
+	const char *name;
+
+	/*
+	 * Returns true if the cpu supports this backend.
+	 */
+	bool (*available)(void);
+
+	int (*set_encrypt_key)(const unsigned char *userkey, const int bits,
+			       AES_KEY *key);
+	int (*set_decrypt_key)(const unsigned char *userkey, const int bits,
+			       AES_KEY *key);
+	void (*encrypt)(const unsigned char *in, unsigned char *out,
+			const AES_KEY *key);
+	void (*decrypt)(const unsigned char *in, unsigned char *out,
+			const AES_KEY *key);
+
+	/*
+	 * For each block: increment the big endian 32-bit counter
+	 * in the last 4 bytes of ctr, then out = in ^ E(ctr).
+	 *
+	 * in and out may be the same buffer.
+	 */
+	void (*ctr32_encrypt_blocks)(const AES_KEY *key,
+				     uint8_t ctr[AES_BLOCK_SIZE],
+				     const uint8_t *in, uint8_t *out,
+				     size_t num_blocks);
+
+	/*
+	 * For each block: X = E(X ^ in)
+	 */
+	void (*cbc_mac_blocks)(const AES_KEY *key,
+			       uint8_t X[AES_BLOCK_SIZE],
+			       const uint8_t *in,
+			       size_t num_blocks);
+
+	/*
+	 * Runs cbc_mac_blocks() for up to AES_BACKEND_MAX_LANES
+	 * independent lanes at once, this hides the latency
+	 * of the AES rounds. lane->in is advanced.
+	 */
+	void (*cbc_mac_blocks_multi)(struct aes_cbc_mac_lane *lanes,
+				     size_t num_lanes,
+				     size_t num_blocks);
+
+	/*
+	 * For each block: Y = (Y ^ in) * H in GF(2^128)
+	 * as defined for GHASH in NIST SP 800-38D.
+	 */
+	void (*ghash_blocks)(const uint8_t H[AES_BLOCK_SIZE],
+			     uint8_t Y[AES_BLOCK_SIZE],
+			     const uint8_t *in,
+			     size_t num_blocks);
+};
+
+extern const struct aes_backend_ops aes_backend_c;
+#ifdef HAVE_AES_ACCEL_X86
+extern const struct aes_backend_ops aes_backend_x86;
+#endif
+#ifdef HAVE_AES_ACCEL_ARMV8
+extern const struct aes_backend_ops aes_backend_armv8;
+#endif
+
+/*
+ * Helpers for backends which want the round keys
+ * as plain byte strings, as used by the cpu instructions.
+ *
+ * The decryption schedule is in the order and form needed
+ * by the "equivalent inverse cipher" (FIPS-197 5.3.5).
+ */
+int aes_backend_bytes_set_encrypt_key(const unsigned char *userkey,
+				      const int bits, AES_KEY *key);
+int aes_backend_bytes_set_decrypt_key(const unsigned char *userkey,
+				      const int bits, AES_KEY *key);
+
+/*
+ * Returns the active backend, the first time it is called
+ * the fastest backend supported by the cpu is selected.
+ */
+const struct aes_backend_ops *samba_aes_backend(void);
+
+/*
+ * Returns a NULL terminated list of all compiled in backends,
+ * the caller needs to check ->available().
+ */
+const struct aes_backend_ops * const *samba_aes_backend_list(void);
+
+/*
+ * Select a backend by name, this is only useful for tests
+ * and benchmarks. It must not be called while AES keys
+ * are in use.
+ */
+bool samba_aes_backend_select(const char *name);
+
+#endif /* LIB_CRYPTO_AES_BACKEND_H */
@@ -0,0 +1,394 @@
+/*
+   AES backend using the ARMv8 cryptography extensions
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
+#include "lib/util/byteorder.h"
+
+#ifdef HAVE_AES_ACCEL_ARMV8
+
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+
+/*
+ * Only the functions in this file are compiled for the
+ * crypto extensions, they are only called after
+ * aes_armv8_available() returned true.
+ */
+#define AES_ARMV8_TARGET __attribute__((target("+crypto")))
+
+static bool aes_armv8_available(void)
+{
+	unsigned long needed = HWCAP_AES | HWCAP_PMULL;
+	unsigned long hwcap;
+
+	hwcap = getauxval(AT_HWCAP);
+	if ((hwcap & needed) != needed) {
+		return false;
+	}
+
+	return true;
+}
+
+#define AES_ARMV8_RK(k, i) \
+	vld1q_u8(((const uint8_t *)(k)->key) + (i) * AES_BLOCK_SIZE)
+
+AES_ARMV8_TARGET
+static inline uint8x16_t aes_armv8_encrypt_block(const AES_KEY *key,
+						 uint8x16_t s)
+{
+	int i;
+
+	for (i = 0; i < key->rounds - 1; i++) {
+		s = vaesmcq_u8(vaeseq_u8(s, AES_ARMV8_RK(key, i)));
+	}
+	s = vaeseq_u8(s, AES_ARMV8_RK(key, key->rounds - 1));
+	return veorq_u8(s, AES_ARMV8_RK(key, key->rounds));
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_encrypt(const unsigned char *in, unsigned char *out,
+			      const AES_KEY *key)
+{
+	vst1q_u8(out, aes_armv8_encrypt_block(key, vld1q_u8(in)));
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_decrypt(const unsigned char *in, unsigned char *out,
+			      const AES_KEY *key)
+{
+	uint8x16_t s = vld1q_u8(in);
+	int i;
+
+	for (i = 0; i < key->rounds - 1; i++) {
+		s = vaesimcq_u8(vaesdq_u8(s, AES_ARMV8_RK(key, i)));
+	}
+	s = vaesdq_u8(s, AES_ARMV8_RK(key, key->rounds - 1));
+	s = veorq_u8(s, AES_ARMV8_RK(key, key->rounds));
+	vst1q_u8(out, s);
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_ctr32_encrypt_blocks(const AES_KEY *key,
+					   uint8_t ctr[AES_BLOCK_SIZE],
+					   const uint8_t *in, uint8_t *out,
+					   size_t num_blocks)
+{
+	uint32_t c = RIVAL(ctr, AES_BLOCK_SIZE - 4);
+
+	while (num_blocks >= 2) {
+		uint8x16_t s0, s1;
+
+		/*
+		 * Two independent blocks keep the
+		 * aese/aesmc pipeline busy.
+		 */
+		RSIVAL(ctr, AES_BLOCK_SIZE - 4, c + 1);
+		s0 = vld1q_u8(ctr);
+		RSIVAL(ctr, AES_BLOCK_SIZE - 4, c + 2);
+		s1 = vld1q_u8(ctr);
+		c += 2;
+
+		s0 = aes_armv8_encrypt_block(key, s0);
+		s1 = aes_armv8_encrypt_block(key, s1);
+
+		vst1q_u8(out, veorq_u8(vld1q_u8(in), s0));
+		vst1q_u8(out + AES_BLOCK_SIZE,
+			 veorq_u8(vld1q_u8(in + AES_BLOCK_SIZE), s1));
+
+		in += AES_BLOCK_SIZE * 2;
+		out += AES_BLOCK_SIZE * 2;
+		num_blocks -= 2;
+	}
+
+	if (num_blocks > 0) {
+		uint8x16_t s;
+
+		c += 1;
+		RSIVAL(ctr, AES_BLOCK_SIZE - 4, c);
+		s = aes_armv8_encrypt_block(key, vld1q_u8(ctr));
+		vst1q_u8(out, veorq_u8(vld1q_u8(in), s));
+	}
+
+	RSIVAL(ctr, AES_BLOCK_SIZE - 4, c);
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_cbc_mac_blocks(const AES_KEY *key,
+				     uint8_t X[AES_BLOCK_SIZE],
+				     const uint8_t *in,
+				     size_t num_blocks)
+{
+	uint8x16_t x = vld1q_u8(X);
+
+	while (num_blocks > 0) {
+		x = aes_armv8_encrypt_block(key, veorq_u8(x, vld1q_u8(in)));
+
+		in += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	vst1q_u8(X, x);
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_cbc_mac_blocks_multi(struct aes_cbc_mac_lane *lanes,
+					   size_t num_lanes,
+					   size_t num_blocks)
+{
+	uint8x16_t x[AES_BACKEND_MAX_LANES];
+	int rounds = lanes[0].key->rounds;
+	size_t l;
+	int i;
+
+	for (l = 0; l < num_lanes; l++) {
+		if (lanes[l].key->rounds != rounds) {
+			break;
+		}
+	}
+
+	if (l != num_lanes || num_lanes > AES_BACKEND_MAX_LANES) {
+		/*
+		 * Mixed key sizes are not worth optimizing
+		 */
+		for (l = 0; l < num_lanes; l++) {
+			aes_armv8_cbc_mac_blocks(lanes[l].key, lanes[l].X,
+						 lanes[l].in, num_blocks);
+			lanes[l].in += num_blocks * AES_BLOCK_SIZE;
+		}
+		return;
+	}
+
+	for (l = 0; l < num_lanes; l++) {
+		x[l] = vld1q_u8(lanes[l].X);
+	}
+
+	while (num_blocks > 0) {
+		for (l = 0; l < num_lanes; l++) {
+			x[l] = veorq_u8(x[l], vld1q_u8(lanes[l].in));
+			lanes[l].in += AES_BLOCK_SIZE;
+		}
+		for (i = 0; i < rounds - 1; i++) {
+			for (l = 0; l < num_lanes; l++) {
+				x[l] = vaeseq_u8(x[l],
+						 AES_ARMV8_RK(lanes[l].key, i));
+				x[l] = vaesmcq_u8(x[l]);
+			}
+		}
+		for (l = 0; l < num_lanes; l++) {
+			x[l] = vaeseq_u8(x[l],
+					 AES_ARMV8_RK(lanes[l].key, rounds - 1));
+			x[l] = veorq_u8(x[l],
+					AES_ARMV8_RK(lanes[l].key, rounds));
+		}
+		num_blocks -= 1;
+	}
+
+	for (l = 0; l < num_lanes; l++) {
+		vst1q_u8(lanes[l].X, x[l]);
+	}
+}
+
+/*
+ * A GHASH block as big endian 128-bit value,
+ * that's the bit reflected form of the field element.
+ */
+struct aes_armv8_u128 {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+/*
+ * An unreduced 256-bit product [x3:x2:x1:x0].
+ */
+struct aes_armv8_u256 {
+	uint64_t x[4];
+};
+
+static inline struct aes_armv8_u128 aes_armv8_load(const uint8_t *p)
+{
+	struct aes_armv8_u128 v = {
+		.hi = BVAL(p, 0),
+		.lo = BVAL(p, 8),
+	};
+
+	return v;
+}
+
+static inline void aes_armv8_store(uint8_t *p, struct aes_armv8_u128 v)
+{
+	RSBVAL(p, 0, v.hi);
+	RSBVAL(p, 8, v.lo);
+}
+
+AES_ARMV8_TARGET
+static inline void aes_armv8_clmul64(uint64_t a, uint64_t b,
+				     uint64_t *lo, uint64_t *hi)
+{
+	poly128_t r = vmull_p64((poly64_t)a, (poly64_t)b);
+	uint64x2_t v = vreinterpretq_u64_p128(r);
+
+	*lo = vgetq_lane_u64(v, 0);
+	*hi = vgetq_lane_u64(v, 1);
+}
+
+AES_ARMV8_TARGET
+static inline void aes_armv8_clmul(struct aes_armv8_u128 a,
+				   struct aes_armv8_u128 b,
+				   struct aes_armv8_u256 *r)
+{
+	uint64_t l0, h0, l1, h1, l2, h2, l3, h3;
+
+	aes_armv8_clmul64(a.lo, b.lo, &l0, &h0);
+	aes_armv8_clmul64(a.lo, b.hi, &l1, &h1);
+	aes_armv8_clmul64(a.hi, b.lo, &l2, &h2);
+	aes_armv8_clmul64(a.hi, b.hi, &l3, &h3);
+
+	r->x[0] ^= l0;
+	r->x[1] ^= h0 ^ l1 ^ l2;
+	r->x[2] ^= h1 ^ h2 ^ l3;
+	r->x[3] ^= h3;
+}
+
+/*
+ * Reduces a 256-bit product of two bit reflected values
+ * modulo the GHASH polynomial x^128 + x^7 + x^2 + x + 1.
+ *
+ * See "Intel Carry-Less Multiplication Instruction and its
+ * Usage for Computing the GCM Mode", algorithm 5.
+ */
+static inline struct aes_armv8_u128 aes_armv8_gf_reduce(
+	const struct aes_armv8_u256 *p)
+{
+	uint64_t x0 = p->x[0];
+	uint64_t x1 = p->x[1];
+	uint64_t x2 = p->x[2];
+	uint64_t x3 = p->x[3];
+	uint64_t d, e0, e1, f0, f1, g0, g1;
+	struct aes_armv8_u128 r;
+
+	/* shift left by one bit, because of the bit reflection */
+	x3 = (x3 << 1) | (x2 >> 63);
+	x2 = (x2 << 1) | (x1 >> 63);
+	x1 = (x1 << 1) | (x0 >> 63);
+	x0 = (x0 << 1);
+
+	d = x1 ^ (x0 << 63) ^ (x0 << 62) ^ (x0 << 57);
+
+	e1 = d >> 1;
+	e0 = (x0 >> 1) | (d << 63);
+	f1 = d >> 2;
+	f0 = (x0 >> 2) | (d << 62);
+	g1 = d >> 7;
+	g0 = (x0 >> 7) | (d << 57);
+
+	r.hi = x3 ^ d ^ e1 ^ f1 ^ g1;
+	r.lo = x2 ^ x0 ^ e0 ^ f0 ^ g0;
+
+	return r;
+}
+
+AES_ARMV8_TARGET
+static inline struct aes_armv8_u128 aes_armv8_gf_mul(struct aes_armv8_u128 a,
+						     struct aes_armv8_u128 b)
+{
+	struct aes_armv8_u256 p = { .x = { 0, } };
+
+	aes_armv8_clmul(a, b, &p);
+	return aes_armv8_gf_reduce(&p);
+}
+
+static inline struct aes_armv8_u128 aes_armv8_xor(struct aes_armv8_u128 a,
+						  struct aes_armv8_u128 b)
+{
+	struct aes_armv8_u128 r = {
+		.hi = a.hi ^ b.hi,
+		.lo = a.lo ^ b.lo,
+	};
+
+	return r;
+}
+
+AES_ARMV8_TARGET
+static void aes_armv8_ghash_blocks(const uint8_t H[AES_BLOCK_SIZE],
+				   uint8_t Y[AES_BLOCK_SIZE],
+				   const uint8_t *in,
+				   size_t num_blocks)
+{
+	struct aes_armv8_u128 h = aes_armv8_load(H);
+	struct aes_armv8_u128 y = aes_armv8_load(Y);
+
+	if (num_blocks >= 8) {
+		struct aes_armv8_u128 h2, h3, h4;
+
+		/*
+		 * Aggregated reduction: with the powers of H
+		 * we only need to reduce once per 4 blocks.
+		 */
+		h2 = aes_armv8_gf_mul(h, h);
+		h3 = aes_armv8_gf_mul(h2, h);
+		h4 = aes_armv8_gf_mul(h3, h);
+
+		while (num_blocks >= 4) {
+			struct aes_armv8_u256 p = { .x = { 0, } };
+			struct aes_armv8_u128 b0, b1, b2, b3;
+
+			b0 = aes_armv8_load(in + AES_BLOCK_SIZE * 0);
+			b1 = aes_armv8_load(in + AES_BLOCK_SIZE * 1);
+			b2 = aes_armv8_load(in + AES_BLOCK_SIZE * 2);
+			b3 = aes_armv8_load(in + AES_BLOCK_SIZE * 3);
+
+			aes_armv8_clmul(aes_armv8_xor(y, b0), h4, &p);
+			aes_armv8_clmul(b1, h3, &p);
+			aes_armv8_clmul(b2, h2, &p);
+			aes_armv8_clmul(b3, h, &p);
+
+			y = aes_armv8_gf_reduce(&p);
+
+			in += AES_BLOCK_SIZE * 4;
+			num_blocks -= 4;
+		}
+	}
+
+	while (num_blocks > 0) {
+		y = aes_armv8_gf_mul(aes_armv8_xor(y, aes_armv8_load(in)), h);
+
+		in += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	aes_armv8_store(Y, y);
+}
+
+const struct aes_backend_ops aes_backend_armv8 = {
+	.name			= "armv8",
+	.available		= aes_armv8_available,
+	.set_encrypt_key	= aes_backend_bytes_set_encrypt_key,
+	.set_decrypt_key	= aes_backend_bytes_set_decrypt_key,
+	.encrypt		= aes_armv8_encrypt,
+	.decrypt		= aes_armv8_decrypt,
+	.ctr32_encrypt_blocks	= aes_armv8_ctr32_encrypt_blocks,
+	.cbc_mac_blocks		= aes_armv8_cbc_mac_blocks,
+	.cbc_mac_blocks_multi	= aes_armv8_cbc_mac_blocks_multi,
+	.ghash_blocks		= aes_armv8_ghash_blocks,
+};
+
+#endif /* HAVE_AES_ACCEL_ARMV8 */
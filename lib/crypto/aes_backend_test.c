@@ -0,0 +1,397 @@
+/*
+   AES backend tests
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "replace.h"
+#include "../lib/util/samba_util.h"
+#include "../lib/torture/torture.h"
+#include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
+#include "lib/util/byteorder.h"
+
+bool torture_local_crypto_aes_cmac_128(struct torture_context *tctx);
+bool torture_local_crypto_aes_ccm_128(struct torture_context *tctx);
+bool torture_local_crypto_aes_gcm_128(struct torture_context *tctx);
+bool torture_local_crypto_aes_backends(struct torture_context *tctx);
+bool torture_local_crypto_aes_speed(struct torture_context *tctx);
+
+#define AES_BACKEND_TEST_BLOCKS 37
+
+static void aes_backend_test_fill(uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = random();
+	}
+}
+
+/*
+ * Compare the primitives of a backend with the
+ * portable C implementation.
+ */
+static bool aes_backend_test_compare(struct torture_context *tctx,
+				     const struct aes_backend_ops *ops)
+{
+	const struct aes_backend_ops *c = &aes_backend_c;
+	static const int bits[] = { 128, 192, 256 };
+	uint8_t userkey[32];
+	uint8_t in[AES_BLOCK_SIZE * AES_BACKEND_TEST_BLOCKS];
+	uint8_t out1[sizeof(in)];
+	uint8_t out2[sizeof(in)];
+	uint8_t X1[AES_BLOCK_SIZE];
+	uint8_t X2[AES_BLOCK_SIZE];
+	uint8_t H[AES_BLOCK_SIZE];
+	AES_KEY key1, key2;
+	size_t i, n, l;
+
+	for (i = 0; i < ARRAY_SIZE(bits); i++) {
+		int ret;
+
+		aes_backend_test_fill(userkey, sizeof(userkey));
+		aes_backend_test_fill(in, AES_BLOCK_SIZE);
+
+		ret = c->set_encrypt_key(userkey, bits[i], &key1);
+		torture_assert_int_equal(tctx, ret, 0, "c set_encrypt_key");
+		ret = ops->set_encrypt_key(userkey, bits[i], &key2);
+		torture_assert_int_equal(tctx, ret, 0, "set_encrypt_key");
+
+		c->encrypt(in, out1, &key1);
+		ops->encrypt(in, out2, &key2);
+		torture_assert_mem_equal(tctx, out1, out2, AES_BLOCK_SIZE,
+					 "encrypt");
+
+		ret = c->set_decrypt_key(userkey, bits[i], &key1);
+		torture_assert_int_equal(tctx, ret, 0, "c set_decrypt_key");
+		ret = ops->set_decrypt_key(userkey, bits[i], &key2);
+		torture_assert_int_equal(tctx, ret, 0, "set_decrypt_key");
+
+		c->decrypt(out1, out1, &key1);
+		ops->decrypt(out2, out2, &key2);
+		torture_assert_mem_equal(tctx, out1, in, AES_BLOCK_SIZE,
+					 "c decrypt");
+		torture_assert_mem_equal(tctx, out2, in, AES_BLOCK_SIZE,
+					 "decrypt");
+	}
+
+	aes_backend_test_fill(userkey, 16);
+	c->set_encrypt_key(userkey, 128, &key1);
+	ops->set_encrypt_key(userkey, 128, &key2);
+
+	for (n = 0; n <= AES_BACKEND_TEST_BLOCKS; n++) {
+		aes_backend_test_fill(in, sizeof(in));
+
+		/* make sure we test the 32-bit counter wrap */
+		aes_backend_test_fill(X1, sizeof(X1));
+		RSIVAL(X1, AES_BLOCK_SIZE - 4, UINT32_MAX - (n / 2));
+		memcpy(X2, X1, sizeof(X1));
+
+		c->ctr32_encrypt_blocks(&key1, X1, in, out1, n);
+		ops->ctr32_encrypt_blocks(&key2, X2, in, out2, n);
+		torture_assert_mem_equal(tctx, out1, out2, n * AES_BLOCK_SIZE,
+					 "ctr32_encrypt_blocks");
+		torture_assert_mem_equal(tctx, X1, X2, sizeof(X1),
+					 "ctr32_encrypt_blocks counter");
+
+		memcpy(out2, in, sizeof(in));
+		memcpy(X2, X1, sizeof(X1));
+		c->ctr32_encrypt_blocks(&key1, X1, in, out1, n);
+		ops->ctr32_encrypt_blocks(&key2, X2, out2, out2, n);
+		torture_assert_mem_equal(tctx, out1, out2, n * AES_BLOCK_SIZE,
+					 "ctr32_encrypt_blocks in place");
+
+		aes_backend_test_fill(X1, sizeof(X1));
+		memcpy(X2, X1, sizeof(X1));
+		c->cbc_mac_blocks(&key1, X1, in, n);
+		ops->cbc_mac_blocks(&key2, X2, in, n);
+		torture_assert_mem_equal(tctx, X1, X2, sizeof(X1),
+					 "cbc_mac_blocks");
+
+		for (l = 1; l <= AES_BACKEND_MAX_LANES; l++) {
+			struct aes_cbc_mac_lane lanes[AES_BACKEND_MAX_LANES];
+			uint8_t XL[AES_BACKEND_MAX_LANES][AES_BLOCK_SIZE];
+			size_t j;
+
+			aes_backend_test_fill(XL[0], sizeof(XL));
+			for (j = 0; j < l; j++) {
+				lanes[j] = (struct aes_cbc_mac_lane) {
+					.key = &key2,
+					.X = XL[j],
+					.in = in + (j * AES_BLOCK_SIZE),
+				};
+			}
+			memcpy(X1, XL[l - 1], sizeof(X1));
+
+			ops->cbc_mac_blocks_multi(lanes, l,
+				n - MIN(n, AES_BACKEND_MAX_LANES - 1));
+
+			c->cbc_mac_blocks(&key1, X1,
+					  in + ((l - 1) * AES_BLOCK_SIZE),
+					  n - MIN(n, AES_BACKEND_MAX_LANES - 1));
+			torture_assert_mem_equal(tctx, X1, XL[l - 1],
+						 sizeof(X1),
+						 "cbc_mac_blocks_multi");
+		}
+
+		aes_backend_test_fill(H, sizeof(H));
+		aes_backend_test_fill(X1, sizeof(X1));
+		memcpy(X2, X1, sizeof(X1));
+		c->ghash_blocks(H, X1, in, n);
+		ops->ghash_blocks(H, X2, in, n);
+		torture_assert_mem_equal(tctx, X1, X2, sizeof(X1),
+					 "ghash_blocks");
+	}
+
+	return true;
+}
+
+/*
+ * Compare aes_cmac_128_update_multi() with aes_cmac_128_update()
+ * for messages of different lengths, fed in random pieces.
+ */
+#define AES_CMAC_MULTI_TEST_NUM 7
+
+static bool aes_backend_test_cmac_multi(struct torture_context *tctx)
+{
+	struct aes_cmac_128_context ctx1[AES_CMAC_MULTI_TEST_NUM];
+	struct aes_cmac_128_context ctx2[AES_CMAC_MULTI_TEST_NUM];
+	struct aes_cmac_128_context *c2[AES_CMAC_MULTI_TEST_NUM];
+	const uint8_t *msg[AES_CMAC_MULTI_TEST_NUM];
+	size_t len[AES_CMAC_MULTI_TEST_NUM];
+	uint8_t buf[AES_CMAC_MULTI_TEST_NUM][AES_BLOCK_SIZE * 9];
+	uint8_t key[AES_BLOCK_SIZE];
+	uint8_t T1[AES_BLOCK_SIZE];
+	uint8_t T2[AES_BLOCK_SIZE];
+	size_t ofs[AES_CMAC_MULTI_TEST_NUM];
+	size_t i, n;
+
+	for (i = 0; i < AES_CMAC_MULTI_TEST_NUM; i++) {
+		aes_backend_test_fill(key, sizeof(key));
+		aes_backend_test_fill(buf[i], sizeof(buf[i]));
+		aes_cmac_128_init(&ctx1[i], key);
+		aes_cmac_128_init(&ctx2[i], key);
+		c2[i] = &ctx2[i];
+		ofs[i] = 0;
+	}
+
+	for (n = 0; n < 8; n++) {
+		for (i = 0; i < AES_CMAC_MULTI_TEST_NUM; i++) {
+			size_t max = sizeof(buf[i]) - ofs[i];
+
+			len[i] = random() % (AES_BLOCK_SIZE * 3);
+			len[i] = MIN(len[i], max);
+			if (n == 7) {
+				len[i] = max;
+			}
+			msg[i] = buf[i] + ofs[i];
+			ofs[i] += len[i];
+
+			aes_cmac_128_update(&ctx1[i], msg[i], len[i]);
+		}
+		aes_cmac_128_update_multi(c2, msg, len,
+					  AES_CMAC_MULTI_TEST_NUM);
+	}
+
+	for (i = 0; i < AES_CMAC_MULTI_TEST_NUM; i++) {
+		aes_cmac_128_final(&ctx1[i], T1);
+		aes_cmac_128_final(&ctx2[i], T2);
+		torture_assert_mem_equal(tctx, T1, T2, sizeof(T1),
+					 "aes_cmac_128_update_multi");
+	}
+
+	return true;
+}
+
+bool torture_local_crypto_aes_backends(struct torture_context *tctx)
+{
+	const struct aes_backend_ops * const *list = samba_aes_backend_list();
+	const struct aes_backend_ops *active = samba_aes_backend();
+	bool ret = true;
+	size_t i;
+
+	torture_comment(tctx, "Active AES backend: %s\n", active->name);
+
+	for (i = 0; list[i] != NULL; i++) {
+		const struct aes_backend_ops *ops = list[i];
+
+		if (!ops->available()) {
+			torture_comment(tctx, "AES backend %s not supported "
+					"by this cpu\n", ops->name);
+			continue;
+		}
+
+		torture_comment(tctx, "Testing AES backend %s\n", ops->name);
+
+		ret = aes_backend_test_compare(tctx, ops);
+		if (!ret) {
+			break;
+		}
+
+		samba_aes_backend_select(ops->name);
+
+		ret = torture_local_crypto_aes_cmac_128(tctx);
+		if (ret) {
+			ret = aes_backend_test_cmac_multi(tctx);
+		}
+		if (ret) {
+			ret = torture_local_crypto_aes_ccm_128(tctx);
+		}
+		if (ret) {
+			ret = torture_local_crypto_aes_gcm_128(tctx);
+		}
+
+		samba_aes_backend_select(active->name);
+
+		torture_assert(tctx, ret,
+			       talloc_asprintf(tctx, "AES mode tests failed "
+					       "with backend %s", ops->name));
+	}
+
+	return ret;
+}
+
+enum aes_speed_alg {
+	AES_SPEED_CMAC,
+	AES_SPEED_CMAC_MULTI,
+	AES_SPEED_CCM,
+	AES_SPEED_GCM,
+};
+
+static const struct {
+	enum aes_speed_alg alg;
+	const char *name;
+} aes_speed_algs[] = {
+	{ AES_SPEED_CMAC, "AES-128-CMAC" },
+	{ AES_SPEED_CMAC_MULTI, "AES-128-CMACx4" },
+	{ AES_SPEED_CCM, "AES-128-CCM" },
+	{ AES_SPEED_GCM, "AES-128-GCM" },
+};
+
+static void aes_speed_run(enum aes_speed_alg alg,
+			  const uint8_t key[AES_BLOCK_SIZE],
+			  const uint8_t nonce[AES_BLOCK_SIZE],
+			  uint8_t *buf, size_t len)
+{
+	uint8_t T[AES_BLOCK_SIZE];
+	union {
+		struct aes_cmac_128_context cmac;
+		struct aes_ccm_128_context ccm;
+		struct aes_gcm_128_context gcm;
+	} c;
+
+	struct aes_cmac_128_context cm[4];
+	struct aes_cmac_128_context *cmp[4];
+	const uint8_t *msg[4];
+	size_t msg_len[4];
+	size_t i;
+
+	switch (alg) {
+	case AES_SPEED_CMAC:
+		aes_cmac_128_init(&c.cmac, key);
+		aes_cmac_128_update(&c.cmac, buf, len);
+		aes_cmac_128_final(&c.cmac, T);
+		break;
+	case AES_SPEED_CMAC_MULTI:
+		/*
+		 * Like signing 4 pdus of a compound
+		 * or pipelined SMB2 reply.
+		 */
+		for (i = 0; i < ARRAY_SIZE(cm); i++) {
+			aes_cmac_128_init(&cm[i], key);
+			cmp[i] = &cm[i];
+			msg[i] = buf + (i * (len / ARRAY_SIZE(cm)));
+			msg_len[i] = len / ARRAY_SIZE(cm);
+		}
+		aes_cmac_128_update_multi(cmp, msg, msg_len, ARRAY_SIZE(cm));
+		for (i = 0; i < ARRAY_SIZE(cm); i++) {
+			aes_cmac_128_final(&cm[i], T);
+		}
+		break;
+	case AES_SPEED_CCM:
+		aes_ccm_128_init(&c.ccm, key, nonce, 32, len);
+		aes_ccm_128_update(&c.ccm, nonce, 16);
+		aes_ccm_128_update(&c.ccm, nonce, 16);
+		aes_ccm_128_update(&c.ccm, buf, len);
+		aes_ccm_128_crypt(&c.ccm, buf, len);
+		aes_ccm_128_digest(&c.ccm, T);
+		break;
+	case AES_SPEED_GCM:
+		aes_gcm_128_init(&c.gcm, key, nonce);
+		aes_gcm_128_updateA(&c.gcm, nonce, 16);
+		aes_gcm_128_updateA(&c.gcm, nonce, 16);
+		aes_gcm_128_crypt(&c.gcm, buf, len);
+		aes_gcm_128_updateC(&c.gcm, buf, len);
+		aes_gcm_128_digest(&c.gcm, T);
+		break;
+	}
+}
+
+/*
+ * Reports the throughput of the AES modes used for
+ * SMB3 signing and encryption with every backend.
+ */
+bool torture_local_crypto_aes_speed(struct torture_context *tctx)
+{
+	const struct aes_backend_ops * const *list = samba_aes_backend_list();
+	const struct aes_backend_ops *active = samba_aes_backend();
+	int msec = torture_setting_int(tctx, "aes_speed_msec", 100);
+	int size = torture_setting_int(tctx, "aes_speed_size", 65536);
+	uint8_t key[AES_BLOCK_SIZE];
+	uint8_t nonce[AES_BLOCK_SIZE];
+	uint8_t *buf;
+	size_t i, a;
+
+	buf = talloc_array(tctx, uint8_t, size);
+	torture_assert(tctx, buf != NULL, "no memory");
+
+	aes_backend_test_fill(key, sizeof(key));
+	aes_backend_test_fill(nonce, sizeof(nonce));
+	aes_backend_test_fill(buf, size);
+
+	for (i = 0; list[i] != NULL; i++) {
+		const struct aes_backend_ops *ops = list[i];
+
+		if (!ops->available()) {
+			continue;
+		}
+
+		samba_aes_backend_select(ops->name);
+
+		for (a = 0; a < ARRAY_SIZE(aes_speed_algs); a++) {
+			struct timeval tv = timeval_current();
+			uint64_t bytes = 0;
+			double secs;
+
+			do {
+				aes_speed_run(aes_speed_algs[a].alg,
+					      key, nonce, buf, size);
+				bytes += size;
+				secs = timeval_elapsed(&tv);
+			} while (secs * 1000 < msec);
+
+			torture_comment(tctx, "%-8s %-14s %8.3f GB/s "
+					"(%d byte buffers)\n",
+					ops->name, aes_speed_algs[a].name,
+					bytes / secs / 1e9, size);
+		}
+	}
+
+	samba_aes_backend_select(active->name);
+
+	TALLOC_FREE(buf);
+	return true;
+}
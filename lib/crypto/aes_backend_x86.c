@@ -0,0 +1,412 @@
+/*
+   AES backend using the x86 AES-NI and PCLMULQDQ instructions
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
+
+#ifdef HAVE_AES_ACCEL_X86
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+/*
+ * We don't require any special compiler flags for the
+ * whole build, only the functions in this file are
+ * compiled for the instruction set extensions.
+ * They are only called after aes_x86_available()
+ * returned true.
+ */
+#define AES_X86_TARGET __attribute__((target("sse2,ssse3,aes,pclmul")))
+
+/*
+ * The number of blocks processed in parallel,
+ * this hides the latency of aesenc and pclmulqdq.
+ */
+#define AES_X86_PARALLEL 4
+
+static bool aes_x86_available(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int needed = bit_AES | bit_PCLMUL | bit_SSSE3;
+	int ok;
+
+	ok = __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+	if (ok == 0) {
+		return false;
+	}
+
+	if ((ecx & needed) != needed) {
+		return false;
+	}
+
+	return true;
+}
+
+#define AES_X86_RK(k, i) \
+	_mm_loadu_si128(((const __m128i *)(const void *)(k)->key) + (i))
+
+AES_X86_TARGET
+static inline __m128i aes_x86_encrypt_block(const AES_KEY *key, __m128i s)
+{
+	int i;
+
+	s = _mm_xor_si128(s, AES_X86_RK(key, 0));
+	for (i = 1; i < key->rounds; i++) {
+		s = _mm_aesenc_si128(s, AES_X86_RK(key, i));
+	}
+	return _mm_aesenclast_si128(s, AES_X86_RK(key, key->rounds));
+}
+
+AES_X86_TARGET
+static void aes_x86_encrypt(const unsigned char *in, unsigned char *out,
+			    const AES_KEY *key)
+{
+	__m128i s = _mm_loadu_si128((const __m128i *)(const void *)in);
+
+	s = aes_x86_encrypt_block(key, s);
+	_mm_storeu_si128((__m128i *)(void *)out, s);
+}
+
+AES_X86_TARGET
+static void aes_x86_decrypt(const unsigned char *in, unsigned char *out,
+			    const AES_KEY *key)
+{
+	__m128i s = _mm_loadu_si128((const __m128i *)(const void *)in);
+	int i;
+
+	s = _mm_xor_si128(s, AES_X86_RK(key, 0));
+	for (i = 1; i < key->rounds; i++) {
+		s = _mm_aesdec_si128(s, AES_X86_RK(key, i));
+	}
+	s = _mm_aesdeclast_si128(s, AES_X86_RK(key, key->rounds));
+	_mm_storeu_si128((__m128i *)(void *)out, s);
+}
+
+/*
+ * Reverses the byte order of a block, this turns the
+ * big endian counter of CTR mode and the bit reflected
+ * GHASH representation into a native 128-bit value.
+ */
+AES_X86_TARGET
+static inline __m128i aes_x86_bswap(__m128i v)
+{
+	const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					  8, 9, 10, 11, 12, 13, 14, 15);
+
+	return _mm_shuffle_epi8(v, mask);
+}
+
+AES_X86_TARGET
+static void aes_x86_ctr32_encrypt_blocks(const AES_KEY *key,
+					 uint8_t ctr[AES_BLOCK_SIZE],
+					 const uint8_t *in, uint8_t *out,
+					 size_t num_blocks)
+{
+	const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+	__m128i c;
+	int i;
+
+	/*
+	 * After the byte swap the 32-bit counter
+	 * is in the lowest 32 bits.
+	 */
+	c = aes_x86_bswap(_mm_loadu_si128((const __m128i *)(void *)ctr));
+
+	while (num_blocks >= AES_X86_PARALLEL) {
+		__m128i s[AES_X86_PARALLEL];
+		int j;
+
+		for (j = 0; j < AES_X86_PARALLEL; j++) {
+			c = _mm_add_epi32(c, one);
+			s[j] = aes_x86_bswap(c);
+			s[j] = _mm_xor_si128(s[j], AES_X86_RK(key, 0));
+		}
+		for (i = 1; i < key->rounds; i++) {
+			__m128i rk = AES_X86_RK(key, i);
+
+			for (j = 0; j < AES_X86_PARALLEL; j++) {
+				s[j] = _mm_aesenc_si128(s[j], rk);
+			}
+		}
+		for (j = 0; j < AES_X86_PARALLEL; j++) {
+			const __m128i *ip = (const __m128i *)(const void *)in;
+			__m128i *op = (__m128i *)(void *)out;
+			__m128i m;
+
+			s[j] = _mm_aesenclast_si128(s[j],
+						    AES_X86_RK(key, key->rounds));
+			m = _mm_loadu_si128(ip + j);
+			_mm_storeu_si128(op + j, _mm_xor_si128(m, s[j]));
+		}
+
+		in += AES_BLOCK_SIZE * AES_X86_PARALLEL;
+		out += AES_BLOCK_SIZE * AES_X86_PARALLEL;
+		num_blocks -= AES_X86_PARALLEL;
+	}
+
+	while (num_blocks > 0) {
+		__m128i s, m;
+
+		c = _mm_add_epi32(c, one);
+		s = aes_x86_encrypt_block(key, aes_x86_bswap(c));
+		m = _mm_loadu_si128((const __m128i *)(const void *)in);
+		_mm_storeu_si128((__m128i *)(void *)out, _mm_xor_si128(m, s));
+
+		in += AES_BLOCK_SIZE;
+		out += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	_mm_storeu_si128((__m128i *)(void *)ctr, aes_x86_bswap(c));
+}
+
+AES_X86_TARGET
+static void aes_x86_cbc_mac_blocks(const AES_KEY *key,
+				   uint8_t X[AES_BLOCK_SIZE],
+				   const uint8_t *in,
+				   size_t num_blocks)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)(void *)X);
+
+	while (num_blocks > 0) {
+		__m128i m = _mm_loadu_si128((const __m128i *)(const void *)in);
+
+		x = aes_x86_encrypt_block(key, _mm_xor_si128(x, m));
+
+		in += AES_BLOCK_SIZE;
+		num_blocks -= 1;
+	}
+
+	_mm_storeu_si128((__m128i *)(void *)X, x);
+}
+
+AES_X86_TARGET
+static void aes_x86_cbc_mac_blocks_multi(struct aes_cbc_mac_lane *lanes,
+					 size_t num_lanes,
+					 size_t num_blocks)
+{
+	__m128i x[AES_BACKEND_MAX_LANES];
+	int rounds = lanes[0].key->rounds;
+	size_t l;
+	int i;
+
+	for (l = 0; l < num_lanes; l++) {
+		if (lanes[l].key->rounds != rounds) {
+			break;
+		}
+	}
+
+	if (l != num_lanes || num_lanes > AES_BACKEND_MAX_LANES) {
+		/*
+		 * Mixed key sizes are not worth optimizing
+		 */
+		for (l = 0; l < num_lanes; l++) {
+			aes_x86_cbc_mac_blocks(lanes[l].key, lanes[l].X,
+					       lanes[l].in, num_blocks);
+			lanes[l].in += num_blocks * AES_BLOCK_SIZE;
+		}
+		return;
+	}
+
+	for (l = 0; l < num_lanes; l++) {
+		x[l] = _mm_loadu_si128((const __m128i *)(void *)lanes[l].X);
+	}
+
+	while (num_blocks > 0) {
+		for (l = 0; l < num_lanes; l++) {
+			const __m128i *ip = (const __m128i *)(const void *)
+					    lanes[l].in;
+
+			x[l] = _mm_xor_si128(x[l], _mm_loadu_si128(ip));
+			x[l] = _mm_xor_si128(x[l], AES_X86_RK(lanes[l].key, 0));
+			lanes[l].in += AES_BLOCK_SIZE;
+		}
+		for (i = 1; i < rounds; i++) {
+			for (l = 0; l < num_lanes; l++) {
+				x[l] = _mm_aesenc_si128(x[l],
+						AES_X86_RK(lanes[l].key, i));
+			}
+		}
+		for (l = 0; l < num_lanes; l++) {
+			x[l] = _mm_aesenclast_si128(x[l],
+					AES_X86_RK(lanes[l].key, rounds));
+		}
+		num_blocks -= 1;
+	}
+
+	for (l = 0; l < num_lanes; l++) {
+		_mm_storeu_si128((__m128i *)(void *)lanes[l].X, x[l]);
+	}
+}
+
+/*
+ * Carry-less multiplication of two 128-bit values
+ * into an unreduced 256-bit result [hi:lo].
+ */
+AES_X86_TARGET
+static inline void aes_x86_clmul(__m128i a, __m128i b,
+				 __m128i *lo, __m128i *hi)
+{
+	__m128i t0, t1, t2, t3;
+
+	t0 = _mm_clmulepi64_si128(a, b, 0x00);
+	t1 = _mm_clmulepi64_si128(a, b, 0x10);
+	t2 = _mm_clmulepi64_si128(a, b, 0x01);
+	t3 = _mm_clmulepi64_si128(a, b, 0x11);
+
+	t1 = _mm_xor_si128(t1, t2);
+	*lo = _mm_xor_si128(t0, _mm_slli_si128(t1, 8));
+	*hi = _mm_xor_si128(t3, _mm_srli_si128(t1, 8));
+}
+
+/*
+ * Reduces a 256-bit product of two bit reflected values
+ * modulo the GHASH polynomial x^128 + x^7 + x^2 + x + 1.
+ *
+ * See "Intel Carry-Less Multiplication Instruction and its
+ * Usage for Computing the GCM Mode", algorithm 5.
+ */
+AES_X86_TARGET
+static inline __m128i aes_x86_gf_reduce(__m128i lo, __m128i hi)
+{
+	__m128i t7, t8, t9, t2, t4, t5;
+
+	/* shift [hi:lo] left by one bit, because of the bit reflection */
+	t7 = _mm_srli_epi32(lo, 31);
+	t8 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	lo = _mm_or_si128(lo, t7);
+	hi = _mm_or_si128(hi, t8);
+	hi = _mm_or_si128(hi, t9);
+
+	/* first phase of the reduction */
+	t7 = _mm_slli_epi32(lo, 31);
+	t8 = _mm_slli_epi32(lo, 30);
+	t9 = _mm_slli_epi32(lo, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	lo = _mm_xor_si128(lo, t7);
+
+	/* second phase of the reduction */
+	t2 = _mm_srli_epi32(lo, 1);
+	t4 = _mm_srli_epi32(lo, 2);
+	t5 = _mm_srli_epi32(lo, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	lo = _mm_xor_si128(lo, t2);
+
+	return _mm_xor_si128(hi, lo);
+}
+
+AES_X86_TARGET
+static inline __m128i aes_x86_gf_mul(__m128i a, __m128i b)
+{
+	__m128i lo, hi;
+
+	aes_x86_clmul(a, b, &lo, &hi);
+	return aes_x86_gf_reduce(lo, hi);
+}
+
+AES_X86_TARGET
+static void aes_x86_ghash_blocks(const uint8_t H[AES_BLOCK_SIZE],
+				 uint8_t Y[AES_BLOCK_SIZE],
+				 const uint8_t *in,
+				 size_t num_blocks)
+{
+	const __m128i *ip = (const __m128i *)(const void *)in;
+	__m128i h, y;
+
+	h = aes_x86_bswap(_mm_loadu_si128((const __m128i *)(const void *)H));
+	y = aes_x86_bswap(_mm_loadu_si128((const __m128i *)(void *)Y));
+
+	if (num_blocks >= AES_X86_PARALLEL * 2) {
+		__m128i h2, h3, h4;
+
+		/*
+		 * Aggregated reduction: with the powers of H
+		 * we only need to reduce once per 4 blocks.
+		 *
+		 * Y' = (Y ^ B0) * H^4 ^ B1 * H^3 ^ B2 * H^2 ^ B3 * H
+		 */
+		h2 = aes_x86_gf_mul(h, h);
+		h3 = aes_x86_gf_mul(h2, h);
+		h4 = aes_x86_gf_mul(h3, h);
+
+		while (num_blocks >= AES_X86_PARALLEL) {
+			__m128i b0, b1, b2, b3;
+			__m128i lo, hi, l, r;
+
+			b0 = aes_x86_bswap(_mm_loadu_si128(ip + 0));
+			b1 = aes_x86_bswap(_mm_loadu_si128(ip + 1));
+			b2 = aes_x86_bswap(_mm_loadu_si128(ip + 2));
+			b3 = aes_x86_bswap(_mm_loadu_si128(ip + 3));
+
+			aes_x86_clmul(_mm_xor_si128(y, b0), h4, &lo, &hi);
+			aes_x86_clmul(b1, h3, &l, &r);
+			lo = _mm_xor_si128(lo, l);
+			hi = _mm_xor_si128(hi, r);
+			aes_x86_clmul(b2, h2, &l, &r);
+			lo = _mm_xor_si128(lo, l);
+			hi = _mm_xor_si128(hi, r);
+			aes_x86_clmul(b3, h, &l, &r);
+			lo = _mm_xor_si128(lo, l);
+			hi = _mm_xor_si128(hi, r);
+
+			y = aes_x86_gf_reduce(lo, hi);
+
+			ip += AES_X86_PARALLEL;
+			num_blocks -= AES_X86_PARALLEL;
+		}
+	}
+
+	while (num_blocks > 0) {
+		__m128i b = aes_x86_bswap(_mm_loadu_si128(ip));
+
+		y = aes_x86_gf_mul(_mm_xor_si128(y, b), h);
+
+		ip += 1;
+		num_blocks -= 1;
+	}
+
+	_mm_storeu_si128((__m128i *)(void *)Y, aes_x86_bswap(y));
+}
+
+const struct aes_backend_ops aes_backend_x86 = {
+	.name			= "aesni",
+	.available		= aes_x86_available,
+	.set_encrypt_key	= aes_backend_bytes_set_encrypt_key,
+	.set_decrypt_key	= aes_backend_bytes_set_decrypt_key,
+	.encrypt		= aes_x86_encrypt,
+	.decrypt		= aes_x86_decrypt,
+	.ctr32_encrypt_blocks	= aes_x86_ctr32_encrypt_blocks,
+	.cbc_mac_blocks		= aes_x86_cbc_mac_blocks,
+	.cbc_mac_blocks_multi	= aes_x86_cbc_mac_blocks_multi,
+	.ghash_blocks		= aes_x86_ghash_blocks,
+};
+
+#endif /* HAVE_AES_ACCEL_X86 */
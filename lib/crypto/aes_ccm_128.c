@@ -19,6 +19,7 @@
 
 #include "replace.h"
 #include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
 #include "lib/util/byteorder.h"
 
 #define M_ ((AES_CCM_128_M - 2) / 2)
@@ -113,12 +114,15 @@ void aes_ccm_128_update(struct aes_ccm_128_context *ctx,
 		ctx->B_i_ofs = 0;
 	}
 
-	while (v_len >= AES_BLOCK_SIZE) {
-		aes_block_xor(ctx->X_i, v, ctx->B_i);
-		AES_encrypt(ctx->B_i, ctx->X_i, &ctx->aes_key);
-		v += AES_BLOCK_SIZE;
-		v_len -= AES_BLOCK_SIZE;
-		*remain -= AES_BLOCK_SIZE;
+	if (v_len >= AES_BLOCK_SIZE) {
+		size_t num_blocks = v_len / AES_BLOCK_SIZE;
+		size_t n = num_blocks * AES_BLOCK_SIZE;
+
+		samba_aes_backend()->cbc_mac_blocks(&ctx->aes_key, ctx->X_i,
+						    v, num_blocks);
+		v += n;
+		v_len -= n;
+		*remain -= n;
 	}
 
 	if (v_len > 0) {
@@ -152,22 +156,39 @@ static inline void aes_ccm_128_S_i(struct aes_ccm_128_context *ctx,
 void aes_ccm_128_crypt(struct aes_ccm_128_context *ctx,
 		       uint8_t *m, size_t m_len)
 {
-	while (m_len > 0) {
-		if (ctx->S_i_ofs == AES_BLOCK_SIZE) {
-			ctx->S_i_ctr += 1;
-			aes_ccm_128_S_i(ctx, ctx->S_i, ctx->S_i_ctr);
-			ctx->S_i_ofs = 0;
-		}
-
-		if (likely(ctx->S_i_ofs == 0 && m_len >= AES_BLOCK_SIZE)) {
-			aes_block_xor(m, ctx->S_i, m);
-			m += AES_BLOCK_SIZE;
-			m_len -= AES_BLOCK_SIZE;
-			ctx->S_i_ctr += 1;
-			aes_ccm_128_S_i(ctx, ctx->S_i, ctx->S_i_ctr);
-			continue;
-		}
+	/*
+	 * Use up the remaining key stream of S_i
+	 */
+	while (ctx->S_i_ofs < AES_BLOCK_SIZE && m_len > 0) {
+		m[0] ^= ctx->S_i[ctx->S_i_ofs];
+		m += 1;
+		m_len -= 1;
+		ctx->S_i_ofs += 1;
+	}
+
+	if (m_len >= AES_BLOCK_SIZE) {
+		size_t num_blocks = m_len / AES_BLOCK_SIZE;
+
+		RSIVAL(ctx->A_i, (AES_BLOCK_SIZE - AES_CCM_128_L),
+		       ctx->S_i_ctr);
+		samba_aes_backend()->ctr32_encrypt_blocks(&ctx->aes_key,
+							  ctx->A_i,
+							  m, m,
+							  num_blocks);
+		ctx->S_i_ctr += num_blocks;
+		m += num_blocks * AES_BLOCK_SIZE;
+		m_len -= num_blocks * AES_BLOCK_SIZE;
+	}
 
+	if (m_len == 0) {
+		return;
+	}
+
+	ctx->S_i_ctr += 1;
+	aes_ccm_128_S_i(ctx, ctx->S_i, ctx->S_i_ctr);
+	ctx->S_i_ofs = 0;
+
+	while (m_len > 0) {
 		m[0] ^= ctx->S_i[ctx->S_i_ofs];
 		m += 1;
 		m_len -= 1;
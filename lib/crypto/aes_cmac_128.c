@@ -20,6 +20,7 @@
 
 #include "replace.h"
 #include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
 
 static const uint8_t const_Zero[] = {
 	0x00, 0x00, 0x00, 0x00,  0x00, 0x00, 0x00, 0x00,
@@ -82,14 +83,16 @@ void aes_cmac_128_update(struct aes_cmac_128_context *ctx,
 	/*
 	 * now checksum everything but the last block
 	 */
-	aes_block_xor(ctx->X, ctx->last, ctx->Y);
-	AES_encrypt(ctx->Y, ctx->X, &ctx->aes_key);
-
-	while (msg_len > AES_BLOCK_SIZE) {
-		aes_block_xor(ctx->X, msg, ctx->Y);
-		AES_encrypt(ctx->Y, ctx->X, &ctx->aes_key);
-		msg += AES_BLOCK_SIZE;
-		msg_len -= AES_BLOCK_SIZE;
+	samba_aes_backend()->cbc_mac_blocks(&ctx->aes_key, ctx->X,
+					    ctx->last, 1);
+
+	if (msg_len > AES_BLOCK_SIZE) {
+		size_t num_blocks = (msg_len - 1) / AES_BLOCK_SIZE;
+
+		samba_aes_backend()->cbc_mac_blocks(&ctx->aes_key, ctx->X,
+						    msg, num_blocks);
+		msg += num_blocks * AES_BLOCK_SIZE;
+		msg_len -= num_blocks * AES_BLOCK_SIZE;
 	}
 
 	/*
@@ -101,6 +104,129 @@ void aes_cmac_128_update(struct aes_cmac_128_context *ctx,
 	ctx->last_len = msg_len;
 }
 
+/*
+ * This is the same as calling aes_cmac_128_update()
+ * for each context, but the AES operations of up to
+ * AES_BACKEND_MAX_LANES contexts are interleaved.
+ */
+void aes_cmac_128_update_multi(struct aes_cmac_128_context * const *ctx,
+			       const uint8_t * const *msg,
+			       const size_t *msg_len,
+			       size_t num)
+{
+	const struct aes_backend_ops *ops = samba_aes_backend();
+	size_t ofs;
+
+	for (ofs = 0; ofs < num; ofs += AES_BACKEND_MAX_LANES) {
+		struct aes_cbc_mac_lane lanes[AES_BACKEND_MAX_LANES];
+		struct aes_cmac_128_context *lctx[AES_BACKEND_MAX_LANES];
+		size_t remaining[AES_BACKEND_MAX_LANES];
+		bool in_last[AES_BACKEND_MAX_LANES];
+		const uint8_t *m[AES_BACKEND_MAX_LANES];
+		size_t len[AES_BACKEND_MAX_LANES];
+		size_t n = MIN(num - ofs, AES_BACKEND_MAX_LANES);
+		size_t num_lanes = 0;
+		size_t i;
+
+		for (i = 0; i < n; i++) {
+			struct aes_cmac_128_context *c = ctx[ofs + i];
+			const uint8_t *p = msg[ofs + i];
+			size_t l = msg_len[ofs + i];
+
+			if (l == 0) {
+				continue;
+			}
+
+			if (c->last_len < AES_BLOCK_SIZE) {
+				size_t copy = MIN(AES_BLOCK_SIZE - c->last_len,
+						  l);
+
+				memcpy(&c->last[c->last_len], p, copy);
+				p += copy;
+				l -= copy;
+				c->last_len += copy;
+			}
+
+			if (l == 0) {
+				/* if it is still the last block, we are done */
+				continue;
+			}
+
+			/*
+			 * The buffered last block is no longer the last
+			 * one, it gets processed together with the
+			 * other lanes below.
+			 */
+			lanes[num_lanes] = (struct aes_cbc_mac_lane) {
+				.key = &c->aes_key,
+				.X = c->X,
+				.in = c->last,
+			};
+			lctx[num_lanes] = c;
+			remaining[num_lanes] = 1;
+			in_last[num_lanes] = true;
+			m[num_lanes] = p;
+			len[num_lanes] = l;
+			num_lanes += 1;
+		}
+
+		while (num_lanes > 0) {
+			size_t blocks = remaining[0];
+
+			for (i = 1; i < num_lanes; i++) {
+				blocks = MIN(blocks, remaining[i]);
+			}
+
+			if (blocks > 0) {
+				ops->cbc_mac_blocks_multi(lanes, num_lanes,
+							  blocks);
+			}
+
+			i = 0;
+			while (i < num_lanes) {
+				size_t more;
+
+				remaining[i] -= blocks;
+				if (remaining[i] > 0) {
+					i++;
+					continue;
+				}
+
+				/*
+				 * Everything but the last block of the
+				 * message gets checksummed directly.
+				 */
+				more = (len[i] - 1) / AES_BLOCK_SIZE;
+				if (in_last[i] && more > 0) {
+					lanes[i].in = m[i];
+					remaining[i] = more;
+					in_last[i] = false;
+					m[i] += more * AES_BLOCK_SIZE;
+					len[i] -= more * AES_BLOCK_SIZE;
+					i++;
+					continue;
+				}
+
+				/*
+				 * copy the last block, it will be processed
+				 * in aes_cmac_128_final().
+				 */
+				ZERO_STRUCT(lctx[i]->last);
+				memcpy(lctx[i]->last, m[i], len[i]);
+				lctx[i]->last_len = len[i];
+
+				num_lanes -= 1;
+				lanes[i] = lanes[num_lanes];
+				lctx[i] = lctx[num_lanes];
+				remaining[i] = remaining[num_lanes];
+				in_last[i] = in_last[num_lanes];
+				m[i] = m[num_lanes];
+				len[i] = len[num_lanes];
+			}
+		}
+	}
+}
+
 void aes_cmac_128_final(struct aes_cmac_128_context *ctx,
 			uint8_t T[AES_BLOCK_SIZE])
 {
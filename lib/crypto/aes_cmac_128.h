@@ -41,6 +41,10 @@ void aes_cmac_128_init(struct aes_cmac_128_context *ctx,
 		       const uint8_t K[AES_BLOCK_SIZE]);
 void aes_cmac_128_update(struct aes_cmac_128_context *ctx,
 			 const uint8_t *_msg, size_t _msg_len);
+void aes_cmac_128_update_multi(struct aes_cmac_128_context * const *ctx,
+			       const uint8_t * const *msg,
+			       const size_t *msg_len,
+			       size_t num);
 void aes_cmac_128_final(struct aes_cmac_128_context *ctx,
 			uint8_t T[AES_BLOCK_SIZE]);
 
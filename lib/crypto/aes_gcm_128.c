@@ -19,6 +19,7 @@
 
 #include "replace.h"
 #include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aes_backend.h"
 #include "lib/util/byteorder.h"
 
 static inline void aes_gcm_128_inc32(uint8_t inout[AES_BLOCK_SIZE])
@@ -30,44 +31,10 @@ static inline void aes_gcm_128_inc32(uint8_t inout[AES_BLOCK_SIZE])
 	RSIVAL(inout, AES_BLOCK_SIZE - 4, v);
 }
 
-static inline void aes_gcm_128_mul(const uint8_t x[AES_BLOCK_SIZE],
-				   const uint8_t y[AES_BLOCK_SIZE],
-				   uint8_t v[AES_BLOCK_SIZE],
-				   uint8_t z[AES_BLOCK_SIZE])
-{
-	uint8_t i;
-	/* 11100001 || 0^120 */
-	static const uint8_t r[AES_BLOCK_SIZE] = {
-		0xE1, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00,
-	};
-
-	memset(z, 0, AES_BLOCK_SIZE);
-	memcpy(v, y, AES_BLOCK_SIZE);
-
-	for (i = 0; i < AES_BLOCK_SIZE; i++) {
-		uint8_t mask;
-		for (mask = 0x80; mask != 0 ; mask >>= 1) {
-			uint8_t v_lsb = v[AES_BLOCK_SIZE-1] & 1;
-			if (x[i] & mask) {
-				aes_block_xor(z, v, z);
-			}
-
-			aes_block_rshift(v, v);
-			if (v_lsb != 0) {
-				aes_block_xor(v, r, v);
-			}
-		}
-	}
-}
-
 static inline void aes_gcm_128_ghash_block(struct aes_gcm_128_context *ctx,
 					   const uint8_t in[AES_BLOCK_SIZE])
 {
-	aes_block_xor(ctx->Y, in, ctx->y.block);
-	aes_gcm_128_mul(ctx->y.block, ctx->H, ctx->v.block, ctx->Y);
+	samba_aes_backend()->ghash_blocks(ctx->H, ctx->Y, in, 1);
 }
 
 void aes_gcm_128_init(struct aes_gcm_128_context *ctx,
@@ -116,10 +83,13 @@ static inline void aes_gcm_128_update_tmp(struct aes_gcm_128_context *ctx,
 		tmp->ofs = 0;
 	}
 
-	while (v_len >= AES_BLOCK_SIZE) {
-		aes_gcm_128_ghash_block(ctx, v);
-		v += AES_BLOCK_SIZE;
-		v_len -= AES_BLOCK_SIZE;
+	if (v_len >= AES_BLOCK_SIZE) {
+		size_t num_blocks = v_len / AES_BLOCK_SIZE;
+
+		samba_aes_backend()->ghash_blocks(ctx->H, ctx->Y,
+						  v, num_blocks);
+		v += num_blocks * AES_BLOCK_SIZE;
+		v_len -= num_blocks * AES_BLOCK_SIZE;
 	}
 
 	if (v_len == 0) {
@@ -154,22 +124,37 @@ static inline void aes_gcm_128_crypt_tmp(struct aes_gcm_128_context *ctx,
 {
 	tmp->total += m_len;
 
-	while (m_len > 0) {
-		if (tmp->ofs == AES_BLOCK_SIZE) {
-			aes_gcm_128_inc32(ctx->CB);
-			AES_encrypt(ctx->CB, tmp->block, &ctx->aes_key);
-			tmp->ofs = 0;
-		}
-
-		if (likely(tmp->ofs == 0 && m_len >= AES_BLOCK_SIZE)) {
-			aes_block_xor(m, tmp->block, m);
-			m += AES_BLOCK_SIZE;
-			m_len -= AES_BLOCK_SIZE;
-			aes_gcm_128_inc32(ctx->CB);
-			AES_encrypt(ctx->CB, tmp->block, &ctx->aes_key);
-			continue;
-		}
+	/*
+	 * Use up the remaining key stream of the last block,
+	 * ctx->CB is the counter that generated tmp->block.
+	 */
+	while (tmp->ofs < AES_BLOCK_SIZE && m_len > 0) {
+		m[0] ^= tmp->block[tmp->ofs];
+		m += 1;
+		m_len -= 1;
+		tmp->ofs += 1;
+	}
+
+	if (m_len >= AES_BLOCK_SIZE) {
+		size_t num_blocks = m_len / AES_BLOCK_SIZE;
+
+		samba_aes_backend()->ctr32_encrypt_blocks(&ctx->aes_key,
+							  ctx->CB,
+							  m, m,
+							  num_blocks);
+		m += num_blocks * AES_BLOCK_SIZE;
+		m_len -= num_blocks * AES_BLOCK_SIZE;
+	}
 
+	if (m_len == 0) {
+		return;
+	}
+
+	aes_gcm_128_inc32(ctx->CB);
+	AES_encrypt(ctx->CB, tmp->block, &ctx->aes_key);
+	tmp->ofs = 0;
+
+	while (m_len > 0) {
 		m[0] ^= tmp->block[tmp->ofs];
 		m += 1;
 		m_len -= 1;
@@ -31,7 +31,7 @@ struct aes_gcm_128_context {
 		size_t ofs;
 		size_t total;
 		uint8_t block[AES_BLOCK_SIZE];
-	} A, C, c, v, y;
+	} A, C, c;
 
 	uint8_t H[AES_BLOCK_SIZE];
 	uint8_t J0[AES_BLOCK_SIZE];
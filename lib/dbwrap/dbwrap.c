@@ -23,6 +23,7 @@
 #include "dbwrap/dbwrap.h"
 #include "dbwrap/dbwrap_private.h"
 #include "lib/util/util_tdb.h"
+#include "lib/util/tsort.h"
 
 /*
  * Fall back using fetch if no genuine exists operation is provided
@@ -387,6 +388,170 @@ NTSTATUS dbwrap_parse_record(struct db_context *db, TDB_DATA key,
 	return db->parse_record(db, key, parser, private_data);
 }
 
+struct dbwrap_parse_multi_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+	size_t idx;
+};
+
+static void dbwrap_parse_multi_parser(TDB_DATA key, TDB_DATA data,
+				      void *private_data)
+{
+	struct dbwrap_parse_multi_state *state =
+		(struct dbwrap_parse_multi_state *)private_data;
+
+	state->parser(state->idx, key, data, state->private_data);
+}
+
+static void dbwrap_null_multi_parser(size_t idx, TDB_DATA key, TDB_DATA val,
+				     void *private_data)
+{
+	return;
+}
+
+/*
+ * Fallback for backends without a batch lookup: one parse_record per key
+ */
+static NTSTATUS dbwrap_fallback_parse_records_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data)
+{
+	struct dbwrap_parse_multi_state state = {
+		.parser = parser, .private_data = private_data
+	};
+	size_t i;
+
+	for (i=0; i<num_keys; i++) {
+		NTSTATUS status;
+
+		state.idx = i;
+		status = db->parse_record(db, keys[i],
+					  dbwrap_parse_multi_parser, &state);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+			continue;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+	return NT_STATUS_OK;
+}
+
+NTSTATUS dbwrap_parse_records_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data)
+{
+	if (parser == NULL) {
+		parser = dbwrap_null_multi_parser;
+	}
+	if (db->parse_records_multi == NULL) {
+		return dbwrap_fallback_parse_records_multi(
+			db, keys, num_keys, parser, private_data);
+	}
+	return db->parse_records_multi(db, keys, num_keys, parser,
+				       private_data);
+}
+
+struct dbwrap_sorted_key {
+	TDB_DATA key;
+	size_t idx;
+};
+
+static int dbwrap_sorted_key_cmp(const struct dbwrap_sorted_key *k1,
+				 const struct dbwrap_sorted_key *k2)
+{
+	int cmp;
+
+	cmp = memcmp(k1->key.dptr, k2->key.dptr,
+		     MIN(k1->key.dsize, k2->key.dsize));
+	if (cmp != 0) {
+		return cmp;
+	}
+	if (k1->key.dsize != k2->key.dsize) {
+		return (k1->key.dsize < k2->key.dsize) ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Fallback for backends without a batch lock: fetch_locked the records
+ * one by one. They are locked in the order of their keys, so that two
+ * processes locking overlapping sets of records can't deadlock.
+ */
+static NTSTATUS dbwrap_fallback_do_locked_multi(
+	struct db_context *db, TALLOC_CTX *mem_ctx,
+	const TDB_DATA *keys, size_t num_keys,
+	void (*fn)(struct db_record **recs, size_t num_recs,
+		   void *private_data),
+	void *private_data)
+{
+	struct dbwrap_sorted_key *sorted;
+	struct db_record **recs;
+	size_t i;
+
+	sorted = talloc_array(mem_ctx, struct dbwrap_sorted_key, num_keys);
+	recs = talloc_array(mem_ctx, struct db_record *, num_keys);
+	if ((sorted == NULL) || (recs == NULL)) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		sorted[i].key = keys[i];
+		sorted[i].idx = i;
+	}
+	TYPESAFE_QSORT(sorted, num_keys, dbwrap_sorted_key_cmp);
+
+	for (i=0; i<num_keys; i++) {
+		struct db_record *rec;
+
+		rec = db->fetch_locked(db, recs, sorted[i].key);
+		if (rec == NULL) {
+			return NT_STATUS_INTERNAL_DB_ERROR;
+		}
+		rec->db = db;
+		recs[sorted[i].idx] = rec;
+	}
+
+	fn(recs, num_keys, private_data);
+
+	return NT_STATUS_OK;
+}
+
+NTSTATUS dbwrap_do_locked_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*fn)(struct db_record **recs, size_t num_recs,
+		   void *private_data),
+	void *private_data)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct dbwrap_lock_order_state *lock_order = NULL;
+	NTSTATUS status;
+
+	if (db->lock_order != DBWRAP_LOCK_ORDER_NONE) {
+		lock_order = dbwrap_check_lock_order(db, frame);
+		if (lock_order == NULL) {
+			TALLOC_FREE(frame);
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
+	if (db->do_locked_multi != NULL) {
+		status = db->do_locked_multi(db, keys, num_keys, fn,
+					     private_data);
+	} else {
+		status = dbwrap_fallback_do_locked_multi(
+			db, frame, keys, num_keys, fn, private_data);
+	}
+
+	TALLOC_FREE(frame);
+	return status;
+}
+
 int dbwrap_wipe(struct db_context *db)
 {
 	if (db->wipe == NULL) {
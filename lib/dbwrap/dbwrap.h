@@ -80,6 +80,27 @@ NTSTATUS dbwrap_parse_record(struct db_context *db, TDB_DATA key,
 			     void (*parser)(TDB_DATA key, TDB_DATA data,
 					    void *private_data),
 			     void *private_data);
+/*
+ * Look up several records at once: "parser" is called with the index
+ * of the key in "keys" for every record found. Backends lock every
+ * tdb chain only once, with ctdb the records not available locally are
+ * fetched with one batch of requests.
+ */
+NTSTATUS dbwrap_parse_records_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data);
+/*
+ * Lock several records at once and call "fn" with them, in the order
+ * of "keys". The records can be stored and deleted from within "fn",
+ * they are unlocked once "fn" returns. The keys must be distinct.
+ */
+NTSTATUS dbwrap_do_locked_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*fn)(struct db_record **recs, size_t num_recs,
+		   void *private_data),
+	void *private_data);
 int dbwrap_wipe(struct db_context *db);
 int dbwrap_check(struct db_context *db);
 int dbwrap_get_seqnum(struct db_context *db);
@@ -55,6 +55,16 @@ struct db_context {
 				 void (*parser)(TDB_DATA key, TDB_DATA data,
 						void *private_data),
 				 void *private_data);
+	NTSTATUS (*parse_records_multi)(
+		struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+		void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+			       void *private_data),
+		void *private_data);
+	NTSTATUS (*do_locked_multi)(
+		struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+		void (*fn)(struct db_record **recs, size_t num_recs,
+			   void *private_data),
+		void *private_data);
 	int (*exists)(struct db_context *db,TDB_DATA key);
 	int (*wipe)(struct db_context *db);
 	int (*check)(struct db_context *db);
@@ -236,6 +236,92 @@ static NTSTATUS db_tdb_parse(struct db_context *db, TDB_DATA key,
 	return NT_STATUS_OK;
 }
 
+struct db_tdb_parse_multi_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+};
+
+static int db_tdb_multi_parser(size_t idx, TDB_DATA key, TDB_DATA data,
+			       void *private_data)
+{
+	struct db_tdb_parse_multi_state *state =
+		(struct db_tdb_parse_multi_state *)private_data;
+	state->parser(idx, key, data, state->private_data);
+	return 0;
+}
+
+static NTSTATUS db_tdb_parse_multi(struct db_context *db,
+				   const TDB_DATA *keys, size_t num_keys,
+				   void (*parser)(size_t idx, TDB_DATA key,
+						  TDB_DATA data,
+						  void *private_data),
+				   void *private_data)
+{
+	struct db_tdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_tdb_ctx);
+	struct db_tdb_parse_multi_state state;
+	int ret;
+
+	state.parser = parser;
+	state.private_data = private_data;
+
+	ret = tdb_parse_record_multi(ctx->wtdb->tdb, keys, num_keys,
+				     db_tdb_multi_parser, &state);
+	if (ret != 0) {
+		return map_nt_error_from_tdb(tdb_error(ctx->wtdb->tdb));
+	}
+	return NT_STATUS_OK;
+}
+
+/*
+ * Lock all chains involved up front, in chain order. The
+ * db_tdb_fetch_locked() calls then only nest those locks, which is
+ * cheap, and the record destructors drop the nesting again.
+ */
+static NTSTATUS db_tdb_do_locked_multi(struct db_context *db,
+				       const TDB_DATA *keys, size_t num_keys,
+				       void (*fn)(struct db_record **recs,
+						  size_t num_recs,
+						  void *private_data),
+				       void *private_data)
+{
+	struct db_tdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_tdb_ctx);
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct db_record **recs;
+	NTSTATUS status;
+	size_t i;
+
+	recs = talloc_array(frame, struct db_record *, num_keys);
+	if (recs == NULL) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (tdb_chainlock_multi(ctx->wtdb->tdb, keys, num_keys) != 0) {
+		DEBUG(3, ("tdb_chainlock_multi failed\n"));
+		TALLOC_FREE(frame);
+		return map_nt_error_from_tdb(tdb_error(ctx->wtdb->tdb));
+	}
+
+	for (i=0; i<num_keys; i++) {
+		recs[i] = db_tdb_fetch_locked(db, recs, keys[i]);
+		if (recs[i] == NULL) {
+			status = NT_STATUS_INTERNAL_DB_ERROR;
+			goto done;
+		}
+		recs[i]->db = db;
+	}
+
+	fn(recs, num_keys, private_data);
+	status = NT_STATUS_OK;
+done:
+	TALLOC_FREE(frame);
+	tdb_chainunlock_multi(ctx->wtdb->tdb, keys, num_keys);
+	return status;
+}
+
 static NTSTATUS db_tdb_store(struct db_record *rec, TDB_DATA data, int flag)
 {
 	struct db_tdb_ctx *ctx = talloc_get_type_abort(rec->private_data,
@@ -445,6 +531,8 @@ struct db_context *db_open_tdb(TALLOC_CTX *mem_ctx,
 	result->traverse = db_tdb_traverse;
 	result->traverse_read = db_tdb_traverse_read;
 	result->parse_record = db_tdb_parse;
+	result->parse_records_multi = db_tdb_parse_multi;
+	result->do_locked_multi = db_tdb_do_locked_multi;
 	result->get_seqnum = db_tdb_get_seqnum;
 	result->persistent = ((tdb_flags & TDB_CLEAR_IF_FIRST) == 0);
 	result->transaction_start = db_tdb_transaction_start;
@@ -516,11 +516,56 @@ _PUBLIC_ const char *talloc_parent_name(const void *ptr)
 struct talloc_pool_hdr {
 	void *end;
 	unsigned int object_count;
+	/*
+	 * Arenas only: frees done by threads other than the owner,
+	 * see talloc_arena().
+	 */
+	unsigned int remote_frees;
 	size_t poolsize;
+	/*
+	 * Arenas only: a marker of the thread that created the pool,
+	 * NULL for a normal talloc pool.
+	 */
+	const void *owner;
+	/*
+	 * Slab pools only: the free lists, placed behind the pool
+	 * memory, see talloc_pool_slab().
+	 */
+	struct talloc_slab *slab;
 };
 
 #define TP_HDR_SIZE TC_ALIGN16(sizeof(struct talloc_pool_hdr))
 
+/*
+  An arena is a pool that only its owner thread allocates from, with
+  the normal non-atomic object_count. Other threads may free (and thus
+  realloc) arena members they were handed with talloc_steal(), they
+  never touch "end" or object_count but increment remote_frees
+  atomically. The owner folds remote_frees back into object_count when
+  it runs out of space.
+
+  Once the owner has freed the arena, remote_frees takes over the whole
+  count: the owner subtracts the number of objects still alive, and
+  from then on every free by any thread increments it. The free that
+  brings it back to zero releases the memory.
+*/
+
+#if defined(HAVE___THREAD) && defined(HAVE___SYNC_FETCH_AND_ADD)
+#define TALLOC_HAVE_ARENAS 1
+
+static __thread char talloc_thread_marker;
+
+static inline const void *talloc_thread_self(void)
+{
+	return &talloc_thread_marker;
+}
+#else
+static inline const void *talloc_thread_self(void)
+{
+	return NULL;
+}
+#endif
+
 static inline struct talloc_pool_hdr *talloc_pool_from_chunk(struct talloc_chunk *c)
 {
 	return (struct talloc_pool_hdr *)((char *)c - TP_HDR_SIZE);
@@ -531,6 +576,146 @@ static inline struct talloc_chunk *talloc_chunk_from_pool(struct talloc_pool_hdr
 	return (struct talloc_chunk *)((char *)h + TP_HDR_SIZE);
 }
 
+/*
+ * Can't use the arena's non-atomic bookkeeping: we're not the owner
+ * or the owner has freed the arena already.
+ */
+static inline bool tc_pool_is_foreign(struct talloc_pool_hdr *pool_hdr)
+{
+	struct talloc_chunk *pool_tc;
+
+	if (likely(pool_hdr->owner == NULL)) {
+		return false;
+	}
+	if (pool_hdr->owner != talloc_thread_self()) {
+		return true;
+	}
+	pool_tc = talloc_chunk_from_pool(pool_hdr);
+	return (pool_tc->flags & TALLOC_FLAG_FREE) != 0;
+}
+
+#ifdef TALLOC_HAVE_ARENAS
+/* The owner picks up frees done by other threads */
+static inline void tc_arena_fold(struct talloc_pool_hdr *pool_hdr)
+{
+	unsigned int remote_frees;
+
+	remote_frees = __sync_lock_test_and_set(&pool_hdr->remote_frees, 0);
+	pool_hdr->object_count -= remote_frees;
+}
+
+/* Drop a foreign reference, true if the arena memory can go */
+static inline bool tc_arena_put(struct talloc_pool_hdr *pool_hdr)
+{
+	return __sync_add_and_fetch(&pool_hdr->remote_frees, 1) == 0;
+}
+
+/* The owner frees the arena, true if the arena memory can go */
+static inline bool tc_arena_release(struct talloc_pool_hdr *pool_hdr)
+{
+	unsigned int alive;
+
+	tc_arena_fold(pool_hdr);
+	alive = pool_hdr->object_count - 1;
+	pool_hdr->object_count = 0;
+
+	if (alive == 0) {
+		return true;
+	}
+	return __sync_sub_and_fetch(&pool_hdr->remote_frees, alive) == 0;
+}
+#else
+static inline void tc_arena_fold(struct talloc_pool_hdr *pool_hdr)
+{
+}
+
+static inline bool tc_arena_put(struct talloc_pool_hdr *pool_hdr)
+{
+	return false;
+}
+
+static inline bool tc_arena_release(struct talloc_pool_hdr *pool_hdr)
+{
+	return true;
+}
+#endif
+
+/*
+  A slab pool keeps freed children on per size class free lists, linked
+  through their (dead) "next" pointers, and recycles them for
+  allocations of the same size before it carves new memory.
+*/
+
+#define TALLOC_SLAB_MAX_CHUNK 2048
+#define TALLOC_SLAB_CLASSES (TALLOC_SLAB_MAX_CHUNK / 16)
+
+struct talloc_slab {
+	struct talloc_chunk *free_chunks[TALLOC_SLAB_CLASSES];
+	size_t cached;
+	size_t hits;
+	size_t misses;
+	size_t fallbacks;
+};
+
+#define TS_SIZE TC_ALIGN16(sizeof(struct talloc_slab))
+
+static inline struct talloc_chunk *tc_slab_get(struct talloc_slab *slab,
+					       size_t chunk_size)
+{
+	struct talloc_chunk *tc;
+	size_t idx = chunk_size / 16 - 1;
+
+	tc = slab->free_chunks[idx];
+	if (tc == NULL) {
+		return NULL;
+	}
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_DEFINED)
+	VALGRIND_MAKE_MEM_DEFINED(&tc->next, sizeof(tc->next));
+#endif
+	slab->free_chunks[idx] = tc->next;
+	slab->cached -= chunk_size;
+	slab->hits += 1;
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(tc, chunk_size);
+#endif
+	return tc;
+}
+
+static inline void tc_slab_put(struct talloc_slab *slab,
+			       struct talloc_chunk *tc)
+{
+	size_t chunk_size = TC_ALIGN16(TC_HDR_SIZE + tc->size);
+	size_t idx = chunk_size / 16 - 1;
+
+	if (chunk_size > TALLOC_SLAB_MAX_CHUNK) {
+		return;
+	}
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(&tc->next, sizeof(tc->next));
+#endif
+	tc->next = slab->free_chunks[idx];
+	slab->free_chunks[idx] = tc;
+	slab->cached += chunk_size;
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_NOACCESS)
+	VALGRIND_MAKE_MEM_NOACCESS(&tc->next, sizeof(tc->next));
+#endif
+}
+
+/* The pool is rewound, the free lists point into reclaimed memory */
+static inline void tc_slab_reset(struct talloc_pool_hdr *pool_hdr)
+{
+	struct talloc_slab *slab = pool_hdr->slab;
+
+	if (likely(slab == NULL)) {
+		return;
+	}
+	memset(slab->free_chunks, 0, sizeof(slab->free_chunks));
+	slab->cached = 0;
+}
+
 static inline void *tc_pool_end(struct talloc_pool_hdr *pool_hdr)
 {
 	struct talloc_chunk *tc = talloc_chunk_from_pool(pool_hdr);
@@ -595,6 +780,10 @@ static inline struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent
 		return NULL;
 	}
 
+	if (unlikely(tc_pool_is_foreign(pool_hdr))) {
+		return NULL;
+	}
+
 	space_left = tc_pool_space_left(pool_hdr);
 
 	/*
@@ -602,6 +791,41 @@ static inline struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent
 	 */
 	chunk_size = TC_ALIGN16(size + prefix_len);
 
+	if (unlikely(pool_hdr->slab != NULL)) {
+		/*
+		 * Only hand out what we can recycle, anything else would
+		 * waste the pool until it is completely empty. Nested
+		 * pools don't qualify: their chunk does not start at the
+		 * beginning of their memory.
+		 */
+		if ((prefix_len != 0) || (chunk_size > TALLOC_SLAB_MAX_CHUNK)) {
+			pool_hdr->slab->fallbacks += 1;
+			return NULL;
+		}
+		result = tc_slab_get(pool_hdr->slab, chunk_size);
+		if (result != NULL) {
+			goto got_chunk;
+		}
+		if (space_left < chunk_size) {
+			pool_hdr->slab->fallbacks += 1;
+			return NULL;
+		}
+		pool_hdr->slab->misses += 1;
+	}
+
+	if (unlikely(space_left < chunk_size) && (pool_hdr->owner != NULL)) {
+		/*
+		 * Frees by other threads don't rewind an arena, see if
+		 * they emptied it.
+		 */
+		tc_arena_fold(pool_hdr);
+		if (pool_hdr->object_count == 1) {
+			pool_hdr->end = tc_pool_first_chunk(pool_hdr);
+			tc_invalidate_pool(pool_hdr);
+			space_left = tc_pool_space_left(pool_hdr);
+		}
+	}
+
 	if (space_left < chunk_size) {
 		return NULL;
 	}
@@ -614,6 +838,7 @@ static inline struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent
 
 	pool_hdr->end = (void *)((char *)pool_hdr->end + chunk_size);
 
+got_chunk:
 	result->flags = talloc_magic | TALLOC_FLAG_POOLMEM;
 	result->pool = pool_hdr;
 
@@ -731,8 +956,11 @@ static inline void *_talloc_pool(const void *context, size_t size)
 	tc->size = 0;
 
 	pool_hdr->object_count = 1;
+	pool_hdr->remote_frees = 0;
 	pool_hdr->end = result;
 	pool_hdr->poolsize = size;
+	pool_hdr->owner = NULL;
+	pool_hdr->slab = NULL;
 
 	tc_invalidate_pool(pool_hdr);
 
@@ -744,6 +972,114 @@ _PUBLIC_ void *talloc_pool(const void *context, size_t size)
 	return _talloc_pool(context, size);
 }
 
+/*
+ * Create a talloc pool that recycles freed children
+ */
+
+_PUBLIC_ void *talloc_pool_slab(const void *context, size_t size)
+{
+	struct talloc_pool_hdr *pool_hdr;
+	void *result;
+	size_t poolsize = TC_ALIGN16(size);
+
+	if ((poolsize < size) || (poolsize + TS_SIZE < poolsize)) {
+		return NULL;
+	}
+
+	result = _talloc_pool(context, poolsize + TS_SIZE);
+	if (unlikely(result == NULL)) {
+		return NULL;
+	}
+
+	pool_hdr = talloc_pool_from_chunk(talloc_chunk_from_ptr(result));
+
+	/*
+	 * The free lists live behind the pool memory, where neither
+	 * allocations nor tc_invalidate_pool() reach.
+	 */
+	pool_hdr->poolsize = poolsize;
+	pool_hdr->slab = (struct talloc_slab *)tc_pool_end(pool_hdr);
+
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(pool_hdr->slab, TS_SIZE);
+#endif
+	memset(pool_hdr->slab, 0, sizeof(struct talloc_slab));
+
+	return result;
+}
+
+_PUBLIC_ int talloc_pool_stats(const void *ptr, struct talloc_pool_stats *stats)
+{
+	struct talloc_chunk *tc;
+	struct talloc_pool_hdr *pool_hdr;
+
+	if (ptr == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	tc = talloc_chunk_from_ptr(ptr);
+	if (!(tc->flags & TALLOC_FLAG_POOL)) {
+		errno = EINVAL;
+		return -1;
+	}
+	pool_hdr = talloc_pool_from_chunk(tc);
+
+	*stats = (struct talloc_pool_stats) {
+		.poolsize = pool_hdr->poolsize,
+		.used = (char *)pool_hdr->end - (char *)tc_pool_first_chunk(pool_hdr),
+		.object_count = pool_hdr->object_count,
+	};
+
+	if (pool_hdr->slab != NULL) {
+		stats->slab_cached = pool_hdr->slab->cached;
+		stats->slab_hits = pool_hdr->slab->hits;
+		stats->slab_misses = pool_hdr->slab->misses;
+		stats->slab_fallbacks = pool_hdr->slab->fallbacks;
+	}
+
+	return 0;
+}
+
+/*
+ * Create a talloc pool owned by the calling thread
+ */
+
+_PUBLIC_ void *talloc_arena(const void *context, size_t size)
+{
+#ifdef TALLOC_HAVE_ARENAS
+	struct talloc_pool_hdr *pool_hdr;
+	void *result;
+
+	if (context != NULL) {
+		struct talloc_chunk *ptc = talloc_chunk_from_ptr(context);
+
+		if (ptc->flags & (TALLOC_FLAG_POOL|TALLOC_FLAG_POOLMEM)) {
+			/*
+			 * The last reference to an arena can be dropped
+			 * by any thread, which must not touch another
+			 * pool.
+			 */
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	result = _talloc_pool(context, size);
+	if (unlikely(result == NULL)) {
+		return NULL;
+	}
+
+	pool_hdr = talloc_pool_from_chunk(talloc_chunk_from_ptr(result));
+	pool_hdr->owner = talloc_thread_self();
+
+	return result;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
 /*
  * Create a talloc pool correctly sized for a basic size plus
  * a number of subobjects whose total size is given. Essentially
@@ -926,6 +1262,16 @@ static inline void _talloc_free_poolmem(struct talloc_chunk *tc,
 
 	TC_INVALIDATE_FULL_CHUNK(tc);
 
+	if (unlikely(tc_pool_is_foreign(pool))) {
+		if (tc_arena_put(pool)) {
+			pool_tc->name = location;
+			talloc_memlimit_update_on_free(pool_tc);
+			TC_INVALIDATE_FULL_CHUNK(pool_tc);
+			free(pool);
+		}
+		return;
+	}
+
 	if (unlikely(pool->object_count == 0)) {
 		talloc_abort("Pool object count zero!");
 		return;
@@ -944,6 +1290,7 @@ static inline void _talloc_free_poolmem(struct talloc_chunk *tc,
 		 */
 		pool->end = tc_pool_first_chunk(pool);
 		tc_invalidate_pool(pool);
+		tc_slab_reset(pool);
 		return;
 	}
 
@@ -981,6 +1328,11 @@ static inline void _talloc_free_poolmem(struct talloc_chunk *tc,
 		return;
 	}
 
+	if ((pool->slab != NULL) && !(tc->flags & TALLOC_FLAG_POOL)) {
+		tc_slab_put(pool->slab, tc);
+		return;
+	}
+
 	/*
 	 * Do nothing. The memory is just "wasted", waiting for the pool
 	 * itself to be freed.
@@ -1089,10 +1441,16 @@ static inline int _talloc_free_internal(void *ptr, const char *location)
 			return 0;
 		}
 
-		pool->object_count--;
+		if (unlikely(pool->owner != NULL)) {
+			if (!tc_arena_release(pool)) {
+				return 0;
+			}
+		} else {
+			pool->object_count--;
 
-		if (likely(pool->object_count != 0)) {
-			return 0;
+			if (likely(pool->object_count != 0)) {
+				return 0;
+			}
 		}
 
 		/*
@@ -1658,6 +2016,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 	struct talloc_chunk *tc;
 	void *new_ptr;
 	bool malloced = false;
+	bool foreign = false;
 	struct talloc_pool_hdr *pool_hdr = NULL;
 	size_t old_size = 0;
 	size_t new_size = 0;
@@ -1699,6 +2058,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 	/* handle realloc inside a talloc_pool */
 	if (unlikely(tc->flags & TALLOC_FLAG_POOLMEM)) {
 		pool_hdr = tc->pool;
+		foreign = tc_pool_is_foreign(pool_hdr);
 	}
 
 #if (ALWAYS_REALLOC == 0)
@@ -1708,7 +2068,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 			void *next_tc = tc_next_chunk(tc);
 			TC_INVALIDATE_SHRINK_CHUNK(tc, size);
 			tc->size = size;
-			if (next_tc == pool_hdr->end) {
+			if (!foreign && next_tc == pool_hdr->end) {
 				/* note: tc->size has changed, so this works */
 				pool_hdr->end = tc_next_chunk(tc);
 			}
@@ -1743,7 +2103,9 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 #if ALWAYS_REALLOC
 	if (pool_hdr) {
 		new_ptr = talloc_alloc_pool(tc, size + TC_HDR_SIZE, 0);
-		pool_hdr->object_count--;
+		if (!foreign) {
+			pool_hdr->object_count--;
+		}
 
 		if (new_ptr == NULL) {
 			new_ptr = malloc(TC_HDR_SIZE+size);
@@ -1753,7 +2115,11 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 
 		if (new_ptr) {
 			memcpy(new_ptr, tc, MIN(tc->size,size) + TC_HDR_SIZE);
-			TC_INVALIDATE_FULL_CHUNK(tc);
+			if (foreign) {
+				_talloc_free_poolmem(tc, __location__ "_talloc_realloc");
+			} else {
+				TC_INVALIDATE_FULL_CHUNK(tc);
+			}
 		}
 	} else {
 		/* We're doing malloc then free here, so record the difference. */
@@ -1780,6 +2146,15 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 			chunk_count -= 1;
 		}
 
+		if (foreign) {
+			/*
+			 * Someone else's arena, all we may do is drop our
+			 * reference. Move to malloc'ed memory.
+			 */
+			chunk_count = 0;
+			next_tc = NULL;
+		}
+
 		if (chunk_count == 1) {
 			/*
 			 * optimize for the case where 'tc' is the only
@@ -1814,6 +2189,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 				}
 #endif
 
+				tc_slab_reset(pool_hdr);
 				memmove(new_ptr, tc, old_used);
 
 				tc = (struct talloc_chunk *)new_ptr;
@@ -2007,6 +2383,9 @@ static inline size_t _talloc_total_mem_internal(const void *ptr,
 					total = pool_hdr->poolsize +
 							TC_HDR_SIZE +
 							TP_HDR_SIZE;
+					if (pool_hdr->slab != NULL) {
+						total += TS_SIZE;
+					}
 				} else {
 					total = tc->size + TC_HDR_SIZE;
 				}
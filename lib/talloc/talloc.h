@@ -853,6 +853,90 @@ void *talloc_find_parent_bytype(const void *ptr, #type);
  */
 void *talloc_pool(const void *context, size_t size);
 
+/**
+ * @brief Allocate a talloc pool owned by the calling thread.
+ *
+ * talloc itself does no locking, threads must work on separate talloc
+ * hierarchies. A plain talloc_pool() does not fit that model: its
+ * children share the pool's object count, so a child that was handed
+ * to another thread with talloc_steal() can't be freed there.
+ *
+ * A talloc arena is a talloc_pool() that is tied to the thread that
+ * created it. Only that thread allocates from it. Children of the arena
+ * can be passed to other threads the usual way (talloc_move() to NULL
+ * under a lock, talloc_move() into the new hierarchy on the other side).
+ * When the receiving thread frees or reallocs them, it only drops its
+ * reference to the arena with an atomic operation, and new children of
+ * such an object come from malloc(3) instead of the arena.
+ *
+ * The arena itself must be freed by its owner thread. Its memory goes
+ * back to the system once the last child is gone, whichever thread
+ * frees that child.
+ *
+ * @param[in]  context  The talloc context to hang the result off, this
+ *                      must not be a pool or be allocated from one.
+ *
+ * @param[in]  size     Size of the talloc arena.
+ *
+ * @return              The allocated talloc arena, NULL on error. errno
+ *                      is ENOSYS if the platform lacks thread-local
+ *                      storage or atomic builtins.
+ */
+void *talloc_arena(const void *context, size_t size);
+
+/**
+ * @brief Allocate a talloc pool that recycles freed children.
+ *
+ * A plain talloc_pool() only reuses its memory once all children are
+ * gone. For long-lived pools with a steady churn of objects, e.g. per
+ * connection request and file structures, that never happens: the pool
+ * fills up and every further allocation goes to malloc(3).
+ *
+ * A slab pool keeps freed children on free lists sorted by size (in 16
+ * byte steps, up to 2048 bytes including the talloc header) and hands
+ * them out again to allocations of the same size class before it takes
+ * fresh memory from the pool. Larger children and nested pools are
+ * always allocated with malloc(3).
+ *
+ * @param[in]  context  The talloc context to hang the result off.
+ *
+ * @param[in]  size     Size of the talloc pool.
+ *
+ * @return              The allocated talloc pool, NULL on error.
+ *
+ * @see talloc_pool()
+ * @see talloc_pool_stats()
+ */
+void *talloc_pool_slab(const void *context, size_t size);
+
+/**
+ * @brief Usage statistics of a talloc pool.
+ *
+ * The slab_* members are only maintained for talloc_pool_slab() pools.
+ */
+struct talloc_pool_stats {
+	size_t poolsize;		/**< bytes available for children */
+	size_t used;			/**< bytes carved from the pool */
+	unsigned int object_count;	/**< live children, plus the pool */
+	size_t slab_cached;		/**< freed bytes kept for reuse */
+	size_t slab_hits;		/**< allocations served from free lists */
+	size_t slab_misses;		/**< allocations carved from the pool */
+	size_t slab_fallbacks;		/**< allocations that went to malloc(3) */
+};
+
+/**
+ * @brief Get the usage statistics of a talloc pool.
+ *
+ * @param[in]  pool     A pointer returned by talloc_pool(),
+ *                      talloc_pool_slab() or talloc_arena().
+ *
+ * @param[out] stats    The statistics.
+ *
+ * @return              0 on success, -1 with errno EINVAL if pool is
+ *                      not a talloc pool.
+ */
+int talloc_pool_stats(const void *pool, struct talloc_pool_stats *stats);
+
 #ifdef DOXYGEN
 /**
  * @brief Allocate a talloc object as/with an additional pool.
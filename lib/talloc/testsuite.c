@@ -1363,6 +1363,106 @@ static bool test_pool_steal(void)
 	return true;
 }
 
+static bool test_pool_slab(void)
+{
+	void *pool;
+	void *pinned;
+	void *p1, *p2, *p3, *p4;
+	struct talloc_pool_stats stats;
+	int i, ret;
+
+	printf("test: pool_slab\n# TALLOC POOL SLAB\n");
+
+	pool = talloc_pool_slab(NULL, 4096);
+	torture_assert("pool_slab", pool != NULL, "talloc_pool_slab failed");
+
+	p1 = talloc_size(pool, 100);
+	p2 = talloc_size(pool, 100);
+	p3 = talloc_size(pool, 200);
+	torture_assert("pool_slab", p1 && p2 && p3, "allocation failed");
+	memset(p1, 0x11, talloc_get_size(p1));
+	memset(p2, 0x11, talloc_get_size(p2));
+	memset(p3, 0x11, talloc_get_size(p3));
+
+	talloc_free(p1);
+	ret = talloc_pool_stats(pool, &stats);
+	torture_assert("pool_slab", ret == 0, "talloc_pool_stats failed");
+	torture_assert("pool_slab", stats.object_count == 3,
+		       "wrong object count");
+	torture_assert("pool_slab", stats.slab_cached > 100,
+		       "freed chunk not cached");
+
+	/* same size class, recycled */
+	p4 = talloc_size(pool, 97);
+	torture_assert("pool_slab", p4 == p1, "chunk not recycled");
+	memset(p4, 0x11, talloc_get_size(p4));
+
+	/* different size class, carved */
+	talloc_free(p2);
+	p1 = talloc_size(pool, 150);
+	torture_assert("pool_slab", p1 > p3, "chunk recycled for wrong size");
+
+	ret = talloc_pool_stats(pool, &stats);
+	torture_assert("pool_slab", ret == 0, "talloc_pool_stats failed");
+	torture_assert("pool_slab", stats.slab_hits == 1, "wrong hit count");
+	torture_assert("pool_slab", stats.slab_misses == 4, "wrong miss count");
+
+	/* empty again: the free lists go with the rewind */
+	talloc_free(p1);
+	talloc_free(p3);
+	talloc_free(p4);
+	ret = talloc_pool_stats(pool, &stats);
+	torture_assert("pool_slab", ret == 0, "talloc_pool_stats failed");
+	torture_assert("pool_slab", stats.object_count == 1,
+		       "wrong object count");
+	torture_assert("pool_slab", stats.used == 0, "pool not rewound");
+	torture_assert("pool_slab", stats.slab_cached == 0,
+		       "free lists not reset");
+
+	/*
+	 * A long-lived object pins the pool. With a plain pool the churn
+	 * below would fall back to malloc once the pool is used up.
+	 */
+	pinned = talloc_size(pool, 64);
+	for (i=0; i<10000; i++) {
+		p1 = talloc_size(pool, 100 + (i % 3) * 100);
+		p2 = talloc_strdup(p1, "churn");
+		p3 = talloc_size(pool, 200);
+		torture_assert("pool_slab", p1 && p2 && p3,
+			       "allocation failed");
+		talloc_free(p1);
+		talloc_free(p3);
+	}
+	ret = talloc_pool_stats(pool, &stats);
+	torture_assert("pool_slab", ret == 0, "talloc_pool_stats failed");
+	torture_assert("pool_slab", stats.slab_fallbacks == 0,
+		       "churn fell back to malloc");
+	torture_assert("pool_slab", stats.used < 2048, "pool not recycled");
+	talloc_free(pinned);
+
+	/* realloc within a slab pool */
+	p1 = talloc_size(pool, 100);
+	p2 = talloc_size(pool, 100);
+	p1 = talloc_realloc_size(NULL, p1, 1000);
+	torture_assert("pool_slab", p1 != NULL, "realloc failed");
+	memset(p1, 0x11, talloc_get_size(p1));
+	p3 = talloc_size(pool, 100);
+	torture_assert("pool_slab", p3 < p2, "realloc did not free chunk");
+	talloc_free(p2);
+	talloc_free(p3);
+	talloc_free(p1);
+
+	p1 = talloc_new(NULL);
+	ret = talloc_pool_stats(p1, &stats);
+	torture_assert("pool_slab", ret == -1, "stats on a non-pool");
+	talloc_free(p1);
+
+	talloc_free(pool);
+
+	printf("success: pool_slab\n");
+	return true;
+}
+
 static bool test_pool_nest(void)
 {
 	void *p1, *p2, *p3;
@@ -1853,6 +1953,236 @@ static bool test_pthread_talloc_passing(void)
 	printf("success: pthread_talloc_passing\n");
 	return true;
 }
+
+#define ARENA_SIZE 1024
+
+static bool in_arena(const void *arena, const void *ptr)
+{
+	const char *a = (const char *)arena;
+	const char *p = (const char *)ptr;
+
+	return (p > a) && (p < a + ARENA_SIZE);
+}
+
+struct arena_thread_state {
+	void *arena;
+	void *p1;
+	void *p2;
+	bool ok;
+};
+
+static void *arena_thread_fn(void *arg)
+{
+	struct arena_thread_state *state = (struct arena_thread_state *)arg;
+	void *top_ctx, *child;
+	char *p1;
+
+	top_ctx = talloc_new(NULL);
+	if (top_ctx == NULL) {
+		return NULL;
+	}
+	p1 = talloc_move(top_ctx, &state->p1);
+
+	/* Children of foreign arena objects must not use the arena */
+	child = talloc_size(p1, 16);
+	if ((child == NULL) || in_arena(state->arena, child)) {
+		talloc_free(top_ctx);
+		return NULL;
+	}
+
+	/* Neither must a realloc */
+	p1 = talloc_realloc(top_ctx, p1, char, 200);
+	if ((p1 == NULL) || in_arena(state->arena, p1)) {
+		talloc_free(top_ctx);
+		return NULL;
+	}
+	if (strcmp(p1, "arena") != 0) {
+		talloc_free(top_ctx);
+		return NULL;
+	}
+
+	talloc_free(state->p2);
+	state->p2 = NULL;
+
+	talloc_free(top_ctx);
+	state->ok = true;
+	return NULL;
+}
+
+static bool test_arena(void)
+{
+	struct arena_thread_state state = { .ok = false };
+	pthread_t thread_id;
+	void *first, *p;
+	int ret;
+
+	talloc_disable_null_tracking();
+
+	printf("test: arena\n# TALLOC ARENA\n");
+
+	state.arena = talloc_arena(NULL, ARENA_SIZE);
+	if (state.arena == NULL) {
+		torture_assert("arena", errno == ENOSYS, "talloc_arena failed");
+		printf("success: arena\n");
+		return true;
+	}
+
+	state.p1 = talloc_strdup(state.arena, "arena");
+	torture_assert("arena", in_arena(state.arena, state.p1),
+		       "not allocated from the arena");
+	first = state.p1;
+	state.p2 = talloc_size(state.arena, 100);
+	torture_assert("arena", in_arena(state.arena, state.p2),
+		       "not allocated from the arena");
+
+	/* the usual handoff: move to NULL, the thread picks it up */
+	state.p1 = talloc_move(NULL, &state.p1);
+	state.p2 = talloc_move(NULL, &state.p2);
+
+	ret = pthread_create(&thread_id, NULL, arena_thread_fn, &state);
+	torture_assert("arena", ret == 0, "pthread_create failed");
+	ret = pthread_join(thread_id, NULL);
+	torture_assert("arena", ret == 0, "pthread_join failed");
+	torture_assert("arena", state.ok, "arena thread failed");
+
+	/*
+	 * The foreign frees left "end" alone, the next allocation that
+	 * does not fit has to rewind the now empty arena.
+	 */
+	p = talloc_size(state.arena, ARENA_SIZE - 128);
+	torture_assert("arena", p == first, "arena not rewound");
+
+	/* An arena does not nest into a pool */
+	torture_assert("arena", talloc_arena(state.arena, 64) == NULL,
+		       "arena inside a pool");
+	torture_assert("arena", errno == EINVAL, "expected EINVAL");
+
+	/* A child may outlive the arena on another thread */
+	state.p1 = talloc_strdup(NULL, "arena");
+	talloc_free(p);
+	p = talloc_strdup(state.arena, "orphan");
+	state.p2 = talloc_move(NULL, &p);
+	talloc_free(state.arena);
+	state.arena = NULL;
+	state.ok = false;
+
+	ret = pthread_create(&thread_id, NULL, arena_thread_fn, &state);
+	torture_assert("arena", ret == 0, "pthread_create failed");
+	ret = pthread_join(thread_id, NULL);
+	torture_assert("arena", ret == 0, "pthread_join failed");
+	torture_assert("arena", state.ok, "arena thread failed");
+
+	printf("success: arena\n");
+	return true;
+}
+
+#define ARENA_SPEED_THREADS 4
+
+enum arena_speed_kind {
+	ARENA_SPEED_MALLOC,
+	ARENA_SPEED_TALLOC,
+	ARENA_SPEED_POOL,
+	ARENA_SPEED_ARENA
+};
+
+struct arena_speed_state {
+	enum arena_speed_kind kind;
+	unsigned count;
+};
+
+static void *arena_speed_fn(void *arg)
+{
+	struct arena_speed_state *state = (struct arena_speed_state *)arg;
+	const int loop = 1000;
+	struct timeval tv;
+	void *ctx = NULL;
+	int i;
+
+	switch (state->kind) {
+	case ARENA_SPEED_MALLOC:
+		break;
+	case ARENA_SPEED_TALLOC:
+		ctx = talloc_new(NULL);
+		break;
+	case ARENA_SPEED_POOL:
+		ctx = talloc_pool(NULL, 1024);
+		break;
+	case ARENA_SPEED_ARENA:
+		ctx = talloc_arena(NULL, 1024);
+		break;
+	}
+	if ((state->kind != ARENA_SPEED_MALLOC) && (ctx == NULL)) {
+		return NULL;
+	}
+
+	tv = timeval_current();
+	do {
+		for (i=0;i<loop;i++) {
+			void *p1, *p2, *p3;
+
+			if (state->kind == ARENA_SPEED_MALLOC) {
+				p1 = malloc(loop % 100);
+				p2 = strdup("foo bar");
+				p3 = malloc(300);
+				free(p1);
+				free(p2);
+				free(p3);
+				continue;
+			}
+			p1 = talloc_size(ctx, loop % 100);
+			p2 = talloc_strdup(p1, "foo bar");
+			p3 = talloc_size(p1, 300);
+			(void)p2;
+			(void)p3;
+			talloc_free(p1);
+		}
+		state->count += 3 * loop;
+	} while (timeval_elapsed(&tv) < 1.0);
+
+	talloc_free(ctx);
+	return NULL;
+}
+
+static bool test_arena_speed(void)
+{
+	static const char *names[] = {
+		[ARENA_SPEED_MALLOC] = "malloc",
+		[ARENA_SPEED_TALLOC] = "talloc",
+		[ARENA_SPEED_POOL] = "talloc_pool",
+		[ARENA_SPEED_ARENA] = "talloc_arena",
+	};
+	enum arena_speed_kind kind;
+
+	talloc_disable_null_tracking();
+
+	printf("test: arena_speed\n# THREADED TALLOC ARENA VS MALLOC SPEED\n");
+
+	for (kind = ARENA_SPEED_MALLOC; kind <= ARENA_SPEED_ARENA; kind++) {
+		struct arena_speed_state state[ARENA_SPEED_THREADS];
+		pthread_t thread_id[ARENA_SPEED_THREADS];
+		struct timeval tv = timeval_current();
+		unsigned count = 0;
+		int i, ret;
+
+		for (i=0; i<ARENA_SPEED_THREADS; i++) {
+			state[i] = (struct arena_speed_state) { .kind = kind };
+			ret = pthread_create(&thread_id[i], NULL,
+					     arena_speed_fn, &state[i]);
+			torture_assert("arena_speed", ret == 0,
+				       "pthread_create failed");
+		}
+		for (i=0; i<ARENA_SPEED_THREADS; i++) {
+			pthread_join(thread_id[i], NULL);
+			count += state[i].count;
+		}
+		fprintf(stderr, "%s: %.0f ops/sec over %d threads\n",
+			names[kind], count/timeval_elapsed(&tv),
+			ARENA_SPEED_THREADS);
+	}
+
+	printf("success: arena_speed\n");
+	return true;
+}
 #endif
 
 static void test_magic_protection_abort(const char *reason)
@@ -1982,6 +2312,8 @@ bool torture_local_talloc(struct torture_context *tctx)
 	test_reset();
 	ret &= test_pool_steal();
 	test_reset();
+	ret &= test_pool_slab();
+	test_reset();
 	ret &= test_free_ref_null_context();
 	test_reset();
 	ret &= test_rusty();
@@ -1992,12 +2324,18 @@ bool torture_local_talloc(struct torture_context *tctx)
 #ifdef HAVE_PTHREAD
 	test_reset();
 	ret &= test_pthread_talloc_passing();
+	test_reset();
+	ret &= test_arena();
 #endif
 
 
 	if (ret) {
 		test_reset();
 		ret &= test_speed();
+#ifdef HAVE_PTHREAD
+		test_reset();
+		ret &= test_arena_speed();
+#endif
 	}
 	test_reset();
 	ret &= test_autofree();
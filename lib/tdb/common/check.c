@@ -309,6 +309,90 @@ static bool tdb_check_free_record(struct tdb_context *tdb,
 	return true;
 }
 
+/* Every record in a size class freelist must be at least that size. */
+static bool tdb_check_freelist_classes(struct tdb_context *tdb)
+{
+	unsigned int list;
+
+	for (list = 0; list < TDB_FREELIST_CLASSES_NUM; list++) {
+		tdb_off_t off;
+		struct tdb_record rec;
+		/* we checked for loops already, but don't hang anyway */
+		size_t max = tdb->map_size / sizeof(rec);
+
+		if (tdb_ofs_read(tdb, TDB_FREELIST_CLASS_TOP(list), &off) == -1)
+			return false;
+
+		while (off != 0 && max-- > 0) {
+			if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
+						   DOCONV()) == -1)
+				return false;
+			if (rec.magic != TDB_FREE_MAGIC ||
+			    tdb_freelist_class(rec.rec_len) < list) {
+				tdb->ecode = TDB_ERR_CORRUPT;
+				TDB_LOG((tdb, TDB_DEBUG_ERROR,
+					 "Record offset %u in freelist class "
+					 "%u has length %u\n",
+					 off, list, rec.rec_len));
+				return false;
+			}
+			off = rec.next;
+		}
+	}
+	return true;
+}
+
+/*
+ * The heads of the buckets split off a hash chain count as that chain.
+ * The directory and segment records count as hash 0, like free records.
+ */
+static bool tdb_check_hash_split(struct tdb_context *tdb,
+				 unsigned char **hashes)
+{
+	uint32_t buckets, bucket;
+	tdb_off_t dir, seg, top, off;
+	unsigned int level;
+	uint64_t size = tdb->hash_size;
+	struct tdb_record rec;
+
+	if (tdb_hash_buckets(tdb, &buckets) == -1 ||
+	    tdb_ofs_read(tdb, TDB_HASH_SPLIT_DIR_OFS, &dir) == -1)
+		return false;
+
+	if (dir != 0) {
+		record_offset(hashes[0], dir);
+		for (level = 0; level < TDB_HASH_SPLIT_LEVELS; level++) {
+			if (tdb_ofs_read(tdb, dir + sizeof(rec)
+					 + level * sizeof(tdb_off_t),
+					 &seg) == -1)
+				return false;
+			if (seg == 0)
+				continue;
+			if (tdb->methods->tdb_read(tdb, seg, &rec, sizeof(rec),
+						   DOCONV()) == -1)
+				return false;
+			if (rec.magic != TDB_HASH_SPLIT_MAGIC ||
+			    rec.data_len < (size << level) * sizeof(tdb_off_t)) {
+				tdb->ecode = TDB_ERR_CORRUPT;
+				TDB_LOG((tdb, TDB_DEBUG_ERROR,
+					 "Bad segment %u for split level %u\n",
+					 seg, level));
+				return false;
+			}
+			record_offset(hashes[0], seg);
+		}
+	}
+
+	for (bucket = tdb->hash_size; bucket < buckets; bucket++) {
+		top = tdb_bucket_top(tdb, bucket);
+		if (top == 0 || tdb_ofs_read(tdb, top, &off) == -1)
+			return false;
+		if (off)
+			record_offset(hashes[1 + bucket % tdb->hash_size], off);
+	}
+	return true;
+}
+
 /* Slow, but should be very rare. */
 size_t tdb_dead_space(struct tdb_context *tdb, tdb_off_t off)
 {
@@ -383,6 +467,21 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 			record_offset(hashes[h], off);
 	}
 
+	/* Size class freelists start in the header, count them as hash 0. */
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		for (h = 0; h < TDB_FREELIST_CLASSES_NUM; h++) {
+			if (tdb_ofs_read(tdb, TDB_FREELIST_CLASS_TOP(h),
+					 &off) == -1)
+				goto free;
+			if (off)
+				record_offset(hashes[0], off);
+		}
+	}
+
+	if ((tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT) &&
+	    !tdb_check_hash_split(tdb, hashes))
+		goto free;
+
 	/* For each record, read it in and check it's ok. */
 	for (off = TDB_DATA_START(tdb->hash_size);
 	     off < tdb->map_size;
@@ -401,6 +500,13 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 			if (!tdb_check_free_record(tdb, off, &rec, hashes))
 				goto free;
 			break;
+		case TDB_HASH_SPLIT_MAGIC:
+			if (!(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT))
+				goto corrupt;
+			if (!tdb_check_record(tdb, off, &rec))
+				goto free;
+			record_offset(hashes[0], off);
+			break;
 		/* If we crash after ftruncate, we can get zeroes or fill. */
 		case TDB_RECOVERY_INVALID_MAGIC:
 		case 0x42424242:
@@ -458,6 +564,10 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 		goto free;
 	}
 
+	if ((tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) &&
+	    !tdb_check_freelist_classes(tdb))
+		goto free;
+
 	free(hashes);
 	if (locked) {
 		tdb_unlockall_read(tdb);
@@ -61,25 +61,53 @@ static tdb_off_t tdb_dump_record(struct tdb_context *tdb, int hash,
 static int tdb_dump_chain(struct tdb_context *tdb, int i)
 {
 	tdb_off_t rec_ptr, top;
-
-	top = TDB_HASH_TOP(i);
+	uint32_t buckets, bucket;
 
 	if (tdb_lock(tdb, i, F_WRLCK) != 0)
 		return -1;
 
-	if (tdb_ofs_read(tdb, top, &rec_ptr) == -1)
+	if (tdb_hash_buckets(tdb, &buckets) == -1)
 		return tdb_unlock(tdb, i, F_WRLCK);
 
-	if (rec_ptr)
-		printf("hash=%d\n", i);
+	/* the chain's own bucket and those split off it */
+	for (bucket = i; bucket < buckets; bucket += tdb->hash_size) {
+		top = tdb_bucket_top(tdb, bucket);
+		if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1)
+			break;
+
+		if (rec_ptr && bucket == i)
+			printf("hash=%d\n", i);
+		else if (rec_ptr)
+			printf("hash=%d bucket=%u\n", i, (unsigned)bucket);
 
-	while (rec_ptr) {
-		rec_ptr = tdb_dump_record(tdb, i, rec_ptr);
+		while (rec_ptr) {
+			rec_ptr = tdb_dump_record(tdb, i, rec_ptr);
+		}
 	}
 
 	return tdb_unlock(tdb, i, F_WRLCK);
 }
 
+static int tdb_dump_freelists(struct tdb_context *tdb)
+{
+	tdb_off_t rec_ptr;
+	unsigned int list;
+
+	if (tdb_lock(tdb, -1, F_WRLCK) != 0)
+		return -1;
+
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list), &rec_ptr) == -1)
+			break;
+
+		while (rec_ptr) {
+			rec_ptr = tdb_dump_record(tdb, -1, rec_ptr);
+		}
+	}
+
+	return tdb_unlock(tdb, -1, F_WRLCK);
+}
+
 _PUBLIC_ void tdb_dump_all(struct tdb_context *tdb)
 {
 	int i;
@@ -87,7 +115,7 @@ _PUBLIC_ void tdb_dump_all(struct tdb_context *tdb)
 		tdb_dump_chain(tdb, i);
 	}
 	printf("freelist:\n");
-	tdb_dump_chain(tdb, -1);
+	tdb_dump_freelists(tdb);
 }
 
 _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
@@ -96,41 +124,50 @@ _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
 	long total_free = 0;
 	tdb_off_t offset, rec_ptr;
 	struct tdb_record rec;
+	unsigned int list;
 
 	if ((ret = tdb_lock(tdb, -1, F_WRLCK)) != 0)
 		return ret;
 
-	offset = FREELIST_TOP;
-
-	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
-		tdb_unlock(tdb, -1, F_WRLCK);
-		return 0;
-	}
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		offset = tdb_freelist_top(tdb, list);
 
-	printf("freelist top=[0x%08x]\n", rec_ptr );
-	while (rec_ptr) {
-		if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
-					   sizeof(rec), DOCONV()) == -1) {
+		/* read in the freelist top */
+		if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
 			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+			return 0;
 		}
 
-		if (rec.magic != TDB_FREE_MAGIC) {
-			printf("bad magic 0x%08x in free list\n", rec.magic);
-			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+		if (tdb_freelist_count(tdb) > 1) {
+			if (rec_ptr == 0) {
+				continue;
+			}
+			printf("freelist class %u ", list);
 		}
 
-		printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
-		       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
-		total_free += rec.rec_len;
-
-		/* move to the next record */
-		rec_ptr = rec.next;
+		printf("freelist top=[0x%08x]\n", rec_ptr );
+		while (rec_ptr) {
+			if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
+						   sizeof(rec), DOCONV()) == -1) {
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			if (rec.magic != TDB_FREE_MAGIC) {
+				printf("bad magic 0x%08x in free list\n", rec.magic);
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
+			       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
+			total_free += rec.rec_len;
+
+			/* move to the next record */
+			rec_ptr = rec.next;
+		}
 	}
 	printf("total rec_len = [0x%08lx (%lu)]\n", total_free, total_free);
 
 	return tdb_unlock(tdb, -1, F_WRLCK);
 }
-
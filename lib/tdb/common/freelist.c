@@ -33,6 +33,59 @@
 */
 #define USE_RIGHT_MERGES 0
 
+/* how many records of the matching size class tdb_allocate looks at */
+#define TDB_FREELIST_CLASS_WALK 16
+
+/*
+ * With TDB_FEATURE_FLAG_FREELIST_CLASSES the free records are kept
+ * in TDB_FREELIST_CLASSES_NUM lists segregated by size: class 0 holds
+ * records shorter than 64 bytes, class c > 0 records of at least
+ * 32 << c bytes and the last class everything from 1MB up.
+ *
+ * A record sits in the list of its size class when it is linked in.
+ * It may grow later by merging with its right neighbour, so a list
+ * can contain larger records than its class, but never smaller ones.
+ */
+unsigned int tdb_freelist_class(tdb_len_t rec_len)
+{
+	unsigned int c = 0;
+
+	rec_len >>= 6;
+	while (rec_len != 0 && c < TDB_FREELIST_CLASSES_NUM - 1) {
+		rec_len >>= 1;
+		c++;
+	}
+	return c;
+}
+
+/* number of freelists in this database */
+unsigned int tdb_freelist_count(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return TDB_FREELIST_CLASSES_NUM;
+	}
+	return 1;
+}
+
+/* offset of the head pointer of freelist number "list" */
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int list)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return TDB_FREELIST_CLASS_TOP(list);
+	}
+	return FREELIST_TOP;
+}
+
+/* the freelist a free record of rec_len bytes belongs to */
+static unsigned int tdb_freelist_list(struct tdb_context *tdb,
+				      tdb_len_t rec_len)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return tdb_freelist_class(rec_len);
+	}
+	return 0;
+}
+
 /* read a freelist record and check for simple errors */
 int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record *rec)
 {
@@ -62,29 +115,48 @@ int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record
 }
 
 
-#if USE_RIGHT_MERGES
 /* Remove an element from the freelist.  Must have alloc lock. */
-static int remove_from_freelist(struct tdb_context *tdb, tdb_off_t off, tdb_off_t next)
+int tdb_remove_from_freelist(struct tdb_context *tdb, tdb_off_t off,
+			     tdb_off_t next)
 {
 	tdb_off_t last_ptr, i;
-
-	/* read in the freelist top */
-	last_ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, last_ptr, &i) != -1 && i != 0) {
-		if (i == off) {
-			/* We've found it! */
-			return tdb_ofs_write(tdb, last_ptr, &next);
+	unsigned int list;
+
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		/* read in the freelist top */
+		last_ptr = tdb_freelist_top(tdb, list);
+		while (tdb_ofs_read(tdb, last_ptr, &i) != -1 && i != 0) {
+			if (i == off) {
+				/* We've found it! */
+				return tdb_ofs_write(tdb, last_ptr, &next);
+			}
+			/* Follow chain (next offset is at start of record) */
+			last_ptr = i;
 		}
-		/* Follow chain (next offset is at start of record) */
-		last_ptr = i;
 	}
 	tdb->ecode = TDB_ERR_CORRUPT;
-	TDB_LOG((tdb, TDB_DEBUG_FATAL,"remove_from_freelist: not on list at off=%u\n", off));
+	TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_remove_from_freelist: not on list at off=%u\n", off));
 	return -1;
 }
-#endif
 
 
+/* prepend a free record to the freelist matching its size (must hold
+   allocation lock) */
+static int tdb_freelist_push(struct tdb_context *tdb, tdb_off_t offset,
+			     struct tdb_record *rec)
+{
+	tdb_off_t top;
+
+	top = tdb_freelist_top(tdb, tdb_freelist_list(tdb, rec->rec_len));
+
+	if (tdb_ofs_read(tdb, top, &rec->next) == -1 ||
+	    tdb_rec_write(tdb, offset, rec) == -1 ||
+	    tdb_ofs_write(tdb, top, &offset) == -1) {
+		return -1;
+	}
+	return 0;
+}
+
 /* update a record tailer (must hold allocation lock) */
 static int update_tailer(struct tdb_context *tdb, tdb_off_t offset,
 			 const struct tdb_record *rec)
@@ -293,6 +365,50 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
 	return 1;
 }
 
+/**
+ * A left merge may have grown a free record out of its size class.
+ * If we find it quickly in the list of its old class, move it to the
+ * list it belongs to now. Must have alloc lock.
+ */
+static int tdb_freelist_promote(struct tdb_context *tdb, tdb_off_t left_ptr,
+				struct tdb_record *left_rec, tdb_len_t old_len)
+{
+	tdb_off_t last_ptr, rec_ptr;
+	unsigned int list, walked;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)) {
+		return 0;
+	}
+
+	list = tdb_freelist_class(old_len);
+	if (tdb_freelist_class(left_rec->rec_len) == list) {
+		return 0;
+	}
+
+	last_ptr = TDB_FREELIST_CLASS_TOP(list);
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+		return -1;
+	}
+
+	for (walked = 0;
+	     rec_ptr != 0 && walked < TDB_FREELIST_CLASS_WALK;
+	     walked++) {
+		if (rec_ptr == left_ptr) {
+			if (tdb_ofs_write(tdb, last_ptr, &left_rec->next) == -1) {
+				return -1;
+			}
+			return tdb_freelist_push(tdb, left_ptr, left_rec);
+		}
+		/* Follow chain (next offset is at start of record) */
+		last_ptr = rec_ptr;
+		if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Add an element into the freelist.
  *
@@ -306,6 +422,8 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
  */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
+	tdb_off_t left_ptr;
+	struct tdb_record left_rec;
 	int ret;
 
 	/* Allocation and tailer lock */
@@ -331,7 +449,7 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 
 		/* If it's free, expand to include it. */
 		if (r.magic == TDB_FREE_MAGIC) {
-			if (remove_from_freelist(tdb, right, r.next) == -1) {
+			if (tdb_remove_from_freelist(tdb, right, r.next) == -1) {
 				TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: right free failed at %u\n", right));
 				goto left;
 			}
@@ -345,12 +463,20 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 left:
 #endif
 
-	ret = check_merge_with_left_record(tdb, offset, rec, NULL, NULL);
+	ret = check_merge_with_left_record(tdb, offset, rec,
+					   &left_ptr, &left_rec);
 	if (ret == -1) {
 		goto fail;
 	}
 	if (ret == 1) {
 		/* merged */
+		ret = tdb_freelist_promote(
+			tdb, left_ptr, &left_rec,
+			left_rec.rec_len - sizeof(*rec) - rec->rec_len);
+		if (ret == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: promote failed at offset=%u\n", left_ptr));
+			goto fail;
+		}
 		goto done;
 	}
 
@@ -358,9 +484,7 @@ left:
 
 	rec->magic = TDB_FREE_MAGIC;
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
-	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	if (tdb_freelist_push(tdb, offset, rec) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%u\n", offset));
 		goto fail;
 	}
@@ -385,11 +509,12 @@ done:
    not the beginning. This is so the left merge in a free is more likely to be
    able to free up the record without fragmentation
  */
+#define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
+
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 				  tdb_len_t length, tdb_off_t rec_ptr,
 				  struct tdb_record *rec, tdb_off_t last_ptr)
 {
-#define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
 
 	if (rec->rec_len < length + MIN_REC_SIZE) {
 		/* we have to grab the whole record */
@@ -434,6 +559,219 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
+/*
+   tdb_allocate_ofs for a record taken from size class freelist "list":
+   if the remainder left behind by the split falls below the size
+   class of that list, it moves to the list it now belongs to. With a
+   single freelist this is just tdb_allocate_ofs
+ */
+static tdb_off_t tdb_allocate_ofs_class(struct tdb_context *tdb,
+					tdb_len_t length, unsigned int list,
+					tdb_off_t rec_ptr,
+					struct tdb_record *rec,
+					tdb_off_t last_ptr)
+{
+	struct tdb_record remainder;
+	tdb_off_t newrec_ptr;
+
+	if (rec->rec_len < length + MIN_REC_SIZE) {
+		return tdb_allocate_ofs(tdb, length, rec_ptr, rec, last_ptr);
+	}
+
+	remainder = *rec;
+	remainder.rec_len -= length + sizeof(*rec);
+
+	if (tdb_freelist_class(remainder.rec_len) >= list) {
+		return tdb_allocate_ofs(tdb, length, rec_ptr, rec, last_ptr);
+	}
+
+	/* unlink it from the previous record */
+	if (tdb_ofs_write(tdb, last_ptr, &rec->next) == -1) {
+		return 0;
+	}
+
+	newrec_ptr = tdb_allocate_ofs(tdb, length, rec_ptr, rec, last_ptr);
+	if (newrec_ptr == 0) {
+		return 0;
+	}
+
+	if (tdb_freelist_push(tdb, rec_ptr, &remainder) == -1) {
+		return 0;
+	}
+
+	return newrec_ptr;
+}
+
+/*
+   first fit allocation from size class freelist "list", looking at no
+   more than max_walk records (0 means no limit). *newrec_ptr is 0 if
+   nothing fits.
+ */
+static int tdb_allocate_from_class_list(struct tdb_context *tdb,
+					tdb_len_t length, unsigned int list,
+					unsigned int max_walk,
+					struct tdb_record *rec,
+					tdb_off_t *newrec_ptr)
+{
+	tdb_off_t rec_ptr, last_ptr;
+	unsigned int walked = 0;
+
+	*newrec_ptr = 0;
+
+	last_ptr = TDB_FREELIST_CLASS_TOP(list);
+
+	/* read in the freelist top */
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+		return -1;
+	}
+
+	while (rec_ptr) {
+		int ret;
+
+		if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
+			return -1;
+		}
+
+		/*
+		 * The enlarged left neighbour stays in whatever list it is
+		 * in: it may well be the record we came from in this one.
+		 * tdb_allocate_from_classes copes with big records in
+		 * small lists.
+		 */
+		ret = check_merge_with_left_record(tdb, rec_ptr, rec,
+						   NULL, NULL);
+		if (ret == -1) {
+			return -1;
+		}
+		if (ret == 1) {
+			/* merged */
+			rec_ptr = rec->next;
+			ret = tdb_ofs_write(tdb, last_ptr, &rec->next);
+			if (ret == -1) {
+				return -1;
+			}
+			continue;
+		}
+
+		if (rec->rec_len >= length) {
+			*newrec_ptr = tdb_allocate_ofs_class(tdb, length, list,
+							     rec_ptr, rec,
+							     last_ptr);
+			if (*newrec_ptr == 0) {
+				return -1;
+			}
+			return 0;
+		}
+
+		/* move to the next record */
+		last_ptr = rec_ptr;
+		rec_ptr = rec->next;
+
+		if (++walked == max_walk) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+   allocation from the size class freelists: a few records of the
+   matching class are looked at, then any record of a bigger class
+   fits, so normally allocation does not depend on the length of the
+   freelist.
+
+   Records grown by left merges can sit in the lists of smaller
+   classes. Before expanding the database, those lists are searched
+   completely.
+ */
+static tdb_off_t tdb_allocate_from_classes(
+	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+{
+	unsigned int class = tdb_freelist_class(length);
+	unsigned int list;
+	tdb_off_t newrec_ptr;
+
+ again:
+	for (list = class; list < TDB_FREELIST_CLASSES_NUM; list++) {
+		if (tdb_allocate_from_class_list(tdb, length, list,
+						 TDB_FREELIST_CLASS_WALK,
+						 rec, &newrec_ptr) == -1) {
+			return 0;
+		}
+		if (newrec_ptr != 0) {
+			return newrec_ptr;
+		}
+	}
+
+	for (list = 0; list <= class; list++) {
+		if (tdb_allocate_from_class_list(tdb, length, list, 0,
+						 rec, &newrec_ptr) == -1) {
+			return 0;
+		}
+		if (newrec_ptr != 0) {
+			return newrec_ptr;
+		}
+	}
+
+	/* we didn't find enough space. See if we can expand the
+	   database and if we can then try again */
+	if (tdb_expand(tdb, length + sizeof(*rec)) == 0) {
+		goto again;
+	}
+
+	return 0;
+}
+
+/*
+   allocate room for length bytes of key and data from a free record
+   that lies completely below limit, used to move records towards the
+   start of the file. First fit, no merging, must have the allocation
+   lock.
+
+   0 is returned if nothing below limit fits
+ */
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     tdb_off_t limit, struct tdb_record *rec)
+{
+	tdb_off_t rec_ptr, last_ptr;
+	unsigned int list;
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	for (list = tdb_freelist_list(tdb, length);
+	     list < tdb_freelist_count(tdb);
+	     list++) {
+		last_ptr = tdb_freelist_top(tdb, list);
+
+		/* read in the freelist top */
+		if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+			return 0;
+		}
+
+		while (rec_ptr) {
+			if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
+				return 0;
+			}
+
+			if (rec->rec_len >= length &&
+			    rec_ptr + sizeof(*rec) + rec->rec_len <= limit) {
+				return tdb_allocate_ofs_class(tdb, length,
+							      list, rec_ptr,
+							      rec, last_ptr);
+			}
+
+			/* move to the next record */
+			last_ptr = rec_ptr;
+			rec_ptr = rec->next;
+		}
+	}
+
+	return 0;
+}
+
 /* allocate some space from the free list. The offset returned points
    to a unconnected tdb_record within the database with room for at
    least length bytes of total data
@@ -458,6 +796,10 @@ static tdb_off_t tdb_allocate_from_freelist(
 	length += sizeof(tdb_off_t);
 	length = TDB_ALIGN(length, TDB_ALIGNMENT);
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return tdb_allocate_from_classes(tdb, length, rec);
+	}
+
  again:
 	merge_created_candidate = false;
 	last_ptr = FREELIST_TOP;
@@ -666,13 +1008,52 @@ blocking_freelist_allocate:
 	return ret;
 }
 
+/**
+ * Move a free record that outgrew the size class of freelist "list"
+ * to the list it belongs to. cur is its predecessor in the list.
+ *
+ * Return code:
+ *  -1 upon error
+ *   0 if the record is in the right list
+ *   1 if the record was moved
+ */
+static int tdb_freelist_reclass(struct tdb_context *tdb, unsigned int list,
+				tdb_off_t cur, tdb_off_t rec_ptr)
+{
+	struct tdb_record rec;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)) {
+		return 0;
+	}
+
+	if (tdb_rec_free_read(tdb, rec_ptr, &rec) == -1) {
+		return -1;
+	}
+
+	if (tdb_freelist_class(rec.rec_len) <= list) {
+		return 0;
+	}
+
+	if (tdb_ofs_write(tdb, cur, &rec.next) == -1 ||
+	    tdb_freelist_push(tdb, rec_ptr, &rec) == -1) {
+		return -1;
+	}
+
+	return 1;
+}
+
 /**
  * Merge adjacent records in the freelist.
+ *
+ * With size class freelists the lists are walked from big to small
+ * records, records that outgrew their class are moved to lists we
+ * are done with.
  */
 static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 				       int *count_records, int *count_merged)
 {
 	tdb_off_t cur, next;
+	unsigned int list;
 	int count = 0;
 	int merged = 0;
 	int ret;
@@ -682,32 +1063,49 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 		return -1;
 	}
 
-	cur = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
-		tdb_off_t next2;
+	list = tdb_freelist_count(tdb);
+	while (list-- > 0) {
+		cur = tdb_freelist_top(tdb, list);
 
-		count++;
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			tdb_off_t next2;
 
-		ret = check_merge_ptr_with_left_record(tdb, next, &next2);
-		if (ret == -1) {
-			goto done;
-		}
-		if (ret == 1) {
-			/*
-			 * merged:
-			 * now let cur->next point to next2 instead of next
-			 */
+			count++;
+
+			ret = check_merge_ptr_with_left_record(tdb, next,
+							       &next2);
+			if (ret == -1) {
+				goto done;
+			}
+			if (ret == 1) {
+				/*
+				 * merged:
+				 * now let cur->next point to next2 instead
+				 * of next, next2 is looked at next. Just
+				 * moving on to next2 would read the header
+				 * at the end of the list.
+				 */
+
+				ret = tdb_ofs_write(tdb, cur, &next2);
+				if (ret != 0) {
+					goto done;
+				}
+
+				merged++;
+				continue;
+			}
 
-			ret = tdb_ofs_write(tdb, cur, &next2);
-			if (ret != 0) {
+			ret = tdb_freelist_reclass(tdb, list, cur, next);
+			if (ret == -1) {
 				goto done;
 			}
+			if (ret == 1) {
+				/* cur->next has changed */
+				continue;
+			}
 
-			next = next2;
-			merged++;
+			cur = next;
 		}
-
-		cur = next;
 	}
 
 	if (count_records != NULL) {
@@ -731,15 +1129,18 @@ done:
 static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 {
 	tdb_off_t ptr;
+	unsigned int list;
 	int count=0;
 
 	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
 		return -1;
 	}
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		ptr = tdb_freelist_top(tdb, list);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
 	}
 
 	tdb_unlock(tdb, -1, F_RDLCK);
@@ -272,7 +272,14 @@ static int tdb_read(struct tdb_context *tdb, tdb_off_t off, void *buf,
 static void tdb_next_hash_chain(struct tdb_context *tdb, uint32_t *chain)
 {
 	uint32_t h = *chain;
-	if (tdb->map_ptr) {
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT) {
+		/* a chain is only empty if its split buckets are too */
+		for (;h < tdb->hash_size;h++) {
+			if (!tdb_hash_split_empty(tdb, h)) {
+				break;
+			}
+		}
+	} else if (tdb->map_ptr) {
 		for (;h < tdb->hash_size;h++) {
 			if (0 != *(uint32_t *)(TDB_HASH_TOP(h) + (unsigned char *)tdb->map_ptr)) {
 				break;
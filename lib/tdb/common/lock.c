@@ -143,6 +143,32 @@ static tdb_off_t lock_offset(int list)
 	return FREELIST_TOP + 4*list;
 }
 
+/*
+ * With TDB_STATISTICS, find out whether a blocking chain lock has to
+ * wait and for how long.
+ */
+static int tdb_brlock_stats(struct tdb_context *tdb,
+			    int rw_type, tdb_off_t offset, size_t len,
+			    int list)
+{
+	struct timeval start, end;
+	int ret;
+
+	ret = fcntl_lock(tdb, rw_type, offset, len, false);
+	if (ret == 0 || (errno != EAGAIN && errno != EACCES)) {
+		return ret;
+	}
+
+	gettimeofday(&start, NULL);
+	ret = fcntl_lock(tdb, rw_type, offset, len, true);
+	gettimeofday(&end, NULL);
+
+	tdb_stats_lock_wait(tdb, list,
+			    (end.tv_sec - start.tv_sec) * 1000000ULL +
+			    end.tv_usec - start.tv_usec);
+	return ret;
+}
+
 /* a byte range locking function - return 0 on success
    this functions locks/unlocks "len" byte at the specified offset.
 
@@ -155,7 +181,7 @@ int tdb_brlock(struct tdb_context *tdb,
 	       int rw_type, tdb_off_t offset, size_t len,
 	       enum tdb_lock_flags flags)
 {
-	int ret;
+	int ret, list;
 
 	if (tdb->flags & TDB_NOLOCK) {
 		return 0;
@@ -171,8 +197,15 @@ int tdb_brlock(struct tdb_context *tdb,
 	}
 
 	do {
-		ret = fcntl_lock(tdb, rw_type, offset, len,
-				 flags & TDB_LOCK_WAIT);
+		if (tdb->stats_rw &&
+		    (flags & TDB_LOCK_WAIT) &&
+		    tdb_stats_lock_list(tdb, offset, len, &list)) {
+			ret = tdb_brlock_stats(tdb, rw_type, offset, len,
+					       list);
+		} else {
+			ret = fcntl_lock(tdb, rw_type, offset, len,
+					 flags & TDB_LOCK_WAIT);
+		}
 		/* Check for a sigalarm break. */
 		if (ret == -1 && errno == EINTR &&
 				tdb->interrupt_sig_ptr &&
@@ -865,6 +898,93 @@ _PUBLIC_ int tdb_chainlock_read_nonblock(struct tdb_context *tdb, TDB_DATA key)
 	return ret;
 }
 
+static int tdb_list_cmp(const void *p1, const void *p2)
+{
+	uint32_t l1 = *(const uint32_t *)p1;
+	uint32_t l2 = *(const uint32_t *)p2;
+
+	if (l1 < l2) {
+		return -1;
+	}
+	return (l1 > l2) ? 1 : 0;
+}
+
+/* the sorted chains of a set of keys, without duplicates */
+static int tdb_multi_lists(struct tdb_context *tdb,
+			   const TDB_DATA *keys, size_t num_keys,
+			   uint32_t **plists, size_t *pnum_lists)
+{
+	uint32_t *lists;
+	size_t i, num_lists;
+
+	lists = (uint32_t *)malloc(sizeof(uint32_t) * (num_keys ? num_keys : 1));
+	if (lists == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+	for (i = 0; i < num_keys; i++) {
+		TDB_DATA key = keys[i];
+		lists[i] = BUCKET(tdb->hash_fn(&key));
+	}
+	qsort(lists, num_keys, sizeof(uint32_t), tdb_list_cmp);
+
+	num_lists = 0;
+	for (i = 0; i < num_keys; i++) {
+		if (num_lists == 0 || lists[num_lists-1] != lists[i]) {
+			lists[num_lists++] = lists[i];
+		}
+	}
+
+	*plists = lists;
+	*pnum_lists = num_lists;
+	return 0;
+}
+
+/* lock the chains of a set of keys, see tdb.h */
+_PUBLIC_ int tdb_chainlock_multi(struct tdb_context *tdb,
+				 const TDB_DATA *keys, size_t num_keys)
+{
+	uint32_t *lists;
+	size_t i, num_lists;
+
+	if (tdb_multi_lists(tdb, keys, num_keys, &lists, &num_lists) == -1) {
+		return -1;
+	}
+	for (i = 0; i < num_lists; i++) {
+		if (tdb_lock(tdb, lists[i], F_WRLCK) == -1) {
+			while (i-- > 0) {
+				tdb_unlock(tdb, lists[i], F_WRLCK);
+			}
+			SAFE_FREE(lists);
+			tdb_trace_ret(tdb, "tdb_chainlock_multi", -1);
+			return -1;
+		}
+	}
+	SAFE_FREE(lists);
+	tdb_trace_ret(tdb, "tdb_chainlock_multi", 0);
+	return 0;
+}
+
+_PUBLIC_ int tdb_chainunlock_multi(struct tdb_context *tdb,
+				   const TDB_DATA *keys, size_t num_keys)
+{
+	uint32_t *lists;
+	size_t i, num_lists;
+	int ret = 0;
+
+	tdb_trace(tdb, "tdb_chainunlock_multi");
+	if (tdb_multi_lists(tdb, keys, num_keys, &lists, &num_lists) == -1) {
+		return -1;
+	}
+	for (i = num_lists; i-- > 0; ) {
+		if (tdb_unlock(tdb, lists[i], F_WRLCK) == -1) {
+			ret = -1;
+		}
+	}
+	SAFE_FREE(lists);
+	return ret;
+}
+
 /* record lock stops delete underneath */
 int tdb_lock_record(struct tdb_context *tdb, tdb_off_t off)
 {
@@ -75,11 +75,52 @@ struct tdb_mutexes {
 	pthread_mutex_t hashchains[1];
 };
 
+/*
+ * With TDB_FEATURE_FLAG_SEQLOCK the mutex area continues with an
+ * array of sequence counters behind the hashchain mutexes, indexed
+ * like them. A chain's counter is odd while its mutex is held. Index
+ * 0 is not used for the freelist but for the allrecord lock: it is
+ * odd while someone holds the allrecord lock for writing, as that
+ * writes into the chains without taking their mutexes.
+ *
+ * A reader that sees the same even counters for its chain and the
+ * allrecord lock before and after looking at the chain did not race
+ * with a writer, so it does not need to lock the chain.
+ */
+static volatile uint32_t *tdb_mutex_seqlocks(struct tdb_context *tdb)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+
+	return (volatile uint32_t *)&m->hashchains[tdb->hash_size+1];
+}
+
+static void tdb_seqlock_enter(volatile uint32_t *seq)
+{
+	/* A dead holder might have left it odd, it has to change anyway */
+	*seq = (*seq + 1) | 1;
+	__sync_synchronize();
+}
+
+static void tdb_seqlock_leave(volatile uint32_t *seq)
+{
+	__sync_synchronize();
+	*seq = (*seq + 1) & ~1;
+}
+
 bool tdb_have_mutexes(struct tdb_context *tdb)
 {
 	return ((tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) != 0);
 }
 
+bool tdb_have_seqlocks(struct tdb_context *tdb)
+{
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK)) {
+		return false;
+	}
+	/* NOLOCK does not map the mutex area */
+	return (tdb->mutexes != NULL);
+}
+
 size_t tdb_mutex_size(struct tdb_context *tdb)
 {
 	size_t mutex_size;
@@ -91,6 +132,10 @@ size_t tdb_mutex_size(struct tdb_context *tdb)
 	mutex_size = sizeof(struct tdb_mutexes);
 	mutex_size += tdb->hash_size * sizeof(pthread_mutex_t);
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) {
+		mutex_size += (tdb->hash_size + 1) * sizeof(uint32_t);
+	}
+
 	return TDB_ALIGN(mutex_size, tdb->page_size);
 }
 
@@ -193,7 +238,8 @@ static int chain_mutex_lock(pthread_mutex_t *m, bool waitflag)
 	return pthread_mutex_consistent(m);
 }
 
-static int allrecord_mutex_lock(struct tdb_mutexes *m, bool waitflag)
+static int allrecord_mutex_lock(struct tdb_mutexes *m,
+				volatile uint32_t *seqlocks, bool waitflag)
 {
 	int ret;
 
@@ -211,6 +257,9 @@ static int allrecord_mutex_lock(struct tdb_mutexes *m, bool waitflag)
 	 * to F_UNLCK. This should also be the indication for
 	 * tdb_needs_recovery.
 	 */
+	if (m->allrecord_lock == F_WRLCK && seqlocks != NULL) {
+		tdb_seqlock_leave(&seqlocks[0]);
+	}
 	m->allrecord_lock = F_UNLCK;
 
 	return pthread_mutex_consistent(&m->allrecord_mutex);
@@ -220,6 +269,7 @@ bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 		    bool waitflag, int *pret)
 {
 	struct tdb_mutexes *m = tdb->mutexes;
+	volatile uint32_t *seqlocks = NULL;
 	pthread_mutex_t *chain;
 	int ret;
 	unsigned idx;
@@ -230,6 +280,10 @@ bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 	}
 	chain = &m->hashchains[idx];
 
+	if (tdb_have_seqlocks(tdb)) {
+		seqlocks = tdb_mutex_seqlocks(tdb);
+	}
+
 again:
 	ret = chain_mutex_lock(chain, waitflag);
 	if (ret == EBUSY) {
@@ -268,6 +322,9 @@ again:
 		 * chain lock.
 		 */
 
+		if (seqlocks != NULL) {
+			tdb_seqlock_enter(&seqlocks[idx]);
+		}
 		*pret = 0;
 		return true;
 	}
@@ -293,6 +350,9 @@ again:
 	}
 
 	if (allrecord_ok) {
+		if (seqlocks != NULL) {
+			tdb_seqlock_enter(&seqlocks[idx]);
+		}
 		*pret = 0;
 		return true;
 	}
@@ -304,7 +364,7 @@ again:
 		errno = ret;
 		goto fail;
 	}
-	ret = allrecord_mutex_lock(m, waitflag);
+	ret = allrecord_mutex_lock(m, seqlocks, waitflag);
 	if (ret == EBUSY) {
 		ret = EAGAIN;
 	}
@@ -344,6 +404,10 @@ bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 	}
 	chain = &m->hashchains[idx];
 
+	if (idx != 0 && tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_leave(&tdb_mutex_seqlocks(tdb)[idx]);
+	}
+
 	ret = pthread_mutex_unlock(chain);
 	if (ret == 0) {
 		*pret = 0;
@@ -358,6 +422,7 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags)
 {
 	struct tdb_mutexes *m = tdb->mutexes;
+	volatile uint32_t *seqlocks = NULL;
 	int ret;
 	uint32_t i;
 	bool waitflag = (flags & TDB_LOCK_WAIT);
@@ -371,7 +436,11 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 		return 0;
 	}
 
-	ret = allrecord_mutex_lock(m, waitflag);
+	if (tdb_have_seqlocks(tdb)) {
+		seqlocks = tdb_mutex_seqlocks(tdb);
+	}
+
+	ret = allrecord_mutex_lock(m, seqlocks, waitflag);
 	if (!waitflag && (ret == EBUSY)) {
 		errno = EAGAIN;
 		tdb->ecode = TDB_ERR_LOCK;
@@ -422,6 +491,10 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			goto fail_unroll_allrecord_lock;
 		}
 	}
+	if ((m->allrecord_lock == F_WRLCK) && (seqlocks != NULL)) {
+		tdb_seqlock_enter(&seqlocks[0]);
+	}
+
 	/*
 	 * We leave this routine with m->allrecord_mutex locked
 	 */
@@ -488,6 +561,10 @@ int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
 		}
 	}
 
+	if (tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_enter(&tdb_mutex_seqlocks(tdb)[0]);
+	}
+
 	return 0;
 
 fail_unroll_allrecord_lock:
@@ -513,6 +590,10 @@ void tdb_mutex_allrecord_downgrade(struct tdb_context *tdb)
 		return;
 	}
 
+	if (tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_leave(&tdb_mutex_seqlocks(tdb)[0]);
+	}
+
 	m->allrecord_lock = F_RDLCK;
 	return;
 }
@@ -543,6 +624,9 @@ int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
 	}
 
 	old = m->allrecord_lock;
+	if ((old == F_WRLCK) && tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_leave(&tdb_mutex_seqlocks(tdb)[0]);
+	}
 	m->allrecord_lock = F_UNLCK;
 
 	ret = pthread_mutex_unlock(&m->allrecord_mutex);
@@ -555,6 +639,37 @@ int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
 	return 0;
 }
 
+/*
+ * Start a lockless read of hash chain "list". Returns false if the
+ * chain or the whole database is being written to, the caller then
+ * has to retry or take the lock.
+ */
+bool tdb_mutex_seqlock_read_begin(struct tdb_context *tdb, uint32_t list,
+				  uint32_t seq[2])
+{
+	volatile uint32_t *seqlocks = tdb_mutex_seqlocks(tdb);
+
+	seq[0] = seqlocks[0];
+	seq[1] = seqlocks[list+1];
+	__sync_synchronize();
+
+	return (((seq[0] | seq[1]) & 1) == 0);
+}
+
+/*
+ * Returns true if nobody wrote to hash chain "list" since
+ * tdb_mutex_seqlock_read_begin() returned seq.
+ */
+bool tdb_mutex_seqlock_read_valid(struct tdb_context *tdb, uint32_t list,
+				  const uint32_t seq[2])
+{
+	volatile uint32_t *seqlocks = tdb_mutex_seqlocks(tdb);
+
+	__sync_synchronize();
+
+	return ((seqlocks[0] == seq[0]) && (seqlocks[list+1] == seq[1]));
+}
+
 int tdb_mutex_init(struct tdb_context *tdb)
 {
 	struct tdb_mutexes *m;
@@ -595,6 +710,14 @@ int tdb_mutex_init(struct tdb_context *tdb)
 
 	m->allrecord_lock = F_UNLCK;
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) {
+		volatile uint32_t *seqlocks = tdb_mutex_seqlocks(tdb);
+
+		for (i=0; i<tdb->hash_size+1; i++) {
+			seqlocks[i] = 0;
+		}
+	}
+
 	ret = pthread_mutex_init(&m->allrecord_mutex, &ma);
 	if (ret != 0) {
 		goto fail;
@@ -978,6 +1101,23 @@ bool tdb_have_mutexes(struct tdb_context *tdb)
 	return false;
 }
 
+bool tdb_have_seqlocks(struct tdb_context *tdb)
+{
+	return false;
+}
+
+bool tdb_mutex_seqlock_read_begin(struct tdb_context *tdb, uint32_t list,
+				  uint32_t seq[2])
+{
+	return false;
+}
+
+bool tdb_mutex_seqlock_read_valid(struct tdb_context *tdb, uint32_t list,
+				  const uint32_t seq[2])
+{
+	return false;
+}
+
 int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags)
 {
@@ -73,7 +73,7 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 
 	/* Make sure older tdbs (which don't check the magic hash fields)
 	 * will refuse to open this TDB. */
-	if (tdb->flags & TDB_INCOMPATIBLE_HASH)
+	if (tdb->flags & (TDB_INCOMPATIBLE_HASH|TDB_XXHASH))
 		newdb->rwlocks = TDB_HASH_RWLOCK_MAGIC;
 
 	/*
@@ -85,6 +85,18 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX;
 	}
 
+	if (tdb->flags & TDB_FREELIST_CLASSES) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELIST_CLASSES;
+	}
+
+	if (tdb->flags & TDB_SEQLOCK_READS) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_SEQLOCK;
+	}
+
+	if (tdb->flags & TDB_HASH_SPLIT) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_HASH_SPLIT;
+	}
+
 	/*
 	 * If we have any features we add the FEATURE_FLAG_MAGIC, overwriting the
 	 * TDB_HASH_RWLOCK_MAGIC above.
@@ -209,6 +221,12 @@ static bool check_header_hash(struct tdb_context *tdb,
 			      struct tdb_header *header,
 			      bool default_hash, uint32_t *m1, uint32_t *m2)
 {
+	static const tdb_hash_func inbuilt_hashes[] = {
+		tdb_old_hash, tdb_jenkins_hash, tdb_xxhash
+	};
+	tdb_hash_func hash_fn = tdb->hash_fn;
+	size_t i;
+
 	tdb_header_hash(tdb, m1, m2);
 	if (header->magic1_hash == *m1 &&
 	    header->magic2_hash == *m2) {
@@ -219,12 +237,27 @@ static bool check_header_hash(struct tdb_context *tdb,
 	if (!default_hash)
 		return false;
 
-	/* Otherwise, try the other inbuilt hash. */
-	if (tdb->hash_fn == tdb_old_hash)
-		tdb->hash_fn = tdb_jenkins_hash;
-	else
-		tdb->hash_fn = tdb_old_hash;
-	return check_header_hash(tdb, header, false, m1, m2);
+	/* Otherwise, try the other inbuilt hashes. */
+	for (i = 0; i < ARRAY_SIZE(inbuilt_hashes); i++) {
+		uint32_t o1, o2;
+
+		if (inbuilt_hashes[i] == hash_fn) {
+			continue;
+		}
+
+		tdb->hash_fn = inbuilt_hashes[i];
+		tdb_header_hash(tdb, &o1, &o2);
+		if (header->magic1_hash == o1 &&
+		    header->magic2_hash == o2) {
+			*m1 = o1;
+			*m2 = o2;
+			return true;
+		}
+	}
+
+	/* Report the magic of the hash we were asked to use. */
+	tdb->hash_fn = hash_fn;
+	return false;
 }
 
 static bool tdb_mutex_open_ok(struct tdb_context *tdb,
@@ -370,12 +403,14 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		hash_alg = "the user defined";
 	} else {
 		/* This controls what we use when creating a tdb. */
-		if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
+		if (tdb->flags & TDB_XXHASH) {
+			tdb->hash_fn = tdb_xxhash;
+		} else if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
 			tdb->hash_fn = tdb_jenkins_hash;
 		} else {
 			tdb->hash_fn = tdb_old_hash;
 		}
-		hash_alg = "either default";
+		hash_alg = "any inbuilt";
 	}
 
 	/* cache the page size */
@@ -399,7 +434,8 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		tdb->read_only = 1;
 		/* read only databases don't do locking or clear if first */
 		tdb->flags |= TDB_NOLOCK;
-		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING);
+		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING|
+				TDB_SEQLOCK_READS|TDB_STATISTICS);
 	}
 
 	if ((tdb->flags & TDB_ALLOW_NESTING) &&
@@ -411,6 +447,15 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		goto fail;
 	}
 
+	if ((tdb->flags & TDB_SEQLOCK_READS) &&
+	    !(tdb->flags & TDB_MUTEX_LOCKING)) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+			"invalid flags for %s - TDB_SEQLOCK_READS "
+			"requires TDB_MUTEX_LOCKING\n", name));
+		errno = EINVAL;
+		goto fail;
+	}
+
 	if (tdb->flags & TDB_MUTEX_LOCKING) {
 		/*
 		 * Here we catch bugs in the callers,
@@ -484,7 +529,7 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 	/* internal databases don't mmap or lock, and start off cleared */
 	if (tdb->flags & TDB_INTERNAL) {
 		tdb->flags |= (TDB_NOLOCK | TDB_NOMMAP);
-		tdb->flags &= ~TDB_CLEAR_IF_FIRST;
+		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_STATISTICS);
 		if (tdb_new_database(tdb, &header, hash_size) != 0) {
 			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: tdb_new_database failed!"));
 			goto fail;
@@ -681,6 +726,10 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		}
 	}
 
+	if (tdb->flags & TDB_STATISTICS) {
+		tdb_stats_open(tdb, mode, locked);
+	}
+
 	if (locked) {
 		if (tdb_nest_unlock(tdb, ACTIVE_LOCK, F_WRLCK, false) == -1) {
 			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
@@ -750,6 +799,7 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		else
 			tdb_munmap(tdb);
 	}
+	tdb_stats_munmap(tdb);
 	if (tdb->fd != -1)
 		if (close(tdb->fd) != 0)
 			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: failed to close tdb->fd on error!\n"));
@@ -793,6 +843,7 @@ _PUBLIC_ int tdb_close(struct tdb_context *tdb)
 	}
 
 	tdb_mutex_munmap(tdb);
+	tdb_stats_munmap(tdb);
 
 	SAFE_FREE(tdb->name);
 	if (tdb->fd != -1) {
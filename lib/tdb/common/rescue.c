@@ -206,6 +206,46 @@ static void logging_suppressed(struct tdb_context *tdb,
 {
 }
 
+static void vet_chain(struct tdb_context *tdb,
+		      struct found_table *found,
+		      tdb_off_t top,
+		      bool is_free)
+{
+	bool slow_chase = false;
+	tdb_off_t slow_off = top;
+	tdb_off_t off;
+	struct tdb_record rec;
+
+	if (tdb_ofs_read(tdb, top, &off) == -1)
+		return;
+
+	while (off && off != slow_off) {
+		if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
+					   DOCONV()) != 0) {
+			break;
+		}
+
+		if (is_free) {
+			/* Don't mark garbage as free. */
+			if (rec.magic != TDB_FREE_MAGIC) {
+				break;
+			}
+			mark_free_area(found, off, sizeof(rec) + rec.rec_len);
+		} else {
+			found_in_hashchain(found, off);
+		}
+
+		off = rec.next;
+
+		/* Loop detection using second pointer at half-speed */
+		if (slow_chase) {
+			/* First entry happens to be next ptr */
+			tdb_ofs_read(tdb, slow_off, &slow_off);
+		}
+		slow_chase = !slow_chase;
+	}
+}
+
 _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 			void (*walk)(TDB_DATA, TDB_DATA, void *private_data),
 			void *private_data)
@@ -250,39 +290,15 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 
 	/* Walk hash chains to positive vet. */
 	for (h = 0; h < 1+tdb->hash_size; h++) {
-		bool slow_chase = false;
-		tdb_off_t slow_off = FREELIST_TOP + h*sizeof(tdb_off_t);
-
-		if (tdb_ofs_read(tdb, FREELIST_TOP + h*sizeof(tdb_off_t),
-				 &off) == -1)
-			continue;
-
-		while (off && off != slow_off) {
-			if (tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
-						   DOCONV()) != 0) {
-				break;
-			}
-
-			/* 0 is the free list, rest are hash chains. */
-			if (h == 0) {
-				/* Don't mark garbage as free. */
-				if (rec.magic != TDB_FREE_MAGIC) {
-					break;
-				}
-				mark_free_area(&found, off,
-					       sizeof(rec) + rec.rec_len);
-			} else {
-				found_in_hashchain(&found, off);
-			}
-
-			off = rec.next;
+		/* 0 is the free list, rest are hash chains. */
+		vet_chain(tdb, &found, FREELIST_TOP + h*sizeof(tdb_off_t),
+			  h == 0);
+	}
 
-			/* Loop detection using second pointer at half-speed */
-			if (slow_chase) {
-				/* First entry happens to be next ptr */
-				tdb_ofs_read(tdb, slow_off, &slow_off);
-			}
-			slow_chase = !slow_chase;
+	/* Size class free lists start in the header. */
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		for (h = 0; h < TDB_FREELIST_CLASSES_NUM; h++) {
+			vet_chain(tdb, &found, TDB_FREELIST_CLASS_TOP(h), true);
 		}
 	}
 
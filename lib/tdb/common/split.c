@@ -0,0 +1,501 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   trivial database library - growing the hash table by splitting chains
+
+     ** NOTE! The following LGPL license applies to the tdb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+#include "tdb_private.h"
+
+/*
+ * With TDB_FEATURE_FLAG_HASH_SPLIT the hash table grows one bucket at
+ * a time, linear hashing style. header.hash_split buckets have been
+ * split off so far, there are hash_size + hash_split buckets.
+ *
+ * In round "level" the table grows from size = hash_size << level to
+ * 2 * size buckets: bucket p = hash_split - (size - hash_size) is split
+ * into p and p + size, moving the records with hash % (2 * size) !=
+ * p. A key lives in bucket hash % size, or hash % (2 * size) if that
+ * one was split already.
+ *
+ * All buckets of a key are congruent modulo hash_size, so the chain
+ * locks, mutexes and statistics stay per hash % hash_size ("list").
+ * One list lock covers all buckets split off it, and splitting bucket
+ * p only needs the lock of list p % hash_size. header.hash_split is
+ * only changed under that lock, and a split never changes the bucket
+ * of a key in another list, so a reader holding its list lock always
+ * sees a consistent bucket.
+ *
+ * The first hash_size buckets are the normal hash table. The buckets
+ * of round "level" are in a segment record allocated from the data
+ * area. header.hash_split_dir points to a record holding the offsets
+ * of TDB_HASH_SPLIT_LEVELS segments. Both kinds of records are marked
+ * with TDB_HASH_SPLIT_MAGIC and are never freed, only tdb_wipe_all()
+ * drops them.
+ *
+ * A split is done by a writer after a store that added a record,
+ * if the average chain length it walked exceeds
+ * TDB_HASH_SPLIT_CHAIN_LEN, as long as the list lock of p can be had
+ * without blocking. It is skipped within transactions and traversals,
+ * and if anyone has a record of bucket p locked, as a traversal could
+ * be positioned there.
+ */
+
+#define TDB_HASH_SPLIT_CHAIN_LEN 2
+
+/* the moving average of the walked chain lengths is scaled by this */
+#define TDB_HASH_SPLIT_AVG_SCALE 16
+
+static tdb_off_t tdb_split_seg_top(tdb_off_t seg, tdb_off_t idx)
+{
+	return seg + sizeof(struct tdb_record) + idx * sizeof(tdb_off_t);
+}
+
+/* Number of buckets at the start of the round "buckets" is in */
+static uint64_t tdb_split_round_size(struct tdb_context *tdb,
+				     uint32_t buckets, unsigned int *level)
+{
+	uint64_t size = tdb->hash_size;
+	unsigned int l = 0;
+
+	while (size * 2 <= buckets) {
+		size *= 2;
+		l += 1;
+	}
+	if (level != NULL) {
+		*level = l;
+	}
+	return size;
+}
+
+static int tdb_split_buckets_read(struct tdb_context *tdb,
+				  int (*ofs_read)(struct tdb_context *tdb,
+						  tdb_off_t offset,
+						  tdb_off_t *d),
+				  uint32_t *buckets)
+{
+	tdb_off_t split;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT)) {
+		*buckets = tdb->hash_size;
+		return 0;
+	}
+	if (ofs_read(tdb, TDB_HASH_SPLIT_OFS, &split) == -1) {
+		return -1;
+	}
+	if (split > UINT32_MAX - tdb->hash_size) {
+		tdb->ecode = TDB_ERR_CORRUPT;
+		return -1;
+	}
+	*buckets = tdb->hash_size + split;
+	return 0;
+}
+
+static uint32_t tdb_split_bucket(struct tdb_context *tdb, uint32_t buckets,
+				 uint32_t hash)
+{
+	uint64_t size = tdb_split_round_size(tdb, buckets, NULL);
+	uint32_t bucket = hash % size;
+
+	if (bucket < buckets - size) {
+		bucket = hash % (size * 2);
+	}
+	return bucket;
+}
+
+static tdb_off_t tdb_split_bucket_top(struct tdb_context *tdb,
+				      uint32_t bucket,
+				      int (*ofs_read)(struct tdb_context *tdb,
+						      tdb_off_t offset,
+						      tdb_off_t *d))
+{
+	tdb_off_t dir, seg;
+	uint64_t size;
+	unsigned int level;
+
+	if (bucket < tdb->hash_size) {
+		return TDB_HASH_TOP(bucket);
+	}
+
+	size = tdb_split_round_size(tdb, bucket, &level);
+	if (level >= TDB_HASH_SPLIT_LEVELS) {
+		return 0;
+	}
+	if (ofs_read(tdb, TDB_HASH_SPLIT_DIR_OFS, &dir) == -1 || dir == 0) {
+		return 0;
+	}
+	if (ofs_read(tdb, tdb_split_seg_top(dir, level), &seg) == -1 ||
+	    seg == 0) {
+		return 0;
+	}
+	return tdb_split_seg_top(seg, bucket - size);
+}
+
+/*
+  The offset of the head of the bucket "hash" is in, 0 on error. The
+  list lock of hash has to be held, or the result has to be validated
+  otherwise like the lockless seqlock reads do, using their ofs_read.
+ */
+tdb_off_t tdb_hash_top_read(struct tdb_context *tdb, uint32_t hash,
+			    int (*ofs_read)(struct tdb_context *tdb,
+					    tdb_off_t offset, tdb_off_t *d))
+{
+	uint32_t buckets;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT)) {
+		return TDB_HASH_TOP(hash);
+	}
+	if (tdb_split_buckets_read(tdb, ofs_read, &buckets) == -1) {
+		return 0;
+	}
+	return tdb_split_bucket_top(
+		tdb, tdb_split_bucket(tdb, buckets, hash), ofs_read);
+}
+
+tdb_off_t tdb_hash_top(struct tdb_context *tdb, uint32_t hash)
+{
+	tdb_off_t top;
+
+	top = tdb_hash_top_read(tdb, hash, tdb_ofs_read);
+	if (top == 0) {
+		tdb->ecode = TDB_ERR_CORRUPT;
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_hash_top: no bucket "
+			 "for hash 0x%08x\n", (unsigned)hash));
+	}
+	return top;
+}
+
+/* The offset of the head of bucket "bucket", 0 on error */
+tdb_off_t tdb_bucket_top(struct tdb_context *tdb, uint32_t bucket)
+{
+	tdb_off_t top;
+
+	top = tdb_split_bucket_top(tdb, bucket, tdb_ofs_read);
+	if (top == 0) {
+		tdb->ecode = TDB_ERR_CORRUPT;
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_bucket_top: bucket %u "
+			 "has no segment\n", (unsigned)bucket));
+	}
+	return top;
+}
+
+/* The number of buckets, hash_size plus those split off */
+int tdb_hash_buckets(struct tdb_context *tdb, uint32_t *buckets)
+{
+	return tdb_split_buckets_read(tdb, tdb_ofs_read, buckets);
+}
+
+/* The bucket "hash" is in */
+int tdb_hash_bucket(struct tdb_context *tdb, uint32_t hash, uint32_t *bucket)
+{
+	uint32_t buckets;
+
+	if (tdb_hash_buckets(tdb, &buckets) == -1) {
+		return -1;
+	}
+	*bucket = tdb_split_bucket(tdb, buckets, hash);
+	return 0;
+}
+
+static uint32_t tdb_split_bitrev(uint32_t x, unsigned int bits)
+{
+	uint32_t r = 0;
+	unsigned int i;
+
+	for (i = 0; i < bits; i++) {
+		r = (r << 1) | (x & 1);
+		x >>= 1;
+	}
+	return r;
+}
+
+/*
+  Move *bucket on to the next bucket of its list, for traversals.
+  Returns 1 if there is one, 0 at the end of the list, -1 on error.
+
+  The buckets of a list are list + i * hash_size. They are visited in
+  the order of i with its bits reversed, read as a binary fraction.
+  Splitting i creates i + 2^level, which then comes directly after i
+  in that order: a traversal that is past i has seen the records of
+  both already, one that is not yet at i will see them in either.
+ */
+int tdb_hash_split_next(struct tdb_context *tdb, uint32_t *bucket)
+{
+	uint32_t buckets, list, count, idx, rev;
+	unsigned int bits;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT)) {
+		return 0;
+	}
+	if (tdb_hash_buckets(tdb, &buckets) == -1) {
+		return -1;
+	}
+
+	list = *bucket % tdb->hash_size;
+	idx = *bucket / tdb->hash_size;
+	count = (buckets - list + tdb->hash_size - 1) / tdb->hash_size;
+
+	for (bits = 0; ((uint64_t)1 << bits) < count; bits++) {
+		;
+	}
+	for (rev = tdb_split_bitrev(idx, bits) + 1;
+	     rev < ((uint64_t)1 << bits);
+	     rev++) {
+		idx = tdb_split_bitrev(rev, bits);
+		if (idx < count) {
+			*bucket = list + idx * tdb->hash_size;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+  Unlocked check whether all buckets of a list are empty, for
+  next_hash_chain(). Anything that is not clearly empty is not.
+ */
+bool tdb_hash_split_empty(struct tdb_context *tdb, uint32_t list)
+{
+	uint32_t buckets, bucket;
+
+	if (tdb_hash_buckets(tdb, &buckets) == -1) {
+		return false;
+	}
+	for (bucket = list; bucket < buckets; bucket += tdb->hash_size) {
+		tdb_off_t top, off;
+
+		top = tdb_split_bucket_top(tdb, bucket, tdb_ofs_read);
+		if (top == 0 || tdb_ofs_read(tdb, top, &off) != 0 ||
+		    off != 0) {
+			return false;
+		}
+		if (bucket > UINT32_MAX - tdb->hash_size) {
+			break;
+		}
+	}
+	return true;
+}
+
+/* Allocate a record of len zero bytes that holds bucket heads */
+static tdb_off_t tdb_split_alloc(struct tdb_context *tdb, uint32_t hash,
+				 tdb_len_t len)
+{
+	static const unsigned char zeros[4096];
+	struct tdb_record rec;
+	tdb_off_t rec_ptr, ofs;
+
+	rec_ptr = tdb_allocate(tdb, hash, len, &rec);
+	if (rec_ptr == 0) {
+		return 0;
+	}
+
+	rec.next = 0;
+	rec.key_len = 0;
+	rec.data_len = len;
+	rec.full_hash = 0;
+	rec.magic = TDB_HASH_SPLIT_MAGIC;
+
+	for (ofs = 0; ofs < len; ofs += sizeof(zeros)) {
+		tdb_len_t n = MIN(len - ofs, sizeof(zeros));
+
+		if (tdb->methods->tdb_write(tdb, rec_ptr + sizeof(rec) + ofs,
+					    zeros, n) == -1) {
+			return 0;
+		}
+	}
+	if (tdb_rec_write(tdb, rec_ptr, &rec) == -1) {
+		return 0;
+	}
+	return rec_ptr;
+}
+
+/* Find or allocate the segment holding the buckets of round "level" */
+static tdb_off_t tdb_split_segment(struct tdb_context *tdb, uint32_t hash,
+				   unsigned int level, uint64_t size)
+{
+	tdb_off_t dir, seg;
+
+	if (tdb_ofs_read(tdb, TDB_HASH_SPLIT_DIR_OFS, &dir) == -1) {
+		return 0;
+	}
+	if (dir == 0) {
+		dir = tdb_split_alloc(tdb, hash, TDB_HASH_SPLIT_LEVELS
+				      * sizeof(tdb_off_t));
+		if (dir == 0 ||
+		    tdb_ofs_write(tdb, TDB_HASH_SPLIT_DIR_OFS, &dir) == -1) {
+			return 0;
+		}
+	}
+
+	if (tdb_ofs_read(tdb, tdb_split_seg_top(dir, level), &seg) == -1) {
+		return 0;
+	}
+	if (seg == 0) {
+		seg = tdb_split_alloc(tdb, hash, size * sizeof(tdb_off_t));
+		if (seg == 0 ||
+		    tdb_ofs_write(tdb, tdb_split_seg_top(dir, level),
+				  &seg) == -1) {
+			return 0;
+		}
+	}
+	return seg;
+}
+
+/*
+  Split the next bucket. The caller holds the list lock of hash.
+  Returns 0 if it was done or skipped, -1 on error.
+ */
+static int tdb_hash_split(struct tdb_context *tdb, uint32_t hash)
+{
+	uint32_t buckets, check, bucket, new_bucket;
+	tdb_off_t split, top, new_top, last, new_last, rec_ptr, seg;
+	tdb_off_t zero = 0;
+	struct tdb_record rec;
+	unsigned int level;
+	uint64_t size;
+	int list, ret = -1;
+
+	if (tdb->read_only || tdb->traverse_read || tdb->traverse_write ||
+	    tdb->transaction != NULL || tdb->travlocks.next != NULL ||
+	    tdb->travlocks.off != 0) {
+		return 0;
+	}
+
+	if (tdb_hash_buckets(tdb, &buckets) == -1) {
+		return -1;
+	}
+	size = tdb_split_round_size(tdb, buckets, &level);
+	if (level >= TDB_HASH_SPLIT_LEVELS || size * 2 > UINT32_MAX) {
+		/* as big as it gets */
+		return 0;
+	}
+	bucket = buckets - size;
+	new_bucket = buckets;
+	list = bucket % tdb->hash_size;
+
+	if (tdb_lock_nonblock(tdb, list, F_WRLCK) == -1) {
+		/* someone else is busy there, next time */
+		return 0;
+	}
+
+	/* Someone else might have split meanwhile */
+	if (tdb_hash_buckets(tdb, &check) == -1) {
+		goto out;
+	}
+	if (check != buckets) {
+		ret = 0;
+		goto out;
+	}
+
+	seg = tdb_split_segment(tdb, hash, level, size);
+	if (seg == 0) {
+		goto out;
+	}
+	new_top = tdb_split_seg_top(seg, new_bucket - size);
+
+	top = tdb_bucket_top(tdb, bucket);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1) {
+		goto out;
+	}
+
+	/* Anyone traversing the bucket has its current record locked */
+	while (rec_ptr != 0) {
+		if (tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+					   DOCONV()) == -1) {
+			goto out;
+		}
+		if (TDB_BAD_MAGIC(&rec) || rec.full_hash % size != bucket ||
+		    rec.next == rec_ptr) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_hash_split: "
+				 "bad record %u in bucket %u\n",
+				 (unsigned)rec_ptr, (unsigned)bucket));
+			goto out;
+		}
+		if (tdb_write_lock_record(tdb, rec_ptr) == -1) {
+			ret = 0;
+			goto out;
+		}
+		tdb_write_unlock_record(tdb, rec_ptr);
+		rec_ptr = rec.next;
+	}
+
+	/* Relink the records into the two chains, keeping their order */
+	last = top;
+	new_last = new_top;
+	if (tdb_ofs_read(tdb, top, &rec_ptr) == -1) {
+		goto out;
+	}
+	while (rec_ptr != 0) {
+		if (tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+					   DOCONV()) == -1) {
+			goto out;
+		}
+		if (rec.full_hash % (size * 2) == bucket) {
+			if (tdb_ofs_write(tdb, last, &rec_ptr) == -1) {
+				goto out;
+			}
+			last = rec_ptr;
+		} else {
+			if (tdb_ofs_write(tdb, new_last, &rec_ptr) == -1) {
+				goto out;
+			}
+			new_last = rec_ptr;
+		}
+		rec_ptr = rec.next;
+	}
+	if (tdb_ofs_write(tdb, last, &zero) == -1 ||
+	    tdb_ofs_write(tdb, new_last, &zero) == -1) {
+		goto out;
+	}
+
+	split = buckets + 1 - tdb->hash_size;
+	if (tdb_ofs_write(tdb, TDB_HASH_SPLIT_OFS, &split) == -1) {
+		goto out;
+	}
+	ret = 0;
+
+out:
+	tdb_unlock(tdb, list, F_WRLCK);
+	return ret;
+}
+
+/*
+  Called after a store added a record to the bucket of hash, under its
+  list lock, with the number of records the store walked there.
+ */
+void tdb_hash_split_check(struct tdb_context *tdb, uint32_t hash,
+			  uint32_t walked)
+{
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT)) {
+		return;
+	}
+
+	tdb->chain_avg -= tdb->chain_avg / TDB_HASH_SPLIT_AVG_SCALE;
+	tdb->chain_avg += walked;
+
+	if (tdb->chain_avg <= TDB_HASH_SPLIT_CHAIN_LEN
+	    * TDB_HASH_SPLIT_AVG_SCALE) {
+		return;
+	}
+
+	if (tdb_hash_split(tdb, hash) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_hash_split_check: "
+			 "failed to split a bucket\n"));
+	}
+}
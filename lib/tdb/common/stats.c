@@ -0,0 +1,448 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   trivial database library - per chain and hot key statistics
+
+     ** NOTE! The following LGPL license applies to the tdb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+#include "tdb_private.h"
+
+/*
+ * With TDB_STATISTICS every process using a database adds to a shared
+ * "<name>.stats" file, mapped MAP_SHARED. It is not part of the
+ * database: the format of the tdb is unchanged, processes opening
+ * without TDB_STATISTICS don't update it, and it can be removed at any
+ * time.
+ *
+ * Chain i is counted in chains[i+1], chains[0] is the freelist. All
+ * updates are atomic adds, there is no locking.
+ *
+ * Hot keys are found with the "space saving" algorithm: every
+ * TDB_STATS_SAMPLE_RATE'th operation of a process looks for its key in
+ * the TDB_STATS_NUM_HOT slots and bumps it, or replaces the key with
+ * the lowest count, inheriting that count. The busy flag protects the
+ * replacement, if it is taken we just drop the sample.
+ */
+
+#define TDB_STATS_MAGIC 0x54444253 /* "TDBS" */
+#define TDB_STATS_VERSION 1
+#define TDB_STATS_NUM_HOT 32
+#define TDB_STATS_SAMPLE_RATE 16
+
+struct tdb_stats_hot_slot {
+	uint32_t busy;
+	uint32_t hash;
+	uint32_t key_len;
+	uint32_t pad;
+	uint64_t count;
+	unsigned char key[TDB_HOT_KEY_MAX_LEN];
+};
+
+struct tdb_stats {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t hash_size;
+	uint32_t num_hot;
+	uint32_t sample_rate;
+	uint32_t pad;
+	struct tdb_stats_hot_slot hot[TDB_STATS_NUM_HOT];
+	struct tdb_chain_stats chains[];
+};
+
+#ifdef HAVE___SYNC_FETCH_AND_ADD
+#define tdb_stats_add(p, v) __sync_fetch_and_add((p), (v))
+#define tdb_stats_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define tdb_stats_barrier() __sync_synchronize()
+#else
+#define tdb_stats_add(p, v) (*(p) += (v))
+static bool tdb_stats_cas(uint32_t *p, uint32_t o, uint32_t n)
+{
+	if (*p != o) {
+		return false;
+	}
+	*p = n;
+	return true;
+}
+#define tdb_stats_barrier() do { } while (0)
+#endif
+
+static size_t tdb_stats_size(uint32_t hash_size)
+{
+	return sizeof(struct tdb_stats) +
+		(hash_size + 1) * sizeof(struct tdb_chain_stats);
+}
+
+static char *tdb_stats_name(struct tdb_context *tdb)
+{
+	size_t len = strlen(tdb->name) + sizeof(".stats");
+	char *name;
+
+	name = malloc(len);
+	if (name == NULL) {
+		return NULL;
+	}
+	snprintf(name, len, "%s.stats", tdb->name);
+	return name;
+}
+
+static bool tdb_stats_valid(struct tdb_context *tdb, struct tdb_stats *s,
+			    size_t size)
+{
+	return (size >= sizeof(*s)) &&
+		(s->magic == TDB_STATS_MAGIC) &&
+		(s->version == TDB_STATS_VERSION) &&
+		(s->hash_size == tdb->hash_size) &&
+		(s->num_hot == TDB_STATS_NUM_HOT) &&
+		(size >= tdb_stats_size(s->hash_size));
+}
+
+static void tdb_stats_init(struct tdb_context *tdb, struct tdb_stats *s)
+{
+	memset(s, 0, tdb_stats_size(tdb->hash_size));
+	s->hash_size = tdb->hash_size;
+	s->num_hot = TDB_STATS_NUM_HOT;
+	s->sample_rate = TDB_STATS_SAMPLE_RATE;
+	s->version = TDB_STATS_VERSION;
+	tdb_stats_barrier();
+	s->magic = TDB_STATS_MAGIC;
+}
+
+/*
+ * Map the statistics for updating, called from tdb_open_ex(). "clear"
+ * is set if TDB_CLEAR_IF_FIRST wiped the database. Failure is not
+ * fatal, we just run without statistics.
+ */
+void tdb_stats_open(struct tdb_context *tdb, mode_t mode, bool clear)
+{
+	struct flock fl;
+	struct stat st;
+	size_t size = tdb_stats_size(tdb->hash_size);
+	char *name;
+	void *ptr;
+	int fd, ret;
+
+	name = tdb_stats_name(tdb);
+	if (name == NULL) {
+		goto fail;
+	}
+	fd = open(name, O_RDWR|O_CREAT, mode);
+	if (fd == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_WARNING, "tdb_stats_open: "
+			 "can't open %s: %s\n", name, strerror(errno)));
+		free(name);
+		goto fail;
+	}
+	free(name);
+
+	/* Serialize the initialization with other openers */
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+	fl.l_pid = 0;
+	do {
+		ret = fcntl(fd, F_SETLKW, &fl);
+	} while (ret == -1 && errno == EINTR);
+	if (ret == -1) {
+		goto fail_close;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		goto fail_close;
+	}
+	if (st.st_size < size) {
+		/* Never shrink, others might have it mapped */
+		if (ftruncate(fd, size) == -1) {
+			goto fail_close;
+		}
+		clear = true;
+	}
+
+	ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		goto fail_close;
+	}
+
+	if (clear || !tdb_stats_valid(tdb, ptr, size)) {
+		tdb_stats_init(tdb, ptr);
+	}
+
+	/* Closing the fd drops the fcntl lock */
+	close(fd);
+
+	tdb->stats = ptr;
+	tdb->stats_size = size;
+	tdb->stats_rw = true;
+	return;
+
+fail_close:
+	TDB_LOG((tdb, TDB_DEBUG_WARNING, "tdb_stats_open: can't set up "
+		 "statistics for %s: %s\n", tdb->name, strerror(errno)));
+	close(fd);
+fail:
+	tdb->flags &= ~TDB_STATISTICS;
+}
+
+/*
+ * Map somebody else's statistics for reading, and for tdb_stats_reset().
+ */
+static int tdb_stats_map(struct tdb_context *tdb)
+{
+	struct stat st;
+	char *name;
+	void *ptr;
+	int fd;
+
+	if (tdb->stats != NULL) {
+		return 0;
+	}
+
+	if (tdb->flags & TDB_INTERNAL) {
+		tdb->ecode = TDB_ERR_NOEXIST;
+		return -1;
+	}
+
+	name = tdb_stats_name(tdb);
+	if (name == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+	fd = open(name, tdb->read_only ? O_RDONLY : O_RDWR);
+	free(name);
+	if (fd == -1) {
+		tdb->ecode = TDB_ERR_NOEXIST;
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof(struct tdb_stats)) {
+		close(fd);
+		tdb->ecode = TDB_ERR_NOEXIST;
+		return -1;
+	}
+
+	ptr = mmap(NULL, st.st_size,
+		   tdb->read_only ? PROT_READ : PROT_READ|PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+
+	if (!tdb_stats_valid(tdb, ptr, st.st_size)) {
+		munmap(ptr, st.st_size);
+		tdb->ecode = TDB_ERR_NOEXIST;
+		return -1;
+	}
+
+	tdb->stats = ptr;
+	tdb->stats_size = st.st_size;
+	return 0;
+}
+
+void tdb_stats_munmap(struct tdb_context *tdb)
+{
+	if (tdb->stats == NULL) {
+		return;
+	}
+	munmap(tdb->stats, tdb->stats_size);
+	tdb->stats = NULL;
+	tdb->stats_size = 0;
+	tdb->stats_rw = false;
+}
+
+/*
+ * The chain, or -1 for the freelist, "offset" is the lock of. False
+ * for all other locks.
+ */
+bool tdb_stats_lock_list(struct tdb_context *tdb, tdb_off_t offset,
+			 size_t len, int *list)
+{
+	if (len != 1 || offset < FREELIST_TOP - 4 ||
+	    offset >= FREELIST_TOP + 4 * tdb->hash_size) {
+		return false;
+	}
+	*list = ((int)offset - (int)FREELIST_TOP) / 4;
+	return true;
+}
+
+void tdb_stats_lock_wait(struct tdb_context *tdb, int list,
+			 unsigned long long usecs)
+{
+	struct tdb_chain_stats *c;
+
+	if (!tdb->stats_rw) {
+		return;
+	}
+	c = &tdb->stats->chains[list + 1];
+	tdb_stats_add(&c->lock_waits, 1);
+	tdb_stats_add(&c->lock_wait_usecs, usecs);
+}
+
+static void tdb_stats_sample(struct tdb_stats *s, TDB_DATA key,
+			     uint32_t hash)
+{
+	struct tdb_stats_hot_slot *min = NULL;
+	size_t len = MIN(key.dsize, TDB_HOT_KEY_MAX_LEN);
+	uint64_t count;
+	int i;
+
+	for (i = 0; i < TDB_STATS_NUM_HOT; i++) {
+		struct tdb_stats_hot_slot *slot = &s->hot[i];
+
+		if (slot->busy) {
+			continue;
+		}
+		if ((slot->count != 0) && (slot->hash == hash) &&
+		    (slot->key_len == key.dsize) &&
+		    (memcmp(slot->key, key.dptr, len) == 0)) {
+			tdb_stats_add(&slot->count, TDB_STATS_SAMPLE_RATE);
+			return;
+		}
+		if ((min == NULL) || (slot->count < min->count)) {
+			min = slot;
+		}
+	}
+
+	if ((min == NULL) || !tdb_stats_cas(&min->busy, 0, 1)) {
+		return;
+	}
+	count = min->count;
+	min->hash = hash;
+	min->key_len = key.dsize;
+	memcpy(min->key, key.dptr, len);
+	min->count = count + TDB_STATS_SAMPLE_RATE;
+	tdb_stats_barrier();
+	min->busy = 0;
+}
+
+void tdb_stats_op(struct tdb_context *tdb, enum tdb_stats_op op,
+		  TDB_DATA key, uint32_t hash)
+{
+	struct tdb_chain_stats *c;
+
+	if (!tdb->stats_rw) {
+		return;
+	}
+
+	c = &tdb->stats->chains[BUCKET(hash) + 1];
+	switch (op) {
+	case TDB_STATS_FETCH:
+		tdb_stats_add(&c->fetches, 1);
+		break;
+	case TDB_STATS_STORE:
+		tdb_stats_add(&c->stores, 1);
+		break;
+	case TDB_STATS_DELETE:
+		tdb_stats_add(&c->deletes, 1);
+		break;
+	}
+
+	if ((++tdb->stats_ops % TDB_STATS_SAMPLE_RATE) == 0) {
+		tdb_stats_sample(tdb->stats, key, hash);
+	}
+}
+
+_PUBLIC_ int tdb_stats_chain(struct tdb_context *tdb, int list,
+			     struct tdb_chain_stats *stats)
+{
+	struct tdb_chain_stats *c;
+
+	if ((list < -1) || (list >= (int)tdb->hash_size)) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+	if (tdb_stats_map(tdb) == -1) {
+		return -1;
+	}
+
+	c = &tdb->stats->chains[list + 1];
+	stats->lock_waits = c->lock_waits;
+	stats->lock_wait_usecs = c->lock_wait_usecs;
+	stats->fetches = c->fetches;
+	stats->stores = c->stores;
+	stats->deletes = c->deletes;
+	return 0;
+}
+
+static int tdb_hot_key_cmp(const void *p1, const void *p2)
+{
+	const struct tdb_hot_key *k1 = p1;
+	const struct tdb_hot_key *k2 = p2;
+
+	if (k1->count == k2->count) {
+		return 0;
+	}
+	return (k1->count > k2->count) ? -1 : 1;
+}
+
+_PUBLIC_ int tdb_stats_hot_keys(struct tdb_context *tdb,
+				struct tdb_hot_key *keys, int max_keys)
+{
+	struct tdb_hot_key all[TDB_STATS_NUM_HOT];
+	int i, num = 0;
+
+	if (max_keys < 0) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+	if (tdb_stats_map(tdb) == -1) {
+		return -1;
+	}
+
+	for (i = 0; i < TDB_STATS_NUM_HOT; i++) {
+		struct tdb_stats_hot_slot *slot = &tdb->stats->hot[i];
+		struct tdb_hot_key *k = &all[num];
+
+		if (slot->busy || slot->count == 0) {
+			continue;
+		}
+		k->count = slot->count;
+		k->hash = slot->hash;
+		k->key_len = slot->key_len;
+		memcpy(k->key, slot->key, sizeof(k->key));
+		num += 1;
+	}
+
+	qsort(all, num, sizeof(all[0]), tdb_hot_key_cmp);
+
+	num = MIN(num, max_keys);
+	if (num > 0) {
+		memcpy(keys, all, num * sizeof(all[0]));
+	}
+	return num;
+}
+
+_PUBLIC_ int tdb_stats_reset(struct tdb_context *tdb)
+{
+	struct tdb_stats *s;
+
+	if (tdb->read_only) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+	if (tdb_stats_map(tdb) == -1) {
+		return -1;
+	}
+	s = tdb->stats;
+
+	memset(s->hot, 0, sizeof(s->hot));
+	memset(s->chains, 0,
+	       (s->hash_size + 1) * sizeof(struct tdb_chain_stats));
+	return 0;
+}
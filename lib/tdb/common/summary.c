@@ -24,6 +24,9 @@
 	"Incompatible hash: %s\n" \
 	"Active/supported feature flags: 0x%08x/0x%08x\n" \
 	"Robust mutexes locking: %s\n" \
+	"Size class freelists: %s\n" \
+	"Lockless seqlock reads: %s\n" \
+	"Split hash buckets: %s\n" \
 	"Smallest/average/largest keys: %zu/%zu/%zu\n" \
 	"Smallest/average/largest data: %zu/%zu/%zu\n" \
 	"Smallest/average/largest padding: %zu/%zu/%zu\n" \
@@ -71,10 +74,11 @@ static size_t tally_mean(const struct tally *tally)
 
 static size_t get_hash_length(struct tdb_context *tdb, unsigned int i)
 {
-	tdb_off_t rec_ptr;
+	tdb_off_t rec_ptr, top;
 	size_t count = 0;
 
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(i), &rec_ptr) == -1)
+	top = tdb_bucket_top(tdb, i);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1)
 		return 0;
 
 	/* keep looking until we find the right record */
@@ -97,6 +101,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	char *ret = NULL;
 	bool locked;
 	size_t unc = 0;
+	size_t split_bytes = 0;
+	uint32_t buckets;
 	int len;
 	struct tdb_record recovery;
 
@@ -142,6 +148,9 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 			tally_add(&freet, rec.rec_len);
 			unc++;
 			break;
+		case TDB_HASH_SPLIT_MAGIC:
+			split_bytes += sizeof(rec) + rec.rec_len;
+			break;
 		/* If we crash after ftruncate, we can get zeroes or fill. */
 		case TDB_RECOVERY_INVALID_MAGIC:
 		case 0x42424242:
@@ -165,7 +174,9 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	if (unc > 1)
 		tally_add(&uncoal, unc - 1);
 
-	for (off = 0; off < tdb->hash_size; off++)
+	if (tdb_hash_buckets(tdb, &buckets) == -1)
+		goto unlock;
+	for (off = 0; off < buckets; off++)
 		tally_add(&hashval, get_hash_length(tdb, off));
 
 	file_size = tdb->hdr_ofs + tdb->map_size;
@@ -174,9 +185,13 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (unsigned long long)file_size, keys.total+data.total,
 		 (size_t)tdb->hdr_ofs, (size_t)tdb->map_size,
 		 keys.num,
+		 (tdb->hash_fn == tdb_xxhash)?"yes (xxhash)":
 		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":"no",
 		 (unsigned)tdb->feature_flags, TDB_SUPPORTED_FEATURE_FLAGS,
 		 (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT)?"yes":"no",
 		 keys.min, tally_mean(&keys), keys.max,
 		 data.min, tally_mean(&data), data.max,
 		 extra.min, tally_mean(&extra), extra.max,
@@ -196,7 +211,7 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (keys.num + freet.num + dead.num)
 		 * (sizeof(struct tdb_record) + sizeof(uint32_t))
 		 * 100.0 / file_size,
-		 tdb->hash_size * sizeof(tdb_off_t)
+		 (tdb->hash_size * sizeof(tdb_off_t) + split_bytes)
 		 * 100.0 / file_size);
 	if (len == -1) {
 		goto unlock;
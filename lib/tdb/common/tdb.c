@@ -79,17 +79,20 @@ static int tdb_key_compare(TDB_DATA key, TDB_DATA data, void *private_data)
 static tdb_off_t tdb_find(struct tdb_context *tdb, TDB_DATA key, uint32_t hash,
 			struct tdb_record *r)
 {
-	tdb_off_t rec_ptr;
+	tdb_off_t rec_ptr, top;
 
 	/* read in the hash top */
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(hash), &rec_ptr) == -1)
+	top = tdb_hash_top(tdb, hash);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1)
 		return 0;
 
 	/* keep looking until we find the right record */
+	tdb->chain_walk = 0;
 	while (rec_ptr) {
 		if (tdb_rec_read(tdb, rec_ptr, r) == -1)
 			return 0;
 
+		tdb->chain_walk += 1;
 		if (!TDB_DEAD(r) && hash==r->full_hash
 		    && key.dsize==r->key_len
 		    && tdb_parse_data(tdb, key, rec_ptr + sizeof(*r),
@@ -109,6 +112,149 @@ static tdb_off_t tdb_find(struct tdb_context *tdb, TDB_DATA key, uint32_t hash,
 	return 0;
 }
 
+/*
+ * With TDB_SEQLOCK_READS, give up on reading without the chain lock after
+ * seeing writers that often. Bigger records are handed to
+ * tdb_parse_record() parsers in place, under the lock, instead of copying.
+ */
+#define TDB_SEQLOCK_READ_RETRIES 10
+#define TDB_SEQLOCK_READ_MAX_COPY 65536
+
+static bool tdb_seqlock_in_map(struct tdb_context *tdb, tdb_off_t off,
+			       tdb_len_t len)
+{
+	tdb_off_t end;
+
+	return (tdb_add_off_t(off, len, &end) && end <= tdb->map_size);
+}
+
+static bool tdb_seqlock_read(struct tdb_context *tdb, tdb_off_t off,
+			     void *buf, tdb_len_t len)
+{
+	if (!tdb_seqlock_in_map(tdb, off, len)) {
+		return false;
+	}
+	memcpy(buf, off + (char *)tdb->map_ptr, len);
+	if (DOCONV()) {
+		tdb_convert(buf, len);
+	}
+	return true;
+}
+
+static int tdb_seqlock_ofs_read(struct tdb_context *tdb, tdb_off_t off,
+				tdb_off_t *d)
+{
+	return tdb_seqlock_read(tdb, off, d, sizeof(*d)) ? 0 : -1;
+}
+
+/*
+  As tdb_find, but without taking the chain lock: the chain is read from
+  the mmap area and the result is only used if the chain's sequence
+  counter did not change meanwhile. If data is not NULL, a copy of the
+  record's data is returned in it.
+
+  Returns 0 if the record was found, -1 if it does not exist and -2 if
+  the caller has to take the lock and use tdb_find.
+ */
+static int tdb_find_lockless(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, tdb_len_t max_data_len,
+			     TDB_DATA *data)
+{
+	uint32_t list = BUCKET(hash);
+	uint32_t seq[2];
+	int retries;
+
+	if (!tdb_have_seqlocks(tdb) || tdb->map_ptr == NULL ||
+	    tdb->transaction != NULL) {
+		return -2;
+	}
+
+	/* Our own locks nest, that's only done by tdb_lock() */
+	if (tdb_have_extra_locks(tdb)) {
+		return -2;
+	}
+
+	for (retries = 0; retries < TDB_SEQLOCK_READ_RETRIES; retries++) {
+		struct tdb_record rec;
+		tdb_off_t rec_ptr, top;
+		tdb_len_t walked = 0;
+		unsigned char *buf = NULL;
+		int ret = -1;
+
+		if (!tdb_mutex_seqlock_read_begin(tdb, list, seq)) {
+			continue;
+		}
+
+		/* With split buckets the bucket depends on the header */
+		top = tdb_hash_top_read(tdb, hash, tdb_seqlock_ofs_read);
+		if (top == 0 || !tdb_seqlock_read(tdb, top, &rec_ptr,
+						  sizeof(rec_ptr))) {
+			return -2;
+		}
+
+		while (rec_ptr != 0) {
+			const unsigned char *p;
+
+			/*
+			 * A racing writer can leave us with anything,
+			 * including loops and offsets behind our mapping.
+			 */
+			if (!tdb_seqlock_read(tdb, rec_ptr, &rec, sizeof(rec)) ||
+			    ++walked > tdb->map_size / sizeof(rec)) {
+				return -2;
+			}
+
+			if (rec.magic != TDB_MAGIC || rec.full_hash != hash ||
+			    rec.key_len != key.dsize) {
+				rec_ptr = rec.next;
+				continue;
+			}
+
+			if (!tdb_seqlock_in_map(tdb, rec_ptr + sizeof(rec),
+						rec.key_len) ||
+			    !tdb_seqlock_in_map(tdb, rec_ptr + sizeof(rec)
+						+ rec.key_len, rec.data_len)) {
+				return -2;
+			}
+			p = (const unsigned char *)tdb->map_ptr
+				+ rec_ptr + sizeof(rec);
+
+			if (memcmp(p, key.dptr, key.dsize) != 0) {
+				rec_ptr = rec.next;
+				continue;
+			}
+
+			if (rec.data_len > max_data_len) {
+				return -2;
+			}
+			if (data != NULL) {
+				buf = (unsigned char *)malloc(
+					rec.data_len ? rec.data_len : 1);
+				if (buf == NULL) {
+					return -2;
+				}
+				memcpy(buf, p + rec.key_len, rec.data_len);
+			}
+			ret = 0;
+			break;
+		}
+
+		if (tdb_mutex_seqlock_read_valid(tdb, list, seq)) {
+			if (ret == 0 && data != NULL) {
+				data->dptr = buf;
+				data->dsize = rec.data_len;
+			}
+			if (ret == -1) {
+				tdb->ecode = TDB_ERR_NOEXIST;
+			}
+			return ret;
+		}
+		SAFE_FREE(buf);
+	}
+
+	return -2;
+}
+
 /* As tdb_find, but if you succeed, keep the lock */
 tdb_off_t tdb_find_lock_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t hash, int locktype,
 			   struct tdb_record *rec)
@@ -123,6 +269,11 @@ tdb_off_t tdb_find_lock_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t has
 }
 
 static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key);
+static int tdb_parse_record_hash(struct tdb_context *tdb, TDB_DATA key,
+				 uint32_t hash,
+				 int (*parser)(TDB_DATA key, TDB_DATA data,
+					       void *private_data),
+				 void *private_data);
 
 static int tdb_update_hash_cmp(TDB_DATA key, TDB_DATA data, void *private_data)
 {
@@ -155,7 +306,8 @@ static int tdb_update_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t hash,
 	if (rec.key_len == key.dsize &&
 	    rec.data_len == dbuf.dsize &&
 	    rec.full_hash == hash &&
-	    tdb_parse_record(tdb, key, tdb_update_hash_cmp, &dbuf) == 0) {
+	    tdb_parse_record_hash(tdb, key, hash,
+				  tdb_update_hash_cmp, &dbuf) == 0) {
 		return 0;
 	}
 
@@ -193,6 +345,15 @@ static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key)
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+	tdb_stats_op(tdb, TDB_STATS_FETCH, key, hash);
+
+	switch (tdb_find_lockless(tdb, key, hash, (tdb_len_t)-1, &ret)) {
+	case 0:
+		return ret;
+	case -1:
+		return tdb_null;
+	}
+
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec)))
 		return tdb_null;
 
@@ -226,6 +387,10 @@ _PUBLIC_ TDB_DATA tdb_fetch(struct tdb_context *tdb, TDB_DATA key)
  * This is interesting for all readers of potentially large data structures in
  * the tdb records, ldb indexes being one example.
  *
+ * With TDB_SEQLOCK_READS records up to TDB_SEQLOCK_READ_MAX_COPY bytes are
+ * copied out of the mmap area without taking the lock, the parser then runs
+ * on that copy.
+ *
  * Return -1 if the record was not found.
  */
 
@@ -234,13 +399,38 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 				   void *private_data),
 		     void *private_data)
 {
-	tdb_off_t rec_ptr;
-	struct tdb_record rec;
-	int ret;
 	uint32_t hash;
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+	tdb_stats_op(tdb, TDB_STATS_FETCH, key, hash);
+
+	return tdb_parse_record_hash(tdb, key, hash, parser, private_data);
+}
+
+static int tdb_parse_record_hash(struct tdb_context *tdb, TDB_DATA key,
+				 uint32_t hash,
+				 int (*parser)(TDB_DATA key, TDB_DATA data,
+					       void *private_data),
+				 void *private_data)
+{
+	tdb_off_t rec_ptr;
+	struct tdb_record rec;
+	TDB_DATA data;
+	int ret;
+
+	ret = tdb_find_lockless(tdb, key, hash, TDB_SEQLOCK_READ_MAX_COPY,
+				&data);
+	if (ret == 0) {
+		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, 0);
+		ret = parser(key, data, private_data);
+		free(data.dptr);
+		return ret;
+	}
+	if (ret == -1) {
+		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, -1);
+		return -1;
+	}
 
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec))) {
 		/* record not found */
@@ -258,6 +448,128 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 	return ret;
 }
 
+struct tdb_parse_multi_key {
+	uint32_t list;
+	uint32_t hash;
+	size_t idx;
+};
+
+static int tdb_parse_multi_key_cmp(const void *p1, const void *p2)
+{
+	const struct tdb_parse_multi_key *k1 =
+		(const struct tdb_parse_multi_key *)p1;
+	const struct tdb_parse_multi_key *k2 =
+		(const struct tdb_parse_multi_key *)p2;
+
+	if (k1->list != k2->list) {
+		return (k1->list < k2->list) ? -1 : 1;
+	}
+	if (k1->idx != k2->idx) {
+		return (k1->idx < k2->idx) ? -1 : 1;
+	}
+	return 0;
+}
+
+struct tdb_parse_multi_state {
+	int (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		      void *private_data);
+	void *private_data;
+	size_t idx;
+	bool found;
+};
+
+static int tdb_parse_multi_parser(TDB_DATA key, TDB_DATA data,
+				  void *private_data)
+{
+	struct tdb_parse_multi_state *state =
+		(struct tdb_parse_multi_state *)private_data;
+
+	state->found = true;
+	return state->parser(state->idx, key, data, state->private_data);
+}
+
+/*
+ * tdb_parse_record() for a set of keys, taking each chain lock only
+ * once. With TDB_SEQLOCK_READS the lookups go without any lock, as in
+ * tdb_parse_record().
+ */
+_PUBLIC_ int tdb_parse_record_multi(struct tdb_context *tdb,
+				    const TDB_DATA *keys, size_t num_keys,
+				    int (*parser)(size_t idx, TDB_DATA key,
+						  TDB_DATA data,
+						  void *private_data),
+				    void *private_data)
+{
+	struct tdb_parse_multi_key *sorted;
+	struct tdb_parse_multi_state state = {
+		.parser = parser, .private_data = private_data
+	};
+	bool lock = !tdb_have_seqlocks(tdb);
+	size_t i, end;
+	int ret = 0;
+
+	if (num_keys == 0) {
+		return 0;
+	}
+
+	sorted = (struct tdb_parse_multi_key *)malloc(
+		sizeof(struct tdb_parse_multi_key) * num_keys);
+	if (sorted == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+	for (i = 0; i < num_keys; i++) {
+		TDB_DATA key = keys[i];
+
+		sorted[i].hash = tdb->hash_fn(&key);
+		sorted[i].list = BUCKET(sorted[i].hash);
+		sorted[i].idx = i;
+		tdb_stats_op(tdb, TDB_STATS_FETCH, key, sorted[i].hash);
+	}
+	qsort(sorted, num_keys, sizeof(struct tdb_parse_multi_key),
+	      tdb_parse_multi_key_cmp);
+
+	for (i = 0; (i < num_keys) && (ret == 0); i = end) {
+		uint32_t list = sorted[i].list;
+
+		for (end = i+1; end < num_keys; end++) {
+			if (sorted[end].list != list) {
+				break;
+			}
+		}
+
+		/* the tdb_parse_record_hash() calls below nest this lock */
+		if (lock && tdb_lock(tdb, list, F_RDLCK) == -1) {
+			ret = -1;
+			break;
+		}
+
+		for (; i < end; i++) {
+			state.idx = sorted[i].idx;
+			state.found = false;
+
+			ret = tdb_parse_record_hash(tdb, keys[state.idx],
+						    sorted[i].hash,
+						    tdb_parse_multi_parser,
+						    &state);
+			if (ret == -1 && !state.found &&
+			    tdb->ecode == TDB_ERR_NOEXIST) {
+				ret = 0;
+			}
+			if (ret != 0) {
+				break;
+			}
+		}
+
+		if (lock) {
+			tdb_unlock(tdb, list, F_RDLCK);
+		}
+	}
+
+	SAFE_FREE(sorted);
+	return ret;
+}
+
 /* check if an entry in the database exists
 
    note that 1 is returned if the key is found and 0 is returned if not found
@@ -268,6 +580,13 @@ static int tdb_exists_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t hash)
 {
 	struct tdb_record rec;
 
+	switch (tdb_find_lockless(tdb, key, hash, (tdb_len_t)-1, NULL)) {
+	case 0:
+		return 1;
+	case -1:
+		return 0;
+	}
+
 	if (tdb_find_lock_hash(tdb, key, hash, F_RDLCK, &rec) == 0)
 		return 0;
 	tdb_unlock(tdb, BUCKET(rec.full_hash), F_RDLCK);
@@ -279,6 +598,7 @@ _PUBLIC_ int tdb_exists(struct tdb_context *tdb, TDB_DATA key)
 	uint32_t hash = tdb->hash_fn(&key);
 	int ret;
 
+	tdb_stats_op(tdb, TDB_STATS_FETCH, key, hash);
 	ret = tdb_exists_hash(tdb, key, hash);
 	tdb_trace_1rec_ret(tdb, "tdb_exists", key, ret);
 	return ret;
@@ -287,7 +607,7 @@ _PUBLIC_ int tdb_exists(struct tdb_context *tdb, TDB_DATA key)
 /* actually delete an entry in the database given the offset */
 int tdb_do_delete(struct tdb_context *tdb, tdb_off_t rec_ptr, struct tdb_record *rec)
 {
-	tdb_off_t last_ptr, i;
+	tdb_off_t last_ptr, i, top;
 	struct tdb_record lastrec;
 
 	if (tdb->read_only || tdb->traverse_read) return -1;
@@ -302,7 +622,8 @@ int tdb_do_delete(struct tdb_context *tdb, tdb_off_t rec_ptr, struct tdb_record
 		return -1;
 
 	/* find previous record in hash chain */
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(rec->full_hash), &i) == -1)
+	top = tdb_hash_top(tdb, rec->full_hash);
+	if (top == 0 || tdb_ofs_read(tdb, top, &i) == -1)
 		return -1;
 	for (last_ptr = 0; i != rec_ptr; last_ptr = i, i = lastrec.next)
 		if (tdb_rec_read(tdb, i, &lastrec) == -1)
@@ -310,7 +631,7 @@ int tdb_do_delete(struct tdb_context *tdb, tdb_off_t rec_ptr, struct tdb_record
 
 	/* unlink it: next ptr is at start of record. */
 	if (last_ptr == 0)
-		last_ptr = TDB_HASH_TOP(rec->full_hash);
+		last_ptr = top;
 	if (tdb_ofs_write(tdb, last_ptr, &rec->next) == -1)
 		return -1;
 
@@ -323,11 +644,12 @@ int tdb_do_delete(struct tdb_context *tdb, tdb_off_t rec_ptr, struct tdb_record
 static int tdb_count_dead(struct tdb_context *tdb, uint32_t hash)
 {
 	int res = 0;
-	tdb_off_t rec_ptr;
+	tdb_off_t rec_ptr, top;
 	struct tdb_record rec;
 
 	/* read in the hash top */
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(hash), &rec_ptr) == -1)
+	top = tdb_hash_top(tdb, hash);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1)
 		return 0;
 
 	while (rec_ptr) {
@@ -349,7 +671,7 @@ int tdb_purge_dead(struct tdb_context *tdb, uint32_t hash)
 {
 	int res = -1;
 	struct tdb_record rec;
-	tdb_off_t rec_ptr;
+	tdb_off_t rec_ptr, top;
 
 	if (tdb_lock_nonblock(tdb, -1, F_WRLCK) == -1) {
 		/*
@@ -359,7 +681,8 @@ int tdb_purge_dead(struct tdb_context *tdb, uint32_t hash)
 	}
 
 	/* read in the hash top */
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(hash), &rec_ptr) == -1)
+	top = tdb_hash_top(tdb, hash);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec_ptr) == -1)
 		goto fail;
 
 	while (rec_ptr) {
@@ -437,6 +760,7 @@ _PUBLIC_ int tdb_delete(struct tdb_context *tdb, TDB_DATA key)
 	uint32_t hash = tdb->hash_fn(&key);
 	int ret;
 
+	tdb_stats_op(tdb, TDB_STATS_DELETE, key, hash);
 	ret = tdb_delete_hash(tdb, key, hash);
 	tdb_trace_1rec_ret(tdb, "tdb_delete", key, ret);
 	return ret;
@@ -456,10 +780,10 @@ tdb_off_t tdb_find_dead(struct tdb_context *tdb, uint32_t hash,
 
 	length += sizeof(tdb_off_t); /* tailer */
 
-	last_ptr = TDB_HASH_TOP(hash);
+	last_ptr = tdb_hash_top(tdb, hash);
 
 	/* read in the hash top */
-	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
+	if (last_ptr == 0 || tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
 		return 0;
 
 	/* keep looking until we find the right record */
@@ -490,7 +814,8 @@ static int _tdb_store(struct tdb_context *tdb, TDB_DATA key,
 		       TDB_DATA dbuf, int flag, uint32_t hash)
 {
 	struct tdb_record rec;
-	tdb_off_t rec_ptr;
+	tdb_off_t rec_ptr, top;
+	uint32_t walked;
 	int ret = -1;
 
 	/* check for it existing, on insert. */
@@ -520,6 +845,9 @@ static int _tdb_store(struct tdb_context *tdb, TDB_DATA key,
 	if (flag != TDB_INSERT)
 		tdb_delete_hash(tdb, key, hash);
 
+	/* the chain length seen by the lookups above */
+	walked = tdb->chain_walk;
+
 	/* we have to allocate some space */
 	rec_ptr = tdb_allocate(tdb, hash, key.dsize + dbuf.dsize, &rec);
 
@@ -528,7 +856,8 @@ static int _tdb_store(struct tdb_context *tdb, TDB_DATA key,
 	}
 
 	/* Read hash top into next ptr */
-	if (tdb_ofs_read(tdb, TDB_HASH_TOP(hash), &rec.next) == -1)
+	top = tdb_hash_top(tdb, hash);
+	if (top == 0 || tdb_ofs_read(tdb, top, &rec.next) == -1)
 		goto fail;
 
 	rec.key_len = key.dsize;
@@ -542,11 +871,13 @@ static int _tdb_store(struct tdb_context *tdb, TDB_DATA key,
 				       key.dptr, key.dsize) == -1
 	    || tdb->methods->tdb_write(tdb, rec_ptr+sizeof(rec)+key.dsize,
 				       dbuf.dptr, dbuf.dsize) == -1
-	    || tdb_ofs_write(tdb, TDB_HASH_TOP(hash), &rec_ptr) == -1) {
+	    || tdb_ofs_write(tdb, top, &rec_ptr) == -1) {
 		/* Need to tdb_unallocate() here */
 		goto fail;
 	}
 
+	tdb_hash_split_check(tdb, hash, walked);
+
  done:
 	ret = 0;
  fail:
@@ -574,6 +905,7 @@ _PUBLIC_ int tdb_store(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf, int
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+	tdb_stats_op(tdb, TDB_STATS_STORE, key, hash);
 	if (tdb_lock(tdb, BUCKET(hash), F_WRLCK) == -1)
 		return -1;
 
@@ -592,6 +924,7 @@ _PUBLIC_ int tdb_append(struct tdb_context *tdb, TDB_DATA key, TDB_DATA new_dbuf
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+	tdb_stats_op(tdb, TDB_STATS_STORE, key, hash);
 	if (tdb_lock(tdb, BUCKET(hash), F_WRLCK) == -1)
 		return -1;
 
@@ -823,10 +1156,21 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		}
 	}
 
+	/* the split buckets are in the data area, back to the start */
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT) {
+		if (tdb_ofs_write(tdb, TDB_HASH_SPLIT_OFS, &offset) == -1 ||
+		    tdb_ofs_write(tdb, TDB_HASH_SPLIT_DIR_OFS, &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to reset split buckets\n"));
+			goto failed;
+		}
+	}
+
 	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	for (i=0;i<(int)tdb_freelist_count(tdb);i++) {
+		if (tdb_ofs_write(tdb, tdb_freelist_top(tdb, i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist %d\n", i));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap
@@ -962,6 +1306,362 @@ _PUBLIC_ int tdb_repack(struct tdb_context *tdb)
 	return 0;
 }
 
+static unsigned long long tdb_repack_usecs(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000ULL
+		+ now.tv_usec - start->tv_usec;
+}
+
+static void tdb_repack_lock_time(struct tdb_repack_stats *stats,
+				 const struct timeval *start)
+{
+	unsigned long long usecs = tdb_repack_usecs(start);
+
+	stats->lock_usecs += usecs;
+	if (usecs > stats->lock_usecs_max) {
+		stats->lock_usecs_max = usecs;
+	}
+}
+
+/*
+  move the record at rec_ptr to free space below limit. Must hold the
+  chain lock, last_ptr points at the record. *new_ptr is 0 if the
+  record was not moved.
+ */
+static int tdb_repack_move_record(struct tdb_context *tdb,
+				  tdb_off_t last_ptr, tdb_off_t rec_ptr,
+				  struct tdb_record *rec, tdb_off_t limit,
+				  tdb_off_t *new_ptr)
+{
+	struct tdb_record newrec;
+	tdb_len_t len = rec->key_len + rec->data_len;
+	unsigned char *buf;
+
+	*new_ptr = 0;
+
+	/* Someone traversing here: leave it alone */
+	if (tdb_write_lock_record(tdb, rec_ptr) == -1) {
+		return 0;
+	}
+
+	buf = tdb_alloc_read(tdb, rec_ptr + sizeof(*rec), len);
+	if (buf == NULL) {
+		goto fail;
+	}
+
+	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+		goto fail;
+	}
+	*new_ptr = tdb_allocate_below(tdb, len, limit, &newrec);
+	if (*new_ptr == 0) {
+		/*
+		 * The holes below the limit are taken or too small,
+		 * moving it towards the start still helps the truncate.
+		 */
+		*new_ptr = tdb_allocate_below(tdb, len, rec_ptr, &newrec);
+	}
+	tdb_unlock(tdb, -1, F_WRLCK);
+
+	if (*new_ptr == 0) {
+		/* nothing further down fits */
+		SAFE_FREE(buf);
+		tdb_write_unlock_record(tdb, rec_ptr);
+		return 0;
+	}
+
+	/* Fill in the new record before anyone can see it */
+	newrec.next = rec->next;
+	newrec.key_len = rec->key_len;
+	newrec.data_len = rec->data_len;
+	newrec.full_hash = rec->full_hash;
+	newrec.magic = TDB_MAGIC;
+
+	if (tdb->methods->tdb_write(tdb, *new_ptr + sizeof(newrec),
+				    buf, len) == -1 ||
+	    tdb_rec_write(tdb, *new_ptr, &newrec) == -1 ||
+	    tdb_ofs_write(tdb, last_ptr, new_ptr) == -1) {
+		goto fail;
+	}
+	SAFE_FREE(buf);
+
+	tdb_write_unlock_record(tdb, rec_ptr);
+
+	/* recover the space */
+	return tdb_free(tdb, rec_ptr, rec);
+
+fail:
+	SAFE_FREE(buf);
+	tdb_write_unlock_record(tdb, rec_ptr);
+	return -1;
+}
+
+/* move the records of one bucket that lie at or beyond limit */
+static int tdb_repack_bucket(struct tdb_context *tdb, uint32_t bucket,
+			     tdb_off_t limit, struct tdb_repack_stats *stats)
+{
+	tdb_off_t last_ptr, rec_ptr, next_ptr, new_ptr;
+	struct tdb_record rec;
+
+	last_ptr = tdb_bucket_top(tdb, bucket);
+	if (last_ptr == 0 || tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+		return -1;
+	}
+
+	while (rec_ptr) {
+		if (tdb_rec_read(tdb, rec_ptr, &rec) == -1) {
+			return -1;
+		}
+
+		/* tdb_free() reuses rec.next for the freelist */
+		next_ptr = rec.next;
+
+		if (rec_ptr >= limit && !TDB_DEAD(&rec)) {
+			if (tdb_repack_move_record(tdb, last_ptr, rec_ptr,
+						   &rec, limit,
+						   &new_ptr) == -1) {
+				return -1;
+			}
+			if (new_ptr != 0) {
+				stats->records_moved += 1;
+				stats->bytes_moved += rec.key_len + rec.data_len;
+				rec_ptr = new_ptr;
+			} else {
+				stats->records_skipped += 1;
+			}
+		}
+
+		last_ptr = rec_ptr;
+		rec_ptr = next_ptr;
+	}
+	return 0;
+}
+
+/* move the records of one hash chain that lie at or beyond limit */
+static int tdb_repack_chain(struct tdb_context *tdb, int chain,
+			    tdb_off_t limit, struct tdb_repack_stats *stats)
+{
+	uint32_t buckets, bucket;
+	struct timeval start;
+	int ret = -1;
+
+	if (tdb_lock(tdb, chain, F_WRLCK) == -1) {
+		return -1;
+	}
+	gettimeofday(&start, NULL);
+
+	/* including the buckets split off it */
+	if (tdb_hash_buckets(tdb, &buckets) == -1) {
+		goto out;
+	}
+	for (bucket = chain; bucket < buckets; bucket += tdb->hash_size) {
+		if (tdb_repack_bucket(tdb, bucket, limit, stats) == -1) {
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	tdb_unlock(tdb, chain, F_WRLCK);
+	tdb_repack_lock_time(stats, &start);
+	return ret;
+}
+
+/*
+  where the file would end if all free space was at the end of it
+ */
+static int tdb_repack_limit(struct tdb_context *tdb, tdb_off_t *limit)
+{
+	tdb_off_t ptr;
+	struct tdb_record rec;
+	tdb_len_t total = 0;
+	unsigned int list;
+
+	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
+		return -1;
+	}
+
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list), &ptr) == -1) {
+			goto fail;
+		}
+
+		while (ptr != 0) {
+			if (tdb_rec_free_read(tdb, ptr, &rec) == -1) {
+				goto fail;
+			}
+			total += sizeof(rec) + rec.rec_len;
+			ptr = rec.next;
+		}
+	}
+
+	tdb_unlock(tdb, -1, F_RDLCK);
+
+	*limit = tdb->map_size - MIN(total, tdb->map_size);
+	if (*limit < TDB_DATA_START(tdb->hash_size)) {
+		*limit = TDB_DATA_START(tdb->hash_size);
+	}
+	return 0;
+
+fail:
+	tdb_unlock(tdb, -1, F_RDLCK);
+	return -1;
+}
+
+/*
+  cut off the free record at the end of the file, if there is one.
+
+  Other processes may still have the old size mapped, but nothing
+  points into the cut off part anymore: they only look there through
+  tdb_expand() or a full scan, which both start with re-reading the
+  file size under the allocation or allrecord lock we hold.
+ */
+static int tdb_repack_truncate(struct tdb_context *tdb,
+			       struct tdb_repack_stats *stats)
+{
+	tdb_off_t rec_ptr, tailer;
+	struct tdb_record rec;
+	struct timeval start;
+	int ret = -1;
+
+	if (tdb->flags & TDB_INTERNAL) {
+		return 0;
+	}
+
+	/*
+	 * Lockless readers may still follow an old pointer to a record
+	 * we moved, that would be a SIGBUS behind the end of the file.
+	 */
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) {
+		return 0;
+	}
+
+	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+		return -1;
+	}
+	gettimeofday(&start, NULL);
+
+	/* must know about any previous expansions by another process */
+	tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
+
+	if (tdb_ofs_read(tdb, tdb->map_size - sizeof(tdb_off_t), &tailer) == -1) {
+		goto out;
+	}
+
+	ret = 0;
+
+	if (tailer < sizeof(rec) ||
+	    tailer > tdb->map_size - TDB_DATA_START(tdb->hash_size)) {
+		/* not a record tailer, nothing to cut off */
+		goto out;
+	}
+
+	rec_ptr = tdb->map_size - tailer;
+
+	if (tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+				   DOCONV()) == -1) {
+		ret = -1;
+		goto out;
+	}
+	if (rec.magic != TDB_FREE_MAGIC ||
+	    sizeof(rec) + rec.rec_len != tailer) {
+		goto out;
+	}
+
+	ret = tdb_remove_from_freelist(tdb, rec_ptr, rec.next);
+	if (ret == -1) {
+		goto out;
+	}
+
+	if (ftruncate(tdb->fd, tdb->hdr_ofs + rec_ptr) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_repack_online: "
+			 "ftruncate to %u failed: %s\n",
+			 rec_ptr, strerror(errno)));
+		/* give the space back */
+		ret = tdb_free(tdb, rec_ptr, &rec);
+		goto out;
+	}
+
+	tdb_munmap(tdb);
+	tdb->map_size = rec_ptr;
+	ret = tdb_mmap(tdb);
+
+	stats->bytes_reclaimed += tailer;
+
+out:
+	tdb_unlock(tdb, -1, F_WRLCK);
+	tdb_repack_lock_time(stats, &start);
+	return ret;
+}
+
+/*
+  repack a tdb without blocking it: move the records at the end of the
+  file into free space further down, one hash chain at a time, then
+  cut off the free space at the end of the file. Records that only fit
+  above the limit move as far down as they can, so a few passes are
+  made until nothing moves anymore.
+ */
+#define TDB_REPACK_ONLINE_PASSES 4
+
+_PUBLIC_ int tdb_repack_online(struct tdb_context *tdb,
+			       struct tdb_repack_stats *stats)
+{
+	struct tdb_repack_stats tmp;
+	struct timeval start;
+	tdb_off_t limit;
+	int i, pass;
+
+	tdb_trace(tdb, "tdb_repack_online");
+
+	if (stats == NULL) {
+		stats = &tmp;
+	}
+	memset(stats, 0, sizeof(*stats));
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+
+	/* We move records around: not inside a transaction or traverse */
+	if (tdb->transaction != NULL || tdb->traverse_write != 0) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+
+	for (pass = 0; pass < TDB_REPACK_ONLINE_PASSES; pass++) {
+		size_t moved = stats->records_moved;
+
+		if (tdb_repack_limit(tdb, &limit) == -1) {
+			return -1;
+		}
+
+		for (i = 0; i < tdb->hash_size; i++) {
+			if (tdb_repack_chain(tdb, i, limit, stats) == -1) {
+				TDB_LOG((tdb, TDB_DEBUG_ERROR,
+					 "tdb_repack_online: failed to "
+					 "repack chain %d\n", i));
+				return -1;
+			}
+		}
+
+		/* coalesce the free space at the end of the file */
+		gettimeofday(&start, NULL);
+		if (tdb_freelist_size(tdb) == -1) {
+			return -1;
+		}
+		tdb_repack_lock_time(stats, &start);
+
+		if (stats->records_moved == moved) {
+			break;
+		}
+	}
+
+	return tdb_repack_truncate(tdb, stats);
+}
+
 /* Even on files, we can get partial writes due to signals. */
 bool tdb_write_all(int fd, const void *buf, size_t count)
 {
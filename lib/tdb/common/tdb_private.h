@@ -54,6 +54,7 @@ typedef uint32_t tdb_off_t;
 #define TDB_RECOVERY_INVALID_MAGIC (0x0)
 #define TDB_HASH_RWLOCK_MAGIC (0xbad1a51U)
 #define TDB_FEATURE_FLAG_MAGIC (0xbad1a52U)
+#define TDB_HASH_SPLIT_MAGIC (0x5b1175edU)
 #define TDB_ALIGNMENT 4
 #define DEFAULT_HASH_SIZE 131
 #define FREELIST_TOP (sizeof(struct tdb_header))
@@ -66,13 +67,25 @@ typedef uint32_t tdb_off_t;
 #define TDB_DATA_START(hash_size) (TDB_HASH_TOP(hash_size-1) + sizeof(tdb_off_t))
 #define TDB_RECOVERY_HEAD offsetof(struct tdb_header, recovery_start)
 #define TDB_SEQNUM_OFS    offsetof(struct tdb_header, sequence_number)
+#define TDB_FREELIST_CLASSES_NUM 16
+#define TDB_FREELIST_CLASS_TOP(c) \
+	(offsetof(struct tdb_header, freelist_classes) + (c)*sizeof(tdb_off_t))
+#define TDB_HASH_SPLIT_OFS offsetof(struct tdb_header, hash_split)
+#define TDB_HASH_SPLIT_DIR_OFS offsetof(struct tdb_header, hash_split_dir)
+#define TDB_HASH_SPLIT_LEVELS 24
 #define TDB_PAD_BYTE 0x42
 #define TDB_PAD_U32  0x42424242
 
 #define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_FREELIST_CLASSES 0x00000002
+#define TDB_FEATURE_FLAG_SEQLOCK 0x00000004
+#define TDB_FEATURE_FLAG_HASH_SPLIT 0x00000008
 
 #define TDB_SUPPORTED_FEATURE_FLAGS ( \
 	TDB_FEATURE_FLAG_MUTEX | \
+	TDB_FEATURE_FLAG_FREELIST_CLASSES | \
+	TDB_FEATURE_FLAG_SEQLOCK | \
+	TDB_FEATURE_FLAG_HASH_SPLIT | \
 	0)
 
 /* NB assumes there is a local variable called "tdb" that is the
@@ -161,7 +174,12 @@ struct tdb_header {
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
 	uint32_t feature_flags;
 	tdb_len_t mutex_size; /* set if TDB_FEATURE_FLAG_MUTEX is set */
-	tdb_off_t reserved[25];
+	/* set if TDB_FEATURE_FLAG_FREELIST_CLASSES is set */
+	tdb_off_t freelist_classes[TDB_FREELIST_CLASSES_NUM];
+	/* set if TDB_FEATURE_FLAG_HASH_SPLIT is set */
+	tdb_off_t hash_split; /* buckets split off the hash chains */
+	tdb_off_t hash_split_dir; /* record pointing to the bucket segments */
+	tdb_off_t reserved[7];
 };
 
 struct tdb_lock_type {
@@ -175,6 +193,7 @@ struct tdb_traverse_lock {
 	uint32_t off;
 	uint32_t hash;
 	int lock_rw;
+	uint32_t bucket; /* the bucket of "hash" we are in */
 };
 
 enum tdb_lock_flags {
@@ -196,6 +215,7 @@ struct tdb_methods {
 };
 
 struct tdb_mutexes;
+struct tdb_stats;
 
 struct tdb_context {
 	char *name; /* the name of the database */
@@ -213,6 +233,14 @@ struct tdb_context {
 	tdb_off_t hdr_ofs; /* this is 0 or header.mutex_size */
 	struct tdb_mutexes *mutexes; /* mmap of the mutex area */
 
+	struct tdb_stats *stats; /* mmap of "<name>.stats" */
+	size_t stats_size;
+	bool stats_rw; /* we opened with TDB_STATISTICS */
+	unsigned int stats_ops; /* for sampling hot keys */
+
+	uint32_t chain_walk; /* records the last tdb_find() walked */
+	uint32_t chain_avg; /* moving average of chain_walk on stores */
+
 	enum TDB_ERROR ecode; /* error code for last tdb error */
 	uint32_t hash_size;
 	uint32_t feature_flags;
@@ -271,6 +299,13 @@ int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
+unsigned int tdb_freelist_class(tdb_len_t rec_len);
+unsigned int tdb_freelist_count(struct tdb_context *tdb);
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int list);
+int tdb_remove_from_freelist(struct tdb_context *tdb, tdb_off_t off,
+			     tdb_off_t next);
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     tdb_off_t limit, struct tdb_record *rec);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 		       struct tdb_record *rec);
 int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
@@ -305,12 +340,42 @@ void tdb_header_hash(struct tdb_context *tdb,
 unsigned int tdb_old_hash(TDB_DATA *key);
 size_t tdb_dead_space(struct tdb_context *tdb, tdb_off_t off);
 bool tdb_add_off_t(tdb_off_t a, tdb_off_t b, tdb_off_t *pret);
+tdb_off_t tdb_hash_top_read(struct tdb_context *tdb, uint32_t hash,
+			    int (*ofs_read)(struct tdb_context *tdb,
+					    tdb_off_t offset, tdb_off_t *d));
+tdb_off_t tdb_hash_top(struct tdb_context *tdb, uint32_t hash);
+tdb_off_t tdb_bucket_top(struct tdb_context *tdb, uint32_t bucket);
+int tdb_hash_buckets(struct tdb_context *tdb, uint32_t *buckets);
+int tdb_hash_bucket(struct tdb_context *tdb, uint32_t hash, uint32_t *bucket);
+int tdb_hash_split_next(struct tdb_context *tdb, uint32_t *bucket);
+bool tdb_hash_split_empty(struct tdb_context *tdb, uint32_t list);
+void tdb_hash_split_check(struct tdb_context *tdb, uint32_t hash,
+			  uint32_t walked);
 
 /* tdb_off_t and tdb_len_t right now are both uint32_t */
 #define tdb_add_len_t tdb_add_off_t
 
+enum tdb_stats_op {
+	TDB_STATS_FETCH,
+	TDB_STATS_STORE,
+	TDB_STATS_DELETE
+};
+void tdb_stats_open(struct tdb_context *tdb, mode_t mode, bool clear);
+void tdb_stats_munmap(struct tdb_context *tdb);
+bool tdb_stats_lock_list(struct tdb_context *tdb, tdb_off_t offset,
+			 size_t len, int *list);
+void tdb_stats_lock_wait(struct tdb_context *tdb, int list,
+			 unsigned long long usecs);
+void tdb_stats_op(struct tdb_context *tdb, enum tdb_stats_op op,
+		  TDB_DATA key, uint32_t hash);
+
 size_t tdb_mutex_size(struct tdb_context *tdb);
 bool tdb_have_mutexes(struct tdb_context *tdb);
+bool tdb_have_seqlocks(struct tdb_context *tdb);
+bool tdb_mutex_seqlock_read_begin(struct tdb_context *tdb, uint32_t list,
+				  uint32_t seq[2]);
+bool tdb_mutex_seqlock_read_valid(struct tdb_context *tdb, uint32_t list,
+				  const uint32_t seq[2]);
 int tdb_mutex_init(struct tdb_context *tdb);
 int tdb_mutex_mmap(struct tdb_context *tdb);
 int tdb_mutex_munmap(struct tdb_context *tdb);
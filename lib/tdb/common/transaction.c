@@ -75,6 +75,13 @@
     needed per commit to prevent race conditions. It might be possible
     to reduce this to 3 or even 2 with some more work.
 
+  - only the bytes a transaction really changed are saved in the
+    recovery area and written back on commit: each block remembers
+    the range it differs from the file in, writes of unchanged data
+    don't count. Large transactions touching a few bytes in many
+    blocks don't pay for whole blocks twice, and a transaction that
+    changed nothing skips the recovery area and the syncs.
+
   - check for a valid recovery record on open of the tdb, while the
     open lock is held. Automatically recover from the transaction
     recovery area if needed, then continue with the open as
@@ -119,6 +126,13 @@ struct tdb_transaction {
 	   written to, it gets created in this list */
 	uint8_t **blocks;
 	uint32_t num_blocks;
+
+	/* the part of each block that differs from the file, for
+	   blocks[i] bytes [dirty[i].start, dirty[i].end) */
+	struct tdb_transaction_range {
+		tdb_len_t start;
+		tdb_len_t end;
+	} *dirty;
 	uint32_t block_size;      /* bytes in each block */
 	uint32_t last_block_size; /* number of valid bytes in the last block */
 
@@ -202,6 +216,44 @@ fail:
 }
 
 
+/*
+  update part of a transaction block, remembering the range that
+  differs from the file. buf == NULL writes zeros.
+*/
+static void transaction_write_block(struct tdb_context *tdb, uint32_t blk,
+				    tdb_off_t off, const void *buf,
+				    tdb_len_t len)
+{
+	struct tdb_transaction_range *dirty = &tdb->transaction->dirty[blk];
+	uint8_t *block = tdb->transaction->blocks[blk];
+
+	if (buf == NULL) {
+		tdb_len_t i;
+
+		for (i = 0; i < len && block[off + i] == 0; i++) {
+			;
+		}
+		if (i == len) {
+			return;
+		}
+		memset(block + off, 0, len);
+	} else {
+		if (memcmp(block + off, buf, len) == 0) {
+			/* rewriting what is there, e.g. an unchanged header */
+			return;
+		}
+		memcpy(block + off, buf, len);
+	}
+
+	if (dirty->start == dirty->end) {
+		dirty->start = off;
+		dirty->end = off + len;
+		return;
+	}
+	dirty->start = MIN(dirty->start, off);
+	dirty->end = MAX(dirty->end, off + len);
+}
+
 /*
   write while in a transaction
 */
@@ -248,6 +300,7 @@ static int transaction_write(struct tdb_context *tdb, tdb_off_t off,
 
 	if (tdb->transaction->num_blocks <= blk) {
 		uint8_t **new_blocks;
+		struct tdb_transaction_range *new_dirty;
 		/* expand the blocks array */
 		new_blocks = (uint8_t **)realloc(tdb->transaction->blocks,
 						 (blk+1)*sizeof(uint8_t *));
@@ -258,18 +311,43 @@ static int transaction_write(struct tdb_context *tdb, tdb_off_t off,
 		memset(&new_blocks[tdb->transaction->num_blocks], 0,
 		       (1+(blk - tdb->transaction->num_blocks))*sizeof(uint8_t *));
 		tdb->transaction->blocks = new_blocks;
+
+		new_dirty = (struct tdb_transaction_range *)realloc(
+			tdb->transaction->dirty,
+			(blk+1)*sizeof(struct tdb_transaction_range));
+		if (new_dirty == NULL) {
+			tdb->ecode = TDB_ERR_OOM;
+			goto fail;
+		}
+		memset(&new_dirty[tdb->transaction->num_blocks], 0,
+		       (1+(blk - tdb->transaction->num_blocks))*sizeof(struct tdb_transaction_range));
+		tdb->transaction->dirty = new_dirty;
+
 		tdb->transaction->num_blocks = blk+1;
 		tdb->transaction->last_block_size = 0;
 	}
 
 	/* allocate and fill a block? */
 	if (tdb->transaction->blocks[blk] == NULL) {
+		struct tdb_transaction_range *dirty = &tdb->transaction->dirty[blk];
+
 		tdb->transaction->blocks[blk] = (uint8_t *)calloc(tdb->transaction->block_size, 1);
 		if (tdb->transaction->blocks[blk] == NULL) {
 			tdb->ecode = TDB_ERR_OOM;
 			tdb->transaction->transaction_error = 1;
 			return -1;
 		}
+
+		/* anything beyond the old end of file is new: the
+		   expansion on commit pads it, so it has to be written */
+		dirty->start = 0;
+		dirty->end = 0;
+		if (tdb->transaction->old_map_size < (blk + 1) * tdb->transaction->block_size) {
+			if (tdb->transaction->old_map_size > blk * tdb->transaction->block_size) {
+				dirty->start = tdb->transaction->old_map_size - (blk * tdb->transaction->block_size);
+			}
+			dirty->end = tdb->transaction->block_size;
+		}
 		if (tdb->transaction->old_map_size > blk * tdb->transaction->block_size) {
 			tdb_len_t len2 = tdb->transaction->block_size;
 			if (len2 + (blk * tdb->transaction->block_size) > tdb->transaction->old_map_size) {
@@ -289,11 +367,7 @@ static int transaction_write(struct tdb_context *tdb, tdb_off_t off,
 	}
 
 	/* overwrite part of an existing block */
-	if (buf == NULL) {
-		memset(tdb->transaction->blocks[blk] + off, 0, len);
-	} else {
-		memcpy(tdb->transaction->blocks[blk] + off, buf, len);
-	}
+	transaction_write_block(tdb, blk, off, buf, len);
 	if (blk == tdb->transaction->num_blocks-1) {
 		if (len + off > tdb->transaction->last_block_size) {
 			tdb->transaction->last_block_size = len + off;
@@ -366,6 +440,13 @@ static void transaction_next_hash_chain(struct tdb_context *tdb, uint32_t *chain
 {
 	uint32_t h = *chain;
 	for (;h < tdb->hash_size;h++) {
+		/* hash_heads only has the first bucket of each chain */
+		if (tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT) {
+			if (!tdb_hash_split_empty(tdb, h)) {
+				break;
+			}
+			continue;
+		}
 		/* the +1 takes account of the freelist */
 		if (0 != tdb->transaction->hash_heads[h+1]) {
 			break;
@@ -594,6 +675,7 @@ static int _tdb_transaction_cancel(struct tdb_context *tdb)
 		}
 	}
 	SAFE_FREE(tdb->transaction->blocks);
+	SAFE_FREE(tdb->transaction->dirty);
 
 	if (tdb->transaction->magic_offset) {
 		const struct tdb_methods *methods = tdb->transaction->io_methods;
@@ -628,6 +710,58 @@ _PUBLIC_ int tdb_transaction_cancel(struct tdb_context *tdb)
 	return _tdb_transaction_cancel(tdb);
 }
 
+/*
+  the part of block i the commit has to write below "eof". With the
+  old file size as "eof" that is what needs to be saved for recovery.
+  False if there is none.
+*/
+static bool transaction_block_range(struct tdb_context *tdb, uint32_t i,
+				    tdb_off_t eof, tdb_off_t *offset,
+				    tdb_len_t *length)
+{
+	const struct tdb_transaction_range *dirty = &tdb->transaction->dirty[i];
+	tdb_off_t start, end, limit;
+
+	if (tdb->transaction->blocks[i] == NULL) {
+		return false;
+	}
+
+	start = i * tdb->transaction->block_size;
+	limit = start + tdb->transaction->block_size;
+	if (i == tdb->transaction->num_blocks-1) {
+		limit = start + tdb->transaction->last_block_size;
+	}
+	limit = MIN(limit, eof);
+
+	end = MIN(start + dirty->end, limit);
+	start += dirty->start;
+	if (start >= end) {
+		return false;
+	}
+
+	*offset = start;
+	*length = end - start;
+	return true;
+}
+
+/*
+  anything to commit?
+*/
+static bool transaction_changed(struct tdb_context *tdb)
+{
+	tdb_off_t offset;
+	tdb_len_t length;
+	uint32_t i;
+
+	for (i=0;i<tdb->transaction->num_blocks;i++) {
+		if (transaction_block_range(tdb, i, (tdb_off_t)-1,
+					    &offset, &length)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
   work out how much space the linearised recovery data will consume
 */
@@ -638,23 +772,21 @@ static bool tdb_recovery_size(struct tdb_context *tdb, tdb_len_t *result)
 
 	recovery_size = sizeof(uint32_t);
 	for (i=0;i<tdb->transaction->num_blocks;i++) {
-		tdb_len_t block_size;
+		tdb_off_t offset;
+		tdb_len_t length;
 		if (i * tdb->transaction->block_size >= tdb->transaction->old_map_size) {
 			break;
 		}
-		if (tdb->transaction->blocks[i] == NULL) {
+		if (!transaction_block_range(tdb, i,
+					     tdb->transaction->old_map_size,
+					     &offset, &length)) {
 			continue;
 		}
 		if (!tdb_add_len_t(recovery_size, 2*sizeof(tdb_off_t),
 				   &recovery_size)) {
 			return false;
 		}
-		if (i == tdb->transaction->num_blocks-1) {
-			block_size = tdb->transaction->last_block_size;
-		} else {
-			block_size =  tdb->transaction->block_size;
-		}
-		if (!tdb_add_len_t(recovery_size, block_size,
+		if (!tdb_add_len_t(recovery_size, length,
 				   &recovery_size)) {
 			return false;
 		}
@@ -846,25 +978,13 @@ static int transaction_setup_recovery(struct tdb_context *tdb,
 		tdb_off_t offset;
 		tdb_len_t length;
 
-		if (tdb->transaction->blocks[i] == NULL) {
-			continue;
-		}
-
-		offset = i * tdb->transaction->block_size;
-		length = tdb->transaction->block_size;
-		if (i == tdb->transaction->num_blocks-1) {
-			length = tdb->transaction->last_block_size;
+		if (i * tdb->transaction->block_size >= old_map_size) {
+			break;
 		}
-
-		if (offset >= old_map_size) {
+		if (!transaction_block_range(tdb, i, old_map_size,
+					     &offset, &length)) {
 			continue;
 		}
-		if (offset + length > tdb->transaction->old_map_size) {
-			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_setup_recovery: transaction data over new region boundary\n"));
-			free(data);
-			tdb->ecode = TDB_ERR_CORRUPT;
-			return -1;
-		}
 		memcpy(p, &offset, 4);
 		memcpy(p+4, &length, 4);
 		if (DOCONV()) {
@@ -965,7 +1085,7 @@ static int _tdb_transaction_prepare_commit(struct tdb_context *tdb)
 	}
 
 	/* check for a null transaction */
-	if (tdb->transaction->blocks == NULL) {
+	if (tdb->transaction->blocks == NULL || !transaction_changed(tdb)) {
 		return 0;
 	}
 
@@ -1038,17 +1158,20 @@ static bool repack_worthwhile(struct tdb_context *tdb)
 	tdb_off_t ptr;
 	struct tdb_record rec;
 	tdb_len_t total = 0, largest = 0;
+	unsigned int list;
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &ptr) == -1) {
-		return false;
-	}
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list), &ptr) == -1) {
+			return false;
+		}
 
-	while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
-		total += rec.rec_len;
-		if (rec.rec_len > largest) {
-			largest = rec.rec_len;
+		while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
+			total += rec.rec_len;
+			if (rec.rec_len > largest) {
+				largest = rec.rec_len;
+			}
+			ptr = rec.next;
 		}
-		ptr = rec.next;
 	}
 
 	return total > largest * 2;
@@ -1084,7 +1207,7 @@ _PUBLIC_ int tdb_transaction_commit(struct tdb_context *tdb)
 	}
 
 	/* check for a null transaction */
-	if (tdb->transaction->blocks == NULL) {
+	if (tdb->transaction->blocks == NULL || !transaction_changed(tdb)) {
 		_tdb_transaction_cancel(tdb);
 		return 0;
 	}
@@ -1102,17 +1225,16 @@ _PUBLIC_ int tdb_transaction_commit(struct tdb_context *tdb)
 		tdb_off_t offset;
 		tdb_len_t length;
 
-		if (tdb->transaction->blocks[i] == NULL) {
+		if (!transaction_block_range(tdb, i, (tdb_off_t)-1,
+					     &offset, &length)) {
+			SAFE_FREE(tdb->transaction->blocks[i]);
 			continue;
 		}
 
-		offset = i * tdb->transaction->block_size;
-		length = tdb->transaction->block_size;
-		if (i == tdb->transaction->num_blocks-1) {
-			length = tdb->transaction->last_block_size;
-		}
-
-		if (methods->tdb_write(tdb, offset, tdb->transaction->blocks[i], length) == -1) {
+		if (methods->tdb_write(tdb, offset,
+				       tdb->transaction->blocks[i] +
+				       (offset % tdb->transaction->block_size),
+				       length) == -1) {
 			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_commit: write failed during commit\n"));
 
 			/* we've overwritten part of the data and
@@ -1135,6 +1257,7 @@ _PUBLIC_ int tdb_transaction_commit(struct tdb_context *tdb)
 	}
 
 	SAFE_FREE(tdb->transaction->blocks);
+	SAFE_FREE(tdb->transaction->dirty);
 	tdb->transaction->num_blocks = 0;
 
 	/* ensure the new data is on disk */
@@ -29,12 +29,35 @@
 
 #define TDB_NEXT_LOCK_ERR ((tdb_off_t)-1)
 
+/*
+  Move on to the next non-empty bucket split off the locked chain:
+  1 if there is one, 0 at the end of the chain, -1 on error
+ */
+static int tdb_next_bucket(struct tdb_context *tdb,
+			   struct tdb_traverse_lock *tlock)
+{
+	tdb_off_t top;
+	int ret;
+
+	while ((ret = tdb_hash_split_next(tdb, &tlock->bucket)) == 1) {
+		top = tdb_bucket_top(tdb, tlock->bucket);
+		if (top == 0 || tdb_ofs_read(tdb, top, &tlock->off) == -1) {
+			return -1;
+		}
+		if (tlock->off != 0) {
+			return 1;
+		}
+	}
+	return ret;
+}
+
 /* Uses traverse lock: 0 = finish, TDB_NEXT_LOCK_ERR = error,
    other = record offset */
 static tdb_off_t tdb_next_lock(struct tdb_context *tdb, struct tdb_traverse_lock *tlock,
 			 struct tdb_record *rec)
 {
 	int want_next = (tlock->off != 0);
+	int ret = 0;
 
 	/* Lock each chain from the start one. */
 	for (; tlock->hash < tdb->hash_size; tlock->hash++) {
@@ -78,6 +101,7 @@ static tdb_off_t tdb_next_lock(struct tdb_context *tdb, struct tdb_traverse_lock
 
 		/* No previous record?  Start at top of chain. */
 		if (!tlock->off) {
+			tlock->bucket = tlock->hash;
 			if (tdb_ofs_read(tdb, TDB_HASH_TOP(tlock->hash),
 				     &tlock->off) == -1)
 				goto fail;
@@ -94,8 +118,9 @@ static tdb_off_t tdb_next_lock(struct tdb_context *tdb, struct tdb_traverse_lock
 			tlock->off = rec->next;
 		}
 
-		/* Iterate through chain */
-		while( tlock->off) {
+		/* Iterate through chain, and the buckets split off it */
+		while (tlock->off ||
+		       (ret = tdb_next_bucket(tdb, tlock)) == 1) {
 			tdb_off_t current;
 			if (tdb_rec_read(tdb, tlock->off, rec) == -1)
 				goto fail;
@@ -121,6 +146,8 @@ static tdb_off_t tdb_next_lock(struct tdb_context *tdb, struct tdb_traverse_lock
 			    tdb_do_delete(tdb, current, rec) != 0)
 				goto fail;
 		}
+		if (ret == -1)
+			goto fail;
 		tdb_unlock(tdb, tlock->hash, tlock->lock_rw);
 		want_next = 0;
 	}
@@ -351,6 +378,11 @@ _PUBLIC_ TDB_DATA tdb_nextkey(struct tdb_context *tdb, TDB_DATA oldkey)
 			return tdb_null;
 		}
 		tdb->travlocks.hash = BUCKET(rec.full_hash);
+		if (tdb_hash_bucket(tdb, rec.full_hash,
+				    &tdb->travlocks.bucket) != 0) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_nextkey: no bucket for the old key!\n"));
+			return tdb_null;
+		}
 		if (tdb_lock_record(tdb, tdb->travlocks.off) != 0) {
 			TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_nextkey: lock_record failed (%s)!\n", strerror(errno)));
 			return tdb_null;
@@ -84,6 +84,19 @@ extern "C" {
 #define TDB_MUTEX_LOCKING 4096 /** optimized locking using robust mutexes if supported,
                                    only with tdb >= 1.3.0 and TDB_CLEAR_IF_FIRST
                                    after checking tdb_runtime_check_for_robust_mutexes() */
+#define TDB_XXHASH 8192 /** Faster hashing using xxHash64, takes precedence over
+                            TDB_INCOMPATIBLE_HASH: can't be opened by tdb < 1.3.9. */
+#define TDB_FREELIST_CLASSES 16384 /** Keep free space in lists segregated by size,
+                                     for allocation independent of the freelist
+                                     length: can't be opened by tdb < 1.3.9. */
+#define TDB_SEQLOCK_READS 32768 /** Read records without taking the chain mutex,
+                                   only with TDB_MUTEX_LOCKING: can't be opened
+                                   by tdb < 1.3.10. */
+#define TDB_STATISTICS 65536 /** Count lock waits and operations per hash chain
+                               and sample hot keys in "<name>.stats" */
+#define TDB_HASH_SPLIT 131072 /** Grow the hash table by splitting chains as
+                                 they get long: can't be opened by
+                                 tdb < 1.3.10. */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -152,6 +165,11 @@ struct tdb_logging_context {
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_XXHASH - Faster hashing using xxHash64: can't be opened by tdb < 1.3.9.\n
+ *                         TDB_FREELIST_CLASSES - Size class freelists: can't be opened by tdb < 1.3.9.\n
+ *                         TDB_SEQLOCK_READS - Lockless reads with TDB_MUTEX_LOCKING: can't be opened by tdb < 1.3.10.\n
+ *                         TDB_STATISTICS - Keep per chain and hot key statistics in "<name>.stats".\n
+ *                         TDB_HASH_SPLIT - Grow the hash table with the number of records: can't be opened by tdb < 1.3.10.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -193,6 +211,11 @@ struct tdb_context *tdb_open(const char *name, int hash_size, int tdb_flags,
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_XXHASH - Faster hashing using xxHash64: can't be opened by tdb < 1.3.9.\n
+ *                         TDB_FREELIST_CLASSES - Size class freelists: can't be opened by tdb < 1.3.9.\n
+ *                         TDB_SEQLOCK_READS - Lockless reads with TDB_MUTEX_LOCKING: can't be opened by tdb < 1.3.10.\n
+ *                         TDB_STATISTICS - Keep per chain and hot key statistics in "<name>.stats".\n
+ *                         TDB_HASH_SPLIT - Grow the hash table with the number of records: can't be opened by tdb < 1.3.10.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -305,7 +328,9 @@ TDB_DATA tdb_fetch(struct tdb_context *tdb, TDB_DATA key);
  *
  * @warning The parser is called while tdb holds a lock on the record. DO NOT
  * call other tdb routines from within the parser. Also, for good performance
- * you should make the parser fast to allow parallel operations.
+ * you should make the parser fast to allow parallel operations. With
+ * TDB_SEQLOCK_READS the parser may instead get a private copy of the record
+ * without any lock held.
  *
  * @param[in]  tdb      The tdb to parse the record.
  *
@@ -324,6 +349,39 @@ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 					    void *private_data),
 			      void *private_data);
 
+/**
+ * @brief Hand several records to a parser function.
+ *
+ * This does what a tdb_parse_record() call per key would do, but the keys
+ * are sorted by hash chain first, and every chain is only locked once for
+ * all the keys in it.
+ *
+ * @warning The same restrictions as for tdb_parse_record() apply to the
+ * parser.
+ *
+ * @param[in]  tdb      The tdb to parse the records.
+ *
+ * @param[in]  keys     The keys to parse.
+ *
+ * @param[in]  num_keys The number of keys.
+ *
+ * @param[in]  parser   The parser to use to parse the data, "idx" is the
+ *                      index of the key in "keys". It is not called for
+ *                      keys that don't exist.
+ *
+ * @param[in]  private_data A private data pointer which is passed to the parser
+ *                          function.
+ *
+ * @return              0 if all records were looked up, -1 on error. A
+ *                      non-zero return value of "parser" stops the lookups
+ *                      and is passed up to the caller.
+ */
+int tdb_parse_record_multi(struct tdb_context *tdb,
+			   const TDB_DATA *keys, size_t num_keys,
+			   int (*parser)(size_t idx, TDB_DATA key,
+					 TDB_DATA data, void *private_data),
+			   void *private_data);
+
 /**
  * @brief Delete an entry in the database given a key.
  *
@@ -809,6 +867,17 @@ void tdb_increment_seqnum_nonblock(struct tdb_context *tdb);
  */
 unsigned int tdb_jenkins_hash(TDB_DATA *key);
 
+/**
+ * @brief Create a hash of the key using xxHash64.
+ *
+ * This is the hash used for databases created with TDB_XXHASH.
+ *
+ * @param[in]  key      The key to hash
+ *
+ * @return              The hash, the 64-bit xxHash64 folded to 32 bits.
+ */
+unsigned int tdb_xxhash(TDB_DATA *key);
+
 /**
  * @brief Check the consistency of the database.
  *
@@ -889,12 +958,75 @@ int tdb_chainunlock_read(struct tdb_context *tdb, TDB_DATA key);
 int tdb_chainlock_mark(struct tdb_context *tdb, TDB_DATA key);
 int tdb_chainlock_unmark(struct tdb_context *tdb, TDB_DATA key);
 
+/*
+ * Lock the chains of several keys, each chain once, in ascending chain
+ * order. Processes locking overlapping sets of keys this way don't
+ * deadlock each other as long as they don't hold other chain locks.
+ */
+int tdb_chainlock_multi(struct tdb_context *tdb,
+			const TDB_DATA *keys, size_t num_keys);
+int tdb_chainunlock_multi(struct tdb_context *tdb,
+			  const TDB_DATA *keys, size_t num_keys);
+
 void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t *sigptr);
 
 /* wipe and repack */
 int tdb_wipe_all(struct tdb_context *tdb);
 int tdb_repack(struct tdb_context *tdb);
 
+/*
+ * Online repack: move the records at the end of the file into free
+ * space further down, one hash chain at a time, then cut off the free
+ * space at the end. Unlike tdb_repack() this only ever holds one chain
+ * lock or the freelist lock for a short time.
+ */
+struct tdb_repack_stats {
+	size_t records_moved;
+	size_t records_skipped; /* no room further down, or traversed */
+	size_t bytes_moved;
+	size_t bytes_reclaimed; /* the file got this much smaller */
+	unsigned long long lock_usecs; /* total time locks were held */
+	unsigned long long lock_usecs_max; /* longest time a lock was held */
+};
+int tdb_repack_online(struct tdb_context *tdb, struct tdb_repack_stats *stats);
+
+/*
+ * Statistics of a database opened with TDB_STATISTICS by at least one
+ * process. They live in a shared "<name>.stats" file next to the
+ * database, so they cover all processes using it and can be read by
+ * anyone, also without TDB_STATISTICS.
+ */
+struct tdb_chain_stats {
+	unsigned long long lock_waits; /* chain lock was not free */
+	unsigned long long lock_wait_usecs; /* time spent waiting for it */
+	unsigned long long fetches;
+	unsigned long long stores;
+	unsigned long long deletes;
+};
+
+/* Get the statistics of chain "list", -1 is the freelist */
+int tdb_stats_chain(struct tdb_context *tdb, int list,
+		    struct tdb_chain_stats *stats);
+
+#define TDB_HOT_KEY_MAX_LEN 64
+
+struct tdb_hot_key {
+	unsigned long long count; /* estimated number of operations */
+	unsigned int hash;
+	size_t key_len; /* only TDB_HOT_KEY_MAX_LEN bytes are kept */
+	unsigned char key[TDB_HOT_KEY_MAX_LEN];
+};
+
+/*
+ * Get up to max_keys of the most used keys, most used first. Keys are
+ * sampled, so counts are estimates. Returns the number of keys or -1.
+ */
+int tdb_stats_hot_keys(struct tdb_context *tdb, struct tdb_hot_key *keys,
+		       int max_keys);
+
+/* Start counting from zero again, not on read-only opens */
+int tdb_stats_reset(struct tdb_context *tdb);
+
 /* Debug functions. Not used in production. */
 void tdb_dump_all(struct tdb_context *tdb);
 int tdb_printfreelist(struct tdb_context *tdb);
@@ -770,6 +770,11 @@ PyObject* module_init(void)
 	PyModule_AddIntConstant(m, "ALLOW_NESTING", TDB_ALLOW_NESTING);
 	PyModule_AddIntConstant(m, "DISALLOW_NESTING", TDB_DISALLOW_NESTING);
 	PyModule_AddIntConstant(m, "INCOMPATIBLE_HASH", TDB_INCOMPATIBLE_HASH);
+	PyModule_AddIntConstant(m, "XXHASH", TDB_XXHASH);
+	PyModule_AddIntConstant(m, "FREELIST_CLASSES", TDB_FREELIST_CLASSES);
+	PyModule_AddIntConstant(m, "SEQLOCK_READS", TDB_SEQLOCK_READS);
+	PyModule_AddIntConstant(m, "STATISTICS", TDB_STATISTICS);
+	PyModule_AddIntConstant(m, "HASH_SPLIT", TDB_HASH_SPLIT);
 
 	PyModule_AddStringConstant(m, "__docformat__", "restructuredText");
 
@@ -0,0 +1,108 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+static double timeval_elapsed2(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) +
+	       (tv2->tv_usec - tv1->tv_usec)*1.0e-6;
+}
+
+static double timeval_elapsed(const struct timeval *tv)
+{
+	struct timeval tv2;
+	gettimeofday(&tv2, NULL);
+	return timeval_elapsed2(tv, &tv2);
+}
+
+static const struct {
+	const char *name;
+	int tdb_flags;
+} layouts[] = {
+	{ "single", 0 },
+	{ "classes", TDB_FREELIST_CLASSES },
+};
+
+#define NUM_KEYS 20000
+#define NUM_OPS 200000
+
+/*
+ * Store and delete records of random size, about a third of the keys
+ * are deleted at any time. Report the time per operation, the file
+ * size and the freelist length for the classic single freelist and
+ * for the size class freelists.
+ */
+int main(int argc, char *argv[])
+{
+	static unsigned char buf[4096];
+	size_t l;
+
+	plan_tests(2 * ARRAY_SIZE(layouts));
+
+	for (l = 0; l < ARRAY_SIZE(layouts); l++) {
+		struct tdb_context *tdb;
+		struct timeval start;
+		double elapsed;
+		unsigned int i, k;
+		TDB_DATA key, data;
+		int num_free;
+
+		srandom(42);
+
+		tdb = tdb_open_ex("run-freelist-churn-bench.tdb", 10007,
+				  TDB_CLEAR_IF_FIRST|TDB_NOLOCK|TDB_NOSYNC|
+				  layouts[l].tdb_flags,
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok(tdb != NULL, "open %s", layouts[l].name);
+
+		key.dptr = (unsigned char *)&k;
+		key.dsize = sizeof(k);
+		data.dptr = buf;
+
+		gettimeofday(&start, NULL);
+		for (i = 0; i < NUM_OPS; i++) {
+			k = random() % NUM_KEYS;
+
+			if (random() % 3 == 0) {
+				tdb_delete(tdb, key);
+				continue;
+			}
+
+			/* a few big records among many small ones */
+			data.dsize = 16 + random() % 256;
+			if (random() % 16 == 0) {
+				data.dsize = random() % sizeof(buf);
+			}
+			tdb_store(tdb, key, data, TDB_REPLACE);
+		}
+		elapsed = timeval_elapsed(&start);
+
+		ok(tdb_check(tdb, NULL, NULL) == 0, "check %s",
+		   layouts[l].name);
+
+		num_free = tdb_freelist_size(tdb);
+
+		diag("%-8s %6.2f us/op, file size %u, %d free records",
+		     layouts[l].name, elapsed * 1e6 / NUM_OPS,
+		     (unsigned)tdb->map_size, num_free);
+
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,135 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/freelistcheck.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_KEYS 500
+#define NUM_OPS 5000
+
+static bool churn(struct tdb_context *tdb)
+{
+	unsigned char buf[5000];
+	unsigned int i, k;
+	TDB_DATA key, data;
+
+	memset(buf, 0x5a, sizeof(buf));
+
+	key.dptr = (unsigned char *)&k;
+	key.dsize = sizeof(k);
+
+	for (i = 0; i < NUM_OPS; i++) {
+		k = random() % NUM_KEYS;
+
+		if (random() % 3 == 0) {
+			tdb_delete(tdb, key);
+			continue;
+		}
+
+		/* mostly small records, some big ones */
+		data.dptr = buf;
+		data.dsize = random() % 200;
+		if (random() % 10 == 0) {
+			data.dsize = random() % sizeof(buf);
+		}
+		if (tdb_store(tdb, key, data, TDB_REPLACE) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP,
+			TDB_CONVERT, TDB_NOMMAP|TDB_CONVERT };
+	int num_entries;
+
+	plan_tests(17 * ARRAY_SIZE(flags) + 3);
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++) {
+		unsigned int list, full = 0;
+		tdb_off_t head_full, head_last;
+
+		tdb = tdb_open_ex("run-freelist-classes.tdb", 131,
+				  TDB_CLEAR_IF_FIRST|TDB_FREELIST_CLASSES|
+				  flags[i],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES);
+
+		ok1(churn(tdb));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		ok1(tdb_validate_freelist(tdb, &num_entries) == 0);
+		ok1(num_entries > 0);
+
+		/* merging moves records that outgrew their class */
+		ok1(tdb_freelist_size(tdb) > 0);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+		/* A record in a too big class is corruption. */
+		for (list = 0; list < TDB_FREELIST_CLASSES_NUM - 1; list++) {
+			tdb_ofs_read(tdb, TDB_FREELIST_CLASS_TOP(list),
+				     &head_full);
+			if (head_full != 0) {
+				full = list;
+				break;
+			}
+		}
+		ok1(head_full != 0);
+		tdb_ofs_read(tdb, TDB_FREELIST_CLASS_TOP(TDB_FREELIST_CLASSES_NUM-1),
+			     &head_last);
+		tdb_ofs_write(tdb, TDB_FREELIST_CLASS_TOP(full), &head_last);
+		tdb_ofs_write(tdb, TDB_FREELIST_CLASS_TOP(TDB_FREELIST_CLASSES_NUM-1),
+			      &head_full);
+		suppress_logging = true;
+		ok1(tdb_check(tdb, NULL, NULL) == -1);
+		suppress_logging = false;
+		ok1(tdb_error(tdb) == TDB_ERR_CORRUPT);
+		tdb_ofs_write(tdb, TDB_FREELIST_CLASS_TOP(full), &head_full);
+		tdb_ofs_write(tdb, TDB_FREELIST_CLASS_TOP(TDB_FREELIST_CLASSES_NUM-1),
+			      &head_last);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+
+		/* The layout is a property of the file, not of the open. */
+		tdb = tdb_open_ex("run-freelist-classes.tdb", 0, flags[i],
+				  O_RDWR, 0600, &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES);
+		ok1(churn(tdb));
+		ok1(tdb_wipe_all(tdb) == 0);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+	}
+
+	/* Without the flag on creation, an existing file keeps one list. */
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 131, TDB_CLEAR_IF_FIRST,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	tdb_close(tdb);
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 131,
+			  TDB_FREELIST_CLASSES,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES));
+	ok1(churn(tdb) && tdb_check(tdb, NULL, NULL) == 0);
+	tdb_close(tdb);
+
+	return exit_status();
+}
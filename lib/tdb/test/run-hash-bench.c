@@ -0,0 +1,93 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+static double timeval_elapsed2(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) +
+	       (tv2->tv_usec - tv1->tv_usec)*1.0e-6;
+}
+
+static double timeval_elapsed(const struct timeval *tv)
+{
+	struct timeval tv2;
+	gettimeofday(&tv2, NULL);
+	return timeval_elapsed2(tv, &tv2);
+}
+
+static const struct {
+	const char *name;
+	tdb_hash_func fn;
+} hashes[] = {
+	{ "old", tdb_old_hash },
+	{ "jenkins", tdb_jenkins_hash },
+	{ "xxhash", tdb_xxhash },
+};
+
+/*
+ * Typical key sizes: 4/8 for ids, 16 for guids,
+ * 24 for file_ids (locking.tdb, brlock.tdb) and
+ * larger ones for names.
+ */
+static const size_t key_sizes[] = { 4, 8, 16, 24, 32, 64, 128, 256, 1024 };
+
+#define HASH_BENCH_BYTES (16 * 1024 * 1024)
+
+/* Report the speed of the inbuilt hash functions per key size. */
+int main(int argc, char *argv[])
+{
+	uint8_t buf[1024];
+	size_t i, k;
+
+	plan_tests(ARRAY_SIZE(key_sizes) * ARRAY_SIZE(hashes));
+
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = random();
+	}
+
+	for (k = 0; k < ARRAY_SIZE(key_sizes); k++) {
+		size_t loops = HASH_BENCH_BYTES / key_sizes[k];
+
+		for (i = 0; i < ARRAY_SIZE(hashes); i++) {
+			struct timeval start;
+			double elapsed;
+			unsigned int sum = 0;
+			TDB_DATA key;
+			size_t l;
+
+			key.dsize = key_sizes[k];
+
+			gettimeofday(&start, NULL);
+			for (l = 0; l < loops; l++) {
+				/* vary the key to keep the cpu honest */
+				key.dptr = buf + (l % (sizeof(buf) - key.dsize + 1));
+				sum += hashes[i].fn(&key);
+			}
+			elapsed = timeval_elapsed(&start);
+
+			ok(elapsed >= 0, "%s hash of %zu byte keys",
+			   hashes[i].name, key_sizes[k]);
+			diag("%-8s %5zu byte keys: %7.2f ns/key %8.1f MB/s "
+			     "(sum 0x%08x)",
+			     hashes[i].name, key_sizes[k],
+			     elapsed * 1e9 / loops,
+			     HASH_BENCH_BYTES / elapsed / 1e6, sum);
+		}
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,119 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_FETCHES 200000
+
+static double timeval_elapsed2(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) +
+	       (tv2->tv_usec - tv1->tv_usec)*1.0e-6;
+}
+
+static double timeval_elapsed(const struct timeval *tv)
+{
+	struct timeval tv2;
+	gettimeofday(&tv2, NULL);
+	return timeval_elapsed2(tv, &tv2);
+}
+
+static int parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	return data.dsize == 100 ? 0 : -1;
+}
+
+/*
+ * Fill a database with the default hash size from 1000 to 100000
+ * records and time fetches of random existing keys at each size. With
+ * a fixed hash table the fetch walks longer and longer chains, with
+ * TDB_HASH_SPLIT the chains are split as they grow. TDB_NOLOCK keeps
+ * the fcntl calls out of the numbers.
+ */
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		int tdb_flags;
+	} modes[] = {
+		{ "fixed", 0 },
+		{ "split", TDB_HASH_SPLIT },
+	};
+	static const unsigned int sizes[] = { 1000, 10000, 100000 };
+	double usecs[ARRAY_SIZE(modes)][ARRAY_SIZE(sizes)];
+	unsigned char buf[100];
+	unsigned int m, s, i, k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	TDB_DATA data = { .dptr = buf, .dsize = sizeof(buf) };
+
+	plan_tests(ARRAY_SIZE(modes) * (ARRAY_SIZE(sizes) + 1) + 2);
+
+	memset(buf, 'x', sizeof(buf));
+
+	for (m = 0; m < ARRAY_SIZE(modes); m++) {
+		struct tdb_context *tdb;
+		uint32_t buckets = 0;
+
+		tdb = tdb_open_ex("run-hash-split-bench.tdb", 0,
+				  TDB_CLEAR_IF_FIRST|TDB_NOSYNC|TDB_NOLOCK|
+				  modes[m].tdb_flags,
+				  O_RDWR|O_CREAT|O_TRUNC, 0600,
+				  &taplogctx, NULL);
+		ok(tdb != NULL, "open %s", modes[m].name);
+
+		k = 0;
+		for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+			struct timeval start;
+			bool fetched = true;
+
+			for (; k < sizes[s]; k++) {
+				tdb_store(tdb, key, data, TDB_INSERT);
+			}
+
+			srandom(s);
+			gettimeofday(&start, NULL);
+			for (i = 0; i < NUM_FETCHES; i++) {
+				k = random() % sizes[s];
+				if (tdb_parse_record(tdb, key, parse_fn,
+						     NULL) != 0) {
+					fetched = false;
+				}
+			}
+			usecs[m][s] = timeval_elapsed(&start) * 1e6
+				/ NUM_FETCHES;
+			k = sizes[s];
+
+			tdb_hash_buckets(tdb, &buckets);
+			ok(fetched, "%s fetches of %u records",
+			   modes[m].name, sizes[s]);
+			diag("%-5s %6u records, %5u buckets: %6.3f us/fetch",
+			     modes[m].name, sizes[s], (unsigned)buckets,
+			     usecs[m][s]);
+		}
+
+		if (modes[m].tdb_flags & TDB_HASH_SPLIT) {
+			/* the chains did not grow with the records */
+			ok1(buckets >= sizes[ARRAY_SIZE(sizes)-1] / 4);
+		}
+		tdb_close(tdb);
+	}
+
+	ok(usecs[1][ARRAY_SIZE(sizes)-1] < usecs[0][ARRAY_SIZE(sizes)-1],
+	   "split buckets are faster with %u records",
+	   sizes[ARRAY_SIZE(sizes)-1]);
+
+	return exit_status();
+}
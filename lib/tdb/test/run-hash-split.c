@@ -0,0 +1,212 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_RECORDS 2000
+#define NUM_CHILD_RECORDS 20000
+
+struct seen {
+	unsigned char count[NUM_RECORDS];
+	unsigned int others;
+	bool slow;
+};
+
+static int mark_seen(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data,
+		     void *private_data)
+{
+	struct seen *seen = (struct seen *)private_data;
+	unsigned int k;
+
+	memcpy(&k, key.dptr, sizeof(k));
+	if (k < NUM_RECORDS) {
+		seen->count[k] += 1;
+	} else {
+		seen->others += 1;
+	}
+	if (seen->slow) {
+		/* give the child time to split what we have not seen yet */
+		usleep(100);
+	}
+	return 0;
+}
+
+static bool seen_once(const struct seen *seen)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		if (seen->count[i] != 1) {
+			diag("record %u seen %u times", i, seen->count[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t buckets(struct tdb_context *tdb)
+{
+	uint32_t b = 0;
+
+	tdb_hash_buckets(tdb, &b);
+	return b;
+}
+
+static bool all_there(struct tdb_context *tdb, unsigned int from,
+		      unsigned int to)
+{
+	unsigned int k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+
+	for (k = from; k < to; k++) {
+		TDB_DATA data = tdb_fetch(tdb, key);
+
+		if (data.dsize != sizeof(k) ||
+		    memcmp(data.dptr, &k, sizeof(k)) != 0) {
+			free(data.dptr);
+			return false;
+		}
+		free(data.dptr);
+	}
+	return true;
+}
+
+static int child_store(struct tdb_context *tdb, int go)
+{
+	unsigned int k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	char c;
+
+	if (tdb_reopen(tdb) != 0) {
+		return 1;
+	}
+	if (read(go, &c, 1) != 1) {
+		return 2;
+	}
+	for (k = NUM_RECORDS; k < NUM_RECORDS + NUM_CHILD_RECORDS; k++) {
+		if (tdb_store(tdb, key, key, TDB_INSERT) != 0) {
+			return 3;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	struct seen seen;
+	unsigned int k, f, n;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	TDB_DATA cur, next;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP, TDB_CONVERT,
+			TDB_MUTEX_LOCKING };
+	int status, go[2];
+	uint32_t b;
+	pid_t pid;
+
+	plan_tests(ARRAY_SIZE(flags) * 22);
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		if ((flags[f] & TDB_MUTEX_LOCKING) &&
+		    !tdb_runtime_check_for_robust_mutexes()) {
+			skip(22, "No robust mutex support");
+			continue;
+		}
+
+		tdb = tdb_open_ex("run-hash-split.tdb", 7,
+				  TDB_CLEAR_IF_FIRST|TDB_NOSYNC|
+				  TDB_HASH_SPLIT|flags[f],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb->feature_flags & TDB_FEATURE_FLAG_HASH_SPLIT);
+		ok1(buckets(tdb) == 7);
+
+		for (k = 0; k < NUM_RECORDS; k++) {
+			tdb_store(tdb, key, key, TDB_INSERT);
+		}
+		b = buckets(tdb);
+		diag("%u records in %u buckets", NUM_RECORDS, b);
+		ok1(b >= NUM_RECORDS / 4 && b <= NUM_RECORDS);
+		ok1(all_there(tdb, 0, NUM_RECORDS));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+		/* Traversals see every record once */
+		memset(&seen, 0, sizeof(seen));
+		ok1(tdb_traverse(tdb, mark_seen, &seen) == NUM_RECORDS);
+		ok1(seen_once(&seen));
+		memset(&seen, 0, sizeof(seen));
+		n = 0;
+		for (cur = tdb_firstkey(tdb); cur.dptr; cur = next) {
+			mark_seen(tdb, cur, tdb_null, &seen);
+			next = tdb_nextkey(tdb, cur);
+			free(cur.dptr);
+			n++;
+		}
+		ok1(n == NUM_RECORDS && seen_once(&seen));
+
+		/* ... also while another process splits the buckets */
+		ok1(pipe(go) == 0);
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			close(go[1]);
+			exit(child_store(tdb, go[0]));
+		}
+		close(go[0]);
+		memset(&seen, 0, sizeof(seen));
+		seen.slow = true;
+		ok1(write(go[1], "", 1) == 1);
+		ok1(tdb_traverse_read(tdb, mark_seen, &seen) >= NUM_RECORDS);
+		ok1(seen_once(&seen));
+		ok1(waitpid(pid, &status, 0) == pid &&
+		    WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		close(go[1]);
+		diag("%u more records seen during the traverse, now %u "
+		     "buckets", seen.others, buckets(tdb));
+		ok1(buckets(tdb) >= (NUM_RECORDS + NUM_CHILD_RECORDS) / 4);
+		ok1(all_there(tdb, 0, NUM_RECORDS + NUM_CHILD_RECORDS) &&
+		    tdb_check(tdb, NULL, NULL) == 0);
+
+		/* Transactions see the split buckets too */
+		ok1(tdb_transaction_start(tdb) == 0);
+		k = NUM_RECORDS + NUM_CHILD_RECORDS;
+		tdb_store(tdb, key, key, TDB_INSERT);
+		ok1(tdb_traverse(tdb, NULL, NULL)
+		    == NUM_RECORDS + NUM_CHILD_RECORDS + 1);
+		ok1(tdb_transaction_commit(tdb) == 0);
+
+		/* Still there when opened without the flag */
+		if (!(flags[f] & TDB_MUTEX_LOCKING)) {
+			tdb_close(tdb);
+			tdb = tdb_open_ex("run-hash-split.tdb", 0,
+					  TDB_NOSYNC|flags[f], O_RDWR, 0600,
+					  &taplogctx, NULL);
+		}
+		ok1(tdb && all_there(tdb, 0, NUM_RECORDS + NUM_CHILD_RECORDS
+				     + 1));
+
+		/* Wiping starts over with hash_size buckets */
+		ok1(tdb_wipe_all(tdb) == 0 && buckets(tdb) == 7);
+		ok1(tdb_traverse(tdb, NULL, NULL) == 0 &&
+		    tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
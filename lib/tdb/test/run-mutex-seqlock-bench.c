@@ -0,0 +1,175 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_READERS 4
+#define NUM_KEYS 32
+#define NUM_READS 200000
+
+static double timeval_elapsed2(const struct timeval *tv1, const struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) +
+	       (tv2->tv_usec - tv1->tv_usec)*1.0e-6;
+}
+
+static double timeval_elapsed(const struct timeval *tv)
+{
+	struct timeval tv2;
+	gettimeofday(&tv2, NULL);
+	return timeval_elapsed2(tv, &tv2);
+}
+
+static int parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	return data.dsize == 100 ? 0 : -1;
+}
+
+static int reader(struct tdb_context *tdb, int go)
+{
+	unsigned int i, k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	char c;
+
+	if (tdb_reopen(tdb) != 0) {
+		return 1;
+	}
+	if (read(go, &c, 1) != 1) {
+		return 2;
+	}
+
+	for (i = 0; i < NUM_READS; i++) {
+		k = i % NUM_KEYS;
+		if (tdb_parse_record(tdb, key, parse_fn, NULL) != 0) {
+			return 3;
+		}
+	}
+	return 0;
+}
+
+/*
+ * A few processes hammer tdb_parse_record() on a handful of keys that
+ * share a small number of hash chains, like smbd processes do on the
+ * hot records of e.g. smbXsrv_tcon_global.tdb. Compare the chain
+ * mutexes with the lockless seqlock reads, with and without a process
+ * updating the same keys.
+ */
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		int tdb_flags;
+		bool writer;
+	} modes[] = {
+		{ "mutex", 0, false },
+		{ "seqlock", TDB_SEQLOCK_READS, false },
+		{ "mutex+writer", 0, true },
+		{ "seqlock+writer", TDB_SEQLOCK_READS, true },
+	};
+	unsigned char buf[100];
+	unsigned int m, i, k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	TDB_DATA data = { .dptr = buf, .dsize = sizeof(buf) };
+
+	if (!tdb_runtime_check_for_robust_mutexes()) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	plan_tests(3 * ARRAY_SIZE(modes));
+
+	memset(buf, 'x', sizeof(buf));
+
+	for (m = 0; m < ARRAY_SIZE(modes); m++) {
+		struct tdb_context *tdb;
+		pid_t readers[NUM_READERS];
+		pid_t writer = -1;
+		struct timeval start;
+		double elapsed;
+		int go[2];
+		bool readers_ok = true;
+
+		tdb = tdb_open_ex("mutex-seqlock-bench.tdb", 3,
+				  TDB_INCOMPATIBLE_HASH|TDB_MUTEX_LOCKING|
+				  TDB_CLEAR_IF_FIRST|TDB_NOSYNC|
+				  modes[m].tdb_flags,
+				  O_RDWR|O_CREAT, 0755,
+				  &taplogctx, NULL);
+		ok(tdb != NULL, "open %s", modes[m].name);
+
+		for (k = 0; k < NUM_KEYS; k++) {
+			tdb_store(tdb, key, data, TDB_INSERT);
+		}
+
+		ok1(pipe(go) == 0);
+		fflush(stdout);
+
+		for (i = 0; i < NUM_READERS; i++) {
+			readers[i] = fork();
+			if (readers[i] == 0) {
+				close(go[1]);
+				exit(reader(tdb, go[0]));
+			}
+		}
+		if (modes[m].writer) {
+			writer = fork();
+			if (writer == 0) {
+				close(go[1]);
+				if (tdb_reopen(tdb) != 0) {
+					exit(1);
+				}
+				/* Runs until killed */
+				for (i = 0; ; i++) {
+					k = i % NUM_KEYS;
+					tdb_store(tdb, key, data, TDB_REPLACE);
+					usleep(10);
+				}
+			}
+		}
+		close(go[0]);
+
+		gettimeofday(&start, NULL);
+		for (i = 0; i < NUM_READERS; i++) {
+			write(go[1], "", 1);
+		}
+		for (i = 0; i < NUM_READERS; i++) {
+			int status;
+
+			if (waitpid(readers[i], &status, 0) != readers[i] ||
+			    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				readers_ok = false;
+			}
+		}
+		elapsed = timeval_elapsed(&start);
+		close(go[1]);
+
+		if (writer != -1) {
+			kill(writer, SIGKILL);
+			waitpid(writer, NULL, 0);
+		}
+
+		ok(readers_ok, "readers %s", modes[m].name);
+
+		diag("%-15s %d readers: %.0f reads/s per process",
+		     modes[m].name, NUM_READERS, NUM_READS / elapsed);
+
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,217 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_KEYS 16
+#define NUM_WRITES 20000
+
+static struct tdb_context *tdb;
+static int tdb_flags = TDB_INCOMPATIBLE_HASH|TDB_MUTEX_LOCKING|
+	TDB_CLEAR_IF_FIRST|TDB_SEQLOCK_READS;
+
+/* Records are "len" bytes of "len", so torn reads are easy to spot */
+static TDB_DATA make_data(unsigned char *buf, unsigned int len)
+{
+	TDB_DATA data = { .dptr = buf, .dsize = len };
+
+	memset(buf, len, len);
+	return data;
+}
+
+static int check_data(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	bool *locked = (bool *)private_data;
+	size_t i;
+
+	if (locked != NULL) {
+		*locked = tdb_have_extra_locks(tdb);
+	}
+	for (i = 0; i < data.dsize; i++) {
+		if (data.dptr[i] != data.dsize) {
+			return -2;
+		}
+	}
+	return 0;
+}
+
+static int writer(int id)
+{
+	unsigned char buf[256];
+	unsigned int i, k;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+
+	if (tdb_reopen(tdb) != 0) {
+		return 1;
+	}
+
+	srandom(id);
+
+	for (i = 0; i < NUM_WRITES; i++) {
+		int ret;
+
+		k = random() % NUM_KEYS;
+
+		if (id == 0 && i % 1000 == 0) {
+			/* Writes under the allrecord lock */
+			ret = tdb_transaction_start(tdb);
+			if (ret == 0) {
+				for (k = 0; k < NUM_KEYS; k++) {
+					tdb_store(tdb, key,
+						  make_data(buf, 1 + i % 200),
+						  TDB_REPLACE);
+				}
+				ret = tdb_transaction_commit(tdb);
+			}
+		} else if (random() % 4 == 0) {
+			ret = tdb_delete(tdb, key);
+			if (ret == -1 && tdb_error(tdb) == TDB_ERR_NOEXIST) {
+				ret = 0;
+			}
+		} else {
+			ret = tdb_store(tdb, key,
+					make_data(buf, 1 + random() % 255),
+					TDB_REPLACE);
+		}
+		if (ret != 0) {
+			return 2;
+		}
+	}
+
+	tdb_close(tdb);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char buf[256];
+	unsigned int i, k, running, torn, found, missing;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	TDB_DATA data;
+	uint32_t list, seq[2], seq2[2];
+	bool locked;
+	pid_t pid[2];
+	int status[2];
+
+	if (!tdb_runtime_check_for_robust_mutexes()) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	plan_tests(24);
+
+	suppress_logging = true;
+	tdb = tdb_open_ex("mutex-seqlock.tdb", 0,
+			  TDB_CLEAR_IF_FIRST|TDB_SEQLOCK_READS,
+			  O_RDWR|O_CREAT, 0755, &taplogctx, NULL);
+	suppress_logging = false;
+	ok(tdb == NULL, "TDB_SEQLOCK_READS needs TDB_MUTEX_LOCKING");
+
+	tdb = tdb_open_ex("mutex-seqlock.tdb", 7, tdb_flags,
+			  O_RDWR|O_CREAT, 0755, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK);
+	ok1(tdb_have_seqlocks(tdb));
+
+	/* Stores move the chain's counter on, leaving it even */
+	k = 0;
+	list = BUCKET(tdb->hash_fn(&key));
+	ok1(tdb_mutex_seqlock_read_begin(tdb, list, seq));
+	ok1(tdb_store(tdb, key, make_data(buf, 10), TDB_INSERT) == 0);
+	ok1(tdb_mutex_seqlock_read_begin(tdb, list, seq2));
+	ok1(seq2[0] == seq[0] && seq2[1] == seq[1] + 2);
+	ok1(!tdb_mutex_seqlock_read_valid(tdb, list, seq));
+
+	/* Readers don't lock */
+	locked = true;
+	ok1(tdb_parse_record(tdb, key, check_data, &locked) == 0);
+	ok1(!locked);
+	data = tdb_fetch(tdb, key);
+	ok1(data.dsize == 10 && check_data(key, data, NULL) == 0);
+	free(data.dptr);
+	ok1(tdb_exists(tdb, key));
+	k = 1;
+	ok1(tdb_parse_record(tdb, key, check_data, NULL) == -1 &&
+	    tdb_error(tdb) == TDB_ERR_NOEXIST);
+	ok1(!tdb_exists(tdb, key));
+
+	/* Under our own lock it is the usual nested lock */
+	k = 0;
+	ok1(tdb_chainlock(tdb, key) == 0);
+	ok1(!tdb_mutex_seqlock_read_begin(tdb, list, seq));
+	ok1(tdb_parse_record(tdb, key, check_data, &locked) == 0);
+	ok1(locked);
+	ok1(tdb_chainunlock(tdb, key) == 0);
+
+	/* Concurrent writers must never show us torn records */
+	fflush(stdout);
+	for (i = 0; i < ARRAY_SIZE(pid); i++) {
+		pid[i] = fork();
+		if (pid[i] == 0) {
+			exit(writer(i));
+		}
+	}
+
+	running = ARRAY_SIZE(pid);
+	torn = found = missing = 0;
+	for (i = 0; running > 0; i++) {
+		int ret;
+
+		if (i % 1000 == 0) {
+			for (k = 0; k < ARRAY_SIZE(pid); k++) {
+				if (pid[k] != 0 &&
+				    waitpid(pid[k], &status[k], WNOHANG) != 0) {
+					pid[k] = 0;
+					running -= 1;
+				}
+			}
+		}
+
+		k = i % NUM_KEYS;
+		if (i % 2 == 0) {
+			ret = tdb_parse_record(tdb, key, check_data, NULL);
+		} else {
+			data = tdb_fetch(tdb, key);
+			ret = -1;
+			if (data.dptr != NULL) {
+				ret = check_data(key, data, NULL);
+				free(data.dptr);
+			}
+		}
+		if (ret == -2) {
+			torn += 1;
+		} else if (ret == 0) {
+			found += 1;
+		} else {
+			missing += 1;
+		}
+	}
+	diag("%u reads: %u found, %u missing, %u torn",
+	     i, found, missing, torn);
+	ok1(torn == 0);
+
+	for (i = 0; i < ARRAY_SIZE(pid); i++) {
+		ok(WIFEXITED(status[i]) && WEXITSTATUS(status[i]) == 0,
+		   "writer %u failed", i);
+	}
+
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+	tdb_close(tdb);
+
+	return exit_status();
+}
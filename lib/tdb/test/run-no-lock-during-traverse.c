@@ -14,6 +14,8 @@
 #include "../common/check.c"
 #include "../common/hash.c"
 #include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
 #include "tap-interface.h"
 #include <stdlib.h>
 #include "logging.h"
@@ -21,6 +21,8 @@ static int ftruncate_check(int fd, off_t length);
 #include "../common/check.c"
 #include "../common/hash.c"
 #include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
 #include "tap-interface.h"
 #include <stdlib.h>
 #include <stdbool.h>
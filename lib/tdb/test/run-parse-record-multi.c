@@ -0,0 +1,169 @@
+#include "../common/tdb_private.h"
+#include <stdarg.h>
+static int fcntl_counting(int fd, int cmd, ...);
+#define fcntl fcntl_counting
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#undef fcntl
+#include <stdlib.h>
+#include "logging.h"
+
+#define HASH_SIZE 7
+#define NUM_RECORDS 100
+#define NUM_MISSING 10
+
+static unsigned int lock_calls;
+
+static int fcntl_counting(int fd, int cmd, ...)
+{
+	va_list ap;
+	struct flock *fl;
+
+	if (cmd != F_SETLK && cmd != F_SETLKW) {
+		int arg3;
+
+		va_start(ap, cmd);
+		arg3 = va_arg(ap, int);
+		va_end(ap);
+		return fcntl(fd, cmd, arg3);
+	}
+
+	va_start(ap, cmd);
+	fl = va_arg(ap, struct flock *);
+	va_end(ap);
+
+	if (fl->l_type != F_UNLCK) {
+		lock_calls += 1;
+	}
+	return fcntl(fd, cmd, fl);
+}
+
+struct parsed {
+	unsigned int count[NUM_RECORDS + NUM_MISSING];
+	unsigned int bad;
+	size_t stop_at;
+};
+
+static int parse_multi(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data)
+{
+	struct parsed *parsed = (struct parsed *)private_data;
+	unsigned int k;
+
+	memcpy(&k, key.dptr, sizeof(k));
+	if (k != idx || data.dsize != sizeof(k) ||
+	    memcmp(data.dptr, &k, sizeof(k)) != 0) {
+		parsed->bad += 1;
+	}
+	parsed->count[idx] += 1;
+	return (idx == parsed->stop_at) ? 42 : 0;
+}
+
+static int parse_one(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	struct parsed parsed;
+	unsigned int keys[NUM_RECORDS + NUM_MISSING];
+	TDB_DATA tkeys[NUM_RECORDS + NUM_MISSING];
+	unsigned int i, f, calls, lockrecs;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP, TDB_CONVERT,
+			TDB_MUTEX_LOCKING|TDB_SEQLOCK_READS };
+	bool ok;
+
+	plan_tests(ARRAY_SIZE(flags) * 11);
+
+	for (i = 0; i < ARRAY_SIZE(keys); i++) {
+		keys[i] = i;
+		tkeys[i].dptr = (unsigned char *)&keys[i];
+		tkeys[i].dsize = sizeof(keys[i]);
+	}
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		bool fcntl_locks = !(flags[f] & TDB_MUTEX_LOCKING);
+
+		if (!fcntl_locks && !tdb_runtime_check_for_robust_mutexes()) {
+			skip(11, "No robust mutex support");
+			continue;
+		}
+
+		tdb = tdb_open_ex("run-parse-record-multi.tdb", HASH_SIZE,
+				  TDB_CLEAR_IF_FIRST|TDB_NOSYNC|flags[f],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		/* the TDB_CLEAR_IF_FIRST active lock */
+		lockrecs = tdb->num_lockrecs;
+
+		for (i = 0; i < NUM_RECORDS; i++) {
+			tdb_store(tdb, tkeys[i], tkeys[i], TDB_INSERT);
+		}
+
+		/* One lock per chain instead of one per key */
+		lock_calls = 0;
+		for (i = 0; i < NUM_RECORDS; i++) {
+			tdb_parse_record(tdb, tkeys[i], parse_one, NULL);
+		}
+		calls = lock_calls;
+
+		memset(&parsed, 0, sizeof(parsed));
+		parsed.stop_at = (size_t)-1;
+		lock_calls = 0;
+		ok1(tdb_parse_record_multi(tdb, tkeys, ARRAY_SIZE(tkeys),
+					   parse_multi, &parsed) == 0);
+		diag("%u lock calls for single lookups, %u for a batch",
+		     calls, lock_calls);
+		ok1(!fcntl_locks ||
+		    (calls == NUM_RECORDS && lock_calls <= HASH_SIZE));
+		ok = (parsed.bad == 0);
+		for (i = 0; i < ARRAY_SIZE(keys); i++) {
+			if (parsed.count[i] != (i < NUM_RECORDS ? 1 : 0)) {
+				ok = false;
+			}
+		}
+		ok1(ok);
+
+		/* A parser's return value stops the lookups */
+		memset(&parsed, 0, sizeof(parsed));
+		parsed.stop_at = NUM_RECORDS / 2;
+		ok1(tdb_parse_record_multi(tdb, tkeys, NUM_RECORDS,
+					   parse_multi, &parsed) == 42);
+		ok1(parsed.count[NUM_RECORDS / 2] == 1);
+		ok1(tdb->num_lockrecs == lockrecs);
+
+		/* Write locks, one per chain, usable for stores */
+		lock_calls = 0;
+		ok1(tdb_chainlock_multi(tdb, tkeys, ARRAY_SIZE(tkeys)) == 0);
+		ok1(!fcntl_locks || lock_calls <= HASH_SIZE);
+		ok = true;
+		for (i = 0; i < ARRAY_SIZE(keys); i++) {
+			if (tdb_store(tdb, tkeys[i], tkeys[i],
+				      TDB_REPLACE) != 0) {
+				ok = false;
+			}
+		}
+		ok1(ok);
+		ok1(tdb_chainunlock_multi(tdb, tkeys, ARRAY_SIZE(tkeys)) == 0
+		    && tdb->num_lockrecs == lockrecs);
+
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,217 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 2000
+
+static TDB_DATA make_data(unsigned int i, unsigned char *buf)
+{
+	TDB_DATA data;
+
+	data.dptr = buf;
+	data.dsize = 10 + (i * 7) % 300;
+	memset(buf, i, data.dsize);
+	return data;
+}
+
+static bool records_ok(struct tdb_context *tdb)
+{
+	unsigned char buf[400];
+	unsigned int i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key, data, expected;
+
+		key.dptr = (unsigned char *)&i;
+		key.dsize = sizeof(i);
+
+		data = tdb_fetch(tdb, key);
+
+		if (i % 4 != 0) {
+			/* deleted */
+			if (data.dptr != NULL) {
+				free(data.dptr);
+				return false;
+			}
+			continue;
+		}
+
+		expected = make_data(i, buf);
+		if (data.dsize != expected.dsize ||
+		    memcmp(data.dptr, expected.dptr, data.dsize) != 0) {
+			free(data.dptr);
+			return false;
+		}
+		free(data.dptr);
+	}
+	return true;
+}
+
+/* Traverse callback holding a record lock while repacking. */
+static int repack_in_traverse(struct tdb_context *tdb, TDB_DATA key,
+			      TDB_DATA data, void *private_data)
+{
+	int *ret = (int *)private_data;
+
+	*ret = tdb_repack_online(tdb, NULL);
+	return 1;
+}
+
+/*
+ * Runs in a child that has the database mapped with its old size
+ * while the parent repacks it.
+ */
+static int child(int flags, int from_parent, int to_parent)
+{
+	struct tdb_context *tdb;
+	unsigned char buf[400];
+	unsigned int i;
+	char c = 0;
+
+	if (read(from_parent, &c, 1) != 1) {
+		return 1;
+	}
+
+	tdb = tdb_open_ex("run-repack-online.tdb", 0, flags,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	if (tdb == NULL) {
+		return 2;
+	}
+
+	if (write(to_parent, &c, 1) != 1 || read(from_parent, &c, 1) != 1) {
+		return 3;
+	}
+
+	if (!records_ok(tdb)) {
+		return 4;
+	}
+
+	/* Grow the file again, starting from the stale size */
+	for (i = NUM_RECORDS; i < NUM_RECORDS * 2; i++) {
+		TDB_DATA key, data;
+
+		key.dptr = (unsigned char *)&i;
+		key.dsize = sizeof(i);
+		data = make_data(i, buf);
+		if (tdb_store(tdb, key, data, TDB_INSERT) != 0) {
+			return 5;
+		}
+	}
+
+	if (tdb_check(tdb, NULL, NULL) != 0) {
+		return 6;
+	}
+
+	tdb_close(tdb);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i, f;
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP,
+			TDB_FREELIST_CLASSES,
+			TDB_CONVERT|TDB_FREELIST_CLASSES };
+	unsigned char buf[400];
+	TDB_DATA key, data;
+
+	plan_tests(ARRAY_SIZE(flags) * 15);
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		struct tdb_repack_stats stats;
+		tdb_off_t old_size;
+		int to_child[2], from_child[2];
+		int ret, status;
+		pid_t pid;
+		char c = 0;
+
+		ok1(pipe(to_child) == 0 && pipe(from_child) == 0);
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			close(to_child[1]);
+			close(from_child[0]);
+			exit(child(flags[f], to_child[0], from_child[1]));
+		}
+		close(to_child[0]);
+		close(from_child[1]);
+
+		tdb = tdb_open_ex("run-repack-online.tdb", 131,
+				  TDB_CLEAR_IF_FIRST|flags[f],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+
+		key.dptr = (unsigned char *)&i;
+		key.dsize = sizeof(i);
+
+		for (i = 0; i < NUM_RECORDS; i++) {
+			data = make_data(i, buf);
+			if (tdb_store(tdb, key, data, TDB_INSERT) != 0) {
+				break;
+			}
+		}
+		ok1(i == NUM_RECORDS);
+
+		/* Leave holes all over the file */
+		for (i = 0; i < NUM_RECORDS; i++) {
+			if (i % 4 != 0 && tdb_delete(tdb, key) != 0) {
+				break;
+			}
+		}
+		ok1(i == NUM_RECORDS);
+
+		/* Let the child map the file before we repack */
+		ok1(write(to_child[1], &c, 1) == 1);
+		ok1(read(from_child[0], &c, 1) == 1);
+
+		old_size = tdb->map_size;
+
+		ok1(tdb_repack_online(tdb, &stats) == 0);
+		diag("moved %zu records (%zu bytes), skipped %zu, "
+		     "reclaimed %zu of %u bytes, locks %llu us (max %llu us)",
+		     stats.records_moved, stats.bytes_moved,
+		     stats.records_skipped, stats.bytes_reclaimed,
+		     (unsigned)old_size, stats.lock_usecs,
+		     stats.lock_usecs_max);
+		ok1(stats.records_moved > 0);
+		ok1(stats.bytes_reclaimed > old_size / 2);
+		ok1(tdb->map_size == old_size - stats.bytes_reclaimed);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		ok1(records_ok(tdb));
+
+		/* Not from inside a traverse */
+		ret = 0;
+		suppress_logging = true;
+		tdb_traverse(tdb, repack_in_traverse, &ret);
+		suppress_logging = false;
+		ok1(ret == -1);
+
+		/* The child still works with the shrunk file */
+		ok1(write(to_child[1], &c, 1) == 1);
+		ok1(waitpid(pid, &status, 0) == pid &&
+		    WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+		tdb_close(tdb);
+		close(to_child[1]);
+		close(from_child[0]);
+	}
+
+	return exit_status();
+}
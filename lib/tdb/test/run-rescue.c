@@ -11,6 +11,8 @@
 #include "../common/hash.c"
 #include "../common/rescue.c"
 #include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
 #include "tap-interface.h"
 #include <stdlib.h>
 #include "logging.h"
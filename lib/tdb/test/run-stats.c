@@ -0,0 +1,212 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_KEYS 100
+#define NUM_HOT_FETCHES 2000
+
+static int parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	return 0;
+}
+
+static bool chain_totals(struct tdb_context *tdb,
+			 struct tdb_chain_stats *total)
+{
+	struct tdb_chain_stats c;
+	int list;
+
+	memset(total, 0, sizeof(*total));
+	for (list = -1; list < (int)tdb->hash_size; list++) {
+		if (tdb_stats_chain(tdb, list, &c) != 0) {
+			return false;
+		}
+		total->lock_waits += c.lock_waits;
+		total->lock_wait_usecs += c.lock_wait_usecs;
+		total->fetches += c.fetches;
+		total->stores += c.stores;
+		total->deletes += c.deletes;
+	}
+	return true;
+}
+
+/* Hold the chain lock of "key" for a while */
+static int locker(struct tdb_context *tdb, TDB_DATA key, int to_parent)
+{
+	if (tdb_reopen(tdb) != 0) {
+		return 1;
+	}
+	if (tdb_chainlock(tdb, key) != 0) {
+		return 2;
+	}
+	if (write(to_parent, "", 1) != 1) {
+		return 3;
+	}
+	usleep(200000);
+	tdb_chainunlock(tdb, key);
+	return 0;
+}
+
+/* Another process, not using TDB_STATISTICS, sees the same numbers */
+static int reader(struct tdb_context *tdb, unsigned int hot)
+{
+	struct tdb_hot_key keys[4];
+	struct tdb_chain_stats total;
+
+	tdb_close(tdb);
+	tdb = tdb_open_ex("run-stats.tdb", 0, 0, O_RDONLY, 0,
+			  &taplogctx, NULL);
+	if (tdb == NULL) {
+		return 1;
+	}
+	if (tdb_stats_hot_keys(tdb, keys, 4) < 1) {
+		return 2;
+	}
+	if (keys[0].key_len != sizeof(hot) ||
+	    memcmp(keys[0].key, &hot, sizeof(hot)) != 0) {
+		return 3;
+	}
+	if (!chain_totals(tdb, &total) || total.stores != NUM_KEYS) {
+		return 4;
+	}
+	if (tdb_stats_reset(tdb) != -1) {
+		return 5;
+	}
+	tdb_close(tdb);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	struct tdb_chain_stats total, c;
+	struct tdb_hot_key keys[TDB_STATS_NUM_HOT];
+	unsigned int i, k, f;
+	TDB_DATA key = { .dptr = (unsigned char *)&k, .dsize = sizeof(k) };
+	TDB_DATA data;
+	int flags[] = { TDB_DEFAULT, TDB_MUTEX_LOCKING };
+	int num, status, fds[2];
+	pid_t pid;
+	char ch;
+
+	plan_tests(ARRAY_SIZE(flags) * 23 + 3);
+
+	/* Without the flag there is nothing to read */
+	unlink("run-stats.tdb.stats");
+	tdb = tdb_open_ex("run-stats.tdb", 7, TDB_CLEAR_IF_FIRST,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb_stats_chain(tdb, 0, &c) == -1 &&
+	    tdb_error(tdb) == TDB_ERR_NOEXIST);
+	ok1(tdb_stats_hot_keys(tdb, keys, 1) == -1);
+	tdb_close(tdb);
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		if ((flags[f] & TDB_MUTEX_LOCKING) &&
+		    !tdb_runtime_check_for_robust_mutexes()) {
+			skip(23, "No robust mutex support");
+			continue;
+		}
+
+		tdb = tdb_open_ex("run-stats.tdb", 7,
+				  TDB_CLEAR_IF_FIRST|TDB_STATISTICS|flags[f],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb->stats_rw);
+
+		/* CLEAR_IF_FIRST started from scratch */
+		ok1(chain_totals(tdb, &total));
+		ok1(total.stores == 0 && total.fetches == 0);
+		ok1(tdb_stats_hot_keys(tdb, keys, ARRAY_SIZE(keys)) == 0);
+
+		for (k = 0; k < NUM_KEYS; k++) {
+			tdb_store(tdb, key, key, TDB_INSERT);
+		}
+		for (i = 0; i < NUM_HOT_FETCHES; i++) {
+			k = (i % 3 != 0) ? 42 : i % NUM_KEYS;
+			if (i % 2 == 0) {
+				data = tdb_fetch(tdb, key);
+				free(data.dptr);
+			} else {
+				tdb_parse_record(tdb, key, parse_fn, NULL);
+			}
+		}
+		for (k = 0; k < NUM_KEYS; k += 10) {
+			tdb_delete(tdb, key);
+		}
+
+		ok1(chain_totals(tdb, &total));
+		ok1(total.stores == NUM_KEYS);
+		ok1(total.fetches == NUM_HOT_FETCHES);
+		ok1(total.deletes == NUM_KEYS / 10);
+		ok1(total.lock_waits == 0);
+
+		/* Two thirds of the fetches were on key 42 */
+		num = tdb_stats_hot_keys(tdb, keys, ARRAY_SIZE(keys));
+		ok1(num > 0 && num <= TDB_STATS_NUM_HOT);
+		k = 42;
+		ok1(keys[0].key_len == sizeof(k) &&
+		    memcmp(keys[0].key, &k, sizeof(k)) == 0 &&
+		    keys[0].hash == tdb->hash_fn(&key));
+		ok1(keys[0].count >= NUM_HOT_FETCHES / 2);
+		for (i = 1; i < num; i++) {
+			if (keys[i].count > keys[i-1].count) {
+				break;
+			}
+		}
+		ok1(i == num);
+
+		/* Someone else sits on key 42's chain */
+		ok1(pipe(fds) == 0);
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			exit(locker(tdb, key, fds[1]));
+		}
+		close(fds[1]);
+		ok1(read(fds[0], &ch, 1) == 1);
+		ok1(tdb_chainlock(tdb, key) == 0);
+		tdb_chainunlock(tdb, key);
+		ok1(waitpid(pid, &status, 0) == pid &&
+		    WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		close(fds[0]);
+
+		ok1(tdb_stats_chain(tdb, BUCKET(tdb->hash_fn(&key)), &c) == 0);
+		diag("%llu lock waits, %llu us", c.lock_waits,
+		     c.lock_wait_usecs);
+		ok1(c.lock_waits == 1 && c.lock_wait_usecs > 50000);
+
+		fflush(stdout);
+		pid = fork();
+		if (pid == 0) {
+			exit(reader(tdb, 42));
+		}
+		ok1(waitpid(pid, &status, 0) == pid &&
+		    WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+		ok1(tdb_stats_reset(tdb) == 0);
+		ok1(chain_totals(tdb, &total) && total.stores == 0 &&
+		    total.lock_waits == 0);
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,120 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 2000
+#define NUM_UPDATES 50
+#define DATA_LEN 100
+
+static TDB_DATA make_data(unsigned int i, unsigned char *buf, unsigned char c)
+{
+	TDB_DATA data = { .dptr = buf, .dsize = DATA_LEN };
+
+	memset(buf, c, DATA_LEN);
+	memcpy(buf, &i, sizeof(i));
+	return data;
+}
+
+static bool records_ok(struct tdb_context *tdb)
+{
+	unsigned char buf[DATA_LEN];
+	unsigned int i;
+	TDB_DATA key = { .dptr = (unsigned char *)&i, .dsize = sizeof(i) };
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA data, expected;
+
+		expected = make_data(i, buf, (i % 40 == 0) ? 'y' : 'x');
+		data = tdb_fetch(tdb, key);
+		if (data.dsize != expected.dsize ||
+		    memcmp(data.dptr, expected.dptr, data.dsize) != 0) {
+			free(data.dptr);
+			return false;
+		}
+		free(data.dptr);
+	}
+	return true;
+}
+
+static tdb_len_t recovery_len(struct tdb_context *tdb)
+{
+	struct tdb_record rec;
+	tdb_off_t off;
+
+	if (tdb_recovery_area(tdb, tdb->methods, &off, &rec) != 0) {
+		return (tdb_len_t)-1;
+	}
+	return rec.data_len;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned char buf[DATA_LEN];
+	unsigned int i, f;
+	TDB_DATA key = { .dptr = (unsigned char *)&i, .dsize = sizeof(i) };
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP, TDB_CONVERT };
+	tdb_len_t len;
+	tdb_off_t hash_top;
+
+	plan_tests(ARRAY_SIZE(flags) * 10);
+
+	for (f = 0; f < ARRAY_SIZE(flags); f++) {
+		tdb = tdb_open_ex("run-transaction-dirty.tdb", 1024,
+				  TDB_CLEAR_IF_FIRST|TDB_NOSYNC|flags[f],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+
+		ok1(tdb_transaction_start(tdb) == 0);
+		for (i = 0; i < NUM_RECORDS; i++) {
+			tdb_store(tdb, key, make_data(i, buf, 'x'),
+				  TDB_INSERT);
+		}
+		ok1(tdb_transaction_commit(tdb) == 0);
+
+		/*
+		 * Rewrite records spread all over the file in place: only
+		 * their data has to go to the recovery area, not the
+		 * whole blocks they are in.
+		 */
+		ok1(tdb_transaction_start(tdb) == 0);
+		for (i = 0; i < NUM_RECORDS; i += NUM_RECORDS / NUM_UPDATES) {
+			tdb_store(tdb, key, make_data(i, buf, 'y'),
+				  TDB_REPLACE);
+		}
+		ok1(tdb_transaction_commit(tdb) == 0);
+		len = recovery_len(tdb);
+		diag("recovery data for %u updates: %u bytes, "
+		     "%u bytes with whole blocks", NUM_UPDATES, len,
+		     NUM_UPDATES * (tdb->page_size + 8));
+		ok1(len < NUM_UPDATES * (DATA_LEN + 8 + 64));
+		ok1(records_ok(tdb));
+
+		/* Writing what is there already is no change at all */
+		ok1(tdb_transaction_start(tdb) == 0);
+		tdb_ofs_read(tdb, TDB_HASH_TOP(0), &hash_top);
+		tdb_ofs_write(tdb, TDB_HASH_TOP(0), &hash_top);
+		ok1(!transaction_changed(tdb));
+		ok1(tdb_transaction_commit(tdb) == 0 &&
+		    tdb_check(tdb, NULL, NULL) == 0);
+
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,134 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "../common/stats.c"
+#include "../common/split.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level, const char *fmt, ...)
+{
+	unsigned int *count = tdb_get_logging_private(tdb);
+	if (strstr(fmt, "hash"))
+		(*count)++;
+}
+
+static unsigned int hdr_rwlocks(const char *fname)
+{
+	struct tdb_header hdr;
+	ssize_t nread;
+
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	nread = read(fd, &hdr, sizeof(hdr));
+	close(fd);
+	if (nread != sizeof(hdr)) {
+		return -1;
+	}
+	return hdr.rwlocks;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count, flags;
+	TDB_DATA d, r;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+
+	plan_tests(6 + 22 * 2);
+
+	/* Reference values of xxHash64, these must not depend on the cpu. */
+	ok1(xxh64((const uint8_t *)"", 0, 0) == 0xEF46DB3751D8E999ULL);
+	ok1(xxh64((const uint8_t *)"a", 1, 0) == 0xD24EC4F1A98C6E5BULL);
+	ok1(xxh64((const uint8_t *)"abc", 3, 0) == 0x44BC2CF5AD770999ULL);
+	ok1(xxh64((const uint8_t *)"Nobody inspects the spammish repetition",
+		  39, 0) == 0xFBCEA83C8A378BF1ULL);
+
+	d.dptr = discard_const_p(uint8_t, "abc");
+	d.dsize = 3;
+	ok1(tdb_xxhash(&d) == (0x44BC2CF5U ^ 0xAD770999U));
+	ok1(tdb_xxhash(&d) != tdb_jenkins_hash(&d));
+
+	for (flags = 0; flags <= TDB_CONVERT; flags += TDB_CONVERT) {
+		unsigned int rwmagic = TDB_HASH_RWLOCK_MAGIC;
+
+		if (flags & TDB_CONVERT)
+			tdb_convert(&rwmagic, sizeof(rwmagic));
+
+		/* Create with the xxhash flag, default hash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-xxhash.tdb", 0,
+				  flags|TDB_XXHASH,
+				  O_CREAT|O_RDWR|O_TRUNC, 0600, &log_ctx,
+				  NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_xxhash);
+		d.dptr = discard_const_p(uint8_t, "Hello");
+		d.dsize = 5;
+		ok1(tdb_store(tdb, d, d, TDB_INSERT) == 0);
+		tdb_close(tdb);
+
+		/* Should have marked rwlocks field. */
+		ok1(hdr_rwlocks("run-xxhash.tdb") == rwmagic);
+
+		/* The xxhash flag wins over the incompatible flag. */
+		tdb = tdb_open_ex("run-xxhash.tdb", 0,
+				  flags|TDB_XXHASH|TDB_INCOMPATIBLE_HASH,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(tdb->hash_fn == tdb_xxhash);
+		tdb_close(tdb);
+
+		/* Cannot open with old or jenkins hash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-xxhash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_old_hash);
+		ok1(!tdb);
+		ok1(log_count == 1);
+
+		log_count = 0;
+		tdb = tdb_open_ex("run-xxhash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_jenkins_hash);
+		ok1(!tdb);
+		ok1(log_count == 1);
+
+		/* Can open with xxhash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-xxhash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_xxhash);
+		ok1(tdb);
+		ok1(log_count == 0);
+		r = tdb_fetch(tdb, d);
+		ok1(r.dsize == 5);
+		free(r.dptr);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+
+		/* Can open by letting it figure it out itself. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-xxhash.tdb", 0, TDB_INCOMPATIBLE_HASH,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_xxhash);
+		r = tdb_fetch(tdb, d);
+		ok1(r.dsize == 5);
+		free(r.dptr);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
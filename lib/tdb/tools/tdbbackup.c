@@ -105,7 +105,7 @@ static int test_fn(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA dbuf, void *state)
   this function is also used for restore
 */
 static int backup_tdb(const char *old_name, const char *new_name,
-		      int hash_size, int nolock)
+		      int hash_size, int hash_flags, int nolock)
 {
 	TDB_CONTEXT *tdb;
 	TDB_CONTEXT *tdb_new;
@@ -136,7 +136,7 @@ static int backup_tdb(const char *old_name, const char *new_name,
 	unlink(tmp_name);
 	tdb_new = tdb_open_ex(tmp_name,
 			      hash_size ? hash_size : tdb_hash_size(tdb),
-			      TDB_DEFAULT,
+			      TDB_DEFAULT | hash_flags,
 			      O_RDWR|O_CREAT|O_EXCL, st.st_mode & 0777,
 			      &log_ctx, NULL);
 	if (!tdb_new) {
@@ -251,7 +251,7 @@ static int verify_tdb(const char *fname, const char *bak_name)
 	/* count is < 0 means an error */
 	if (count < 0) {
 		printf("restoring %s\n", fname);
-		return backup_tdb(bak_name, fname, 0, 0);
+		return backup_tdb(bak_name, fname, 0, 0, 0);
 	}
 
 	printf("%s : %d records\n", fname, count);
@@ -281,6 +281,8 @@ static void usage(void)
 	printf("   -s suffix     set the backup suffix\n");
 	printf("   -v            verify mode (restore if corrupt)\n");
 	printf("   -n hashsize   set the new hash size for the backup\n");
+	printf("   -H hash       set the hash function for the backup,\n"
+	       "                 one of old, jenkins or xxhash\n");
 	printf("   -l            open without locking to back up mutex dbs\n");
 }
 
@@ -291,12 +293,13 @@ static void usage(void)
 	int c;
 	int verify = 0;
 	int hashsize = 0;
+	int hashflags = 0;
 	int nolock = 0;
 	const char *suffix = ".bak";
 
 	log_ctx.log_fn = tdb_log;
 
-	while ((c = getopt(argc, argv, "vhs:n:l")) != -1) {
+	while ((c = getopt(argc, argv, "vhs:n:H:l")) != -1) {
 		switch (c) {
 		case 'h':
 			usage();
@@ -310,6 +313,20 @@ static void usage(void)
 		case 'n':
 			hashsize = atoi(optarg);
 			break;
+		case 'H':
+			if (strcmp(optarg, "old") == 0) {
+				hashflags = 0;
+			} else if (strcmp(optarg, "jenkins") == 0) {
+				hashflags = TDB_INCOMPATIBLE_HASH;
+			} else if (strcmp(optarg, "xxhash") == 0) {
+				hashflags = TDB_XXHASH;
+			} else {
+				fprintf(stderr, "Unknown hash function %s\n",
+					optarg);
+				usage();
+				exit(1);
+			}
+			break;
 		case 'l':
 			nolock = 1;
 			break;
@@ -337,7 +354,7 @@ static void usage(void)
 		} else {
 			if (file_newer(fname, bak_name) &&
 			    backup_tdb(fname, bak_name, hashsize,
-				       nolock) != 0) {
+				       hashflags, nolock) != 0) {
 				ret = 1;
 			}
 		}
@@ -64,6 +64,8 @@ enum commands {
 	CMD_SYSTEM,
 	CMD_CHECK,
 	CMD_REPACK,
+	CMD_REPACK_ONLINE,
+	CMD_STATS,
 	CMD_QUIT,
 	CMD_HELP
 };
@@ -102,7 +104,9 @@ COMMAND_TABLE cmd_table[] = {
 	{"quit",	CMD_QUIT},
 	{"q",		CMD_QUIT},
 	{"!",		CMD_SYSTEM},
+	{"repack_online",	CMD_REPACK_ONLINE},
 	{"repack",	CMD_REPACK},
+	{"stats",	CMD_STATS},
 	{NULL,		CMD_HELP}
 };
 
@@ -237,6 +241,8 @@ static void help(void)
 "  freelist_size        : print the number of records in the freelist\n"
 "  check                : check the integrity of an opened database\n"
 "  repack               : repack the database\n"
+"  repack_online        : repack the database without blocking it\n"
+"  stats     [reset]    : show (or reset) chain and hot key statistics\n"
 "  speed                : perform speed tests on the database\n"
 "  ! command            : execute system command\n"
 "  1 | first            : print the first record\n"
@@ -612,6 +618,111 @@ static void check_db(TDB_CONTEXT *the_tdb)
 		       tdbcount);
 }
 
+static void repack_online_tdb(void)
+{
+	struct tdb_repack_stats stats;
+
+	if (tdb_repack_online(tdb, &stats) != 0) {
+		printf("Online repack failed: %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	printf("Moved %zu records (%zu bytes), skipped %zu records\n",
+	       stats.records_moved, stats.bytes_moved,
+	       stats.records_skipped);
+	printf("Reclaimed %zu bytes, locks held for %llu us "
+	       "(longest %llu us)\n",
+	       stats.bytes_reclaimed, stats.lock_usecs,
+	       stats.lock_usecs_max);
+}
+
+#define STATS_TOP_CHAINS 10
+
+static void stats_tdb(const char *arg)
+{
+	struct tdb_chain_stats total = { 0 };
+	struct tdb_chain_stats top[STATS_TOP_CHAINS];
+	int top_list[STATS_TOP_CHAINS];
+	struct tdb_hot_key keys[16];
+	int list, i, num_top = 0, num_keys;
+
+	if (arg != NULL && strcmp(arg, "reset") == 0) {
+		if (tdb_stats_reset(tdb) != 0) {
+			printf("Can't reset statistics: %s\n",
+			       tdb_errorstr(tdb));
+		}
+		return;
+	}
+
+	for (list = -1; list < tdb_hash_size(tdb); list++) {
+		struct tdb_chain_stats c;
+
+		if (tdb_stats_chain(tdb, list, &c) != 0) {
+			printf("No statistics: %s (open with TDB_STATISTICS)\n",
+			       tdb_errorstr(tdb));
+			return;
+		}
+		total.lock_waits += c.lock_waits;
+		total.lock_wait_usecs += c.lock_wait_usecs;
+		total.fetches += c.fetches;
+		total.stores += c.stores;
+		total.deletes += c.deletes;
+
+		if (c.lock_waits == 0) {
+			continue;
+		}
+		/* Keep the chains with the longest waits, longest first */
+		for (i = num_top; i > 0; i--) {
+			if (top[i-1].lock_wait_usecs >= c.lock_wait_usecs) {
+				break;
+			}
+			if (i < STATS_TOP_CHAINS) {
+				top[i] = top[i-1];
+				top_list[i] = top_list[i-1];
+			}
+		}
+		if (i < STATS_TOP_CHAINS) {
+			top[i] = c;
+			top_list[i] = list;
+			if (num_top < STATS_TOP_CHAINS) {
+				num_top++;
+			}
+		}
+	}
+
+	printf("fetches %llu, stores %llu, deletes %llu\n",
+	       total.fetches, total.stores, total.deletes);
+	printf("lock waits %llu, %llu us\n",
+	       total.lock_waits, total.lock_wait_usecs);
+
+	if (num_top > 0) {
+		printf("\nchain         waits       wait us     fetches      stores\n");
+	}
+	for (i = 0; i < num_top; i++) {
+		if (top_list[i] == -1) {
+			printf("freelist ");
+		} else {
+			printf("%8d ", top_list[i]);
+		}
+		printf("%10llu %13llu %11llu %11llu\n",
+		       top[i].lock_waits, top[i].lock_wait_usecs,
+		       top[i].fetches, top[i].stores);
+	}
+
+	num_keys = tdb_stats_hot_keys(tdb, keys, ARRAY_SIZE(keys));
+	if (num_keys > 0) {
+		printf("\nhot keys (sampled)\n");
+	}
+	for (i = 0; i < num_keys; i++) {
+		int len = MIN(keys[i].key_len, TDB_HOT_KEY_MAX_LEN);
+
+		printf("%10llu chain %u key(%zu) = \"",
+		       keys[i].count, keys[i].hash % tdb_hash_size(tdb), keys[i].key_len);
+		print_asc((const char *)keys[i].key, len);
+		printf("%s\"\n", len < keys[i].key_len ? "..." : "");
+	}
+}
+
 static int do_command(void)
 {
 	COMMAND_TABLE *ctp = cmd_table;
@@ -669,6 +780,14 @@ static int do_command(void)
 			bIterate = 0;
 			tdb_repack(tdb);
 			return 0;
+		case CMD_REPACK_ONLINE:
+			bIterate = 0;
+			repack_online_tdb();
+			return 0;
+		case CMD_STATS:
+			bIterate = 0;
+			stats_tdb(arg1);
+			return 0;
 		case CMD_TRANSACTION_CANCEL:
 			bIterate = 0;
 			tdb_transaction_cancel(tdb);
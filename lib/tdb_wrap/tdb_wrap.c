@@ -145,7 +145,8 @@ struct tdb_wrap *tdb_wrap_open(TALLOC_CTX *mem_ctx,
 
 		if (tdb_flags & TDB_MUTEX_LOCKING) {
 			if (!tdb_runtime_check_for_robust_mutexes()) {
-				tdb_flags &= ~TDB_MUTEX_LOCKING;
+				tdb_flags &= ~(TDB_MUTEX_LOCKING|
+					       TDB_SEQLOCK_READS);
 			}
 		}
 
@@ -601,14 +601,18 @@ int main(int argc, const char **argv)
 	struct tevent_context *ev;
 	struct sockaddr_in addr;
 	struct tevent_req *req;
+	const char *backend = NULL;
 	bool result;
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+	if ((argc != 2) && (argc != 3)) {
+		fprintf(stderr, "Usage: %s <port> [backend]\n", argv[0]);
 		exit(1);
 	}
 
 	port = atoi(argv[1]);
+	if (argc == 3) {
+		backend = argv[2];
+	}
 
 	printf("listening on port %d\n", port);
 
@@ -636,9 +640,9 @@ int main(int argc, const char **argv)
 		exit(1);
 	}
 
-	ev = tevent_context_init(NULL);
+	ev = tevent_context_init_byname(NULL, backend);
 	if (ev == NULL) {
-		fprintf(stderr, "tevent_context_init failed\n");
+		fprintf(stderr, "tevent_context_init_byname failed\n");
 		exit(1);
 	}
 
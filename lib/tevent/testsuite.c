@@ -673,6 +673,362 @@ static bool test_event_fd2(struct torture_context *tctx,
 	return true;
 }
 
+/*
+ * The pattern of lib/tevent/echo_server.c: every read and every
+ * write on the server side of a connection gets a fresh fde, so the
+ * backends have to deal with a steady stream of fd additions and
+ * removals, as smbd does for its client sockets.
+ */
+
+#define TEST_EVENT_ECHO_CONNS 32
+#define TEST_EVENT_ECHO_ROUNDS 1000
+
+struct test_event_echo_state {
+	struct tevent_context *ev;
+	unsigned num_finished;
+	bool finished;
+	const char *error;
+};
+
+struct test_event_echo_conn {
+	struct test_event_echo_state *state;
+	int client_fd;
+	int server_fd;
+	struct tevent_fd *client_fde;
+	struct tevent_fd *server_fde;
+	unsigned num_rounds;
+	uint8_t buf[64];
+	ssize_t buflen;
+};
+
+static void test_event_echo_fail(struct test_event_echo_state *state,
+				 const char *location)
+{
+	state->finished = true;
+	state->error = location;
+}
+
+static void test_event_echo_server_read(struct tevent_context *ev_ctx,
+					struct tevent_fd *fde,
+					uint16_t flags,
+					void *private_data);
+
+static void test_event_echo_server_write(struct tevent_context *ev_ctx,
+					 struct tevent_fd *fde,
+					 uint16_t flags,
+					 void *private_data)
+{
+	struct test_event_echo_conn *conn =
+		(struct test_event_echo_conn *)private_data;
+	ssize_t ret;
+
+	ret = write(conn->server_fd, conn->buf, conn->buflen);
+	if (ret != conn->buflen) {
+		test_event_echo_fail(conn->state, __location__);
+		return;
+	}
+
+	TALLOC_FREE(conn->server_fde);
+	conn->server_fde = tevent_add_fd(ev_ctx, conn, conn->server_fd,
+					 TEVENT_FD_READ,
+					 test_event_echo_server_read, conn);
+	if (conn->server_fde == NULL) {
+		test_event_echo_fail(conn->state, __location__);
+	}
+}
+
+static void test_event_echo_server_read(struct tevent_context *ev_ctx,
+					struct tevent_fd *fde,
+					uint16_t flags,
+					void *private_data)
+{
+	struct test_event_echo_conn *conn =
+		(struct test_event_echo_conn *)private_data;
+
+	conn->buflen = read(conn->server_fd, conn->buf, sizeof(conn->buf));
+	if (conn->buflen <= 0) {
+		test_event_echo_fail(conn->state, __location__);
+		return;
+	}
+
+	TALLOC_FREE(conn->server_fde);
+	conn->server_fde = tevent_add_fd(ev_ctx, conn, conn->server_fd,
+					 TEVENT_FD_WRITE,
+					 test_event_echo_server_write, conn);
+	if (conn->server_fde == NULL) {
+		test_event_echo_fail(conn->state, __location__);
+	}
+}
+
+static void test_event_echo_client_read(struct tevent_context *ev_ctx,
+					struct tevent_fd *fde,
+					uint16_t flags,
+					void *private_data)
+{
+	struct test_event_echo_conn *conn =
+		(struct test_event_echo_conn *)private_data;
+	struct test_event_echo_state *state = conn->state;
+	uint8_t v;
+	ssize_t ret;
+
+	ret = read(conn->client_fd, &v, 1);
+	if (ret != 1) {
+		test_event_echo_fail(state, __location__);
+		return;
+	}
+	if (v != (uint8_t)conn->num_rounds) {
+		test_event_echo_fail(state, __location__);
+		return;
+	}
+
+	conn->num_rounds++;
+	if (conn->num_rounds == TEST_EVENT_ECHO_ROUNDS) {
+		TALLOC_FREE(conn->client_fde);
+		state->num_finished++;
+		if (state->num_finished == TEST_EVENT_ECHO_CONNS) {
+			state->finished = true;
+		}
+		return;
+	}
+
+	v = (uint8_t)conn->num_rounds;
+	ret = write(conn->client_fd, &v, 1);
+	if (ret != 1) {
+		test_event_echo_fail(state, __location__);
+	}
+}
+
+static int test_event_echo_conn_destructor(struct test_event_echo_conn *conn)
+{
+	TALLOC_FREE(conn->client_fde);
+	TALLOC_FREE(conn->server_fde);
+	close(conn->client_fd);
+	close(conn->server_fd);
+	return 0;
+}
+
+static void test_event_echo_timeout(struct tevent_context *ev_ctx,
+				    struct tevent_timer *te,
+				    struct timeval tval,
+				    void *private_data)
+{
+	struct test_event_echo_state *state =
+		(struct test_event_echo_state *)private_data;
+
+	test_event_echo_fail(state, __location__);
+}
+
+static bool test_event_echo(struct torture_context *tctx,
+			    const void *test_data)
+{
+	const char *backend = (const char *)test_data;
+	struct test_event_echo_state state;
+	struct test_event_echo_conn *conns[TEST_EVENT_ECHO_CONNS];
+	struct timeval t;
+	int i;
+
+	ZERO_STRUCT(state);
+
+	state.ev = tevent_context_init_byname(tctx, backend);
+	if (state.ev == NULL) {
+		torture_skip(tctx, talloc_asprintf(tctx,
+			     "event backend '%s' not supported\n",
+			     backend));
+		return true;
+	}
+
+	tevent_set_debug_stderr(state.ev);
+	torture_comment(tctx, "backend '%s' - %s\n",
+			backend, __FUNCTION__);
+
+	/*
+	 * the timer should never expire
+	 */
+	tevent_add_timer(state.ev, state.ev, timeval_current_ofs(600, 0),
+			 test_event_echo_timeout, &state);
+
+	for (i=0; i<TEST_EVENT_ECHO_CONNS; i++) {
+		struct test_event_echo_conn *conn;
+		int sock[2];
+		int ret;
+
+		ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+		torture_assert(tctx, ret == 0, "socketpair failed");
+
+		conn = talloc_zero(state.ev, struct test_event_echo_conn);
+		torture_assert(tctx, conn != NULL, "talloc failed");
+		conn->state = &state;
+		conn->client_fd = sock[0];
+		conn->server_fd = sock[1];
+		talloc_set_destructor(conn, test_event_echo_conn_destructor);
+
+		conn->client_fde = tevent_add_fd(
+			state.ev, conn, conn->client_fd, TEVENT_FD_READ,
+			test_event_echo_client_read, conn);
+		torture_assert(tctx, conn->client_fde != NULL,
+			       "tevent_add_fd failed");
+		conn->server_fde = tevent_add_fd(
+			state.ev, conn, conn->server_fd, TEVENT_FD_READ,
+			test_event_echo_server_read, conn);
+		torture_assert(tctx, conn->server_fde != NULL,
+			       "tevent_add_fd failed");
+
+		conns[i] = conn;
+	}
+
+	t = timeval_current();
+
+	for (i=0; i<TEST_EVENT_ECHO_CONNS; i++) {
+		uint8_t v = 0;
+		write(conns[i]->client_fd, &v, 1);
+	}
+
+	while (!state.finished) {
+		errno = 0;
+		if (tevent_loop_once(state.ev) == -1) {
+			talloc_free(state.ev);
+			torture_fail(tctx, talloc_asprintf(tctx,
+				     "Failed event loop %s\n",
+				     strerror(errno)));
+		}
+	}
+
+	torture_comment(tctx, "Got %.2f echo round trips/sec\n",
+			state.num_finished * TEST_EVENT_ECHO_ROUNDS /
+			timeval_elapsed(&t));
+
+	talloc_free(state.ev);
+
+	torture_assert(tctx, state.error == NULL, talloc_asprintf(tctx,
+		       "%s", state.error));
+
+	return true;
+}
+
+/*
+ * Add a million timers with lots of equal expiry times, cancel
+ * some of them and check that the rest runs in the right order:
+ * zero timers first in the order they were added, then by expiry
+ * time, timers with the same expiry time again in the order they
+ * were added. All of them are in the past, so the loop never
+ * waits.
+ */
+
+#define TEST_TIMER_STRESS_NUM (1024*1024)
+
+struct test_timer_stress_state {
+	struct test_timer_stress_timer {
+		struct test_timer_stress_state *state;
+		struct tevent_timer *te;
+	} *timers;
+	uint32_t num_run;
+	uint32_t last_idx;
+	struct timeval last_tv;
+	const char *error;
+};
+
+static struct timeval test_timer_stress_tv(uint32_t idx)
+{
+	uint32_t h = idx * 2654435761U;
+
+	if ((idx % 64) == 0) {
+		return tevent_timeval_zero();
+	}
+	return tevent_timeval_set(1 + h % 4096, (h >> 12) % 16);
+}
+
+static void test_timer_stress_handler(struct tevent_context *ev,
+				      struct tevent_timer *te,
+				      struct timeval current_time,
+				      void *private_data)
+{
+	struct test_timer_stress_timer *t =
+		(struct test_timer_stress_timer *)private_data;
+	struct test_timer_stress_state *state = t->state;
+	uint32_t idx = t - state->timers;
+	struct timeval tv = test_timer_stress_tv(idx);
+	int cmp;
+
+	t->te = NULL;
+
+	if (state->num_run > 0) {
+		cmp = tevent_timeval_compare(&state->last_tv, &tv);
+		if ((cmp > 0) || ((cmp == 0) && (state->last_idx > idx))) {
+			state->error = __location__;
+		}
+	}
+
+	state->last_tv = tv;
+	state->last_idx = idx;
+	state->num_run += 1;
+}
+
+static bool test_timer_stress(struct torture_context *tctx,
+			      const void *test_data)
+{
+	struct tevent_context *ev;
+	struct test_timer_stress_state state;
+	uint32_t i, num_expected = 0;
+	struct timeval t;
+
+	ZERO_STRUCT(state);
+
+	ev = tevent_context_init(tctx);
+	torture_assert(tctx, ev != NULL, "tevent_context_init failed");
+
+	state.timers = talloc_zero_array(ev, struct test_timer_stress_timer,
+					 TEST_TIMER_STRESS_NUM);
+	torture_assert(tctx, state.timers != NULL, "talloc failed");
+
+	t = timeval_current();
+
+	for (i=0; i<TEST_TIMER_STRESS_NUM; i++) {
+		struct test_timer_stress_timer *timer = &state.timers[i];
+
+		timer->state = &state;
+		timer->te = tevent_add_timer(ev, ev,
+					     test_timer_stress_tv(i),
+					     test_timer_stress_handler,
+					     timer);
+		torture_assert(tctx, timer->te != NULL,
+			       "tevent_add_timer failed");
+	}
+
+	torture_comment(tctx, "Added %u timers in %.2f secs\n",
+			(unsigned)TEST_TIMER_STRESS_NUM, timeval_elapsed(&t));
+
+	for (i=0; i<TEST_TIMER_STRESS_NUM; i++) {
+		if ((i % 4) == 1) {
+			TALLOC_FREE(state.timers[i].te);
+			continue;
+		}
+		num_expected += 1;
+	}
+
+	t = timeval_current();
+
+	while (state.num_run < num_expected) {
+		if (tevent_loop_once(ev) == -1) {
+			talloc_free(ev);
+			torture_fail(tctx, "Failed event loop\n");
+		}
+		if (state.error != NULL) {
+			break;
+		}
+	}
+
+	torture_comment(tctx, "Ran %u timers in %.2f secs\n",
+			(unsigned)state.num_run, timeval_elapsed(&t));
+
+	talloc_free(ev);
+
+	torture_assert(tctx, state.error == NULL, state.error);
+	torture_assert_int_equal(tctx, state.num_run, num_expected,
+				 "wrong number of timers run");
+
+	return true;
+}
+
 #ifdef HAVE_PTHREAD
 
 static pthread_mutex_t threaded_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -1154,10 +1510,18 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 					       "fd2",
 					       test_event_fd2,
 					       (const void *)list[i]);
+		torture_suite_add_simple_tcase_const(backend_suite,
+					       "echo",
+					       test_event_echo,
+					       (const void *)list[i]);
 
 		torture_suite_add_suite(suite, backend_suite);
 	}
 
+	torture_suite_add_simple_tcase_const(suite, "timer_stress",
+					     test_timer_stress,
+					     NULL);
+
 #ifdef HAVE_PTHREAD
 	torture_suite_add_simple_tcase_const(suite, "threaded_poll_mt",
 					     test_event_context_threaded,
@@ -128,6 +128,9 @@ static void tevent_backend_init(void)
 #elif defined(HAVE_SOLARIS_PORTS)
 	tevent_port_init();
 #endif
+#if defined(HAVE_IO_URING)
+	tevent_io_uring_init();
+#endif
 
 	tevent_standard_init();
 }
@@ -179,6 +182,7 @@ int tevent_common_context_destructor(struct tevent_context *ev)
 	struct tevent_timer *te, *tn;
 	struct tevent_immediate *ie, *in;
 	struct tevent_signal *se, *sn;
+	size_t i;
 
 	if (ev->pipe_fde) {
 		talloc_free(ev->pipe_fde);
@@ -200,6 +204,15 @@ int tevent_common_context_destructor(struct tevent_context *ev)
 		DLIST_REMOVE(ev->timer_events, te);
 	}
 
+	for (i=0; i<ev->timer_heap.num; i++) {
+		te = ev->timer_heap.entries[i];
+		te->event_ctx = NULL;
+		te->heap_idx = TEVENT_TIMER_NOT_IN_HEAP;
+	}
+	TALLOC_FREE(ev->timer_heap.entries);
+	ev->timer_heap.num = 0;
+	ev->timer_heap.size = 0;
+
 	for (ie = ev->immediate_events; ie; ie = in) {
 		in = ie->next;
 		ie->event_ctx = NULL;
@@ -196,8 +196,19 @@ struct tevent_timer {
 	const char *location;
 	/* this is private for the events_ops implementation */
 	void *additional_data;
+	/*
+	 * the position in ev->timer_heap and the order of adding,
+	 * used by tevent_common_add_timer_v2()
+	 */
+	size_t heap_idx;
+	uint64_t seq;
 };
 
+/*
+ * heap_idx of timers that are only in the timer_events list
+ */
+#define TEVENT_TIMER_NOT_IN_HEAP SIZE_MAX
+
 struct tevent_immediate {
 	struct tevent_immediate *prev, *next;
 	struct tevent_context *event_ctx;
@@ -282,6 +293,20 @@ struct tevent_context {
 	 * tevent_common_add_timer_v2()
 	 */
 	struct tevent_timer *last_zero_timer;
+
+	/*
+	 * A binary min-heap of the non-zero timers added via
+	 * tevent_common_add_timer_v2(), ordered by next_event and
+	 * then by the order of adding. The first heap element is
+	 * also linked into timer_events behind the zero timers, so
+	 * the head of timer_events is always the next timer to run.
+	 */
+	struct {
+		struct tevent_timer **entries;
+		size_t num;
+		size_t size;
+		uint64_t seq;
+	} timer_heap;
 };
 
 const struct tevent_ops *tevent_find_ops_byname(const char *name);
@@ -354,6 +379,9 @@ void tevent_epoll_set_panic_fallback(struct tevent_context *ev,
 #ifdef HAVE_SOLARIS_PORTS
 bool tevent_port_init(void);
 #endif
+#ifdef HAVE_IO_URING
+bool tevent_io_uring_init(void);
+#endif
 
 
 void tevent_trace_point_callback(struct tevent_context *ev,
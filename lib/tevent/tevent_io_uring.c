@@ -0,0 +1,905 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   main select loop and event handling - io_uring implementation
+
+     ** NOTE! The following LGPL license applies to the tevent
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Every fde gets its own one-shot IORING_OP_POLL_ADD. Adding an fde
+  or changing its flags only marks it dirty, all the poll requests
+  that need to be (re)armed or removed are handed to the kernel
+  together with the wait for the next event in a single
+  io_uring_enter() call. The epoll backend needs one epoll_ctl() per
+  change plus the epoll_wait().
+
+  Two fdes on the same fd are no problem, they have separate poll
+  requests, so there is no multiplexing as in the epoll backend.
+
+  Poll requests are identified by the index of the fde's slot and a
+  generation counter, completions of requests that were removed or
+  belong to a freed fde are ignored.
+*/
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/select.h"
+#include "tevent.h"
+#include "tevent_internal.h"
+#include "tevent_util.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+
+#define IO_URING_EV_ENTRIES 256
+
+#define IO_URING_EV_UDATA_TIMEOUT UINT64_MAX
+#define IO_URING_EV_UDATA_REMOVE (UINT64_MAX-1)
+
+#define io_uring_ev_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define io_uring_ev_store_release(p, v) \
+	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct io_uring_ev_slot {
+	struct tevent_fd *fde;
+	uint32_t gen;
+	uint16_t armed;
+	bool in_use;
+	bool dirty;
+};
+
+struct io_uring_event_context {
+	/* a pointer back to the generic event_context */
+	struct tevent_context *ev;
+
+	int ring_fd;
+	pid_t pid;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct __kernel_timespec timeout;
+
+	struct io_uring_ev_slot *slots;
+	uint32_t num_slots;
+	uint32_t *free_slots;
+	uint32_t num_free;
+
+	uint32_t *dirty;
+	uint32_t num_dirty;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+			      unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+/*
+  called when io_uring fails in a way we can't recover from
+*/
+static void io_uring_ev_panic(struct io_uring_event_context *uring_ev,
+			      const char *reason)
+{
+	tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+		     "%s (%s) - calling abort()\n", reason, strerror(errno));
+	abort();
+}
+
+static void io_uring_ev_unmap(struct io_uring_event_context *uring_ev)
+{
+	if (uring_ev->sqes != NULL) {
+		munmap(uring_ev->sqes, uring_ev->sqes_size);
+		uring_ev->sqes = NULL;
+	}
+	if ((uring_ev->cq_ring != NULL) &&
+	    (uring_ev->cq_ring != uring_ev->sq_ring)) {
+		munmap(uring_ev->cq_ring, uring_ev->cq_ring_size);
+	}
+	uring_ev->cq_ring = NULL;
+	if (uring_ev->sq_ring != NULL) {
+		munmap(uring_ev->sq_ring, uring_ev->sq_ring_size);
+		uring_ev->sq_ring = NULL;
+	}
+	if (uring_ev->ring_fd != -1) {
+		close(uring_ev->ring_fd);
+		uring_ev->ring_fd = -1;
+	}
+}
+
+/*
+ free the ring
+*/
+static int io_uring_ctx_destructor(struct io_uring_event_context *uring_ev)
+{
+	io_uring_ev_unmap(uring_ev);
+	return 0;
+}
+
+/*
+ create and map the ring
+*/
+static int io_uring_ev_setup_ring(struct io_uring_event_context *uring_ev)
+{
+	struct io_uring_params p;
+	uint8_t *sq_ring, *cq_ring;
+	unsigned *sq_array;
+	unsigned i;
+
+	memset(&p, 0, sizeof(p));
+
+	uring_ev->ring_fd = sys_io_uring_setup(IO_URING_EV_ENTRIES, &p);
+	if (uring_ev->ring_fd == -1) {
+		return -1;
+	}
+
+	if (!ev_set_close_on_exec(uring_ev->ring_fd)) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_WARNING,
+			     "Failed to set close-on-exec, file descriptor may be leaked to children.\n");
+	}
+
+	/*
+	 * Without NODROP the kernel throws away completions when
+	 * more polls fire than the completion ring holds.
+	 */
+	if (!(p.features & IORING_FEAT_NODROP)) {
+		io_uring_ev_unmap(uring_ev);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	uring_ev->sq_ring_size = p.sq_off.array +
+		p.sq_entries * sizeof(unsigned);
+	uring_ev->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		uring_ev->sq_ring_size = MAX(uring_ev->sq_ring_size,
+					     uring_ev->cq_ring_size);
+		uring_ev->cq_ring_size = uring_ev->sq_ring_size;
+	}
+
+	uring_ev->sq_ring = mmap(NULL, uring_ev->sq_ring_size,
+				 PROT_READ|PROT_WRITE,
+				 MAP_SHARED|MAP_POPULATE,
+				 uring_ev->ring_fd, IORING_OFF_SQ_RING);
+	if (uring_ev->sq_ring == MAP_FAILED) {
+		uring_ev->sq_ring = NULL;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		uring_ev->cq_ring = uring_ev->sq_ring;
+	} else {
+		uring_ev->cq_ring = mmap(NULL, uring_ev->cq_ring_size,
+					 PROT_READ|PROT_WRITE,
+					 MAP_SHARED|MAP_POPULATE,
+					 uring_ev->ring_fd,
+					 IORING_OFF_CQ_RING);
+		if (uring_ev->cq_ring == MAP_FAILED) {
+			uring_ev->cq_ring = NULL;
+			goto fail;
+		}
+	}
+
+	uring_ev->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring_ev->sqes = mmap(NULL, uring_ev->sqes_size,
+			      PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			      uring_ev->ring_fd, IORING_OFF_SQES);
+	if (uring_ev->sqes == MAP_FAILED) {
+		uring_ev->sqes = NULL;
+		goto fail;
+	}
+
+	sq_ring = (uint8_t *)uring_ev->sq_ring;
+	uring_ev->sq_head = (unsigned *)(sq_ring + p.sq_off.head);
+	uring_ev->sq_tail = (unsigned *)(sq_ring + p.sq_off.tail);
+	uring_ev->sq_mask = *(unsigned *)(sq_ring + p.sq_off.ring_mask);
+	uring_ev->sq_entries = p.sq_entries;
+
+	/* sqe i always sits in slot i of the submission ring */
+	sq_array = (unsigned *)(sq_ring + p.sq_off.array);
+	for (i=0; i<p.sq_entries; i++) {
+		sq_array[i] = i;
+	}
+
+	cq_ring = (uint8_t *)uring_ev->cq_ring;
+	uring_ev->cq_head = (unsigned *)(cq_ring + p.cq_off.head);
+	uring_ev->cq_tail = (unsigned *)(cq_ring + p.cq_off.tail);
+	uring_ev->cq_mask = *(unsigned *)(cq_ring + p.cq_off.ring_mask);
+	uring_ev->cqes = (struct io_uring_cqe *)(cq_ring + p.cq_off.cqes);
+
+	uring_ev->pid = getpid();
+	return 0;
+
+fail:
+	io_uring_ev_unmap(uring_ev);
+	return -1;
+}
+
+static unsigned io_uring_ev_pending(struct io_uring_event_context *uring_ev)
+{
+	return *uring_ev->sq_tail -
+		io_uring_ev_load_acquire(uring_ev->sq_head);
+}
+
+static int io_uring_ev_submit(struct io_uring_event_context *uring_ev,
+			      unsigned min_complete)
+{
+	unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+	return sys_io_uring_enter(uring_ev->ring_fd,
+				  io_uring_ev_pending(uring_ev),
+				  min_complete, flags);
+}
+
+/*
+  get a free sqe, NULL if the submission ring is full even after
+  handing it to the kernel
+*/
+static struct io_uring_sqe *io_uring_ev_get_sqe(
+	struct io_uring_event_context *uring_ev, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail = *uring_ev->sq_tail;
+
+	if (io_uring_ev_pending(uring_ev) == uring_ev->sq_entries) {
+		io_uring_ev_submit(uring_ev, 0);
+		if (io_uring_ev_pending(uring_ev) == uring_ev->sq_entries) {
+			return NULL;
+		}
+	}
+
+	sqe = &uring_ev->sqes[tail & uring_ev->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = user_data;
+	return sqe;
+}
+
+static void io_uring_ev_queue_sqe(struct io_uring_event_context *uring_ev)
+{
+	io_uring_ev_store_release(uring_ev->sq_tail, *uring_ev->sq_tail + 1);
+}
+
+static uint64_t io_uring_ev_udata(uint32_t idx, uint32_t gen)
+{
+	return ((uint64_t)gen << 32) | idx;
+}
+
+static uint32_t io_uring_ev_next_gen(uint32_t gen)
+{
+	gen += 1;
+	if (gen == UINT32_MAX) {
+		/* keep clear of the special user_data values */
+		gen = 0;
+	}
+	return gen;
+}
+
+/*
+  map from TEVENT_FD_* to POLLIN/POLLOUT
+*/
+static uint16_t io_uring_map_flags(uint16_t flags)
+{
+	uint16_t ret = 0;
+	if (flags & TEVENT_FD_READ) ret |= POLLIN;
+	if (flags & TEVENT_FD_WRITE) ret |= POLLOUT;
+	return ret;
+}
+
+static void io_uring_ev_mark_dirty(struct io_uring_event_context *uring_ev,
+				   uint32_t idx)
+{
+	struct io_uring_ev_slot *slot = &uring_ev->slots[idx];
+
+	if (slot->dirty) {
+		return;
+	}
+	slot->dirty = true;
+	uring_ev->dirty[uring_ev->num_dirty++] = idx;
+}
+
+static void io_uring_ev_free_slot(struct io_uring_event_context *uring_ev,
+				  uint32_t idx)
+{
+	struct io_uring_ev_slot *slot = &uring_ev->slots[idx];
+
+	slot->in_use = false;
+	uring_ev->free_slots[uring_ev->num_free++] = idx;
+}
+
+static bool io_uring_ev_alloc_slot(struct io_uring_event_context *uring_ev,
+				   uint32_t *pidx)
+{
+	struct io_uring_ev_slot *slots;
+	uint32_t *free_slots, *dirty;
+	uint32_t i, num_slots;
+
+	if (uring_ev->num_free == 0) {
+		num_slots = MAX(uring_ev->num_slots * 2, 16);
+
+		slots = talloc_realloc(uring_ev, uring_ev->slots,
+				       struct io_uring_ev_slot, num_slots);
+		if (slots == NULL) {
+			return false;
+		}
+		uring_ev->slots = slots;
+
+		free_slots = talloc_realloc(uring_ev, uring_ev->free_slots,
+					    uint32_t, num_slots);
+		if (free_slots == NULL) {
+			return false;
+		}
+		uring_ev->free_slots = free_slots;
+
+		dirty = talloc_realloc(uring_ev, uring_ev->dirty,
+				       uint32_t, num_slots);
+		if (dirty == NULL) {
+			return false;
+		}
+		uring_ev->dirty = dirty;
+
+		for (i=num_slots; i>uring_ev->num_slots; i--) {
+			uring_ev->slots[i-1] = (struct io_uring_ev_slot) {
+				.fde = NULL
+			};
+			uring_ev->free_slots[uring_ev->num_free++] = i-1;
+		}
+		uring_ev->num_slots = num_slots;
+	}
+
+	*pidx = uring_ev->free_slots[--uring_ev->num_free];
+	uring_ev->slots[*pidx].in_use = true;
+	return true;
+}
+
+/*
+  bring the poll request of a slot in line with what its fde wants.
+  Returns false if the submission ring is full.
+*/
+static bool io_uring_ev_update_slot(struct io_uring_event_context *uring_ev,
+				    uint32_t idx)
+{
+	struct io_uring_ev_slot *slot = &uring_ev->slots[idx];
+	struct io_uring_sqe *sqe;
+	uint16_t want = 0;
+
+	if (slot->fde != NULL) {
+		want = io_uring_map_flags(slot->fde->flags);
+	}
+
+	if ((slot->armed != 0) && (slot->armed != want)) {
+		sqe = io_uring_ev_get_sqe(uring_ev,
+					  IO_URING_EV_UDATA_REMOVE);
+		if (sqe == NULL) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = io_uring_ev_udata(idx, slot->gen);
+		io_uring_ev_queue_sqe(uring_ev);
+
+		slot->armed = 0;
+		slot->gen = io_uring_ev_next_gen(slot->gen);
+	}
+
+	if ((want != 0) && (slot->armed == 0)) {
+		sqe = io_uring_ev_get_sqe(uring_ev,
+					  io_uring_ev_udata(idx, slot->gen));
+		if (sqe == NULL) {
+			return false;
+		}
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = slot->fde->fd;
+		sqe->poll_events = want;
+		io_uring_ev_queue_sqe(uring_ev);
+
+		slot->armed = want;
+	}
+
+	if ((slot->fde == NULL) && (slot->armed == 0)) {
+		io_uring_ev_free_slot(uring_ev, idx);
+	}
+
+	return true;
+}
+
+/*
+  queue all pending poll changes, the ones not fitting into the
+  submission ring stay dirty
+*/
+static void io_uring_ev_flush(struct io_uring_event_context *uring_ev)
+{
+	uint32_t i, num_dirty = uring_ev->num_dirty;
+
+	uring_ev->num_dirty = 0;
+
+	for (i=0; i<num_dirty; i++) {
+		uint32_t idx = uring_ev->dirty[i];
+		struct io_uring_ev_slot *slot = &uring_ev->slots[idx];
+
+		slot->dirty = false;
+
+		if (!slot->in_use) {
+			continue;
+		}
+		if (!io_uring_ev_update_slot(uring_ev, idx)) {
+			io_uring_ev_mark_dirty(uring_ev, idx);
+		}
+	}
+}
+
+/*
+  recreate the ring when our pid changes, the mapping is shared
+  with our parent
+*/
+static void io_uring_check_reopen(struct io_uring_event_context *uring_ev)
+{
+	uint32_t i;
+
+	if (uring_ev->pid == getpid()) {
+		return;
+	}
+
+	io_uring_ev_unmap(uring_ev);
+
+	if (io_uring_ev_setup_ring(uring_ev) != 0) {
+		io_uring_ev_panic(uring_ev, "io_uring_setup() failed");
+		return;
+	}
+
+	for (i=0; i<uring_ev->num_slots; i++) {
+		struct io_uring_ev_slot *slot = &uring_ev->slots[i];
+
+		if (!slot->in_use) {
+			continue;
+		}
+		slot->armed = 0;
+		slot->gen = io_uring_ev_next_gen(slot->gen);
+		if (slot->fde == NULL) {
+			io_uring_ev_free_slot(uring_ev, i);
+			continue;
+		}
+		io_uring_ev_mark_dirty(uring_ev, i);
+	}
+}
+
+/*
+  create a io_uring_event_context structure.
+*/
+static int io_uring_event_context_init(struct tevent_context *ev)
+{
+	struct io_uring_event_context *uring_ev;
+
+	/*
+	 * We might be called during tevent_re_initialise()
+	 * which means we need to free our old additional_data.
+	 */
+	TALLOC_FREE(ev->additional_data);
+
+	uring_ev = talloc_zero(ev, struct io_uring_event_context);
+	if (uring_ev == NULL) {
+		return -1;
+	}
+	uring_ev->ev = ev;
+	uring_ev->ring_fd = -1;
+
+	if (io_uring_ev_setup_ring(uring_ev) != 0) {
+		tevent_debug(ev, TEVENT_DEBUG_FATAL,
+			     "Failed to create io_uring: %s\n",
+			     strerror(errno));
+		talloc_free(uring_ev);
+		return -1;
+	}
+	talloc_set_destructor(uring_ev, io_uring_ctx_destructor);
+
+	ev->additional_data = uring_ev;
+	return 0;
+}
+
+/*
+  destroy an fd_event
+*/
+static int io_uring_event_fd_destructor(struct tevent_fd *fde)
+{
+	struct tevent_context *ev = fde->event_ctx;
+	struct io_uring_event_context *uring_ev = NULL;
+	uint64_t idx = fde->additional_flags;
+
+	if ((ev == NULL) || (idx == UINT64_MAX)) {
+		return tevent_common_fd_destructor(fde);
+	}
+
+	uring_ev = talloc_get_type_abort(ev->additional_data,
+					 struct io_uring_event_context);
+
+	io_uring_check_reopen(uring_ev);
+
+	uring_ev->slots[idx].fde = NULL;
+	fde->additional_flags = UINT64_MAX;
+
+	/*
+	 * Remove the poll request right away, it holds a reference
+	 * to the file: A socket would not be closed before our next
+	 * trip to the kernel.
+	 */
+	if (io_uring_ev_update_slot(uring_ev, idx)) {
+		if (io_uring_ev_pending(uring_ev) != 0) {
+			io_uring_ev_submit(uring_ev, 0);
+		}
+	} else {
+		io_uring_ev_mark_dirty(uring_ev, idx);
+	}
+
+	return tevent_common_fd_destructor(fde);
+}
+
+/*
+  add a fd based event
+  return NULL on failure (memory allocation error)
+*/
+static struct tevent_fd *io_uring_event_add_fd(struct tevent_context *ev,
+					       TALLOC_CTX *mem_ctx,
+					       int fd, uint16_t flags,
+					       tevent_fd_handler_t handler,
+					       void *private_data,
+					       const char *handler_name,
+					       const char *location)
+{
+	struct io_uring_event_context *uring_ev =
+		talloc_get_type_abort(ev->additional_data,
+		struct io_uring_event_context);
+	struct tevent_fd *fde;
+	uint32_t idx;
+
+	if (!io_uring_ev_alloc_slot(uring_ev, &idx)) {
+		return NULL;
+	}
+
+	fde = tevent_common_add_fd(ev, mem_ctx, fd, flags,
+				   handler, private_data,
+				   handler_name, location);
+	if (fde == NULL) {
+		io_uring_ev_free_slot(uring_ev, idx);
+		return NULL;
+	}
+
+	uring_ev->slots[idx].fde = fde;
+	uring_ev->slots[idx].armed = 0;
+	fde->additional_flags = idx;
+	talloc_set_destructor(fde, io_uring_event_fd_destructor);
+
+	io_uring_ev_mark_dirty(uring_ev, idx);
+
+	return fde;
+}
+
+/*
+  set the fd event flags
+*/
+static void io_uring_event_set_fd_flags(struct tevent_fd *fde,
+					uint16_t flags)
+{
+	struct tevent_context *ev;
+	struct io_uring_event_context *uring_ev;
+	uint64_t idx = fde->additional_flags;
+
+	if (fde->flags == flags) return;
+
+	fde->flags = flags;
+
+	ev = fde->event_ctx;
+	if ((ev == NULL) || (idx == UINT64_MAX)) {
+		return;
+	}
+	uring_ev = talloc_get_type_abort(ev->additional_data,
+					 struct io_uring_event_context);
+
+	io_uring_ev_mark_dirty(uring_ev, idx);
+}
+
+/*
+  look at the completions until we find a ready fde. The remaining
+  completions stay in the ring for the next round, so a single
+  io_uring_enter() serves as many event loop rounds as there were
+  ready fdes.
+*/
+static struct tevent_fd *io_uring_ev_reap(
+	struct io_uring_event_context *uring_ev,
+	bool *got_timeout, uint16_t *prevents)
+{
+	struct tevent_context *ev = uring_ev->ev;
+	struct tevent_fd *fde = NULL;
+	unsigned head, tail;
+
+	head = *uring_ev->cq_head;
+	tail = io_uring_ev_load_acquire(uring_ev->cq_tail);
+
+	while ((head != tail) && (fde == NULL)) {
+		struct io_uring_cqe *cqe =
+			&uring_ev->cqes[head & uring_ev->cq_mask];
+		uint64_t user_data = cqe->user_data;
+		int32_t res = cqe->res;
+		struct io_uring_ev_slot *slot;
+		uint32_t idx, gen;
+
+		head += 1;
+
+		if (user_data == IO_URING_EV_UDATA_TIMEOUT) {
+			*got_timeout = true;
+			continue;
+		}
+		if (user_data == IO_URING_EV_UDATA_REMOVE) {
+			continue;
+		}
+
+		idx = user_data & UINT32_MAX;
+		gen = user_data >> 32;
+
+		if (idx >= uring_ev->num_slots) {
+			continue;
+		}
+		slot = &uring_ev->slots[idx];
+		if (!slot->in_use || (slot->gen != gen) ||
+		    (slot->armed == 0)) {
+			/* a stale completion */
+			continue;
+		}
+
+		slot->armed = 0;
+		slot->gen = io_uring_ev_next_gen(slot->gen);
+
+		if (slot->fde == NULL) {
+			io_uring_ev_free_slot(uring_ev, idx);
+			continue;
+		}
+
+		if (res < 0) {
+			/*
+			 * the fd is gone. Disable the fde, matching
+			 * the epoll behavior for EBADF.
+			 */
+			tevent_debug(ev, TEVENT_DEBUG_ERROR,
+				     "POLL_ADD %s for fde[%p] fd[%d] - "
+				     "disabling\n", strerror(-res),
+				     slot->fde, slot->fde->fd);
+			DLIST_REMOVE(ev->fd_events, slot->fde);
+			slot->fde->event_ctx = NULL;
+			slot->fde->additional_flags = UINT64_MAX;
+			slot->fde = NULL;
+			io_uring_ev_free_slot(uring_ev, idx);
+			continue;
+		}
+
+		/* one-shot poll, it needs to be armed again */
+		io_uring_ev_mark_dirty(uring_ev, idx);
+
+		fde = slot->fde;
+		*prevents = res;
+	}
+
+	io_uring_ev_store_release(uring_ev->cq_head, head);
+
+	return fde;
+}
+
+/*
+  event loop handling using io_uring
+*/
+static int io_uring_event_loop(struct io_uring_event_context *uring_ev,
+			       struct timeval *tvalp)
+{
+	struct tevent_context *ev = uring_ev->ev;
+	struct tevent_fd *fde = NULL;
+	unsigned min_complete;
+	uint16_t revents = 0;
+	uint16_t flags = 0;
+	bool got_timeout = false;
+	int ret, wait_errno;
+
+	if (ev->signal_events &&
+	    tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	io_uring_ev_flush(uring_ev);
+
+	fde = io_uring_ev_reap(uring_ev, &got_timeout, &revents);
+
+	if (fde == NULL) {
+		min_complete = 1;
+	} else if (io_uring_ev_pending(uring_ev) != 0) {
+		min_complete = 0;
+	} else {
+		goto dispatch;
+	}
+
+	if ((min_complete > 0) && (tvalp != NULL)) {
+		struct io_uring_sqe *sqe;
+
+		/*
+		 * A timeout with a completion count of one finishes
+		 * with the first poll, so it never outlives this wait.
+		 */
+		sqe = io_uring_ev_get_sqe(uring_ev,
+					  IO_URING_EV_UDATA_TIMEOUT);
+		if (sqe != NULL) {
+			uring_ev->timeout.tv_sec = tvalp->tv_sec;
+			uring_ev->timeout.tv_nsec = tvalp->tv_usec * 1000;
+
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->fd = -1;
+			sqe->addr = (uint64_t)(uintptr_t)&uring_ev->timeout;
+			sqe->len = 1;
+			sqe->off = 1;
+			io_uring_ev_queue_sqe(uring_ev);
+		} else {
+			min_complete = 0;
+		}
+	}
+
+	if (min_complete > 0) {
+		tevent_trace_point_callback(ev, TEVENT_TRACE_BEFORE_WAIT);
+	}
+	ret = io_uring_ev_submit(uring_ev, min_complete);
+	wait_errno = errno;
+	if (min_complete > 0) {
+		tevent_trace_point_callback(ev, TEVENT_TRACE_AFTER_WAIT);
+	}
+
+	if (ret == -1 && wait_errno == EINTR && ev->signal_events) {
+		if (tevent_common_check_signal(ev)) {
+			return 0;
+		}
+	}
+
+	if (ret == -1 && wait_errno != EINTR && wait_errno != EAGAIN &&
+	    wait_errno != EBUSY) {
+		errno = wait_errno;
+		io_uring_ev_panic(uring_ev, "io_uring_enter() failed");
+		return -1;
+	}
+
+	if (fde == NULL) {
+		fde = io_uring_ev_reap(uring_ev, &got_timeout, &revents);
+	}
+
+	if ((fde == NULL) && got_timeout) {
+		/* we don't care about a possible delay here */
+		tevent_common_loop_timer_delay(ev);
+		return 0;
+	}
+
+dispatch:
+	if (fde == NULL) {
+		return 0;
+	}
+
+	if ((fde->flags & TEVENT_FD_READ) && (fde->flags & TEVENT_FD_WRITE) &&
+	    ((revents & (POLLIN|POLLOUT)) != (POLLIN|POLLOUT))) {
+		struct pollfd pfd = {
+			.fd = fde->fd, .events = POLLIN|POLLOUT
+		};
+
+		/*
+		 * A poll request completed by a wakeup only reports
+		 * the event that woke it up. Handlers waiting for both
+		 * directions expect to see both, as with the other
+		 * backends.
+		 */
+		if (poll(&pfd, 1, 0) == 1) {
+			revents |= pfd.revents;
+		}
+	}
+
+	if (revents & (POLLHUP|POLLERR)) {
+		/* If we only wait for TEVENT_FD_WRITE, we
+		   should not tell the event handler about it,
+		   and remove the writable flag, as we only
+		   report errors when waiting for read events
+		   to match the select behavior. */
+		if (!(fde->flags & TEVENT_FD_READ)) {
+			TEVENT_FD_NOT_WRITEABLE(fde);
+			return 0;
+		}
+		flags |= TEVENT_FD_READ;
+	}
+	if (revents & POLLIN) flags |= TEVENT_FD_READ;
+	if (revents & POLLOUT) flags |= TEVENT_FD_WRITE;
+
+	/*
+	 * make sure we only pass the flags
+	 * the handler is expecting.
+	 */
+	flags &= fde->flags;
+	if (flags) {
+		fde->handler(ev, fde, flags, fde->private_data);
+	}
+
+	return 0;
+}
+
+/*
+  do a single event loop using the events defined in ev
+*/
+static int io_uring_event_loop_once(struct tevent_context *ev,
+				    const char *location)
+{
+	struct io_uring_event_context *uring_ev =
+		talloc_get_type_abort(ev->additional_data,
+		struct io_uring_event_context);
+	struct timeval tval;
+
+	if (ev->signal_events &&
+	    tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	if (ev->immediate_events &&
+	    tevent_common_loop_immediate(ev)) {
+		return 0;
+	}
+
+	tval = tevent_common_loop_timer_delay(ev);
+	if (tevent_timeval_is_zero(&tval)) {
+		return 0;
+	}
+
+	io_uring_check_reopen(uring_ev);
+
+	return io_uring_event_loop(uring_ev, &tval);
+}
+
+static const struct tevent_ops io_uring_event_ops = {
+	.context_init		= io_uring_event_context_init,
+	.add_fd			= io_uring_event_add_fd,
+	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
+	.get_fd_flags		= tevent_common_fd_get_flags,
+	.set_fd_flags		= io_uring_event_set_fd_flags,
+	.add_timer		= tevent_common_add_timer_v2,
+	.schedule_immediate	= tevent_common_schedule_immediate,
+	.add_signal		= tevent_common_add_signal,
+	.loop_once		= io_uring_event_loop_once,
+	.loop_wait		= tevent_common_loop_wait,
+};
+
+_PRIVATE_ bool tevent_io_uring_init(void)
+{
+	return tevent_register_backend("io_uring", &io_uring_event_ops);
+}
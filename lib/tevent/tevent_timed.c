@@ -128,6 +128,152 @@ struct timeval tevent_timeval_current_ofs(uint32_t secs, uint32_t usecs)
 	return tevent_timeval_add(&tv, secs, usecs);
 }
 
+/*
+  the timer heap is ordered by next_event, timers with the same
+  next_event run in the order they were added
+*/
+static bool tevent_timer_heap_less(const struct tevent_timer *te1,
+				   const struct tevent_timer *te2)
+{
+	int ret;
+
+	ret = tevent_timeval_compare(&te1->next_event, &te2->next_event);
+	if (ret != 0) {
+		return ret < 0;
+	}
+	return te1->seq < te2->seq;
+}
+
+static void tevent_timer_heap_set(struct tevent_context *ev, size_t idx,
+				  struct tevent_timer *te)
+{
+	ev->timer_heap.entries[idx] = te;
+	te->heap_idx = idx;
+}
+
+static void tevent_timer_heap_up(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer **entries = ev->timer_heap.entries;
+	struct tevent_timer *te = entries[idx];
+
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+
+		if (!tevent_timer_heap_less(te, entries[parent])) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, entries[parent]);
+		idx = parent;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+static void tevent_timer_heap_down(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer **entries = ev->timer_heap.entries;
+	struct tevent_timer *te = entries[idx];
+	size_t num = ev->timer_heap.num;
+
+	while (true) {
+		size_t child = idx * 2 + 1;
+
+		if (child >= num) {
+			break;
+		}
+		if ((child + 1 < num) &&
+		    tevent_timer_heap_less(entries[child + 1],
+					   entries[child])) {
+			child += 1;
+		}
+		if (!tevent_timer_heap_less(entries[child], te)) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, entries[child]);
+		idx = child;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+/*
+  add a non-zero timer to the heap, a new first element replaces
+  the old one in timer_events
+*/
+static bool tevent_timer_heap_add(struct tevent_context *ev,
+				  struct tevent_timer *te)
+{
+	struct tevent_timer *old_first = NULL;
+
+	if (ev->timer_heap.num == ev->timer_heap.size) {
+		struct tevent_timer **entries;
+		size_t size = MAX(ev->timer_heap.size * 2, 16);
+
+		entries = talloc_realloc(ev, ev->timer_heap.entries,
+					 struct tevent_timer *, size);
+		if (entries == NULL) {
+			return false;
+		}
+		ev->timer_heap.entries = entries;
+		ev->timer_heap.size = size;
+	}
+
+	if (ev->timer_heap.num > 0) {
+		old_first = ev->timer_heap.entries[0];
+	}
+
+	te->seq = ev->timer_heap.seq++;
+	ev->timer_heap.entries[ev->timer_heap.num] = te;
+	ev->timer_heap.num += 1;
+	tevent_timer_heap_up(ev, ev->timer_heap.num - 1);
+
+	if (ev->timer_heap.entries[0] != old_first) {
+		if (old_first != NULL) {
+			DLIST_REMOVE(ev->timer_events, old_first);
+		}
+		DLIST_ADD_END(ev->timer_events, te);
+	}
+
+	return true;
+}
+
+static void tevent_timer_heap_remove(struct tevent_context *ev,
+				     struct tevent_timer *te)
+{
+	size_t idx = te->heap_idx;
+	struct tevent_timer *last;
+
+	if (idx == 0) {
+		DLIST_REMOVE(ev->timer_events, te);
+	}
+
+	ev->timer_heap.num -= 1;
+	last = ev->timer_heap.entries[ev->timer_heap.num];
+	te->heap_idx = TEVENT_TIMER_NOT_IN_HEAP;
+
+	if (last != te) {
+		tevent_timer_heap_set(ev, idx, last);
+		tevent_timer_heap_up(ev, idx);
+		tevent_timer_heap_down(ev, last->heap_idx);
+	}
+
+	if ((idx == 0) && (ev->timer_heap.num > 0)) {
+		DLIST_ADD_END(ev->timer_events, ev->timer_heap.entries[0]);
+	}
+}
+
+static void tevent_common_timer_unlink(struct tevent_context *ev,
+				       struct tevent_timer *te)
+{
+	if (te->heap_idx != TEVENT_TIMER_NOT_IN_HEAP) {
+		tevent_timer_heap_remove(ev, te);
+		return;
+	}
+
+	if (ev->last_zero_timer == te) {
+		ev->last_zero_timer = DLIST_PREV(te);
+	}
+	DLIST_REMOVE(ev->timer_events, te);
+}
+
 /*
   destroy a timed event
 */
@@ -141,10 +287,7 @@ static int tevent_common_timed_destructor(struct tevent_timer *te)
 		     "Destroying timer event %p \"%s\"\n",
 		     te, te->handler_name);
 
-	if (te->event_ctx->last_zero_timer == te) {
-		te->event_ctx->last_zero_timer = DLIST_PREV(te);
-	}
-	DLIST_REMOVE(te->event_ctx->timer_events, te);
+	tevent_common_timer_unlink(te->event_ctx, te);
 
 	return 0;
 }
@@ -180,6 +323,8 @@ static struct tevent_timer *tevent_common_add_timer_internal(
 	te->handler_name	= handler_name;
 	te->location		= location;
 	te->additional_data	= NULL;
+	te->heap_idx		= TEVENT_TIMER_NOT_IN_HEAP;
+	te->seq			= 0;
 
 	if (ev->timer_events == NULL) {
 		ev->last_zero_timer = NULL;
@@ -198,6 +343,17 @@ static struct tevent_timer *tevent_common_add_timer_internal(
 		 */
 		prev_te = ev->last_zero_timer;
 		ev->last_zero_timer = te;
+	} else if (optimize_zero) {
+		/*
+		 * All other timers go into the heap,
+		 * smbd and ctdbd can have tens of
+		 * thousands of them.
+		 */
+		if (!tevent_timer_heap_add(ev, te)) {
+			talloc_free(te);
+			return NULL;
+		}
+		goto done;
 	} else {
 		/*
 		 * we traverse the list from the tail
@@ -228,6 +384,7 @@ static struct tevent_timer *tevent_common_add_timer_internal(
 
 	DLIST_ADD_AFTER(ev->timer_events, te, prev_te);
 
+done:
 	talloc_set_destructor(te, tevent_common_timed_destructor);
 
 	tevent_debug(ev, TEVENT_DEBUG_TRACE,
@@ -249,7 +406,8 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev,
 	 * versions which use tevent_common_add_timer()
 	 * without using tevent_common_loop_timer_delay(),
 	 * it just uses DLIST_REMOVE(ev->timer_events, te)
-	 * and would leave ev->last_zero_timer behind.
+	 * and would leave ev->last_zero_timer and the
+	 * timer heap behind.
 	 */
 	return tevent_common_add_timer_internal(ev, mem_ctx, next_event,
 						handler, private_data,
@@ -267,6 +425,7 @@ struct tevent_timer *tevent_common_add_timer_v2(struct tevent_context *ev,
 {
 	/*
 	 * Here we turn on last_zero_timer optimization
+	 * and the timer heap
 	 */
 	return tevent_common_add_timer_internal(ev, mem_ctx, next_event,
 						handler, private_data,
@@ -322,10 +481,7 @@ struct timeval tevent_common_loop_timer_delay(struct tevent_context *ev)
 	/* We need to remove the timer from the list before calling the
 	 * handler because in a semi-async inner event loop called from the
 	 * handler we don't want to come across this event again -- vl */
-	if (ev->last_zero_timer == te) {
-		ev->last_zero_timer = DLIST_PREV(te);
-	}
-	DLIST_REMOVE(ev->timer_events, te);
+	tevent_common_timer_unlink(ev, te);
 
 	tevent_debug(te->event_ctx, TEVENT_DEBUG_TRACE,
 		     "Running timer event %p \"%s\"\n",
@@ -177,6 +177,191 @@ NTSTATUS smb2_signing_check_pdu(DATA_BLOB signing_key,
 	return NT_STATUS_OK;
 }
 
+/*
+ * Calculates the AES-CMAC signatures of several pdus,
+ * the AES operations of the pdus are interleaved.
+ *
+ * The signature field in the header is treated as zero.
+ */
+#define SMB2_SIGNING_BATCH 8
+
+static void smb2_signing_cmac_batch(const struct smb2_signing_pdu *pdus,
+				    size_t num_pdus,
+				    uint8_t res[][16])
+{
+	static const uint8_t zero_sig[16] = { 0, };
+	struct aes_cmac_128_context ctx[SMB2_SIGNING_BATCH];
+	struct aes_cmac_128_context *c[SMB2_SIGNING_BATCH];
+	const uint8_t *msg[SMB2_SIGNING_BATCH];
+	size_t len[SMB2_SIGNING_BATCH];
+	int max_count = 0;
+	size_t i;
+	int j;
+
+	SMB_ASSERT(num_pdus <= SMB2_SIGNING_BATCH);
+
+	for (i = 0; i < num_pdus; i++) {
+		uint8_t key[AES_BLOCK_SIZE];
+
+		ZERO_STRUCT(key);
+		memcpy(key, pdus[i].signing_key.data,
+		       MIN(pdus[i].signing_key.length, 16));
+
+		aes_cmac_128_init(&ctx[i], key);
+		ZERO_STRUCT(key);
+
+		c[i] = &ctx[i];
+		max_count = MAX(max_count, pdus[i].count);
+
+		msg[i] = (const uint8_t *)pdus[i].vector[0].iov_base;
+		len[i] = SMB2_HDR_SIGNATURE;
+	}
+	aes_cmac_128_update_multi(c, msg, len, num_pdus);
+
+	for (i = 0; i < num_pdus; i++) {
+		msg[i] = zero_sig;
+		len[i] = sizeof(zero_sig);
+	}
+	aes_cmac_128_update_multi(c, msg, len, num_pdus);
+
+	for (j = 1; j < max_count; j++) {
+		for (i = 0; i < num_pdus; i++) {
+			msg[i] = NULL;
+			len[i] = 0;
+
+			if (j >= pdus[i].count) {
+				continue;
+			}
+
+			msg[i] = (const uint8_t *)pdus[i].vector[j].iov_base;
+			len[i] = pdus[i].vector[j].iov_len;
+		}
+		aes_cmac_128_update_multi(c, msg, len, num_pdus);
+	}
+
+	for (i = 0; i < num_pdus; i++) {
+		aes_cmac_128_final(&ctx[i], res[i]);
+	}
+}
+
+/*
+ * Returns true if the pdu needs a signature.
+ */
+static NTSTATUS smb2_signing_pdu_needed(const struct smb2_signing_pdu *pdu,
+					bool *needed)
+{
+	const uint8_t *hdr;
+	uint64_t session_id;
+
+	*needed = false;
+
+	if (pdu->count < 2) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (pdu->vector[0].iov_len != SMB2_HDR_BODY) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	hdr = (const uint8_t *)pdu->vector[0].iov_base;
+
+	session_id = BVAL(hdr, SMB2_HDR_SESSION_ID);
+	if (session_id == 0) {
+		/*
+		 * do not sign messages with a zero session_id.
+		 * See MS-SMB2 3.2.4.1.1
+		 */
+		return NT_STATUS_OK;
+	}
+
+	*needed = true;
+	return NT_STATUS_OK;
+}
+
+/*
+ * The same as calling smb2_signing_sign_pdu() for each pdu,
+ * but the signatures of multiple pdus are calculated together.
+ */
+NTSTATUS smb2_signing_sign_pdus(enum protocol_types protocol,
+				struct smb2_signing_pdu *pdus,
+				size_t num_pdus)
+{
+	struct smb2_signing_pdu batch[SMB2_SIGNING_BATCH];
+	uint8_t res[SMB2_SIGNING_BATCH][16];
+	size_t num_batch = 0;
+	size_t i;
+
+	if (protocol < PROTOCOL_SMB2_24) {
+		for (i = 0; i < num_pdus; i++) {
+			NTSTATUS status;
+
+			status = smb2_signing_sign_pdu(pdus[i].signing_key,
+						       protocol,
+						       pdus[i].vector,
+						       pdus[i].count);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
+		}
+		return NT_STATUS_OK;
+	}
+
+	for (i = 0; i < num_pdus; i++) {
+		uint8_t *hdr = (uint8_t *)pdus[i].vector[0].iov_base;
+		NTSTATUS status;
+		bool needed;
+		size_t b;
+
+		status = smb2_signing_pdu_needed(&pdus[i], &needed);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		if (!needed) {
+			continue;
+		}
+
+		if (pdus[i].signing_key.length == 0) {
+			DEBUG(2,("Wrong session key length %u for SMB2 signing\n",
+				 (unsigned)pdus[i].signing_key.length));
+			return NT_STATUS_ACCESS_DENIED;
+		}
+
+		memset(hdr + SMB2_HDR_SIGNATURE, 0, 16);
+
+		SIVAL(hdr, SMB2_HDR_FLAGS,
+		      IVAL(hdr, SMB2_HDR_FLAGS) | SMB2_HDR_FLAG_SIGNED);
+
+		batch[num_batch++] = pdus[i];
+		if ((num_batch < SMB2_SIGNING_BATCH) && (i + 1 < num_pdus)) {
+			continue;
+		}
+
+		smb2_signing_cmac_batch(batch, num_batch, res);
+
+		for (b = 0; b < num_batch; b++) {
+			hdr = (uint8_t *)batch[b].vector[0].iov_base;
+			memcpy(hdr + SMB2_HDR_SIGNATURE, res[b], 16);
+		}
+		DEBUG(5,("signed %u SMB2 messages\n", (unsigned)num_batch));
+
+		num_batch = 0;
+	}
+
+	if (num_batch > 0) {
+		size_t b;
+
+		smb2_signing_cmac_batch(batch, num_batch, res);
+
+		for (b = 0; b < num_batch; b++) {
+			uint8_t *hdr = (uint8_t *)batch[b].vector[0].iov_base;
+			memcpy(hdr + SMB2_HDR_SIGNATURE, res[b], 16);
+		}
+		DEBUG(5,("signed %u SMB2 messages\n", (unsigned)num_batch));
+	}
+
+	return NT_STATUS_OK;
+}
+
 void smb2_key_derivation(const uint8_t *KI, size_t KI_len,
 			 const uint8_t *Label, size_t Label_len,
 			 const uint8_t *Context, size_t Context_len,
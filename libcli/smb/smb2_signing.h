@@ -33,6 +33,20 @@ NTSTATUS smb2_signing_check_pdu(DATA_BLOB signing_key,
 				const struct iovec *vector,
 				int count);
 
+/*
+ * A pdu for smb2_signing_sign_pdus(),
+ * vector[0] is the SMB2 header.
+ */
+struct smb2_signing_pdu {
+	DATA_BLOB signing_key;
+	struct iovec *vector;
+	int count;
+};
+
+NTSTATUS smb2_signing_sign_pdus(enum protocol_types protocol,
+				struct smb2_signing_pdu *pdus,
+				size_t num_pdus);
+
 void smb2_key_derivation(const uint8_t *KI, size_t KI_len,
 			 const uint8_t *Label, size_t Label_len,
 			 const uint8_t *Context, size_t Context_len,
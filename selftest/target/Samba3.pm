@@ -544,6 +544,7 @@ sub setup_simpleserver($$)
 	lanman auth = yes
 	vfs objects = xattr_tdb streams_depot
 	change notify = no
+	messaging:shm ring size = 65536
 
 [vfs_aio_fork]
 	path = $prefix_abs/share
@@ -1572,6 +1573,23 @@ sub provision($$$$$$$$)
 	copy = tmp
 	aio read size = 1
 	aio write size = 1
+[async_getinfo]
+	copy = tmp
+	vfs objects = delay_inject
+	delay_inject:stat = 1000
+	smbd:async getinfo = yes
+[name_index]
+	copy = tmp
+	smbd:name index = yes
+[async_dir]
+	copy = tmp
+	vfs objects = delay_inject
+	delay_inject:stat = 1000
+	delay_inject:getxattr = 1000
+	smbd:async query directory = yes
+[dir_cache]
+	copy = tmp
+	smbd:dir cache = yes
 
 [print\$]
 	copy = tmp
@@ -62,6 +62,14 @@ int ctdbd_parse(struct ctdbd_connection *conn, uint32_t db_id,
 		void (*parser)(TDB_DATA key, TDB_DATA data,
 			       void *private_data),
 		void *private_data);
+int ctdbd_migrate_multi(struct ctdbd_connection *conn, uint32_t db_id,
+			const TDB_DATA *keys, size_t num_keys);
+int ctdbd_parse_multi(struct ctdbd_connection *conn, uint32_t db_id,
+		      const TDB_DATA *keys, const bool *local_copy,
+		      size_t num_keys,
+		      void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+				     void *private_data),
+		      void *private_data);
 
 int ctdbd_traverse(struct ctdbd_connection *master, uint32_t db_id,
 		   void (*fn)(TDB_DATA key, TDB_DATA data,
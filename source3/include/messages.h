@@ -135,6 +135,23 @@ NTSTATUS messaging_send_iov(struct messaging_context *msg_ctx,
 			    const struct iovec *iov, int iovlen,
 			    const int *fds, size_t num_fds);
 
+/*
+ * One destination for messaging_send_iov_multi(). "prefix" is sent
+ * in front of the payload shared by all destinations, it may be
+ * empty. "ret" is 0 or the errno for this destination.
+ */
+struct messaging_send_multi_dst {
+	struct server_id dst;
+	struct iovec prefix;
+	int ret;
+};
+
+int messaging_send_iov_multi(struct messaging_context *msg_ctx,
+			     uint32_t msg_type,
+			     struct messaging_send_multi_dst *dsts,
+			     size_t num_dsts,
+			     const struct iovec *iov, int iovlen);
+
 struct tevent_req *messaging_filtered_read_send(
 	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 	struct messaging_context *msg_ctx,
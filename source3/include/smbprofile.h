@@ -69,6 +69,9 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(syscall_asys_fsync) \
 	SMBPROFILE_STATS_BASIC(syscall_stat) \
 	SMBPROFILE_STATS_BASIC(syscall_fstat) \
+	SMBPROFILE_STATS_BASIC(syscall_asys_fstat) \
+	SMBPROFILE_STATS_BASIC(syscall_asys_stat) \
+	SMBPROFILE_STATS_BASIC(syscall_asys_getxattr) \
 	SMBPROFILE_STATS_BASIC(syscall_lstat) \
 	SMBPROFILE_STATS_BASIC(syscall_get_alloc_size) \
 	SMBPROFILE_STATS_BASIC(syscall_unlink) \
@@ -114,6 +117,15 @@ struct tevent_context;
 	SMBPROFILE_STATS_COUNT(statcache_hits) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
+	SMBPROFILE_STATS_SECTION_START(dircache, "Directory Cache") \
+	SMBPROFILE_STATS_COUNT(dir_cache_lookups) \
+	SMBPROFILE_STATS_COUNT(dir_cache_hits) \
+	SMBPROFILE_STATS_COUNT(dir_cache_misses) \
+	SMBPROFILE_STATS_COUNT(dir_cache_stores) \
+	SMBPROFILE_STATS_COUNT(dir_cache_invalidations) \
+	SMBPROFILE_STATS_COUNT(dir_cache_wipes) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
 	SMBPROFILE_STATS_SECTION_START(writecache, "Write Cache") \
 	SMBPROFILE_STATS_COUNT(writecache_allocations) \
 	SMBPROFILE_STATS_COUNT(writecache_deallocations) \
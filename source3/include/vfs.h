@@ -170,8 +170,11 @@
 /* Bump to version 34 - Samba 4.4 will ship with that */
 /* Version 34 - Remove bool posix_open, add uint64_t posix_flags */
 /* Version 34 - Added bool posix_pathnames to struct smb_request */
+/* Bump to version 35 - Add SMB_VFS_FSTAT_SEND/RECV */
+/* Version 35 - Add SMB_VFS_STAT_SEND/RECV and SMB_VFS_GETXATTR_SEND/RECV */
+/* Version 35 - Add the hash index links to struct files_struct */
 
-#define SMB_VFS_INTERFACE_VERSION 34
+#define SMB_VFS_INTERFACE_VERSION 35
 
 /*
     All intercepted VFS operations must be declared as static functions inside module source
@@ -221,8 +224,21 @@ struct fsp_lease {
 	struct smb2_lease lease;
 };
 
+/*
+ * Chain of one of the per-connection hash indexes of open files, see
+ * smbd/files.c
+ */
+struct fsp_hash_link {
+	struct files_struct *next, *prev;
+	uint32_t hash;
+	bool linked;
+};
+
 typedef struct files_struct {
 	struct files_struct *next, *prev;
+	struct fsp_hash_link file_id_link;
+	struct fsp_hash_link fd_link;
+	struct fsp_hash_link lease_link;
 	uint64_t fnum;
 	struct smbXsrv_open *op;
 	struct connection_struct *conn;
@@ -615,6 +631,18 @@ struct vfs_fn_pointers {
 	int (*fsync_recv_fn)(struct tevent_req *req, int *err);
 	int (*stat_fn)(struct vfs_handle_struct *handle, struct smb_filename *smb_fname);
 	int (*fstat_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp, SMB_STRUCT_STAT *sbuf);
+	struct tevent_req *(*fstat_send_fn)(struct vfs_handle_struct *handle,
+					    TALLOC_CTX *mem_ctx,
+					    struct tevent_context *ev,
+					    struct files_struct *fsp,
+					    SMB_STRUCT_STAT *sbuf);
+	int (*fstat_recv_fn)(struct tevent_req *req, int *err);
+	struct tevent_req *(*stat_send_fn)(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   const struct smb_filename *smb_fname,
+					   SMB_STRUCT_STAT *sbuf);
+	int (*stat_recv_fn)(struct tevent_req *req, int *err);
 	int (*lstat_fn)(struct vfs_handle_struct *handle, struct smb_filename *smb_filename);
 	uint64_t (*get_alloc_size_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp, const SMB_STRUCT_STAT *sbuf);
 	int (*unlink_fn)(struct vfs_handle_struct *handle,
@@ -788,6 +816,14 @@ struct vfs_fn_pointers {
 
 	/* EA operations. */
 	ssize_t (*getxattr_fn)(struct vfs_handle_struct *handle,const char *path, const char *name, void *value, size_t size);
+	struct tevent_req *(*getxattr_send_fn)(struct vfs_handle_struct *handle,
+					       TALLOC_CTX *mem_ctx,
+					       struct tevent_context *ev,
+					       const char *path,
+					       const char *name,
+					       void *value,
+					       size_t size);
+	ssize_t (*getxattr_recv_fn)(struct tevent_req *req, int *err);
 	ssize_t (*fgetxattr_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp, const char *name, void *value, size_t size);
 	ssize_t (*listxattr_fn)(struct vfs_handle_struct *handle, const char *path, char *list, size_t size);
 	ssize_t (*flistxattr_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp, char *list, size_t size);
@@ -1053,6 +1089,18 @@ int smb_vfs_call_stat(struct vfs_handle_struct *handle,
 		      struct smb_filename *smb_fname);
 int smb_vfs_call_fstat(struct vfs_handle_struct *handle,
 		       struct files_struct *fsp, SMB_STRUCT_STAT *sbuf);
+struct tevent_req *smb_vfs_call_fstat_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   SMB_STRUCT_STAT *sbuf);
+int SMB_VFS_FSTAT_RECV(struct tevent_req *req, int *perrno);
+struct tevent_req *smb_vfs_call_stat_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  const struct smb_filename *smb_fname,
+					  SMB_STRUCT_STAT *sbuf);
+int SMB_VFS_STAT_RECV(struct tevent_req *req, int *perrno);
 int smb_vfs_call_lstat(struct vfs_handle_struct *handle,
 		       struct smb_filename *smb_filename);
 uint64_t smb_vfs_call_get_alloc_size(struct vfs_handle_struct *handle,
@@ -1234,6 +1282,14 @@ int smb_vfs_call_sys_acl_delete_def_file(struct vfs_handle_struct *handle,
 ssize_t smb_vfs_call_getxattr(struct vfs_handle_struct *handle,
 			      const char *path, const char *name, void *value,
 			      size_t size);
+struct tevent_req *smb_vfs_call_getxattr_send(struct vfs_handle_struct *handle,
+					      TALLOC_CTX *mem_ctx,
+					      struct tevent_context *ev,
+					      const char *path,
+					      const char *name,
+					      void *value,
+					      size_t size);
+ssize_t SMB_VFS_GETXATTR_RECV(struct tevent_req *req, int *perrno);
 ssize_t smb_vfs_call_fgetxattr(struct vfs_handle_struct *handle,
 			       struct files_struct *fsp, const char *name,
 			       void *value, size_t size);
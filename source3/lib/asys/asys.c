@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include "../pthreadpool/pthreadpool.h"
+#include "lib/util/setid.h"
 
 struct asys_pwrite_args {
 	int fildes;
@@ -39,14 +40,37 @@ struct asys_fsync_args {
 	int fildes;
 };
 
+struct asys_fstat_args {
+	int fildes;
+	struct stat *sbuf;
+};
+
+struct asys_fstatat_args {
+	int dirfd;
+	const char *pathname;
+	struct stat *sbuf;
+	int flags;
+};
+
+struct asys_getxattr_args {
+	const char *path;
+	const char *name;
+	void *value;
+	size_t size;
+};
+
 union asys_job_args {
 	struct asys_pwrite_args pwrite_args;
 	struct asys_pread_args pread_args;
 	struct asys_fsync_args fsync_args;
+	struct asys_fstat_args fstat_args;
+	struct asys_fstatat_args fstatat_args;
+	struct asys_getxattr_args getxattr_args;
 };
 
 struct asys_job {
 	void *private_data;
+	struct asys_creds_context *cctx;
 	union asys_job_args args;
 	ssize_t ret;
 	int err;
@@ -63,7 +87,10 @@ struct asys_context {
 };
 
 struct asys_creds_context {
-	int dummy;
+	uid_t uid;
+	gid_t gid;
+	unsigned num_gids;
+	gid_t *gids;
 };
 
 int asys_context_init(struct asys_context **pctx, unsigned max_parallel)
@@ -125,6 +152,7 @@ static int asys_new_job(struct asys_context *ctx, int *jobid,
 		job = ctx->jobs[i];
 		if (!job->busy) {
 			job->err = 0;
+			job->cctx = NULL;
 			*pjob = job;
 			*jobid = i;
 			return 0;
@@ -275,6 +303,256 @@ static void asys_fsync_do(void *private_data)
 	}
 }
 
+static void asys_fstat_do(void *private_data);
+
+int asys_fstat(struct asys_context *ctx, int fildes, struct stat *sbuf,
+	       void *private_data)
+{
+	struct asys_job *job;
+	struct asys_fstat_args *args;
+	int jobid;
+	int ret;
+
+	ret = asys_new_job(ctx, &jobid, &job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->private_data = private_data;
+
+	args = &job->args.fstat_args;
+	args->fildes = fildes;
+	args->sbuf = sbuf;
+
+	ret = pthreadpool_add_job_prio(ctx->pool, jobid, PTHREADPOOL_PRIO_HIGH,
+				       asys_fstat_do, job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->busy = 1;
+
+	return 0;
+}
+
+static void asys_fstat_do(void *private_data)
+{
+	struct asys_job *job = (struct asys_job *)private_data;
+	struct asys_fstat_args *args = &job->args.fstat_args;
+
+	job->ret = fstat(args->fildes, args->sbuf);
+	if (job->ret == -1) {
+		job->err = errno;
+	}
+}
+
+struct asys_creds_context *asys_creds_context_create(
+	struct asys_context *ctx,
+	uid_t uid, gid_t gid, unsigned num_gids, gid_t *gids)
+{
+#ifdef USE_LINUX_THREAD_CREDENTIALS
+	struct asys_creds_context *cctx;
+
+	cctx = malloc(sizeof(struct asys_creds_context) +
+		      num_gids * sizeof(gid_t));
+	if (cctx == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	cctx->uid = uid;
+	cctx->gid = gid;
+	cctx->num_gids = num_gids;
+	cctx->gids = (gid_t *)(cctx + 1);
+	if (num_gids != 0) {
+		memcpy(cctx->gids, gids, num_gids * sizeof(gid_t));
+	}
+	return cctx;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+int asys_creds_context_delete(struct asys_creds_context *cctx)
+{
+	free(cctx);
+	return 0;
+}
+
+#ifdef USE_LINUX_THREAD_CREDENTIALS
+
+/*
+ * The credentials a worker thread currently runs with. Jobs for the
+ * same user come in long runs, only switch when they change.
+ */
+#define ASYS_CACHED_GIDS 64
+
+#ifdef HAVE___THREAD
+static __thread bool asys_thread_creds_valid;
+static __thread uid_t asys_thread_uid;
+static __thread gid_t asys_thread_gid;
+static __thread unsigned asys_thread_num_gids;
+static __thread gid_t asys_thread_gids[ASYS_CACHED_GIDS];
+#endif
+
+static int asys_set_creds(const struct asys_creds_context *cctx)
+{
+#ifdef HAVE___THREAD
+	if (asys_thread_creds_valid &&
+	    (asys_thread_uid == cctx->uid) &&
+	    (asys_thread_gid == cctx->gid) &&
+	    (asys_thread_num_gids == cctx->num_gids) &&
+	    (memcmp(asys_thread_gids, cctx->gids,
+		    cctx->num_gids * sizeof(gid_t)) == 0)) {
+		return 0;
+	}
+	asys_thread_creds_valid = false;
+#endif
+
+	/*
+	 * Same sequence as set_thread_credentials(): The syscalls
+	 * only change the calling thread's credentials.
+	 */
+	if (samba_setresuid(0, 0, -1) != 0) {
+		return errno;
+	}
+	if (samba_setresgid(cctx->gid, cctx->gid, -1) != 0) {
+		return errno;
+	}
+	if (samba_setgroups(cctx->num_gids, cctx->gids) != 0) {
+		return errno;
+	}
+	if (samba_setresuid(cctx->uid, cctx->uid, -1) != 0) {
+		return errno;
+	}
+
+#ifdef HAVE___THREAD
+	if (cctx->num_gids <= ASYS_CACHED_GIDS) {
+		asys_thread_uid = cctx->uid;
+		asys_thread_gid = cctx->gid;
+		asys_thread_num_gids = cctx->num_gids;
+		memcpy(asys_thread_gids, cctx->gids,
+		       cctx->num_gids * sizeof(gid_t));
+		asys_thread_creds_valid = true;
+	}
+#endif
+	return 0;
+}
+
+#else
+
+static int asys_set_creds(const struct asys_creds_context *cctx)
+{
+	return ENOSYS;
+}
+
+#endif
+
+static void asys_fstatat_do(void *private_data);
+
+int asys_fstatat(struct asys_context *ctx, struct asys_creds_context *cctx,
+		 int dirfd, const char *pathname, struct stat *sbuf,
+		 int flags, void *private_data)
+{
+	struct asys_job *job;
+	struct asys_fstatat_args *args;
+	int jobid;
+	int ret;
+
+	ret = asys_new_job(ctx, &jobid, &job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->private_data = private_data;
+	job->cctx = cctx;
+
+	args = &job->args.fstatat_args;
+	args->dirfd = dirfd;
+	args->pathname = pathname;
+	args->sbuf = sbuf;
+	args->flags = flags;
+
+	ret = pthreadpool_add_job_prio(ctx->pool, jobid, PTHREADPOOL_PRIO_HIGH,
+				       asys_fstatat_do, job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->busy = 1;
+
+	return 0;
+}
+
+static void asys_fstatat_do(void *private_data)
+{
+	struct asys_job *job = (struct asys_job *)private_data;
+	struct asys_fstatat_args *args = &job->args.fstatat_args;
+
+	if (job->cctx != NULL) {
+		job->err = asys_set_creds(job->cctx);
+		if (job->err != 0) {
+			job->ret = -1;
+			return;
+		}
+	}
+
+	job->ret = fstatat(args->dirfd, args->pathname, args->sbuf,
+			   args->flags);
+	if (job->ret == -1) {
+		job->err = errno;
+	}
+}
+
+static void asys_getxattr_do(void *private_data);
+
+int asys_getxattr(struct asys_context *ctx, struct asys_creds_context *cctx,
+		  const char *path, const char *name, void *value,
+		  size_t size, void *private_data)
+{
+	struct asys_job *job;
+	struct asys_getxattr_args *args;
+	int jobid;
+	int ret;
+
+	ret = asys_new_job(ctx, &jobid, &job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->private_data = private_data;
+	job->cctx = cctx;
+
+	args = &job->args.getxattr_args;
+	args->path = path;
+	args->name = name;
+	args->value = value;
+	args->size = size;
+
+	ret = pthreadpool_add_job_prio(ctx->pool, jobid, PTHREADPOOL_PRIO_HIGH,
+				       asys_getxattr_do, job);
+	if (ret != 0) {
+		return ret;
+	}
+	job->busy = 1;
+
+	return 0;
+}
+
+static void asys_getxattr_do(void *private_data)
+{
+	struct asys_job *job = (struct asys_job *)private_data;
+	struct asys_getxattr_args *args = &job->args.getxattr_args;
+
+	if (job->cctx != NULL) {
+		job->err = asys_set_creds(job->cctx);
+		if (job->err != 0) {
+			job->ret = -1;
+			return;
+		}
+	}
+
+	job->ret = getxattr(args->path, args->name, args->value, args->size);
+	if (job->ret == -1) {
+		job->err = errno;
+	}
+}
+
 void asys_cancel(struct asys_context *ctx, void *private_data)
 {
 	unsigned i;
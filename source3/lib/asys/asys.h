@@ -135,14 +135,44 @@ int asys_pwrite(struct asys_context *ctx, int fildes, const void *buf,
 int asys_ftruncate(struct asys_context *ctx, int filedes, off_t length,
 		   void *private_data);
 int asys_fsync(struct asys_context *ctx, int fd, void *private_data);
+
+/*
+ * asys_fstat(), asys_fstatat() and asys_getxattr() are queued with
+ * PTHREADPOOL_PRIO_HIGH, ahead of reads and writes.
+ */
+int asys_fstat(struct asys_context *ctx, int fd, struct stat *sbuf,
+	       void *private_data);
 int asys_close(struct asys_context *ctx, int fd, void *private_data);
 
+/**
+ * @brief Create a credentials context
+ *
+ * Jobs issued with a credentials context switch the worker thread to
+ * these credentials before doing the system call. The context must
+ * stay around until all jobs using it have finished.
+ *
+ * @return		The new context, NULL with errno set on failure.
+ *			ENOSYS means the platform can't switch
+ *			credentials per thread.
+ */
 struct asys_creds_context *asys_creds_context_create(
 	struct asys_context *ctx,
 	uid_t uid, gid_t gid, unsigned num_gids, gid_t *gids);
 
 int asys_creds_context_delete(struct asys_creds_context *ctx);
 
+/*
+ * The path-based calls run on a worker thread at an unspecified time:
+ * pathname must be absolute or relative to dirfd, never relative to
+ * the current directory.
+ */
+int asys_fstatat(struct asys_context *ctx, struct asys_creds_context *cctx,
+		 int dirfd, const char *pathname, struct stat *sbuf,
+		 int flags, void *private_data);
+int asys_getxattr(struct asys_context *ctx, struct asys_creds_context *cctx,
+		  const char *path, const char *name, void *value,
+		  size_t size, void *private_data);
+
 int asys_open(struct asys_context *ctx, struct asys_creds_context *cctx,
 	      const char *pathname, int flags, mode_t mode,
 	      void *private_data);
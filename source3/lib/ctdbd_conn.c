@@ -1039,6 +1039,212 @@ int ctdbd_parse(struct ctdbd_connection *conn, uint32_t db_id,
 	return ret;
 }
 
+/*
+ * Send a CTDB_REQ_CALL for each of a set of keys before waiting for any
+ * reply, so that ctdbd can work on all of them in parallel. The replies
+ * come in any order, "reply_fn" is called with the index of the key.
+ */
+
+#define CTDBD_CALL_MULTI_BATCH 256
+
+static int ctdbd_call_multi(struct ctdbd_connection *conn, uint32_t db_id,
+			    uint32_t callid, const TDB_DATA *keys,
+			    const uint32_t *flags, size_t num_keys,
+			    int (*reply_fn)(size_t idx,
+					    struct ctdb_reply_call_old *reply,
+					    void *private_data),
+			    void *private_data)
+{
+	struct ctdb_req_call_old *reqs;
+	struct iovec *iov;
+	size_t done, num, i;
+	int ret = 0;
+
+	reqs = talloc_zero_array(talloc_tos(), struct ctdb_req_call_old,
+				 CTDBD_CALL_MULTI_BATCH);
+	if (reqs == NULL) {
+		return ENOMEM;
+	}
+	iov = talloc_array(reqs, struct iovec, CTDBD_CALL_MULTI_BATCH * 2);
+	if (iov == NULL) {
+		TALLOC_FREE(reqs);
+		return ENOMEM;
+	}
+
+	for (done = 0; done < num_keys; done += num) {
+		size_t pending;
+		ssize_t nwritten;
+
+		num = MIN(num_keys - done, CTDBD_CALL_MULTI_BATCH);
+		pending = num;
+
+		for (i=0; i<num; i++) {
+			struct ctdb_req_call_old *req = &reqs[i];
+			TDB_DATA key = keys[done + i];
+
+			ZERO_STRUCTP(req);
+
+			req->hdr.length = offsetof(struct ctdb_req_call_old,
+						   data) + key.dsize;
+			req->hdr.ctdb_magic   = CTDB_MAGIC;
+			req->hdr.ctdb_version = CTDB_PROTOCOL;
+			req->hdr.operation    = CTDB_REQ_CALL;
+			req->hdr.reqid        = ctdbd_next_reqid(conn);
+			req->flags            = flags[done + i];
+			req->callid           = callid;
+			req->db_id            = db_id;
+			req->keylen           = key.dsize;
+
+			iov[i*2].iov_base = req;
+			iov[i*2].iov_len = offsetof(struct ctdb_req_call_old,
+						    data);
+			iov[i*2+1].iov_base = key.dptr;
+			iov[i*2+1].iov_len = key.dsize;
+		}
+
+		nwritten = write_data_iov(conn->fd, iov, num * 2);
+		if (nwritten == -1) {
+			DEBUG(3, ("write_data_iov failed: %s\n",
+				  strerror(errno)));
+			cluster_fatal("cluster dispatch daemon msg write "
+				      "error\n");
+		}
+
+		while (pending > 0) {
+			struct ctdb_req_header *hdr = NULL;
+
+			ret = ctdb_read_req(conn, 0, NULL, &hdr);
+			if (ret != 0) {
+				DEBUG(10, ("ctdb_read_req failed: %s\n",
+					   strerror(ret)));
+				goto fail;
+			}
+
+			for (i=0; i<num; i++) {
+				if (reqs[i].hdr.reqid == hdr->reqid) {
+					break;
+				}
+			}
+			if (i == num) {
+				DEBUG(0, ("Discarding unexpected ctdb reqid "
+					  "%u\n", hdr->reqid));
+				TALLOC_FREE(hdr);
+				continue;
+			}
+			/* don't match a duplicate reply again */
+			reqs[i].hdr.reqid = 0;
+			pending -= 1;
+
+			if (hdr->operation != CTDB_REPLY_CALL) {
+				DEBUG(0, ("received invalid reply\n"));
+				TALLOC_FREE(hdr);
+				ret = EIO;
+				goto fail;
+			}
+
+			ret = reply_fn(done + i,
+				       (struct ctdb_reply_call_old *)hdr,
+				       private_data);
+			TALLOC_FREE(hdr);
+			if (ret != 0) {
+				goto fail;
+			}
+		}
+	}
+
+fail:
+	TALLOC_FREE(reqs);
+	return ret;
+}
+
+static int ctdbd_migrate_multi_reply(size_t idx,
+				     struct ctdb_reply_call_old *reply,
+				     void *private_data)
+{
+	return 0;
+}
+
+/*
+ * Migrate several records to us with one batch of requests
+ */
+int ctdbd_migrate_multi(struct ctdbd_connection *conn, uint32_t db_id,
+			const TDB_DATA *keys, size_t num_keys)
+{
+	uint32_t *flags;
+	size_t i;
+	int ret;
+
+	flags = talloc_array(talloc_tos(), uint32_t, num_keys);
+	if (flags == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<num_keys; i++) {
+		flags[i] = CTDB_IMMEDIATE_MIGRATION;
+	}
+
+	ret = ctdbd_call_multi(conn, db_id, CTDB_NULL_FUNC, keys, flags,
+			       num_keys, ctdbd_migrate_multi_reply, NULL);
+	TALLOC_FREE(flags);
+	return ret;
+}
+
+struct ctdbd_parse_multi_state {
+	const TDB_DATA *keys;
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+};
+
+static int ctdbd_parse_multi_reply(size_t idx,
+				   struct ctdb_reply_call_old *reply,
+				   void *private_data)
+{
+	struct ctdbd_parse_multi_state *state =
+		(struct ctdbd_parse_multi_state *)private_data;
+
+	/*
+	 * Treat an empty record as non-existing
+	 */
+	if (reply->datalen != 0) {
+		state->parser(idx, state->keys[idx],
+			      make_tdb_data(&reply->data[0], reply->datalen),
+			      state->private_data);
+	}
+	return 0;
+}
+
+/*
+ * Fetch several records with one batch of requests and parse them. The
+ * parser is not called for records that don't exist.
+ */
+int ctdbd_parse_multi(struct ctdbd_connection *conn, uint32_t db_id,
+		      const TDB_DATA *keys, const bool *local_copy,
+		      size_t num_keys,
+		      void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+				     void *private_data),
+		      void *private_data)
+{
+	struct ctdbd_parse_multi_state state = {
+		.keys = keys, .parser = parser, .private_data = private_data
+	};
+	uint32_t *flags;
+	size_t i;
+	int ret;
+
+	flags = talloc_array(talloc_tos(), uint32_t, num_keys);
+	if (flags == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<num_keys; i++) {
+		flags[i] = local_copy[i] ? CTDB_WANT_READONLY : 0;
+	}
+
+	ret = ctdbd_call_multi(conn, db_id, CTDB_FETCH_FUNC, keys, flags,
+			       num_keys, ctdbd_parse_multi_reply, &state);
+	TALLOC_FREE(flags);
+	return ret;
+}
+
 /*
   Traverse a ctdb database. This uses a kind-of hackish way to open a second
   connection to ctdbd to avoid the hairy recursive and async problems with
@@ -1313,6 +1313,209 @@ static NTSTATUS db_ctdb_parse_record(struct db_context *db, TDB_DATA key,
 	return NT_STATUS_OK;
 }
 
+struct db_ctdb_parse_multi_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+	bool *done;
+	bool *ask_for_readonly_copy;
+	size_t *remote_idx;
+};
+
+static int db_ctdb_parse_multi_local(size_t idx, TDB_DATA key, TDB_DATA data,
+				     void *private_data)
+{
+	struct db_ctdb_parse_multi_state *state =
+		(struct db_ctdb_parse_multi_state *)private_data;
+	struct ctdb_ltdb_header *header;
+
+	if (data.dsize < sizeof(struct ctdb_ltdb_header)) {
+		return 0;
+	}
+	header = (struct ctdb_ltdb_header *)data.dptr;
+
+	if (!db_ctdb_can_use_local_hdr(header, true)) {
+		/* see db_ctdb_parse_record_parser_nonpersistent() */
+		state->ask_for_readonly_copy[idx] = true;
+		return 0;
+	}
+
+	state->parser(
+		idx, key,
+		make_tdb_data(data.dptr + sizeof(struct ctdb_ltdb_header),
+			      data.dsize - sizeof(struct ctdb_ltdb_header)),
+		state->private_data);
+	state->done[idx] = true;
+	return 0;
+}
+
+static void db_ctdb_parse_multi_remote(size_t idx, TDB_DATA key,
+				       TDB_DATA data, void *private_data)
+{
+	struct db_ctdb_parse_multi_state *state =
+		(struct db_ctdb_parse_multi_state *)private_data;
+
+	state->parser(state->remote_idx[idx], key, data, state->private_data);
+}
+
+/*
+ * Parse what we have locally in one pass over the local tdb, then get
+ * the rest from ctdbd with one batch of requests.
+ */
+static NTSTATUS db_ctdb_parse_records_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data)
+{
+	struct db_ctdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_ctdb_ctx);
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct db_ctdb_parse_multi_state state;
+	TDB_DATA *remote_keys;
+	bool *remote_ro;
+	size_t i, num_remote;
+	int ret;
+
+	state.parser = parser;
+	state.private_data = private_data;
+	state.done = talloc_zero_array(frame, bool, num_keys);
+	state.ask_for_readonly_copy = talloc_zero_array(frame, bool, num_keys);
+	state.remote_idx = talloc_array(frame, size_t, num_keys);
+	remote_keys = talloc_array(frame, TDB_DATA, num_keys);
+	remote_ro = talloc_array(frame, bool, num_keys);
+
+	if ((state.done == NULL) || (state.ask_for_readonly_copy == NULL) ||
+	    (state.remote_idx == NULL) || (remote_keys == NULL) ||
+	    (remote_ro == NULL)) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	ret = tdb_parse_record_multi(ctx->wtdb->tdb, keys, num_keys,
+				     db_ctdb_parse_multi_local, &state);
+	if (ret != 0) {
+		NTSTATUS status = tdb_error_to_ntstatus(ctx->wtdb->tdb);
+		TALLOC_FREE(frame);
+		return status;
+	}
+
+	num_remote = 0;
+	for (i=0; i<num_keys; i++) {
+		if (state.done[i]) {
+			continue;
+		}
+		remote_keys[num_remote] = keys[i];
+		remote_ro[num_remote] = state.ask_for_readonly_copy[i];
+		state.remote_idx[num_remote] = i;
+		num_remote += 1;
+	}
+
+	if (num_remote == 0) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_OK;
+	}
+
+	ret = ctdbd_parse_multi(messaging_ctdbd_connection(), ctx->db_id,
+				remote_keys, remote_ro, num_remote,
+				db_ctdb_parse_multi_remote, &state);
+	TALLOC_FREE(frame);
+	if (ret != 0) {
+		return map_nt_error_from_unix(ret);
+	}
+	return NT_STATUS_OK;
+}
+
+/*
+ * Lock all chains of the records in the local tdb, and if we are not
+ * dmaster for all of them, drop the locks again and migrate the
+ * missing ones with one batch of requests. ctdbd needs the chain
+ * locks to put migrated records into the local tdb, so we can't ask
+ * for migrations while holding them. Once we have all records, the
+ * fetch_locked_internal() calls only nest the chain locks and find
+ * usable local copies.
+ */
+static NTSTATUS db_ctdb_do_locked_multi(
+	struct db_context *db, const TDB_DATA *keys, size_t num_keys,
+	void (*fn)(struct db_record **recs, size_t num_recs,
+		   void *private_data),
+	void *private_data)
+{
+	struct db_ctdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_ctdb_ctx);
+	struct tdb_context *tdb = ctx->wtdb->tdb;
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct db_record **recs;
+	TDB_DATA *migrate_keys;
+	size_t i, num_migrate;
+	int migrate_attempts = 0;
+	NTSTATUS status;
+	int ret;
+
+	recs = talloc_zero_array(frame, struct db_record *, num_keys);
+	migrate_keys = talloc_array(frame, TDB_DATA, num_keys);
+	if ((recs == NULL) || (migrate_keys == NULL)) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+again:
+	if (tdb_chainlock_multi(tdb, keys, num_keys) != 0) {
+		DEBUG(3, ("tdb_chainlock_multi failed\n"));
+		TALLOC_FREE(frame);
+		return tdb_error_to_ntstatus(tdb);
+	}
+
+	num_migrate = 0;
+	for (i=0; i<num_keys; i++) {
+		TDB_DATA ctdb_data = tdb_fetch(tdb, keys[i]);
+
+		if (!db_ctdb_can_use_local_copy(ctdb_data, false)) {
+			migrate_keys[num_migrate++] = keys[i];
+		}
+		SAFE_FREE(ctdb_data.dptr);
+	}
+
+	if (num_migrate != 0) {
+		tdb_chainunlock_multi(tdb, keys, num_keys);
+
+		migrate_attempts += 1;
+		if (migrate_attempts > ctx->warn_migrate_attempts) {
+			DEBUG(0, ("db_ctdb_do_locked_multi for %s: %u of "
+				  "%u records still not here after %d "
+				  "attempts\n", tdb_name(tdb),
+				  (unsigned)num_migrate, (unsigned)num_keys,
+				  migrate_attempts));
+		}
+
+		ret = ctdbd_migrate_multi(messaging_ctdbd_connection(),
+					  ctx->db_id, migrate_keys,
+					  num_migrate);
+		if (ret != 0) {
+			DEBUG(5, ("ctdbd_migrate_multi failed: %s\n",
+				  strerror(ret)));
+			TALLOC_FREE(frame);
+			return map_nt_error_from_unix(ret);
+		}
+		goto again;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		recs[i] = fetch_locked_internal(ctx, recs, keys[i], false);
+		if (recs[i] == NULL) {
+			status = NT_STATUS_INTERNAL_DB_ERROR;
+			goto done;
+		}
+	}
+
+	fn(recs, num_keys, private_data);
+	status = NT_STATUS_OK;
+done:
+	TALLOC_FREE(frame);
+	tdb_chainunlock_multi(tdb, keys, num_keys);
+	return status;
+}
+
 struct traverse_state {
 	struct db_context *db;
 	int (*fn)(struct db_record *rec, void *private_data);
@@ -1702,6 +1905,14 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 	result->fetch_locked = db_ctdb_fetch_locked;
 	result->try_fetch_locked = db_ctdb_try_fetch_locked;
 	result->parse_record = db_ctdb_parse_record;
+	if (!result->persistent) {
+		/*
+		 * Persistent databases go through the g_lock based
+		 * transactions, they use the generic fallbacks.
+		 */
+		result->parse_records_multi = db_ctdb_parse_records_multi;
+		result->do_locked_multi = db_ctdb_do_locked_multi;
+	}
 	result->traverse = db_ctdb_traverse;
 	result->traverse_read = db_ctdb_traverse_read;
 	result->get_seqnum = db_ctdb_get_seqnum;
@@ -97,6 +97,8 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 	if (tdb_flags & TDB_CLEAR_IF_FIRST) {
 		const char *base;
 		bool try_mutex = false;
+		bool try_seqlock = true;
+		bool try_hash_split = true;
 
 		base = strrchr_m(name, '/');
 		if (base != NULL) {
@@ -111,6 +113,58 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 		if (try_mutex && tdb_runtime_check_for_robust_mutexes()) {
 			tdb_flags |= TDB_MUTEX_LOCKING;
 		}
+
+		/*
+		 * Lockless reads of mutex tdbs for the many smbds
+		 * reading brlock.tdb, smbXsrv_*_global.tdb and friends
+		 */
+		try_seqlock = lp_parm_bool(-1, "dbwrap_tdb_seqlock_reads", "*",
+					   try_seqlock);
+		try_seqlock = lp_parm_bool(-1, "dbwrap_tdb_seqlock_reads", base,
+					   try_seqlock);
+
+		if (try_seqlock && (tdb_flags & TDB_MUTEX_LOCKING)) {
+			tdb_flags |= TDB_SEQLOCK_READS;
+		}
+
+		/*
+		 * The hash sizes of locking.tdb and friends are fixed
+		 * guesses, let the chains split as the tdbs fill up.
+		 * They are recreated on startup, so the new format
+		 * does not hurt.
+		 */
+		try_hash_split = lp_parm_bool(-1, "dbwrap_tdb_hash_split", "*",
+					      try_hash_split);
+		try_hash_split = lp_parm_bool(-1, "dbwrap_tdb_hash_split", base,
+					      try_hash_split);
+
+		if (try_hash_split) {
+			tdb_flags |= TDB_HASH_SPLIT;
+		}
+	}
+
+	{
+		const char *base;
+		bool try_statistics = false;
+
+		base = strrchr_m(name, '/');
+		if (base != NULL) {
+			base += 1;
+		} else {
+			base = name;
+		}
+
+		/*
+		 * Per chain lock waits and hot keys, see "tdbtool stats"
+		 */
+		try_statistics = lp_parm_bool(-1, "dbwrap_tdb_statistics", "*",
+					      try_statistics);
+		try_statistics = lp_parm_bool(-1, "dbwrap_tdb_statistics", base,
+					      try_statistics);
+
+		if (try_statistics) {
+			tdb_flags |= TDB_STATISTICS;
+		}
 	}
 
 	sockname = lp_ctdbd_socket();
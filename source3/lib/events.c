@@ -337,6 +337,7 @@ void dump_event_list(struct tevent_context *ev)
 	struct tevent_timer *te;
 	struct tevent_fd *fe;
 	struct timeval evt, now;
+	size_t i;
 
 	if (!ev) {
 		return;
@@ -348,6 +349,23 @@ void dump_event_list(struct tevent_context *ev)
 
 	for (te = ev->timer_events; te; te = te->next) {
 
+		if (te->heap_idx != TEVENT_TIMER_NOT_IN_HEAP) {
+			/* listed below */
+			continue;
+		}
+
+		evt = timeval_until(&now, &te->next_event);
+
+		DEBUGADD(10,("Timed Event \"%s\" %p handled in %d seconds (at %s)\n",
+			   te->handler_name,
+			   te,
+			   (int)evt.tv_sec,
+			   http_timestring(talloc_tos(), te->next_event.tv_sec)));
+	}
+
+	for (i=0; i<ev->timer_heap.num; i++) {
+
+		te = ev->timer_heap.entries[i];
 		evt = timeval_until(&now, &te->next_event);
 
 		DEBUGADD(10,("Timed Event \"%s\" %p handled in %d seconds (at %s)\n",
@@ -372,7 +390,7 @@ static const struct tevent_ops s3_event_ops = {
 	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
 	.get_fd_flags		= tevent_common_fd_get_flags,
 	.set_fd_flags		= tevent_common_fd_set_flags,
-	.add_timer		= tevent_common_add_timer,
+	.add_timer		= tevent_common_add_timer_v2,
 	.schedule_immediate	= tevent_common_schedule_immediate,
 	.add_signal		= tevent_common_add_signal,
 	.loop_once		= s3_event_loop_once,
@@ -130,7 +130,8 @@ static bool gencache_init(void)
 				      TDB_INCOMPATIBLE_HASH|
 				      TDB_SEQNUM|
 				      TDB_NOSYNC|
-				      TDB_MUTEX_LOCKING,
+				      TDB_MUTEX_LOCKING|
+				      TDB_SEQLOCK_READS,
 				      open_flags, 0644);
 	if (cache_notrans == NULL) {
 		DEBUG(5, ("Opening %s failed: %s\n", cache_fname,
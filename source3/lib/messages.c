@@ -348,6 +348,9 @@ struct messaging_context *messaging_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
+	messaging_dgm_set_ring_size(
+		lp_parm_ulong(-1, "messaging", "shm ring size", 0));
+
 	talloc_set_destructor(ctx, messaging_context_destructor);
 
 	if (lp_clustering()) {
@@ -410,6 +413,9 @@ NTSTATUS messaging_reinit(struct messaging_context *msg_ctx)
 		return map_nt_error_from_unix(ret);
 	}
 
+	messaging_dgm_set_ring_size(
+		lp_parm_ulong(-1, "messaging", "shm ring size", 0));
+
 	TALLOC_FREE(msg_ctx->remote);
 
 	if (lp_clustering()) {
@@ -579,6 +585,82 @@ NTSTATUS messaging_send_iov(struct messaging_context *msg_ctx,
 	return NT_STATUS_OK;
 }
 
+/*
+ * Send the same message to many destinations. Local destinations are
+ * handed to the dgm layer in batches, so that a notify with many
+ * watchers costs a few sendmmsg calls instead of one sendmsg each.
+ */
+#define MESSAGING_SEND_MULTI_BATCH 64
+
+int messaging_send_iov_multi(struct messaging_context *msg_ctx,
+			     uint32_t msg_type,
+			     struct messaging_send_multi_dst *dsts,
+			     size_t num_dsts,
+			     const struct iovec *iov, int iovlen)
+{
+	size_t i = 0;
+
+	if (iovlen < 0) {
+		return EINVAL;
+	}
+
+	while (i < num_dsts) {
+		uint8_t hdrs[MESSAGING_SEND_MULTI_BATCH][MESSAGE_HDR_LENGTH];
+		struct iovec iovs[MESSAGING_SEND_MULTI_BATCH][iovlen+2];
+		struct messaging_dgm_dst dgm[MESSAGING_SEND_MULTI_BATCH];
+		struct messaging_send_multi_dst *batch[
+			MESSAGING_SEND_MULTI_BATCH];
+		size_t j, num_batch = 0;
+
+		for (; (i < num_dsts) &&
+			     (num_batch < MESSAGING_SEND_MULTI_BATCH); i++) {
+			struct messaging_send_multi_dst *d = &dsts[i];
+			struct iovec *iov2 = iovs[num_batch];
+
+			iov2[0] = (struct iovec) {
+				.iov_base = hdrs[num_batch],
+				.iov_len = MESSAGE_HDR_LENGTH
+			};
+			iov2[1] = d->prefix;
+			memcpy(&iov2[2], iov, iovlen * sizeof(*iov));
+
+			if (server_id_is_disconnected(&d->dst)) {
+				d->ret = EINVAL;
+				continue;
+			}
+
+			if (!procid_is_local(&d->dst)) {
+				d->ret = messaging_send_iov_from(
+					msg_ctx, msg_ctx->id, d->dst,
+					msg_type, &iov2[1], iovlen+1,
+					NULL, 0);
+				continue;
+			}
+
+			message_hdr_put(hdrs[num_batch], msg_type,
+					msg_ctx->id, d->dst);
+
+			dgm[num_batch] = (struct messaging_dgm_dst) {
+				.pid = d->dst.pid,
+				.iov = iov2,
+				.iovlen = iovlen+2
+			};
+			batch[num_batch] = d;
+			num_batch += 1;
+		}
+
+		become_root();
+		messaging_dgm_send_multi(dgm, num_batch);
+		unbecome_root();
+
+		for (j=0; j<num_batch; j++) {
+			batch[j]->ret = dgm[j].ret;
+		}
+	}
+
+	return 0;
+}
+
 static struct messaging_rec *messaging_rec_dup(TALLOC_CTX *mem_ctx,
 					       struct messaging_rec *rec)
 {
@@ -20,6 +20,7 @@
 #include "replace.h"
 #include "system/network.h"
 #include "system/filesys.h"
+#include "system/select.h"
 #include <dirent.h>
 #include "lib/util/data_blob.h"
 #include "lib/util/debug.h"
@@ -30,6 +31,9 @@
 #include "poll_funcs/poll_funcs_tevent.h"
 #include "unix_msg/unix_msg.h"
 #include "lib/util/genrand.h"
+#include "lib/util/dlinklist.h"
+#include "lib/msghdr.h"
+#include "lib/msg_ring/msg_ring.h"
 
 struct sun_path_buf {
 	/*
@@ -55,6 +59,91 @@ struct messaging_dgm_context {
 	void *recv_cb_private_data;
 
 	bool *have_dgm_context;
+
+	/*
+	 * Optional shared memory rings to peers on this host, see
+	 * messaging_dgm_set_ring_size()
+	 */
+	size_t ring_size;
+	unsigned num_out_rings;
+	struct messaging_dgm_out_ring *out_rings;
+	struct messaging_dgm_in_ring *in_rings;
+	int ring_kick[2];
+	struct poll_watch *ring_kick_watch;
+	bool ring_kicked;
+};
+
+/*
+ * A sender sets up a ring to a peer by sending it a SETUP datagram
+ * carrying one end of a socketpair. The memfd holding the ring comes
+ * through that socketpair, unix_msg refuses to pass seekable fds. The
+ * socketpair then serves as doorbell for the receiver, as
+ * acknowledgement for the sender and to detect the death of either
+ * side.
+ *
+ * Once a ring exists, all datagrams to the peer carry a SEQ header,
+ * so the receiver can merge them with the ring in the sender's order:
+ * Messages with fds, messages that do not fit into the ring and
+ * messages sent while the ring is full still go via unix_msg.
+ */
+
+#define MESSAGING_DGM_RING_SETUP 1
+#define MESSAGING_DGM_RING_SEQ 2
+
+/*
+ * msg_type 0xffffffff does not exist, so this can't be confused with
+ * a message from messages.c
+ */
+static const uint8_t messaging_dgm_ring_magic[8] = {
+	0xff, 0xff, 0xff, 0xff, 'r', 'i', 'n', 'g'
+};
+
+struct messaging_dgm_ring_hdr {
+	uint8_t magic[8];
+	uint32_t type;
+	uint32_t seq;
+	uint64_t pid;
+};
+
+/*
+ * Don't map a ring for every process we ever talk to. The list is
+ * kept in LRU order, closed entries are reclaimed when we hit the
+ * limit.
+ */
+#define MESSAGING_DGM_MAX_OUT_RINGS 32
+
+struct messaging_dgm_out_ring {
+	struct messaging_dgm_out_ring *prev, *next;
+	struct messaging_dgm_context *ctx;
+	pid_t pid;
+	struct msg_ring *ring;
+	int sock;
+	struct poll_watch *w;
+	uint32_t seq;
+	bool acked;
+};
+
+struct messaging_dgm_in_ring {
+	struct messaging_dgm_in_ring *prev, *next;
+	struct messaging_dgm_context *ctx;
+	pid_t pid;
+	struct msg_ring *ring;
+	int sock;
+	struct poll_watch *w;
+	uint32_t next_seq;
+	struct messaging_dgm_deferred *deferred;
+	bool busy;
+	bool waiting;
+	bool closed;
+};
+
+struct messaging_dgm_deferred {
+	struct messaging_dgm_deferred *prev, *next;
+	uint32_t seq;
+	size_t num_fds;
+	int *fds;
+	size_t msg_len;
+	uint8_t msg[];
 };
 
 static struct messaging_dgm_context *global_dgm_context;
@@ -195,6 +284,7 @@ int messaging_dgm_init(struct tevent_context *ev,
 		goto fail_nomem;
 	}
 	ctx->pid = getpid();
+	ctx->ring_kick[0] = ctx->ring_kick[1] = -1;
 	ctx->recv_cb = recv_cb;
 	ctx->recv_cb_private_data = recv_cb_private_data;
 
@@ -264,6 +354,19 @@ fail_nomem:
 
 static int messaging_dgm_context_destructor(struct messaging_dgm_context *c)
 {
+	while (c->out_rings != NULL) {
+		TALLOC_FREE(c->out_rings);
+	}
+	while (c->in_rings != NULL) {
+		TALLOC_FREE(c->in_rings);
+	}
+	if (c->ring_kick_watch != NULL) {
+		c->msg_callbacks->watch_free(c->ring_kick_watch);
+		c->ring_kick_watch = NULL;
+		close(c->ring_kick[0]);
+		close(c->ring_kick[1]);
+	}
+
 	/*
 	 * First delete the socket to avoid races. The lockfile is the
 	 * indicator that we're still around.
@@ -299,6 +402,735 @@ void messaging_dgm_destroy(void)
 	TALLOC_FREE(global_dgm_context);
 }
 
+static int messaging_dgm_prep_sock(int fd)
+{
+	int flags, ret;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1) {
+		return errno;
+	}
+	ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	if (ret == -1) {
+		return errno;
+	}
+
+	flags = fcntl(fd, F_GETFD);
+	if (flags == -1) {
+		return errno;
+	}
+	ret = fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+	if (ret == -1) {
+		return errno;
+	}
+	return 0;
+}
+
+static int messaging_dgm_ring_sock_write(int sock)
+{
+	uint8_t c = 0;
+	ssize_t written;
+
+	do {
+		written = send(sock, &c, 1, MSG_DONTWAIT|MSG_NOSIGNAL);
+	} while ((written == -1) && (errno == EINTR));
+
+	if (written == -1) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			/*
+			 * Enough unread bytes in the socket, the peer
+			 * will wake up.
+			 */
+			return 0;
+		}
+		return errno;
+	}
+	return 0;
+}
+
+static int messaging_dgm_ring_send_fd(int sock, int fd)
+{
+	uint8_t c = 0;
+	struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	ssize_t fdlen = msghdr_prep_fds(NULL, NULL, 0, &fd, 1);
+	uint8_t buf[fdlen];
+	ssize_t sent;
+
+	msghdr_prep_fds(&msg, buf, fdlen, &fd, 1);
+
+	sent = sendmsg(sock, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (sent == -1) {
+		return errno;
+	}
+	return 0;
+}
+
+static int messaging_dgm_ring_recv_fd(int sock, int *pfd)
+{
+	uint8_t c;
+	struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	size_t bufsize = msghdr_prep_recv_fds(NULL, NULL, 0, 1);
+	uint8_t buf[bufsize];
+	int flags = MSG_DONTWAIT;
+	ssize_t received;
+	size_t num_fds;
+
+	msghdr_prep_recv_fds(&msg, buf, bufsize, 1);
+
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+	received = recvmsg(sock, &msg, flags);
+	if (received == -1) {
+		return errno;
+	}
+
+	num_fds = msghdr_extract_fds(&msg, NULL, 0);
+	if ((received != 1) || (num_fds != 1)) {
+		return EINVAL;
+	}
+	msghdr_extract_fds(&msg, pfd, 1);
+
+	return 0;
+}
+
+static void messaging_dgm_out_ring_close(struct messaging_dgm_out_ring *r)
+{
+	if (r->w != NULL) {
+		r->ctx->msg_callbacks->watch_free(r->w);
+		r->w = NULL;
+	}
+	msg_ring_free(r->ring);
+	r->ring = NULL;
+	if (r->sock != -1) {
+		close(r->sock);
+		r->sock = -1;
+	}
+}
+
+static int messaging_dgm_out_ring_destructor(struct messaging_dgm_out_ring *r)
+{
+	messaging_dgm_out_ring_close(r);
+	DLIST_REMOVE(r->ctx->out_rings, r);
+	r->ctx->num_out_rings -= 1;
+	return 0;
+}
+
+static void messaging_dgm_out_ring_handler(struct poll_watch *w, int fd,
+					   short events, void *private_data)
+{
+	struct messaging_dgm_out_ring *r = talloc_get_type_abort(
+		private_data, struct messaging_dgm_out_ring);
+	uint8_t c;
+	ssize_t nread;
+
+	nread = read(fd, &c, 1);
+	if (nread == 1) {
+		/*
+		 * The receiver mapped the ring
+		 */
+		r->acked = true;
+		return;
+	}
+	if ((nread == -1) && ((errno == EAGAIN) || (errno == EINTR))) {
+		return;
+	}
+
+	DEBUG(10, ("%s: ring to %u closed\n", __func__, (unsigned)r->pid));
+
+	if (r->acked) {
+		/*
+		 * The receiver used the ring and exited. Free the
+		 * slot, a new process with this pid gets a new ring.
+		 */
+		TALLOC_FREE(r);
+		return;
+	}
+
+	/*
+	 * The receiver does not want the ring. Keep the entry around
+	 * to not try again and again, messaging_dgm_out_ring_get()
+	 * reclaims it when it needs the slot.
+	 */
+	messaging_dgm_out_ring_close(r);
+}
+
+static int messaging_dgm_out_ring_setup(struct messaging_dgm_context *ctx,
+					const struct sockaddr_un *dst,
+					struct messaging_dgm_out_ring *r)
+{
+	struct messaging_dgm_ring_hdr hdr;
+	struct iovec iov;
+	int sv[2];
+	int memfd;
+	int ret;
+
+	ret = msg_ring_create(ctx->ring_size, &memfd, &r->ring);
+	if (ret != 0) {
+		return ret;
+	}
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	if (ret == -1) {
+		ret = errno;
+		close(memfd);
+		return ret;
+	}
+	r->sock = sv[0];
+
+	ret = messaging_dgm_prep_sock(sv[0]);
+	if (ret == 0) {
+		ret = messaging_dgm_prep_sock(sv[1]);
+	}
+	if (ret == 0) {
+		ret = messaging_dgm_ring_send_fd(sv[0], memfd);
+	}
+	close(memfd);
+	if (ret != 0) {
+		close(sv[1]);
+		return ret;
+	}
+
+	memcpy(hdr.magic, messaging_dgm_ring_magic, sizeof(hdr.magic));
+	hdr.type = MESSAGING_DGM_RING_SETUP;
+	hdr.seq = r->seq;
+	hdr.pid = ctx->pid;
+
+	iov = (struct iovec) { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+
+	ret = unix_msg_send(ctx->dgm_ctx, dst, &iov, 1, &sv[1], 1);
+	close(sv[1]);
+	if (ret != 0) {
+		return ret;
+	}
+
+	r->w = ctx->msg_callbacks->watch_new(
+		ctx->msg_callbacks, sv[0], POLLIN,
+		messaging_dgm_out_ring_handler, r);
+	if (r->w == NULL) {
+		return ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct messaging_dgm_out_ring *messaging_dgm_out_ring_get(
+	struct messaging_dgm_context *ctx, const struct sockaddr_un *dst,
+	pid_t pid)
+{
+	struct messaging_dgm_out_ring *r;
+	int ret;
+
+	for (r = ctx->out_rings; r != NULL; r = r->next) {
+		if (r->pid == pid) {
+			DLIST_PROMOTE(ctx->out_rings, r);
+			return r;
+		}
+	}
+
+	if (ctx->num_out_rings >= MESSAGING_DGM_MAX_OUT_RINGS) {
+		struct messaging_dgm_out_ring *prev;
+
+		/*
+		 * Reclaim the least recently used closed ring
+		 */
+		for (r = DLIST_TAIL(ctx->out_rings); r != NULL; r = prev) {
+			prev = DLIST_PREV(r);
+			if (r->ring == NULL) {
+				TALLOC_FREE(r);
+				break;
+			}
+		}
+		if (ctx->num_out_rings >= MESSAGING_DGM_MAX_OUT_RINGS) {
+			return NULL;
+		}
+	}
+
+	r = talloc(ctx, struct messaging_dgm_out_ring);
+	if (r == NULL) {
+		return NULL;
+	}
+	*r = (struct messaging_dgm_out_ring) {
+		.ctx = ctx, .pid = pid, .sock = -1
+	};
+	DLIST_ADD(ctx->out_rings, r);
+	ctx->num_out_rings += 1;
+	talloc_set_destructor(r, messaging_dgm_out_ring_destructor);
+
+	ret = messaging_dgm_out_ring_setup(ctx, dst, r);
+	if (ret != 0) {
+		DEBUG(10, ("%s: Could not set up ring to %u: %s\n", __func__,
+			   (unsigned)pid, strerror(ret)));
+		messaging_dgm_out_ring_close(r);
+	}
+
+	return r;
+}
+
+static int messaging_dgm_ring_send(struct messaging_dgm_context *ctx,
+				   const struct sockaddr_un *dst, pid_t pid,
+				   const struct iovec *iov, int iovlen,
+				   const int *fds, size_t num_fds)
+{
+	struct messaging_dgm_out_ring *r;
+	struct messaging_dgm_ring_hdr hdr;
+	struct iovec iov2[iovlen+1];
+	int ret;
+
+	r = messaging_dgm_out_ring_get(ctx, dst, pid);
+	if ((r == NULL) || (r->ring == NULL)) {
+		return unix_msg_send(ctx->dgm_ctx, dst, iov, iovlen,
+				     fds, num_fds);
+	}
+
+	if (r->acked && (num_fds == 0)) {
+		bool wakeup;
+
+		ret = msg_ring_put(r->ring, r->seq, iov, iovlen, &wakeup);
+		if (ret == 0) {
+			r->seq += 1;
+
+			if (!wakeup) {
+				return 0;
+			}
+			ret = messaging_dgm_ring_sock_write(r->sock);
+			if (ret == 0) {
+				return 0;
+			}
+
+			/*
+			 * Nobody will read the ring anymore, the
+			 * receiver closed its end.
+			 */
+			DEBUG(10, ("%s: doorbell to %u failed: %s\n",
+				   __func__, (unsigned)pid, strerror(ret)));
+			TALLOC_FREE(r);
+			return unix_msg_send(ctx->dgm_ctx, dst, iov, iovlen,
+					     fds, num_fds);
+		}
+	}
+
+	/*
+	 * Not acked yet, fds, ring full or message too large
+	 */
+
+	memcpy(hdr.magic, messaging_dgm_ring_magic, sizeof(hdr.magic));
+	hdr.type = MESSAGING_DGM_RING_SEQ;
+	hdr.seq = r->seq;
+	hdr.pid = ctx->pid;
+
+	iov2[0] = (struct iovec) { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+	memcpy(&iov2[1], iov, sizeof(struct iovec) * iovlen);
+
+	ret = unix_msg_send(ctx->dgm_ctx, dst, iov2, iovlen+1, fds, num_fds);
+	if (ret == 0) {
+		r->seq += 1;
+	}
+	return ret;
+}
+
+static int messaging_dgm_deferred_destructor(
+	struct messaging_dgm_deferred *d)
+{
+	size_t i;
+
+	for (i=0; i<d->num_fds; i++) {
+		if (d->fds[i] != -1) {
+			close(d->fds[i]);
+		}
+	}
+	return 0;
+}
+
+static int messaging_dgm_in_ring_destructor(struct messaging_dgm_in_ring *r)
+{
+	if (r->w != NULL) {
+		r->ctx->msg_callbacks->watch_free(r->w);
+		r->w = NULL;
+	}
+	msg_ring_free(r->ring);
+	if (r->sock != -1) {
+		close(r->sock);
+	}
+	DLIST_REMOVE(r->ctx->in_rings, r);
+	return 0;
+}
+
+static struct messaging_dgm_in_ring *messaging_dgm_in_ring_find(
+	struct messaging_dgm_context *ctx, pid_t pid)
+{
+	struct messaging_dgm_in_ring *r;
+
+	for (r = ctx->in_rings; r != NULL; r = r->next) {
+		if ((r->pid == pid) && !r->closed) {
+			return r;
+		}
+	}
+	return NULL;
+}
+
+static void messaging_dgm_ring_kick(struct messaging_dgm_context *ctx)
+{
+	if (ctx->ring_kicked) {
+		return;
+	}
+	ctx->ring_kicked = (messaging_dgm_ring_sock_write(
+				    ctx->ring_kick[1]) == 0);
+}
+
+enum messaging_dgm_deliver {
+	MESSAGING_DGM_DELIVERED,
+	MESSAGING_DGM_EMPTY,
+	MESSAGING_DGM_WAITING
+};
+
+/*
+ * Deliver the next message from a peer, merging its ring and its
+ * datagrams in the sender's order.
+ */
+static enum messaging_dgm_deliver messaging_dgm_in_ring_deliver(
+	struct messaging_dgm_in_ring *r)
+{
+	struct messaging_dgm_context *ctx = r->ctx;
+	struct messaging_dgm_deferred *d = r->deferred;
+	const uint8_t *msg = NULL;
+	size_t msg_len = 0;
+	uint32_t seq = 0;
+	int ret = ENOENT;
+
+	if (r->ring != NULL) {
+		ret = msg_ring_peek(r->ring, &seq, &msg, &msg_len);
+	}
+	if ((ret != 0) && (ret != ENOENT)) {
+		DEBUG(1, ("%s: Invalid ring from %u: %s\n", __func__,
+			  (unsigned)r->pid, strerror(ret)));
+		r->closed = true;
+		msg_ring_free(r->ring);
+		r->ring = NULL;
+	}
+
+	if ((ret == 0) && ((d == NULL) || ((int32_t)(seq - d->seq) < 0))) {
+
+		if ((d == NULL) && (seq != r->next_seq) && !r->closed) {
+			/*
+			 * A datagram is still on its way
+			 */
+			return MESSAGING_DGM_WAITING;
+		}
+
+		r->next_seq = seq + 1;
+
+		r->busy = true;
+		ctx->recv_cb(msg, msg_len, NULL, 0,
+			     ctx->recv_cb_private_data);
+		r->busy = false;
+
+		msg_ring_consume(r->ring);
+		return MESSAGING_DGM_DELIVERED;
+	}
+
+	if (d != NULL) {
+		DLIST_REMOVE(r->deferred, d);
+		r->next_seq = d->seq + 1;
+
+		ctx->recv_cb(d->msg, d->msg_len, d->fds, d->num_fds,
+			     ctx->recv_cb_private_data);
+		TALLOC_FREE(d);
+		return MESSAGING_DGM_DELIVERED;
+	}
+
+	return MESSAGING_DGM_EMPTY;
+}
+
+/*
+ * Hand out one message per event loop round, just like unix_msg
+ * does. messaging_read_send() callers re-arm from a deferred
+ * callback and would miss a burst of messages. The kick socket stays
+ * readable as long as there is work left.
+ */
+static void messaging_dgm_ring_kick_handler(struct poll_watch *w, int fd,
+					    short events, void *private_data)
+{
+	struct messaging_dgm_context *ctx = talloc_get_type_abort(
+		private_data, struct messaging_dgm_context);
+	struct messaging_dgm_in_ring *r, *next;
+	uint8_t buf[16];
+
+	for (r = ctx->in_rings; r != NULL; r = r->next) {
+		enum messaging_dgm_deliver ret;
+
+		if (r->busy) {
+			continue;
+		}
+
+		ret = messaging_dgm_in_ring_deliver(r);
+		r->waiting = (ret == MESSAGING_DGM_WAITING);
+
+		if (ret == MESSAGING_DGM_DELIVERED) {
+			/*
+			 * A nested event loop might have cleared the
+			 * kick
+			 */
+			DLIST_DEMOTE(ctx->in_rings, r);
+			messaging_dgm_ring_kick(ctx);
+			return;
+		}
+	}
+
+	(void)read(fd, buf, sizeof(buf));
+	ctx->ring_kicked = false;
+
+	for (r = ctx->in_rings; r != NULL; r = next) {
+		next = r->next;
+
+		if (r->busy || r->waiting) {
+			continue;
+		}
+		if (r->closed) {
+			if (r->deferred == NULL) {
+				TALLOC_FREE(r);
+			}
+			continue;
+		}
+		if (!msg_ring_prepare_sleep(r->ring)) {
+			messaging_dgm_ring_kick(ctx);
+		}
+	}
+}
+
+static int messaging_dgm_ring_kick_init(struct messaging_dgm_context *ctx)
+{
+	int ret;
+
+	if (ctx->ring_kick_watch != NULL) {
+		return 0;
+	}
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, ctx->ring_kick);
+	if (ret == -1) {
+		return errno;
+	}
+
+	ret = messaging_dgm_prep_sock(ctx->ring_kick[0]);
+	if (ret == 0) {
+		ret = messaging_dgm_prep_sock(ctx->ring_kick[1]);
+	}
+	if (ret != 0) {
+		goto fail;
+	}
+
+	ctx->ring_kick_watch = ctx->msg_callbacks->watch_new(
+		ctx->msg_callbacks, ctx->ring_kick[0], POLLIN,
+		messaging_dgm_ring_kick_handler, ctx);
+	if (ctx->ring_kick_watch == NULL) {
+		ret = ENOMEM;
+		goto fail;
+	}
+	return 0;
+
+fail:
+	close(ctx->ring_kick[0]);
+	close(ctx->ring_kick[1]);
+	ctx->ring_kick[0] = ctx->ring_kick[1] = -1;
+	return ret;
+}
+
+static void messaging_dgm_in_ring_handler(struct poll_watch *w, int fd,
+					  short events, void *private_data)
+{
+	struct messaging_dgm_in_ring *r = talloc_get_type_abort(
+		private_data, struct messaging_dgm_in_ring);
+	uint8_t buf[64];
+	ssize_t nread;
+
+	nread = read(fd, buf, sizeof(buf));
+	if ((nread == 0) ||
+	    ((nread == -1) && (errno != EAGAIN) && (errno != EINTR))) {
+		/*
+		 * The sender is gone, pick up what it left behind
+		 */
+		r->closed = true;
+		r->ctx->msg_callbacks->watch_free(r->w);
+		r->w = NULL;
+	}
+
+	/*
+	 * No more doorbells while we're busy with the ring
+	 */
+	if (r->ring != NULL) {
+		msg_ring_wakeup(r->ring);
+	}
+	messaging_dgm_ring_kick(r->ctx);
+}
+
+static void messaging_dgm_in_ring_setup(
+	struct messaging_dgm_context *ctx,
+	const struct messaging_dgm_ring_hdr *hdr,
+	int *fds, size_t num_fds)
+{
+	struct messaging_dgm_in_ring *r;
+	struct msg_ring *ring;
+	int sock, memfd, ret;
+
+	if (num_fds != 1) {
+		DEBUG(1, ("%s: Got %u fds\n", __func__, (unsigned)num_fds));
+		return;
+	}
+	sock = fds[0];
+	fds[0] = -1;
+
+	ret = messaging_dgm_ring_kick_init(ctx);
+	if (ret != 0) {
+		DEBUG(1, ("%s: messaging_dgm_ring_kick_init failed: %s\n",
+			  __func__, strerror(ret)));
+		close(sock);
+		return;
+	}
+
+	ret = messaging_dgm_ring_recv_fd(sock, &memfd);
+	if (ret != 0) {
+		DEBUG(1, ("%s: Could not receive ring from %u: %s\n",
+			  __func__, (unsigned)hdr->pid, strerror(ret)));
+		close(sock);
+		return;
+	}
+
+	ret = msg_ring_attach(memfd, &ring);
+	close(memfd);
+	if (ret != 0) {
+		DEBUG(1, ("%s: Could not map ring from %u: %s\n",
+			  __func__, (unsigned)hdr->pid, strerror(ret)));
+		close(sock);
+		return;
+	}
+
+	/*
+	 * The sender started over, let the old ring drain
+	 */
+	r = messaging_dgm_in_ring_find(ctx, hdr->pid);
+	if (r != NULL) {
+		r->closed = true;
+		messaging_dgm_ring_kick(ctx);
+	}
+
+	r = talloc(ctx, struct messaging_dgm_in_ring);
+	if (r == NULL) {
+		msg_ring_free(ring);
+		close(sock);
+		return;
+	}
+	*r = (struct messaging_dgm_in_ring) {
+		.ctx = ctx, .pid = hdr->pid, .ring = ring, .sock = sock,
+		.next_seq = hdr->seq
+	};
+	DLIST_ADD_END(ctx->in_rings, r);
+	talloc_set_destructor(r, messaging_dgm_in_ring_destructor);
+
+	ret = messaging_dgm_prep_sock(sock);
+	if (ret != 0) {
+		TALLOC_FREE(r);
+		return;
+	}
+
+	r->w = ctx->msg_callbacks->watch_new(
+		ctx->msg_callbacks, sock, POLLIN,
+		messaging_dgm_in_ring_handler, r);
+	if (r->w == NULL) {
+		TALLOC_FREE(r);
+		return;
+	}
+
+	/*
+	 * Announce that we wait for the doorbell before telling the
+	 * sender to use the ring.
+	 */
+	msg_ring_prepare_sleep(r->ring);
+
+	ret = messaging_dgm_ring_sock_write(sock);
+	if (ret != 0) {
+		TALLOC_FREE(r);
+		return;
+	}
+}
+
+static void messaging_dgm_ring_recv(struct messaging_dgm_context *ctx,
+				    const struct messaging_dgm_ring_hdr *hdr,
+				    uint8_t *msg, size_t msg_len,
+				    int *fds, size_t num_fds)
+{
+	struct messaging_dgm_in_ring *r;
+	struct messaging_dgm_deferred *d;
+	size_t i;
+
+	if (hdr->type == MESSAGING_DGM_RING_SETUP) {
+		messaging_dgm_in_ring_setup(ctx, hdr, fds, num_fds);
+		goto close_fds;
+	}
+
+	if (hdr->type != MESSAGING_DGM_RING_SEQ) {
+		DEBUG(1, ("%s: Unknown type %u\n", __func__,
+			  (unsigned)hdr->type));
+		goto close_fds;
+	}
+
+	r = messaging_dgm_in_ring_find(ctx, hdr->pid);
+	if (r == NULL) {
+		ctx->recv_cb(msg, msg_len, fds, num_fds,
+			     ctx->recv_cb_private_data);
+		return;
+	}
+
+	/*
+	 * Queue behind the ring messages sent before this one
+	 */
+
+	d = talloc_size(r, offsetof(struct messaging_dgm_deferred, msg) +
+			msg_len);
+	if (d == NULL) {
+		goto close_fds;
+	}
+	talloc_set_name_const(d, "struct messaging_dgm_deferred");
+
+	d->seq = hdr->seq;
+	d->msg_len = msg_len;
+	memcpy(d->msg, msg, msg_len);
+	d->num_fds = 0;
+	d->fds = talloc_memdup(d, fds, sizeof(int) * num_fds);
+	if ((num_fds != 0) && (d->fds == NULL)) {
+		TALLOC_FREE(d);
+		goto close_fds;
+	}
+	d->num_fds = num_fds;
+	for (i=0; i<num_fds; i++) {
+		fds[i] = -1;
+	}
+	talloc_set_destructor(d, messaging_dgm_deferred_destructor);
+
+	DLIST_ADD_END(r->deferred, d);
+	messaging_dgm_ring_kick(ctx);
+	return;
+
+close_fds:
+	for (i=0; i<num_fds; i++) {
+		if (fds[i] != -1) {
+			close(fds[i]);
+		}
+	}
+}
+
+void messaging_dgm_set_ring_size(size_t ring_size)
+{
+	struct messaging_dgm_context *ctx = global_dgm_context;
+
+	if (ctx == NULL) {
+		return;
+	}
+	ctx->ring_size = ring_size;
+}
+
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
 		       const int *fds, size_t num_fds)
@@ -322,11 +1154,101 @@ int messaging_dgm_send(pid_t pid,
 
 	DEBUG(10, ("%s: Sending message to %u\n", __func__, (unsigned)pid));
 
+	if ((ctx->ring_size != 0) && (getpid() == ctx->pid) &&
+	    (pid != ctx->pid)) {
+		return messaging_dgm_ring_send(ctx, &dst, pid, iov, iovlen,
+					       fds, num_fds);
+	}
+
 	ret = unix_msg_send(ctx->dgm_ctx, &dst, iov, iovlen, fds, num_fds);
 
 	return ret;
 }
 
+/*
+ * Don't put more than this on the stack in messaging_dgm_send_multi()
+ */
+#define MESSAGING_DGM_MULTI_BATCH 64
+
+static bool messaging_dgm_ring_wanted(struct messaging_dgm_context *ctx,
+				      pid_t pid)
+{
+	struct messaging_dgm_out_ring *r;
+
+	if ((ctx->ring_size == 0) || (getpid() != ctx->pid) ||
+	    (pid == ctx->pid)) {
+		return false;
+	}
+
+	for (r = ctx->out_rings; r != NULL; r = r->next) {
+		if (r->pid == pid) {
+			return (r->ring != NULL);
+		}
+	}
+
+	return (ctx->num_out_rings < MESSAGING_DGM_MAX_OUT_RINGS);
+}
+
+void messaging_dgm_send_multi(struct messaging_dgm_dst *dsts,
+			      size_t num_dsts)
+{
+	struct messaging_dgm_context *ctx = global_dgm_context;
+	size_t i = 0;
+
+	if (ctx == NULL) {
+		for (i=0; i<num_dsts; i++) {
+			dsts[i].ret = ENOTCONN;
+		}
+		return;
+	}
+
+	while (i < num_dsts) {
+		struct sockaddr_un addrs[MESSAGING_DGM_MULTI_BATCH];
+		struct unix_msg_dst udsts[MESSAGING_DGM_MULTI_BATCH];
+		struct messaging_dgm_dst *batch[MESSAGING_DGM_MULTI_BATCH];
+		size_t j, num_batch = 0;
+
+		for (; (i < num_dsts) &&
+			     (num_batch < MESSAGING_DGM_MULTI_BATCH); i++) {
+			struct messaging_dgm_dst *d = &dsts[i];
+			struct sockaddr_un *addr = &addrs[num_batch];
+			ssize_t pathlen;
+
+			if (messaging_dgm_ring_wanted(ctx, d->pid)) {
+				d->ret = messaging_dgm_send(
+					d->pid, d->iov, d->iovlen, NULL, 0);
+				continue;
+			}
+
+			*addr = (struct sockaddr_un) { .sun_family = AF_UNIX };
+
+			pathlen = snprintf(addr->sun_path,
+					   sizeof(addr->sun_path), "%s/%u",
+					   ctx->socket_dir.buf,
+					   (unsigned)d->pid);
+			if (pathlen >= sizeof(addr->sun_path)) {
+				d->ret = ENAMETOOLONG;
+				continue;
+			}
+
+			udsts[num_batch] = (struct unix_msg_dst) {
+				.dst = addr, .iov = d->iov, .iovlen = d->iovlen
+			};
+			batch[num_batch] = d;
+			num_batch += 1;
+		}
+
+		DEBUG(10, ("%s: Sending %u messages\n", __func__,
+			   (unsigned)num_batch));
+
+		unix_msg_send_multi(ctx->dgm_ctx, udsts, num_batch);
+
+		for (j=0; j<num_batch; j++) {
+			batch[j]->ret = udsts[j].ret;
+		}
+	}
+}
+
 static void messaging_dgm_recv(struct unix_msg_ctx *ctx,
 			       uint8_t *msg, size_t msg_len,
 			       int *fds, size_t num_fds,
@@ -335,6 +1257,17 @@ static void messaging_dgm_recv(struct unix_msg_ctx *ctx,
 	struct messaging_dgm_context *dgm_ctx = talloc_get_type_abort(
 		private_data, struct messaging_dgm_context);
 
+	if ((msg_len >= sizeof(struct messaging_dgm_ring_hdr)) &&
+	    (memcmp(msg, messaging_dgm_ring_magic,
+		    sizeof(messaging_dgm_ring_magic)) == 0)) {
+		struct messaging_dgm_ring_hdr hdr;
+
+		memcpy(&hdr, msg, sizeof(hdr));
+		messaging_dgm_ring_recv(dgm_ctx, &hdr, msg + sizeof(hdr),
+					msg_len - sizeof(hdr), fds, num_fds);
+		return;
+	}
+
 	dgm_ctx->recv_cb(msg, msg_len, fds, num_fds,
 			 dgm_ctx->recv_cb_private_data);
 }
@@ -403,6 +1336,7 @@ int messaging_dgm_cleanup(pid_t pid)
 {
 	struct messaging_dgm_context *ctx = global_dgm_context;
 	struct sun_path_buf lockfile_name, socket_name;
+	struct messaging_dgm_out_ring *r;
 	int fd, len, ret;
 	struct flock lck = {};
 
@@ -450,6 +1384,13 @@ int messaging_dgm_cleanup(pid_t pid)
 
 	DEBUG(10, ("%s: Cleaning up : %s\n", __func__, strerror(ret)));
 
+	for (r = ctx->out_rings; r != NULL; r = r->next) {
+		if (r->pid == pid) {
+			TALLOC_FREE(r);
+			break;
+		}
+	}
+
 	(void)unlink(socket_name.buf);
 	(void)unlink(lockfile_name.buf);
 	(void)close(fd);
@@ -39,7 +39,18 @@ int messaging_dgm_get_unique(pid_t pid, uint64_t *unique);
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
 		       const int *fds, size_t num_fds);
+
+struct messaging_dgm_dst {
+	pid_t pid;
+	const struct iovec *iov;
+	int iovlen;
+	int ret;
+};
+void messaging_dgm_send_multi(struct messaging_dgm_dst *dsts,
+			      size_t num_dsts);
+
 int messaging_dgm_cleanup(pid_t pid);
+void messaging_dgm_set_ring_size(size_t ring_size);
 int messaging_dgm_wipe(void);
 void *messaging_dgm_register_tevent_context(TALLOC_CTX *mem_ctx,
 					    struct tevent_context *ev);
@@ -0,0 +1,374 @@
+/*
+ * Single producer, single consumer message ring in shared memory
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "msg_ring.h"
+#include "lib/util/iov_buf.h"
+
+#ifdef HAVE_MSG_RING
+
+#include <sys/mman.h>
+
+#define MSG_RING_MAGIC 0x6d736772 /* "msgr" */
+
+#define msg_ring_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define msg_ring_store_release(p, v) \
+	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define msg_ring_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/*
+ * The producer only writes "head", the consumer only writes "tail"
+ * and "sleeping". Keep them on separate cache lines.
+ */
+struct msg_ring_shared {
+	uint32_t magic;
+	uint32_t size;
+	uint8_t pad1[56];
+	uint64_t head;
+	uint8_t pad2[56];
+	uint64_t tail;
+	uint32_t sleeping;
+	uint8_t pad3[52];
+	uint8_t data[];
+};
+
+/*
+ * Every message is preceded by this header. Records are 8 byte
+ * aligned, so the header itself never wraps around the end of the
+ * data area, the message might.
+ */
+struct msg_ring_rec {
+	uint32_t len;
+	uint32_t seq;
+};
+
+#define MSG_RING_ALIGN(x) (((x)+7) & ~(size_t)7)
+
+struct msg_ring {
+	struct msg_ring_shared *shared;
+	size_t map_size;
+
+	/*
+	 * Our own copies, the other side could scribble over the
+	 * shared ones.
+	 */
+	uint32_t size;
+	uint64_t head;
+	uint64_t tail;
+
+	/* The consumer's tail after the message it looked at */
+	uint64_t peeked;
+
+	size_t max_msg;
+	uint8_t *bounce;
+};
+
+static struct msg_ring *msg_ring_new(struct msg_ring_shared *shared,
+				     size_t map_size, uint32_t size)
+{
+	struct msg_ring *ring;
+
+	ring = calloc(1, sizeof(struct msg_ring));
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->shared = shared;
+	ring->map_size = map_size;
+	ring->size = size;
+	ring->max_msg = size / 4;
+
+	return ring;
+}
+
+int msg_ring_create(size_t size, int *pfd, struct msg_ring **pring)
+{
+	struct msg_ring *ring;
+	struct msg_ring_shared *shared;
+	size_t map_size;
+	uint32_t ring_size = 4096;
+	int fd, ret;
+
+	while (ring_size < size) {
+		if (ring_size >= (1U<<30)) {
+			return EINVAL;
+		}
+		ring_size <<= 1;
+	}
+	map_size = sizeof(struct msg_ring_shared) + ring_size;
+
+	fd = memfd_create("msg_ring", MFD_CLOEXEC);
+	if (fd == -1) {
+		return errno;
+	}
+
+	ret = ftruncate(fd, map_size);
+	if (ret == -1) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+
+	shared = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	if (shared == MAP_FAILED) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+
+	shared->magic = MSG_RING_MAGIC;
+	shared->size = ring_size;
+
+	ring = msg_ring_new(shared, map_size, ring_size);
+	if (ring == NULL) {
+		munmap(shared, map_size);
+		close(fd);
+		return ENOMEM;
+	}
+
+	*pfd = fd;
+	*pring = ring;
+	return 0;
+}
+
+int msg_ring_attach(int fd, struct msg_ring **pring)
+{
+	struct msg_ring *ring;
+	struct msg_ring_shared *shared;
+	struct stat st;
+	uint32_t size;
+	int ret;
+
+	ret = fstat(fd, &st);
+	if (ret == -1) {
+		return errno;
+	}
+	if ((st.st_size < sizeof(struct msg_ring_shared)) ||
+	    (st.st_size > sizeof(struct msg_ring_shared) + (1U<<30))) {
+		return EINVAL;
+	}
+
+	shared = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	if (shared == MAP_FAILED) {
+		return errno;
+	}
+
+	size = shared->size;
+
+	if ((shared->magic != MSG_RING_MAGIC) ||
+	    (size < 4096) || ((size & (size-1)) != 0) ||
+	    (sizeof(struct msg_ring_shared) + size != st.st_size)) {
+		munmap(shared, st.st_size);
+		return EINVAL;
+	}
+
+	ring = msg_ring_new(shared, st.st_size, size);
+	if (ring == NULL) {
+		munmap(shared, st.st_size);
+		return ENOMEM;
+	}
+
+	ring->bounce = malloc(ring->max_msg);
+	if (ring->bounce == NULL) {
+		msg_ring_free(ring);
+		return ENOMEM;
+	}
+
+	ring->tail = msg_ring_load_acquire(&shared->tail);
+	ring->peeked = ring->tail;
+
+	*pring = ring;
+	return 0;
+}
+
+void msg_ring_free(struct msg_ring *ring)
+{
+	if (ring == NULL) {
+		return;
+	}
+	munmap(ring->shared, ring->map_size);
+	free(ring->bounce);
+	free(ring);
+}
+
+int msg_ring_put(struct msg_ring *ring, uint32_t seq,
+		 const struct iovec *iov, int iovlen, bool *wakeup)
+{
+	struct msg_ring_shared *shared = ring->shared;
+	uint32_t mask = ring->size - 1;
+	struct msg_ring_rec rec;
+	uint64_t tail, pos;
+	ssize_t len;
+	size_t rec_len;
+	int i;
+
+	len = iov_buflen(iov, iovlen);
+	if ((len == -1) || (len > ring->max_msg)) {
+		return EMSGSIZE;
+	}
+	rec_len = sizeof(rec) + MSG_RING_ALIGN(len);
+
+	tail = msg_ring_load_acquire(&shared->tail);
+	if (rec_len > ring->size - (ring->head - tail)) {
+		return ENOSPC;
+	}
+
+	rec = (struct msg_ring_rec) { .len = len, .seq = seq };
+	memcpy(&shared->data[ring->head & mask], &rec, sizeof(rec));
+
+	pos = ring->head + sizeof(rec);
+
+	for (i=0; i<iovlen; i++) {
+		const uint8_t *buf = (const uint8_t *)iov[i].iov_base;
+		size_t buflen = iov[i].iov_len;
+
+		while (buflen > 0) {
+			size_t ofs = pos & mask;
+			size_t thislen = MIN(buflen, ring->size - ofs);
+
+			memcpy(&shared->data[ofs], buf, thislen);
+			buf += thislen;
+			buflen -= thislen;
+			pos += thislen;
+		}
+	}
+
+	ring->head += rec_len;
+	msg_ring_store_release(&shared->head, ring->head);
+
+	/*
+	 * Pairs with the fence in msg_ring_prepare_sleep(): Either the
+	 * consumer sees our head, or we see it sleeping.
+	 */
+	msg_ring_fence();
+	*wakeup = (__atomic_load_n(&shared->sleeping, __ATOMIC_RELAXED) != 0);
+
+	return 0;
+}
+
+int msg_ring_peek(struct msg_ring *ring, uint32_t *seq,
+		  const uint8_t **msg, size_t *msg_len)
+{
+	struct msg_ring_shared *shared = ring->shared;
+	uint32_t mask = ring->size - 1;
+	struct msg_ring_rec rec;
+	uint64_t head, avail;
+	size_t rec_len, ofs, first;
+
+	head = msg_ring_load_acquire(&shared->head);
+	if (head == ring->tail) {
+		return ENOENT;
+	}
+
+	avail = head - ring->tail;
+	if ((avail > ring->size) || (avail < sizeof(rec))) {
+		return EINVAL;
+	}
+
+	memcpy(&rec, &shared->data[ring->tail & mask], sizeof(rec));
+
+	rec_len = sizeof(rec) + MSG_RING_ALIGN(rec.len);
+	if ((rec.len > ring->max_msg) || (rec_len > avail)) {
+		return EINVAL;
+	}
+
+	/*
+	 * Always copy: The producer can still write into the mapping,
+	 * the message we hand out must not change under our callers'
+	 * feet after we checked it.
+	 */
+	ofs = (ring->tail + sizeof(rec)) & mask;
+	first = MIN(rec.len, ring->size - ofs);
+
+	memcpy(ring->bounce, &shared->data[ofs], first);
+	memcpy(ring->bounce + first, &shared->data[0], rec.len - first);
+
+	*msg = ring->bounce;
+	*seq = rec.seq;
+	*msg_len = rec.len;
+	ring->peeked = ring->tail + rec_len;
+
+	return 0;
+}
+
+void msg_ring_consume(struct msg_ring *ring)
+{
+	ring->tail = ring->peeked;
+	msg_ring_store_release(&ring->shared->tail, ring->tail);
+}
+
+bool msg_ring_prepare_sleep(struct msg_ring *ring)
+{
+	struct msg_ring_shared *shared = ring->shared;
+
+	__atomic_store_n(&shared->sleeping, 1, __ATOMIC_RELAXED);
+	msg_ring_fence();
+
+	if (msg_ring_load_acquire(&shared->head) != ring->tail) {
+		__atomic_store_n(&shared->sleeping, 0, __ATOMIC_RELAXED);
+		return false;
+	}
+	return true;
+}
+
+void msg_ring_wakeup(struct msg_ring *ring)
+{
+	__atomic_store_n(&ring->shared->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+#else /* HAVE_MSG_RING */
+
+int msg_ring_create(size_t size, int *pfd, struct msg_ring **pring)
+{
+	return ENOSYS;
+}
+
+int msg_ring_attach(int fd, struct msg_ring **pring)
+{
+	return ENOSYS;
+}
+
+void msg_ring_free(struct msg_ring *ring)
+{
+}
+
+int msg_ring_put(struct msg_ring *ring, uint32_t seq,
+		 const struct iovec *iov, int iovlen, bool *wakeup)
+{
+	return ENOSYS;
+}
+
+int msg_ring_peek(struct msg_ring *ring, uint32_t *seq,
+		  const uint8_t **msg, size_t *msg_len)
+{
+	return ENOSYS;
+}
+
+void msg_ring_consume(struct msg_ring *ring)
+{
+}
+
+bool msg_ring_prepare_sleep(struct msg_ring *ring)
+{
+	return true;
+}
+
+void msg_ring_wakeup(struct msg_ring *ring)
+{
+}
+
+#endif /* HAVE_MSG_RING */
@@ -0,0 +1,118 @@
+/*
+ * Single producer, single consumer message ring in shared memory
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MSG_RING_H__
+#define __MSG_RING_H__
+
+#include "replace.h"
+#include "system/filesys.h"
+
+/**
+ * @defgroup msg_ring Shared memory message ring
+ *
+ * A msg_ring moves messages from exactly one producer process to
+ * exactly one consumer process through a memfd mapped by both. Putting
+ * a message into the ring and taking it out are plain memory copies,
+ * no system call is involved.
+ *
+ * The producer creates the ring with msg_ring_create() and hands the
+ * returned fd to the consumer, which maps it with msg_ring_attach().
+ *
+ * Waking up the consumer is up to the caller: msg_ring_put() tells the
+ * producer whether the consumer announced with msg_ring_prepare_sleep()
+ * that it is about to wait for a wakeup. Only then a doorbell needs to
+ * be rung.
+ *
+ * @{
+ */
+
+struct msg_ring;
+
+/**
+ * @brief Create a ring as the producer
+ *
+ * @param[in]	size	The size of the data area, rounded up to a
+ *			power of two.
+ * @param[out]	pfd	The memfd to pass to the consumer, the caller
+ *			has to close it.
+ * @param[out]	pring	The new ring
+ * @return		0 on success, an errno otherwise. ENOSYS means
+ *			the platform does not support rings.
+ */
+int msg_ring_create(size_t size, int *pfd, struct msg_ring **pring);
+
+/**
+ * @brief Map a ring as the consumer
+ *
+ * @param[in]	fd	The memfd from msg_ring_create(). It is not
+ *			needed after msg_ring_attach() returns.
+ * @param[out]	pring	The new ring
+ * @return		0 on success, an errno otherwise
+ */
+int msg_ring_attach(int fd, struct msg_ring **pring);
+
+void msg_ring_free(struct msg_ring *ring);
+
+/**
+ * @brief Put a message into the ring
+ *
+ * @param[in]	ring	The ring
+ * @param[in]	seq	A sequence number passed to the consumer
+ * @param[in]	iov	The message
+ * @param[in]	iovlen	The number of iov structs
+ * @param[out]	wakeup	Set to true if the consumer waits for a wakeup
+ * @return		0 on success, ENOSPC if the ring is too full,
+ *			EMSGSIZE if the message will never fit.
+ */
+int msg_ring_put(struct msg_ring *ring, uint32_t seq,
+		 const struct iovec *iov, int iovlen, bool *wakeup);
+
+/**
+ * @brief Look at the oldest message in the ring
+ *
+ * The message is copied out of the shared mapping into a buffer owned
+ * by the ring, so the producer can't change it. It stays valid until
+ * the next msg_ring_peek() or msg_ring_free() call.
+ *
+ * @return		0 on success, ENOENT if the ring is empty,
+ *			EINVAL if the producer wrote garbage.
+ */
+int msg_ring_peek(struct msg_ring *ring, uint32_t *seq,
+		  const uint8_t **msg, size_t *msg_len);
+
+/**
+ * @brief Remove the message returned by msg_ring_peek()
+ */
+void msg_ring_consume(struct msg_ring *ring);
+
+/**
+ * @brief Announce that the consumer is going to wait for a wakeup
+ *
+ * @return		true if the ring is still empty and the consumer
+ *			may wait, false if it has to look again.
+ */
+bool msg_ring_prepare_sleep(struct msg_ring *ring);
+
+/**
+ * @brief The consumer is awake again, the producer does not need to
+ *	  ring the doorbell.
+ */
+void msg_ring_wakeup(struct msg_ring *ring);
+
+/* @} */
+
+#endif /* __MSG_RING_H__ */
@@ -30,15 +30,50 @@
 #include "system/filesys.h"
 #include "replace.h"
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #include "pthreadpool.h"
 #include "lib/util/dlinklist.h"
 
+/*
+ * Jobs are queued in per-worker queues. A worker takes jobs from its
+ * own queue first and steals from the others when that is empty,
+ * PTHREADPOOL_PRIO_HIGH jobs from any queue before
+ * PTHREADPOOL_PRIO_NORMAL ones. pool->mutex is only taken to start
+ * and stop threads and by workers running out of work, busy workers
+ * only contend on the queue locks.
+ *
+ * Finished job ids are collected in a list, the signalling fd only
+ * becomes readable when that list becomes non-empty, so a burst of
+ * completions costs a single write and a single read.
+ */
+
+#define PTHREADPOOL_MAX_QUEUES 64
+
 struct pthreadpool_job {
 	int id;
 	void (*fn)(void *private_data);
 	void *private_data;
 };
 
+/*
+ * A FIFO ring of jobs
+ */
+struct pthreadpool_jobs {
+	size_t jobs_array_len;
+	struct pthreadpool_job *jobs;
+
+	size_t head;
+	size_t num_jobs;
+};
+
+struct pthreadpool_queue {
+	pthread_mutex_t mutex;
+	struct pthreadpool_jobs prio[PTHREADPOOL_NUM_PRIOS];
+};
+
 struct pthreadpool {
 	/*
 	 * List pthreadpools for fork safety
@@ -56,18 +91,38 @@ struct pthreadpool {
 	pthread_cond_t condvar;
 
 	/*
-	 * Array of jobs
+	 * Per-worker job queues
 	 */
-	size_t jobs_array_len;
-	struct pthreadpool_job *jobs;
+	unsigned num_queues;
+	struct pthreadpool_queue *queues;
 
-	size_t head;
-	size_t num_jobs;
+	/*
+	 * Round robin counters for placing jobs and workers
+	 */
+	unsigned next_queue;
+	unsigned next_worker;
 
 	/*
-	 * pipe for signalling
+	 * Number of queued jobs not yet picked up by a worker, only
+	 * changed with pthreadpool_atomic_add()
 	 */
-	int sig_pipe[2];
+	int num_jobs;
+
+	/*
+	 * Finished job ids not yet collected by
+	 * pthreadpool_finished_jobs()
+	 */
+	struct {
+		pthread_mutex_t mutex;
+		int *ids;
+		size_t num;
+		size_t len;
+	} finished;
+
+	/*
+	 * eventfd or pipe for signalling
+	 */
+	int sig_fd[2];
 
 	/*
 	 * indicator to worker threads that they should shut down
@@ -85,7 +140,8 @@ struct pthreadpool {
 	int num_threads;
 
 	/*
-	 * Number of idle threads
+	 * Number of idle threads, only changed with
+	 * pthreadpool_atomic_add() with pool->mutex held
 	 */
 	int num_idle;
 
@@ -102,6 +158,117 @@ static pthread_once_t pthreadpool_atfork_initialized = PTHREAD_ONCE_INIT;
 
 static void pthreadpool_prep_atfork(void);
 
+#ifdef HAVE___SYNC_FETCH_AND_ADD
+#define pthreadpool_atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#else
+static pthread_mutex_t pthreadpool_atomic_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int pthreadpool_atomic_add(int *p, int v)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(&pthreadpool_atomic_mutex);
+	assert(ret == 0);
+	*p += v;
+	v = *p;
+	ret = pthread_mutex_unlock(&pthreadpool_atomic_mutex);
+	assert(ret == 0);
+
+	return v;
+}
+#endif
+
+#define pthreadpool_atomic_load(p) pthreadpool_atomic_add((p), 0)
+
+static int pthreadpool_signal_init(struct pthreadpool *pool)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	int fd;
+
+	fd = eventfd(0, 0);
+	if (fd == -1) {
+		return errno;
+	}
+	pool->sig_fd[0] = pool->sig_fd[1] = fd;
+#else
+	int ret;
+
+	ret = pipe(pool->sig_fd);
+	if (ret == -1) {
+		return errno;
+	}
+#endif
+	return 0;
+}
+
+static void pthreadpool_signal_close(struct pthreadpool *pool)
+{
+	if (pool->sig_fd[1] != pool->sig_fd[0]) {
+		close(pool->sig_fd[1]);
+	}
+	close(pool->sig_fd[0]);
+	pool->sig_fd[0] = pool->sig_fd[1] = -1;
+}
+
+/*
+ * Make the signal fd readable, pool->finished.mutex must be locked
+ */
+static int pthreadpool_signal_write(struct pthreadpool *pool)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t val = 1;
+#else
+	char val = 0;
+#endif
+	ssize_t written;
+
+	do {
+		written = write(pool->sig_fd[1], &val, sizeof(val));
+	} while ((written == -1) && (errno == EINTR));
+
+	if (written != sizeof(val)) {
+		return (written == -1) ? errno : EIO;
+	}
+	return 0;
+}
+
+static int pthreadpool_signal_read(struct pthreadpool *pool)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t val;
+#else
+	char val;
+#endif
+	ssize_t nread;
+
+	do {
+		nread = read(pool->sig_fd[0], &val, sizeof(val));
+	} while ((nread == -1) && (errno == EINTR));
+
+	if (nread != sizeof(val)) {
+		return (nread == -1) ? errno : EIO;
+	}
+	return 0;
+}
+
+static void pthreadpool_free(struct pthreadpool *pool)
+{
+	unsigned i, j;
+
+	for (i=0; i<pool->num_queues; i++) {
+		struct pthreadpool_queue *q = &pool->queues[i];
+
+		pthread_mutex_destroy(&q->mutex);
+		for (j=0; j<PTHREADPOOL_NUM_PRIOS; j++) {
+			free(q->prio[j].jobs);
+		}
+	}
+	free(pool->queues);
+	free(pool->finished.ids);
+	free(pool->exited);
+	free(pool);
+}
+
 /*
  * Initialize a thread pool
  */
@@ -109,48 +276,64 @@ static void pthreadpool_prep_atfork(void);
 int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult)
 {
 	struct pthreadpool *pool;
+	unsigned num_queues;
 	int ret;
 
-	pool = (struct pthreadpool *)malloc(sizeof(struct pthreadpool));
+	pool = (struct pthreadpool *)calloc(1, sizeof(struct pthreadpool));
 	if (pool == NULL) {
 		return ENOMEM;
 	}
 
-	pool->jobs_array_len = 4;
-	pool->jobs = calloc(
-		pool->jobs_array_len, sizeof(struct pthreadpool_job));
+	num_queues = PTHREADPOOL_MAX_QUEUES;
+	if ((max_threads != 0) && (max_threads < num_queues)) {
+		num_queues = max_threads;
+	}
 
-	if (pool->jobs == NULL) {
+	pool->queues = calloc(num_queues, sizeof(struct pthreadpool_queue));
+	if (pool->queues == NULL) {
 		free(pool);
 		return ENOMEM;
 	}
 
-	pool->head = pool->num_jobs = 0;
+	for (pool->num_queues = 0;
+	     pool->num_queues < num_queues;
+	     pool->num_queues++) {
+		struct pthreadpool_queue *q = &pool->queues[pool->num_queues];
 
-	ret = pipe(pool->sig_pipe);
-	if (ret == -1) {
-		int err = errno;
-		free(pool->jobs);
-		free(pool);
-		return err;
+		ret = pthread_mutex_init(&q->mutex, NULL);
+		if (ret != 0) {
+			pthreadpool_free(pool);
+			return ret;
+		}
+	}
+
+	ret = pthreadpool_signal_init(pool);
+	if (ret != 0) {
+		pthreadpool_free(pool);
+		return ret;
+	}
+
+	ret = pthread_mutex_init(&pool->finished.mutex, NULL);
+	if (ret != 0) {
+		pthreadpool_signal_close(pool);
+		pthreadpool_free(pool);
+		return ret;
 	}
 
 	ret = pthread_mutex_init(&pool->mutex, NULL);
 	if (ret != 0) {
-		close(pool->sig_pipe[0]);
-		close(pool->sig_pipe[1]);
-		free(pool->jobs);
-		free(pool);
+		pthread_mutex_destroy(&pool->finished.mutex);
+		pthreadpool_signal_close(pool);
+		pthreadpool_free(pool);
 		return ret;
 	}
 
 	ret = pthread_cond_init(&pool->condvar, NULL);
 	if (ret != 0) {
 		pthread_mutex_destroy(&pool->mutex);
-		close(pool->sig_pipe[0]);
-		close(pool->sig_pipe[1]);
-		free(pool->jobs);
-		free(pool);
+		pthread_mutex_destroy(&pool->finished.mutex);
+		pthreadpool_signal_close(pool);
+		pthreadpool_free(pool);
 		return ret;
 	}
 
@@ -165,10 +348,9 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult)
 	if (ret != 0) {
 		pthread_cond_destroy(&pool->condvar);
 		pthread_mutex_destroy(&pool->mutex);
-		close(pool->sig_pipe[0]);
-		close(pool->sig_pipe[1]);
-		free(pool->jobs);
-		free(pool);
+		pthread_mutex_destroy(&pool->finished.mutex);
+		pthreadpool_signal_close(pool);
+		pthreadpool_free(pool);
 		return ret;
 	}
 	DLIST_ADD(pthreadpools, pool);
@@ -187,6 +369,7 @@ static void pthreadpool_prepare(void)
 {
 	int ret;
 	struct pthreadpool *pool;
+	unsigned i;
 
 	ret = pthread_mutex_lock(&pthreadpools_mutex);
 	assert(ret == 0);
@@ -196,6 +379,12 @@ static void pthreadpool_prepare(void)
 	while (pool != NULL) {
 		ret = pthread_mutex_lock(&pool->mutex);
 		assert(ret == 0);
+		for (i=0; i<pool->num_queues; i++) {
+			ret = pthread_mutex_lock(&pool->queues[i].mutex);
+			assert(ret == 0);
+		}
+		ret = pthread_mutex_lock(&pool->finished.mutex);
+		assert(ret == 0);
 		pool = pool->next;
 	}
 }
@@ -204,10 +393,17 @@ static void pthreadpool_parent(void)
 {
 	int ret;
 	struct pthreadpool *pool;
+	unsigned i;
 
 	for (pool = DLIST_TAIL(pthreadpools);
 	     pool != NULL;
 	     pool = DLIST_PREV(pool)) {
+		ret = pthread_mutex_unlock(&pool->finished.mutex);
+		assert(ret == 0);
+		for (i=pool->num_queues; i>0; i--) {
+			ret = pthread_mutex_unlock(&pool->queues[i-1].mutex);
+			assert(ret == 0);
+		}
 		ret = pthread_mutex_unlock(&pool->mutex);
 		assert(ret == 0);
 	}
@@ -220,15 +416,15 @@ static void pthreadpool_child(void)
 {
 	int ret;
 	struct pthreadpool *pool;
+	unsigned i, j;
 
 	for (pool = DLIST_TAIL(pthreadpools);
 	     pool != NULL;
 	     pool = DLIST_PREV(pool)) {
 
-		close(pool->sig_pipe[0]);
-		close(pool->sig_pipe[1]);
+		pthreadpool_signal_close(pool);
 
-		ret = pipe(pool->sig_pipe);
+		ret = pthreadpool_signal_init(pool);
 		assert(ret == 0);
 
 		pool->num_threads = 0;
@@ -238,8 +434,23 @@ static void pthreadpool_child(void)
 		pool->exited = NULL;
 
 		pool->num_idle = 0;
-		pool->head = 0;
 		pool->num_jobs = 0;
+		pool->finished.num = 0;
+
+		ret = pthread_mutex_unlock(&pool->finished.mutex);
+		assert(ret == 0);
+
+		for (i=pool->num_queues; i>0; i--) {
+			struct pthreadpool_queue *q = &pool->queues[i-1];
+
+			for (j=0; j<PTHREADPOOL_NUM_PRIOS; j++) {
+				q->prio[j].head = 0;
+				q->prio[j].num_jobs = 0;
+			}
+
+			ret = pthread_mutex_unlock(&q->mutex);
+			assert(ret == 0);
+		}
 
 		ret = pthread_mutex_unlock(&pool->mutex);
 		assert(ret == 0);
@@ -262,7 +473,7 @@ static void pthreadpool_prep_atfork(void)
 
 int pthreadpool_signal_fd(struct pthreadpool *pool)
 {
-	return pool->sig_pipe[0];
+	return pool->sig_fd[0];
 }
 
 /*
@@ -294,29 +505,91 @@ static void pthreadpool_join_children(struct pthreadpool *pool)
 }
 
 /*
- * Fetch a finished job number from the signal pipe
+ * Fetch finished job numbers
  */
 
 int pthreadpool_finished_jobs(struct pthreadpool *pool, int *jobids,
 			      unsigned num_jobids)
 {
-	ssize_t to_read, nread;
+	size_t num;
+	int ret;
 
-	nread = -1;
-	errno = EINTR;
+	/*
+	 * This blocks until at least one job has finished
+	 */
+	ret = pthreadpool_signal_read(pool);
+	if (ret != 0) {
+		return -ret;
+	}
 
-	to_read = sizeof(int) * num_jobids;
+	ret = pthread_mutex_lock(&pool->finished.mutex);
+	if (ret != 0) {
+		return -ret;
+	}
+
+	num = pool->finished.num;
+	if (num > num_jobids) {
+		num = num_jobids;
+	}
+
+	memcpy(jobids, pool->finished.ids, sizeof(int) * num);
+	pool->finished.num -= num;
+
+	if (pool->finished.num > 0) {
+		memmove(pool->finished.ids, pool->finished.ids + num,
+			sizeof(int) * pool->finished.num);
+
+		/*
+		 * Keep the fd readable for the rest
+		 */
+		ret = pthreadpool_signal_write(pool);
+		if (ret != 0) {
+			pthread_mutex_unlock(&pool->finished.mutex);
+			return -ret;
+		}
+	}
+
+	ret = pthread_mutex_unlock(&pool->finished.mutex);
+	assert(ret == 0);
+
+	return num;
+}
+
+/*
+ * Hand a finished job id to pthreadpool_finished_jobs()
+ */
+static int pthreadpool_job_done(struct pthreadpool *pool, int id)
+{
+	int ret;
 
-	while ((nread == -1) && (errno == EINTR)) {
-		nread = read(pool->sig_pipe[0], jobids, to_read);
+	ret = pthread_mutex_lock(&pool->finished.mutex);
+	if (ret != 0) {
+		return ret;
 	}
-	if (nread == -1) {
-		return -errno;
+
+	if (pool->finished.num == pool->finished.len) {
+		size_t new_len = MAX(pool->finished.len * 2, 16);
+		int *tmp;
+
+		tmp = realloc(pool->finished.ids, sizeof(int) * new_len);
+		if (tmp == NULL) {
+			pthread_mutex_unlock(&pool->finished.mutex);
+			return ENOMEM;
+		}
+		pool->finished.ids = tmp;
+		pool->finished.len = new_len;
 	}
-	if ((nread % sizeof(int)) != 0) {
-		return -EINVAL;
+
+	pool->finished.ids[pool->finished.num] = id;
+	pool->finished.num += 1;
+
+	ret = 0;
+	if (pool->finished.num == 1) {
+		ret = pthreadpool_signal_write(pool);
 	}
-	return nread / sizeof(int);
+
+	pthread_mutex_unlock(&pool->finished.mutex);
+	return ret;
 }
 
 /*
@@ -325,14 +598,15 @@ int pthreadpool_finished_jobs(struct pthreadpool *pool, int *jobids,
 
 int pthreadpool_destroy(struct pthreadpool *pool)
 {
-	int ret, ret1;
+	int ret, ret1, ret2;
 
 	ret = pthread_mutex_lock(&pool->mutex);
 	if (ret != 0) {
 		return ret;
 	}
 
-	if ((pool->num_jobs != 0) || pool->shutdown) {
+	if ((pthreadpool_atomic_load(&pool->num_jobs) != 0) ||
+	    pool->shutdown) {
 		ret = pthread_mutex_unlock(&pool->mutex);
 		assert(ret == 0);
 		return EBUSY;
@@ -381,6 +655,7 @@ int pthreadpool_destroy(struct pthreadpool *pool)
 	}
 	ret = pthread_mutex_destroy(&pool->mutex);
 	ret1 = pthread_cond_destroy(&pool->condvar);
+	ret2 = pthread_mutex_destroy(&pool->finished.mutex);
 
 	if (ret != 0) {
 		return ret;
@@ -388,6 +663,9 @@ int pthreadpool_destroy(struct pthreadpool *pool)
 	if (ret1 != 0) {
 		return ret1;
 	}
+	if (ret2 != 0) {
+		return ret2;
+	}
 
 	ret = pthread_mutex_lock(&pthreadpools_mutex);
 	if (ret != 0) {
@@ -397,15 +675,8 @@ int pthreadpool_destroy(struct pthreadpool *pool)
 	ret = pthread_mutex_unlock(&pthreadpools_mutex);
 	assert(ret == 0);
 
-	close(pool->sig_pipe[0]);
-	pool->sig_pipe[0] = -1;
-
-	close(pool->sig_pipe[1]);
-	pool->sig_pipe[1] = -1;
-
-	free(pool->exited);
-	free(pool->jobs);
-	free(pool);
+	pthreadpool_signal_close(pool);
+	pthreadpool_free(pool);
 
 	return 0;
 }
@@ -432,8 +703,8 @@ static void pthreadpool_server_exit(struct pthreadpool *pool)
 	pool->num_exited += 1;
 }
 
-static bool pthreadpool_get_job(struct pthreadpool *p,
-				struct pthreadpool_job *job)
+static bool pthreadpool_get_job_from(struct pthreadpool_jobs *p,
+				     struct pthreadpool_job *job)
 {
 	if (p->num_jobs == 0) {
 		return false;
@@ -444,16 +715,16 @@ static bool pthreadpool_get_job(struct pthreadpool *p,
 	return true;
 }
 
-static bool pthreadpool_put_job(struct pthreadpool *p,
-				int id,
-				void (*fn)(void *private_data),
-				void *private_data)
+static bool pthreadpool_put_job_to(struct pthreadpool_jobs *p,
+				   int id,
+				   void (*fn)(void *private_data),
+				   void *private_data)
 {
 	struct pthreadpool_job *job;
 
 	if (p->num_jobs == p->jobs_array_len) {
 		struct pthreadpool_job *tmp;
-		size_t new_len = p->jobs_array_len * 2;
+		size_t new_len = MAX(p->jobs_array_len * 2, 4);
 
 		tmp = realloc(
 			p->jobs, sizeof(struct pthreadpool_job) * new_len);
@@ -487,9 +758,51 @@ static bool pthreadpool_put_job(struct pthreadpool *p,
 	return true;
 }
 
+/*
+ * Look for a job, high priority ones first, starting with the
+ * worker's own queue
+ */
+static bool pthreadpool_get_job(struct pthreadpool *pool, unsigned home,
+				struct pthreadpool_job *job)
+{
+	int prio;
+	unsigned i;
+
+	for (prio = PTHREADPOOL_NUM_PRIOS - 1; prio >= 0; prio--) {
+		for (i=0; i<pool->num_queues; i++) {
+			struct pthreadpool_queue *q =
+				&pool->queues[(home + i) % pool->num_queues];
+			bool ok;
+			int ret;
+
+			/*
+			 * Unlocked peek to skip empty queues, we look
+			 * again with the lock held
+			 */
+			if (*(volatile size_t *)&q->prio[prio].num_jobs == 0) {
+				continue;
+			}
+
+			ret = pthread_mutex_lock(&q->mutex);
+			assert(ret == 0);
+			ok = pthreadpool_get_job_from(&q->prio[prio], job);
+			ret = pthread_mutex_unlock(&q->mutex);
+			assert(ret == 0);
+
+			if (ok) {
+				pthreadpool_atomic_add(&pool->num_jobs, -1);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 static void *pthreadpool_server(void *arg)
 {
 	struct pthreadpool *pool = (struct pthreadpool *)arg;
+	unsigned home;
 	int res;
 
 	res = pthread_mutex_lock(&pool->mutex);
@@ -497,10 +810,55 @@ static void *pthreadpool_server(void *arg)
 		return NULL;
 	}
 
+	home = pool->next_worker++ % pool->num_queues;
+
 	while (1) {
 		struct timespec ts;
 		struct pthreadpool_job job;
 
+		if (pthreadpool_get_job(pool, home, &job)) {
+
+			/*
+			 * Do the work with the mutex unlocked
+			 */
+
+			res = pthread_mutex_unlock(&pool->mutex);
+			assert(res == 0);
+
+			job.fn(job.private_data);
+
+			res = pthreadpool_job_done(pool, job.id);
+
+			if (res != 0) {
+				pthread_mutex_lock(&pool->mutex);
+				pthreadpool_server_exit(pool);
+				pthread_mutex_unlock(&pool->mutex);
+				return NULL;
+			}
+
+			/*
+			 * Stay away from pool->mutex while there is
+			 * work to do
+			 */
+			while (pthreadpool_get_job(pool, home, &job)) {
+				job.fn(job.private_data);
+
+				res = pthreadpool_job_done(pool, job.id);
+				if (res != 0) {
+					break;
+				}
+			}
+
+			pthread_mutex_lock(&pool->mutex);
+
+			if (res != 0) {
+				pthreadpool_server_exit(pool);
+				pthread_mutex_unlock(&pool->mutex);
+				return NULL;
+			}
+			continue;
+		}
+
 		/*
 		 * idle-wait at most 1 second. If nothing happens in that
 		 * time, exit this thread.
@@ -509,55 +867,53 @@ static void *pthreadpool_server(void *arg)
 		clock_gettime(CLOCK_REALTIME, &ts);
 		ts.tv_sec += 1;
 
-		while ((pool->num_jobs == 0) && (pool->shutdown == 0)) {
+		while (pool->shutdown == 0) {
+
+			/*
+			 * pthreadpool_add_job() increments num_jobs
+			 * before looking at num_idle, so either it
+			 * sees us idle and signals the condvar or we
+			 * see its job here.
+			 */
+			pthreadpool_atomic_add(&pool->num_idle, 1);
+
+			if (pthreadpool_atomic_load(&pool->num_jobs) != 0) {
+				pthreadpool_atomic_add(&pool->num_idle, -1);
+				break;
+			}
 
-			pool->num_idle += 1;
 			res = pthread_cond_timedwait(
 				&pool->condvar, &pool->mutex, &ts);
-			pool->num_idle -= 1;
 
 			if (res == ETIMEDOUT) {
 
-				if (pool->num_jobs == 0) {
+				if (pthreadpool_atomic_load(
+					    &pool->num_jobs) == 0) {
 					/*
 					 * we timed out and still no work for
-					 * us. Exit.
+					 * us. Exit. We stay counted as idle
+					 * until num_threads is down: A
+					 * pthreadpool_add_job() that missed
+					 * our num_jobs check then either sees
+					 * us idle and waits for pool->mutex,
+					 * or it sees room for a new thread.
 					 */
 					pthreadpool_server_exit(pool);
+					pthreadpool_atomic_add(
+						&pool->num_idle, -1);
 					pthread_mutex_unlock(&pool->mutex);
 					return NULL;
 				}
 
+				pthreadpool_atomic_add(&pool->num_idle, -1);
 				break;
 			}
+			pthreadpool_atomic_add(&pool->num_idle, -1);
 			assert(res == 0);
 		}
 
-		if (pthreadpool_get_job(pool, &job)) {
-			ssize_t written;
-			int sig_pipe = pool->sig_pipe[1];
-
-			/*
-			 * Do the work with the mutex unlocked
-			 */
-
-			res = pthread_mutex_unlock(&pool->mutex);
-			assert(res == 0);
-
-			job.fn(job.private_data);
-
-			res = pthread_mutex_lock(&pool->mutex);
-			assert(res == 0);
-
-			written = write(sig_pipe, &job.id, sizeof(job.id));
-			if (written != sizeof(int)) {
-				pthreadpool_server_exit(pool);
-				pthread_mutex_unlock(&pool->mutex);
-				return NULL;
-			}
-		}
-
-		if ((pool->num_jobs == 0) && (pool->shutdown != 0)) {
+		if ((pthreadpool_atomic_load(&pool->num_jobs) == 0) &&
+		    (pool->shutdown != 0)) {
 			/*
 			 * No more work to do and we're asked to shut down, so
 			 * exit
@@ -578,16 +934,20 @@ static void *pthreadpool_server(void *arg)
 	}
 }
 
-int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
-			void (*fn)(void *private_data), void *private_data)
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data)
 {
+	struct pthreadpool_queue *q;
 	pthread_t thread_id;
+	unsigned num_queues;
 	int res;
 	sigset_t mask, omask;
+	bool ok;
 
-	res = pthread_mutex_lock(&pool->mutex);
-	if (res != 0) {
-		return res;
+	if ((unsigned)prio >= PTHREADPOOL_NUM_PRIOS) {
+		return EINVAL;
 	}
 
 	if (pool->shutdown) {
@@ -595,24 +955,54 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 		 * Protect against the pool being shut down while
 		 * trying to add a job
 		 */
-		res = pthread_mutex_unlock(&pool->mutex);
-		assert(res == 0);
 		return EINVAL;
 	}
 
 	/*
-	 * Just some cleanup under the mutex
+	 * Spread the jobs over the queues of the threads we have,
+	 * stealing takes care of the rest.
 	 */
-	pthreadpool_join_children(pool);
+	num_queues = *(volatile int *)&pool->num_threads;
+	if ((num_queues == 0) || (num_queues > pool->num_queues)) {
+		num_queues = pool->num_queues;
+	}
+	q = &pool->queues[pool->next_queue++ % num_queues];
 
-	/*
-	 * Add job to the end of the queue
-	 */
-	if (!pthreadpool_put_job(pool, job_id, fn, private_data)) {
-		pthread_mutex_unlock(&pool->mutex);
+	res = pthread_mutex_lock(&q->mutex);
+	if (res != 0) {
+		return res;
+	}
+	ok = pthreadpool_put_job_to(&q->prio[prio], job_id, fn,
+				    private_data);
+	res = pthread_mutex_unlock(&q->mutex);
+	assert(res == 0);
+
+	if (!ok) {
 		return ENOMEM;
 	}
 
+	pthreadpool_atomic_add(&pool->num_jobs, 1);
+
+	if ((pthreadpool_atomic_load(&pool->num_idle) == 0) &&
+	    (pool->max_threads != 0) &&
+	    (*(volatile int *)&pool->num_threads >= pool->max_threads)) {
+		/*
+		 * All threads are busy and we can't start new ones,
+		 * one of them will find the job.
+		 */
+		return 0;
+	}
+
+	res = pthread_mutex_lock(&pool->mutex);
+	if (res != 0) {
+		return res;
+	}
+
+	/*
+	 * Just some cleanup under the mutex
+	 */
+	pthreadpool_join_children(pool);
+
 	if (pool->num_idle > 0) {
 		/*
 		 * We have idle threads, wake one.
@@ -654,3 +1044,10 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 	pthread_mutex_unlock(&pool->mutex);
 	return res;
 }
+
+int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
+			void (*fn)(void *private_data), void *private_data)
+{
+	return pthreadpool_add_job_prio(pool, job_id, PTHREADPOOL_PRIO_NORMAL,
+					fn, private_data);
+}
@@ -72,6 +72,39 @@ int pthreadpool_destroy(struct pthreadpool *pool);
 int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 			void (*fn)(void *private_data), void *private_data);
 
+/**
+ * @brief Job priorities
+ *
+ * Workers pick up all queued PTHREADPOOL_PRIO_HIGH jobs before any
+ * PTHREADPOOL_PRIO_NORMAL ones, so short metadata operations don't
+ * have to wait behind a queue of large reads and writes.
+ */
+enum pthreadpool_prio {
+	PTHREADPOOL_PRIO_NORMAL = 0,
+	PTHREADPOOL_PRIO_HIGH = 1,
+};
+
+#define PTHREADPOOL_NUM_PRIOS 2
+
+/**
+ * @brief Add a job with a priority to a pthreadpool
+ *
+ * Like pthreadpool_add_job(), which uses PTHREADPOOL_PRIO_NORMAL.
+ * Jobs of the same priority are not guaranteed to run in the order
+ * they were added.
+ *
+ * @param[in]	pool		The pool to run the job on
+ * @param[in]	job_id		A custom identifier
+ * @param[in]	prio		The priority class of the job
+ * @param[in]	fn		The function to run asynchronously
+ * @param[in]	private_data	Pointer passed to fn
+ * @return			success: 0, failure: errno
+ */
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data);
+
 /**
  * @brief Get the signalling fd from a pthreadpool
  *
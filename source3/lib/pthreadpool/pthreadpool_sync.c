@@ -133,6 +133,17 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 
 }
 
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data)
+{
+	/*
+	 * Jobs run right away, there is nothing to prioritize
+	 */
+	return pthreadpool_add_job(pool, job_id, fn, private_data);
+}
+
 int pthreadpool_finished_jobs(struct pthreadpool *pool, int *jobids,
 			      unsigned num_jobids)
 {
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include "pthreadpool.h"
@@ -137,6 +139,197 @@ static int test_busydestroy(void)
 	return 0;
 }
 
+static int test_prio(void)
+{
+	struct pthreadpool *p;
+	int busy_timeout = 100;
+	int timeout = 0;
+	int i, ret, num_left;
+
+	ret = pthreadpool_init(1, &p);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_init failed: %s\n",
+			strerror(ret));
+		return -1;
+	}
+
+	/*
+	 * Keep the only thread busy while we queue 10 normal jobs
+	 * and then a high priority one. The latter has to overtake
+	 * the others.
+	 */
+	ret = pthreadpool_add_job(p, 0, test_sleep, &busy_timeout);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_add_job failed: %s\n",
+			strerror(ret));
+		return -1;
+	}
+	for (i=1; i<=10; i++) {
+		ret = pthreadpool_add_job_prio(p, i, PTHREADPOOL_PRIO_NORMAL,
+					       test_sleep, &timeout);
+		if (ret != 0) {
+			fprintf(stderr, "pthreadpool_add_job_prio failed: "
+				"%s\n", strerror(ret));
+			return -1;
+		}
+	}
+	ret = pthreadpool_add_job_prio(p, 11, PTHREADPOOL_PRIO_HIGH,
+				       test_sleep, &timeout);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_add_job_prio failed: %s\n",
+			strerror(ret));
+		return -1;
+	}
+
+	num_left = 11;
+
+	while (1) {
+		int jobid = -1;
+
+		ret = pthreadpool_finished_jobs(p, &jobid, 1);
+		if (ret != 1) {
+			fprintf(stderr, "pthreadpool_finished_jobs "
+				"returned %d\n", ret);
+			return -1;
+		}
+		if (jobid == 11) {
+			break;
+		}
+		if (jobid != 0) {
+			fprintf(stderr, "job %d finished before the high "
+				"priority one\n", jobid);
+			return -1;
+		}
+		num_left -= 1;
+	}
+
+	for (i=0; i<num_left; i++) {
+		int jobid = -1;
+
+		ret = pthreadpool_finished_jobs(p, &jobid, 1);
+		if ((ret != 1) || (jobid < 0) || (jobid > 10)) {
+			fprintf(stderr, "invalid job number %d\n", jobid);
+			return -1;
+		}
+	}
+
+	ret = pthreadpool_destroy(p);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_destroy failed: %s\n",
+			strerror(ret));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * A worker exits after one second without work. Submit jobs to single
+ * threaded pools right when their workers are about to time out, none
+ * of the jobs may get stuck in the queue.
+ */
+
+#define IDLE_EXIT_POOLS 128
+#define IDLE_EXIT_ROUNDS 4
+
+static int64_t test_idle_exit_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int test_idle_exit(void)
+{
+	struct pthreadpool *pools[IDLE_EXIT_POOLS];
+	int64_t idle_since[IDLE_EXIT_POOLS];
+	int timeout = 0;
+	int i, round, ret;
+
+	for (i=0; i<IDLE_EXIT_POOLS; i++) {
+		ret = pthreadpool_init(1, &pools[i]);
+		if (ret != 0) {
+			fprintf(stderr, "pthreadpool_init failed: %s\n",
+				strerror(ret));
+			return -1;
+		}
+	}
+
+	for (round=0; round<IDLE_EXIT_ROUNDS; round++) {
+
+		for (i=0; i<IDLE_EXIT_POOLS; i++) {
+			int jobid = -1;
+
+			ret = pthreadpool_add_job(pools[i], i, test_sleep,
+						  &timeout);
+			if (ret != 0) {
+				fprintf(stderr, "pthreadpool_add_job failed: "
+					"%s\n", strerror(ret));
+				return -1;
+			}
+			ret = pthreadpool_finished_jobs(pools[i], &jobid, 1);
+			if ((ret != 1) || (jobid != i)) {
+				fprintf(stderr, "pthreadpool_finished_jobs "
+					"returned %d/%d\n", ret, jobid);
+				return -1;
+			}
+			idle_since[i] = test_idle_exit_now();
+		}
+
+		/*
+		 * Spread the submits over 300us before to 300us after
+		 * the expected timeout
+		 */
+		for (i=0; i<IDLE_EXIT_POOLS; i++) {
+			int64_t when = idle_since[i] + 1000000 - 300 +
+				i * 600 / IDLE_EXIT_POOLS;
+
+			while (test_idle_exit_now() < when) {
+				;
+			}
+
+			ret = pthreadpool_add_job(pools[i], i, test_sleep,
+						  &timeout);
+			if (ret != 0) {
+				fprintf(stderr, "pthreadpool_add_job failed: "
+					"%s\n", strerror(ret));
+				return -1;
+			}
+		}
+
+		for (i=0; i<IDLE_EXIT_POOLS; i++) {
+			struct pollfd pfd = {
+				.fd = pthreadpool_signal_fd(pools[i]),
+				.events = POLLIN
+			};
+			int jobid = -1;
+
+			ret = poll(&pfd, 1, 5000);
+			if (ret != 1) {
+				fprintf(stderr, "job %d in round %d got "
+					"stuck\n", i, round);
+				return -1;
+			}
+			ret = pthreadpool_finished_jobs(pools[i], &jobid, 1);
+			if ((ret != 1) || (jobid != i)) {
+				fprintf(stderr, "pthreadpool_finished_jobs "
+					"returned %d/%d\n", ret, jobid);
+				return -1;
+			}
+		}
+	}
+
+	for (i=0; i<IDLE_EXIT_POOLS; i++) {
+		ret = pthreadpool_destroy(pools[i]);
+		if (ret != 0) {
+			fprintf(stderr, "pthreadpool_destroy failed: %s\n",
+				strerror(ret));
+			return -1;
+		}
+	}
+	return 0;
+}
+
 struct threaded_state {
 	pthread_t tid;
 	struct pthreadpool *p;
@@ -388,6 +581,18 @@ int main(void)
 		return 1;
 	}
 
+	ret = test_prio();
+	if (ret != 0) {
+		fprintf(stderr, "test_prio failed\n");
+		return 1;
+	}
+
+	ret = test_idle_exit();
+	if (ret != 0) {
+		fprintf(stderr, "test_idle_exit failed\n");
+		return 1;
+	}
+
 	/*
 	 * Test 10 threads adding jobs on a single pool
 	 */
@@ -895,6 +895,126 @@ int unix_msg_send(struct unix_msg_ctx *ctx, const struct sockaddr_un *dst,
 	return ret;
 }
 
+/*
+ * Number of datagrams handed to one sendmmsg call, and the largest
+ * iov array we batch
+ */
+#define UNIX_MSG_MMSG_BATCH 64
+#define UNIX_MSG_MMSG_IOV 8
+
+#ifdef HAVE_SENDMMSG
+
+struct unix_msg_mmsg {
+	struct mmsghdr hdrs[UNIX_MSG_MMSG_BATCH];
+	struct iovec iovs[UNIX_MSG_MMSG_BATCH][UNIX_MSG_MMSG_IOV+1];
+	struct unix_msg_dst *dsts[UNIX_MSG_MMSG_BATCH];
+	size_t num;
+};
+
+static void unix_msg_mmsg_flush(struct unix_msg_ctx *ctx,
+				struct unix_msg_mmsg *m)
+{
+	size_t done = 0;
+
+	while (done < m->num) {
+		struct unix_msg_dst *d;
+		int i, sent;
+
+		sent = sendmmsg(unix_dgram_sock(ctx->dgram), &m->hdrs[done],
+				m->num - done, 0);
+		if (sent > 0) {
+			for (i=0; i<sent; i++) {
+				m->dsts[done+i]->ret = 0;
+			}
+			done += sent;
+			continue;
+		}
+
+		/*
+		 * Full receive queue, dead peer or EINTR for the first
+		 * message: unix_msg_send knows how to queue and what
+		 * to report.
+		 */
+		d = m->dsts[done];
+		d->ret = unix_msg_send(ctx, d->dst, d->iov, d->iovlen,
+				       NULL, 0);
+		done += 1;
+	}
+
+	m->num = 0;
+}
+
+#endif
+
+void unix_msg_send_multi(struct unix_msg_ctx *ctx,
+			 struct unix_msg_dst *dsts, size_t num_dsts)
+{
+#ifdef HAVE_SENDMMSG
+	static const uint64_t cookie = 0;
+	struct unix_msg_mmsg m;
+	size_t i;
+
+	m.num = 0;
+
+	for (i=0; i<num_dsts; i++) {
+		struct unix_msg_dst *d = &dsts[i];
+		struct iovec *iov;
+		ssize_t msglen;
+
+		msglen = iov_buflen(d->iov, d->iovlen);
+
+		if ((msglen == -1) ||
+		    (msglen > (ctx->fragment_len - sizeof(uint64_t))) ||
+		    (d->iovlen > UNIX_MSG_MMSG_IOV) ||
+		    (find_send_queue(ctx->dgram, d->dst->sun_path) != NULL)) {
+			/*
+			 * Keep the order in case "d" shows up in the
+			 * batch as well
+			 */
+			unix_msg_mmsg_flush(ctx, &m);
+			d->ret = unix_msg_send(ctx, d->dst, d->iov, d->iovlen,
+					       NULL, 0);
+			continue;
+		}
+
+		iov = m.iovs[m.num];
+		iov[0] = (struct iovec) {
+			.iov_base = discard_const_p(uint64_t, &cookie),
+			.iov_len = sizeof(cookie)
+		};
+		if (d->iovlen > 0) {
+			memcpy(&iov[1], d->iov, sizeof(struct iovec) * d->iovlen);
+		}
+
+		m.hdrs[m.num] = (struct mmsghdr) {
+			.msg_hdr = {
+				.msg_name = discard_const_p(
+					struct sockaddr_un, d->dst),
+				.msg_namelen = sizeof(*d->dst),
+				.msg_iov = iov,
+				.msg_iovlen = d->iovlen + 1
+			}
+		};
+		m.dsts[m.num] = d;
+		m.num += 1;
+
+		if (m.num == UNIX_MSG_MMSG_BATCH) {
+			unix_msg_mmsg_flush(ctx, &m);
+		}
+	}
+
+	unix_msg_mmsg_flush(ctx, &m);
+#else
+	size_t i;
+
+	for (i=0; i<num_dsts; i++) {
+		struct unix_msg_dst *d = &dsts[i];
+		d->ret = unix_msg_send(ctx, d->dst, d->iov, d->iovlen,
+				       NULL, 0);
+	}
+#endif
+}
+
 static void unix_msg_recv(struct unix_dgram_ctx *dgram_ctx,
 			  uint8_t *buf, size_t buflen,
 			  int *fds, size_t num_fds,
@@ -108,6 +108,37 @@ int unix_msg_send(struct unix_msg_ctx *ctx, const struct sockaddr_un *dst,
 		  const struct iovec *iov, int iovlen,
 		  const int *fds, size_t num_fds);
 
+/**
+ * @brief A destination for unix_msg_send_multi()
+ */
+
+struct unix_msg_dst {
+	const struct sockaddr_un *dst;
+	const struct iovec *iov;
+	int iovlen;
+
+	/**
+	 * @brief 0 or errno, filled by unix_msg_send_multi()
+	 */
+	int ret;
+};
+
+/**
+ * @brief Send messages to a list of destinations
+ *
+ * Short messages to destinations without queued messages are sent
+ * with as few sendmmsg(2) calls as possible, everything else goes
+ * through unix_msg_send(). Messages to the same destination are sent
+ * in order.
+ *
+ * @param[in] ctx The context to send across
+ * @param[in,out] dsts The destinations and messages, ret is set per entry
+ * @param[in] num_dsts The number of destinations
+ */
+
+void unix_msg_send_multi(struct unix_msg_ctx *ctx,
+			 struct unix_msg_dst *dsts, size_t num_dsts);
+
 /**
  * @brief Free a unix_msg_ctx
  *
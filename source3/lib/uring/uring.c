@@ -0,0 +1,464 @@
+/*
+ * Async I/O via the Linux io_uring interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uring.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/*
+ * We talk to the kernel directly, liburing is not available
+ * everywhere and we only need a tiny subset of it.
+ */
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+			      unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg,
+				 unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+#define uring_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define uring_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct uring_job {
+	void *private_data;
+	struct iovec iov;
+	char busy;
+	char canceled;
+};
+
+struct uring_context {
+	int ring_fd;
+	int event_fd;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned *sq_array;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+
+	unsigned to_submit;
+
+	/*
+	 * One job per possible completion, the CQ ring can never
+	 * overflow. Free jobs are kept on a stack of indexes.
+	 */
+	unsigned num_jobs;
+	struct uring_job *jobs;
+	unsigned num_free;
+	unsigned *free_jobs;
+};
+
+static void uring_unmap(struct uring_context *ctx)
+{
+	if (ctx->sqes != NULL) {
+		munmap(ctx->sqes, ctx->sqes_size);
+	}
+	if ((ctx->cq_ring != NULL) && (ctx->cq_ring != ctx->sq_ring)) {
+		munmap(ctx->cq_ring, ctx->cq_ring_size);
+	}
+	if (ctx->sq_ring != NULL) {
+		munmap(ctx->sq_ring, ctx->sq_ring_size);
+	}
+}
+
+static void uring_context_free(struct uring_context *ctx)
+{
+	uring_unmap(ctx);
+	if (ctx->event_fd != -1) {
+		close(ctx->event_fd);
+	}
+	if (ctx->ring_fd != -1) {
+		close(ctx->ring_fd);
+	}
+	free(ctx->free_jobs);
+	free(ctx->jobs);
+	free(ctx);
+}
+
+int uring_context_init(struct uring_context **pctx, unsigned entries)
+{
+	struct uring_context *ctx;
+	struct io_uring_params p;
+	uint8_t *sq_ring, *cq_ring;
+	unsigned i;
+	int ret;
+
+	ctx = calloc(1, sizeof(struct uring_context));
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	ctx->ring_fd = -1;
+	ctx->event_fd = -1;
+
+	memset(&p, 0, sizeof(p));
+
+	ctx->ring_fd = sys_io_uring_setup(entries, &p);
+	if (ctx->ring_fd == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	ret = fcntl(ctx->ring_fd, F_SETFD, FD_CLOEXEC);
+	if (ret == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	ctx->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ctx->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->sq_ring_size = MAX(ctx->sq_ring_size, ctx->cq_ring_size);
+		ctx->cq_ring_size = ctx->sq_ring_size;
+	}
+
+	ctx->sq_ring = mmap(NULL, ctx->sq_ring_size, PROT_READ|PROT_WRITE,
+			    MAP_SHARED|MAP_POPULATE, ctx->ring_fd,
+			    IORING_OFF_SQ_RING);
+	if (ctx->sq_ring == MAP_FAILED) {
+		ctx->sq_ring = NULL;
+		ret = errno;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->cq_ring = ctx->sq_ring;
+	} else {
+		ctx->cq_ring = mmap(NULL, ctx->cq_ring_size,
+				    PROT_READ|PROT_WRITE,
+				    MAP_SHARED|MAP_POPULATE, ctx->ring_fd,
+				    IORING_OFF_CQ_RING);
+		if (ctx->cq_ring == MAP_FAILED) {
+			ctx->cq_ring = NULL;
+			ret = errno;
+			goto fail;
+		}
+	}
+
+	ctx->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = mmap(NULL, ctx->sqes_size, PROT_READ|PROT_WRITE,
+			 MAP_SHARED|MAP_POPULATE, ctx->ring_fd,
+			 IORING_OFF_SQES);
+	if (ctx->sqes == MAP_FAILED) {
+		ctx->sqes = NULL;
+		ret = errno;
+		goto fail;
+	}
+
+	sq_ring = (uint8_t *)ctx->sq_ring;
+	ctx->sq_head = (unsigned *)(sq_ring + p.sq_off.head);
+	ctx->sq_tail = (unsigned *)(sq_ring + p.sq_off.tail);
+	ctx->sq_mask = *(unsigned *)(sq_ring + p.sq_off.ring_mask);
+	ctx->sq_entries = p.sq_entries;
+	ctx->sq_array = (unsigned *)(sq_ring + p.sq_off.array);
+
+	cq_ring = (uint8_t *)ctx->cq_ring;
+	ctx->cq_head = (unsigned *)(cq_ring + p.cq_off.head);
+	ctx->cq_tail = (unsigned *)(cq_ring + p.cq_off.tail);
+	ctx->cq_mask = *(unsigned *)(cq_ring + p.cq_off.ring_mask);
+	ctx->cqes = (struct io_uring_cqe *)(cq_ring + p.cq_off.cqes);
+
+	ctx->num_jobs = p.cq_entries;
+	ctx->jobs = calloc(ctx->num_jobs, sizeof(struct uring_job));
+	ctx->free_jobs = calloc(ctx->num_jobs, sizeof(unsigned));
+	if ((ctx->jobs == NULL) || (ctx->free_jobs == NULL)) {
+		ret = ENOMEM;
+		goto fail;
+	}
+	for (i=0; i<ctx->num_jobs; i++) {
+		ctx->free_jobs[i] = ctx->num_jobs - i - 1;
+	}
+	ctx->num_free = ctx->num_jobs;
+
+	ctx->event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (ctx->event_fd == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	ret = sys_io_uring_register(ctx->ring_fd, IORING_REGISTER_EVENTFD,
+				    &ctx->event_fd, 1);
+	if (ret == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	*pctx = ctx;
+	return 0;
+
+fail:
+	uring_context_free(ctx);
+	return ret;
+}
+
+int uring_context_destroy(struct uring_context *ctx)
+{
+	unsigned i;
+
+	for (i=0; i<ctx->num_jobs; i++) {
+		if (ctx->jobs[i].busy) {
+			return EBUSY;
+		}
+	}
+
+	uring_context_free(ctx);
+	return 0;
+}
+
+int uring_signalfd(struct uring_context *ctx)
+{
+	return ctx->event_fd;
+}
+
+unsigned uring_queued(struct uring_context *ctx)
+{
+	return ctx->to_submit;
+}
+
+int uring_submit(struct uring_context *ctx)
+{
+	while (ctx->to_submit > 0) {
+		int ret;
+
+		ret = sys_io_uring_enter(ctx->ring_fd, ctx->to_submit, 0, 0);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		ctx->to_submit -= MIN(ctx->to_submit, (unsigned)ret);
+	}
+	return 0;
+}
+
+static int uring_get_sqe(struct uring_context *ctx, void *private_data,
+			 struct io_uring_sqe **psqe, struct uring_job **pjob)
+{
+	struct io_uring_sqe *sqe;
+	struct uring_job *job;
+	unsigned tail, idx, jobid;
+
+	if (ctx->num_free == 0) {
+		return EAGAIN;
+	}
+
+	tail = *ctx->sq_tail;
+
+	if (tail - uring_load_acquire(ctx->sq_head) == ctx->sq_entries) {
+		int ret = uring_submit(ctx);
+		if (ret != 0) {
+			return ret;
+		}
+		if (tail - uring_load_acquire(ctx->sq_head) ==
+		    ctx->sq_entries) {
+			return EAGAIN;
+		}
+	}
+
+	ctx->num_free -= 1;
+	jobid = ctx->free_jobs[ctx->num_free];
+	job = &ctx->jobs[jobid];
+	job->private_data = private_data;
+	job->busy = 1;
+	job->canceled = 0;
+
+	idx = tail & ctx->sq_mask;
+	sqe = &ctx->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = jobid;
+
+	ctx->sq_array[idx] = idx;
+
+	*psqe = sqe;
+	*pjob = job;
+	return 0;
+}
+
+static void uring_queue_sqe(struct uring_context *ctx)
+{
+	uring_store_release(ctx->sq_tail, *ctx->sq_tail + 1);
+	ctx->to_submit += 1;
+}
+
+static int uring_rw(struct uring_context *ctx, uint8_t opcode, int fildes,
+		    void *buf, size_t nbyte, off_t offset, void *private_data)
+{
+	struct io_uring_sqe *sqe;
+	struct uring_job *job;
+	int ret;
+
+	ret = uring_get_sqe(ctx, private_data, &sqe, &job);
+	if (ret != 0) {
+		return ret;
+	}
+
+	job->iov.iov_base = buf;
+	job->iov.iov_len = nbyte;
+
+	sqe->opcode = opcode;
+	sqe->fd = fildes;
+	sqe->off = offset;
+	sqe->addr = (uint64_t)(uintptr_t)&job->iov;
+	sqe->len = 1;
+
+	uring_queue_sqe(ctx);
+	return 0;
+}
+
+int uring_pread(struct uring_context *ctx, int fildes, void *buf,
+		size_t nbyte, off_t offset, void *private_data)
+{
+	return uring_rw(ctx, IORING_OP_READV, fildes, buf, nbyte, offset,
+			private_data);
+}
+
+int uring_pwrite(struct uring_context *ctx, int fildes, const void *buf,
+		 size_t nbyte, off_t offset, void *private_data)
+{
+	return uring_rw(ctx, IORING_OP_WRITEV, fildes,
+			(void *)(uintptr_t)buf, nbyte, offset, private_data);
+}
+
+int uring_fsync(struct uring_context *ctx, int fildes, void *private_data)
+{
+	struct io_uring_sqe *sqe;
+	struct uring_job *job;
+	int ret;
+
+	ret = uring_get_sqe(ctx, private_data, &sqe, &job);
+	if (ret != 0) {
+		return ret;
+	}
+
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = fildes;
+
+	uring_queue_sqe(ctx);
+	return 0;
+}
+
+void uring_cancel(struct uring_context *ctx, void *private_data)
+{
+	unsigned i;
+
+	for (i=0; i<ctx->num_jobs; i++) {
+		struct uring_job *job = &ctx->jobs[i];
+
+		if (job->busy && (job->private_data == private_data)) {
+			job->canceled = 1;
+		}
+	}
+}
+
+int uring_results(struct uring_context *ctx, struct uring_result *results,
+		  unsigned num_results)
+{
+	uint64_t val;
+	unsigned head, tail;
+	unsigned i = 0;
+	ssize_t nread;
+
+	/*
+	 * Clear the eventfd before looking at the ring: A completion
+	 * arriving after this will signal it again.
+	 */
+	nread = read(ctx->event_fd, &val, sizeof(val));
+	if ((nread == -1) && (errno != EAGAIN) && (errno != EINTR)) {
+		return -errno;
+	}
+
+	head = *ctx->cq_head;
+	tail = uring_load_acquire(ctx->cq_tail);
+
+	while ((head != tail) && (i < num_results)) {
+		struct io_uring_cqe *cqe = &ctx->cqes[head & ctx->cq_mask];
+		struct uring_result *result = &results[i];
+		struct uring_job *job;
+		uint64_t jobid = cqe->user_data;
+
+		head += 1;
+
+		if (jobid >= ctx->num_jobs) {
+			uring_store_release(ctx->cq_head, head);
+			return -EIO;
+		}
+		job = &ctx->jobs[jobid];
+
+		if (job->canceled) {
+			result->ret = -1;
+			result->err = ECANCELED;
+		} else if (cqe->res < 0) {
+			result->ret = -1;
+			result->err = -cqe->res;
+		} else {
+			result->ret = cqe->res;
+			result->err = 0;
+		}
+		result->private_data = job->private_data;
+
+		job->busy = 0;
+		ctx->free_jobs[ctx->num_free] = jobid;
+		ctx->num_free += 1;
+
+		i += 1;
+	}
+
+	uring_store_release(ctx->cq_head, head);
+
+	if (head != tail) {
+		/*
+		 * More completions than the caller wanted, keep the
+		 * signal fd readable.
+		 */
+		val = 1;
+		nread = write(ctx->event_fd, &val, sizeof(val));
+		if (nread != sizeof(val)) {
+			return -errno;
+		}
+	}
+
+	return i;
+}
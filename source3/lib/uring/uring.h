@@ -0,0 +1,130 @@
+/*
+ * Async I/O via the Linux io_uring interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "replace.h"
+#include "system/filesys.h"
+
+/**
+ * @defgroup uring Async I/O via io_uring
+ *
+ * This module offers the pread/pwrite/fsync subset of the asys API
+ * on top of the Linux io_uring interface. Instead of handing every
+ * request to a helper thread, the requests are put into a submission
+ * ring shared with the kernel.
+ *
+ * The basic flow of operations is:
+ *
+ * The application creates a uring_context structure using
+ * uring_context_init().
+ *
+ * The application queues requests with uring_pread(), uring_pwrite()
+ * and uring_fsync(). These do not enter the kernel, they only fill
+ * the submission ring. uring_submit() hands all queued requests to
+ * the kernel with a single system call, so an application should
+ * queue everything it has and then call uring_submit() once, for
+ * example from a tevent immediate. If the submission ring is full,
+ * the queueing functions submit on their own.
+ *
+ * The application puts the fd returned by uring_signalfd() into its
+ * event loop. When the signal fd becomes readable, the application
+ * calls uring_results() to grab the results of the requests that
+ * finished in the meantime.
+ *
+ * The requests are submitted with the credentials of the caller of
+ * uring_submit(), so only fd-based operations are offered.
+ *
+ * @{
+ */
+
+struct uring_context;
+
+/**
+ * @brief Create an io_uring context
+ *
+ * @param[out]	pctx	The new context
+ * @param[in]	entries	The size of the submission ring. At most
+ *			twice this number of requests can be in flight.
+ * @return		0 on success, an errno otherwise. ENOSYS or
+ *			EPERM mean the kernel does not offer io_uring.
+ */
+int uring_context_init(struct uring_context **pctx, unsigned entries);
+int uring_context_destroy(struct uring_context *ctx);
+
+/**
+ * @brief Get the signal fd
+ *
+ * uring_signalfd() returns an eventfd that will become readable
+ * whenever an asynchronous request has finished. When the signalfd is
+ * readable, calling uring_results() will not block.
+ *
+ * @param[in]	ctx	The uring context
+ * @return		A file descriptor indicating a finished operation
+ */
+int uring_signalfd(struct uring_context *ctx);
+
+struct uring_result {
+	ssize_t ret;
+	int err;
+	void *private_data;
+};
+
+/**
+ * @brief Pull the results from async operations
+ *
+ * If not all finished requests fit into the results array, the
+ * signal fd stays readable.
+ *
+ * @param[in]	ctx	    The uring context
+ * @param[out]  results     The result structs
+ * @param[in]   num_results The length of the results array
+ * @return		    success: >=0, number of finished jobs
+ *                          failure: -errno
+ */
+int uring_results(struct uring_context *ctx, struct uring_result *results,
+		  unsigned num_results);
+
+/**
+ * @brief Hand all queued requests to the kernel
+ *
+ * @param[in]	ctx	The uring context
+ * @return		0 on success, an errno otherwise
+ */
+int uring_submit(struct uring_context *ctx);
+
+/**
+ * @brief Number of requests queued but not yet submitted
+ */
+unsigned uring_queued(struct uring_context *ctx);
+
+void uring_cancel(struct uring_context *ctx, void *private_data);
+
+/*
+ * These return EAGAIN if the maximum number of requests is already in
+ * flight. The caller should then use a different way to do the I/O.
+ */
+int uring_pread(struct uring_context *ctx, int fildes, void *buf,
+		size_t nbyte, off_t offset, void *private_data);
+int uring_pwrite(struct uring_context *ctx, int fildes, const void *buf,
+		 size_t nbyte, off_t offset, void *private_data);
+int uring_fsync(struct uring_context *ctx, int fildes, void *private_data);
+
+/* @} */
+
+#endif /* __URING_H__ */
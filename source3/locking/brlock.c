@@ -359,6 +359,12 @@ void brl_init(bool read_only)
 		 * propagation has a delay.
 		 */
 		tdb_flags |= TDB_SEQNUM;
+
+		/*
+		 * ctdb only knows about the jenkins hash
+		 * and the classic freelist.
+		 */
+		tdb_flags |= TDB_XXHASH|TDB_FREELIST_CLASSES;
 	}
 
 	db_path = lock_path("brlock.tdb");
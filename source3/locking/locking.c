@@ -646,6 +646,67 @@ bool is_valid_share_mode_entry(const struct share_mode_entry *e)
 	return (num_props != 0);
 }
 
+static int share_mode_u64_cmp(uint64_t a, uint64_t b)
+{
+	if (a == b) {
+		return 0;
+	}
+	return (a < b) ? -1 : 1;
+}
+
+/*
+ * Order of the share mode entries, both in memory and in the record
+ */
+
+int share_mode_entry_cmp(struct server_id pid1, uint64_t share_file_id1,
+			 struct server_id pid2, uint64_t share_file_id2)
+{
+	int cmp;
+
+	cmp = share_mode_u64_cmp(pid1.pid, pid2.pid);
+	if (cmp != 0) {
+		return cmp;
+	}
+	cmp = share_mode_u64_cmp(pid1.task_id, pid2.task_id);
+	if (cmp != 0) {
+		return cmp;
+	}
+	cmp = share_mode_u64_cmp(pid1.vnn, pid2.vnn);
+	if (cmp != 0) {
+		return cmp;
+	}
+	cmp = share_mode_u64_cmp(pid1.unique_id, pid2.unique_id);
+	if (cmp != 0) {
+		return cmp;
+	}
+	return share_mode_u64_cmp(share_file_id1, share_file_id2);
+}
+
+/*
+ * Index of the first entry not sorting before pid/share_file_id
+ */
+
+static uint32_t share_mode_entry_lower_bound(const struct share_mode_data *d,
+					     struct server_id pid,
+					     uint64_t share_file_id)
+{
+	uint32_t lo = 0;
+	uint32_t hi = d->num_share_modes;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const struct share_mode_entry *e = &d->share_modes[mid];
+
+		if (share_mode_entry_cmp(e->pid, e->share_file_id,
+					 pid, share_file_id) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
 /*
  * See if we need to remove a lease being referred to by a
  * share mode that is being marked stale or deleted.
@@ -794,17 +855,21 @@ bool share_mode_stale_pid(struct share_mode_data *d, uint32_t idx)
 void remove_stale_share_mode_entries(struct share_mode_data *d)
 {
 	uint32_t i;
+	uint32_t num_valid = 0;
 
-	i = 0;
-	while (i < d->num_share_modes) {
+	/*
+	 * Keep the order, see share_mode_entry_cmp()
+	 */
+	for (i=0; i<d->num_share_modes; i++) {
 		if (d->share_modes[i].stale) {
-			struct share_mode_entry *m = d->share_modes;
-			m[i] = m[d->num_share_modes-1];
-			d->num_share_modes -= 1;
-		} else {
-			i += 1;
+			continue;
 		}
+		if (i != num_valid) {
+			d->share_modes[num_valid] = d->share_modes[i];
+		}
+		num_valid += 1;
 	}
+	d->num_share_modes = num_valid;
 }
 
 bool set_share_mode(struct share_mode_lock *lck, struct files_struct *fsp,
@@ -814,6 +879,8 @@ bool set_share_mode(struct share_mode_lock *lck, struct files_struct *fsp,
 	struct share_mode_data *d = lck->data;
 	struct share_mode_entry *tmp, *e;
 	struct share_mode_lease *lease = NULL;
+	struct server_id pid = messaging_server_id(fsp->conn->sconn->msg_ctx);
+	uint32_t idx;
 
 	if (lease_idx == UINT32_MAX) {
 		lease = NULL;
@@ -829,12 +896,21 @@ bool set_share_mode(struct share_mode_lock *lck, struct files_struct *fsp,
 		return false;
 	}
 	d->share_modes = tmp;
-	e = &d->share_modes[d->num_share_modes];
+
+	/*
+	 * Insert sorted, so that find_share_mode_entry() can do a
+	 * binary search and the record does not need to be sorted
+	 * when it's stored.
+	 */
+	idx = share_mode_entry_lower_bound(d, pid, fsp->fh->gen_id);
+	memmove(&d->share_modes[idx+1], &d->share_modes[idx],
+		sizeof(struct share_mode_entry) * (d->num_share_modes - idx));
+	e = &d->share_modes[idx];
 	d->num_share_modes += 1;
 	d->modified = true;
 
 	ZERO_STRUCTP(e);
-	e->pid = messaging_server_id(fsp->conn->sconn->msg_ctx);
+	e->pid = pid;
 	e->share_access = fsp->share_access;
 	e->private_options = fsp->fh->private_options;
 	e->access_mask = fsp->access_mask;
@@ -859,10 +935,32 @@ static struct share_mode_entry *find_share_mode_entry(
 {
 	struct share_mode_data *d = lck->data;
 	struct server_id pid;
-	int i;
+	uint32_t i;
 
 	pid = messaging_server_id(fsp->conn->sconn->msg_ctx);
 
+	i = share_mode_entry_lower_bound(d, pid, fsp->fh->gen_id);
+
+	for (; i<d->num_share_modes; i++) {
+		struct share_mode_entry *e = &d->share_modes[i];
+
+		if (share_mode_entry_cmp(e->pid, e->share_file_id,
+					 pid, fsp->fh->gen_id) != 0) {
+			break;
+		}
+		if (!is_valid_share_mode_entry(e)) {
+			continue;
+		}
+		if (!file_id_equal(&fsp->file_id, &e->id)) {
+			continue;
+		}
+		return e;
+	}
+
+	/*
+	 * Someone might have modified the entries without keeping
+	 * them sorted. Look at all of them before giving up.
+	 */
 	for (i=0; i<d->num_share_modes; i++) {
 		struct share_mode_entry *e = &d->share_modes[i];
 
@@ -897,7 +995,10 @@ bool del_share_mode(struct share_mode_lock *lck, files_struct *fsp)
 		return False;
 	}
 	remove_share_mode_lease(lck->data, e);
-	*e = lck->data->share_modes[lck->data->num_share_modes-1];
+	/* Keep the order, see share_mode_entry_cmp() */
+	memmove(e, e+1,
+		sizeof(struct share_mode_entry) *
+		(lck->data->num_share_modes - (e - lck->data->share_modes) - 1));
 	lck->data->num_share_modes -= 1;
 	lck->data->modified = True;
 	return True;
@@ -58,23 +58,41 @@
 /* the locking database handle */
 static struct db_context *lock_db;
 
+static bool share_mode_entry_size_init(void);
+
 static bool locking_init_internal(bool read_only)
 {
+	int tdb_flags;
 	char *db_path;
 
+	if (!share_mode_entry_size_init()) {
+		return false;
+	}
+
 	brl_init(read_only);
 
 	if (lock_db)
 		return True;
 
+	tdb_flags = TDB_DEFAULT|TDB_VOLATILE|TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH;
+
+	if (!lp_clustering()) {
+		/*
+		 * ctdb only knows about the jenkins hash
+		 * and the classic freelist, so we can only
+		 * use the faster xxhash and the size class
+		 * freelists for the local case.
+		 */
+		tdb_flags |= TDB_XXHASH|TDB_FREELIST_CLASSES;
+	}
+
 	db_path = lock_path("locking.tdb");
 	if (db_path == NULL) {
 		return false;
 	}
 
 	lock_db = db_open(NULL, db_path,
-			  SMB_OPEN_DATABASE_TDB_HASH_SIZE,
-			  TDB_DEFAULT|TDB_VOLATILE|TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH,
+			  SMB_OPEN_DATABASE_TDB_HASH_SIZE, tdb_flags,
 			  read_only?O_RDONLY:O_RDWR|O_CREAT, 0644,
 			  DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
 	TALLOC_FREE(db_path);
@@ -178,17 +196,225 @@ static void share_mode_memcache_store(struct share_mode_data *d)
 			&d);
 }
 
+/*******************************************************************
+ A locking.tdb record looks like this:
+
+ [uint32 hdr_len][hdr_len bytes share_mode_data][share mode entries]
+
+ The share_mode_data NDR blob is stored with num_share_modes == 0.
+ The share mode entries follow it as an array of NOALIGN NDR encoded
+ share_mode_entry structs. They all have the same size and are
+ sorted by pid and share_file_id, see share_mode_entry_cmp().
+
+ This way storing a record with thousands of opens does not have to
+ marshall all entries again. unparse_share_modes() only encodes the
+ entries that have been added or changed, the others are copied
+ from the old record.
+******************************************************************/
+
+/* Bounds the stack buffer of share_mode_entry_push() */
+#define SHARE_MODE_ENTRY_MAX_SIZE 256
+
+static size_t share_mode_entry_size;
+
+/*
+ * share_mode_entry has no variable length members, every entry takes
+ * as many bytes as a zeroed one.
+ */
+
+static bool share_mode_entry_size_init(void)
+{
+	struct share_mode_entry e;
+	struct ndr_push *ndr;
+	enum ndr_err_code ndr_err;
+
+	if (share_mode_entry_size != 0) {
+		return true;
+	}
+
+	ZERO_STRUCT(e);
+
+	ndr = ndr_push_init_ctx(talloc_tos());
+	if (ndr == NULL) {
+		DEBUG(0, ("ndr_push_init_ctx failed\n"));
+		return false;
+	}
+	ndr->flags = LIBNDR_FLAG_NOALIGN;
+
+	ndr_err = ndr_push_share_mode_entry(ndr, NDR_SCALARS, &e);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DEBUG(0, ("ndr_push_share_mode_entry failed: %s\n",
+			  ndr_errstr(ndr_err)));
+		TALLOC_FREE(ndr);
+		return false;
+	}
+	if (ndr->offset > SHARE_MODE_ENTRY_MAX_SIZE) {
+		DEBUG(0, ("share mode entry has %u bytes, at most %u "
+			  "supported\n", (unsigned)ndr->offset,
+			  (unsigned)SHARE_MODE_ENTRY_MAX_SIZE));
+		TALLOC_FREE(ndr);
+		return false;
+	}
+	share_mode_entry_size = ndr->offset;
+	TALLOC_FREE(ndr);
+
+	return true;
+}
+
+static bool share_mode_entry_pull(const uint8_t *buf,
+				  struct share_mode_entry *e)
+{
+	struct ndr_pull ndr = {
+		.data = discard_const_p(uint8_t, buf),
+		.data_size = share_mode_entry_size,
+		.flags = LIBNDR_FLAG_NOALIGN,
+	};
+	enum ndr_err_code ndr_err;
+
+	ndr_err = ndr_pull_share_mode_entry(&ndr, NDR_SCALARS, e);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DEBUG(1, ("ndr_pull_share_mode_entry failed: %s\n",
+			  ndr_errstr(ndr_err)));
+		return false;
+	}
+	if (ndr.offset != share_mode_entry_size) {
+		DEBUG(1, ("share mode entry has %u bytes, expected %u\n",
+			  (unsigned)ndr.offset,
+			  (unsigned)share_mode_entry_size));
+		return false;
+	}
+
+	/*
+	 * Initialize the values that are [skip] in the idl. The NDR code
+	 * does not initialize them.
+	 */
+	e->stale = false;
+	e->lease = NULL;
+
+	return true;
+}
+
+static void share_mode_entry_push(const struct share_mode_entry *e,
+				  uint8_t *buf)
+{
+	/*
+	 * Twice the size so that ndr_push_expand() never has to
+	 * talloc_realloc our stack buffer
+	 */
+	uint8_t tmp[SHARE_MODE_ENTRY_MAX_SIZE * 2];
+	struct ndr_push ndr = {
+		.data = tmp,
+		.alloc_size = sizeof(tmp),
+		.flags = LIBNDR_FLAG_NOALIGN,
+	};
+	struct share_mode_entry copy = *e;
+	enum ndr_err_code ndr_err;
+
+	/*
+	 * The [skip] lease pointer still leaves a pointer marker in
+	 * the blob. Make it NULL, share_mode_entry_pull() must not
+	 * allocate anything. There are no buffers to push, the
+	 * NDR_BUFFERS part would only add a copy of the time.
+	 */
+	copy.lease = NULL;
+
+	ndr_err = ndr_push_share_mode_entry(&ndr, NDR_SCALARS, &copy);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		smb_panic("ndr_push_share_mode_entry failed");
+	}
+	if (ndr.offset != share_mode_entry_size) {
+		smb_panic("share mode entry size mismatch");
+	}
+
+	memcpy(buf, tmp, share_mode_entry_size);
+}
+
+/*
+ * Only compare what ends up in the record, the [skip] fields don't
+ * matter.
+ */
+
+static bool share_mode_entry_equal(const struct share_mode_entry *e1,
+				   const struct share_mode_entry *e2)
+{
+	return (server_id_equal(&e1->pid, &e2->pid) &&
+		(e1->op_mid == e2->op_mid) &&
+		(e1->op_type == e2->op_type) &&
+		(e1->lease_idx == e2->lease_idx) &&
+		(e1->access_mask == e2->access_mask) &&
+		(e1->share_access == e2->share_access) &&
+		(e1->private_options == e2->private_options) &&
+		(e1->time.tv_sec == e2->time.tv_sec) &&
+		(e1->time.tv_usec == e2->time.tv_usec) &&
+		file_id_equal(&e1->id, &e2->id) &&
+		(e1->share_file_id == e2->share_file_id) &&
+		(e1->uid == e2->uid) &&
+		(e1->flags == e2->flags) &&
+		(e1->name_hash == e2->name_hash));
+}
+
+static int share_mode_entry_sort_cmp(const struct share_mode_entry *e1,
+				     const struct share_mode_entry *e2)
+{
+	return share_mode_entry_cmp(e1->pid, e1->share_file_id,
+				    e2->pid, e2->share_file_id);
+}
+
+/*
+ * Find the entries in a record. Returns false for records that don't
+ * follow the layout described above.
+ */
+
+static bool share_mode_record_split(const TDB_DATA dbuf,
+				    DATA_BLOB *hdr,
+				    const uint8_t **entries,
+				    uint32_t *num_entries)
+{
+	uint32_t hdr_len;
+	size_t entries_len;
+
+	if (dbuf.dsize < sizeof(uint32_t)) {
+		return false;
+	}
+	hdr_len = IVAL(dbuf.dptr, 0);
+	if (hdr_len > dbuf.dsize - sizeof(uint32_t)) {
+		return false;
+	}
+	entries_len = dbuf.dsize - sizeof(uint32_t) - hdr_len;
+	if ((entries_len % share_mode_entry_size) != 0) {
+		return false;
+	}
+
+	*hdr = data_blob_const(dbuf.dptr + sizeof(uint32_t), hdr_len);
+	*entries = hdr->data + hdr_len;
+	*num_entries = entries_len / share_mode_entry_size;
+	return true;
+}
+
 /*
  * NB. We use ndr_pull_hyper on a stack-created
  * struct ndr_pull with no talloc allowed, as we
  * need this to be really fast as an ndr-peek into
- * the first 8 bytes of the blob.
+ * the first 8 bytes of the share_mode_data blob.
  */
 
 static enum ndr_err_code get_blob_sequence_number(DATA_BLOB *blob,
 						uint64_t *pseq)
 {
-	struct ndr_pull ndr = {.data = blob->data, .data_size = blob->length};
+	struct ndr_pull ndr;
+
+	if (blob->length < sizeof(uint32_t)) {
+		return NDR_ERR_BUFSIZE;
+	}
+
+	/*
+	 * Start at the share_mode_data, ndr_pull_hyper aligns to 8
+	 * bytes.
+	 */
+	ndr = (struct ndr_pull) {
+		.data = blob->data + sizeof(uint32_t),
+		.data_size = blob->length - sizeof(uint32_t),
+	};
 	NDR_CHECK(ndr_pull_hyper(&ndr, NDR_SCALARS, pseq));
 	return NDR_ERR_SUCCESS;
 }
@@ -225,7 +451,7 @@ static struct share_mode_data *share_mode_memcache_fetch(TALLOC_CTX *mem_ctx,
 			file_id_string(mem_ctx, &id)));
 		return NULL;
 	}
-	/* sequence number key is at start of blob. */
+	/* sequence number key is at start of the share_mode_data. */
 	ndr_err = get_blob_sequence_number(blob, &sequence_number);
 	if (ndr_err != NDR_ERR_SUCCESS) {
 		/* Bad blob. Remove entry. */
@@ -278,25 +504,23 @@ static struct share_mode_data *share_mode_memcache_fetch(TALLOC_CTX *mem_ctx,
 }
 
 /*******************************************************************
- Get all share mode entries for a dev/inode pair.
+ Pull a share_mode_data struct including the share mode entries out
+ of a locking.tdb record.
 ********************************************************************/
 
-static struct share_mode_data *parse_share_modes(TALLOC_CTX *mem_ctx,
-						const TDB_DATA key,
-						const TDB_DATA dbuf)
+static struct share_mode_data *share_mode_data_pull(TALLOC_CTX *mem_ctx,
+						   const TDB_DATA dbuf)
 {
 	struct share_mode_data *d;
 	enum ndr_err_code ndr_err;
-	uint32_t i;
-	DATA_BLOB blob;
+	DATA_BLOB hdr;
+	const uint8_t *entries;
+	uint32_t i, num_entries;
 
-	blob.data = dbuf.dptr;
-	blob.length = dbuf.dsize;
-
-	/* See if we already have a cached copy of this key. */
-	d = share_mode_memcache_fetch(mem_ctx, key, &blob);
-	if (d != NULL) {
-		return d;
+	if (!share_mode_record_split(dbuf, &hdr, &entries, &num_entries)) {
+		DEBUG(1, ("invalid share mode record of %u bytes\n",
+			  (unsigned)dbuf.dsize));
+		return NULL;
 	}
 
 	d = talloc(mem_ctx, struct share_mode_data);
@@ -306,23 +530,35 @@ static struct share_mode_data *parse_share_modes(TALLOC_CTX *mem_ctx,
 	}
 
 	ndr_err = ndr_pull_struct_blob_all(
-		&blob, d, d, (ndr_pull_flags_fn_t)ndr_pull_share_mode_data);
+		&hdr, d, d, (ndr_pull_flags_fn_t)ndr_pull_share_mode_data);
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
 		DEBUG(1, ("ndr_pull_share_mode_lock failed: %s\n",
 			  ndr_errstr(ndr_err)));
 		goto fail;
 	}
+	if (d->num_share_modes != 0) {
+		DEBUG(1, ("share mode record header with %u entries\n",
+			  (unsigned)d->num_share_modes));
+		goto fail;
+	}
 
-	/*
-	 * Initialize the values that are [skip] in the idl. The NDR code does
-	 * not initialize them.
-	 */
+	TALLOC_FREE(d->share_modes);
+	d->share_modes = talloc_array(d, struct share_mode_entry,
+				      num_entries);
+	if (d->share_modes == NULL) {
+		DEBUG(0, ("talloc failed\n"));
+		goto fail;
+	}
 
-	for (i=0; i<d->num_share_modes; i++) {
+	for (i=0; i<num_entries; i++) {
 		struct share_mode_entry *e = &d->share_modes[i];
+		bool ok;
 
-		e->stale = false;
-		e->lease = NULL;
+		ok = share_mode_entry_pull(
+			entries + i * share_mode_entry_size, e);
+		if (!ok) {
+			goto fail;
+		}
 		if (e->op_type != LEASE_OPLOCK) {
 			continue;
 		}
@@ -331,11 +567,15 @@ static struct share_mode_data *parse_share_modes(TALLOC_CTX *mem_ctx,
 		}
 		e->lease = &d->leases[e->lease_idx];
 	}
+	d->num_share_modes = num_entries;
+
 	d->modified = false;
 	d->fresh = false;
+	d->stored_share_modes = NULL;
+	d->num_stored_share_modes = 0;
 
 	if (DEBUGLEVEL >= 10) {
-		DEBUG(10, ("parse_share_modes:\n"));
+		DEBUG(10, ("share_mode_data_pull:\n"));
 		NDR_PRINT_DEBUG(share_mode_data, d);
 	}
 
@@ -345,14 +585,61 @@ fail:
 	return NULL;
 }
 
+/*******************************************************************
+ Get all share mode entries for a dev/inode pair.
+********************************************************************/
+
+static struct share_mode_data *parse_share_modes(TALLOC_CTX *mem_ctx,
+						const TDB_DATA key,
+						const TDB_DATA dbuf)
+{
+	struct share_mode_data *d;
+	DATA_BLOB blob;
+
+	blob.data = dbuf.dptr;
+	blob.length = dbuf.dsize;
+
+	/* See if we already have a cached copy of this key. */
+	d = share_mode_memcache_fetch(mem_ctx, key, &blob);
+	if (d != NULL) {
+		return d;
+	}
+
+	d = share_mode_data_pull(mem_ctx, dbuf);
+	if (d == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * Remember what's in the record, unparse_share_modes() will
+	 * only have to encode the entries that differ.
+	 */
+	d->stored_share_modes = talloc_memdup(
+		d, d->share_modes,
+		sizeof(struct share_mode_entry) * d->num_share_modes);
+	if ((d->stored_share_modes == NULL) && (d->num_share_modes != 0)) {
+		DEBUG(0, ("talloc failed\n"));
+		TALLOC_FREE(d);
+		return NULL;
+	}
+	d->num_stored_share_modes = d->num_share_modes;
+
+	return d;
+}
+
 /*******************************************************************
  Create a storable data blob from a modified share_mode_data struct.
 ********************************************************************/
 
 static TDB_DATA unparse_share_modes(struct share_mode_data *d)
 {
-	DATA_BLOB blob;
+	DATA_BLOB hdr;
 	enum ndr_err_code ndr_err;
+	struct share_mode_entry *share_modes, *stored;
+	uint32_t i, j, num_share_modes, num_stored;
+	const uint8_t *old_entries = NULL;
+	uint8_t *buf, *entries;
+	size_t len;
 
 	if (DEBUGLEVEL >= 10) {
 		DEBUG(10, ("unparse_share_modes:\n"));
@@ -371,13 +658,103 @@ static TDB_DATA unparse_share_modes(struct share_mode_data *d)
 		return make_tdb_data(NULL, 0);
 	}
 
+	for (i=1; i<d->num_share_modes; i++) {
+		if (share_mode_entry_sort_cmp(&d->share_modes[i-1],
+					      &d->share_modes[i]) > 0) {
+			break;
+		}
+	}
+	if (i < d->num_share_modes) {
+		TYPESAFE_QSORT(d->share_modes, d->num_share_modes,
+			       share_mode_entry_sort_cmp);
+	}
+
+	/*
+	 * The header is the share_mode_data without the entries
+	 */
+	share_modes = d->share_modes;
+	num_share_modes = d->num_share_modes;
+	d->share_modes = NULL;
+	d->num_share_modes = 0;
+
 	ndr_err = ndr_push_struct_blob(
-		&blob, d, d, (ndr_push_flags_fn_t)ndr_push_share_mode_data);
+		&hdr, d, d, (ndr_push_flags_fn_t)ndr_push_share_mode_data);
+
+	d->share_modes = share_modes;
+	d->num_share_modes = num_share_modes;
+
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
 		smb_panic("ndr_push_share_mode_lock failed");
 	}
 
-	return make_tdb_data(blob.data, blob.length);
+	len = sizeof(uint32_t) + hdr.length +
+		(size_t)num_share_modes * share_mode_entry_size;
+	buf = talloc_size(d, len);
+	if (buf == NULL) {
+		smb_panic("talloc failed");
+	}
+	SIVAL(buf, 0, hdr.length);
+	memcpy(buf + sizeof(uint32_t), hdr.data, hdr.length);
+	entries = buf + sizeof(uint32_t) + hdr.length;
+	TALLOC_FREE(hdr.data);
+
+	stored = d->stored_share_modes;
+	num_stored = 0;
+
+	if ((d->record != NULL) && !d->fresh) {
+		TDB_DATA old = dbwrap_record_get_value(d->record);
+		DATA_BLOB old_hdr;
+		uint32_t num_old;
+		bool ok;
+
+		ok = share_mode_record_split(old, &old_hdr, &old_entries,
+					     &num_old);
+		if (ok && (num_old == d->num_stored_share_modes)) {
+			num_stored = num_old;
+		}
+	}
+
+	/*
+	 * Both arrays are sorted. Walk them in parallel and copy what
+	 * did not change.
+	 */
+	j = 0;
+	for (i=0; i<num_share_modes; i++) {
+		const struct share_mode_entry *e = &share_modes[i];
+		uint8_t *p = entries + i * share_mode_entry_size;
+
+		while ((j < num_stored) &&
+		       (share_mode_entry_sort_cmp(&stored[j], e) < 0)) {
+			j += 1;
+		}
+		if ((j < num_stored) && share_mode_entry_equal(&stored[j], e)) {
+			memcpy(p, old_entries + j * share_mode_entry_size,
+			       share_mode_entry_size);
+			j += 1;
+			continue;
+		}
+		share_mode_entry_push(e, p);
+	}
+
+	/*
+	 * What we store is what the next unparse_share_modes() from
+	 * the memcache will compare against.
+	 */
+	if (talloc_get_size(stored) <
+	    sizeof(struct share_mode_entry) * num_share_modes) {
+		TALLOC_FREE(d->stored_share_modes);
+		stored = talloc_array(d, struct share_mode_entry,
+				      num_share_modes);
+		if (stored == NULL) {
+			smb_panic("talloc failed");
+		}
+		d->stored_share_modes = stored;
+	}
+	memcpy(stored, share_modes,
+	       sizeof(struct share_mode_entry) * num_share_modes);
+	d->num_stored_share_modes = num_share_modes;
+
+	return make_tdb_data(buf, len);
 }
 
 /*******************************************************************
@@ -660,11 +1037,8 @@ static int share_mode_traverse_fn(struct db_record *rec, void *_state)
 {
 	struct share_mode_forall_state *state =
 		(struct share_mode_forall_state *)_state;
-	uint32_t i;
 	TDB_DATA key;
 	TDB_DATA value;
-	DATA_BLOB blob;
-	enum ndr_err_code ndr_err;
 	struct share_mode_data *d;
 	struct file_id fid;
 	int ret;
@@ -678,32 +1052,11 @@ static int share_mode_traverse_fn(struct db_record *rec, void *_state)
 	}
 	memcpy(&fid, key.dptr, sizeof(fid));
 
-	d = talloc(talloc_tos(), struct share_mode_data);
+	d = share_mode_data_pull(talloc_tos(), value);
 	if (d == NULL) {
 		return 0;
 	}
 
-	blob.data = value.dptr;
-	blob.length = value.dsize;
-
-	ndr_err = ndr_pull_struct_blob_all(
-		&blob, d, d, (ndr_pull_flags_fn_t)ndr_pull_share_mode_data);
-	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
-		DEBUG(1, ("ndr_pull_share_mode_lock failed\n"));
-		return 0;
-	}
-
-	for (i=0; i<d->num_share_modes; i++) {
-		struct share_mode_entry *entry = &d->share_modes[i];
-		entry->stale = false; /* [skip] in idl */
-		entry->lease = &d->leases[entry->lease_idx];
-	}
-
-	if (DEBUGLEVEL > 10) {
-		DEBUG(11, ("parse_share_modes:\n"));
-		NDR_PRINT_DEBUG(share_mode_data, d);
-	}
-
 	ret = state->fn(fid, d, state->private_data);
 
 	TALLOC_FREE(d);
@@ -749,6 +749,64 @@ static int vfswrap_asys_state_destructor(struct vfswrap_asys_state *s)
 	return 0;
 }
 
+/*
+ * Metadata jobs run on behalf of requests that can go away while the
+ * worker thread is still busy, for example a directory prefetch of a
+ * client that disconnects. The worker only touches memory owned by
+ * the job: the credentials, the path, the name and the result
+ * buffers. A request going away just detaches from its job,
+ * vfswrap_asys_finished() frees the job once the worker is done.
+ */
+struct vfswrap_asys_job {
+	struct tevent_req *req;
+	bool done;
+	struct asys_creds_context *cctx;
+	char *path;
+	char *name;
+	struct stat st;
+	uint8_t *value;
+	ssize_t ret;
+	int err;
+	SMBPROFILE_BASIC_ASYNC_STATE(profile_basic);
+};
+
+static int vfswrap_asys_job_destructor(struct vfswrap_asys_job *job)
+{
+	if (job->cctx != NULL) {
+		asys_creds_context_delete(job->cctx);
+	}
+	return 0;
+}
+
+static struct vfswrap_asys_job *vfswrap_asys_job_create(
+	struct tevent_req *req)
+{
+	struct vfswrap_asys_job *job;
+
+	job = talloc_zero(NULL, struct vfswrap_asys_job);
+	if (job == NULL) {
+		return NULL;
+	}
+	job->req = req;
+	talloc_set_destructor(job, vfswrap_asys_job_destructor);
+	return job;
+}
+
+/*
+ * Called from the destructor of the request state
+ */
+static void vfswrap_asys_job_release(struct vfswrap_asys_job *job)
+{
+	if (job == NULL) {
+		return;
+	}
+	if (job->done) {
+		TALLOC_FREE(job);
+		return;
+	}
+	job->req = NULL;
+}
+
 static struct tevent_req *vfswrap_pread_send(struct vfs_handle_struct *handle,
 					     TALLOC_CTX *mem_ctx,
 					     struct tevent_context *ev,
@@ -854,14 +912,19 @@ static void vfswrap_asys_finished(struct tevent_context *ev,
 					uint16_t flags, void *p)
 {
 	struct asys_context *asys_ctx = (struct asys_context *)p;
-	struct asys_result results[get_outstanding_aio_calls()];
+	/*
+	 * Detached jobs may still come back after their callers have
+	 * dropped the outstanding count, always collect at least one
+	 */
+	int num_results = MAX(get_outstanding_aio_calls(), 1);
+	struct asys_result results[num_results];
 	int i, ret;
 
 	if ((flags & TEVENT_FD_READ) == 0) {
 		return;
 	}
 
-	ret = asys_results(asys_ctx, results, get_outstanding_aio_calls());
+	ret = asys_results(asys_ctx, results, num_results);
 	if (ret < 0) {
 		DEBUG(1, ("asys_results returned %s\n", strerror(-ret)));
 		return;
@@ -869,6 +932,7 @@ static void vfswrap_asys_finished(struct tevent_context *ev,
 
 	for (i=0; i<ret; i++) {
 		struct asys_result *result = &results[i];
+		struct vfswrap_asys_job *job;
 		struct tevent_req *req;
 		struct vfswrap_asys_state *state;
 
@@ -876,6 +940,23 @@ static void vfswrap_asys_finished(struct tevent_context *ev,
 			continue;
 		}
 
+		job = talloc_get_type(result->private_data,
+				      struct vfswrap_asys_job);
+		if (job != NULL) {
+			SMBPROFILE_BASIC_ASYNC_END(job->profile_basic);
+			if (job->req == NULL) {
+				/* Nobody waits for it anymore */
+				TALLOC_FREE(job);
+				continue;
+			}
+			job->done = true;
+			job->ret = result->ret;
+			job->err = result->err;
+			tevent_req_defer_callback(job->req, ev);
+			tevent_req_done(job->req);
+			continue;
+		}
+
 		req = talloc_get_type_abort(result->private_data,
 					    struct tevent_req);
 		state = tevent_req_data(req, struct vfswrap_asys_state);
@@ -1030,6 +1111,201 @@ static int vfswrap_fstat(vfs_handle_struct *handle, files_struct *fsp, SMB_STRUC
 	return result;
 }
 
+struct vfswrap_fstat_state {
+	struct vfswrap_asys_job *job;
+	SMB_STRUCT_STAT *sbuf;
+	bool fake_dir_create_times;
+};
+
+static int vfswrap_fstat_state_destructor(struct vfswrap_fstat_state *s)
+{
+	vfswrap_asys_job_release(s->job);
+	return 0;
+}
+
+static struct tevent_req *vfswrap_fstat_send(struct vfs_handle_struct *handle,
+					     TALLOC_CTX *mem_ctx,
+					     struct tevent_context *ev,
+					     struct files_struct *fsp,
+					     SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req;
+	struct vfswrap_fstat_state *state;
+	struct vfswrap_asys_job *job;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state, struct vfswrap_fstat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->sbuf = sbuf;
+	state->fake_dir_create_times =
+		lp_fake_directory_create_times(SNUM(handle->conn));
+
+	if (!vfswrap_init_asys_ctx(handle->conn->sconn)) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	job = vfswrap_asys_job_create(req);
+	if (tevent_req_nomem(job, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BASIC_ASYNC_START(syscall_asys_fstat, profile_p,
+				     job->profile_basic);
+	ret = asys_fstat(handle->conn->sconn->asys_ctx, fsp->fh->fd,
+			 &job->st, job);
+	if (ret != 0) {
+		TALLOC_FREE(job);
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+	state->job = job;
+	talloc_set_destructor(state, vfswrap_fstat_state_destructor);
+
+	return req;
+}
+
+/*
+ * Hand out the stat result of a finished job
+ */
+static int vfswrap_asys_job_stat(struct vfswrap_asys_job *job,
+				 SMB_STRUCT_STAT *sbuf,
+				 bool fake_dir_create_times, int *err)
+{
+	*err = job->err;
+	if (job->ret != 0) {
+		return job->ret;
+	}
+	/* we always want directories to appear zero size */
+	if (S_ISDIR(job->st.st_mode)) {
+		job->st.st_size = 0;
+	}
+	init_stat_ex_from_stat(sbuf, &job->st, fake_dir_create_times);
+	return 0;
+}
+
+static int vfswrap_fstat_recv(struct tevent_req *req, int *err)
+{
+	struct vfswrap_fstat_state *state = tevent_req_data(
+		req, struct vfswrap_fstat_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	return vfswrap_asys_job_stat(state->job, state->sbuf,
+				     state->fake_dir_create_times, err);
+}
+
+/*
+ * Path based calls run on a worker thread with the credentials of the
+ * current user. The thread must not depend on our working directory.
+ * The job gets its own copy of the absolute path.
+ */
+static bool vfswrap_asys_job_creds(struct vfs_handle_struct *handle,
+				   struct vfswrap_asys_job *job,
+				   const char *path)
+{
+	const struct security_unix_token *utok;
+
+	if (path[0] == '/') {
+		job->path = talloc_strdup(job, path);
+	} else {
+		job->path = talloc_asprintf(job, "%s/%s",
+					    handle->conn->cwd, path);
+	}
+	if (job->path == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	utok = get_current_utok(handle->conn);
+	job->cctx = asys_creds_context_create(handle->conn->sconn->asys_ctx,
+					      utok->uid, utok->gid,
+					      utok->ngroups, utok->groups);
+	return (job->cctx != NULL);
+}
+
+struct vfswrap_stat_state {
+	struct vfswrap_asys_job *job;
+	SMB_STRUCT_STAT *sbuf;
+	bool fake_dir_create_times;
+};
+
+static int vfswrap_stat_state_destructor(struct vfswrap_stat_state *s)
+{
+	vfswrap_asys_job_release(s->job);
+	return 0;
+}
+
+static struct tevent_req *vfswrap_stat_send(struct vfs_handle_struct *handle,
+					    TALLOC_CTX *mem_ctx,
+					    struct tevent_context *ev,
+					    const struct smb_filename *smb_fname,
+					    SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req;
+	struct vfswrap_stat_state *state;
+	struct vfswrap_asys_job *job;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state, struct vfswrap_stat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->sbuf = sbuf;
+	state->fake_dir_create_times =
+		lp_fake_directory_create_times(SNUM(handle->conn));
+
+	if (smb_fname->stream_name) {
+		tevent_req_error(req, ENOENT);
+		return tevent_req_post(req, ev);
+	}
+
+	if (!vfswrap_init_asys_ctx(handle->conn->sconn)) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	job = vfswrap_asys_job_create(req);
+	if (tevent_req_nomem(job, req)) {
+		return tevent_req_post(req, ev);
+	}
+	if (!vfswrap_asys_job_creds(handle, job, smb_fname->base_name)) {
+		ret = errno;
+		TALLOC_FREE(job);
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BASIC_ASYNC_START(syscall_asys_stat, profile_p,
+				     job->profile_basic);
+	ret = asys_fstatat(handle->conn->sconn->asys_ctx, job->cctx,
+			   AT_FDCWD, job->path, &job->st, 0, job);
+	if (ret != 0) {
+		TALLOC_FREE(job);
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+	state->job = job;
+	talloc_set_destructor(state, vfswrap_stat_state_destructor);
+
+	return req;
+}
+
+static int vfswrap_stat_recv(struct tevent_req *req, int *err)
+{
+	struct vfswrap_stat_state *state = tevent_req_data(
+		req, struct vfswrap_stat_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	return vfswrap_asys_job_stat(state->job, state->sbuf,
+				     state->fake_dir_create_times, err);
+}
+
 static int vfswrap_lstat(vfs_handle_struct *handle,
 			 struct smb_filename *smb_fname)
 {
@@ -2426,6 +2702,91 @@ static ssize_t vfswrap_getxattr(struct vfs_handle_struct *handle,const char *pat
 	return getxattr(path, name, value, size);
 }
 
+struct vfswrap_getxattr_state {
+	struct vfswrap_asys_job *job;
+	void *value;
+	size_t size;
+};
+
+static int vfswrap_getxattr_state_destructor(struct vfswrap_getxattr_state *s)
+{
+	vfswrap_asys_job_release(s->job);
+	return 0;
+}
+
+static struct tevent_req *vfswrap_getxattr_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, const char *path, const char *name,
+	void *value, size_t size)
+{
+	struct tevent_req *req;
+	struct vfswrap_getxattr_state *state;
+	struct vfswrap_asys_job *job;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfswrap_getxattr_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->value = value;
+	state->size = size;
+
+	if (!vfswrap_init_asys_ctx(handle->conn->sconn)) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	job = vfswrap_asys_job_create(req);
+	if (tevent_req_nomem(job, req)) {
+		return tevent_req_post(req, ev);
+	}
+	job->name = talloc_strdup(job, name);
+	job->value = talloc_array(job, uint8_t, size);
+	if ((job->name == NULL) || (job->value == NULL)) {
+		TALLOC_FREE(job);
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+	if (!vfswrap_asys_job_creds(handle, job, path)) {
+		ret = errno;
+		TALLOC_FREE(job);
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BASIC_ASYNC_START(syscall_asys_getxattr, profile_p,
+				     job->profile_basic);
+	ret = asys_getxattr(handle->conn->sconn->asys_ctx, job->cctx,
+			    job->path, job->name, job->value, size, job);
+	if (ret != 0) {
+		TALLOC_FREE(job);
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+	state->job = job;
+	talloc_set_destructor(state, vfswrap_getxattr_state_destructor);
+
+	return req;
+}
+
+static ssize_t vfswrap_getxattr_recv(struct tevent_req *req, int *err)
+{
+	struct vfswrap_getxattr_state *state = tevent_req_data(
+		req, struct vfswrap_getxattr_state);
+	struct vfswrap_asys_job *job = state->job;
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = job->err;
+	if ((job->ret > 0) && (state->size != 0)) {
+		memcpy(state->value, job->value,
+		       MIN((size_t)job->ret, state->size));
+	}
+	return job->ret;
+}
+
 static ssize_t vfswrap_fgetxattr(struct vfs_handle_struct *handle, struct files_struct *fsp, const char *name, void *value, size_t size)
 {
 	return fgetxattr(fsp->fh->fd, name, value, size);
@@ -2591,6 +2952,10 @@ static struct vfs_fn_pointers vfs_default_fns = {
 	.fsync_recv_fn = vfswrap_asys_int_recv,
 	.stat_fn = vfswrap_stat,
 	.fstat_fn = vfswrap_fstat,
+	.fstat_send_fn = vfswrap_fstat_send,
+	.fstat_recv_fn = vfswrap_fstat_recv,
+	.stat_send_fn = vfswrap_stat_send,
+	.stat_recv_fn = vfswrap_stat_recv,
 	.lstat_fn = vfswrap_lstat,
 	.get_alloc_size_fn = vfswrap_get_alloc_size,
 	.unlink_fn = vfswrap_unlink,
@@ -2652,6 +3017,8 @@ static struct vfs_fn_pointers vfs_default_fns = {
 
 	/* EA operations. */
 	.getxattr_fn = vfswrap_getxattr,
+	.getxattr_send_fn = vfswrap_getxattr_send,
+	.getxattr_recv_fn = vfswrap_getxattr_recv,
 	.fgetxattr_fn = vfswrap_fgetxattr,
 	.listxattr_fn = vfswrap_listxattr,
 	.flistxattr_fn = vfswrap_flistxattr,
@@ -0,0 +1,289 @@
+/*
+ * Add a fixed latency to metadata calls, for testing how smbd copes
+ * with file systems where they go over the network
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "lib/util/tevent_unix.h"
+
+/*
+ * "delay_inject:stat = <usecs>" and "delay_inject:getxattr = <usecs>"
+ *
+ * The synchronous calls sleep, the _send variants complete that much
+ * later without blocking smbd, like a network file system would. An
+ * fstat and a readdir that returns stat information count as a stat.
+ */
+
+static unsigned delay_inject_usecs(struct vfs_handle_struct *handle,
+				   const char *op)
+{
+	return lp_parm_int(SNUM(handle->conn), "delay_inject", op, 0);
+}
+
+static struct dirent *delay_inject_readdir(struct vfs_handle_struct *handle,
+					   DIR *dirp, SMB_STRUCT_STAT *sbuf)
+{
+	if (sbuf != NULL) {
+		usleep(delay_inject_usecs(handle, "stat"));
+	}
+	return SMB_VFS_NEXT_READDIR(handle, dirp, sbuf);
+}
+
+static int delay_inject_stat(struct vfs_handle_struct *handle,
+			     struct smb_filename *smb_fname)
+{
+	usleep(delay_inject_usecs(handle, "stat"));
+	return SMB_VFS_NEXT_STAT(handle, smb_fname);
+}
+
+struct delay_inject_stat_state {
+	struct tevent_context *ev;
+	struct timeval endtime;
+	int ret;
+	int err;
+};
+
+static void delay_inject_stat_done(struct tevent_req *subreq);
+static void delay_inject_stat_waited(struct tevent_req *subreq);
+
+static struct tevent_req *delay_inject_stat_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, const struct smb_filename *smb_fname,
+	SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct delay_inject_stat_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct delay_inject_stat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->endtime = timeval_current_ofs_usec(
+		delay_inject_usecs(handle, "stat"));
+
+	subreq = SMB_VFS_NEXT_STAT_SEND(state, ev, handle, smb_fname, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, delay_inject_stat_done, req);
+	return req;
+}
+
+static void delay_inject_stat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct delay_inject_stat_state *state = tevent_req_data(
+		req, struct delay_inject_stat_state);
+
+	state->ret = SMB_VFS_STAT_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+
+	subreq = tevent_wakeup_send(state, state->ev, state->endtime);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, delay_inject_stat_waited, req);
+}
+
+static void delay_inject_stat_waited(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	bool ok;
+
+	ok = tevent_wakeup_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (!ok) {
+		tevent_req_error(req, EIO);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static int delay_inject_stat_recv(struct tevent_req *req, int *err)
+{
+	struct delay_inject_stat_state *state = tevent_req_data(
+		req, struct delay_inject_stat_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
+static int delay_inject_fstat(struct vfs_handle_struct *handle,
+			      struct files_struct *fsp, SMB_STRUCT_STAT *sbuf)
+{
+	usleep(delay_inject_usecs(handle, "stat"));
+	return SMB_VFS_NEXT_FSTAT(handle, fsp, sbuf);
+}
+
+static void delay_inject_fstat_done(struct tevent_req *subreq);
+
+static struct tevent_req *delay_inject_fstat_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct delay_inject_stat_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct delay_inject_stat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->endtime = timeval_current_ofs_usec(
+		delay_inject_usecs(handle, "stat"));
+
+	subreq = SMB_VFS_NEXT_FSTAT_SEND(state, ev, handle, fsp, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, delay_inject_fstat_done, req);
+	return req;
+}
+
+static void delay_inject_fstat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct delay_inject_stat_state *state = tevent_req_data(
+		req, struct delay_inject_stat_state);
+
+	state->ret = SMB_VFS_FSTAT_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+
+	subreq = tevent_wakeup_send(state, state->ev, state->endtime);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, delay_inject_stat_waited, req);
+}
+
+static ssize_t delay_inject_getxattr(struct vfs_handle_struct *handle,
+				     const char *path, const char *name,
+				     void *value, size_t size)
+{
+	usleep(delay_inject_usecs(handle, "getxattr"));
+	return SMB_VFS_NEXT_GETXATTR(handle, path, name, value, size);
+}
+
+struct delay_inject_getxattr_state {
+	struct tevent_context *ev;
+	struct timeval endtime;
+	ssize_t ret;
+	int err;
+};
+
+static void delay_inject_getxattr_done(struct tevent_req *subreq);
+static void delay_inject_getxattr_waited(struct tevent_req *subreq);
+
+static struct tevent_req *delay_inject_getxattr_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, const char *path, const char *name,
+	void *value, size_t size)
+{
+	struct tevent_req *req, *subreq;
+	struct delay_inject_getxattr_state *state;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct delay_inject_getxattr_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->endtime = timeval_current_ofs_usec(
+		delay_inject_usecs(handle, "getxattr"));
+
+	subreq = SMB_VFS_NEXT_GETXATTR_SEND(state, ev, handle, path, name,
+					    value, size);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, delay_inject_getxattr_done, req);
+	return req;
+}
+
+static void delay_inject_getxattr_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct delay_inject_getxattr_state *state = tevent_req_data(
+		req, struct delay_inject_getxattr_state);
+
+	state->ret = SMB_VFS_GETXATTR_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+
+	subreq = tevent_wakeup_send(state, state->ev, state->endtime);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, delay_inject_getxattr_waited, req);
+}
+
+static void delay_inject_getxattr_waited(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	bool ok;
+
+	ok = tevent_wakeup_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (!ok) {
+		tevent_req_error(req, EIO);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static ssize_t delay_inject_getxattr_recv(struct tevent_req *req, int *err)
+{
+	struct delay_inject_getxattr_state *state = tevent_req_data(
+		req, struct delay_inject_getxattr_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
+static struct vfs_fn_pointers vfs_delay_inject_fns = {
+	.readdir_fn = delay_inject_readdir,
+	.stat_fn = delay_inject_stat,
+	.stat_send_fn = delay_inject_stat_send,
+	.stat_recv_fn = delay_inject_stat_recv,
+	.fstat_fn = delay_inject_fstat,
+	.fstat_send_fn = delay_inject_fstat_send,
+	.fstat_recv_fn = delay_inject_stat_recv,
+	.getxattr_fn = delay_inject_getxattr,
+	.getxattr_send_fn = delay_inject_getxattr_send,
+	.getxattr_recv_fn = delay_inject_getxattr_recv,
+};
+
+static_decl_vfs;
+NTSTATUS vfs_delay_inject_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION,
+				"delay_inject", &vfs_delay_inject_fns);
+}
@@ -0,0 +1,368 @@
+/*
+ * Async pread, pwrite and fsync using the Linux io_uring interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "lib/util/tevent_unix.h"
+#include "lib/uring/uring.h"
+
+/*
+ * One ring per smbd. The requests queued while processing one round
+ * of the event loop are handed to the kernel with a single
+ * io_uring_enter from a tevent immediate, the completions are reaped
+ * when the ring's eventfd becomes readable.
+ */
+
+static struct uring_context *uring_ctx;
+static struct tevent_fd *uring_fde;
+static struct tevent_immediate *uring_submit_im;
+static bool uring_submit_scheduled;
+static bool uring_unavailable;
+
+static void vfs_io_uring_finished(struct tevent_context *ev,
+				  struct tevent_fd *fde,
+				  uint16_t flags, void *private_data);
+
+static bool vfs_io_uring_init_ctx(struct vfs_handle_struct *handle)
+{
+	struct tevent_context *ev = handle->conn->sconn->ev_ctx;
+	int num_entries;
+	int ret;
+
+	if (uring_ctx != NULL) {
+		return true;
+	}
+	if (uring_unavailable) {
+		return false;
+	}
+
+	num_entries = lp_parm_int(-1, "io_uring", "num entries", 128);
+
+	ret = uring_context_init(&uring_ctx, num_entries);
+	if (ret != 0) {
+		DEBUG(1, ("uring_context_init failed: %s, using the default "
+			  "async I/O\n", strerror(ret)));
+		uring_unavailable = true;
+		return false;
+	}
+
+	uring_submit_im = tevent_create_immediate(NULL);
+	if (uring_submit_im == NULL) {
+		goto fail;
+	}
+
+	uring_fde = tevent_add_fd(ev, NULL, uring_signalfd(uring_ctx),
+				  TEVENT_FD_READ, vfs_io_uring_finished,
+				  NULL);
+	if (uring_fde == NULL) {
+		goto fail;
+	}
+
+	DEBUG(10, ("vfs_io_uring: initialized with %d entries\n",
+		   num_entries));
+	return true;
+
+fail:
+	TALLOC_FREE(uring_fde);
+	TALLOC_FREE(uring_submit_im);
+	uring_context_destroy(uring_ctx);
+	uring_ctx = NULL;
+	return false;
+}
+
+static void vfs_io_uring_submit(struct tevent_context *ev,
+				struct tevent_immediate *im,
+				void *private_data)
+{
+	int ret;
+
+	uring_submit_scheduled = false;
+
+	ret = uring_submit(uring_ctx);
+	if (ret != 0) {
+		/*
+		 * The requests stay queued in the ring, the next
+		 * request or completion tries again.
+		 */
+		DEBUG(1, ("uring_submit failed: %s\n", strerror(ret)));
+	}
+}
+
+static void vfs_io_uring_schedule_submit(struct tevent_context *ev)
+{
+	if (uring_submit_scheduled) {
+		return;
+	}
+	tevent_schedule_immediate(uring_submit_im, ev, vfs_io_uring_submit,
+				  NULL);
+	uring_submit_scheduled = true;
+}
+
+struct vfs_io_uring_state {
+	struct tevent_req *req;
+	bool in_flight;
+	ssize_t ret;
+	int err;
+};
+
+static int vfs_io_uring_state_destructor(struct vfs_io_uring_state *s)
+{
+	if (s->in_flight) {
+		uring_cancel(uring_ctx, s->req);
+	}
+	return 0;
+}
+
+static void vfs_io_uring_finished(struct tevent_context *ev,
+				  struct tevent_fd *fde,
+				  uint16_t flags, void *private_data)
+{
+	struct uring_result results[128];
+	int i, ret;
+
+	if ((flags & TEVENT_FD_READ) == 0) {
+		return;
+	}
+
+	ret = uring_results(uring_ctx, results, ARRAY_SIZE(results));
+	if (ret < 0) {
+		DEBUG(1, ("uring_results returned %s\n", strerror(-ret)));
+		return;
+	}
+
+	for (i=0; i<ret; i++) {
+		struct uring_result *result = &results[i];
+		struct tevent_req *req;
+		struct vfs_io_uring_state *state;
+
+		if ((result->ret == -1) && (result->err == ECANCELED)) {
+			continue;
+		}
+
+		req = talloc_get_type_abort(result->private_data,
+					    struct tevent_req);
+		state = tevent_req_data(req, struct vfs_io_uring_state);
+
+		state->in_flight = false;
+		state->ret = result->ret;
+		state->err = result->err;
+		tevent_req_defer_callback(req, ev);
+		tevent_req_done(req);
+	}
+
+	if (uring_queued(uring_ctx) != 0) {
+		vfs_io_uring_schedule_submit(ev);
+	}
+}
+
+static void vfs_io_uring_queued(struct tevent_req *req,
+				struct vfs_io_uring_state *state,
+				struct tevent_context *ev)
+{
+	state->req = req;
+	state->in_flight = true;
+	talloc_set_destructor(state, vfs_io_uring_state_destructor);
+	vfs_io_uring_schedule_submit(ev);
+}
+
+static void vfs_io_uring_pread_done(struct tevent_req *subreq);
+
+static struct tevent_req *vfs_io_uring_pread_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	void *data, size_t n, off_t offset)
+{
+	struct tevent_req *req, *subreq;
+	struct vfs_io_uring_state *state;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state, struct vfs_io_uring_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	if (vfs_io_uring_init_ctx(handle)) {
+		ret = uring_pread(uring_ctx, fsp->fh->fd, data, n, offset,
+				  req);
+		if (ret == 0) {
+			vfs_io_uring_queued(req, state, ev);
+			return req;
+		}
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	/*
+	 * No io_uring or the ring is full
+	 */
+	subreq = SMB_VFS_NEXT_PREAD_SEND(state, ev, handle, fsp, data,
+					 n, offset);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfs_io_uring_pread_done, req);
+	return req;
+}
+
+static void vfs_io_uring_pread_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_io_uring_state *state = tevent_req_data(
+		req, struct vfs_io_uring_state);
+
+	state->ret = SMB_VFS_PREAD_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static void vfs_io_uring_pwrite_done(struct tevent_req *subreq);
+
+static struct tevent_req *vfs_io_uring_pwrite_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	const void *data, size_t n, off_t offset)
+{
+	struct tevent_req *req, *subreq;
+	struct vfs_io_uring_state *state;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state, struct vfs_io_uring_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	if (vfs_io_uring_init_ctx(handle)) {
+		ret = uring_pwrite(uring_ctx, fsp->fh->fd, data, n, offset,
+				   req);
+		if (ret == 0) {
+			vfs_io_uring_queued(req, state, ev);
+			return req;
+		}
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	subreq = SMB_VFS_NEXT_PWRITE_SEND(state, ev, handle, fsp, data,
+					  n, offset);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfs_io_uring_pwrite_done, req);
+	return req;
+}
+
+static void vfs_io_uring_pwrite_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_io_uring_state *state = tevent_req_data(
+		req, struct vfs_io_uring_state);
+
+	state->ret = SMB_VFS_PWRITE_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static void vfs_io_uring_fsync_done(struct tevent_req *subreq);
+
+static struct tevent_req *vfs_io_uring_fsync_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp)
+{
+	struct tevent_req *req, *subreq;
+	struct vfs_io_uring_state *state;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state, struct vfs_io_uring_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	if (vfs_io_uring_init_ctx(handle)) {
+		ret = uring_fsync(uring_ctx, fsp->fh->fd, req);
+		if (ret == 0) {
+			vfs_io_uring_queued(req, state, ev);
+			return req;
+		}
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	subreq = SMB_VFS_NEXT_FSYNC_SEND(state, ev, handle, fsp);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfs_io_uring_fsync_done, req);
+	return req;
+}
+
+static void vfs_io_uring_fsync_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_io_uring_state *state = tevent_req_data(
+		req, struct vfs_io_uring_state);
+
+	state->ret = SMB_VFS_FSYNC_RECV(subreq, &state->err);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static ssize_t vfs_io_uring_recv(struct tevent_req *req, int *err)
+{
+	struct vfs_io_uring_state *state = tevent_req_data(
+		req, struct vfs_io_uring_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	*err = state->err;
+	return state->ret;
+}
+
+static int vfs_io_uring_int_recv(struct tevent_req *req, int *err)
+{
+	/*
+	 * Use implicit conversion ssize_t->int
+	 */
+	return vfs_io_uring_recv(req, err);
+}
+
+static struct vfs_fn_pointers vfs_io_uring_fns = {
+	.pread_send_fn = vfs_io_uring_pread_send,
+	.pread_recv_fn = vfs_io_uring_recv,
+	.pwrite_send_fn = vfs_io_uring_pwrite_send,
+	.pwrite_recv_fn = vfs_io_uring_recv,
+	.fsync_send_fn = vfs_io_uring_fsync_send,
+	.fsync_recv_fn = vfs_io_uring_int_recv,
+};
+
+static_decl_vfs;
+NTSTATUS vfs_io_uring_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION,
+				"io_uring", &vfs_io_uring_fns);
+}
@@ -683,7 +683,9 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 				off_t startpos,
 				size_t smb_maxcnt)
 {
+	struct smbXsrv_connection *xconn = smbreq->smb2req->xconn;
 	struct aio_extra *aio_ex;
+	NTSTATUS status;
 	size_t min_aio_read_size = lp_aio_read_size(SNUM(conn));
 	struct tevent_req *req;
 
@@ -714,12 +716,13 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 	}
 
 	/* Create the out buffer. */
-	*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
-	if (preadbuf->data == NULL) {
-		return NT_STATUS_NO_MEMORY;
+	status = smbd_smb2_read_buf_alloc(ctx, xconn, smb_maxcnt, preadbuf);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
 	}
 
 	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
+		smbd_smb2_read_buf_free(xconn, preadbuf);
 		return NT_STATUS_NO_MEMORY;
 	}
 
@@ -730,6 +733,7 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 	/* Take the lock until the AIO completes. */
 	if (!SMB_VFS_STRICT_LOCK(conn, fsp, &aio_ex->lock)) {
 		TALLOC_FREE(aio_ex);
+		smbd_smb2_read_buf_free(xconn, preadbuf);
 		return NT_STATUS_FILE_LOCK_CONFLICT;
 	}
 
@@ -743,6 +747,7 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 			  "Error %s\n", strerror(errno)));
 		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
 		TALLOC_FREE(aio_ex);
+		smbd_smb2_read_buf_free(xconn, preadbuf);
 		return NT_STATUS_RETRY;
 	}
 	tevent_req_set_callback(req, aio_pread_smb2_done, aio_ex);
@@ -751,6 +756,11 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 		DEBUG(1, ("Could not add req to fsp\n"));
 		SMB_VFS_STRICT_UNLOCK(conn, fsp, &aio_ex->lock);
 		TALLOC_FREE(aio_ex);
+		/*
+		 * The pread might still be running, leave the buffer
+		 * to ctx.
+		 */
+		*preadbuf = data_blob_null;
 		return NT_STATUS_RETRY;
 	}
 
@@ -36,6 +36,9 @@
 #define START_OF_DIRECTORY_OFFSET ((long)0)
 #define DOT_DOT_DIRECTORY_OFFSET ((long)0x80000000)
 
+/* Offsets into a cached listing */
+#define DIR_CACHE_OFFSET(pos) ((long)(pos) + 1)
+
 /* "Special" directory offsets in 32-bit wire format. */
 #define WIRE_END_OF_DIRECTORY_OFFSET ((uint32_t)0xFFFFFFFF)
 #define WIRE_START_OF_DIRECTORY_OFFSET ((uint32_t)0)
@@ -59,6 +62,13 @@ struct smb_Dir {
 	unsigned int file_number;
 	files_struct *fsp; /* Back pointer to containing fsp, only
 			      set from OpenDir_fsp(). */
+	struct dir_cache_listing *cache; /* Read from here instead */
+	size_t cache_pos;
+	ssize_t cache_current;
+	struct dir_cache_builder *cache_builder; /* Collect for the cache */
+	bool cache_builder_current;
+	long cache_builder_prev_offset;
+	fstring cache_ea;
 };
 
 struct dptr_struct {
@@ -76,6 +86,7 @@ struct dptr_struct {
 	bool priv;     /* Directory handle opened with privilege. */
 	uint32_t counter;
 	struct memcache *dptr_cache;
+	struct dptr_prefetch *prefetch;
 };
 
 static struct smb_Dir *OpenDir_fsp(TALLOC_CTX *mem_ctx, connection_struct *conn,
@@ -554,6 +565,18 @@ NTSTATUS dptr_create(connection_struct *conn,
 
 	dptr->attr = attr;
 
+	if (dptr->has_wild && !(req != NULL && req->posix_pathnames)) {
+		/*
+		 * Only a search for everything can fill the cache
+		 */
+		bool all = (strcmp(wcard, "*") == 0);
+
+		dir_hnd->cache = dir_cache_lookup(
+			dir_hnd, conn, dptr->path,
+			all ? &dir_hnd->cache_builder : NULL);
+		dir_hnd->cache_current = -1;
+	}
+
 	if (sconn->using_smb2) {
 		goto done;
 	}
@@ -685,6 +708,10 @@ void dptr_set_priv(struct dptr_struct *dptr)
  Return the next visible file name, skipping veto'd and invisible files.
 ****************************************************************************/
 
+static bool dptr_prefetch_pending(struct dptr_struct *dptr);
+static void dptr_prefetch_lookup(struct dptr_struct *dptr, const char *name,
+				 SMB_STRUCT_STAT *pst);
+
 static const char *dptr_normal_ReadDirName(struct dptr_struct *dptr,
 					   long *poffset, SMB_STRUCT_STAT *pst,
 					   char **ptalloced)
@@ -693,8 +720,20 @@ static const char *dptr_normal_ReadDirName(struct dptr_struct *dptr,
 	const char *name;
 	char *talloced = NULL;
 
-	while ((name = ReadDirName(dptr->dir_hnd, poffset, pst, &talloced))
-	       != NULL) {
+	while (true) {
+		/*
+		 * Don't let readdir stat names a prefetch already has
+		 * the metadata for.
+		 */
+		bool prefetched = dptr_prefetch_pending(dptr);
+
+		SET_STAT_INVALID(*pst);
+		name = ReadDirName(dptr->dir_hnd, poffset,
+				   prefetched ? NULL : pst, &talloced);
+		if (name == NULL) {
+			break;
+		}
+		dptr_prefetch_lookup(dptr, name, pst);
 		if (is_visible_file(dptr->conn, dptr->path, name, pst, True)) {
 			*ptalloced = talloced;
 			return name;
@@ -832,6 +871,348 @@ ret:
 	return name;
 }
 
+/****************************************************************************
+ Fetch the metadata of the next directory entries in parallel.
+
+ The names are read ahead and the directory is positioned back where it
+ was. stat and the DOS attribute EA of every name go out through
+ SMB_VFS_STAT_SEND and SMB_VFS_GETXATTR_SEND at the same time. The
+ results are handed to dptr_normal_ReadDirName() and the lanman2 mode_fn
+ as the entries come along in the normal, ordered listing.
+****************************************************************************/
+
+struct dptr_prefetch_entry {
+	struct tevent_req *req;
+	char *name;
+	struct smb_filename *smb_fname;
+	SMB_STRUCT_STAT st;
+	bool have_st;
+	fstring ea;
+	ssize_t ea_len;
+	bool have_ea;
+};
+
+struct dptr_prefetch {
+	struct dptr_prefetch_entry *entries;
+	size_t num_entries;
+	size_t next;
+	struct dptr_prefetch_entry *current;
+};
+
+struct dptr_prefetch_state {
+	struct dptr_prefetch *prefetch;
+	size_t num_pending;
+};
+
+/*
+ * The client may go away with lookups still in flight, the vfs
+ * finishes them without us.
+ */
+static int dptr_prefetch_state_destructor(struct dptr_prefetch_state *state)
+{
+	while (state->num_pending > 0) {
+		decrement_outstanding_aio_calls();
+		state->num_pending -= 1;
+	}
+	return 0;
+}
+
+static void dptr_prefetch_stat_done(struct tevent_req *subreq);
+static void dptr_prefetch_ea_done(struct tevent_req *subreq);
+
+struct tevent_req *dptr_prefetch_send(TALLOC_CTX *mem_ctx,
+				      struct tevent_context *ev,
+				      struct dptr_struct *dptr,
+				      size_t max_entries,
+				      size_t space,
+				      size_t entry_size)
+{
+	struct tevent_req *req;
+	struct dptr_prefetch_state *state;
+	struct dptr_prefetch *prefetch;
+	connection_struct *conn = dptr->conn;
+	struct smb_Dir *dir_hnd = dptr->dir_hnd;
+	bool wcard_is_star;
+	long offset, saved_offset;
+	unsigned saved_file_number;
+	size_t i, used = 0;
+
+	req = tevent_req_create(mem_ctx, &state, struct dptr_prefetch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	prefetch = talloc_zero(state, struct dptr_prefetch);
+	if (tevent_req_nomem(prefetch, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->prefetch = prefetch;
+	talloc_set_destructor(state, dptr_prefetch_state_destructor);
+
+	if (!dptr->has_wild || (dir_hnd == NULL) ||
+	    (dir_hnd->cache != NULL) || (dir_hnd->cache_builder != NULL) ||
+	    (max_entries == 0)) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	prefetch->entries = talloc_zero_array(
+		prefetch, struct dptr_prefetch_entry, max_entries);
+	if (tevent_req_nomem(prefetch->entries, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	wcard_is_star = (strcmp(dptr->wcard, "*") == 0);
+
+	saved_offset = offset = TellDir(dir_hnd);
+	saved_file_number = dir_hnd->file_number;
+
+	while ((prefetch->num_entries < max_entries) && (used < space)) {
+		struct dptr_prefetch_entry *e;
+		const char *name;
+		char *talloced = NULL;
+		char *path;
+
+		/* Only the names, the stat goes out below */
+		name = ReadDirName(dir_hnd, &offset, NULL, &talloced);
+		if (name == NULL) {
+			break;
+		}
+
+		/*
+		 * Names only matching through their mangled form are
+		 * left to the synchronous path.
+		 */
+		if (!wcard_is_star &&
+		    !mask_match_search(name, dptr->wcard,
+				       conn->case_sensitive)) {
+			TALLOC_FREE(talloced);
+			continue;
+		}
+
+		e = &prefetch->entries[prefetch->num_entries];
+		e->req = req;
+		e->name = talloc_strdup(prefetch->entries, name);
+		TALLOC_FREE(talloced);
+		if (e->name == NULL) {
+			break;
+		}
+
+		if (ISDOT(dptr->path)) {
+			path = e->name;
+		} else {
+			path = talloc_asprintf(prefetch->entries, "%s/%s",
+					       dptr->path, e->name);
+		}
+		if (path == NULL) {
+			break;
+		}
+		e->smb_fname = synthetic_smb_fname(prefetch->entries, path,
+						   NULL, NULL);
+		if (e->smb_fname == NULL) {
+			break;
+		}
+
+		prefetch->num_entries += 1;
+		used += (entry_size + strlen(name) * 2 + 7) & ~7;
+	}
+
+	SeekDir(dir_hnd, saved_offset);
+	dir_hnd->file_number = saved_file_number;
+
+	for (i=0; i<prefetch->num_entries; i++) {
+		struct dptr_prefetch_entry *e = &prefetch->entries[i];
+		struct tevent_req *subreq;
+
+		subreq = SMB_VFS_STAT_SEND(state, ev, conn, e->smb_fname,
+					   &e->st);
+		if (subreq == NULL) {
+			break;
+		}
+		tevent_req_set_callback(subreq, dptr_prefetch_stat_done, e);
+		increment_outstanding_aio_calls();
+		state->num_pending += 1;
+
+		if (lp_store_dos_attributes(SNUM(conn))) {
+			subreq = SMB_VFS_GETXATTR_SEND(
+				state, ev, conn, e->smb_fname->base_name,
+				SAMBA_XATTR_DOS_ATTRIB, e->ea, sizeof(e->ea));
+			if (subreq == NULL) {
+				break;
+			}
+			tevent_req_set_callback(subreq,
+						dptr_prefetch_ea_done, e);
+			increment_outstanding_aio_calls();
+			state->num_pending += 1;
+		}
+	}
+
+	DBG_DEBUG("prefetching %zu entries of %s, %zu requests\n",
+		  prefetch->num_entries, dptr->path, state->num_pending);
+
+	if (state->num_pending == 0) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+	return req;
+}
+
+static void dptr_prefetch_entry_done(struct tevent_req *req)
+{
+	struct dptr_prefetch_state *state = tevent_req_data(
+		req, struct dptr_prefetch_state);
+
+	decrement_outstanding_aio_calls();
+
+	state->num_pending -= 1;
+	if (state->num_pending == 0) {
+		tevent_req_done(req);
+	}
+}
+
+static void dptr_prefetch_stat_done(struct tevent_req *subreq)
+{
+	struct dptr_prefetch_entry *e = (struct dptr_prefetch_entry *)
+		tevent_req_callback_data_void(subreq);
+	int ret, err;
+
+	ret = SMB_VFS_STAT_RECV(subreq, &err);
+	TALLOC_FREE(subreq);
+
+	/* Failures are left to the synchronous path */
+	e->have_st = (ret == 0);
+
+	dptr_prefetch_entry_done(e->req);
+}
+
+static void dptr_prefetch_ea_done(struct tevent_req *subreq)
+{
+	struct dptr_prefetch_entry *e = (struct dptr_prefetch_entry *)
+		tevent_req_callback_data_void(subreq);
+	int err;
+
+	e->ea_len = SMB_VFS_GETXATTR_RECV(subreq, &err);
+	TALLOC_FREE(subreq);
+
+	e->have_ea = ((e->ea_len >= 0) || (err == ENOATTR));
+
+	dptr_prefetch_entry_done(e->req);
+}
+
+void dptr_prefetch_recv(struct tevent_req *req, struct dptr_struct *dptr)
+{
+	struct dptr_prefetch_state *state = tevent_req_data(
+		req, struct dptr_prefetch_state);
+
+	TALLOC_FREE(dptr->prefetch);
+	if (tevent_req_is_in_progress(req)) {
+		return;
+	}
+	dptr->prefetch = talloc_move(dptr, &state->prefetch);
+}
+
+void dptr_prefetch_discard(struct dptr_struct *dptr)
+{
+	TALLOC_FREE(dptr->prefetch);
+}
+
+static bool dptr_prefetch_pending(struct dptr_struct *dptr)
+{
+	struct dptr_prefetch *prefetch = dptr->prefetch;
+
+	return ((prefetch != NULL) &&
+		(prefetch->next < prefetch->num_entries));
+}
+
+static void dptr_prefetch_lookup(struct dptr_struct *dptr, const char *name,
+				 SMB_STRUCT_STAT *pst)
+{
+	struct dptr_prefetch *prefetch = dptr->prefetch;
+	struct dptr_prefetch_entry *e;
+
+	if (prefetch == NULL) {
+		return;
+	}
+	prefetch->current = NULL;
+
+	/*
+	 * The entries are in directory order, but might skip names.
+	 * After a seek nothing matches anymore.
+	 */
+	if (prefetch->next >= prefetch->num_entries) {
+		return;
+	}
+	e = &prefetch->entries[prefetch->next];
+	if (strcmp(e->name, name) != 0) {
+		return;
+	}
+	prefetch->next += 1;
+	prefetch->current = e;
+
+	if (e->have_st && !VALID_STAT(*pst)) {
+		*pst = e->st;
+	}
+}
+
+/****************************************************************************
+ The DOS attribute EA prefetched for the name dptr_ReadDirName() returned
+ last. A blob with NULL data means the file has none.
+****************************************************************************/
+
+bool dptr_prefetched_dos_attr(struct dptr_struct *dptr,
+			      const struct smb_filename *smb_fname,
+			      DATA_BLOB *blob)
+{
+	struct smb_Dir *dir_hnd = dptr->dir_hnd;
+	struct dptr_prefetch_entry *e;
+
+	if (dir_hnd == NULL) {
+		return false;
+	}
+
+	if ((dir_hnd->cache != NULL) && (dir_hnd->cache_current != -1)) {
+		return dir_cache_dos_attr(dir_hnd->cache,
+					  dir_hnd->cache_current, blob);
+	}
+
+	if ((dir_hnd->cache_builder != NULL) &&
+	    dir_hnd->cache_builder_current &&
+	    lp_store_dos_attributes(SNUM(dptr->conn))) {
+		/*
+		 * Read it here instead of in dos_mode(), so that the
+		 * cache gets it as well.
+		 */
+		ssize_t len;
+
+		len = SMB_VFS_GETXATTR(dptr->conn, smb_fname->base_name,
+				       SAMBA_XATTR_DOS_ATTRIB,
+				       dir_hnd->cache_ea,
+				       sizeof(dir_hnd->cache_ea));
+		if (len >= 0) {
+			*blob = data_blob_const(dir_hnd->cache_ea, len);
+		} else if (errno == ENOATTR) {
+			*blob = data_blob_null;
+		} else {
+			return false;
+		}
+		dir_cache_builder_set_dos_attr(dir_hnd->cache_builder, blob);
+		return true;
+	}
+
+	if ((dptr->prefetch == NULL) || (dptr->prefetch->current == NULL)) {
+		return false;
+	}
+	e = dptr->prefetch->current;
+	if (!e->have_ea) {
+		return false;
+	}
+	if (e->ea_len < 0) {
+		*blob = data_blob_null;
+	} else {
+		*blob = data_blob_const(e->ea, e->ea_len);
+	}
+	return true;
+}
+
 /****************************************************************************
  Search for a file by name, skipping veto'ed and not visible files.
 ****************************************************************************/
@@ -1571,6 +1952,7 @@ static int smb_Dir_destructor(struct smb_Dir *dirp)
 			 * dirp->fsp.
 			 */
 			dirp->fsp->fh->fd = -1;
+			fsp_index_fd(dirp->fsp);
 			if (dirp->fsp->dptr != NULL) {
 				SMB_ASSERT(dirp->fsp->dptr->dir_hnd == dirp);
 				dirp->fsp->dptr->dir_hnd = NULL;
@@ -1704,6 +2086,10 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 	const char *n;
 	char *talloced = NULL;
 	connection_struct *conn = dirp->conn;
+	long prev_offset;
+
+	dirp->cache_current = -1;
+	dirp->cache_builder_current = false;
 
 	/* Cheat to allow . and .. to be the first entries returned. */
 	if (((*poffset == START_OF_DIRECTORY_OFFSET) ||
@@ -1728,6 +2114,22 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 
 	/* A real offset, seek to it. */
 	SeekDir(dirp, *poffset);
+	prev_offset = dirp->offset;
+
+	if (dirp->cache != NULL) {
+		if (dirp->cache_pos >= dir_cache_num_entries(dirp->cache)) {
+			*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
+			*ptalloced = NULL;
+			return NULL;
+		}
+		n = dir_cache_entry(dirp->cache, dirp->cache_pos, sbuf);
+		dirp->cache_current = dirp->cache_pos;
+		dirp->cache_pos += 1;
+		*poffset = dirp->offset = DIR_CACHE_OFFSET(dirp->cache_pos);
+		*ptalloced = NULL;
+		dirp->file_number++;
+		return n;
+	}
 
 	while ((n = vfs_readdirname(conn, dirp->dir, sbuf, &talloced))) {
 		/* Ignore . and .. - we've already returned them. */
@@ -1740,10 +2142,19 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 		*poffset = dirp->offset = SMB_VFS_TELLDIR(conn, dirp->dir);
 		*ptalloced = talloced;
 		dirp->file_number++;
+		if (dirp->cache_builder != NULL) {
+			dir_cache_builder_add(dirp->cache_builder, n, sbuf);
+			dirp->cache_builder_current = true;
+			dirp->cache_builder_prev_offset = prev_offset;
+		}
 		return n;
 	}
 	*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
 	*ptalloced = NULL;
+	if (dirp->cache_builder != NULL) {
+		dir_cache_builder_finish(dirp->cache_builder);
+		TALLOC_FREE(dirp->cache_builder);
+	}
 	return NULL;
 }
 
@@ -1753,8 +2164,12 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 
 void RewindDir(struct smb_Dir *dirp, long *poffset)
 {
+	/* The cache only takes one pass through the directory */
+	TALLOC_FREE(dirp->cache_builder);
+
 	SMB_VFS_REWINDDIR(dirp->conn, dirp->dir);
 	dirp->file_number = 0;
+	dirp->cache_pos = 0;
 	dirp->offset = START_OF_DIRECTORY_OFFSET;
 	*poffset = START_OF_DIRECTORY_OFFSET;
 }
@@ -1785,7 +2200,22 @@ void SeekDir(struct smb_Dir *dirp, long offset)
 			dirp->file_number = 2;
 		} else if (offset == END_OF_DIRECTORY_OFFSET) {
 			; /* Don't seek in this case. */
+		} else if (dirp->cache != NULL) {
+			dirp->cache_pos = offset - 1;
 		} else {
+			if ((dirp->cache_builder != NULL) &&
+			    (offset == dirp->cache_builder_prev_offset)) {
+				/*
+				 * The last name did not fit into the
+				 * reply, it will be read again.
+				 */
+				dir_cache_builder_remove_last(
+					dirp->cache_builder);
+				dirp->cache_builder_prev_offset =
+					END_OF_DIRECTORY_OFFSET;
+			} else {
+				TALLOC_FREE(dirp->cache_builder);
+			}
 			SMB_VFS_SEEKDIR(dirp->conn, dirp->dir, offset);
 		}
 		dirp->offset = offset;
@@ -1863,9 +2293,7 @@ bool SearchDir(struct smb_Dir *dirp, const char *name, long *poffset)
 	}
 
 	/* Not found in the name cache. Rewind directory and start from scratch. */
-	SMB_VFS_REWINDDIR(conn, dirp->dir);
-	dirp->file_number = 0;
-	*poffset = START_OF_DIRECTORY_OFFSET;
+	RewindDir(dirp, poffset);
 	while ((entry = ReadDirName(dirp, poffset, NULL, &talloced))) {
 		if (conn->case_sensitive ? (strcmp(entry, name) == 0) : strequal(entry, name)) {
 			TALLOC_FREE(talloced);
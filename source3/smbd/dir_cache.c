@@ -0,0 +1,830 @@
+/*
+   Unix SMB/CIFS implementation.
+   Directory listings shared between smbd processes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_open.h"
+#include "util_tdb.h"
+#include "../librpc/gen_ndr/notify.h"
+
+/*
+ * With "smbd:dir cache = yes" on a share, what a full search of a
+ * directory read, that is every name with its stat information and
+ * DOS attribute EA, is kept in dir_cache.tdb. The next search in that
+ * directory, from any smbd, is served from the cached copy instead of
+ * reading and stat'ing the directory again.
+ *
+ * There is one record per directory, keyed by its file_id:
+ *
+ *	struct dir_cache_hdr
+ *	service name, padded to 8 bytes
+ *	num_entries times
+ *		struct dir_cache_ent
+ *		name, EA, padded to 8 bytes
+ *
+ * A record is only used if the directory still has the mtime and
+ * ctime it had when it was read, if it is younger than
+ * "smbd:dir cache ttl" seconds and if it was filled through the same
+ * share. Names, stat information and EAs can look different through
+ * the VFS modules of another share on the same directory.
+ *
+ * Changes done by smbd come in via notify_fname(), right where they
+ * are handed to notifyd, and drop the parent directory's record. That
+ * covers names as well as attribute, time and EA changes of the
+ * entries. Writes and ACL changes don't always show up there, the
+ * first write through a handle and set_sd() drop the record
+ * explicitly. A listing in which an entry's ctime is younger than two
+ * seconds is not stored, that entry is still being changed. Changes
+ * to a file behind our back don't touch the directory, they are only
+ * picked up after the ttl.
+ *
+ * The stat information of the entries was collected with the
+ * permissions of whoever filled the record. Only directories every
+ * user can search are cached, so that this does not show anything
+ * the user could not see anyway.
+ *
+ * The sum of all record sizes is kept in the "SIZE" record. If it
+ * grows beyond "smbd:dir cache size" bytes, the whole cache is wiped,
+ * and a single listing larger than a quarter of that is not stored.
+ */
+
+#define DIR_CACHE_HASH_SIZE 10007
+
+#define DIR_CACHE_SIZE_KEY "SIZE"
+
+/* Don't trust an mtime younger than this for a fresh listing */
+#define DIR_CACHE_MIN_AGE 2
+
+#define DIR_CACHE_DEFAULT_SIZE (64*1024*1024)
+#define DIR_CACHE_MAX_SIZE (1024*1024*1024)
+
+#define DIR_CACHE_ALIGN(x) (((x)+7) & ~(size_t)7)
+
+/* dir_cache_ent.ea_len for a file without the EA */
+#define DIR_CACHE_NO_EA (-1)
+/* dir_cache_ent.ea_len if reading the EA failed */
+#define DIR_CACHE_UNKNOWN_EA (-2)
+
+struct dir_cache_hdr {
+	struct file_id id;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	int64_t stored;
+	uint32_t num_entries;
+	uint32_t service_len;
+};
+
+struct dir_cache_ent {
+	SMB_STRUCT_STAT st;
+	uint32_t name_len;
+	int32_t ea_len;
+};
+
+struct dir_cache_listing {
+	uint8_t *buf;
+	size_t buflen;
+	size_t num_entries;
+	size_t *ofs;
+};
+
+static struct db_context *dir_cache_db;
+
+static bool dir_cache_enabled(connection_struct *conn)
+{
+	if (lp_clustering()) {
+		return false;
+	}
+	if (lp_posix_pathnames()) {
+		return false;
+	}
+	return lp_parm_bool(SNUM(conn), "smbd", "dir cache", false);
+}
+
+static struct db_context *dir_cache_db_open(void)
+{
+	char *db_path;
+
+	if (dir_cache_db != NULL) {
+		return dir_cache_db;
+	}
+
+	db_path = lock_path("dir_cache.tdb");
+	if (db_path == NULL) {
+		return NULL;
+	}
+
+	dir_cache_db = db_open(NULL, db_path, DIR_CACHE_HASH_SIZE,
+			       TDB_DEFAULT | TDB_CLEAR_IF_FIRST |
+			       TDB_INCOMPATIBLE_HASH,
+			       O_RDWR | O_CREAT, 0600,
+			       DBWRAP_LOCK_ORDER_3, DBWRAP_FLAG_NONE);
+	if (dir_cache_db == NULL) {
+		DEBUG(1, ("%s: db_open(%s) failed: %s\n", __func__, db_path,
+			  strerror(errno)));
+	}
+	TALLOC_FREE(db_path);
+
+	return dir_cache_db;
+}
+
+/****************************************************************************
+ The parent opens the database, so that it survives the short lived
+ smbd processes in spite of TDB_CLEAR_IF_FIRST. Without the cache the
+ shares work as before, so failing to open it is not fatal.
+****************************************************************************/
+
+void dir_cache_init(void)
+{
+	int snum, num_services;
+
+	if (lp_clustering() || lp_posix_pathnames()) {
+		return;
+	}
+
+	num_services = lp_numservices();
+	for (snum = 0; snum < num_services; snum++) {
+		if (lp_snum_ok(snum) &&
+		    lp_parm_bool(snum, "smbd", "dir cache", false)) {
+			(void)dir_cache_db_open();
+			return;
+		}
+	}
+}
+
+static size_t dir_cache_max_size(void)
+{
+	unsigned long size;
+
+	size = lp_parm_ulong(-1, "smbd", "dir cache size",
+			     DIR_CACHE_DEFAULT_SIZE);
+	return MIN(size, DIR_CACHE_MAX_SIZE);
+}
+
+static TDB_DATA dir_cache_key(const struct file_id *id)
+{
+	return make_tdb_data((const uint8_t *)id, sizeof(*id));
+}
+
+static void dir_cache_hdr_stamp(struct dir_cache_hdr *hdr,
+				const SMB_STRUCT_STAT *st)
+{
+	hdr->mtime_sec = st->st_ex_mtime.tv_sec;
+	hdr->mtime_nsec = st->st_ex_mtime.tv_nsec;
+	hdr->ctime_sec = st->st_ex_ctime.tv_sec;
+	hdr->ctime_nsec = st->st_ex_ctime.tv_nsec;
+}
+
+/*
+ * Check the layout of a record and remember where the entries are. buf
+ * is taken over, also on failure.
+ */
+
+static struct dir_cache_listing *dir_cache_parse(TALLOC_CTX *mem_ctx,
+						 uint8_t *buf, size_t buflen)
+{
+	struct dir_cache_listing *listing = NULL;
+	struct dir_cache_hdr hdr;
+	size_t i, ofs;
+
+	if (buflen < sizeof(hdr)) {
+		goto fail;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+
+	ofs = sizeof(hdr) + DIR_CACHE_ALIGN(hdr.service_len);
+	if ((ofs < sizeof(hdr)) || (ofs > buflen)) {
+		goto fail;
+	}
+
+	listing = talloc_zero(mem_ctx, struct dir_cache_listing);
+	if (listing == NULL) {
+		goto fail;
+	}
+	listing->ofs = talloc_array(listing, size_t, hdr.num_entries);
+	if (listing->ofs == NULL) {
+		goto fail;
+	}
+
+	for (i=0; i<hdr.num_entries; i++) {
+		struct dir_cache_ent ent;
+		size_t len;
+
+		if (buflen - ofs < sizeof(ent)) {
+			goto fail;
+		}
+		memcpy(&ent, buf + ofs, sizeof(ent));
+
+		if ((ent.ea_len < 0) &&
+		    (ent.ea_len != DIR_CACHE_NO_EA) &&
+		    (ent.ea_len != DIR_CACHE_UNKNOWN_EA)) {
+			goto fail;
+		}
+
+		len = ent.name_len;
+		if (ent.ea_len > 0) {
+			len += ent.ea_len;
+		}
+		if ((ent.name_len == 0) ||
+		    (ent.name_len > buflen - ofs - sizeof(ent)) ||
+		    (len > buflen - ofs - sizeof(ent)) ||
+		    (buf[ofs + sizeof(ent) + ent.name_len - 1] != '\0')) {
+			goto fail;
+		}
+
+		listing->ofs[i] = ofs;
+		ofs += DIR_CACHE_ALIGN(sizeof(ent) + len);
+		ofs = MIN(ofs, buflen);
+	}
+
+	listing->buf = talloc_move(listing, &buf);
+	listing->buflen = buflen;
+	listing->num_entries = hdr.num_entries;
+
+	return listing;
+
+fail:
+	TALLOC_FREE(listing);
+	TALLOC_FREE(buf);
+	return NULL;
+}
+
+struct dir_cache_fetch_state {
+	TALLOC_CTX *mem_ctx;
+	const struct file_id *id;
+	const SMB_STRUCT_STAT *dir_st;
+	const char *service;
+	int ttl;
+	uint8_t *buf;
+	size_t buflen;
+};
+
+static void dir_cache_fetch_fn(TDB_DATA key, TDB_DATA data,
+			       void *private_data)
+{
+	struct dir_cache_fetch_state *state = private_data;
+	struct dir_cache_hdr hdr, now;
+	size_t service_len = strlen(state->service) + 1;
+	time_t t = time(NULL);
+
+	if (data.dsize < sizeof(hdr) + service_len) {
+		return;
+	}
+	memcpy(&hdr, data.dptr, sizeof(hdr));
+
+	dir_cache_hdr_stamp(&now, state->dir_st);
+
+	if (!file_id_equal(&hdr.id, state->id) ||
+	    (hdr.mtime_sec != now.mtime_sec) ||
+	    (hdr.mtime_nsec != now.mtime_nsec) ||
+	    (hdr.ctime_sec != now.ctime_sec) ||
+	    (hdr.ctime_nsec != now.ctime_nsec) ||
+	    (hdr.stored > t) || (t - hdr.stored >= state->ttl)) {
+		return;
+	}
+
+	if ((hdr.service_len != service_len) ||
+	    (memcmp(data.dptr + sizeof(hdr), state->service,
+		    service_len) != 0)) {
+		return;
+	}
+
+	state->buf = (uint8_t *)talloc_memdup(state->mem_ctx, data.dptr,
+					      data.dsize);
+	if (state->buf == NULL) {
+		return;
+	}
+	state->buflen = data.dsize;
+}
+
+static void dir_cache_account(struct db_context *db, uint32_t change)
+{
+	uint32_t size = 0;
+	NTSTATUS status;
+
+	status = dbwrap_change_uint32_atomic_bystring(
+		db, DIR_CACHE_SIZE_KEY, &size, change);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(5, ("%s: dbwrap_change_uint32_atomic failed: %s\n",
+			  __func__, nt_errstr(status)));
+		return;
+	}
+	size += change;
+
+	if (size > dir_cache_max_size()) {
+		DEBUG(10, ("%s: %u bytes cached, wiping\n", __func__,
+			   (unsigned)size));
+		DO_PROFILE_INC(dir_cache_wipes);
+		dbwrap_wipe(db);
+	}
+}
+
+static void dir_cache_store(struct db_context *db, const struct file_id *id,
+			    const uint8_t *buf, size_t buflen)
+{
+	struct db_record *rec;
+	TDB_DATA old;
+	uint32_t change;
+	NTSTATUS status;
+
+	if (buflen > dir_cache_max_size() / 4) {
+		DEBUG(10, ("%s: listing of %zu bytes is too large\n",
+			   __func__, buflen));
+		return;
+	}
+
+	rec = dbwrap_fetch_locked(db, talloc_tos(), dir_cache_key(id));
+	if (rec == NULL) {
+		return;
+	}
+	old = dbwrap_record_get_value(rec);
+
+	status = dbwrap_record_store(rec, make_tdb_data(buf, buflen), 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(5, ("%s: dbwrap_record_store failed: %s\n", __func__,
+			  nt_errstr(status)));
+		TALLOC_FREE(rec);
+		return;
+	}
+	DO_PROFILE_INC(dir_cache_stores);
+
+	change = (uint32_t)buflen - (uint32_t)old.dsize;
+	TALLOC_FREE(rec);
+
+	dir_cache_account(db, change);
+}
+
+static void dir_cache_delete(struct db_context *db, const struct file_id *id)
+{
+	struct db_record *rec;
+	TDB_DATA old;
+	uint32_t size;
+	NTSTATUS status;
+
+	rec = dbwrap_fetch_locked(db, talloc_tos(), dir_cache_key(id));
+	if (rec == NULL) {
+		return;
+	}
+	old = dbwrap_record_get_value(rec);
+	if (old.dsize == 0) {
+		TALLOC_FREE(rec);
+		return;
+	}
+
+	size = old.dsize;
+
+	status = dbwrap_record_delete(rec);
+	TALLOC_FREE(rec);
+	if (NT_STATUS_IS_OK(status)) {
+		DO_PROFILE_INC(dir_cache_invalidations);
+		dir_cache_account(db, -size);
+	}
+}
+
+/*
+ * Make room for len bytes at *pbuflen, the padding to 8 bytes is
+ * zeroed. The bytes below *pbuflen are kept.
+ */
+
+static uint8_t *dir_cache_append(uint8_t **pbuf, size_t *pbuflen,
+				 size_t len)
+{
+	size_t buflen = *pbuflen;
+	size_t newlen = buflen + DIR_CACHE_ALIGN(len);
+	uint8_t *buf = *pbuf;
+
+	if (newlen < buflen) {
+		return NULL;
+	}
+	if (newlen > talloc_get_size(buf)) {
+		buf = talloc_realloc(NULL, buf, uint8_t,
+				     MAX(newlen, buflen * 2));
+		if (buf == NULL) {
+			return NULL;
+		}
+		*pbuf = buf;
+	}
+	memset(buf + buflen + len, 0, newlen - buflen - len);
+	*pbuflen = newlen;
+	return buf + buflen;
+}
+
+/*
+ * A record is built from the names a search in a directory reads. It
+ * is stored when that search reaches the end of the directory without
+ * having seeked around.
+ */
+
+struct dir_cache_builder {
+	connection_struct *conn;
+	char *dir_path;
+	time_t started;
+	struct dir_cache_hdr hdr;
+	uint8_t *buf;
+	size_t buflen;
+	size_t last_ofs;
+	bool have_last;
+	bool failed;
+};
+
+static int dir_cache_builder_destructor(struct dir_cache_builder *b)
+{
+	TALLOC_FREE(b->buf);
+	return 0;
+}
+
+static struct dir_cache_builder *dir_cache_builder_create(
+	TALLOC_CTX *mem_ctx, connection_struct *conn, const char *dir_path,
+	const struct dir_cache_hdr *hdr, const char *service)
+{
+	struct dir_cache_builder *b;
+	uint8_t *p;
+
+	b = talloc_zero(mem_ctx, struct dir_cache_builder);
+	if (b == NULL) {
+		return NULL;
+	}
+	talloc_set_destructor(b, dir_cache_builder_destructor);
+
+	b->conn = conn;
+	b->started = time(NULL);
+	b->hdr = *hdr;
+	b->dir_path = talloc_strdup(b, dir_path);
+	if (b->dir_path == NULL) {
+		TALLOC_FREE(b);
+		return NULL;
+	}
+
+	b->buf = talloc_array(NULL, uint8_t, 4096);
+	if (b->buf == NULL) {
+		TALLOC_FREE(b);
+		return NULL;
+	}
+
+	/* The header is filled in when storing */
+	if ((dir_cache_append(&b->buf, &b->buflen, sizeof(*hdr)) == NULL) ||
+	    ((p = dir_cache_append(&b->buf, &b->buflen, hdr->service_len))
+	     == NULL)) {
+		TALLOC_FREE(b);
+		return NULL;
+	}
+	memcpy(p, service, hdr->service_len);
+
+	return b;
+}
+
+static void dir_cache_builder_fail(struct dir_cache_builder *b)
+{
+	b->failed = true;
+	TALLOC_FREE(b->buf);
+	b->buflen = 0;
+}
+
+/****************************************************************************
+ A name the search read from the directory. st may be NULL or invalid if
+ the VFS did not hand out stat information with it.
+****************************************************************************/
+
+void dir_cache_builder_add(struct dir_cache_builder *b, const char *name,
+			   const SMB_STRUCT_STAT *st)
+{
+	struct dir_cache_ent ent = {
+		.name_len = strlen(name) + 1,
+		.ea_len = DIR_CACHE_UNKNOWN_EA,
+	};
+	size_t ofs = b->buflen;
+	uint8_t *p;
+
+	if (b->failed) {
+		return;
+	}
+
+	if (st != NULL) {
+		ent.st = *st;
+	} else {
+		SET_STAT_INVALID(ent.st);
+	}
+
+	if (VALID_STAT(ent.st) &&
+	    (ent.st.st_ex_ctime.tv_sec + DIR_CACHE_MIN_AGE > b->started)) {
+		DEBUG(10, ("%s: %s in %s was just changed\n", __func__, name,
+			   b->dir_path));
+		dir_cache_builder_fail(b);
+		return;
+	}
+
+	p = dir_cache_append(&b->buf, &b->buflen, sizeof(ent) + ent.name_len);
+	if ((p == NULL) || (b->buflen > dir_cache_max_size() / 4)) {
+		DEBUG(10, ("%s: not caching %s\n", __func__, b->dir_path));
+		dir_cache_builder_fail(b);
+		return;
+	}
+	memcpy(p, &ent, sizeof(ent));
+	memcpy(p + sizeof(ent), name, ent.name_len);
+
+	b->last_ofs = ofs;
+	b->have_last = true;
+	b->hdr.num_entries += 1;
+}
+
+/****************************************************************************
+ The search will read the name added last again.
+****************************************************************************/
+
+void dir_cache_builder_remove_last(struct dir_cache_builder *b)
+{
+	if (b->failed) {
+		return;
+	}
+	if (!b->have_last) {
+		dir_cache_builder_fail(b);
+		return;
+	}
+	b->buflen = b->last_ofs;
+	b->have_last = false;
+	b->hdr.num_entries -= 1;
+}
+
+/****************************************************************************
+ The DOS attribute EA of the name added last. A blob with NULL data means
+ the file has none.
+****************************************************************************/
+
+void dir_cache_builder_set_dos_attr(struct dir_cache_builder *b,
+				    const DATA_BLOB *blob)
+{
+	struct dir_cache_ent ent;
+	uint8_t *p;
+
+	if (b->failed || !b->have_last) {
+		return;
+	}
+
+	memcpy(&ent, b->buf + b->last_ofs, sizeof(ent));
+
+	if (blob->data == NULL) {
+		ent.ea_len = DIR_CACHE_NO_EA;
+		memcpy(b->buf + b->last_ofs, &ent, sizeof(ent));
+		return;
+	}
+
+	/* Grow the last entry by the EA, the name stays in place */
+	ent.ea_len = blob->length;
+	b->buflen = b->last_ofs;
+	p = dir_cache_append(&b->buf, &b->buflen,
+			     sizeof(ent) + ent.name_len + ent.ea_len);
+	if (p == NULL) {
+		dir_cache_builder_fail(b);
+		return;
+	}
+	memcpy(p, &ent, sizeof(ent));
+	memcpy(p + sizeof(ent) + ent.name_len, blob->data, blob->length);
+}
+
+/****************************************************************************
+ The search reached the end of the directory. Store what it saw unless
+ the directory changed in the meantime.
+****************************************************************************/
+
+void dir_cache_builder_finish(struct dir_cache_builder *b)
+{
+	struct db_context *db;
+	struct smb_filename *smb_dname;
+	struct dir_cache_hdr now;
+
+	if (b->failed) {
+		return;
+	}
+
+	db = dir_cache_db_open();
+	if (db == NULL) {
+		return;
+	}
+
+	smb_dname = synthetic_smb_fname(talloc_tos(), b->dir_path, NULL,
+					NULL);
+	if ((smb_dname == NULL) || (SMB_VFS_STAT(b->conn, smb_dname) != 0)) {
+		TALLOC_FREE(smb_dname);
+		return;
+	}
+	dir_cache_hdr_stamp(&now, &smb_dname->st);
+	TALLOC_FREE(smb_dname);
+
+	if ((now.mtime_sec != b->hdr.mtime_sec) ||
+	    (now.mtime_nsec != b->hdr.mtime_nsec) ||
+	    (now.ctime_sec != b->hdr.ctime_sec) ||
+	    (now.ctime_nsec != b->hdr.ctime_nsec)) {
+		DEBUG(10, ("%s: %s changed while reading it\n", __func__,
+			   b->dir_path));
+		return;
+	}
+
+	memcpy(b->buf, &b->hdr, sizeof(b->hdr));
+	dir_cache_store(db, &b->hdr.id, b->buf, b->buflen);
+}
+
+/****************************************************************************
+ Get the listing of a directory. If it is not cached and pbuilder is not
+ NULL, hand out a builder to collect it while reading the directory.
+****************************************************************************/
+
+struct dir_cache_listing *dir_cache_lookup(TALLOC_CTX *mem_ctx,
+					   connection_struct *conn,
+					   const char *dir_path,
+					   struct dir_cache_builder **pbuilder)
+{
+	TALLOC_CTX *frame;
+	struct db_context *db;
+	struct smb_filename *smb_dname;
+	struct dir_cache_listing *listing = NULL;
+	struct dir_cache_fetch_state state;
+	struct dir_cache_hdr hdr;
+	struct file_id id;
+	const char *service;
+	NTSTATUS status;
+
+	if (!dir_cache_enabled(conn)) {
+		return NULL;
+	}
+
+	db = dir_cache_db_open();
+	if (db == NULL) {
+		return NULL;
+	}
+
+	frame = talloc_stackframe();
+
+	smb_dname = synthetic_smb_fname(frame, dir_path, NULL, NULL);
+	if ((smb_dname == NULL) || (SMB_VFS_STAT(conn, smb_dname) != 0)) {
+		goto done;
+	}
+	if (!S_ISDIR(smb_dname->st.st_ex_mode) ||
+	    !(smb_dname->st.st_ex_mode & S_IXOTH)) {
+		goto done;
+	}
+
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	service = lp_const_servicename(SNUM(conn));
+
+	DO_PROFILE_INC(dir_cache_lookups);
+
+	state = (struct dir_cache_fetch_state) {
+		.mem_ctx = mem_ctx, .id = &id, .dir_st = &smb_dname->st,
+		.service = service,
+		.ttl = lp_parm_int(SNUM(conn), "smbd", "dir cache ttl", 10),
+	};
+
+	status = dbwrap_parse_record(db, dir_cache_key(&id),
+				     dir_cache_fetch_fn, &state);
+	if (NT_STATUS_IS_OK(status) && (state.buf != NULL)) {
+		listing = dir_cache_parse(mem_ctx, state.buf, state.buflen);
+		if (listing != NULL) {
+			DO_PROFILE_INC(dir_cache_hits);
+			DEBUG(10, ("%s: %zu entries of %s from the cache\n",
+				   __func__, listing->num_entries, dir_path));
+			goto done;
+		}
+
+		/* Other smbds would trip over it as well */
+		DEBUG(1, ("%s: dropping corrupt cache entry for %s\n",
+			  __func__, dir_path));
+		dir_cache_delete(db, &id);
+	}
+
+	DO_PROFILE_INC(dir_cache_misses);
+
+	if (pbuilder == NULL) {
+		goto done;
+	}
+
+	hdr = (struct dir_cache_hdr) {
+		.id = id,
+		.stored = time(NULL),
+		.service_len = strlen(service) + 1,
+	};
+	dir_cache_hdr_stamp(&hdr, &smb_dname->st);
+
+	/* A later change might end up with the same mtime */
+	if (hdr.stored - hdr.mtime_sec < DIR_CACHE_MIN_AGE) {
+		goto done;
+	}
+
+	*pbuilder = dir_cache_builder_create(mem_ctx, conn, dir_path, &hdr,
+					     service);
+
+done:
+	TALLOC_FREE(frame);
+	return listing;
+}
+
+size_t dir_cache_num_entries(const struct dir_cache_listing *listing)
+{
+	return listing->num_entries;
+}
+
+/****************************************************************************
+ Name and stat information of the idx'th entry.
+****************************************************************************/
+
+const char *dir_cache_entry(const struct dir_cache_listing *listing,
+			    size_t idx, SMB_STRUCT_STAT *st)
+{
+	const uint8_t *p = listing->buf + listing->ofs[idx];
+
+	if (st != NULL) {
+		memcpy(st, p, sizeof(*st));
+	}
+	return (const char *)p + sizeof(struct dir_cache_ent);
+}
+
+/****************************************************************************
+ The DOS attribute EA of the idx'th entry. A blob with NULL data means the
+ file has none, false means we don't know.
+****************************************************************************/
+
+bool dir_cache_dos_attr(const struct dir_cache_listing *listing,
+			size_t idx, DATA_BLOB *blob)
+{
+	const uint8_t *p = listing->buf + listing->ofs[idx];
+	struct dir_cache_ent ent;
+
+	memcpy(&ent, p, sizeof(ent));
+
+	if (ent.ea_len == DIR_CACHE_UNKNOWN_EA) {
+		return false;
+	}
+	if (ent.ea_len == DIR_CACHE_NO_EA) {
+		*blob = data_blob_null;
+		return true;
+	}
+	*blob = data_blob_const(p + sizeof(ent) + ent.name_len, ent.ea_len);
+	return true;
+}
+
+/****************************************************************************
+ Something in the directory of path was changed through smbd: a name
+ came or went, or path itself was modified. Any action drops the
+ directory's record.
+****************************************************************************/
+
+void dir_cache_notify(connection_struct *conn, uint32_t action,
+		      uint32_t filter, const char *path)
+{
+	TALLOC_CTX *frame;
+	struct db_context *db;
+	struct smb_filename *smb_dname;
+	struct file_id id;
+	const char *p;
+	char *parent;
+
+	if (!dir_cache_enabled(conn)) {
+		return;
+	}
+
+	db = dir_cache_db_open();
+	if (db == NULL) {
+		return;
+	}
+
+	frame = talloc_stackframe();
+
+	p = strrchr_m(path, '/');
+	if (p == NULL) {
+		parent = talloc_strdup(frame, ".");
+	} else {
+		parent = talloc_strndup(frame, path, p - path);
+	}
+	if (parent == NULL) {
+		goto done;
+	}
+
+	smb_dname = synthetic_smb_fname(frame, parent, NULL, NULL);
+	if ((smb_dname == NULL) || (SMB_VFS_STAT(conn, smb_dname) != 0)) {
+		goto done;
+	}
+
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	dir_cache_delete(db, &id);
+
+done:
+	TALLOC_FREE(frame);
+}
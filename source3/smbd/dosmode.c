@@ -259,6 +259,7 @@ static uint32_t dos_mode_from_sbuf(connection_struct *conn,
 
 static bool get_ea_dos_attribute(connection_struct *conn,
 				 struct smb_filename *smb_fname,
+				 const DATA_BLOB *prefetched,
 				 uint32_t *pattr)
 {
 	struct xattr_DOSATTRIB dosattrib;
@@ -275,9 +276,18 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 	/* Don't reset pattr to zero as we may already have filename-based attributes we
 	   need to preserve. */
 
-	sizeret = SMB_VFS_GETXATTR(conn, smb_fname->base_name,
-				   SAMBA_XATTR_DOS_ATTRIB, attrstr,
-				   sizeof(attrstr));
+	if (prefetched != NULL) {
+		/* A NULL blob means the file has no DOS attribute EA */
+		if (prefetched->data == NULL) {
+			return false;
+		}
+		sizeret = MIN(prefetched->length, sizeof(attrstr));
+		memcpy(attrstr, prefetched->data, sizeret);
+	} else {
+		sizeret = SMB_VFS_GETXATTR(conn, smb_fname->base_name,
+					   SAMBA_XATTR_DOS_ATTRIB, attrstr,
+					   sizeof(attrstr));
+	}
 	if (sizeret == -1) {
 		DBG_INFO("Cannot get attribute "
 			 "from EA on file %s: Error = %s\n",
@@ -558,7 +568,9 @@ err_out:
  if "store dos attributes" is true.
 ****************************************************************************/
 
-uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname)
+static uint32_t dos_mode_internal(connection_struct *conn,
+				  struct smb_filename *smb_fname,
+				  const DATA_BLOB *prefetched_ea)
 {
 	uint32_t result = 0;
 	bool offline;
@@ -587,7 +599,7 @@ uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname)
 	}
 
 	/* Get the DOS attributes from an EA by preference. */
-	if (!get_ea_dos_attribute(conn, smb_fname, &result)) {
+	if (!get_ea_dos_attribute(conn, smb_fname, prefetched_ea, &result)) {
 		result |= dos_mode_from_sbuf(conn, smb_fname);
 	}
 
@@ -623,6 +635,23 @@ uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname)
 	return result;
 }
 
+uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname)
+{
+	return dos_mode_internal(conn, smb_fname, NULL);
+}
+
+/****************************************************************************
+ dos_mode() with the DOS attribute EA already read, for example by a
+ directory listing. A blob with NULL data means the file has no EA.
+****************************************************************************/
+
+uint32_t dos_mode_prefetched(connection_struct *conn,
+			     struct smb_filename *smb_fname,
+			     const DATA_BLOB *dos_attr_ea)
+{
+	return dos_mode_internal(conn, smb_fname, dos_attr_ea);
+}
+
 /*******************************************************************
  chmod a file - but preserve some bits.
  If "store dos attributes" is also set it will store the create time
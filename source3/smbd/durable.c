@@ -695,7 +695,7 @@ NTSTATUS vfs_default_durable_reconnect(struct connection_struct *conn,
 
 	fsp->fh->private_options = e->private_options;
 	fsp->fh->gen_id = smbXsrv_open_hash(op);
-	fsp->file_id = file_id;
+	fsp_set_file_id(fsp, file_id);
 	fsp->file_pid = smb1req->smbpid;
 	fsp->vuid = smb1req->vuid;
 	fsp->open_time = e->time;
@@ -748,6 +748,8 @@ NTSTATUS vfs_default_durable_reconnect(struct connection_struct *conn,
 			fsp_free(fsp);
 			return NT_STATUS_OBJECT_NAME_NOT_FOUND;
 		}
+
+		fsp_index_lease(fsp);
 	}
 
 	fsp->initial_allocation_size = cookie.initial_allocation_size;
@@ -279,6 +279,11 @@ void mark_file_modified(files_struct *fsp)
 
 	fsp->modified = true;
 
+	/* Cached listings would show the old size and times */
+	dir_cache_notify(fsp->conn, NOTIFY_ACTION_MODIFIED,
+			 FILE_NOTIFY_CHANGE_SIZE|FILE_NOTIFY_CHANGE_LAST_WRITE,
+			 fsp->fsp_name->base_name);
+
 	if (SMB_VFS_FSTAT(fsp, &fsp->fsp_name->st) != 0) {
 		return;
 	}
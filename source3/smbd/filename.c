@@ -1250,6 +1250,12 @@ int get_real_filename(connection_struct *conn, const char *path,
 		return ret;
 	}
 
+	ret = name_index_get_real_filename(conn, path, name, mem_ctx,
+					   found_name);
+	if (ret == 0 || (ret == -1 && errno != EOPNOTSUPP)) {
+		return ret;
+	}
+
 	return get_real_filename_full_scan(conn, path, name, mangled, mem_ctx,
 					   found_name);
 }
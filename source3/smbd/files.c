@@ -26,6 +26,201 @@
 
 #define FILE_HANDLE_OFFSET 0x1000
 
+/*
+ * Clients like virus scanners and indexers keep tens of thousands of
+ * handles open. To not walk sconn->files for every oplock break or
+ * lease message, the open files are also kept in hash tables by
+ * file_id, fd and lease key. The chains are linked through the
+ * fsp_hash_link members of files_struct, link_ofs says which one.
+ */
+
+#define FSP_HASH_MIN_BUCKETS 64
+
+struct fsp_hash {
+	size_t link_ofs;
+	uint32_t num_buckets;
+	uint32_t num_entries;
+	struct files_struct **buckets;
+};
+
+static struct fsp_hash *fsp_hash_create(TALLOC_CTX *mem_ctx, size_t link_ofs)
+{
+	struct fsp_hash *h;
+
+	h = talloc_zero(mem_ctx, struct fsp_hash);
+	if (h == NULL) {
+		return NULL;
+	}
+	h->link_ofs = link_ofs;
+	h->num_buckets = FSP_HASH_MIN_BUCKETS;
+	h->buckets = talloc_zero_array(h, struct files_struct *,
+				       h->num_buckets);
+	if (h->buckets == NULL) {
+		TALLOC_FREE(h);
+		return NULL;
+	}
+	return h;
+}
+
+static struct fsp_hash_link *fsp_hash_link(const struct fsp_hash *h,
+					   struct files_struct *fsp)
+{
+	return (struct fsp_hash_link *)((char *)fsp + h->link_ofs);
+}
+
+static void fsp_hash_insert(struct fsp_hash *h, struct files_struct *fsp)
+{
+	struct fsp_hash_link *l = fsp_hash_link(h, fsp);
+	struct files_struct **bucket = &h->buckets[l->hash % h->num_buckets];
+
+	l->prev = NULL;
+	l->next = *bucket;
+	if (l->next != NULL) {
+		fsp_hash_link(h, l->next)->prev = fsp;
+	}
+	*bucket = fsp;
+	l->linked = true;
+	h->num_entries += 1;
+}
+
+static void fsp_hash_remove(struct fsp_hash *h, struct files_struct *fsp)
+{
+	struct fsp_hash_link *l;
+
+	if (h == NULL) {
+		return;
+	}
+	l = fsp_hash_link(h, fsp);
+
+	if (!l->linked) {
+		return;
+	}
+	if (l->prev != NULL) {
+		fsp_hash_link(h, l->prev)->next = l->next;
+	} else {
+		h->buckets[l->hash % h->num_buckets] = l->next;
+	}
+	if (l->next != NULL) {
+		fsp_hash_link(h, l->next)->prev = l->prev;
+	}
+	l->next = l->prev = NULL;
+	l->linked = false;
+	h->num_entries -= 1;
+}
+
+/*
+ * Keep the chains short. If we can't grow, the chains just get longer.
+ */
+static void fsp_hash_grow(struct fsp_hash *h)
+{
+	struct files_struct **old_buckets = h->buckets;
+	uint32_t old_num_buckets = h->num_buckets;
+	struct files_struct **buckets;
+	uint32_t i;
+
+	if ((h->num_entries < h->num_buckets * 2) ||
+	    (h->num_buckets > UINT32_MAX / 4)) {
+		return;
+	}
+
+	buckets = talloc_zero_array(h, struct files_struct *,
+				    h->num_buckets * 4);
+	if (buckets == NULL) {
+		return;
+	}
+
+	h->buckets = buckets;
+	h->num_buckets *= 4;
+	h->num_entries = 0;
+
+	for (i=0; i<old_num_buckets; i++) {
+		struct files_struct *fsp, *next;
+
+		for (fsp = old_buckets[i]; fsp != NULL; fsp = next) {
+			next = fsp_hash_link(h, fsp)->next;
+			fsp_hash_insert(h, fsp);
+		}
+	}
+
+	TALLOC_FREE(old_buckets);
+}
+
+static void fsp_hash_add(struct fsp_hash *h, struct files_struct *fsp,
+			 uint32_t hash)
+{
+	if (h == NULL) {
+		return;
+	}
+	fsp_hash_remove(h, fsp);
+	fsp_hash_link(h, fsp)->hash = hash;
+	fsp_hash_insert(h, fsp);
+	fsp_hash_grow(h);
+}
+
+static struct files_struct *fsp_hash_first(const struct fsp_hash *h,
+					   uint32_t hash)
+{
+	struct files_struct *fsp;
+
+	if (h == NULL) {
+		return NULL;
+	}
+	fsp = h->buckets[hash % h->num_buckets];
+
+	while ((fsp != NULL) && (fsp_hash_link(h, fsp)->hash != hash)) {
+		fsp = fsp_hash_link(h, fsp)->next;
+	}
+	return fsp;
+}
+
+static struct files_struct *fsp_hash_next(const struct fsp_hash *h,
+					  struct files_struct *fsp)
+{
+	uint32_t hash = fsp_hash_link(h, fsp)->hash;
+
+	do {
+		fsp = fsp_hash_link(h, fsp)->next;
+	} while ((fsp != NULL) && (fsp_hash_link(h, fsp)->hash != hash));
+
+	return fsp;
+}
+
+static uint32_t fsp_file_id_hash(const struct file_id *id)
+{
+	TDB_DATA key = make_tdb_data((const uint8_t *)id, sizeof(*id));
+	return tdb_jenkins_hash(&key);
+}
+
+static uint32_t fsp_lease_key_hash(const struct smb2_lease_key *lease_key)
+{
+	TDB_DATA key = make_tdb_data((const uint8_t *)lease_key->data,
+				     sizeof(lease_key->data));
+	return tdb_jenkins_hash(&key);
+}
+
+/*
+ * Connections from create_conn_struct() never see file_init(), they
+ * get their indexes with the first fsp.
+ */
+static bool file_init_index(struct smbd_server_connection *sconn)
+{
+	if (sconn->fsp_by_file_id == NULL) {
+		sconn->fsp_by_file_id = fsp_hash_create(
+			sconn, offsetof(struct files_struct, file_id_link));
+	}
+	if (sconn->fsp_by_fd == NULL) {
+		sconn->fsp_by_fd = fsp_hash_create(
+			sconn, offsetof(struct files_struct, fd_link));
+	}
+	if (sconn->fsp_by_lease_key == NULL) {
+		sconn->fsp_by_lease_key = fsp_hash_create(
+			sconn, offsetof(struct files_struct, lease_link));
+	}
+	return ((sconn->fsp_by_file_id != NULL) &&
+		(sconn->fsp_by_fd != NULL) &&
+		(sconn->fsp_by_lease_key != NULL));
+}
+
 /**
  * create new fsp to be used for file_new or a durable handle reconnect
  */
@@ -35,8 +230,17 @@ NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 	NTSTATUS status = NT_STATUS_NO_MEMORY;
 	files_struct *fsp = NULL;
 	struct smbd_server_connection *sconn = conn->sconn;
+	TALLOC_CTX *mem_pool = mem_ctx;
+
+	if (!file_init_index(sconn)) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (sconn->slab_pool != NULL) {
+		mem_pool = sconn->slab_pool;
+	}
 
-	fsp = talloc_zero(mem_ctx, struct files_struct);
+	fsp = talloc_zero(mem_pool, struct files_struct);
 	if (fsp == NULL) {
 		goto fail;
 	}
@@ -46,11 +250,16 @@ NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 	 * when doing a dos/fcb open, which will then share the file_handle
 	 * across multiple fsps.
 	 */
-	fsp->fh = talloc_zero(mem_ctx, struct fd_handle);
+	fsp->fh = talloc_zero(mem_pool, struct fd_handle);
 	if (fsp->fh == NULL) {
 		goto fail;
 	}
 
+	if (mem_pool != mem_ctx) {
+		talloc_reparent(mem_pool, mem_ctx, fsp);
+		talloc_reparent(mem_pool, mem_ctx, fsp->fh);
+	}
+
 	fsp->fh->ref_count = 1;
 	fsp->fh->fd = -1;
 
@@ -59,6 +268,8 @@ NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 
 	DLIST_ADD(sconn->files, fsp);
 	sconn->num_files += 1;
+	fsp_hash_add(sconn->fsp_by_file_id, fsp,
+		     fsp_file_id_hash(&fsp->file_id));
 
 	conn->num_files_open++;
 
@@ -132,13 +343,6 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		req->chain_fsp = fsp;
 	}
 
-	/* A new fsp invalidates the positive and
-	  negative fsp_fi_cache as the new fsp is pushed
-	  at the start of the list and we search from
-	  a cache hit to the *end* of the list. */
-
-	ZERO_STRUCT(sconn->fsp_fi_cache);
-
 	*result = fsp;
 	return NT_STATUS_OK;
 }
@@ -235,7 +439,7 @@ bool file_init(struct smbd_server_connection *sconn)
 
 	sconn->real_max_open_files = files_max_open_fds;
 
-	return true;
+	return file_init_index(sconn);
 }
 
 /****************************************************************************
@@ -283,14 +487,11 @@ struct files_struct *files_forall(
 
 files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 {
-	int count=0;
 	files_struct *fsp;
 
-	for (fsp=sconn->files; fsp; fsp=fsp->next,count++) {
+	for (fsp = fsp_hash_first(sconn->fsp_by_fd, fd); fsp;
+	     fsp = fsp_hash_next(sconn->fsp_by_fd, fsp)) {
 		if (fsp->fh->fd == fd) {
-			if (count > 10) {
-				DLIST_PROMOTE(sconn->files, fsp);
-			}
 			return fsp;
 		}
 	}
@@ -305,20 +506,16 @@ files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 files_struct *file_find_dif(struct smbd_server_connection *sconn,
 			    struct file_id id, unsigned long gen_id)
 {
-	int count=0;
 	files_struct *fsp;
 
 	if (gen_id == 0) {
 		return NULL;
 	}
 
-	for (fsp=sconn->files; fsp; fsp=fsp->next,count++) {
+	for (fsp = file_find_di_first(sconn, id); fsp;
+	     fsp = file_find_di_next(fsp)) {
 		/* We can have a fsp->fh->fd == -1 here as it could be a stat open. */
-		if (file_id_equal(&fsp->file_id, &id) &&
-		    fsp->fh->gen_id == gen_id ) {
-			if (count > 10) {
-				DLIST_PROMOTE(sconn->files, fsp);
-			}
+		if (fsp->fh->gen_id == gen_id) {
 			/* Paranoia check. */
 			if ((fsp->fh->fd == -1) &&
 			    (fsp->oplock_type != NO_OPLOCK &&
@@ -341,8 +538,6 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 
 /****************************************************************************
  Find the first fsp given a device and inode.
- We use a singleton cache here to speed up searching from getfilepathinfo
- calls.
 ****************************************************************************/
 
 files_struct *file_find_di_first(struct smbd_server_connection *sconn,
@@ -350,23 +545,15 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 {
 	files_struct *fsp;
 
-	if (file_id_equal(&sconn->fsp_fi_cache.id, &id)) {
-		/* Positive or negative cache hit. */
-		return sconn->fsp_fi_cache.fsp;
-	}
-
-	sconn->fsp_fi_cache.id = id;
-
-	for (fsp=sconn->files;fsp;fsp=fsp->next) {
+	for (fsp = fsp_hash_first(sconn->fsp_by_file_id,
+				  fsp_file_id_hash(&id));
+	     fsp;
+	     fsp = fsp_hash_next(sconn->fsp_by_file_id, fsp)) {
 		if (file_id_equal(&fsp->file_id, &id)) {
-			/* Setup positive cache. */
-			sconn->fsp_fi_cache.fsp = fsp;
 			return fsp;
 		}
 	}
 
-	/* Setup negative cache. */
-	sconn->fsp_fi_cache.fsp = NULL;
 	return NULL;
 }
 
@@ -376,9 +563,11 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 
 files_struct *file_find_di_next(files_struct *start_fsp)
 {
+	struct fsp_hash *h = start_fsp->conn->sconn->fsp_by_file_id;
 	files_struct *fsp;
 
-	for (fsp = start_fsp->next;fsp;fsp=fsp->next) {
+	for (fsp = fsp_hash_next(h, start_fsp); fsp;
+	     fsp = fsp_hash_next(h, fsp)) {
 		if (file_id_equal(&fsp->file_id, &start_fsp->file_id)) {
 			return fsp;
 		}
@@ -393,7 +582,10 @@ struct files_struct *file_find_one_fsp_from_lease_key(
 {
 	struct files_struct *fsp;
 
-	for (fsp = sconn->files; fsp; fsp=fsp->next) {
+	for (fsp = fsp_hash_first(sconn->fsp_by_lease_key,
+				  fsp_lease_key_hash(lease_key));
+	     fsp;
+	     fsp = fsp_hash_next(sconn->fsp_by_lease_key, fsp)) {
 		if ((fsp->lease != NULL) &&
 		    (fsp->lease->lease.lease_key.data[0] ==
 		     lease_key->data[0]) &&
@@ -405,6 +597,51 @@ struct files_struct *file_find_one_fsp_from_lease_key(
 	return NULL;
 }
 
+/****************************************************************************
+ Set the file_id of an fsp, keeping the index current.
+****************************************************************************/
+
+void fsp_set_file_id(files_struct *fsp, struct file_id id)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+
+	fsp->file_id = id;
+	fsp_hash_add(sconn->fsp_by_file_id, fsp, fsp_file_id_hash(&id));
+}
+
+/****************************************************************************
+ Index fsp->fh->fd after it changed. fd_open() and fd_close() do this,
+ anything else that sets the fd of an fsp on sconn->files has to call
+ it as well, file_find_fd() only looks at the index.
+****************************************************************************/
+
+void fsp_index_fd(files_struct *fsp)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+
+	if (fsp->fh->fd == -1) {
+		fsp_hash_remove(sconn->fsp_by_fd, fsp);
+		return;
+	}
+	fsp_hash_add(sconn->fsp_by_fd, fsp, fsp->fh->fd);
+}
+
+/****************************************************************************
+ Index fsp->lease once its key is set.
+****************************************************************************/
+
+void fsp_index_lease(files_struct *fsp)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+
+	if (fsp->lease == NULL) {
+		fsp_hash_remove(sconn->fsp_by_lease_key, fsp);
+		return;
+	}
+	fsp_hash_add(sconn->fsp_by_lease_key, fsp,
+		     fsp_lease_key_hash(&fsp->lease->lease.lease_key));
+}
+
 /****************************************************************************
  Find any fsp open with a pathname below that of an already open path.
 ****************************************************************************/
@@ -481,6 +718,9 @@ void fsp_free(files_struct *fsp)
 	DLIST_REMOVE(sconn->files, fsp);
 	SMB_ASSERT(sconn->num_files > 0);
 	sconn->num_files--;
+	fsp_hash_remove(sconn->fsp_by_file_id, fsp);
+	fsp_hash_remove(sconn->fsp_by_fd, fsp);
+	fsp_hash_remove(sconn->fsp_by_lease_key, fsp);
 
 	TALLOC_FREE(fsp->fake_file_handle);
 
@@ -540,11 +780,6 @@ void file_free(struct smb_request *req, files_struct *fsp)
 		remove_smb2_chained_fsp(fsp);
 	}
 
-	/* Closing a file can invalidate the positive cache. */
-	if (fsp == sconn->fsp_fi_cache.fsp) {
-		ZERO_STRUCT(sconn->fsp_fi_cache);
-	}
-
 	/* Drop all remaining extensions. */
 	vfs_remove_all_fsp_extensions(fsp);
 
@@ -697,8 +932,9 @@ NTSTATUS dup_file_fsp(struct smb_request *req, files_struct *from,
 
 	to->fh = from->fh;
 	to->fh->ref_count++;
+	fsp_index_fd(to);
 
-	to->file_id = from->file_id;
+	fsp_set_file_id(to, from->file_id);
 	to->initial_allocation_size = from->initial_allocation_size;
 	to->file_pid = from->file_pid;
 	to->vuid = from->vuid;
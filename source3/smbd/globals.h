@@ -30,12 +30,6 @@ extern struct smbd_dmapi_context *dmapi_ctx;
 /* how many write cache buffers have been allocated */
 extern unsigned int allocated_write_caches;
 
-/* A singleton cache to speed up searching by dev/inode. */
-struct fsp_singleton_cache {
-	files_struct *fsp;
-	struct file_id id;
-};
-
 extern const struct mangle_fns *mangle_fns;
 
 extern unsigned char *chartest;
@@ -288,6 +282,11 @@ NTSTATUS smbd_smb2_request_process_close(struct smbd_smb2_request *req);
 NTSTATUS smbd_smb2_request_process_flush(struct smbd_smb2_request *req);
 NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req);
 NTSTATUS smb2_read_complete(struct tevent_req *req, ssize_t nread, int err);
+NTSTATUS smbd_smb2_read_buf_alloc(TALLOC_CTX *mem_ctx,
+				  struct smbXsrv_connection *xconn,
+				  size_t size, DATA_BLOB *blob);
+void smbd_smb2_read_buf_free(struct smbXsrv_connection *xconn,
+			     DATA_BLOB *blob);
 NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req);
 NTSTATUS smb2_write_complete(struct tevent_req *req, ssize_t nwritten, int err);
 NTSTATUS smb2_write_complete_nosync(struct tevent_req *req, ssize_t nwritten,
@@ -457,6 +456,19 @@ struct smbXsrv_connection {
 		} request_read_state;
 		struct smbd_smb2_send_queue *send_queue;
 		size_t send_queue_len;
+		/*
+		 * Used to flush the send_queue after all
+		 * replies of the current event loop iteration
+		 * are queued, so that they can be signed together.
+		 */
+		struct tevent_immediate *send_immediate;
+
+		/*
+		 * Page aligned buffers for READ responses that
+		 * have to go through memory, see
+		 * smbd_smb2_read_buf_alloc().
+		 */
+		struct smbd_smb2_read_buf_cache *read_buf_cache;
 
 		struct {
 			/*
@@ -678,6 +690,15 @@ struct smbd_smb2_send_queue {
 	struct iovec *vector;
 	int count;
 
+	/*
+	 * If sign_key.length is not 0, the pdu in sign_vector
+	 * still needs to be signed. This is done in batches
+	 * by smbd_smb2_flush_send_queue().
+	 */
+	DATA_BLOB sign_key;
+	struct iovec *sign_vector;
+	int sign_count;
+
 	TALLOC_CTX *mem_ctx;
 };
 
@@ -875,7 +896,17 @@ struct smbd_server_connection {
 	struct files_struct *files;
 
 	int real_max_open_files;
-	struct fsp_singleton_cache fsp_fi_cache;
+
+	/* Indexes of "files" by file_id, fd and lease key */
+	struct fsp_hash *fsp_by_file_id;
+	struct fsp_hash *fsp_by_fd;
+	struct fsp_hash *fsp_by_lease_key;
+
+	/*
+	 * talloc_pool_slab() for SMB2 requests and files_structs,
+	 * NULL unless "smbd:slab pool size" is set.
+	 */
+	TALLOC_CTX *slab_pool;
 
 	struct pending_message_list *deferred_open_queue;
 
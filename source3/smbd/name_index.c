@@ -0,0 +1,977 @@
+/*
+   Unix SMB/CIFS implementation.
+   Case-insensitive directory name index shared between smbd processes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_open.h"
+#include "util_tdb.h"
+#include "messages.h"
+#include "lib/background.h"
+#include "../librpc/gen_ndr/notify.h"
+
+/*
+ * When a case-insensitive lookup misses, get_real_filename() has to
+ * scan the whole directory. With "smbd:name index = yes" the result
+ * of such a scan is kept in name_index.tdb, so that every smbd can
+ * answer the next lookup in that directory with a single fetch.
+ *
+ * Per directory there is a header record
+ *
+ *	"D" <absolute directory path>
+ *
+ * holding device, inode and mtime of the directory as seen right
+ * before the scan, plus the generation of the scan. Every name found
+ * is stored as
+ *
+ *	"N" <generation as 16 hex digits> "/" <upper cased name>
+ *
+ * with the name as found on disk. The generation is the scan's start
+ * time in the upper 32 bits and random in the lower ones, so
+ * concurrent scans of a directory never write the same records. The
+ * scan only stores its header if the header still has the generation
+ * seen before the scan, the loser removes its names again. A lookup
+ * that does not find its name checks that the header did not change
+ * in the meantime before it reports ENOENT.
+ *
+ * Changes done by smbd come in via notify_fname() and update the
+ * index in place. Any other change to the directory changes its
+ * mtime, which makes the next lookup rescan it. A change made behind
+ * our back within the same mtime tick as a change done by smbd can go
+ * unnoticed until the directory changes again.
+ *
+ * A rescan removes the names of the previous generation it saw again.
+ * Names that vanished behind our back and the names of removed
+ * directories are pruned by a background job of the parent smbd
+ * every "smbd:name index prune interval" seconds. It removes headers
+ * of directories that are gone and names of generations that no
+ * header refers to and that are older than NAME_INDEX_PRUNE_AGE.
+ */
+
+#define NAME_INDEX_HASH_SIZE 1000003
+
+/* Don't trust an mtime younger than this for a fresh scan */
+#define NAME_INDEX_MIN_AGE 2
+
+#define NAME_INDEX_CASE_DUPS 0x0001
+
+/*
+ * Unreferenced names younger than this might belong to a scan in
+ * progress. A scan that takes more than half of it does not store its
+ * result.
+ */
+#define NAME_INDEX_PRUNE_AGE 3600
+
+#define NAME_INDEX_DEFAULT_PRUNE_INTERVAL (60*15)
+
+struct name_index_hdr {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t gen;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+static struct db_context *name_index_db;
+
+static bool name_index_enabled(connection_struct *conn)
+{
+	if (lp_clustering()) {
+		return false;
+	}
+	if (conn->case_sensitive) {
+		return false;
+	}
+	if (!(conn->fs_capabilities & FILE_CASE_SENSITIVE_SEARCH)) {
+		return false;
+	}
+	return lp_parm_bool(SNUM(conn), "smbd", "name index", false);
+}
+
+static struct db_context *name_index_db_open(void)
+{
+	char *db_path;
+
+	if (name_index_db != NULL) {
+		return name_index_db;
+	}
+
+	db_path = lock_path("name_index.tdb");
+	if (db_path == NULL) {
+		return NULL;
+	}
+
+	name_index_db = db_open(NULL, db_path, NAME_INDEX_HASH_SIZE,
+				TDB_DEFAULT | TDB_CLEAR_IF_FIRST |
+				TDB_INCOMPATIBLE_HASH | TDB_XXHASH,
+				O_RDWR | O_CREAT, 0600,
+				DBWRAP_LOCK_ORDER_3, DBWRAP_FLAG_NONE);
+	if (name_index_db == NULL) {
+		DEBUG(1, ("%s: db_open(%s) failed: %s\n", __func__, db_path,
+			  strerror(errno)));
+	}
+	TALLOC_FREE(db_path);
+
+	return name_index_db;
+}
+
+static int name_index_prune(void *private_data);
+static void name_index_prune_done(struct tevent_req *req);
+
+static int name_index_prune_interval(void)
+{
+	return lp_parm_int(-1, "smbd", "name index prune interval",
+			   NAME_INDEX_DEFAULT_PRUNE_INTERVAL);
+}
+
+/****************************************************************************
+ The parent opens the database, so that it survives the short lived
+ smbd processes in spite of TDB_CLEAR_IF_FIRST, and prunes it from time
+ to time. Nothing happens unless a share uses the index, and failing
+ here is not fatal, the index is just a cache.
+****************************************************************************/
+
+void name_index_init(struct messaging_context *msg_ctx)
+{
+	struct tevent_req *req;
+	int snum, num_services;
+	bool used = false;
+
+	if (lp_clustering()) {
+		return;
+	}
+
+	num_services = lp_numservices();
+	for (snum = 0; snum < num_services; snum++) {
+		if (lp_snum_ok(snum) &&
+		    lp_parm_bool(snum, "smbd", "name index", false)) {
+			used = true;
+			break;
+		}
+	}
+	if (!used) {
+		return;
+	}
+
+	if (name_index_db_open() == NULL) {
+		return;
+	}
+
+	req = background_job_send(
+		msg_ctx, messaging_tevent_context(msg_ctx), msg_ctx, NULL, 0,
+		name_index_prune_interval(), name_index_prune, NULL);
+	if (req == NULL) {
+		DEBUG(1, ("%s: background_job_send failed\n", __func__));
+		return;
+	}
+	tevent_req_set_callback(req, name_index_prune_done, msg_ctx);
+}
+
+static void name_index_prune_done(struct tevent_req *req)
+{
+	struct messaging_context *msg_ctx = tevent_req_callback_data(
+		req, struct messaging_context);
+	NTSTATUS status;
+
+	status = background_job_recv(req);
+	TALLOC_FREE(req);
+	DEBUG(1, ("name index prune job ended with %s\n",
+		  nt_errstr(status)));
+
+	req = background_job_send(
+		msg_ctx, messaging_tevent_context(msg_ctx), msg_ctx, NULL, 0,
+		name_index_prune_interval(), name_index_prune, NULL);
+	if (req == NULL) {
+		DEBUG(1, ("%s: background_job_send failed\n", __func__));
+		return;
+	}
+	tevent_req_set_callback(req, name_index_prune_done, msg_ctx);
+}
+
+static char *name_index_dirpath(TALLOC_CTX *mem_ctx,
+				connection_struct *conn, const char *path)
+{
+	if ((path == NULL) || (path[0] == '\0') || ISDOT(path)) {
+		return talloc_strdup(mem_ctx, conn->connectpath);
+	}
+	if (path[0] == '.' && path[1] == '/') {
+		path += 2;
+	}
+	if (path[0] == '/') {
+		return talloc_strdup(mem_ctx, path);
+	}
+	return talloc_asprintf(mem_ctx, "%s/%s", conn->connectpath, path);
+}
+
+static TDB_DATA name_index_hdr_key(TALLOC_CTX *mem_ctx, const char *dirpath)
+{
+	char *key = talloc_asprintf(mem_ctx, "D%s", dirpath);
+	return string_tdb_data(key);
+}
+
+static TDB_DATA name_index_name_key(TALLOC_CTX *mem_ctx, uint64_t gen,
+				    const char *folded)
+{
+	char *key = talloc_asprintf(mem_ctx, "N%016"PRIx64"/%s", gen,
+				    folded);
+	return string_tdb_data(key);
+}
+
+static uint64_t name_index_new_gen(void)
+{
+	uint32_t rnd;
+
+	generate_random_buffer((uint8_t *)&rnd, sizeof(rnd));
+	return ((uint64_t)time(NULL) << 32) | rnd;
+}
+
+static time_t name_index_gen_time(uint64_t gen)
+{
+	return (time_t)(gen >> 32);
+}
+
+static bool name_index_parse_hdr(TDB_DATA data, struct name_index_hdr *hdr)
+{
+	if (data.dsize != sizeof(struct name_index_hdr)) {
+		return false;
+	}
+	memcpy(hdr, data.dptr, sizeof(struct name_index_hdr));
+	return true;
+}
+
+struct name_index_fetch_hdr_state {
+	struct name_index_hdr *hdr;
+	bool ok;
+};
+
+static void name_index_fetch_hdr_parser(TDB_DATA key, TDB_DATA data,
+					void *private_data)
+{
+	struct name_index_fetch_hdr_state *state = private_data;
+	state->ok = name_index_parse_hdr(data, state->hdr);
+}
+
+/*
+ * Fetch the header of dirpath. Returns false if there is none.
+ */
+static bool name_index_fetch_hdr(struct db_context *db, const char *dirpath,
+				 struct name_index_hdr *hdr)
+{
+	struct name_index_fetch_hdr_state state = { .hdr = hdr };
+	TDB_DATA key;
+	NTSTATUS status;
+
+	key = name_index_hdr_key(talloc_tos(), dirpath);
+	if (key.dptr == NULL) {
+		return false;
+	}
+	status = dbwrap_parse_record(db, key, name_index_fetch_hdr_parser,
+				     &state);
+	TALLOC_FREE(key.dptr);
+
+	return NT_STATUS_IS_OK(status) && state.ok;
+}
+
+static bool name_index_hdr_matches(const struct name_index_hdr *hdr,
+				   const SMB_STRUCT_STAT *st)
+{
+	return ((hdr->dev == st->st_ex_dev) &&
+		(hdr->ino == st->st_ex_ino) &&
+		(hdr->mtime_sec == st->st_ex_mtime.tv_sec) &&
+		(hdr->mtime_nsec == st->st_ex_mtime.tv_nsec));
+}
+
+static void name_index_hdr_stamp(struct name_index_hdr *hdr,
+				 const SMB_STRUCT_STAT *st)
+{
+	hdr->dev = st->st_ex_dev;
+	hdr->ino = st->st_ex_ino;
+	hdr->mtime_sec = st->st_ex_mtime.tv_sec;
+	hdr->mtime_nsec = st->st_ex_mtime.tv_nsec;
+}
+
+/*
+ * Store the header if the index still has generation "expected_gen",
+ * 0 meaning no header at all. Otherwise someone else rescanned the
+ * directory while we were looking at it, don't mix the two: With
+ * "drop" set, delete the header, else leave it alone.
+ */
+static bool name_index_store_hdr(struct db_context *db, const char *dirpath,
+				 const struct name_index_hdr *hdr,
+				 uint64_t expected_gen, bool drop)
+{
+	struct db_record *rec;
+	struct name_index_hdr cur = { .gen = 0 };
+	TDB_DATA key, value;
+	NTSTATUS status = NT_STATUS_OK;
+	bool stored = false;
+
+	key = name_index_hdr_key(talloc_tos(), dirpath);
+	if (key.dptr == NULL) {
+		return false;
+	}
+
+	rec = dbwrap_fetch_locked(db, talloc_tos(), key);
+	TALLOC_FREE(key.dptr);
+	if (rec == NULL) {
+		DEBUG(5, ("%s: dbwrap_fetch_locked failed\n", __func__));
+		return false;
+	}
+
+	value = dbwrap_record_get_value(rec);
+	if (!name_index_parse_hdr(value, &cur)) {
+		cur.gen = 0;
+	}
+
+	if (cur.gen == expected_gen) {
+		status = dbwrap_record_store(
+			rec, make_tdb_data((const uint8_t *)hdr, sizeof(*hdr)),
+			0);
+		stored = NT_STATUS_IS_OK(status);
+	} else if (drop) {
+		status = dbwrap_record_delete(rec);
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(5, ("%s: storing %s failed: %s\n", __func__, dirpath,
+			  nt_errstr(status)));
+	}
+
+	TALLOC_FREE(rec);
+	return stored;
+}
+
+static void name_index_delete_hdr(struct db_context *db, const char *dirpath)
+{
+	TDB_DATA key;
+
+	key = name_index_hdr_key(talloc_tos(), dirpath);
+	if (key.dptr == NULL) {
+		return;
+	}
+	dbwrap_delete(db, key);
+	TALLOC_FREE(key.dptr);
+}
+
+struct name_index_fetch_name_state {
+	TALLOC_CTX *mem_ctx;
+	char *name;
+	bool found;
+};
+
+static void name_index_fetch_name_parser(TDB_DATA key, TDB_DATA data,
+					 void *private_data)
+{
+	struct name_index_fetch_name_state *state = private_data;
+
+	if ((data.dsize == 0) || (data.dptr[data.dsize-1] != '\0')) {
+		return;
+	}
+
+	state->found = true;
+
+	if (state->mem_ctx != NULL) {
+		state->name = talloc_strdup(state->mem_ctx,
+					    (char *)data.dptr);
+	}
+}
+
+/*
+ * Look up "folded" in generation "gen". If mem_ctx is NULL, just
+ * report whether it exists.
+ */
+static bool name_index_fetch_name(struct db_context *db, uint64_t gen,
+				  const char *folded, TALLOC_CTX *mem_ctx,
+				  char **name)
+{
+	struct name_index_fetch_name_state state = { .mem_ctx = mem_ctx };
+	TDB_DATA key;
+
+	key = name_index_name_key(talloc_tos(), gen, folded);
+	if (key.dptr == NULL) {
+		return false;
+	}
+	dbwrap_parse_record(db, key, name_index_fetch_name_parser, &state);
+	TALLOC_FREE(key.dptr);
+
+	if (name != NULL) {
+		*name = state.name;
+	}
+	return state.found;
+}
+
+static NTSTATUS name_index_store_name(struct db_context *db, uint64_t gen,
+				      const char *folded, const char *name)
+{
+	TDB_DATA key;
+	NTSTATUS status;
+
+	key = name_index_name_key(talloc_tos(), gen, folded);
+	if (key.dptr == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	status = dbwrap_store(db, key,
+			      make_tdb_data((const uint8_t *)name,
+					    strlen(name) + 1),
+			      0);
+	TALLOC_FREE(key.dptr);
+	return status;
+}
+
+static void name_index_delete_name(struct db_context *db, uint64_t gen,
+				   const char *folded)
+{
+	TDB_DATA key;
+
+	key = name_index_name_key(talloc_tos(), gen, folded);
+	if (key.dptr == NULL) {
+		return;
+	}
+	dbwrap_delete(db, key);
+	TALLOC_FREE(key.dptr);
+}
+
+static void name_index_delete_names(struct db_context *db, uint64_t gen,
+				    char **folded, size_t num_folded)
+{
+	size_t i;
+
+	for (i=0; i<num_folded; i++) {
+		name_index_delete_name(db, gen, folded[i]);
+	}
+}
+
+/*
+ * Scan the directory, answering the lookup from what we see and filling
+ * the index on the way. "old_gen" is the generation of the header
+ * before the scan, 0 if there was none.
+ */
+static int name_index_build(connection_struct *conn, struct db_context *db,
+			    const char *path, const char *dirpath,
+			    const SMB_STRUCT_STAT *st, uint64_t old_gen,
+			    const char *folded, TALLOC_CTX *mem_ctx,
+			    char **found_name)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct name_index_hdr hdr = { .flags = 0 };
+	struct smb_Dir *dir_hnd;
+	const char *dname = NULL;
+	char *talloced = NULL;
+	long offset = 0;
+	bool store = true;
+	char **names = NULL;
+	size_t num_names = 0;
+	int saved_errno = 0;
+
+	*found_name = NULL;
+
+	name_index_hdr_stamp(&hdr, st);
+	hdr.gen = name_index_new_gen();
+
+	dir_hnd = OpenDir(frame, conn, path, NULL, 0);
+	if (dir_hnd == NULL) {
+		saved_errno = errno;
+		DEBUG(3, ("%s: OpenDir(%s) failed: %s\n", __func__, path,
+			  strerror(errno)));
+		goto fail;
+	}
+
+	while ((dname = ReadDirName(dir_hnd, &offset, NULL, &talloced))) {
+		char *dfolded;
+
+		if (ISDOT(dname) || ISDOTDOT(dname)) {
+			TALLOC_FREE(talloced);
+			continue;
+		}
+
+		dfolded = strupper_talloc(frame, dname);
+		if (dfolded == NULL) {
+			TALLOC_FREE(talloced);
+			saved_errno = ENOMEM;
+			goto fail;
+		}
+
+		if ((*found_name == NULL) && (strcmp(dfolded, folded) == 0)) {
+			*found_name = talloc_strdup(mem_ctx, dname);
+			if (*found_name == NULL) {
+				TALLOC_FREE(talloced);
+				saved_errno = ENOMEM;
+				goto fail;
+			}
+		}
+
+		if (store &&
+		    name_index_fetch_name(db, hdr.gen, dfolded, NULL, NULL)) {
+			/*
+			 * Same name in another case, the first one
+			 * wins as in the full scan.
+			 */
+			hdr.flags |= NAME_INDEX_CASE_DUPS;
+			TALLOC_FREE(dfolded);
+		} else if (store) {
+			NTSTATUS status;
+
+			names = talloc_realloc(frame, names, char *,
+					       num_names + 1);
+			if (names == NULL) {
+				TALLOC_FREE(talloced);
+				saved_errno = ENOMEM;
+				goto fail;
+			}
+			names[num_names++] = dfolded;
+
+			status = name_index_store_name(db, hdr.gen, dfolded,
+						       dname);
+			if (!NT_STATUS_IS_OK(status)) {
+				DEBUG(3, ("%s: storing %s failed: %s\n",
+					  __func__, dname,
+					  nt_errstr(status)));
+				store = false;
+			}
+		} else {
+			TALLOC_FREE(dfolded);
+		}
+
+		TALLOC_FREE(talloced);
+	}
+
+	TALLOC_FREE(dir_hnd);
+
+	if (store &&
+	    (time(NULL) - name_index_gen_time(hdr.gen) >
+	     NAME_INDEX_PRUNE_AGE / 2)) {
+		/*
+		 * The prune job might have removed our names
+		 */
+		DEBUG(3, ("%s: scanning %s took too long\n", __func__,
+			  dirpath));
+		store = false;
+	}
+
+	if (store && name_index_store_hdr(db, dirpath, &hdr, old_gen, false)) {
+		DEBUG(10, ("%s: indexed %zu names in %s\n", __func__,
+			   num_names, dirpath));
+		/*
+		 * Lookups that still use the old generation find
+		 * the header changed when they miss a name.
+		 */
+		if (old_gen != 0) {
+			name_index_delete_names(db, old_gen, names, num_names);
+		}
+	} else {
+		name_index_delete_names(db, hdr.gen, names, num_names);
+	}
+
+	TALLOC_FREE(frame);
+
+	if (*found_name == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	return 0;
+
+fail:
+	if (names != NULL) {
+		name_index_delete_names(db, hdr.gen, names, num_names);
+	}
+	TALLOC_FREE(*found_name);
+	TALLOC_FREE(frame);
+	errno = saved_errno;
+	return -1;
+}
+
+/****************************************************************************
+ Find a name in "path" ignoring case, using the name index. Returns -1 with
+ errno EOPNOTSUPP if the index can't answer, the caller needs to scan the
+ directory then.
+****************************************************************************/
+
+int name_index_get_real_filename(connection_struct *conn, const char *path,
+				 const char *name, TALLOC_CTX *mem_ctx,
+				 char **found_name)
+{
+	TALLOC_CTX *frame;
+	struct db_context *db;
+	struct smb_filename *smb_dname;
+	struct name_index_hdr hdr;
+	char *dirpath, *folded;
+	uint64_t old_gen = 0;
+	int ret = -1;
+	int saved_errno = EOPNOTSUPP;
+
+	if (!name_index_enabled(conn)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	db = name_index_db_open();
+	if (db == NULL) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	frame = talloc_stackframe();
+
+	if ((path == NULL) || (*path == '\0')) {
+		path = ".";
+	}
+
+	dirpath = name_index_dirpath(frame, conn, path);
+	folded = strupper_talloc(frame, name);
+	smb_dname = synthetic_smb_fname(frame, path, NULL, NULL);
+	if ((dirpath == NULL) || (folded == NULL) || (smb_dname == NULL)) {
+		saved_errno = ENOMEM;
+		goto done;
+	}
+
+	if (SMB_VFS_STAT(conn, smb_dname) != 0) {
+		saved_errno = errno;
+		goto done;
+	}
+
+	if (name_index_fetch_hdr(db, dirpath, &hdr)) {
+		old_gen = hdr.gen;
+	}
+
+	if ((old_gen != 0) && name_index_hdr_matches(&hdr, &smb_dname->st)) {
+		struct name_index_hdr now;
+
+		if (name_index_fetch_name(db, hdr.gen, folded, mem_ctx,
+					  found_name)) {
+			ret = (*found_name != NULL) ? 0 : -1;
+			saved_errno = (ret == 0) ? 0 : ENOMEM;
+			goto done;
+		}
+
+		/*
+		 * A rescan or the prune job might have removed the
+		 * names of the generation we looked at.
+		 */
+		if (name_index_fetch_hdr(db, dirpath, &now) &&
+		    (now.gen == hdr.gen)) {
+			saved_errno = ENOENT;
+		}
+		goto done;
+	}
+
+	if (smb_dname->st.st_ex_mtime.tv_sec + NAME_INDEX_MIN_AGE >
+	    time(NULL)) {
+		/*
+		 * The directory might still change within the current
+		 * mtime granularity, let the caller do a plain scan.
+		 */
+		saved_errno = EOPNOTSUPP;
+		goto done;
+	}
+
+	ret = name_index_build(conn, db, path, dirpath, &smb_dname->st,
+			       old_gen, folded, mem_ctx, found_name);
+	saved_errno = (ret == 0) ? 0 : errno;
+
+done:
+	TALLOC_FREE(frame);
+	errno = saved_errno;
+	return ret;
+}
+
+/****************************************************************************
+ Apply a change smbd made to a directory to the name index.
+****************************************************************************/
+
+void name_index_notify(connection_struct *conn, uint32_t action,
+		       uint32_t filter, const char *path)
+{
+	TALLOC_CTX *frame;
+	struct db_context *db;
+	struct smb_filename *smb_dname;
+	struct name_index_hdr hdr;
+	const char *base, *p;
+	char *parent, *dirpath, *folded;
+	uint64_t gen;
+	bool add;
+
+	if (!(filter & (FILE_NOTIFY_CHANGE_FILE_NAME |
+			FILE_NOTIFY_CHANGE_DIR_NAME))) {
+		return;
+	}
+
+	switch (action) {
+	case NOTIFY_ACTION_ADDED:
+	case NOTIFY_ACTION_NEW_NAME:
+		add = true;
+		break;
+	case NOTIFY_ACTION_REMOVED:
+	case NOTIFY_ACTION_OLD_NAME:
+		add = false;
+		break;
+	default:
+		return;
+	}
+
+	if (!name_index_enabled(conn)) {
+		return;
+	}
+
+	db = name_index_db_open();
+	if (db == NULL) {
+		return;
+	}
+
+	frame = talloc_stackframe();
+
+	p = strrchr_m(path, '/');
+	if (p == NULL) {
+		parent = talloc_strdup(frame, ".");
+		base = path;
+	} else {
+		parent = talloc_strndup(frame, path, p - path);
+		base = p + 1;
+	}
+	if (parent == NULL) {
+		goto done;
+	}
+
+	if (!add) {
+		/*
+		 * If this was a directory, its own index is gone. The
+		 * prune job removes its names.
+		 */
+		char *oldpath = name_index_dirpath(frame, conn, path);
+		if (oldpath != NULL) {
+			name_index_delete_hdr(db, oldpath);
+		}
+	}
+
+	dirpath = name_index_dirpath(frame, conn, parent);
+	folded = strupper_talloc(frame, base);
+	if ((dirpath == NULL) || (folded == NULL)) {
+		goto done;
+	}
+
+	if (!name_index_fetch_hdr(db, dirpath, &hdr)) {
+		/* Not indexed */
+		goto done;
+	}
+	gen = hdr.gen;
+
+	if (add) {
+		char *existing = NULL;
+
+		if (name_index_fetch_name(db, gen, folded, frame,
+					  &existing)) {
+			if ((existing == NULL) ||
+			    (strcmp(existing, base) != 0)) {
+				hdr.flags |= NAME_INDEX_CASE_DUPS;
+			}
+		} else {
+			NTSTATUS status;
+
+			status = name_index_store_name(db, gen, folded, base);
+			if (!NT_STATUS_IS_OK(status)) {
+				name_index_delete_hdr(db, dirpath);
+				goto done;
+			}
+		}
+	} else {
+		char *existing = NULL;
+
+		if (hdr.flags & NAME_INDEX_CASE_DUPS) {
+			/*
+			 * Another case variant might take over, we
+			 * don't know. Rescan next time.
+			 */
+			name_index_delete_hdr(db, dirpath);
+			goto done;
+		}
+
+		if (name_index_fetch_name(db, gen, folded, frame,
+					  &existing) &&
+		    (existing != NULL) && (strcmp(existing, base) == 0)) {
+			name_index_delete_name(db, gen, folded);
+		}
+	}
+
+	smb_dname = synthetic_smb_fname(frame, parent, NULL, NULL);
+	if ((smb_dname == NULL) || (SMB_VFS_STAT(conn, smb_dname) != 0)) {
+		name_index_delete_hdr(db, dirpath);
+		goto done;
+	}
+
+	name_index_hdr_stamp(&hdr, &smb_dname->st);
+	name_index_store_hdr(db, dirpath, &hdr, gen, true);
+
+done:
+	TALLOC_FREE(frame);
+}
+
+/*
+ * The prune job, run in a child of the parent smbd
+ */
+
+struct name_index_prune_state {
+	uint64_t *gens;
+	size_t num_gens;
+	time_t now;
+	size_t num_deleted;
+};
+
+static int name_index_prune_hdr_fn(struct db_record *rec,
+				   void *private_data)
+{
+	struct name_index_prune_state *state = private_data;
+	struct name_index_hdr hdr;
+	TDB_DATA key, value;
+	char *dirpath;
+	SMB_STRUCT_STAT st;
+	uint64_t *gens;
+	int ret;
+
+	key = dbwrap_record_get_key(rec);
+	if ((key.dsize < 2) || (key.dptr[0] != 'D')) {
+		return 0;
+	}
+
+	value = dbwrap_record_get_value(rec);
+	if (!name_index_parse_hdr(value, &hdr)) {
+		goto delete;
+	}
+
+	dirpath = talloc_strndup(talloc_tos(), (const char *)key.dptr + 1,
+				 key.dsize - 1);
+	if (dirpath == NULL) {
+		return -1;
+	}
+
+	/*
+	 * The directory was removed or replaced behind our back
+	 */
+	ret = sys_stat(dirpath, &st, false);
+	TALLOC_FREE(dirpath);
+	if ((ret == -1) && ((errno == ENOENT) || (errno == ENOTDIR))) {
+		goto delete;
+	}
+	if ((ret == 0) &&
+	    ((hdr.dev != st.st_ex_dev) || (hdr.ino != st.st_ex_ino))) {
+		goto delete;
+	}
+
+	gens = talloc_realloc(NULL, state->gens, uint64_t,
+			      state->num_gens + 1);
+	if (gens == NULL) {
+		return -1;
+	}
+	gens[state->num_gens] = hdr.gen;
+	state->gens = gens;
+	state->num_gens += 1;
+	return 0;
+
+delete:
+	if (NT_STATUS_IS_OK(dbwrap_record_delete(rec))) {
+		state->num_deleted += 1;
+	}
+	return 0;
+}
+
+static int name_index_gen_cmp(const void *p1, const void *p2)
+{
+	const uint64_t *g1 = p1, *g2 = p2;
+
+	if (*g1 == *g2) {
+		return 0;
+	}
+	return (*g1 < *g2) ? -1 : 1;
+}
+
+static int name_index_prune_name_fn(struct db_record *rec,
+				    void *private_data)
+{
+	struct name_index_prune_state *state = private_data;
+	TDB_DATA key;
+	char genstr[17];
+	uint64_t gen;
+	char *end;
+
+	key = dbwrap_record_get_key(rec);
+	if ((key.dsize < 18) || (key.dptr[0] != 'N') ||
+	    (key.dptr[17] != '/')) {
+		return 0;
+	}
+	memcpy(genstr, key.dptr + 1, 16);
+	genstr[16] = '\0';
+
+	gen = strtoull(genstr, &end, 16);
+	if (*end != '\0') {
+		return 0;
+	}
+
+	if (name_index_gen_time(gen) + NAME_INDEX_PRUNE_AGE > state->now) {
+		/*
+		 * Might be a scan in progress
+		 */
+		return 0;
+	}
+
+	if (bsearch(&gen, state->gens, state->num_gens, sizeof(uint64_t),
+		    name_index_gen_cmp) != NULL) {
+		return 0;
+	}
+
+	if (NT_STATUS_IS_OK(dbwrap_record_delete(rec))) {
+		state->num_deleted += 1;
+	}
+	return 0;
+}
+
+static int name_index_prune(void *private_data)
+{
+	struct name_index_prune_state state = { .now = time(NULL) };
+	struct db_context *db;
+	NTSTATUS status;
+
+	db = name_index_db_open();
+	if (db == NULL) {
+		return name_index_prune_interval();
+	}
+
+	status = dbwrap_traverse(db, name_index_prune_hdr_fn, &state, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(1, ("%s: dbwrap_traverse failed: %s\n", __func__,
+			  nt_errstr(status)));
+		goto done;
+	}
+
+	if (state.num_gens != 0) {
+		qsort(state.gens, state.num_gens, sizeof(uint64_t),
+		      name_index_gen_cmp);
+	}
+
+	status = dbwrap_traverse(db, name_index_prune_name_fn, &state, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(1, ("%s: dbwrap_traverse failed: %s\n", __func__,
+			  nt_errstr(status)));
+	}
+
+	DEBUG(10, ("%s: pruned %zu records\n", __func__, state.num_deleted));
+done:
+	TALLOC_FREE(state.gens);
+	return name_index_prune_interval();
+}
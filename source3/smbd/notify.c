@@ -500,6 +500,9 @@ void notify_fname(connection_struct *conn, uint32_t action, uint32_t filter,
 		path += 2;
 	}
 
+	name_index_notify(conn, action, filter, path);
+	dir_cache_notify(conn, action, filter, path);
+
 	notify_trigger(notify_ctx, action, filter, conn->connectpath, path);
 }
 
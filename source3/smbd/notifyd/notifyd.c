@@ -733,12 +733,15 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 
 {
 	struct notifyd_trigger_state *tstate = private_data;
-	struct notify_event_msg msg = { .action = tstate->msg->action };
-	struct iovec iov[2];
+	struct notify_event_msg *msgs;
+	struct messaging_send_multi_dst *dsts;
+	size_t *dst_instances;
+	struct iovec iov;
 	size_t path_len = key.dsize;
 	struct notifyd_instance *instances = NULL;
 	size_t num_instances = 0;
-	size_t i;
+	size_t i, num_dsts;
+	int ret;
 
 	if (!notifyd_parse_entry(data.dptr, data.dsize, &instances,
 				 &num_instances)) {
@@ -750,16 +753,29 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 		   (unsigned)num_instances, (int)key.dsize,
 		   (char *)key.dptr));
 
-	iov[0].iov_base = &msg;
-	iov[0].iov_len = offsetof(struct notify_event_msg, path);
-	iov[1].iov_base = tstate->msg->path + path_len + 1;
-	iov[1].iov_len = strlen((char *)(iov[1].iov_base)) + 1;
+	if (num_instances == 0) {
+		return;
+	}
+
+	msgs = talloc_array(talloc_tos(), struct notify_event_msg,
+			    num_instances);
+	dsts = talloc_array(msgs, struct messaging_send_multi_dst,
+			    num_instances);
+	dst_instances = talloc_array(msgs, size_t, num_instances);
+	if ((msgs == NULL) || (dsts == NULL) || (dst_instances == NULL)) {
+		DEBUG(1, ("%s: talloc_array failed\n", __func__));
+		TALLOC_FREE(msgs);
+		return;
+	}
+
+	iov.iov_base = tstate->msg->path + path_len + 1;
+	iov.iov_len = strlen((char *)(iov.iov_base)) + 1;
+
+	num_dsts = 0;
 
 	for (i=0; i<num_instances; i++) {
 		struct notifyd_instance *instance = &instances[i];
-		struct server_id_buf idbuf;
 		uint32_t i_filter;
-		NTSTATUS status;
 
 		if (tstate->covered_by_sys_notify) {
 			if (tstate->recursive) {
@@ -779,31 +795,55 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 			continue;
 		}
 
-		msg.private_data = instance->instance.private_data;
+		/*
+		 * Only private_data differs between the watchers,
+		 * send it as the per-destination prefix.
+		 */
+		msgs[num_dsts] = (struct notify_event_msg) {
+			.action = tstate->msg->action,
+			.private_data = instance->instance.private_data
+		};
+		dsts[num_dsts] = (struct messaging_send_multi_dst) {
+			.dst = instance->client,
+			.prefix.iov_base = &msgs[num_dsts],
+			.prefix.iov_len = offsetof(struct notify_event_msg,
+						   path)
+		};
+		dst_instances[num_dsts] = i;
+		num_dsts += 1;
+	}
 
-		status = messaging_send_iov(
-			tstate->msg_ctx, instance->client,
-			MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
+	ret = messaging_send_iov_multi(tstate->msg_ctx, MSG_PVFS_NOTIFY,
+				       dsts, num_dsts, &iov, 1);
+	if (ret != 0) {
+		DEBUG(1, ("%s: messaging_send_iov_multi failed: %s\n",
+			  __func__, strerror(ret)));
+	}
+
+	for (i=0; i<num_dsts; i++) {
+		struct messaging_send_multi_dst *d = &dsts[i];
+		struct server_id_buf idbuf;
 
 		DEBUG(10, ("%s: messaging_send_iov to %s returned %s\n",
-			   __func__,
-			   server_id_str_buf(instance->client, &idbuf),
-			   nt_errstr(status)));
+			   __func__, server_id_str_buf(d->dst, &idbuf),
+			   strerror(d->ret)));
 
-		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
-		    procid_is_local(&instance->client)) {
+		if ((d->ret == ENOENT) && procid_is_local(&d->dst)) {
 			/*
 			 * That process has died
 			 */
-			notifyd_send_delete(tstate->msg_ctx, key, instance);
+			notifyd_send_delete(tstate->msg_ctx, key,
+					    &instances[dst_instances[i]]);
 			continue;
 		}
 
-		if (!NT_STATUS_IS_OK(status)) {
+		if (d->ret != 0) {
 			DEBUG(1, ("%s: messaging_send_iov returned %s\n",
-				  __func__, nt_errstr(status)));
+				  __func__, strerror(d->ret)));
 		}
 	}
+
+	TALLOC_FREE(msgs);
 }
 
 /*
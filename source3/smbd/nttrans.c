@@ -953,6 +953,12 @@ NTSTATUS set_sd(files_struct *fsp, struct security_descriptor *psd,
 	}
 
 	status = SMB_VFS_FSET_NT_ACL(fsp, security_info_sent, psd);
+	if (NT_STATUS_IS_OK(status)) {
+		/* The mode and owner of cached listings may be stale */
+		dir_cache_notify(fsp->conn, NOTIFY_ACTION_MODIFIED,
+				 FILE_NOTIFY_CHANGE_SECURITY,
+				 fsp->fsp_name->base_name);
+	}
 
 	TALLOC_FREE(psd);
 
@@ -368,6 +368,7 @@ NTSTATUS fd_open(struct connection_struct *conn,
 #endif
 
 	fsp->fh->fd = SMB_VFS_OPEN(conn, smb_fname, fsp, flags, mode);
+	fsp_index_fd(fsp);
 	if (fsp->fh->fd == -1) {
 		int posix_errno = errno;
 #ifdef O_NOFOLLOW
@@ -430,6 +431,7 @@ NTSTATUS fd_close(files_struct *fsp)
 
 	ret = SMB_VFS_CLOSE(fsp);
 	fsp->fh->fd = -1;
+	fsp_index_fd(fsp);
 	if (ret == -1) {
 		return map_nt_error_from_unix(errno);
 	}
@@ -979,7 +981,7 @@ static NTSTATUS open_file(files_struct *fsp,
 		return NT_STATUS_FILE_IS_A_DIRECTORY;
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	fsp->can_lock = True;
@@ -1642,6 +1644,7 @@ static NTSTATUS grant_fsp_lease(struct files_struct *fsp,
 
 		/* Ensure we're in sync with current lease state. */
 		fsp_lease_update(lck, fsp_client_guid(fsp), fsp->lease);
+		fsp_index_lease(fsp);
 		return NT_STATUS_OK;
 	}
 
@@ -1696,6 +1699,8 @@ static NTSTATUS grant_fsp_lease(struct files_struct *fsp,
 	d->num_leases += 1;
 	d->modified = true;
 
+	fsp_index_lease(fsp);
+
 	return NT_STATUS_OK;
 }
 
@@ -2699,7 +2704,7 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 		return NT_STATUS_ACCESS_DENIED;
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	fsp->share_access = share_access;
 	fsp->fh->private_options = private_flags;
 	fsp->access_mask = open_access_mask; /* We change this to the
@@ -3557,7 +3562,7 @@ static NTSTATUS open_directory(connection_struct *conn,
 	 * Setup the files_struct for it.
 	 */
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_dname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	fsp->can_lock = False;
@@ -3900,6 +3900,7 @@ void smbd_process(struct tevent_context *ev_ctx,
 	const char *locaddr = NULL;
 	const char *remaddr = NULL;
 	int ret;
+	unsigned long slab_pool_size;
 	NTSTATUS status;
 	struct timeval tv = timeval_current();
 	NTTIME now = timeval_to_nttime(&tv);
@@ -3926,6 +3927,19 @@ void smbd_process(struct tevent_context *ev_ctx,
 	sconn->ev_ctx = ev_ctx;
 	sconn->msg_ctx = msg_ctx;
 
+	slab_pool_size = lp_parm_ulong(-1, "smbd", "slab pool size", 0);
+	if (slab_pool_size != 0) {
+		/*
+		 * Requests and open files churn for the whole lifetime
+		 * of the process, recycle their memory instead of
+		 * fragmenting the heap.
+		 */
+		sconn->slab_pool = talloc_pool_slab(sconn, slab_pool_size);
+		if (sconn->slab_pool == NULL) {
+			exit_server("failed to create slab pool");
+		}
+	}
+
 	if (lp_server_max_protocol() >= PROTOCOL_SMB2_02) {
 		/*
 		 * We're not making the decision here,
@@ -203,6 +203,17 @@ int dptr_dnum(struct dptr_struct *dptr);
 bool dptr_get_priv(struct dptr_struct *dptr);
 void dptr_set_priv(struct dptr_struct *dptr);
 bool dptr_SearchDir(struct dptr_struct *dptr, const char *name, long *poffset, SMB_STRUCT_STAT *pst);
+struct tevent_req *dptr_prefetch_send(TALLOC_CTX *mem_ctx,
+				      struct tevent_context *ev,
+				      struct dptr_struct *dptr,
+				      size_t max_entries,
+				      size_t space,
+				      size_t entry_size);
+void dptr_prefetch_recv(struct tevent_req *req, struct dptr_struct *dptr);
+void dptr_prefetch_discard(struct dptr_struct *dptr);
+bool dptr_prefetched_dos_attr(struct dptr_struct *dptr,
+			      const struct smb_filename *smb_fname,
+			      DATA_BLOB *blob);
 void dptr_init_search_op(struct dptr_struct *dptr);
 bool dptr_fill(struct smbd_server_connection *sconn,
 	       char *buf1,unsigned int key);
@@ -242,6 +253,29 @@ bool dmapi_new_session(void);
 bool dmapi_destroy_session(void);
 uint32_t dmapi_file_flags(const char * const path);
 
+/* The following definitions come from smbd/dir_cache.c  */
+
+struct dir_cache_listing;
+struct dir_cache_builder;
+void dir_cache_init(void);
+void dir_cache_builder_add(struct dir_cache_builder *b, const char *name,
+			   const SMB_STRUCT_STAT *st);
+void dir_cache_builder_remove_last(struct dir_cache_builder *b);
+void dir_cache_builder_set_dos_attr(struct dir_cache_builder *b,
+				    const DATA_BLOB *blob);
+void dir_cache_builder_finish(struct dir_cache_builder *b);
+struct dir_cache_listing *dir_cache_lookup(TALLOC_CTX *mem_ctx,
+					   connection_struct *conn,
+					   const char *dir_path,
+					   struct dir_cache_builder **pbuilder);
+size_t dir_cache_num_entries(const struct dir_cache_listing *listing);
+const char *dir_cache_entry(const struct dir_cache_listing *listing,
+			    size_t idx, SMB_STRUCT_STAT *st);
+bool dir_cache_dos_attr(const struct dir_cache_listing *listing,
+			size_t idx, DATA_BLOB *blob);
+void dir_cache_notify(connection_struct *conn, uint32_t action,
+		      uint32_t filter, const char *path);
+
 /* The following definitions come from smbd/dnsregister.c  */
 
 bool smbd_setup_mdns_registration(struct tevent_context *ev,
@@ -257,6 +291,9 @@ uint32_t dos_mode_msdfs(connection_struct *conn,
 		      const struct smb_filename *smb_fname);
 int dos_attributes_to_stat_dos_flags(uint32_t dosmode);
 uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname);
+uint32_t dos_mode_prefetched(connection_struct *conn,
+			     struct smb_filename *smb_fname,
+			     const DATA_BLOB *dos_attr_ea);
 int file_set_dosmode(connection_struct *conn, struct smb_filename *smb_fname,
 		     uint32_t dosmode, const char *parent_dir, bool newfile);
 NTSTATUS file_set_sparse(connection_struct *conn,
@@ -375,6 +412,9 @@ files_struct *file_find_di_next(files_struct *start_fsp);
 struct files_struct *file_find_one_fsp_from_lease_key(
 	struct smbd_server_connection *sconn,
 	const struct smb2_lease_key *lease_key);
+void fsp_set_file_id(files_struct *fsp, struct file_id id);
+void fsp_index_fd(files_struct *fsp);
+void fsp_index_lease(files_struct *fsp);
 bool file_find_subpath(files_struct *dir_fsp);
 void file_sync_all(connection_struct *conn);
 void fsp_free(files_struct *fsp);
@@ -1072,6 +1112,15 @@ NTSTATUS srvstr_push_fn(const char *base_ptr, uint16_t smb_flags2, void *dest,
 		      const char *src, int dest_len, int flags, size_t *ret_len);
 ssize_t message_push_string(uint8_t **outbuf, const char *str, int flags);
 
+/* The following definitions come from smbd/name_index.c  */
+
+void name_index_init(struct messaging_context *msg_ctx);
+int name_index_get_real_filename(connection_struct *conn, const char *path,
+				 const char *name, TALLOC_CTX *mem_ctx,
+				 char **found_name);
+void name_index_notify(connection_struct *conn, uint32_t action,
+		       uint32_t filter, const char *path);
+
 /* The following definitions come from smbd/statcache.c  */
 
 void stat_cache_add( const char *full_orig_name,
@@ -73,6 +73,21 @@ static struct files_struct *log_writeable_file_fn(
 	return NULL;
 }
 
+static void log_slab_pool_stats(TALLOC_CTX *slab_pool)
+{
+	struct talloc_pool_stats stats;
+
+	if (talloc_pool_stats(slab_pool, &stats) != 0) {
+		return;
+	}
+
+	DEBUG(3, ("slab pool: %zu of %zu bytes used, %u objects, "
+		  "%zu bytes cached, %zu hits, %zu misses, %zu fallbacks\n",
+		  stats.used, stats.poolsize, stats.object_count,
+		  stats.slab_cached, stats.slab_hits, stats.slab_misses,
+		  stats.slab_fallbacks));
+}
+
 /****************************************************************************
  Exit the server.
 ****************************************************************************/
@@ -131,6 +146,9 @@ static void exit_server_common(enum server_exit_reason how,
 			bool found = false;
 			files_forall(sconn, log_writeable_file_fn, &found);
 		}
+		if (sconn->slab_pool != NULL) {
+			log_slab_pool_stats(sconn->slab_pool);
+		}
 	}
 
 	change_to_root_user();
@@ -208,6 +208,10 @@ static void smbd_smb2_request_getinfo_done(struct tevent_req *subreq)
 
 struct smbd_smb2_getinfo_state {
 	struct smbd_smb2_request *smb2req;
+	struct files_struct *fsp;
+	uint16_t file_info_level;
+	uint32_t in_output_buffer_length;
+	SMB_STRUCT_STAT sbuf;
 	NTSTATUS status;
 	DATA_BLOB out_output_buffer;
 };
@@ -242,6 +246,65 @@ static void smb2_ipc_getinfo(struct tevent_req *req,
 	}
 }
 
+static NTSTATUS smbd_smb2_getinfo_file(struct smbd_smb2_getinfo_state *state,
+				       connection_struct *conn,
+				       struct files_struct *fsp,
+				       bool delete_pending,
+				       struct timespec write_time_ts)
+{
+	char *data = NULL;
+	unsigned int data_size = 0;
+	struct ea_list *ea_list = NULL;
+	int lock_data_count = 0;
+	char *lock_data = NULL;
+	size_t fixed_portion;
+	NTSTATUS status;
+
+	status = smbd_do_qfilepathinfo(conn, state,
+				       state->file_info_level,
+				       fsp,
+				       fsp->fsp_name,
+				       delete_pending,
+				       write_time_ts,
+				       ea_list,
+				       lock_data_count,
+				       lock_data,
+				       STR_UNICODE,
+				       state->in_output_buffer_length,
+				       &fixed_portion,
+				       &data,
+				       &data_size);
+	if (!NT_STATUS_IS_OK(status)) {
+		SAFE_FREE(data);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_INVALID_LEVEL)) {
+			status = NT_STATUS_INVALID_INFO_CLASS;
+		}
+		return status;
+	}
+	if (state->in_output_buffer_length < fixed_portion) {
+		SAFE_FREE(data);
+		return NT_STATUS_INFO_LENGTH_MISMATCH;
+	}
+	if (data_size > 0) {
+		state->out_output_buffer = data_blob_talloc(state,
+							    data,
+							    data_size);
+		SAFE_FREE(data);
+		if (state->out_output_buffer.data == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		if (data_size > state->in_output_buffer_length) {
+			state->out_output_buffer.length =
+				state->in_output_buffer_length;
+			status = STATUS_BUFFER_OVERFLOW;
+		}
+	}
+	SAFE_FREE(data);
+	return status;
+}
+
+static void smbd_smb2_getinfo_fstat_done(struct tevent_req *subreq);
+
 static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 						 struct tevent_context *ev,
 						 struct smbd_smb2_request *smb2req,
@@ -285,33 +348,28 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 	switch (in_info_type) {
 	case SMB2_GETINFO_FILE:
 	{
-		uint16_t file_info_level;
-		char *data = NULL;
-		unsigned int data_size = 0;
 		bool delete_pending = false;
 		struct timespec write_time_ts;
 		struct file_id fileid;
-		struct ea_list *ea_list = NULL;
-		int lock_data_count = 0;
-		char *lock_data = NULL;
-		size_t fixed_portion;
 
 		ZERO_STRUCT(write_time_ts);
 
 		switch (in_file_info_class) {
 		case 0x0F:/* RAW_FILEINFO_SMB2_ALL_EAS */
-			file_info_level = 0xFF00 | in_file_info_class;
+			state->file_info_level = 0xFF00 | in_file_info_class;
 			break;
 
 		case 0x12:/* RAW_FILEINFO_SMB2_ALL_INFORMATION */
-			file_info_level = 0xFF00 | in_file_info_class;
+			state->file_info_level = 0xFF00 | in_file_info_class;
 			break;
 
 		default:
 			/* the levels directly map to the passthru levels */
-			file_info_level = in_file_info_class + 1000;
+			state->file_info_level = in_file_info_class + 1000;
 			break;
 		}
+		state->fsp = fsp;
+		state->in_output_buffer_length = in_output_buffer_length;
 
 		if (fsp->fake_file_handle) {
 			/*
@@ -327,7 +385,7 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 			 * to do this call. JRA.
 			 */
 
-			if (INFO_LEVEL_IS_UNIX(file_info_level)) {
+			if (INFO_LEVEL_IS_UNIX(state->file_info_level)) {
 				/* Always do lstat for UNIX calls. */
 				if (SMB_VFS_LSTAT(conn, fsp->fsp_name)) {
 					DEBUG(3,("smbd_smb2_getinfo_send: "
@@ -352,6 +410,34 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 						       &fsp->fsp_name->st);
 			get_file_infos(fileid, fsp->name_hash,
 				&delete_pending, &write_time_ts);
+		} else if (lp_parm_bool(SNUM(conn), "smbd", "async getinfo",
+					false)) {
+			struct tevent_req *subreq;
+
+			/*
+			 * Hand the fstat to the aio thread pool so a
+			 * slow file system does not stall every other
+			 * handle of this client. The stat lands in
+			 * state->sbuf, fsp->fsp_name->st is only
+			 * updated back on the main thread.
+			 */
+			subreq = SMB_VFS_FSTAT_SEND(state, ev, fsp,
+						    &state->sbuf);
+			if (tevent_req_nomem(subreq, req)) {
+				return tevent_req_post(req, ev);
+			}
+			tevent_req_set_callback(subreq,
+						smbd_smb2_getinfo_fstat_done,
+						req);
+
+			/* Ensure any close request knows about this outstanding IO. */
+			if (!aio_add_req_to_fsp(fsp, req)) {
+				tevent_req_nterror(req, NT_STATUS_NO_MEMORY);
+				return tevent_req_post(req, ev);
+			}
+
+			increment_outstanding_aio_calls();
+			return req;
 		} else {
 			/*
 			 * Original code - this is an open file.
@@ -371,49 +457,14 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 				&delete_pending, &write_time_ts);
 		}
 
-		status = smbd_do_qfilepathinfo(conn, state,
-					       file_info_level,
-					       fsp,
-					       fsp->fsp_name,
-					       delete_pending,
-					       write_time_ts,
-					       ea_list,
-					       lock_data_count,
-					       lock_data,
-					       STR_UNICODE,
-					       in_output_buffer_length,
-					       &fixed_portion,
-					       &data,
-					       &data_size);
-		if (!NT_STATUS_IS_OK(status)) {
-			SAFE_FREE(data);
-			if (NT_STATUS_EQUAL(status, NT_STATUS_INVALID_LEVEL)) {
-				status = NT_STATUS_INVALID_INFO_CLASS;
-			}
+		status = smbd_smb2_getinfo_file(state, conn, fsp,
+						delete_pending,
+						write_time_ts);
+		if (!(NT_STATUS_IS_OK(status) ||
+		      NT_STATUS_EQUAL(status, STATUS_BUFFER_OVERFLOW))) {
 			tevent_req_nterror(req, status);
 			return tevent_req_post(req, ev);
 		}
-		if (in_output_buffer_length < fixed_portion) {
-			SAFE_FREE(data);
-			tevent_req_nterror(
-				req, NT_STATUS_INFO_LENGTH_MISMATCH);
-			return tevent_req_post(req, ev);
-		}
-		if (data_size > 0) {
-			state->out_output_buffer = data_blob_talloc(state,
-								    data,
-								    data_size);
-			SAFE_FREE(data);
-			if (tevent_req_nomem(state->out_output_buffer.data, req)) {
-				return tevent_req_post(req, ev);
-			}
-			if (data_size > in_output_buffer_length) {
-				state->out_output_buffer.length =
-					in_output_buffer_length;
-				status = STATUS_BUFFER_OVERFLOW;
-			}
-		}
-		SAFE_FREE(data);
 		break;
 	}
 
@@ -537,6 +588,67 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 	return tevent_req_post(req, ev);
 }
 
+static void smbd_smb2_getinfo_fstat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smbd_smb2_getinfo_state *state = tevent_req_data(
+		req, struct smbd_smb2_getinfo_state);
+	struct files_struct *fsp = state->fsp;
+	connection_struct *conn = fsp->conn;
+	bool delete_pending = false;
+	struct timespec write_time_ts;
+	struct file_id fileid;
+	NTSTATUS status;
+	int ret, err;
+	bool ok;
+
+	decrement_outstanding_aio_calls();
+
+	ret = SMB_VFS_FSTAT_RECV(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		DEBUG(3, ("smbd_smb2_getinfo_fstat_done: "
+			  "fstat of %s failed (%s)\n",
+			  fsp_fnum_dbg(fsp), strerror(err)));
+		tevent_req_nterror(req, map_nt_error_from_unix(err));
+		return;
+	}
+	fsp->fsp_name->st = state->sbuf;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user(state->smb2req->tcon->compat,
+			    state->smb2req->session->compat->vuid);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return;
+	}
+
+	ok = set_current_service(state->smb2req->tcon->compat, 0, true);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return;
+	}
+
+	ZERO_STRUCT(write_time_ts);
+	fileid = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	get_file_infos(fileid, fsp->name_hash,
+		       &delete_pending, &write_time_ts);
+
+	status = smbd_smb2_getinfo_file(state, conn, fsp,
+					delete_pending,
+					write_time_ts);
+	if (!(NT_STATUS_IS_OK(status) ||
+	      NT_STATUS_EQUAL(status, STATUS_BUFFER_OVERFLOW))) {
+		tevent_req_nterror(req, status);
+		return;
+	}
+	state->status = status;
+	tevent_req_done(req);
+}
+
 static NTSTATUS smbd_smb2_getinfo_recv(struct tevent_req *req,
 				       TALLOC_CTX *mem_ctx,
 				       DATA_BLOB *out_output_buffer,
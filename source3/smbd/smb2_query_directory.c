@@ -194,9 +194,45 @@ static void smbd_smb2_request_find_done(struct tevent_req *subreq)
 
 struct smbd_smb2_query_directory_state {
 	struct smbd_smb2_request *smb2req;
+	struct smb_request *smbreq;
+	files_struct *fsp;
+	const char *in_file_name;
+	uint32_t in_output_buffer_length;
+	uint32_t info_level;
+	uint32_t max_count;
+	uint32_t dirtype;
+	bool dont_descend;
+	bool ask_sharemode;
+	NTSTATUS empty_status;
 	DATA_BLOB out_output_buffer;
 };
 
+static void smbd_smb2_query_directory_prefetched(struct tevent_req *subreq);
+static void smbd_smb2_query_directory_fill(struct tevent_req *req);
+
+/*
+ * The smallest possible size of an entry of an info level, used to
+ * guess how many entries fit into the output buffer.
+ */
+static size_t smbd_smb2_query_directory_entry_size(uint32_t info_level)
+{
+	switch (info_level) {
+	case SMB_FIND_FILE_DIRECTORY_INFO:
+		return 64;
+	case SMB_FIND_FILE_FULL_DIRECTORY_INFO:
+		return 68;
+	case SMB_FIND_FILE_BOTH_DIRECTORY_INFO:
+		return 94;
+	case SMB_FIND_FILE_NAMES_INFO:
+		return 12;
+	case SMB_FIND_ID_BOTH_DIRECTORY_INFO:
+		return 104;
+	case SMB_FIND_ID_FULL_DIRECTORY_INFO:
+		return 80;
+	}
+	return 64;
+}
+
 static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 					      struct tevent_context *ev,
 					      struct smbd_smb2_request *smb2req,
@@ -216,12 +252,6 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	NTSTATUS empty_status;
 	uint32_t info_level;
 	uint32_t max_count;
-	char *pdata;
-	char *base_data;
-	char *end_data;
-	int last_entry_off = 0;
-	int off = 0;
-	uint32_t num = 0;
 	uint32_t dirtype = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_DIRECTORY;
 	bool dont_descend = false;
 	bool ask_sharemode = true;
@@ -413,16 +443,6 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	}
 
 	state->out_output_buffer.length = 0;
-	pdata = (char *)state->out_output_buffer.data;
-	base_data = pdata;
-	/*
-	 * end_data must include the safety margin as it's what is
-	 * used to determine if pushed strings have been truncated.
-	 */
-	end_data = pdata + in_output_buffer_length + DIR_ENTRY_SAFETY_MARGIN - 1;
-	last_entry_off = 0;
-	off = 0;
-	num = 0;
 
 	DEBUG(8,("smbd_smb2_query_directory_send: dirpath=<%s> dontdescend=<%s>, "
 		"in_output_buffer_length = %u\n",
@@ -437,22 +457,129 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 				     "smbd", "search ask sharemode",
 				     true);
 
+	state->smbreq = smbreq;
+	state->fsp = fsp;
+	state->in_file_name = in_file_name;
+	state->in_output_buffer_length = in_output_buffer_length;
+	state->info_level = info_level;
+	state->max_count = max_count;
+	state->dirtype = dirtype;
+	state->dont_descend = dont_descend;
+	state->ask_sharemode = ask_sharemode;
+	state->empty_status = empty_status;
+
+	if ((max_count > 1) && !dont_descend &&
+	    lp_parm_bool(SNUM(conn), "smbd", "async query directory",
+			 false)) {
+		struct tevent_req *subreq;
+
+		/*
+		 * Get stat and DOS attributes of the entries that
+		 * will go into this response in parallel from the aio
+		 * thread pool. The response itself is built in
+		 * directory order once they are all there.
+		 */
+		subreq = dptr_prefetch_send(
+			state, ev, fsp->dptr, max_count,
+			in_output_buffer_length,
+			smbd_smb2_query_directory_entry_size(info_level));
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_set_callback(subreq,
+					smbd_smb2_query_directory_prefetched,
+					req);
+
+		/* Ensure any close request knows about this outstanding IO. */
+		if (!aio_add_req_to_fsp(fsp, req)) {
+			tevent_req_nterror(req, NT_STATUS_NO_MEMORY);
+			return tevent_req_post(req, ev);
+		}
+		return req;
+	}
+
+	smbd_smb2_query_directory_fill(req);
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+	return req;
+}
+
+static void smbd_smb2_query_directory_prefetched(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	struct smbd_smb2_request *smb2req = state->smb2req;
+	bool ok;
+
+	if (state->fsp->dptr == NULL) {
+		TALLOC_FREE(subreq);
+		tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
+		return;
+	}
+	dptr_prefetch_recv(subreq, state->fsp->dptr);
+	TALLOC_FREE(subreq);
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user(smb2req->tcon->compat,
+			    smb2req->session->compat->vuid);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return;
+	}
+
+	ok = set_current_service(smb2req->tcon->compat, 0, true);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return;
+	}
+
+	smbd_smb2_query_directory_fill(req);
+}
+
+static void smbd_smb2_query_directory_fill(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	files_struct *fsp = state->fsp;
+	connection_struct *conn = fsp->conn;
+	char *pdata;
+	char *base_data;
+	char *end_data;
+	int last_entry_off = 0;
+	int off = 0;
+	uint32_t num = 0;
+	NTSTATUS status;
+
+	pdata = (char *)state->out_output_buffer.data;
+	base_data = pdata;
+	/*
+	 * end_data must include the safety margin as it's what is
+	 * used to determine if pushed strings have been truncated.
+	 */
+	end_data = pdata + state->in_output_buffer_length +
+		DIR_ENTRY_SAFETY_MARGIN - 1;
+
 	while (true) {
 		bool got_exact_match = false;
-		int space_remaining = in_output_buffer_length - off;
+		int space_remaining = state->in_output_buffer_length - off;
 
 		SMB_ASSERT(space_remaining >= 0);
 
 		status = smbd_dirptr_lanman2_entry(state,
 					       conn,
 					       fsp->dptr,
-					       smbreq->flags2,
-					       in_file_name,
-					       dirtype,
-					       info_level,
+					       state->smbreq->flags2,
+					       state->in_file_name,
+					       state->dirtype,
+					       state->info_level,
 					       false, /* requires_resume_key */
-					       dont_descend,
-					       ask_sharemode,
+					       state->dont_descend,
+					       state->ask_sharemode,
 					       8, /* align to 8 bytes */
 					       false, /* no padding */
 					       &pdata,
@@ -472,33 +599,31 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 				 * entry.
 				 */
 				continue;
-			} else if (num > 0) {
+			}
+			dptr_prefetch_discard(fsp->dptr);
+			if (num > 0) {
 				SIVAL(state->out_output_buffer.data, last_entry_off, 0);
 				tevent_req_done(req);
-				return tevent_req_post(req, ev);
 			} else if (NT_STATUS_EQUAL(status, STATUS_MORE_ENTRIES)) {
 				tevent_req_nterror(req, NT_STATUS_INFO_LENGTH_MISMATCH);
-				return tevent_req_post(req, ev);
 			} else {
-				tevent_req_nterror(req, empty_status);
-				return tevent_req_post(req, ev);
+				tevent_req_nterror(req, state->empty_status);
 			}
+			return;
 		}
 
 		num++;
 		state->out_output_buffer.length = off;
 
-		if (num < max_count) {
+		if (num < state->max_count) {
 			continue;
 		}
 
+		dptr_prefetch_discard(fsp->dptr);
 		SIVAL(state->out_output_buffer.data, last_entry_off, 0);
 		tevent_req_done(req);
-		return tevent_req_post(req, ev);
+		return;
 	}
-
-	tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
-	return tevent_req_post(req, ev);
 }
 
 static NTSTATUS smbd_smb2_query_directory_recv(struct tevent_req *req,
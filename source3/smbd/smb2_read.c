@@ -169,6 +169,182 @@ static void smbd_smb2_request_read_done(struct tevent_req *subreq)
 	}
 }
 
+/*
+ * Reads that can not use sendfile, in particular all signed reads,
+ * go through a buffer. For large reads we hand out page aligned
+ * buffers that are cached per connection, so that a stream of reads
+ * does not allocate and fault in fresh memory for every request.
+ * "smbd:read buffer cache" is the number of idle buffers kept per
+ * connection, 0 disables the cache.
+ */
+
+#define SMBD_SMB2_READ_BUF_MIN_SIZE 65536
+
+struct smbd_smb2_read_buf {
+	struct smbd_smb2_read_buf *prev, *next;
+	struct smbd_smb2_read_buf_cache *cache;
+	void *buf;
+};
+
+struct smbd_smb2_read_buf_cache {
+	/* buffers currently handed out */
+	struct smbd_smb2_read_buf *busy;
+	size_t buf_size;
+	size_t num_free;
+	size_t max_free;
+	void **free_bufs;
+};
+
+static int smbd_smb2_read_buf_cache_destructor(
+	struct smbd_smb2_read_buf_cache *cache)
+{
+	struct smbd_smb2_read_buf *b;
+	size_t i;
+
+	/*
+	 * Outstanding buffers free their memory themselves
+	 */
+	while ((b = cache->busy) != NULL) {
+		DLIST_REMOVE(cache->busy, b);
+		b->cache = NULL;
+	}
+
+	for (i=0; i<cache->num_free; i++) {
+		free(cache->free_bufs[i]);
+	}
+	cache->num_free = 0;
+
+	return 0;
+}
+
+static struct smbd_smb2_read_buf_cache *smbd_smb2_read_buf_cache(
+	struct smbXsrv_connection *xconn)
+{
+	struct smbd_smb2_read_buf_cache *cache;
+	int max_free;
+
+	if (xconn->smb2.read_buf_cache != NULL) {
+		return xconn->smb2.read_buf_cache;
+	}
+
+	max_free = lp_parm_int(-1, "smbd", "read buffer cache", 0);
+
+	cache = talloc_zero(xconn, struct smbd_smb2_read_buf_cache);
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->buf_size = xconn->smb2.server.max_read;
+	cache->max_free = MAX(max_free, 0);
+
+	if (cache->max_free > 0) {
+		cache->free_bufs = talloc_array(cache, void *,
+						cache->max_free);
+		if (cache->free_bufs == NULL) {
+			TALLOC_FREE(cache);
+			return NULL;
+		}
+	}
+	talloc_set_destructor(cache, smbd_smb2_read_buf_cache_destructor);
+
+	xconn->smb2.read_buf_cache = cache;
+	return cache;
+}
+
+static int smbd_smb2_read_buf_destructor(struct smbd_smb2_read_buf *b)
+{
+	struct smbd_smb2_read_buf_cache *cache = b->cache;
+
+	if (cache == NULL) {
+		free(b->buf);
+		return 0;
+	}
+
+	DLIST_REMOVE(cache->busy, b);
+
+	if (cache->num_free < cache->max_free) {
+		cache->free_bufs[cache->num_free++] = b->buf;
+		return 0;
+	}
+
+	free(b->buf);
+	return 0;
+}
+
+NTSTATUS smbd_smb2_read_buf_alloc(TALLOC_CTX *mem_ctx,
+				  struct smbXsrv_connection *xconn,
+				  size_t size, DATA_BLOB *blob)
+{
+	struct smbd_smb2_read_buf_cache *cache = NULL;
+	struct smbd_smb2_read_buf *b;
+	int ret;
+
+	if (size >= SMBD_SMB2_READ_BUF_MIN_SIZE) {
+		cache = smbd_smb2_read_buf_cache(xconn);
+	}
+
+	if ((cache == NULL) || (cache->max_free == 0) ||
+	    (size > cache->buf_size)) {
+		*blob = data_blob_talloc(mem_ctx, NULL, size);
+		if ((size > 0) && (blob->data == NULL)) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		return NT_STATUS_OK;
+	}
+
+	b = talloc_zero(mem_ctx, struct smbd_smb2_read_buf);
+	if (b == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (cache->num_free > 0) {
+		b->buf = cache->free_bufs[--cache->num_free];
+	} else {
+		ret = posix_memalign(&b->buf, getpagesize(), cache->buf_size);
+		if (ret != 0) {
+			TALLOC_FREE(b);
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
+	b->cache = cache;
+	DLIST_ADD(cache->busy, b);
+	talloc_set_destructor(b, smbd_smb2_read_buf_destructor);
+
+	*blob = data_blob_const(b->buf, size);
+	return NT_STATUS_OK;
+}
+
+/*
+ * The talloc parent of a buffer from smbd_smb2_read_buf_alloc()
+ */
+static void *smbd_smb2_read_buf_owner(struct smbXsrv_connection *xconn,
+				      uint8_t *data)
+{
+	struct smbd_smb2_read_buf_cache *cache = xconn->smb2.read_buf_cache;
+	struct smbd_smb2_read_buf *b;
+
+	if ((cache == NULL) || (data == NULL)) {
+		return data;
+	}
+
+	for (b = cache->busy; b != NULL; b = b->next) {
+		if (b->buf == data) {
+			return b;
+		}
+	}
+
+	return data;
+}
+
+void smbd_smb2_read_buf_free(struct smbXsrv_connection *xconn,
+			     DATA_BLOB *blob)
+{
+	void *owner = smbd_smb2_read_buf_owner(xconn, blob->data);
+
+	TALLOC_FREE(owner);
+	*blob = data_blob_null;
+}
+
 struct smbd_smb2_read_state {
 	struct smbd_smb2_request *smb2req;
 	struct smb_request *smbreq;
@@ -556,10 +732,12 @@ static struct tevent_req *smbd_smb2_read_send(TALLOC_CTX *mem_ctx,
 		}
 	}
 
-	/* Ok, read into memory. Allocate the out buffer. */
-	state->out_data = data_blob_talloc(state, NULL, in_length);
-	if (in_length > 0 && tevent_req_nomem(state->out_data.data, req)) {
+	/* Ok, read into memory. Allocate the buffer. */
+	status = smbd_smb2_read_buf_alloc(state, smb2req->xconn, in_length,
+					  &state->out_data);
+	if (!NT_STATUS_IS_OK(status)) {
 		SMB_VFS_STRICT_UNLOCK(conn, fsp, &lock);
+		tevent_req_nterror(req, status);
 		return tevent_req_post(req, ev);
 	}
 
@@ -640,7 +818,8 @@ static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 	}
 
 	*out_data = state->out_data;
-	talloc_steal(mem_ctx, out_data->data);
+	talloc_steal(mem_ctx, smbd_smb2_read_buf_owner(state->smb2req->xconn,
+						       out_data->data));
 	*out_remaining = state->out_remaining;
 
 	if (state->out_headers.length > 0) {
@@ -37,6 +37,7 @@ static void smbd_smb2_connection_handler(struct tevent_context *ev,
 					 uint16_t flags,
 					 void *private_data);
 static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn);
+static NTSTATUS smbd_smb2_schedule_flush(struct smbXsrv_connection *xconn);
 
 static const struct smbd_smb2_dispatch_table {
 	uint16_t opcode;
@@ -272,7 +273,8 @@ static int smbd_smb2_request_destructor(struct smbd_smb2_request *req)
 	return 0;
 }
 
-static struct smbd_smb2_request *smbd_smb2_request_allocate(TALLOC_CTX *mem_ctx)
+static struct smbd_smb2_request *smbd_smb2_request_allocate(
+	struct smbXsrv_connection *xconn)
 {
 	TALLOC_CTX *mem_pool;
 	struct smbd_smb2_request *req;
@@ -281,7 +283,10 @@ static struct smbd_smb2_request *smbd_smb2_request_allocate(TALLOC_CTX *mem_ctx)
 	/* Enable this to find subtle valgrind errors. */
 	mem_pool = talloc_init("smbd_smb2_request_allocate");
 #else
-	mem_pool = talloc_tos();
+	mem_pool = xconn->client->sconn->slab_pool;
+	if (mem_pool == NULL) {
+		mem_pool = talloc_tos();
+	}
 #endif
 	if (mem_pool == NULL) {
 		return NULL;
@@ -289,10 +294,9 @@ static struct smbd_smb2_request *smbd_smb2_request_allocate(TALLOC_CTX *mem_ctx)
 
 	req = talloc_zero(mem_pool, struct smbd_smb2_request);
 	if (req == NULL) {
-		talloc_free(mem_pool);
 		return NULL;
 	}
-	talloc_reparent(mem_pool, mem_ctx, req);
+	talloc_reparent(mem_pool, xconn, req);
 #if 0
 	TALLOC_FREE(mem_pool);
 #endif
@@ -2719,6 +2723,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	struct iovec *firsttf = SMBD_SMB2_IDX_TF_IOV(req,out,first_idx);
 	struct iovec *outhdr = SMBD_SMB2_OUT_HDR_IOV(req);
 	struct iovec *outdyn = SMBD_SMB2_OUT_DYN_IOV(req);
+	bool defer_flush = false;
 	NTSTATUS status;
 	bool ok;
 
@@ -2872,12 +2877,30 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 		struct smbXsrv_session *x = req->session;
 		DATA_BLOB signing_key = smbd_smb2_signing_key(x, xconn);
 
-		status = smb2_signing_sign_pdu(signing_key,
-					       xconn->protocol,
-					       outhdr,
-					       SMBD_SMB2_NUM_IOV_PER_REQ - 1);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
+		if (req->preauth == NULL && signing_key.length > 0) {
+			/*
+			 * The header will not change anymore,
+			 * defer the signing to
+			 * smbd_smb2_flush_send_queue(), which
+			 * signs all pending replies together.
+			 */
+			req->queue_entry.sign_key =
+				data_blob_dup_talloc(req, signing_key);
+			if (req->queue_entry.sign_key.data == NULL) {
+				return NT_STATUS_NO_MEMORY;
+			}
+			req->queue_entry.sign_vector = outhdr;
+			req->queue_entry.sign_count =
+				SMBD_SMB2_NUM_IOV_PER_REQ - 1;
+			defer_flush = true;
+		} else {
+			status = smb2_signing_sign_pdu(signing_key,
+						xconn->protocol,
+						outhdr,
+						SMBD_SMB2_NUM_IOV_PER_REQ - 1);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
 		}
 	}
 	if (req->first_key.length > 0) {
@@ -2931,6 +2954,10 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	DLIST_ADD_END(xconn->smb2.send_queue, &req->queue_entry);
 	xconn->smb2.send_queue_len++;
 
+	if (defer_flush) {
+		return smbd_smb2_schedule_flush(xconn);
+	}
+
 	status = smbd_smb2_flush_send_queue(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
 		return status;
@@ -3562,6 +3589,114 @@ static int socket_error_from_errno(int ret,
 	return sys_errno;
 }
 
+/*
+ * Sign all pdus in the send queue which still need a signature,
+ * see smbd_smb2_request_reply().
+ */
+static NTSTATUS smbd_smb2_sign_send_queue(struct smbXsrv_connection *xconn)
+{
+	struct smbd_smb2_send_queue *entries[16];
+	struct smb2_signing_pdu pdus[ARRAY_SIZE(entries)];
+	struct smbd_smb2_send_queue *e;
+	size_t num = 0;
+
+	e = xconn->smb2.send_queue;
+
+	while (num > 0 || e != NULL) {
+		NTSTATUS status;
+		size_t i;
+
+		if (e != NULL) {
+			struct smbd_smb2_send_queue *cur = e;
+
+			e = e->next;
+
+			if (cur->sign_key.length == 0) {
+				continue;
+			}
+
+			entries[num] = cur;
+			pdus[num] = (struct smb2_signing_pdu) {
+				.signing_key = cur->sign_key,
+				.vector = cur->sign_vector,
+				.count = cur->sign_count,
+			};
+			num += 1;
+
+			if (num < ARRAY_SIZE(entries) && e != NULL) {
+				continue;
+			}
+		}
+
+		status = smb2_signing_sign_pdus(xconn->protocol, pdus, num);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+
+		for (i = 0; i < num; i++) {
+			data_blob_clear_free(&entries[i]->sign_key);
+			entries[i]->sign_vector = NULL;
+			entries[i]->sign_count = 0;
+		}
+		num = 0;
+	}
+
+	return NT_STATUS_OK;
+}
+
+static void smbd_smb2_flush_immediate(struct tevent_context *ev,
+				      struct tevent_immediate *im,
+				      void *private_data)
+{
+	struct smbXsrv_connection *xconn =
+		talloc_get_type_abort(private_data,
+		struct smbXsrv_connection);
+	NTSTATUS status;
+
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		/*
+		 * we're not supposed to do any io
+		 */
+		return;
+	}
+
+	status = smbd_smb2_flush_send_queue(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+
+	/*
+	 * smbd_smb2_request_next_incoming() may have
+	 * stopped reading because of the queue length.
+	 */
+	status = smbd_smb2_request_next_incoming(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+}
+
+/*
+ * Flush the send queue once all replies of the current
+ * event loop iteration are queued.
+ */
+static NTSTATUS smbd_smb2_schedule_flush(struct smbXsrv_connection *xconn)
+{
+	if (xconn->smb2.send_immediate == NULL) {
+		xconn->smb2.send_immediate = tevent_create_immediate(xconn);
+		if (xconn->smb2.send_immediate == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
+	tevent_schedule_immediate(xconn->smb2.send_immediate,
+				  xconn->ev_ctx,
+				  smbd_smb2_flush_immediate,
+				  xconn);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn)
 {
 	int ret;
@@ -3573,6 +3708,15 @@ static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn)
 		return NT_STATUS_OK;
 	}
 
+	if (xconn->smb2.send_immediate != NULL) {
+		NTSTATUS status;
+
+		status = smbd_smb2_sign_send_queue(xconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+
 	while (xconn->smb2.send_queue != NULL) {
 		struct smbd_smb2_send_queue *e = xconn->smb2.send_queue;
 		bool ok;
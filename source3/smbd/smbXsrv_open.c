@@ -51,11 +51,21 @@ NTSTATUS smbXsrv_open_global_init(void)
 {
 	char *global_path = NULL;
 	struct db_context *db_ctx = NULL;
+	int tdb_flags;
 
 	if (smbXsrv_open_global_db_ctx != NULL) {
 		return NT_STATUS_OK;
 	}
 
+	tdb_flags = TDB_DEFAULT | TDB_CLEAR_IF_FIRST | TDB_INCOMPATIBLE_HASH;
+
+	if (!lp_clustering()) {
+		/*
+		 * ctdb only knows about the jenkins hash.
+		 */
+		tdb_flags |= TDB_XXHASH;
+	}
+
 	global_path = lock_path("smbXsrv_open_global.tdb");
 	if (global_path == NULL) {
 		return NT_STATUS_NO_MEMORY;
@@ -63,9 +73,7 @@ NTSTATUS smbXsrv_open_global_init(void)
 
 	db_ctx = db_open(NULL, global_path,
 			 0, /* hash_size */
-			 TDB_DEFAULT |
-			 TDB_CLEAR_IF_FIRST |
-			 TDB_INCOMPATIBLE_HASH,
+			 tdb_flags,
 			 O_RDWR | O_CREAT, 0600,
 			 DBWRAP_LOCK_ORDER_1,
 			 DBWRAP_FLAG_NONE);
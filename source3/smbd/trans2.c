@@ -1510,6 +1510,7 @@ static bool check_msdfs_link(connection_struct *conn,
 
 struct smbd_dirptr_lanman2_state {
 	connection_struct *conn;
+	struct dptr_struct *dirptr;
 	uint32_t info_level;
 	bool check_mangled_names;
 	bool has_wild;
@@ -1621,6 +1622,7 @@ static bool smbd_dirptr_lanman2_mode_fn(TALLOC_CTX *ctx,
 		(struct smbd_dirptr_lanman2_state *)private_data;
 	bool ms_dfs_link = false;
 	uint32_t mode = 0;
+	DATA_BLOB dos_attr_ea;
 
 	if (INFO_LEVEL_IS_UNIX(state->info_level)) {
 		if (SMB_VFS_LSTAT(state->conn, smb_fname) != 0) {
@@ -1649,6 +1651,10 @@ static bool smbd_dirptr_lanman2_mode_fn(TALLOC_CTX *ctx,
 
 	if (ms_dfs_link) {
 		mode = dos_mode_msdfs(state->conn, smb_fname);
+	} else if (dptr_prefetched_dos_attr(state->dirptr, smb_fname,
+					    &dos_attr_ea)) {
+		mode = dos_mode_prefetched(state->conn, smb_fname,
+					   &dos_attr_ea);
 	} else {
 		mode = dos_mode(state->conn, smb_fname);
 	}
@@ -2381,6 +2387,7 @@ NTSTATUS smbd_dirptr_lanman2_entry(TALLOC_CTX *ctx,
 
 	ZERO_STRUCT(state);
 	state.conn = conn;
+	state.dirptr = dirptr;
 	state.info_level = info_level;
 	state.check_mangled_names = lp_mangled_names(conn->params);
 	state.has_wild = dptr_has_wild(dirptr);
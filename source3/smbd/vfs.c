@@ -1843,6 +1843,181 @@ int smb_vfs_call_fstat(struct vfs_handle_struct *handle,
 	return handle->fns->fstat_fn(handle, fsp, sbuf);
 }
 
+struct smb_vfs_call_fstat_state {
+	int (*recv_fn)(struct tevent_req *req, int *err);
+	int retval;
+};
+
+static void smb_vfs_call_fstat_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_fstat_send(struct vfs_handle_struct *handle,
+					   TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct files_struct *fsp,
+					   SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_fstat_state *state;
+	struct vfs_handle_struct *h;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_fstat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * A module that overrides fstat but not fstat_send (streams,
+	 * fake timestamps, ...) must still see the call. Do it
+	 * synchronously through the normal path in that case.
+	 */
+	for (h = handle; h != NULL; h = h->next) {
+		if (h->fns->fstat_send_fn != NULL) {
+			break;
+		}
+		if (h->fns->fstat_fn != NULL) {
+			state->retval = smb_vfs_call_fstat(handle, fsp, sbuf);
+			if (state->retval == -1) {
+				tevent_req_error(req, errno);
+				return tevent_req_post(req, ev);
+			}
+			tevent_req_done(req);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	VFS_FIND(fstat_send);
+	state->recv_fn = handle->fns->fstat_recv_fn;
+
+	subreq = handle->fns->fstat_send_fn(handle, state, ev, fsp, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_fstat_done, req);
+	return req;
+}
+
+static void smb_vfs_call_fstat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_fstat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fstat_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+int SMB_VFS_FSTAT_RECV(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_fstat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fstat_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
+struct smb_vfs_call_stat_state {
+	int (*recv_fn)(struct tevent_req *req, int *err);
+	int retval;
+};
+
+static void smb_vfs_call_stat_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_stat_send(struct vfs_handle_struct *handle,
+					  TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  const struct smb_filename *smb_fname,
+					  SMB_STRUCT_STAT *sbuf)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_stat_state *state;
+	struct vfs_handle_struct *h;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_stat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * Same as for fstat_send: A module overriding stat but not
+	 * stat_send gets a synchronous stat.
+	 */
+	for (h = handle; h != NULL; h = h->next) {
+		if (h->fns->stat_send_fn != NULL) {
+			break;
+		}
+		if (h->fns->stat_fn != NULL) {
+			struct smb_filename *tmp;
+
+			tmp = cp_smb_filename(state, smb_fname);
+			if (tevent_req_nomem(tmp, req)) {
+				return tevent_req_post(req, ev);
+			}
+			state->retval = smb_vfs_call_stat(handle, tmp);
+			if (state->retval == -1) {
+				tevent_req_error(req, errno);
+				return tevent_req_post(req, ev);
+			}
+			*sbuf = tmp->st;
+			TALLOC_FREE(tmp);
+			tevent_req_done(req);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	VFS_FIND(stat_send);
+	state->recv_fn = handle->fns->stat_recv_fn;
+
+	subreq = handle->fns->stat_send_fn(handle, state, ev, smb_fname, sbuf);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_stat_done, req);
+	return req;
+}
+
+static void smb_vfs_call_stat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_stat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_stat_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+int SMB_VFS_STAT_RECV(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_stat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_stat_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
 int smb_vfs_call_lstat(struct vfs_handle_struct *handle,
 		       struct smb_filename *smb_filename)
 {
@@ -2375,6 +2550,93 @@ ssize_t smb_vfs_call_getxattr(struct vfs_handle_struct *handle,
 	return handle->fns->getxattr_fn(handle, path, name, value, size);
 }
 
+struct smb_vfs_call_getxattr_state {
+	ssize_t (*recv_fn)(struct tevent_req *req, int *err);
+	ssize_t retval;
+};
+
+static void smb_vfs_call_getxattr_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_getxattr_send(struct vfs_handle_struct *handle,
+					      TALLOC_CTX *mem_ctx,
+					      struct tevent_context *ev,
+					      const char *path,
+					      const char *name,
+					      void *value,
+					      size_t size)
+{
+	struct tevent_req *req, *subreq;
+	struct smb_vfs_call_getxattr_state *state;
+	struct vfs_handle_struct *h;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_getxattr_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * xattr_tdb, streams_xattr and friends override getxattr but
+	 * not getxattr_send, they get a synchronous call.
+	 */
+	for (h = handle; h != NULL; h = h->next) {
+		if (h->fns->getxattr_send_fn != NULL) {
+			break;
+		}
+		if (h->fns->getxattr_fn != NULL) {
+			state->retval = smb_vfs_call_getxattr(
+				handle, path, name, value, size);
+			if (state->retval == -1) {
+				tevent_req_error(req, errno);
+				return tevent_req_post(req, ev);
+			}
+			tevent_req_done(req);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	VFS_FIND(getxattr_send);
+	state->recv_fn = handle->fns->getxattr_recv_fn;
+
+	subreq = handle->fns->getxattr_send_fn(handle, state, ev, path, name,
+					       value, size);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_vfs_call_getxattr_done, req);
+	return req;
+}
+
+static void smb_vfs_call_getxattr_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_getxattr_state *state = tevent_req_data(
+		req, struct smb_vfs_call_getxattr_state);
+	int err;
+
+	state->retval = state->recv_fn(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (state->retval == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+ssize_t SMB_VFS_GETXATTR_RECV(struct tevent_req *req, int *perrno)
+{
+	struct smb_vfs_call_getxattr_state *state = tevent_req_data(
+		req, struct smb_vfs_call_getxattr_state);
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		*perrno = err;
+		return -1;
+	}
+	return state->retval;
+}
+
 ssize_t smb_vfs_call_fgetxattr(struct vfs_handle_struct *handle,
 			       struct files_struct *fsp, const char *name,
 			       void *value, size_t size)
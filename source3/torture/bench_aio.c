@@ -0,0 +1,487 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Compare the async I/O backends smbd can use
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "system/select.h"
+#include "lib/pthreadpool/pthreadpool.h"
+#include "lib/asys/asys.h"
+#ifdef HAVE_LINUX_IO_URING
+#include "lib/uring/uring.h"
+#endif
+#include "proto.h"
+
+extern int torture_numops;
+
+#define BENCH_AIO_FILE "bench_aio.dat"
+#define BENCH_AIO_FILESIZE (16*1024*1024)
+#define BENCH_AIO_IOSIZE 4096
+#define BENCH_AIO_DEPTH 32
+
+struct bench_aio_slot {
+	unsigned idx;
+	bool write;
+	int fd;
+	off_t offset;
+	ssize_t ret;
+	int err;
+	struct timespec start;
+	uint8_t buf[BENCH_AIO_IOSIZE];
+};
+
+struct bench_aio_done {
+	struct bench_aio_slot *slot;
+	ssize_t ret;
+	int err;
+};
+
+struct bench_aio_ops {
+	const char *name;
+	int (*init)(void **pctx);
+	int (*signalfd)(void *ctx);
+	int (*queue)(void *ctx, struct bench_aio_slot *slot);
+	int (*submit)(void *ctx);
+	int (*results)(void *ctx, struct bench_aio_done *done, unsigned num);
+	void (*destroy)(void *ctx);
+};
+
+/*
+ * The default smbd path, vfs_default hands everything to asys
+ */
+
+static int bench_asys_init(void **pctx)
+{
+	struct asys_context *ctx;
+	int ret;
+
+	ret = asys_context_init(&ctx, lp_aio_max_threads());
+	if (ret != 0) {
+		return ret;
+	}
+	*pctx = ctx;
+	return 0;
+}
+
+static int bench_asys_signalfd(void *ctx)
+{
+	return asys_signalfd((struct asys_context *)ctx);
+}
+
+static int bench_asys_queue(void *ctx, struct bench_aio_slot *slot)
+{
+	if (slot->write) {
+		return asys_pwrite((struct asys_context *)ctx, slot->fd,
+				   slot->buf, sizeof(slot->buf),
+				   slot->offset, slot);
+	}
+	return asys_pread((struct asys_context *)ctx, slot->fd, slot->buf,
+			  sizeof(slot->buf), slot->offset, slot);
+}
+
+static int bench_asys_results(void *ctx, struct bench_aio_done *done,
+			      unsigned num)
+{
+	struct asys_result results[num];
+	int i, ret;
+
+	ret = asys_results((struct asys_context *)ctx, results, num);
+	for (i=0; i<ret; i++) {
+		done[i].slot = results[i].private_data;
+		done[i].ret = results[i].ret;
+		done[i].err = results[i].err;
+	}
+	return ret;
+}
+
+static void bench_asys_destroy(void *ctx)
+{
+	asys_context_destroy((struct asys_context *)ctx);
+}
+
+/*
+ * One pthreadpool job per request, the way vfs_aio_pthread does it
+ */
+
+static void bench_pthreadpool_job(void *private_data)
+{
+	struct bench_aio_slot *slot = private_data;
+
+	if (slot->write) {
+		slot->ret = pwrite(slot->fd, slot->buf, sizeof(slot->buf),
+				   slot->offset);
+	} else {
+		slot->ret = pread(slot->fd, slot->buf, sizeof(slot->buf),
+				  slot->offset);
+	}
+	slot->err = (slot->ret == -1) ? errno : 0;
+}
+
+struct bench_pthreadpool {
+	struct pthreadpool *pool;
+	struct bench_aio_slot *slots[BENCH_AIO_DEPTH];
+};
+
+static int bench_pthreadpool_init(void **pctx)
+{
+	struct bench_pthreadpool *ctx;
+	int ret;
+
+	ctx = talloc_zero(NULL, struct bench_pthreadpool);
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	ret = pthreadpool_init(lp_aio_max_threads(), &ctx->pool);
+	if (ret != 0) {
+		TALLOC_FREE(ctx);
+		return ret;
+	}
+	*pctx = ctx;
+	return 0;
+}
+
+static int bench_pthreadpool_signalfd(void *ctx)
+{
+	struct bench_pthreadpool *p = ctx;
+	return pthreadpool_signal_fd(p->pool);
+}
+
+static int bench_pthreadpool_queue(void *ctx, struct bench_aio_slot *slot)
+{
+	struct bench_pthreadpool *p = ctx;
+
+	p->slots[slot->idx] = slot;
+	return pthreadpool_add_job(p->pool, slot->idx, bench_pthreadpool_job,
+				   slot);
+}
+
+static int bench_pthreadpool_results(void *ctx, struct bench_aio_done *done,
+				     unsigned num)
+{
+	struct bench_pthreadpool *p = ctx;
+	int jobids[num];
+	int i, ret;
+
+	ret = pthreadpool_finished_jobs(p->pool, jobids, num);
+	for (i=0; i<ret; i++) {
+		struct bench_aio_slot *slot = p->slots[jobids[i]];
+
+		done[i].slot = slot;
+		done[i].ret = slot->ret;
+		done[i].err = slot->err;
+	}
+	return ret;
+}
+
+static void bench_pthreadpool_destroy(void *ctx)
+{
+	struct bench_pthreadpool *p = ctx;
+
+	pthreadpool_destroy(p->pool);
+	TALLOC_FREE(p);
+}
+
+#ifdef HAVE_LINUX_IO_URING
+
+/*
+ * vfs_io_uring
+ */
+
+static int bench_uring_init(void **pctx)
+{
+	struct uring_context *ctx;
+	int ret;
+
+	ret = uring_context_init(&ctx, BENCH_AIO_DEPTH);
+	if (ret != 0) {
+		return ret;
+	}
+	*pctx = ctx;
+	return 0;
+}
+
+static int bench_uring_signalfd(void *ctx)
+{
+	return uring_signalfd((struct uring_context *)ctx);
+}
+
+static int bench_uring_queue(void *ctx, struct bench_aio_slot *slot)
+{
+	if (slot->write) {
+		return uring_pwrite((struct uring_context *)ctx, slot->fd,
+				    slot->buf, sizeof(slot->buf),
+				    slot->offset, slot);
+	}
+	return uring_pread((struct uring_context *)ctx, slot->fd, slot->buf,
+			   sizeof(slot->buf), slot->offset, slot);
+}
+
+static int bench_uring_submit(void *ctx)
+{
+	return uring_submit((struct uring_context *)ctx);
+}
+
+static int bench_uring_results(void *ctx, struct bench_aio_done *done,
+			       unsigned num)
+{
+	struct uring_result results[num];
+	int i, ret;
+
+	ret = uring_results((struct uring_context *)ctx, results, num);
+	for (i=0; i<ret; i++) {
+		done[i].slot = results[i].private_data;
+		done[i].ret = results[i].ret;
+		done[i].err = results[i].err;
+	}
+	return ret;
+}
+
+static void bench_uring_destroy(void *ctx)
+{
+	uring_context_destroy((struct uring_context *)ctx);
+}
+
+#endif
+
+static const struct bench_aio_ops bench_aio_backends[] = {
+	{
+		.name = "asys",
+		.init = bench_asys_init,
+		.signalfd = bench_asys_signalfd,
+		.queue = bench_asys_queue,
+		.results = bench_asys_results,
+		.destroy = bench_asys_destroy,
+	},
+	{
+		.name = "pthreadpool",
+		.init = bench_pthreadpool_init,
+		.signalfd = bench_pthreadpool_signalfd,
+		.queue = bench_pthreadpool_queue,
+		.results = bench_pthreadpool_results,
+		.destroy = bench_pthreadpool_destroy,
+	},
+#ifdef HAVE_LINUX_IO_URING
+	{
+		.name = "io_uring",
+		.init = bench_uring_init,
+		.signalfd = bench_uring_signalfd,
+		.queue = bench_uring_queue,
+		.submit = bench_uring_submit,
+		.results = bench_uring_results,
+		.destroy = bench_uring_destroy,
+	},
+#endif
+};
+
+static off_t bench_aio_offset(void)
+{
+	return (random() % (BENCH_AIO_FILESIZE / BENCH_AIO_IOSIZE))
+		* BENCH_AIO_IOSIZE;
+}
+
+/*
+ * Keep BENCH_AIO_DEPTH random 4k requests in flight until num_ops
+ * have finished. Every completion batch is followed by one submit,
+ * just like smbd does it from the event loop.
+ */
+static bool bench_aio_run(const struct bench_aio_ops *ops, int fd,
+			  bool write, unsigned num_ops)
+{
+	struct bench_aio_slot *slots;
+	struct bench_aio_done done[BENCH_AIO_DEPTH];
+	struct timespec start, end;
+	unsigned i, issued, finished;
+	uint64_t latency_sum = 0, latency_max = 0;
+	double secs;
+	void *ctx;
+	int ret;
+
+	ret = ops->init(&ctx);
+	if (ret != 0) {
+		d_printf("%s: init failed: %s, skipping\n", ops->name,
+			 strerror(ret));
+		return true;
+	}
+
+	slots = talloc_zero_array(talloc_tos(), struct bench_aio_slot,
+				  BENCH_AIO_DEPTH);
+	if (slots == NULL) {
+		d_fprintf(stderr, "talloc failed\n");
+		ops->destroy(ctx);
+		return false;
+	}
+
+	srandom(1);
+	clock_gettime_mono(&start);
+
+	issued = 0;
+	finished = 0;
+
+	for (i=0; (i<BENCH_AIO_DEPTH) && (issued<num_ops); i++) {
+		struct bench_aio_slot *slot = &slots[i];
+
+		slot->idx = i;
+		slot->write = write;
+		slot->fd = fd;
+		slot->offset = bench_aio_offset();
+		clock_gettime_mono(&slot->start);
+
+		ret = ops->queue(ctx, slot);
+		if (ret != 0) {
+			d_fprintf(stderr, "%s: queue failed: %s\n", ops->name,
+				  strerror(ret));
+			goto fail;
+		}
+		issued += 1;
+	}
+
+	while (finished < num_ops) {
+		struct pollfd pfd;
+		int num_done;
+
+		if (ops->submit != NULL) {
+			ret = ops->submit(ctx);
+			if (ret != 0) {
+				d_fprintf(stderr, "%s: submit failed: %s\n",
+					  ops->name, strerror(ret));
+				goto fail;
+			}
+		}
+
+		pfd = (struct pollfd) {
+			.fd = ops->signalfd(ctx), .events = POLLIN
+		};
+		ret = poll(&pfd, 1, -1);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			d_fprintf(stderr, "poll failed: %s\n",
+				  strerror(errno));
+			goto fail;
+		}
+
+		num_done = ops->results(ctx, done, ARRAY_SIZE(done));
+		if (num_done < 0) {
+			d_fprintf(stderr, "%s: results failed: %s\n",
+				  ops->name, strerror(-num_done));
+			goto fail;
+		}
+
+		for (i=0; i<num_done; i++) {
+			struct bench_aio_slot *slot = done[i].slot;
+			struct timespec now;
+			uint64_t latency;
+
+			if (done[i].ret != BENCH_AIO_IOSIZE) {
+				d_fprintf(stderr, "%s: I/O returned %d: %s\n",
+					  ops->name, (int)done[i].ret,
+					  strerror(done[i].err));
+				goto fail;
+			}
+
+			clock_gettime_mono(&now);
+			latency = nsec_time_diff(&now, &slot->start);
+			latency_sum += latency;
+			latency_max = MAX(latency_max, latency);
+			finished += 1;
+
+			if (issued == num_ops) {
+				continue;
+			}
+
+			slot->offset = bench_aio_offset();
+			slot->start = now;
+			ret = ops->queue(ctx, slot);
+			if (ret != 0) {
+				d_fprintf(stderr, "%s: queue failed: %s\n",
+					  ops->name, strerror(ret));
+				goto fail;
+			}
+			issued += 1;
+		}
+	}
+
+	clock_gettime_mono(&end);
+	secs = nsec_time_diff(&end, &start) * 1.0e-9;
+
+	d_printf("%-11s %-6s %8.0f ops/s %8.1f MB/s  avg %7.1f us  "
+		 "max %8.1f us\n", ops->name, write ? "pwrite" : "pread",
+		 num_ops / secs,
+		 num_ops * (double)BENCH_AIO_IOSIZE / secs / (1024*1024),
+		 latency_sum / 1000.0 / num_ops, latency_max / 1000.0);
+
+	ops->destroy(ctx);
+	TALLOC_FREE(slots);
+	return true;
+
+fail:
+	/*
+	 * Requests might still be in flight, leak the context and the
+	 * buffers instead of pulling them away under the kernel.
+	 */
+	return false;
+}
+
+bool run_bench_aio(int dummy)
+{
+	uint8_t buf[BENCH_AIO_IOSIZE];
+	unsigned num_ops = torture_numops * 100;
+	size_t i;
+	bool ok = false;
+	int fd;
+
+	fd = open(BENCH_AIO_FILE, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (fd == -1) {
+		d_fprintf(stderr, "open failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	memset(buf, 'x', sizeof(buf));
+
+	for (i=0; i<BENCH_AIO_FILESIZE/BENCH_AIO_IOSIZE; i++) {
+		ssize_t nwritten;
+
+		nwritten = pwrite(fd, buf, sizeof(buf), i * sizeof(buf));
+		if (nwritten != sizeof(buf)) {
+			d_fprintf(stderr, "pwrite failed: %s\n",
+				  strerror(errno));
+			goto done;
+		}
+	}
+
+	d_printf("%u random %d byte requests, %d in flight, on a %d MB "
+		 "cached file\n", num_ops, BENCH_AIO_IOSIZE,
+		 BENCH_AIO_DEPTH, BENCH_AIO_FILESIZE / (1024*1024));
+
+	for (i=0; i<ARRAY_SIZE(bench_aio_backends); i++) {
+		const struct bench_aio_ops *ops = &bench_aio_backends[i];
+
+		if (!bench_aio_run(ops, fd, false, num_ops)) {
+			goto done;
+		}
+		if (!bench_aio_run(ops, fd, true, num_ops)) {
+			goto done;
+		}
+	}
+
+	ok = true;
+done:
+	close(fd);
+	unlink(BENCH_AIO_FILE);
+	return ok;
+}
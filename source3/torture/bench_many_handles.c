@@ -0,0 +1,292 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Measure oplock break latency in an smbd holding many open handles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+#include "lib/util/tevent_ntstatus.h"
+
+extern int torture_numops;
+
+/*
+ * The first connection opens torture_numops files with batch oplocks,
+ * like an indexer or virus scanner keeping handles on a whole tree. The
+ * second connection then opens some of them, spread over the whole
+ * range, and waits for the break. The smbd of the first connection has
+ * to find the oplocked handle for the break message and the ack.
+ *
+ * The breaks are timed once with just BENCH_HANDLES_BREAKS files open,
+ * and again with all torture_numops. Without indexed lookups the second
+ * round gets slower with every handle. smbd needs an fd per handle, run
+ * it with a high enough "ulimit -n".
+ */
+
+#define BENCH_HANDLES_DIR "bench_handles"
+#define BENCH_HANDLES_BREAKS 200
+
+struct bench_handles_state {
+	struct tevent_context *ev;
+	struct cli_state *cli1;
+	bool got_break;
+	bool got_open;
+	uint16_t fnum2;
+	NTSTATUS status;
+};
+
+static void bench_handles_got_break(struct tevent_req *subreq)
+{
+	struct bench_handles_state *state = tevent_req_callback_data(
+		subreq, struct bench_handles_state);
+	uint16_t fnum;
+	uint8_t level;
+	NTSTATUS status;
+
+	status = cli_smb_oplock_break_waiter_recv(subreq, &fnum, &level);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		state->status = status;
+		return;
+	}
+	state->got_break = true;
+
+	subreq = cli_oplock_ack_send(state, state->ev, state->cli1, fnum,
+				     NO_OPLOCK);
+	if (subreq == NULL) {
+		state->status = NT_STATUS_NO_MEMORY;
+	}
+}
+
+static void bench_handles_got_open(struct tevent_req *subreq)
+{
+	struct bench_handles_state *state = tevent_req_callback_data(
+		subreq, struct bench_handles_state);
+
+	state->status = cli_openx_recv(subreq, &state->fnum2);
+	TALLOC_FREE(subreq);
+	state->got_open = true;
+}
+
+/*
+ * Break the oplock cli1 holds on fname, returns the seconds the open
+ * from cli2 took or -1 on failure.
+ */
+static double bench_handles_break(struct tevent_context *ev,
+				  struct cli_state *cli1,
+				  struct cli_state *cli2,
+				  const char *fname)
+{
+	struct bench_handles_state *state;
+	struct tevent_req *subreq;
+	struct timeval start;
+	double secs = -1;
+
+	state = talloc_zero(ev, struct bench_handles_state);
+	if (state == NULL) {
+		return -1;
+	}
+	state->ev = ev;
+	state->cli1 = cli1;
+	state->status = NT_STATUS_OK;
+
+	subreq = cli_smb_oplock_break_waiter_send(state, ev, cli1);
+	if (subreq == NULL) {
+		goto done;
+	}
+	tevent_req_set_callback(subreq, bench_handles_got_break, state);
+
+	start = timeval_current();
+
+	subreq = cli_openx_send(state, ev, cli2, fname, O_RDWR, DENY_NONE);
+	if (subreq == NULL) {
+		goto done;
+	}
+	tevent_req_set_callback(subreq, bench_handles_got_open, state);
+
+	/* The ack has to go out before we continue */
+	while ((!state->got_open || !state->got_break) &&
+	       NT_STATUS_IS_OK(state->status)) {
+		if (tevent_loop_once(ev) == -1) {
+			printf("tevent_loop_once failed: %s\n",
+			       strerror(errno));
+			goto done;
+		}
+		if (state->got_open && (secs < 0)) {
+			secs = timeval_elapsed(&start);
+		}
+	}
+
+	if (!NT_STATUS_IS_OK(state->status)) {
+		printf("oplock break of %s failed: %s\n", fname,
+		       nt_errstr(state->status));
+		secs = -1;
+		goto done;
+	}
+
+	cli_close(cli2, state->fnum2);
+done:
+	TALLOC_FREE(state);
+	return secs;
+}
+
+static void bench_handles_fname(fstring fname, int i)
+{
+	fstr_sprintf(fname, BENCH_HANDLES_DIR "\\file_%06d.dat", i);
+}
+
+/*
+ * Open files [from, to) on cli1 with a batch oplock
+ */
+static bool bench_handles_open(struct cli_state *cli1, uint16_t *fnums,
+			       int from, int to)
+{
+	struct timeval start = timeval_current();
+	NTSTATUS status;
+	int i;
+
+	for (i=from; i<to; i++) {
+		fstring fname;
+
+		bench_handles_fname(fname, i);
+
+		status = cli_openx(cli1, fname, O_RDWR|O_CREAT, DENY_NONE,
+				   &fnums[i]);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("open of %s failed (%s)\n", fname,
+			       nt_errstr(status));
+			return false;
+		}
+	}
+
+	printf("opened %d handles in %.3f secs\n", to - from,
+	       timeval_elapsed(&start));
+	return true;
+}
+
+/*
+ * Break BENCH_HANDLES_BREAKS oplocks on files spread over [from, to)
+ */
+static bool bench_handles_breaks(struct cli_state *cli1,
+				 struct cli_state *cli2, int from, int to)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_context *ev;
+	double secs, total = 0, max = 0;
+	int i;
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		TALLOC_FREE(frame);
+		return false;
+	}
+
+	for (i=0; i<BENCH_HANDLES_BREAKS; i++) {
+		fstring fname;
+
+		bench_handles_fname(
+			fname, from + i * (to - from) / BENCH_HANDLES_BREAKS);
+
+		secs = bench_handles_break(ev, cli1, cli2, fname);
+		if (secs < 0) {
+			TALLOC_FREE(frame);
+			return false;
+		}
+		total += secs;
+		max = MAX(max, secs);
+	}
+
+	printf("%d handles open: %d breaks, %.3f ms avg, %.3f ms max\n",
+	       to, BENCH_HANDLES_BREAKS,
+	       total * 1000 / BENCH_HANDLES_BREAKS, max * 1000);
+
+	TALLOC_FREE(frame);
+	return true;
+}
+
+bool run_bench_many_handles(int dummy)
+{
+	struct cli_state *cli1 = NULL, *cli2 = NULL;
+	uint16_t *fnums = NULL;
+	NTSTATUS status;
+	bool ret = false;
+	int num_open = 0;
+	int i;
+
+	printf("Starting BENCH-MANY-HANDLES with %d handles\n",
+	       torture_numops);
+
+	if (torture_numops < 2 * BENCH_HANDLES_BREAKS) {
+		printf("Need at least %d handles\n",
+		       2 * BENCH_HANDLES_BREAKS);
+		return false;
+	}
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		goto fail;
+	}
+
+	status = cli_mkdir(cli1, BENCH_HANDLES_DIR);
+	if (!NT_STATUS_IS_OK(status) &&
+	    !NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_COLLISION)) {
+		printf("mkdir of %s failed (%s)\n", BENCH_HANDLES_DIR,
+		       nt_errstr(status));
+		goto fail;
+	}
+
+	fnums = talloc_array(talloc_tos(), uint16_t, torture_numops);
+	if (fnums == NULL) {
+		goto fail;
+	}
+
+	cli1->use_oplocks = true;
+
+	if (!bench_handles_open(cli1, fnums, 0, BENCH_HANDLES_BREAKS)) {
+		goto fail;
+	}
+	num_open = BENCH_HANDLES_BREAKS;
+
+	if (!bench_handles_breaks(cli1, cli2, 0, num_open)) {
+		goto fail;
+	}
+
+	if (!bench_handles_open(cli1, fnums, num_open, torture_numops)) {
+		goto fail;
+	}
+	num_open = torture_numops;
+
+	if (!bench_handles_breaks(cli1, cli2, BENCH_HANDLES_BREAKS,
+				  num_open)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	for (i=0; i<num_open; i++) {
+		cli_close(cli1, fnums[i]);
+	}
+	TALLOC_FREE(fnums);
+	if (cli1 != NULL) {
+		torture_close_connection(cli1);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	return ret;
+}
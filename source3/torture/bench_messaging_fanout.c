@@ -0,0 +1,297 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Send one message to many processes, one by one and batched
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "messages.h"
+
+extern int torture_nprocs;
+extern int torture_numops;
+
+/*
+ * torture_nprocs children each wait for torture_numops messages and
+ * report back. The parent sends every round to all children, like
+ * notifyd does for a directory with many watchers, first with
+ * messaging_send_iov() per child, then with messaging_send_iov_multi().
+ */
+
+#define MSG_TORTURE_FANOUT 0xF105
+#define MSG_TORTURE_FANOUT_DONE 0xF106
+
+struct fanout_child_state {
+	unsigned count;
+	bool done;
+};
+
+static void fanout_child_msg(struct messaging_context *msg_ctx,
+			     void *private_data, uint32_t msg_type,
+			     struct server_id src, DATA_BLOB *data)
+{
+	struct fanout_child_state *state = private_data;
+
+	state->count += 1;
+	if (state->count < torture_numops) {
+		return;
+	}
+	state->count = 0;
+
+	messaging_send(msg_ctx, src, MSG_TORTURE_FANOUT_DONE,
+		       &data_blob_null);
+}
+
+static void fanout_child_exit(struct tevent_context *ev,
+			      struct tevent_fd *fde,
+			      uint16_t flags,
+			      void *private_data)
+{
+	struct fanout_child_state *state = private_data;
+	state->done = true;
+}
+
+static void fanout_child(int ready_pipe, int exit_pipe)
+{
+	struct fanout_child_state state = { .count = 0 };
+	struct tevent_context *ev;
+	struct messaging_context *msg_ctx;
+	struct tevent_fd *exit_handler;
+	char c = 0;
+
+	ev = samba_tevent_context_init(talloc_tos());
+	if (ev == NULL) {
+		fprintf(stderr, "child tevent_context_init failed\n");
+		exit(1);
+	}
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "child messaging_init failed\n");
+		exit(1);
+	}
+	messaging_register(msg_ctx, &state, MSG_TORTURE_FANOUT,
+			   fanout_child_msg);
+
+	exit_handler = tevent_add_fd(ev, ev, exit_pipe, TEVENT_FD_READ,
+				     fanout_child_exit, &state);
+	if (exit_handler == NULL) {
+		fprintf(stderr, "child tevent_add_fd failed\n");
+		exit(1);
+	}
+
+	if (write(ready_pipe, &c, 1) != 1) {
+		fprintf(stderr, "child write failed\n");
+		exit(1);
+	}
+
+	while (!state.done) {
+		if (tevent_loop_once(ev) != 0) {
+			fprintf(stderr, "child tevent_loop_once failed\n");
+			exit(1);
+		}
+	}
+
+	TALLOC_FREE(msg_ctx);
+	TALLOC_FREE(ev);
+}
+
+static void fanout_done_msg(struct messaging_context *msg_ctx,
+			    void *private_data, uint32_t msg_type,
+			    struct server_id src, DATA_BLOB *data)
+{
+	unsigned *num_done = private_data;
+	*num_done += 1;
+}
+
+static bool fanout_round(struct tevent_context *ev,
+			 struct messaging_context *msg_ctx,
+			 struct messaging_send_multi_dst *dsts,
+			 size_t num_dsts, bool multi, unsigned *num_done)
+{
+	uint8_t prefix[24] = { 0 };
+	uint8_t payload[64] = { 0 };
+	struct iovec iov[2];
+	struct timeval start, sending;
+	double send_time = 0;
+	size_t i;
+	int r;
+
+	iov[0] = (struct iovec) { .iov_base = prefix,
+				  .iov_len = sizeof(prefix) };
+	iov[1] = (struct iovec) { .iov_base = payload,
+				  .iov_len = sizeof(payload) };
+
+	for (i=0; i<num_dsts; i++) {
+		dsts[i].prefix = iov[0];
+	}
+
+	*num_done = 0;
+	start = timeval_current();
+
+	for (r=0; r<torture_numops; r++) {
+		sending = timeval_current();
+
+		if (multi) {
+			int ret;
+
+			ret = messaging_send_iov_multi(
+				msg_ctx, MSG_TORTURE_FANOUT, dsts, num_dsts,
+				&iov[1], 1);
+			if (ret != 0) {
+				fprintf(stderr, "messaging_send_iov_multi "
+					"failed: %s\n", strerror(ret));
+				return false;
+			}
+			for (i=0; i<num_dsts; i++) {
+				if (dsts[i].ret != 0) {
+					fprintf(stderr, "send to %u failed: "
+						"%s\n",
+						(unsigned)dsts[i].dst.pid,
+						strerror(dsts[i].ret));
+					return false;
+				}
+			}
+		} else {
+			for (i=0; i<num_dsts; i++) {
+				NTSTATUS status;
+
+				status = messaging_send_iov(
+					msg_ctx, dsts[i].dst,
+					MSG_TORTURE_FANOUT, iov,
+					ARRAY_SIZE(iov), NULL, 0);
+				if (!NT_STATUS_IS_OK(status)) {
+					fprintf(stderr, "messaging_send_iov "
+						"failed: %s\n",
+						nt_errstr(status));
+					return false;
+				}
+			}
+		}
+
+		send_time += timeval_elapsed(&sending);
+	}
+
+	while (*num_done < num_dsts) {
+		if (tevent_loop_once(ev) != 0) {
+			fprintf(stderr, "tevent_loop_once failed\n");
+			return false;
+		}
+	}
+
+	printf("%s: %u messages, %.3f s sending (%.0f msgs/s), "
+	       "all delivered after %.3f s\n",
+	       multi ? "messaging_send_iov_multi" : "messaging_send_iov",
+	       (unsigned)(num_dsts * torture_numops), send_time,
+	       num_dsts * torture_numops / send_time,
+	       timeval_elapsed(&start));
+
+	return true;
+}
+
+bool run_bench_messaging_fanout(int dummy)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	struct messaging_send_multi_dst *dsts;
+	struct server_id my_id;
+	unsigned num_done = 0;
+	pid_t *children;
+	int ready_pipe[2];
+	int exit_pipe[2];
+	bool ok = false;
+	int i;
+
+	children = talloc_zero_array(talloc_tos(), pid_t, torture_nprocs);
+	dsts = talloc_zero_array(talloc_tos(),
+				 struct messaging_send_multi_dst,
+				 torture_nprocs);
+	if ((children == NULL) || (dsts == NULL)) {
+		fprintf(stderr, "talloc failed\n");
+		return false;
+	}
+
+	if ((pipe(ready_pipe) != 0) || (pipe(exit_pipe) != 0)) {
+		perror("pipe failed");
+		return false;
+	}
+
+	for (i=0; i<torture_nprocs; i++) {
+		children[i] = fork();
+		if (children[i] == -1) {
+			perror("fork failed");
+			goto done;
+		}
+		if (children[i] == 0) {
+			close(ready_pipe[0]);
+			close(exit_pipe[1]);
+			fanout_child(ready_pipe[1], exit_pipe[0]);
+			exit(0);
+		}
+	}
+	close(ready_pipe[1]);
+	close(exit_pipe[0]);
+
+	for (i=0; i<torture_nprocs; i++) {
+		char c;
+		if (read(ready_pipe[0], &c, 1) != 1) {
+			perror("read failed");
+			goto done;
+		}
+	}
+
+	ev = samba_tevent_context_init(talloc_tos());
+	if (ev == NULL) {
+		fprintf(stderr, "tevent_context_init failed\n");
+		goto done;
+	}
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "messaging_init failed\n");
+		goto done;
+	}
+	messaging_register(msg_ctx, &num_done, MSG_TORTURE_FANOUT_DONE,
+			   fanout_done_msg);
+
+	my_id = messaging_server_id(msg_ctx);
+
+	for (i=0; i<torture_nprocs; i++) {
+		dsts[i].dst = my_id;
+		dsts[i].dst.pid = children[i];
+	}
+
+	printf("%d receivers, %d rounds\n", torture_nprocs, torture_numops);
+
+	ok = fanout_round(ev, msg_ctx, dsts, torture_nprocs, false,
+			  &num_done);
+	if (ok) {
+		ok = fanout_round(ev, msg_ctx, dsts, torture_nprocs, true,
+				  &num_done);
+	}
+
+done:
+	close(exit_pipe[1]);
+
+	for (i=0; i<torture_nprocs; i++) {
+		if (children[i] > 0) {
+			waitpid(children[i], NULL, 0);
+		}
+	}
+
+	TALLOC_FREE(msg_ctx);
+	TALLOC_FREE(ev);
+	TALLOC_FREE(dsts);
+	TALLOC_FREE(children);
+	return ok;
+}
@@ -29,6 +29,82 @@ static void null_job(void *private_data)
 	return;
 }
 
+static void spin_job(void *private_data)
+{
+	volatile unsigned i;
+
+	for (i=0; i<1000; i++) {
+		;
+	}
+}
+
+/*
+ * Keep 4 jobs per thread in flight and see how many jobs per second
+ * we get through
+ */
+static bool bench_pthreadpool_scaling(unsigned num_threads, int num_jobs,
+				      void (*fn)(void *private_data))
+{
+	struct pthreadpool *pool;
+	struct timeval start;
+	int num_queued, num_done;
+	int in_flight = num_threads * 4;
+	int ret;
+
+	ret = pthreadpool_init(num_threads, &pool);
+	if (ret != 0) {
+		d_fprintf(stderr, "pthreadpool_init failed: %s\n",
+			  strerror(ret));
+		return false;
+	}
+
+	start = timeval_current();
+	num_queued = num_done = 0;
+
+	while (num_done < num_jobs) {
+		int jobids[64];
+
+		while ((num_queued < num_jobs) &&
+		       (num_queued - num_done < in_flight)) {
+			ret = pthreadpool_add_job(pool, num_queued, fn, NULL);
+			if (ret != 0) {
+				d_fprintf(stderr, "pthreadpool_add_job "
+					  "failed: %s\n", strerror(ret));
+				goto fail;
+			}
+			num_queued += 1;
+		}
+
+		ret = pthreadpool_finished_jobs(pool, jobids,
+						ARRAY_SIZE(jobids));
+		if (ret < 0) {
+			d_fprintf(stderr, "pthreadpool_finished_jobs "
+				  "failed: %s\n", strerror(-ret));
+			goto fail;
+		}
+		num_done += ret;
+	}
+
+	d_printf("%2u threads: %8.0f jobs/sec\n", num_threads,
+		 num_jobs / timeval_elapsed(&start));
+
+	pthreadpool_destroy(pool);
+	return true;
+
+fail:
+	while (num_done < num_queued) {
+		int jobids[64];
+		ret = pthreadpool_finished_jobs(pool, jobids,
+						ARRAY_SIZE(jobids));
+		if (ret < 0) {
+			break;
+		}
+		num_done += ret;
+	}
+	pthreadpool_destroy(pool);
+	return false;
+}
+
 bool run_bench_pthreadpool(int dummy)
 {
 	struct pthreadpool *pool;
@@ -60,5 +136,25 @@ bool run_bench_pthreadpool(int dummy)
 
 	pthreadpool_destroy(pool);
 
-	return (ret == 1);
+	if (ret != 1) {
+		return false;
+	}
+
+	d_printf("null jobs:\n");
+	for (i=1; i<=64; i*=2) {
+		if (!bench_pthreadpool_scaling(i, torture_numops * 100,
+					       null_job)) {
+			return false;
+		}
+	}
+
+	d_printf("spinning jobs:\n");
+	for (i=1; i<=64; i*=2) {
+		if (!bench_pthreadpool_scaling(i, torture_numops * 100,
+					       spin_job)) {
+			return false;
+		}
+	}
+
+	return true;
 }
@@ -0,0 +1,224 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Measure open/close latency on a file with many share mode entries
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+#include "../libcli/smb/smbXcli_base.h"
+
+extern fstring host, workgroup, share, password, username, myname;
+extern int torture_numops;
+
+/*
+ * The first connection opens one file torture_numops times, each open
+ * adds an entry to the file's share mode record in locking.tdb. Then
+ * both connections open and close the same file BENCH_SHARE_MODES_STORM
+ * times. Every open and close has to load and store the record with
+ * all the entries. The first connection's smbd usually finds the
+ * record in its memcache, the second one has to parse it.
+ */
+
+#define BENCH_SHARE_MODES_FNAME "bench_share_modes.dat"
+#define BENCH_SHARE_MODES_STORM 1000
+
+static bool bench_share_modes_connect(struct cli_state **pcli)
+{
+	struct cli_state *cli = NULL;
+	NTSTATUS status;
+
+	if (!torture_init_connection(&cli)) {
+		return false;
+	}
+
+	status = smbXcli_negprot(cli->conn, cli->timeout,
+				 PROTOCOL_SMB2_02, PROTOCOL_SMB2_02);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_session_setup(cli, username,
+				   password, strlen(password),
+				   password, strlen(password),
+				   workgroup);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", "", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	*pcli = cli;
+	return true;
+fail:
+	torture_close_connection(cli);
+	return false;
+}
+
+static NTSTATUS bench_share_modes_open(struct cli_state *cli,
+				       uint64_t *fid_persistent,
+				       uint64_t *fid_volatile)
+{
+	return smb2cli_create(cli->conn, cli->timeout,
+		cli->smb2.session, cli->smb2.tcon, BENCH_SHARE_MODES_FNAME,
+		SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+		SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+		SEC_FILE_READ_DATA, /* desired_access, */
+		FILE_ATTRIBUTE_NORMAL, /* file_attributes, */
+		FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+		FILE_OPEN_IF, /* create_disposition, */
+		FILE_NON_DIRECTORY_FILE, /* create_options, */
+		NULL, /* smb2_create_blobs *blobs */
+		fid_persistent,
+		fid_volatile,
+		NULL, NULL, NULL);
+}
+
+static NTSTATUS bench_share_modes_close(struct cli_state *cli,
+					uint64_t fid_persistent,
+					uint64_t fid_volatile)
+{
+	return smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+			     cli->smb2.tcon, 0, fid_persistent, fid_volatile);
+}
+
+static bool bench_share_modes_storm(struct cli_state *cli, const char *who)
+{
+	struct timeval start;
+	double secs;
+	NTSTATUS status;
+	int i;
+
+	start = timeval_current();
+
+	for (i=0; i<BENCH_SHARE_MODES_STORM; i++) {
+		uint64_t fid_persistent, fid_volatile;
+
+		status = bench_share_modes_open(cli, &fid_persistent,
+						&fid_volatile);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_create returned %s\n",
+			       nt_errstr(status));
+			return false;
+		}
+		status = bench_share_modes_close(cli, fid_persistent,
+						 fid_volatile);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_close returned %s\n",
+			       nt_errstr(status));
+			return false;
+		}
+	}
+
+	secs = timeval_elapsed(&start);
+	printf("%s: %d open/close pairs in %.3f secs, %.3f ms per pair\n",
+	       who, BENCH_SHARE_MODES_STORM, secs,
+	       secs * 1000 / BENCH_SHARE_MODES_STORM);
+	return true;
+}
+
+bool run_bench_share_modes(int dummy)
+{
+	struct cli_state *cli1 = NULL, *cli2 = NULL;
+	uint64_t *fid_persistent = NULL, *fid_volatile = NULL;
+	struct timeval start;
+	double secs;
+	NTSTATUS status;
+	bool ret = false;
+	int num_open = 0;
+	int i;
+
+	printf("Starting BENCH-SHARE-MODES with %d share mode entries\n",
+	       torture_numops);
+
+	if (!bench_share_modes_connect(&cli1) ||
+	    !bench_share_modes_connect(&cli2)) {
+		goto fail;
+	}
+
+	fid_persistent = talloc_array(talloc_tos(), uint64_t, torture_numops);
+	fid_volatile = talloc_array(talloc_tos(), uint64_t, torture_numops);
+	if ((fid_persistent == NULL) || (fid_volatile == NULL)) {
+		goto fail;
+	}
+
+	if (!bench_share_modes_storm(cli2, "no entries")) {
+		goto fail;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		status = bench_share_modes_open(cli1, &fid_persistent[i],
+						&fid_volatile[i]);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_create returned %s after %d opens\n",
+			       nt_errstr(status), i);
+			goto fail;
+		}
+		num_open += 1;
+	}
+
+	secs = timeval_elapsed(&start);
+	printf("%d opens in %.3f secs, %.3f ms per open\n",
+	       torture_numops, secs, secs * 1000 / torture_numops);
+
+	if (!bench_share_modes_storm(cli1, "same smbd") ||
+	    !bench_share_modes_storm(cli2, "other smbd")) {
+		goto fail;
+	}
+
+	start = timeval_current();
+
+	while (num_open > 0) {
+		num_open -= 1;
+		status = bench_share_modes_close(cli1,
+						 fid_persistent[num_open],
+						 fid_volatile[num_open]);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_close returned %s\n",
+			       nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	secs = timeval_elapsed(&start);
+	printf("%d closes in %.3f secs, %.3f ms per close\n",
+	       torture_numops, secs, secs * 1000 / torture_numops);
+
+	ret = true;
+fail:
+	for (i=0; i<num_open; i++) {
+		bench_share_modes_close(cli1, fid_persistent[i],
+					fid_volatile[i]);
+	}
+	TALLOC_FREE(fid_persistent);
+	TALLOC_FREE(fid_volatile);
+	if (cli1 != NULL) {
+		torture_close_connection(cli1);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	return ret;
+}
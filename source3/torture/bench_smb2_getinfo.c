@@ -0,0 +1,235 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Measure SMB2 GETINFO throughput over independent handles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "lib/util/tevent_ntstatus.h"
+
+extern fstring host, workgroup, share, password, username, myname;
+extern int torture_nprocs;
+extern int torture_numops;
+
+/*
+ * One client connection, torture_nprocs open handles with one
+ * FileAllInformation query outstanding on each. With
+ * "smbd:async getinfo = yes" the server can overlap the fstat calls
+ * of independent handles, so the rate should grow with -N until the
+ * aio thread pool or the disk saturates.
+ */
+
+struct bench_getinfo_handle {
+	struct bench_getinfo_state *state;
+	uint64_t fid_persistent;
+	uint64_t fid_volatile;
+	int todo;
+};
+
+struct bench_getinfo_state {
+	struct tevent_context *ev;
+	struct cli_state *cli;
+	int num_running;
+	NTSTATUS status;
+};
+
+static void bench_getinfo_done(struct tevent_req *subreq);
+
+static bool bench_getinfo_send_next(struct bench_getinfo_handle *h)
+{
+	struct bench_getinfo_state *state = h->state;
+	struct cli_state *cli = state->cli;
+	struct tevent_req *subreq;
+
+	subreq = smb2cli_query_info_send(
+		state, state->ev, cli->conn, cli->timeout,
+		cli->smb2.session, cli->smb2.tcon,
+		1,    /* in_info_type: SMB2_GETINFO_FILE */
+		0x12, /* in_file_info_class: FileAllInformation */
+		0xFFFF, /* in_max_output_length */
+		NULL, /* in_input_buffer */
+		0,    /* in_additional_info */
+		0,    /* in_flags */
+		h->fid_persistent, h->fid_volatile);
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, bench_getinfo_done, h);
+	state->num_running += 1;
+	return true;
+}
+
+static void bench_getinfo_done(struct tevent_req *subreq)
+{
+	struct bench_getinfo_handle *h = tevent_req_callback_data(
+		subreq, struct bench_getinfo_handle);
+	struct bench_getinfo_state *state = h->state;
+	NTSTATUS status;
+
+	state->num_running -= 1;
+
+	status = smb2cli_query_info_recv(subreq, subreq, NULL);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		state->status = status;
+		return;
+	}
+
+	h->todo -= 1;
+	if (h->todo == 0) {
+		return;
+	}
+	if (!bench_getinfo_send_next(h)) {
+		state->status = NT_STATUS_NO_MEMORY;
+	}
+}
+
+bool run_bench_smb2_getinfo(int dummy)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct bench_getinfo_state *state;
+	struct bench_getinfo_handle **handles;
+	struct cli_state *cli = NULL;
+	struct timeval start;
+	double secs;
+	NTSTATUS status;
+	bool ret = false;
+	int num_handles = MAX(torture_nprocs, 1);
+	int i;
+
+	printf("Starting BENCH-SMB2-GETINFO with %d handles\n", num_handles);
+
+	if (!torture_init_connection(&cli)) {
+		goto fail;
+	}
+
+	status = smbXcli_negprot(cli->conn, cli->timeout,
+				 PROTOCOL_SMB2_02, PROTOCOL_SMB2_02);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_session_setup(cli, username,
+				   password, strlen(password),
+				   password, strlen(password),
+				   workgroup);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", "", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	state = talloc_zero(frame, struct bench_getinfo_state);
+	handles = talloc_zero_array(frame, struct bench_getinfo_handle *,
+				    num_handles);
+	if ((state == NULL) || (handles == NULL)) {
+		goto fail;
+	}
+	state->ev = samba_tevent_context_init(state);
+	if (state->ev == NULL) {
+		goto fail;
+	}
+	state->cli = cli;
+	state->status = NT_STATUS_OK;
+
+	for (i=0; i<num_handles; i++) {
+		struct bench_getinfo_handle *h;
+		char *fname;
+
+		h = talloc_zero(handles, struct bench_getinfo_handle);
+		if (h == NULL) {
+			goto close;
+		}
+		fname = talloc_asprintf(frame, "bench_getinfo_%d.dat", i);
+		if (fname == NULL) {
+			goto close;
+		}
+
+		status = smb2cli_create(cli->conn, cli->timeout,
+			cli->smb2.session, cli->smb2.tcon, fname,
+			SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+			SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+			SEC_STD_ALL | SEC_FILE_ALL, /* desired_access, */
+			FILE_ATTRIBUTE_NORMAL, /* file_attributes, */
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+			FILE_OVERWRITE_IF, /* create_disposition, */
+			FILE_DELETE_ON_CLOSE, /* create_options, */
+			NULL, /* smb2_create_blobs *blobs */
+			&h->fid_persistent,
+			&h->fid_volatile,
+			NULL, NULL, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_create(%s) returned %s\n", fname,
+			       nt_errstr(status));
+			goto close;
+		}
+		h->state = state;
+		h->todo = torture_numops;
+		handles[i] = h;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<num_handles; i++) {
+		if (!bench_getinfo_send_next(handles[i])) {
+			printf("smb2cli_query_info_send failed\n");
+			goto close;
+		}
+	}
+
+	while ((state->num_running > 0) && NT_STATUS_IS_OK(state->status)) {
+		if (tevent_loop_once(state->ev) != 0) {
+			printf("tevent_loop_once failed\n");
+			goto close;
+		}
+	}
+	if (!NT_STATUS_IS_OK(state->status)) {
+		printf("smb2cli_query_info returned %s\n",
+		       nt_errstr(state->status));
+		goto close;
+	}
+
+	secs = timeval_elapsed(&start);
+	printf("%d handles: %d getinfo in %.3f secs, %.0f ops/sec\n",
+	       num_handles, num_handles * torture_numops, secs,
+	       num_handles * torture_numops / secs);
+
+	ret = true;
+close:
+	for (i=0; i<num_handles; i++) {
+		if (handles[i] == NULL) {
+			continue;
+		}
+		smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+			      cli->smb2.tcon, 0, handles[i]->fid_persistent,
+			      handles[i]->fid_volatile);
+	}
+fail:
+	if (cli != NULL) {
+		torture_close_connection(cli);
+	}
+	TALLOC_FREE(frame);
+	return ret;
+}
@@ -0,0 +1,409 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Watch smbd memory use during an SMB2 open/close storm
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "lib/util/tevent_ntstatus.h"
+#include "locking/proto.h"
+#include "librpc/gen_ndr/open_files.h"
+
+extern fstring host, workgroup, share, password, username, myname;
+extern int torture_nprocs;
+extern int torture_numops;
+
+/*
+ * torture_nprocs workers on one connection, each keeping a few handles
+ * open at a time and replacing the oldest one with a fresh open. The
+ * overlapping lifetimes are what fragments a long-lived smbd heap.
+ *
+ * If smbd runs on this machine with the same smb.conf, the test finds
+ * its pid through locking.tdb and reports its RSS ten times during the
+ * run. Compare runs with and without "smbd:slab pool size".
+ */
+
+#define BENCH_OPENCLOSE_HANDLES 4
+#define BENCH_OPENCLOSE_ANCHOR "bench_openclose_anchor.dat"
+
+struct bench_openclose_worker {
+	struct bench_openclose_state *state;
+	char *fname;
+	uint64_t fid_persistent[BENCH_OPENCLOSE_HANDLES];
+	uint64_t fid_volatile[BENCH_OPENCLOSE_HANDLES];
+	int num_open;
+	int next;
+	int todo;
+};
+
+struct bench_openclose_state {
+	struct tevent_context *ev;
+	struct cli_state *cli;
+	int num_running;
+	int num_done;
+	NTSTATUS status;
+};
+
+static void bench_openclose_create_done(struct tevent_req *subreq);
+static void bench_openclose_close_done(struct tevent_req *subreq);
+
+static bool bench_openclose_send_next(struct bench_openclose_worker *w)
+{
+	struct bench_openclose_state *state = w->state;
+	struct cli_state *cli = state->cli;
+	struct tevent_req *subreq;
+
+	if (w->num_open < BENCH_OPENCLOSE_HANDLES) {
+		subreq = smb2cli_create_send(
+			state, state->ev, cli->conn, cli->timeout,
+			cli->smb2.session, cli->smb2.tcon, w->fname,
+			SMB2_OPLOCK_LEVEL_NONE,
+			SMB2_IMPERSONATION_IMPERSONATION,
+			SEC_FILE_READ_ATTRIBUTE,
+			FILE_ATTRIBUTE_NORMAL,
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+			FILE_OPEN_IF,
+			0,
+			NULL);
+		if (subreq == NULL) {
+			return false;
+		}
+		tevent_req_set_callback(subreq, bench_openclose_create_done,
+					w);
+	} else {
+		subreq = smb2cli_close_send(
+			state, state->ev, cli->conn, cli->timeout,
+			cli->smb2.session, cli->smb2.tcon, 0,
+			w->fid_persistent[w->next], w->fid_volatile[w->next]);
+		if (subreq == NULL) {
+			return false;
+		}
+		tevent_req_set_callback(subreq, bench_openclose_close_done,
+					w);
+	}
+	state->num_running += 1;
+	return true;
+}
+
+static void bench_openclose_continue(struct bench_openclose_worker *w)
+{
+	struct bench_openclose_state *state = w->state;
+
+	if (w->todo == 0) {
+		return;
+	}
+	if (!bench_openclose_send_next(w)) {
+		state->status = NT_STATUS_NO_MEMORY;
+	}
+}
+
+static void bench_openclose_create_done(struct tevent_req *subreq)
+{
+	struct bench_openclose_worker *w = tevent_req_callback_data(
+		subreq, struct bench_openclose_worker);
+	struct bench_openclose_state *state = w->state;
+	NTSTATUS status;
+
+	state->num_running -= 1;
+
+	status = smb2cli_create_recv(subreq, &w->fid_persistent[w->next],
+				     &w->fid_volatile[w->next],
+				     NULL, NULL, NULL);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		state->status = status;
+		return;
+	}
+
+	w->num_open += 1;
+	w->next = (w->next + 1) % BENCH_OPENCLOSE_HANDLES;
+	w->todo -= 1;
+	state->num_done += 1;
+
+	bench_openclose_continue(w);
+}
+
+static void bench_openclose_close_done(struct tevent_req *subreq)
+{
+	struct bench_openclose_worker *w = tevent_req_callback_data(
+		subreq, struct bench_openclose_worker);
+	struct bench_openclose_state *state = w->state;
+	NTSTATUS status;
+
+	state->num_running -= 1;
+
+	status = smb2cli_close_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		state->status = status;
+		return;
+	}
+
+	w->num_open -= 1;
+
+	bench_openclose_continue(w);
+}
+
+struct bench_openclose_find_state {
+	pid_t pid;
+};
+
+static int bench_openclose_find_fn(const struct share_mode_entry *e,
+				   const char *service_path,
+				   const char *base_name,
+				   const char *stream_name,
+				   void *private_data)
+{
+	struct bench_openclose_find_state *state =
+		(struct bench_openclose_find_state *)private_data;
+
+	if (strcmp(base_name, BENCH_OPENCLOSE_ANCHOR) != 0) {
+		return 0;
+	}
+	if (!procid_is_local(&e->pid)) {
+		return 0;
+	}
+	state->pid = e->pid.pid;
+	return 1;
+}
+
+/*
+ * Find the smbd serving us, through the anchor file we keep open
+ */
+static pid_t bench_openclose_server_pid(void)
+{
+	struct bench_openclose_find_state state = { .pid = 0 };
+
+	if (!locking_init_readonly()) {
+		return 0;
+	}
+	share_entry_forall(bench_openclose_find_fn, &state);
+	locking_end();
+
+	return state.pid;
+}
+
+/*
+ * VmRSS of pid in kB, -1 if unknown
+ */
+static long bench_openclose_rss(pid_t pid)
+{
+	char path[64];
+	char line[256];
+	long rss = -1;
+	FILE *f;
+
+	if (pid == 0) {
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (strncmp(line, "VmRSS:", 6) == 0) {
+			rss = strtol(line + 6, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+	return rss;
+}
+
+static void bench_openclose_report(struct timeval *start, int num_done,
+				   pid_t pid)
+{
+	double secs = timeval_elapsed(start);
+	long rss = bench_openclose_rss(pid);
+
+	if (rss == -1) {
+		printf("%8.3f secs: %d opens, %.0f opens/sec, smbd RSS unknown\n",
+		       secs, num_done, num_done / secs);
+		return;
+	}
+	printf("%8.3f secs: %d opens, %.0f opens/sec, smbd RSS %ld kB\n",
+	       secs, num_done, num_done / secs, rss);
+}
+
+bool run_bench_smb2_openclose(int dummy)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct bench_openclose_state *state;
+	struct bench_openclose_worker **workers = NULL;
+	struct cli_state *cli = NULL;
+	struct timeval start;
+	uint64_t anchor_persistent, anchor_volatile;
+	bool anchor_open = false;
+	NTSTATUS status;
+	bool ret = false;
+	int num_workers = MAX(torture_nprocs, 1);
+	int report_every, next_report;
+	pid_t pid;
+	int i, j;
+
+	printf("Starting BENCH-SMB2-OPENCLOSE with %d workers\n",
+	       num_workers);
+
+	if (!torture_init_connection(&cli)) {
+		goto fail;
+	}
+
+	status = smbXcli_negprot(cli->conn, cli->timeout,
+				 PROTOCOL_SMB2_02, PROTOCOL_SMB2_02);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_session_setup(cli, username,
+				   password, strlen(password),
+				   password, strlen(password),
+				   workgroup);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", "", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = smb2cli_create(cli->conn, cli->timeout,
+				cli->smb2.session, cli->smb2.tcon,
+				BENCH_OPENCLOSE_ANCHOR,
+				SMB2_OPLOCK_LEVEL_NONE,
+				SMB2_IMPERSONATION_IMPERSONATION,
+				SEC_STD_ALL | SEC_FILE_ALL,
+				FILE_ATTRIBUTE_NORMAL,
+				FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+				FILE_OVERWRITE_IF,
+				FILE_DELETE_ON_CLOSE,
+				NULL,
+				&anchor_persistent,
+				&anchor_volatile,
+				NULL, NULL, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smb2cli_create(%s) returned %s\n",
+		       BENCH_OPENCLOSE_ANCHOR, nt_errstr(status));
+		goto fail;
+	}
+	anchor_open = true;
+
+	pid = bench_openclose_server_pid();
+	if (pid == 0) {
+		printf("smbd not found in locking.tdb, not reporting RSS\n");
+	}
+
+	state = talloc_zero(frame, struct bench_openclose_state);
+	workers = talloc_zero_array(frame, struct bench_openclose_worker *,
+				    num_workers);
+	if ((state == NULL) || (workers == NULL)) {
+		goto close;
+	}
+	state->ev = samba_tevent_context_init(state);
+	if (state->ev == NULL) {
+		goto close;
+	}
+	state->cli = cli;
+	state->status = NT_STATUS_OK;
+
+	for (i=0; i<num_workers; i++) {
+		struct bench_openclose_worker *w;
+
+		w = talloc_zero(workers, struct bench_openclose_worker);
+		if (w == NULL) {
+			goto close;
+		}
+		w->fname = talloc_asprintf(w, "bench_openclose_%d.dat", i);
+		if (w->fname == NULL) {
+			goto close;
+		}
+		w->state = state;
+		w->todo = torture_numops;
+		workers[i] = w;
+	}
+
+	report_every = MAX(num_workers * torture_numops / 10, 1);
+	next_report = report_every;
+
+	printf("smbd RSS before the storm: %ld kB\n",
+	       bench_openclose_rss(pid));
+
+	start = timeval_current();
+
+	for (i=0; i<num_workers; i++) {
+		if (!bench_openclose_send_next(workers[i])) {
+			printf("smb2cli_create_send failed\n");
+			goto close;
+		}
+	}
+
+	while ((state->num_running > 0) && NT_STATUS_IS_OK(state->status)) {
+		if (tevent_loop_once(state->ev) != 0) {
+			printf("tevent_loop_once failed\n");
+			goto close;
+		}
+		if (state->num_done >= next_report) {
+			bench_openclose_report(&start, state->num_done, pid);
+			next_report += report_every;
+		}
+	}
+	if (!NT_STATUS_IS_OK(state->status)) {
+		printf("open/close storm failed: %s\n",
+		       nt_errstr(state->status));
+		goto close;
+	}
+
+	ret = true;
+close:
+	for (i=0; (workers != NULL) && (i<num_workers); i++) {
+		struct bench_openclose_worker *w = workers[i];
+
+		if (w == NULL) {
+			continue;
+		}
+		for (j=0; j<w->num_open; j++) {
+			/* the open handles are the ones before "next" */
+			int h = (w->next - w->num_open + j +
+				 BENCH_OPENCLOSE_HANDLES) %
+				BENCH_OPENCLOSE_HANDLES;
+
+			smb2cli_close(cli->conn, cli->timeout,
+				      cli->smb2.session, cli->smb2.tcon, 0,
+				      w->fid_persistent[h],
+				      w->fid_volatile[h]);
+		}
+		cli_unlink(cli, w->fname, 0);
+	}
+fail:
+	if (anchor_open) {
+		smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+			      cli->smb2.tcon, 0, anchor_persistent,
+			      anchor_volatile);
+	}
+	if (cli != NULL) {
+		torture_close_connection(cli);
+	}
+	TALLOC_FREE(frame);
+	return ret;
+}
@@ -0,0 +1,237 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Measure SMB2 QUERY_DIRECTORY throughput on a large directory
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+#include "../libcli/smb/smbXcli_base.h"
+
+extern fstring host, workgroup, share, password, username, myname;
+extern int torture_numops;
+
+/*
+ * List a directory with torture_numops entries three times using
+ * FileIdBothDirectoryInformation and 64k output buffers, like
+ * Windows Explorer does. Run it against shares with and without
+ * "smbd:async query directory", and with "vfs objects = delay_inject"
+ * to see what the prefetching buys on slow metadata.
+ *
+ * The directory is left in place so that further runs, for example
+ * against another share with the same path, don't have to create it
+ * again.
+ */
+
+#define BENCH_QUERYDIR_DIR "bench_querydir"
+#define BENCH_QUERYDIR_ROUNDS 3
+
+static NTSTATUS bench_querydir_open(struct cli_state *cli,
+				    uint32_t create_disposition,
+				    uint64_t *fid_persistent,
+				    uint64_t *fid_volatile)
+{
+	return smb2cli_create(cli->conn, cli->timeout,
+		cli->smb2.session, cli->smb2.tcon, BENCH_QUERYDIR_DIR,
+		SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+		SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+		SEC_STD_SYNCHRONIZE|SEC_DIR_LIST|SEC_DIR_ADD_FILE, /* desired_access, */
+		FILE_ATTRIBUTE_DIRECTORY, /* file_attributes, */
+		FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+		create_disposition, /* create_disposition, */
+		FILE_DIRECTORY_FILE, /* create_options, */
+		NULL, /* smb2_create_blobs *blobs */
+		fid_persistent,
+		fid_volatile,
+		NULL, NULL, NULL);
+}
+
+static NTSTATUS bench_querydir_list(struct cli_state *cli,
+				    unsigned *num_entries)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	uint64_t fid_persistent, fid_volatile;
+	NTSTATUS status;
+
+	*num_entries = 0;
+
+	status = bench_querydir_open(cli, FILE_OPEN, &fid_persistent,
+				     &fid_volatile);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(frame);
+		return status;
+	}
+
+	while (true) {
+		TALLOC_CTX *mem_ctx = talloc_new(frame);
+		uint8_t *data;
+		uint32_t data_len;
+		uint32_t ofs = 0;
+
+		status = smb2cli_query_directory(
+			cli->conn, cli->timeout, cli->smb2.session,
+			cli->smb2.tcon,
+			SMB2_FIND_ID_BOTH_DIRECTORY_INFO, /* level */
+			0,	/* flags */
+			0,	/* file_index */
+			fid_persistent, fid_volatile,
+			"*",
+			0xffff, /* outbuf_len */
+			mem_ctx, &data, &data_len);
+		if (!NT_STATUS_IS_OK(status)) {
+			TALLOC_FREE(mem_ctx);
+			break;
+		}
+
+		while (ofs + 4 <= data_len) {
+			uint32_t next = IVAL(data, ofs);
+
+			*num_entries += 1;
+			if (next == 0) {
+				break;
+			}
+			ofs += next;
+		}
+		TALLOC_FREE(mem_ctx);
+	}
+	if (NT_STATUS_EQUAL(status, STATUS_NO_MORE_FILES)) {
+		status = NT_STATUS_OK;
+	}
+
+	smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+		      cli->smb2.tcon, 0, fid_persistent, fid_volatile);
+	TALLOC_FREE(frame);
+	return status;
+}
+
+static bool bench_querydir_populate(struct cli_state *cli)
+{
+	uint64_t fid_persistent, fid_volatile;
+	NTSTATUS status;
+	int i;
+
+	status = bench_querydir_open(cli, FILE_OPEN_IF, &fid_persistent,
+				     &fid_volatile);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smb2cli_create(%s) returned %s\n", BENCH_QUERYDIR_DIR,
+		       nt_errstr(status));
+		return false;
+	}
+	smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+		      cli->smb2.tcon, 0, fid_persistent, fid_volatile);
+
+	for (i=0; i<torture_numops; i++) {
+		fstring fname;
+
+		fstr_sprintf(fname, BENCH_QUERYDIR_DIR "\\file_%06d.dat", i);
+
+		status = smb2cli_create(cli->conn, cli->timeout,
+			cli->smb2.session, cli->smb2.tcon, fname,
+			SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+			SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+			SEC_FILE_READ_ATTRIBUTE, /* desired_access, */
+			FILE_ATTRIBUTE_NORMAL, /* file_attributes, */
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+			FILE_OPEN_IF, /* create_disposition, */
+			FILE_NON_DIRECTORY_FILE, /* create_options, */
+			NULL, /* smb2_create_blobs *blobs */
+			&fid_persistent,
+			&fid_volatile,
+			NULL, NULL, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_create(%s) returned %s\n", fname,
+			       nt_errstr(status));
+			return false;
+		}
+		smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+			      cli->smb2.tcon, 0, fid_persistent, fid_volatile);
+	}
+
+	return true;
+}
+
+bool run_bench_smb2_querydir(int dummy)
+{
+	struct cli_state *cli = NULL;
+	struct timeval start;
+	double secs;
+	NTSTATUS status;
+	unsigned num_entries;
+	bool ret = false;
+	int i;
+
+	printf("Starting BENCH-SMB2-QUERYDIR with %d files\n",
+	       torture_numops);
+
+	if (!torture_init_connection(&cli)) {
+		goto fail;
+	}
+
+	status = smbXcli_negprot(cli->conn, cli->timeout,
+				 PROTOCOL_SMB2_02, PROTOCOL_SMB2_02);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_session_setup(cli, username,
+				   password, strlen(password),
+				   password, strlen(password),
+				   workgroup);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", "", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = bench_querydir_list(cli, &num_entries);
+	if (!NT_STATUS_IS_OK(status) ||
+	    (num_entries < torture_numops + 2)) {
+		printf("Creating %d files in %s\n", torture_numops,
+		       BENCH_QUERYDIR_DIR);
+		if (!bench_querydir_populate(cli)) {
+			goto fail;
+		}
+	}
+
+	for (i=0; i<BENCH_QUERYDIR_ROUNDS; i++) {
+		start = timeval_current();
+
+		status = bench_querydir_list(cli, &num_entries);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_query_directory returned %s\n",
+			       nt_errstr(status));
+			goto fail;
+		}
+
+		secs = timeval_elapsed(&start);
+		printf("%u entries in %.3f secs, %.0f entries/sec\n",
+		       num_entries, secs, num_entries / secs);
+	}
+
+	ret = true;
+fail:
+	if (cli != NULL) {
+		torture_close_connection(cli);
+	}
+	return ret;
+}
@@ -29,6 +29,7 @@ struct source_state {
 	int msg_type;
 	struct timeval interval;
 	struct server_id dst;
+	unsigned num_msgs;
 };
 
 static void source_waited(struct tevent_req *subreq);
@@ -38,7 +39,8 @@ static struct tevent_req *source_send(TALLOC_CTX *mem_ctx,
 				      struct messaging_context *msg_ctx,
 				      int msg_type,
 				      struct timeval interval,
-				      struct server_id dst)
+				      struct server_id dst,
+				      unsigned num_msgs)
 {
 	struct tevent_req *req, *subreq;
 	struct source_state *state;
@@ -52,6 +54,7 @@ static struct tevent_req *source_send(TALLOC_CTX *mem_ctx,
 	state->msg_type = msg_type;
 	state->interval = interval;
 	state->dst = dst;
+	state->num_msgs = num_msgs;
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -72,6 +75,7 @@ static void source_waited(struct tevent_req *subreq)
 		req, struct source_state);
 	bool ok;
 	uint8_t buf[200] = { };
+	unsigned i;
 
 	ok = tevent_wakeup_recv(subreq);
 	TALLOC_FREE(subreq);
@@ -80,8 +84,10 @@ static void source_waited(struct tevent_req *subreq)
 		return;
 	}
 
-	messaging_send_buf(state->msg_ctx, state->dst, state->msg_type,
-			   buf, sizeof(buf));
+	for (i=0; i<state->num_msgs; i++) {
+		messaging_send_buf(state->msg_ctx, state->dst,
+				   state->msg_type, buf, sizeof(buf));
+	}
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -111,11 +117,15 @@ int main(int argc, const char *argv[])
 	struct tevent_req *req;
 	int ret;
 	struct server_id id;
+	unsigned num_msgs = 1;
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <dst>\n", argv[0]);
+	if ((argc != 2) && (argc != 3)) {
+		fprintf(stderr, "Usage: %s <dst> [msgs per 10ms]\n", argv[0]);
 		return -1;
 	}
+	if (argc == 3) {
+		num_msgs = strtoul(argv[2], NULL, 10);
+	}
 
 	lp_load_global(get_dyn_CONFIGFILE());
 
@@ -138,7 +148,7 @@ int main(int argc, const char *argv[])
 	}
 
 	req = source_send(ev, ev, msg_ctx, MSG_SMB_NOTIFY,
-			  timeval_set(0, 10000), id);
+			  timeval_set(0, 10000), id, num_msgs);
 	if (req == NULL) {
 		perror("source_send failed");
 		return -1;
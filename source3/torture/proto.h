@@ -108,10 +108,19 @@ bool run_cleanup4(int dummy);
 bool run_notify_bench2(int dummy);
 bool run_notify_bench3(int dummy);
 bool run_dbwrap_watch1(int dummy);
+bool run_dbwrap_multi(int dummy);
 bool run_idmap_tdb_common_test(int dummy);
 bool run_local_dbwrap_ctdb(int dummy);
 bool run_qpathinfo_bufsize(int dummy);
+bool run_fcb_dup(int dummy);
 bool run_bench_pthreadpool(int dummy);
+bool run_bench_aio(int dummy);
+bool run_bench_smb2_getinfo(int dummy);
+bool run_bench_smb2_querydir(int dummy);
+bool run_bench_smb2_openclose(int dummy);
+bool run_bench_messaging_fanout(int dummy);
+bool run_bench_many_handles(int dummy);
+bool run_bench_share_modes(int dummy);
 bool run_messaging_read1(int dummy);
 bool run_messaging_read2(int dummy);
 bool run_messaging_read3(int dummy);
@@ -120,6 +129,8 @@ bool run_messaging_fdpass1(int dummy);
 bool run_messaging_fdpass2(int dummy);
 bool run_messaging_fdpass2a(int dummy);
 bool run_messaging_fdpass2b(int dummy);
+bool run_msg_ring(int dummy);
+bool run_local_share_mode_record(int dummy);
 bool run_oplock_cancel(int dummy);
 
 #endif /* __TORTURE_H__ */
@@ -0,0 +1,245 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test dbwrap_parse_records_multi and dbwrap_do_locked_multi
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "system/filesys.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_open.h"
+#include "lib/dbwrap/dbwrap_rbt.h"
+#include "lib/util/util_tdb.h"
+
+#define NUM_RECORDS 100
+#define NUM_MISSING 10
+
+struct dbwrap_multi_state {
+	uint32_t keys[NUM_RECORDS + NUM_MISSING];
+	TDB_DATA tkeys[NUM_RECORDS + NUM_MISSING];
+	unsigned seen[NUM_RECORDS + NUM_MISSING];
+	uint32_t add;
+	unsigned bad;
+};
+
+static void dbwrap_multi_parser(size_t idx, TDB_DATA key, TDB_DATA data,
+				void *private_data)
+{
+	struct dbwrap_multi_state *state = private_data;
+	uint32_t val;
+
+	if ((idx >= ARRAY_SIZE(state->keys)) ||
+	    (key.dsize != sizeof(uint32_t)) ||
+	    (memcmp(key.dptr, &state->keys[idx], sizeof(uint32_t)) != 0) ||
+	    (data.dsize != sizeof(uint32_t))) {
+		state->bad += 1;
+		return;
+	}
+	memcpy(&val, data.dptr, sizeof(val));
+	if (val != state->keys[idx] + state->add) {
+		state->bad += 1;
+	}
+	state->seen[idx] += 1;
+}
+
+static bool dbwrap_multi_check(struct db_context *db,
+			       struct dbwrap_multi_state *state,
+			       size_t num_expected)
+{
+	NTSTATUS status;
+	size_t i;
+
+	memset(state->seen, 0, sizeof(state->seen));
+	state->bad = 0;
+
+	status = dbwrap_parse_records_multi(db, state->tkeys,
+					    ARRAY_SIZE(state->tkeys),
+					    dbwrap_multi_parser, state);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_parse_records_multi failed: %s\n",
+			nt_errstr(status));
+		return false;
+	}
+	if (state->bad != 0) {
+		fprintf(stderr, "%u bad records\n", state->bad);
+		return false;
+	}
+	for (i=0; i<ARRAY_SIZE(state->seen); i++) {
+		unsigned expected = (i < num_expected) ? 1 : 0;
+
+		if (state->seen[i] != expected) {
+			fprintf(stderr, "record %u seen %u times, expected "
+				"%u\n", (unsigned)i, state->seen[i],
+				expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void dbwrap_multi_update(struct db_record **recs, size_t num_recs,
+				void *private_data)
+{
+	struct dbwrap_multi_state *state = private_data;
+	size_t i;
+
+	if (num_recs != NUM_RECORDS + NUM_MISSING) {
+		state->bad += 1;
+		return;
+	}
+
+	for (i=0; i<num_recs; i++) {
+		TDB_DATA key = dbwrap_record_get_key(recs[i]);
+		TDB_DATA value = dbwrap_record_get_value(recs[i]);
+		uint32_t val;
+		NTSTATUS status;
+
+		if ((key.dsize != sizeof(uint32_t)) ||
+		    (memcmp(key.dptr, &state->keys[i],
+			    sizeof(uint32_t)) != 0)) {
+			state->bad += 1;
+			continue;
+		}
+
+		if (i >= NUM_RECORDS) {
+			/* Missing records come as empty ones */
+			if (value.dsize != 0) {
+				state->bad += 1;
+			}
+			continue;
+		}
+
+		if (value.dsize != sizeof(uint32_t)) {
+			state->bad += 1;
+			continue;
+		}
+		memcpy(&val, value.dptr, sizeof(val));
+		if (val != state->keys[i]) {
+			state->bad += 1;
+		}
+
+		if (i == NUM_RECORDS - 1) {
+			status = dbwrap_record_delete(recs[i]);
+		} else {
+			val = state->keys[i] + 1;
+			status = dbwrap_record_store(
+				recs[i], make_tdb_data((uint8_t *)&val,
+						       sizeof(val)), 0);
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			state->bad += 1;
+		}
+	}
+}
+
+static bool dbwrap_multi_test(struct db_context *db)
+{
+	struct dbwrap_multi_state *state;
+	NTSTATUS status;
+	bool ret = false;
+	size_t i;
+
+	state = talloc_zero(talloc_tos(), struct dbwrap_multi_state);
+	if (state == NULL) {
+		fprintf(stderr, "talloc failed\n");
+		return false;
+	}
+
+	for (i=0; i<ARRAY_SIZE(state->keys); i++) {
+		state->keys[i] = i * 7919;
+		state->tkeys[i] = make_tdb_data((uint8_t *)&state->keys[i],
+						sizeof(uint32_t));
+	}
+	for (i=0; i<NUM_RECORDS; i++) {
+		status = dbwrap_store(db, state->tkeys[i], state->tkeys[i], 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "dbwrap_store failed: %s\n",
+				nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	if (!dbwrap_multi_check(db, state, NUM_RECORDS)) {
+		goto fail;
+	}
+
+	status = dbwrap_do_locked_multi(db, state->tkeys,
+					ARRAY_SIZE(state->tkeys),
+					dbwrap_multi_update, state);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_do_locked_multi failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (state->bad != 0) {
+		fprintf(stderr, "%u bad locked records\n", state->bad);
+		goto fail;
+	}
+
+	/* The updates are there, the last record is gone */
+	state->add = 1;
+	if (!dbwrap_multi_check(db, state, NUM_RECORDS - 1)) {
+		goto fail;
+	}
+
+	/* We can lock again, all locks were released */
+	status = dbwrap_store(db, state->tkeys[0], state->tkeys[0], 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_store failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(state);
+	return ret;
+}
+
+bool run_dbwrap_multi(int dummy)
+{
+	struct db_context *db;
+	bool ret = false;
+
+	db = db_open(talloc_tos(), "test_multi.tdb", 7, TDB_CLEAR_IF_FIRST,
+		     O_CREAT|O_RDWR, 0644, DBWRAP_LOCK_ORDER_1,
+		     DBWRAP_FLAG_NONE);
+	if (db == NULL) {
+		fprintf(stderr, "db_open failed: %s\n", strerror(errno));
+		goto fail;
+	}
+	if (!dbwrap_multi_test(db)) {
+		fprintf(stderr, "tdb test failed\n");
+		goto fail;
+	}
+	TALLOC_FREE(db);
+
+	/* rbt has no batch operations, this tests the fallbacks */
+	db = db_open_rbt(talloc_tos());
+	if (db == NULL) {
+		fprintf(stderr, "db_open_rbt failed\n");
+		goto fail;
+	}
+	if (!dbwrap_multi_test(db)) {
+		fprintf(stderr, "rbt test failed\n");
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(db);
+	return ret;
+}
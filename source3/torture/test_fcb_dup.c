@@ -0,0 +1,110 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test that FCB opens find each other by file_id
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "system/filesys.h"
+#include "libsmb/libsmb.h"
+
+/*
+ * A second FCB open of a file is a duplicate of the first one. Close
+ * the first one, a third FCB open then can only succeed if smbd finds
+ * the duplicate by its file_id.
+ */
+
+bool run_fcb_dup(int dummy)
+{
+	struct cli_state *cli = NULL;
+	const char *fname = "fcb_dup.dat";
+	uint16_t fnum1 = UINT16_MAX, fnum2 = UINT16_MAX, fnum3 = UINT16_MAX;
+	const uint8_t data = 'x';
+	uint8_t buf = 0;
+	size_t nread;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting FCB-DUP\n");
+
+	if (!torture_open_connection(&cli, 0)) {
+		printf("torture_open_connection failed\n");
+		return false;
+	}
+
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+
+	status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_EXCL, DENY_FCB,
+			   &fnum1);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("first open returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_openx(cli, fname, O_RDWR, DENY_FCB, &fnum2);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("second open returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_close(cli, fnum1);
+	fnum1 = UINT16_MAX;
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_close returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_openx(cli, fname, O_RDWR, DENY_FCB, &fnum3);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("third open returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * The duplicates share one file handle
+	 */
+	status = cli_writeall(cli, fnum3, 0, &data, 0, sizeof(data), NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_writeall returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_read(cli, fnum2, (char *)&buf, 0, sizeof(buf), &nread);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_read returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if ((nread != sizeof(buf)) || (buf != data)) {
+		printf("read %d bytes (%c), expected %c\n", (int)nread,
+		       (char)buf, (char)data);
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (fnum1 != UINT16_MAX) {
+		cli_close(cli, fnum1);
+	}
+	if (fnum2 != UINT16_MAX) {
+		cli_close(cli, fnum2);
+	}
+	if (fnum3 != UINT16_MAX) {
+		cli_close(cli, fnum3);
+	}
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli);
+	return ret;
+}
@@ -0,0 +1,277 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test the shared memory message ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "lib/msg_ring/msg_ring.h"
+#include <sys/mman.h>
+
+/*
+ * The smallest ring, a message can be at most a quarter of it
+ */
+#define MSG_RING_TEST_SIZE 4096
+#define MSG_RING_TEST_MAX_MSG (MSG_RING_TEST_SIZE/4)
+
+static void msg_ring_test_fill(uint8_t *buf, size_t len, uint32_t seq)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = seq + i;
+	}
+}
+
+static bool msg_ring_test_check(const uint8_t *buf, size_t len, uint32_t seq)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (buf[i] != (uint8_t)(seq + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool msg_ring_test_get(struct msg_ring *ring, uint32_t seq,
+			      size_t len)
+{
+	const uint8_t *msg;
+	size_t msg_len;
+	uint32_t got_seq;
+	int ret;
+
+	ret = msg_ring_peek(ring, &got_seq, &msg, &msg_len);
+	if (ret != 0) {
+		fprintf(stderr, "msg_ring_peek failed: %s\n", strerror(ret));
+		return false;
+	}
+	if ((got_seq != seq) || (msg_len != len)) {
+		fprintf(stderr, "Expected seq %u len %u, got seq %u len %u\n",
+			(unsigned)seq, (unsigned)len, (unsigned)got_seq,
+			(unsigned)msg_len);
+		return false;
+	}
+	if (!msg_ring_test_check(msg, msg_len, seq)) {
+		fprintf(stderr, "Message %u corrupt\n", (unsigned)seq);
+		return false;
+	}
+	msg_ring_consume(ring);
+	return true;
+}
+
+/*
+ * Split a message into up to three iovecs
+ */
+static int msg_ring_test_put(struct msg_ring *ring, uint32_t seq,
+			     uint8_t *buf, size_t len, bool *wakeup)
+{
+	struct iovec iov[3];
+	size_t a = len/3, b = len/2;
+
+	msg_ring_test_fill(buf, len, seq);
+
+	iov[0] = (struct iovec) { .iov_base = buf, .iov_len = a };
+	iov[1] = (struct iovec) { .iov_base = buf + a, .iov_len = b - a };
+	iov[2] = (struct iovec) { .iov_base = buf + b, .iov_len = len - b };
+
+	return msg_ring_put(ring, seq, iov, ARRAY_SIZE(iov), wakeup);
+}
+
+bool run_msg_ring(int dummy)
+{
+	struct msg_ring *prod = NULL, *cons = NULL;
+	uint8_t buf[MSG_RING_TEST_MAX_MSG+1];
+	struct stat st;
+	const uint8_t *msg;
+	size_t msg_len, len;
+	uint32_t seq, first, i;
+	bool wakeup;
+	void *map = MAP_FAILED;
+	int fd = -1;
+	int ret;
+	bool ok = false;
+
+	ret = msg_ring_create(MSG_RING_TEST_SIZE, &fd, &prod);
+	if (ret == ENOSYS) {
+		printf("msg_ring not supported, skipping\n");
+		return true;
+	}
+	if (ret != 0) {
+		fprintf(stderr, "msg_ring_create failed: %s\n", strerror(ret));
+		return false;
+	}
+
+	ret = msg_ring_attach(fd, &cons);
+	if (ret != 0) {
+		fprintf(stderr, "msg_ring_attach failed: %s\n", strerror(ret));
+		goto fail;
+	}
+
+	ret = msg_ring_peek(cons, &seq, &msg, &msg_len);
+	if (ret != ENOENT) {
+		fprintf(stderr, "peek on empty ring returned %s\n",
+			strerror(ret));
+		goto fail;
+	}
+
+	/*
+	 * A message larger than a quarter of the ring never fits
+	 */
+	ret = msg_ring_test_put(prod, 0, buf, MSG_RING_TEST_MAX_MSG+1,
+				&wakeup);
+	if (ret != EMSGSIZE) {
+		fprintf(stderr, "oversized put returned %s\n", strerror(ret));
+		goto fail;
+	}
+
+	/*
+	 * Empty messages and messages of odd sizes, running around
+	 * the ring a few times. Records and message bodies wrap at
+	 * different offsets.
+	 */
+	seq = 0;
+	for (i=0; i<1000; i++) {
+		len = (i * 37) % (MSG_RING_TEST_MAX_MSG+1);
+
+		ret = msg_ring_test_put(prod, seq, buf, len, &wakeup);
+		if (ret != 0) {
+			fprintf(stderr, "msg_ring_put %u failed: %s\n",
+				(unsigned)i, strerror(ret));
+			goto fail;
+		}
+		if (wakeup) {
+			fprintf(stderr, "wakeup without sleeper\n");
+			goto fail;
+		}
+		if (!msg_ring_test_get(cons, seq, len)) {
+			goto fail;
+		}
+		seq += 1;
+	}
+
+	/*
+	 * Fill the ring, the consumer must see all messages in order
+	 */
+	first = seq;
+	do {
+		ret = msg_ring_test_put(prod, seq, buf, 100, &wakeup);
+		if (ret == 0) {
+			seq += 1;
+		}
+	} while (ret == 0);
+
+	if (ret != ENOSPC) {
+		fprintf(stderr, "put into full ring returned %s\n",
+			strerror(ret));
+		goto fail;
+	}
+	/*
+	 * 8 bytes record header plus 100 bytes aligned to 104
+	 */
+	if (seq - first != MSG_RING_TEST_SIZE / 112) {
+		fprintf(stderr, "%u messages fit, expected %u\n",
+			(unsigned)(seq - first),
+			(unsigned)(MSG_RING_TEST_SIZE / 112));
+		goto fail;
+	}
+
+	for (i=first; i<seq; i++) {
+		if (!msg_ring_test_get(cons, i, 100)) {
+			goto fail;
+		}
+	}
+
+	/*
+	 * The producer has to ring the doorbell only for a sleeping
+	 * consumer
+	 */
+	if (!msg_ring_prepare_sleep(cons)) {
+		fprintf(stderr, "Could not sleep on empty ring\n");
+		goto fail;
+	}
+	ret = msg_ring_test_put(prod, seq, buf, 10, &wakeup);
+	if ((ret != 0) || !wakeup) {
+		fprintf(stderr, "put to sleeper: ret=%s, wakeup=%d\n",
+			strerror(ret), (int)wakeup);
+		goto fail;
+	}
+	msg_ring_wakeup(cons);
+
+	ret = msg_ring_test_put(prod, seq+1, buf, 10, &wakeup);
+	if ((ret != 0) || wakeup) {
+		fprintf(stderr, "put to awake consumer: ret=%s, wakeup=%d\n",
+			strerror(ret), (int)wakeup);
+		goto fail;
+	}
+
+	if (msg_ring_prepare_sleep(cons)) {
+		fprintf(stderr, "Could sleep on non-empty ring\n");
+		goto fail;
+	}
+
+	/*
+	 * The message handed out must be our own copy
+	 */
+	ret = msg_ring_peek(cons, &seq, &msg, &msg_len);
+	if (ret != 0) {
+		fprintf(stderr, "msg_ring_peek failed: %s\n", strerror(ret));
+		goto fail;
+	}
+
+	ret = fstat(fd, &st);
+	if (ret == -1) {
+		fprintf(stderr, "fstat failed: %s\n", strerror(errno));
+		goto fail;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+		goto fail;
+	}
+	memset(map, 0xff, st.st_size);
+
+	if (!msg_ring_test_check(msg, msg_len, seq)) {
+		fprintf(stderr, "Peeked message changed\n");
+		goto fail;
+	}
+	msg_ring_consume(cons);
+
+	/*
+	 * A producer scribbling over the ring must not crash us
+	 */
+	ret = msg_ring_peek(cons, &seq, &msg, &msg_len);
+	if (ret != EINVAL) {
+		fprintf(stderr, "peek on garbage returned %s\n",
+			strerror(ret));
+		goto fail;
+	}
+
+	ok = true;
+fail:
+	if (map != MAP_FAILED) {
+		munmap(map, st.st_size);
+	}
+	msg_ring_free(cons);
+	msg_ring_free(prod);
+	if (fd != -1) {
+		close(fd);
+	}
+	return ok;
+}
@@ -0,0 +1,308 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test storing share mode records with only the changed entries
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "locking/proto.h"
+#include "librpc/gen_ndr/open_files.h"
+#include "lib/util/memcache.h"
+
+/*
+ * unparse_share_modes() copies the entries that did not change from
+ * the old record and only encodes the others. Change the entries of a
+ * record the ways smbd does, through the record and through the
+ * memcache copy, and check after each store that the record holds
+ * exactly what we expect.
+ */
+
+#define SHARE_MODE_RECORD_MAX 64
+
+struct share_mode_record_model {
+	struct share_mode_entry entries[SHARE_MODE_RECORD_MAX];
+	uint32_t num_entries;
+	uint64_t next_share_file_id;
+};
+
+static int share_mode_record_cmp(const void *p1, const void *p2)
+{
+	const struct share_mode_entry *e1 = p1;
+	const struct share_mode_entry *e2 = p2;
+
+	return share_mode_entry_cmp(e1->pid, e1->share_file_id,
+				    e2->pid, e2->share_file_id);
+}
+
+static void share_mode_record_sort(struct share_mode_entry *entries,
+				   uint32_t num_entries)
+{
+	qsort(entries, num_entries, sizeof(struct share_mode_entry),
+	      share_mode_record_cmp);
+}
+
+static bool share_mode_record_entry_equal(const struct share_mode_entry *e1,
+					  const struct share_mode_entry *e2)
+{
+	return (server_id_equal(&e1->pid, &e2->pid) &&
+		(e1->op_mid == e2->op_mid) &&
+		(e1->op_type == e2->op_type) &&
+		(e1->access_mask == e2->access_mask) &&
+		(e1->share_access == e2->share_access) &&
+		(e1->private_options == e2->private_options) &&
+		(e1->time.tv_sec == e2->time.tv_sec) &&
+		(e1->time.tv_usec == e2->time.tv_usec) &&
+		file_id_equal(&e1->id, &e2->id) &&
+		(e1->share_file_id == e2->share_file_id) &&
+		(e1->uid == e2->uid) &&
+		(e1->flags == e2->flags) &&
+		(e1->name_hash == e2->name_hash));
+}
+
+static void share_mode_record_new_entry(struct share_mode_record_model *m,
+					struct file_id id,
+					struct share_mode_entry *e)
+{
+	*e = (struct share_mode_entry) {
+		.pid = {
+			.pid = 1000 + random() % 4,
+			.task_id = random() % 2,
+			.vnn = NONCLUSTER_VNN,
+			.unique_id = random() % 3,
+		},
+		.op_mid = random(),
+		.op_type = NO_OPLOCK,
+		.access_mask = random(),
+		.share_access = random() % 8,
+		.private_options = random(),
+		.time = { .tv_sec = random(), .tv_usec = random() % 1000000 },
+		.id = id,
+		.share_file_id = m->next_share_file_id++,
+		.uid = random(),
+		.flags = random(),
+		.name_hash = random(),
+	};
+}
+
+/*
+ * Look at what is stored, not at a memcache copy
+ */
+static bool share_mode_record_check(const struct share_mode_record_model *m,
+				    struct file_id id)
+{
+	struct share_mode_lock *lck;
+	struct share_mode_data *d;
+	uint32_t i;
+
+	memcache_flush(NULL, SHARE_MODE_LOCK_CACHE);
+
+	lck = fetch_share_mode_unlocked(talloc_tos(), id);
+	if (m->num_entries == 0) {
+		if (lck != NULL) {
+			fprintf(stderr, "Empty record still there\n");
+			TALLOC_FREE(lck);
+			return false;
+		}
+		return true;
+	}
+	if (lck == NULL) {
+		fprintf(stderr, "fetch_share_mode_unlocked failed\n");
+		return false;
+	}
+	d = lck->data;
+
+	if (d->num_share_modes != m->num_entries) {
+		fprintf(stderr, "Got %u entries, expected %u\n",
+			(unsigned)d->num_share_modes,
+			(unsigned)m->num_entries);
+		TALLOC_FREE(lck);
+		return false;
+	}
+	for (i=0; i<m->num_entries; i++) {
+		if (!share_mode_record_entry_equal(&d->share_modes[i],
+						   &m->entries[i])) {
+			fprintf(stderr, "Entry %u differs\n", (unsigned)i);
+			TALLOC_FREE(lck);
+			return false;
+		}
+	}
+
+	TALLOC_FREE(lck);
+	return true;
+}
+
+/*
+ * One round of changes: delete some entries, change some in place,
+ * give some a new pid and share_file_id like a durable reconnect does
+ * and add new ones at the end.
+ */
+static bool share_mode_record_change(struct share_mode_record_model *m,
+				     struct file_id id,
+				     const struct smb_filename *smb_fname,
+				     bool from_memcache)
+{
+	struct timespec old_write_time = { .tv_sec = 0 };
+	struct share_mode_lock *lck;
+	struct share_mode_data *d;
+	uint32_t i, num_add;
+
+	if (!from_memcache) {
+		memcache_flush(NULL, SHARE_MODE_LOCK_CACHE);
+	}
+
+	lck = get_share_mode_lock(talloc_tos(), id, "/", smb_fname,
+				  &old_write_time);
+	if (lck == NULL) {
+		fprintf(stderr, "get_share_mode_lock failed\n");
+		return false;
+	}
+	d = lck->data;
+
+	if (d->num_share_modes != m->num_entries) {
+		fprintf(stderr, "Locked %u entries, expected %u\n",
+			(unsigned)d->num_share_modes,
+			(unsigned)m->num_entries);
+		TALLOC_FREE(lck);
+		return false;
+	}
+
+	i = 0;
+	while (i < d->num_share_modes) {
+		struct share_mode_entry *e = &d->share_modes[i];
+
+		switch (random() % 6) {
+		case 0:
+			/* del_share_mode() */
+			memmove(e, e+1, sizeof(*e) *
+				(d->num_share_modes - i - 1));
+			d->num_share_modes -= 1;
+			memmove(&m->entries[i], &m->entries[i+1],
+				sizeof(*e) * (m->num_entries - i - 1));
+			m->num_entries -= 1;
+			continue;
+		case 1:
+			/* e.g. an oplock downgrade */
+			e->access_mask = random();
+			e->flags = random();
+			break;
+		case 2:
+			/* vfs_default_durable_reconnect() */
+			e->pid.pid = 1000 + random() % 4;
+			e->pid.unique_id = random() % 3;
+			e->share_file_id = m->next_share_file_id++;
+			break;
+		default:
+			break;
+		}
+		m->entries[i] = *e;
+		i += 1;
+	}
+
+	num_add = random() % 8;
+	num_add = MIN(num_add, SHARE_MODE_RECORD_MAX - m->num_entries);
+
+	d->share_modes = talloc_realloc(d, d->share_modes,
+					struct share_mode_entry,
+					d->num_share_modes + num_add);
+	if (d->share_modes == NULL) {
+		fprintf(stderr, "talloc_realloc failed\n");
+		TALLOC_FREE(lck);
+		return false;
+	}
+	for (i=0; i<num_add; i++) {
+		struct share_mode_entry *e =
+			&d->share_modes[d->num_share_modes];
+
+		share_mode_record_new_entry(m, id, e);
+		d->num_share_modes += 1;
+		m->entries[m->num_entries++] = *e;
+	}
+
+	share_mode_record_sort(m->entries, m->num_entries);
+
+	d->modified = true;
+	TALLOC_FREE(lck);
+
+	return share_mode_record_check(m, id);
+}
+
+bool run_local_share_mode_record(int dummy)
+{
+	struct share_mode_record_model *m;
+	struct smb_filename *smb_fname;
+	struct file_id id;
+	unsigned i;
+	bool ret = false;
+
+	if (!locking_init()) {
+		fprintf(stderr, "locking_init failed\n");
+		return false;
+	}
+
+	m = talloc_zero(talloc_tos(), struct share_mode_record_model);
+	smb_fname = synthetic_smb_fname(talloc_tos(), "share_mode_record",
+					NULL, NULL);
+	if ((m == NULL) || (smb_fname == NULL)) {
+		fprintf(stderr, "talloc failed\n");
+		goto fail;
+	}
+
+	id = (struct file_id) {
+		.devid = random(), .inode = random(), .extid = getpid()
+	};
+
+	/*
+	 * Grow the record, then shrink and refill it a few times.
+	 * Every second round works on the memcache copy the previous
+	 * store left behind.
+	 */
+	for (i=0; i<200; i++) {
+		if (!share_mode_record_change(m, id, smb_fname,
+					      (i % 2) == 1)) {
+			fprintf(stderr, "Round %u failed\n", i);
+			goto fail;
+		}
+	}
+
+	/*
+	 * Deleting all entries deletes the record
+	 */
+	while (m->num_entries > 0) {
+		struct timespec old_write_time = { .tv_sec = 0 };
+		struct share_mode_lock *lck;
+
+		lck = get_share_mode_lock(talloc_tos(), id, "/", smb_fname,
+					  &old_write_time);
+		if (lck == NULL) {
+			fprintf(stderr, "get_share_mode_lock failed\n");
+			goto fail;
+		}
+		lck->data->num_share_modes -= 1;
+		lck->data->modified = true;
+		TALLOC_FREE(lck);
+
+		m->num_entries -= 1;
+		if (!share_mode_record_check(m, id)) {
+			goto fail;
+		}
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(smb_fname);
+	TALLOC_FREE(m);
+	return ret;
+}
@@ -9999,6 +9999,12 @@ static struct {
 	{"NEGNOWAIT", run_negprot_nowait, 0},
 	{"NBENCH",  run_nbench, 0},
 	{"NBENCH2", run_nbench2, 0},
+	{"BENCH-SMB2-GETINFO", run_bench_smb2_getinfo, 0},
+	{"BENCH-SMB2-QUERYDIR", run_bench_smb2_querydir, 0},
+	{"BENCH-SMB2-OPENCLOSE", run_bench_smb2_openclose, 0},
+	{"BENCH-MESSAGING-FANOUT", run_bench_messaging_fanout, 0},
+	{"BENCH-MANY-HANDLES", run_bench_many_handles, 0},
+	{"BENCH-SHARE-MODES", run_bench_share_modes, 0},
 	{"OPLOCK1",  run_oplock1, 0},
 	{"OPLOCK2",  run_oplock2, 0},
 	{"OPLOCK4",  run_oplock4, 0},
@@ -10075,10 +10081,12 @@ static struct {
 	{ "CLEANUP3", run_cleanup3 },
 	{ "CLEANUP4", run_cleanup4 },
 	{ "OPLOCK-CANCEL", run_oplock_cancel },
+	{ "FCB-DUP", run_fcb_dup, 0},
 	{ "LOCAL-SUBSTITUTE", run_local_substitute, 0},
 	{ "LOCAL-GENCACHE", run_local_gencache, 0},
 	{ "LOCAL-TALLOC-DICT", run_local_talloc_dict, 0},
 	{ "LOCAL-DBWRAP-WATCH1", run_dbwrap_watch1, 0 },
+	{ "LOCAL-DBWRAP-MULTI", run_dbwrap_multi, 0 },
 	{ "LOCAL-MESSAGING-READ1", run_messaging_read1, 0 },
 	{ "LOCAL-MESSAGING-READ2", run_messaging_read2, 0 },
 	{ "LOCAL-MESSAGING-READ3", run_messaging_read3, 0 },
@@ -10087,6 +10095,8 @@ static struct {
 	{ "LOCAL-MESSAGING-FDPASS2", run_messaging_fdpass2, 0 },
 	{ "LOCAL-MESSAGING-FDPASS2a", run_messaging_fdpass2a, 0 },
 	{ "LOCAL-MESSAGING-FDPASS2b", run_messaging_fdpass2b, 0 },
+	{ "LOCAL-MSG-RING", run_msg_ring, 0 },
+	{ "LOCAL-SHARE-MODE-RECORD", run_local_share_mode_record, 0 },
 	{ "LOCAL-BASE64", run_local_base64, 0},
 	{ "LOCAL-RBTREE", run_local_rbtree, 0},
 	{ "LOCAL-MEMCACHE", run_local_memcache, 0},
@@ -10107,6 +10117,7 @@ static struct {
 	{ "local-tdb-writer", run_local_tdb_writer, 0 },
 	{ "LOCAL-DBWRAP-CTDB", run_local_dbwrap_ctdb, 0 },
 	{ "LOCAL-BENCH-PTHREADPOOL", run_bench_pthreadpool, 0 },
+	{ "LOCAL-BENCH-AIO", run_bench_aio, 0 },
 	{ "qpathinfo-bufsize", run_qpathinfo_bufsize, 0 },
 	{NULL, NULL, 0}};
 
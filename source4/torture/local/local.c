@@ -68,6 +68,7 @@
 	torture_dsdb_syntax,
 	torture_registry,
 	torture_local_verif_trailer,
+	torture_local_smb2_signing,
 	torture_local_nss,
 	torture_local_fsrvp,
 	NULL
@@ -94,6 +95,10 @@ NTSTATUS torture_local_init(void)
 				      torture_local_crypto_aes_ccm_128);
 	torture_suite_add_simple_test(suite, "crypto.aes_gcm_128",
 				      torture_local_crypto_aes_gcm_128);
+	torture_suite_add_simple_test(suite, "crypto.aes_backends",
+				      torture_local_crypto_aes_backends);
+	torture_suite_add_simple_test(suite, "crypto.aes_speed",
+				      torture_local_crypto_aes_speed);
 
 	for (i = 0; suite_generators[i]; i++)
 		torture_suite_add_suite(suite,
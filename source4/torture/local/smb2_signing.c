@@ -0,0 +1,178 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   test suite for batched SMB2 signing
+
+   Copyright (C) Samba Team 2016
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "../libcli/smb/smb_common.h"
+#include "torture/torture.h"
+#include "torture/local/proto.h"
+
+#define SIGN_PDUS_MAX_PDUS 19
+#define SIGN_PDUS_MAX_IOVS 4
+
+struct sign_pdus_msg {
+	uint8_t key[16];
+	uint8_t hdr[SMB2_HDR_BODY];
+	uint8_t body[SIGN_PDUS_MAX_IOVS-1][300];
+	struct iovec vector[SIGN_PDUS_MAX_IOVS];
+	int count;
+};
+
+static void sign_pdus_fill(uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = random();
+	}
+}
+
+/*
+ * Random messages with 1-3 body iovecs of random length, among them
+ * empty ones and ones with a zero session id, which are not signed.
+ */
+static void sign_pdus_setup(struct sign_pdus_msg *msgs, size_t num)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < num; i++) {
+		struct sign_pdus_msg *m = &msgs[i];
+
+		sign_pdus_fill(m->key, sizeof(m->key));
+		sign_pdus_fill(m->hdr, sizeof(m->hdr));
+		sign_pdus_fill((uint8_t *)m->body, sizeof(m->body));
+
+		if ((random() % 5) == 0) {
+			SBVAL(m->hdr, SMB2_HDR_SESSION_ID, 0);
+		}
+
+		m->vector[0] = (struct iovec) {
+			.iov_base = m->hdr, .iov_len = sizeof(m->hdr)
+		};
+		m->count = 2 + random() % (SIGN_PDUS_MAX_IOVS - 1);
+
+		for (j = 1; j < m->count; j++) {
+			m->vector[j] = (struct iovec) {
+				.iov_base = m->body[j-1],
+				.iov_len = random() % sizeof(m->body[j-1])
+			};
+		}
+	}
+}
+
+static bool test_sign_pdus_protocol(struct torture_context *tctx,
+				    enum protocol_types protocol)
+{
+	struct sign_pdus_msg *msgs1, *msgs2;
+	struct smb2_signing_pdu pdus[SIGN_PDUS_MAX_PDUS];
+	size_t num, i;
+	int j;
+	NTSTATUS status;
+
+	msgs1 = talloc_array(tctx, struct sign_pdus_msg, SIGN_PDUS_MAX_PDUS);
+	torture_assert(tctx, msgs1 != NULL, "talloc_array failed");
+	msgs2 = talloc_array(tctx, struct sign_pdus_msg, SIGN_PDUS_MAX_PDUS);
+	torture_assert(tctx, msgs2 != NULL, "talloc_array failed");
+
+	for (num = 1; num <= SIGN_PDUS_MAX_PDUS; num++) {
+		sign_pdus_setup(msgs1, num);
+
+		for (i = 0; i < num; i++) {
+			msgs2[i] = msgs1[i];
+			for (j = 0; j < msgs1[i].count; j++) {
+				uint8_t *base = (uint8_t *)&msgs1[i];
+				uint8_t *p = msgs1[i].vector[j].iov_base;
+
+				msgs2[i].vector[j].iov_base =
+					(uint8_t *)&msgs2[i] + (p - base);
+			}
+		}
+
+		for (i = 0; i < num; i++) {
+			status = smb2_signing_sign_pdu(
+				data_blob_const(msgs1[i].key,
+						sizeof(msgs1[i].key)),
+				protocol, msgs1[i].vector, msgs1[i].count);
+			torture_assert_ntstatus_ok(tctx, status,
+						   "smb2_signing_sign_pdu");
+
+			pdus[i] = (struct smb2_signing_pdu) {
+				.signing_key = data_blob_const(
+					msgs2[i].key, sizeof(msgs2[i].key)),
+				.vector = msgs2[i].vector,
+				.count = msgs2[i].count,
+			};
+		}
+
+		status = smb2_signing_sign_pdus(protocol, pdus, num);
+		torture_assert_ntstatus_ok(tctx, status,
+					   "smb2_signing_sign_pdus");
+
+		for (i = 0; i < num; i++) {
+			torture_assert_mem_equal(
+				tctx, msgs2[i].hdr, msgs1[i].hdr,
+				sizeof(msgs1[i].hdr),
+				talloc_asprintf(tctx, "pdu %u of %u differs",
+						(unsigned)i, (unsigned)num));
+
+			status = smb2_signing_check_pdu(
+				data_blob_const(msgs2[i].key,
+						sizeof(msgs2[i].key)),
+				protocol, msgs2[i].vector, msgs2[i].count);
+			torture_assert_ntstatus_ok(tctx, status,
+						   "smb2_signing_check_pdu");
+		}
+	}
+
+	TALLOC_FREE(msgs1);
+	TALLOC_FREE(msgs2);
+	return true;
+}
+
+/*
+ * smb2_signing_sign_pdus() must produce the same signatures as
+ * smb2_signing_sign_pdu() for each pdu, for batches of any size.
+ */
+static bool test_sign_pdus(struct torture_context *tctx)
+{
+	static const enum protocol_types protocols[] = {
+		PROTOCOL_SMB2_10, PROTOCOL_SMB3_00, PROTOCOL_SMB3_11
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+		if (!test_sign_pdus_protocol(tctx, protocols[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct torture_suite *torture_local_smb2_signing(TALLOC_CTX *mem_ctx)
+{
+	struct torture_suite *suite = torture_suite_create(mem_ctx,
+							   "smb2_signing");
+
+	torture_suite_add_simple_test(suite, "sign_pdus", test_sign_pdus);
+
+	return suite;
+}
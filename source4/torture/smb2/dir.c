@@ -22,6 +22,7 @@
 */
 
 #include "includes.h"
+#include <tevent.h>
 #include "libcli/smb2/smb2.h"
 #include "libcli/smb2/smb2_calls.h"
 #include "libcli/smb_composite/smb_composite.h"
@@ -1371,6 +1372,105 @@ done:
 	return ret;
 }
 
+static void prefetch_disconnect_timeout(struct tevent_context *ev,
+					struct tevent_timer *te,
+					struct timeval current_time,
+					void *private_data)
+{
+	bool *timesup = (bool *)private_data;
+	*timesup = true;
+}
+
+/*
+   disconnect while the server still looks up the directory entries
+   of a query directory, it must not touch the lookups of the gone
+   client
+*/
+static bool test_prefetch_disconnect(struct torture_context *tctx,
+				     struct smb2_tree *tree)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(tctx);
+	const int num_files = 1000;
+	struct file_elem files[1000] = {};
+	struct multiple_result result;
+	struct smb2_tree *tree2 = NULL;
+	struct smb2_handle h, h2;
+	struct smb2_request *req;
+	struct smb2_find f;
+	bool ret = true;
+	NTSTATUS status;
+	int i;
+
+	status = populate_tree(tctx, mem_ctx, tree, files, num_files, &h);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+
+	for (i = 0; i < 10; i++) {
+		TALLOC_CTX *wait_ctx;
+		struct tevent_timer *te;
+		bool timesup = false;
+
+		torture_assert_goto(tctx, torture_smb2_connection(tctx, &tree2),
+				    ret, done, "torture_smb2_connection failed");
+
+		status = torture_smb2_testdir(tree2, DNAME, &h2);
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+
+		ZERO_STRUCT(f);
+		f.in.file.handle	= h2;
+		f.in.pattern		= "*";
+		f.in.continue_flags	= 0;
+		f.in.max_response_size	= 0x10000;
+		f.in.level		= SMB2_FIND_BOTH_DIRECTORY_INFO;
+
+		req = smb2_find_send(tree2, &f);
+		torture_assert_goto(tctx, req != NULL, ret, done,
+				    "smb2_find_send failed");
+
+		/*
+		 * Get the request out, but go away before the reply. The
+		 * timer is gone once it fired, wait_ctx takes care of it
+		 * in either case.
+		 */
+		wait_ctx = talloc_new(mem_ctx);
+		torture_assert_goto(tctx, wait_ctx != NULL, ret, done,
+				    "talloc_new failed");
+		te = tevent_add_timer(tctx->ev, wait_ctx,
+				      tevent_timeval_current_ofs(0, i * 1000),
+				      prefetch_disconnect_timeout, &timesup);
+		torture_assert_goto(tctx, te != NULL, ret, done,
+				    "tevent_add_timer failed");
+		while (!timesup && (req->state < SMB2_REQUEST_DONE)) {
+			if (tevent_loop_once(tctx->ev) != 0) {
+				break;
+			}
+		}
+		TALLOC_FREE(wait_ctx);
+		TALLOC_FREE(tree2);
+	}
+
+	/*
+	 * The server must still be there and list everything
+	 */
+	ZERO_STRUCT(result);
+	result.tctx = tctx;
+
+	status = multiple_smb2_search(tree, tctx, "*",
+				      SMB2_FIND_BOTH_DIRECTORY_INFO,
+				      RAW_SEARCH_DATA_BOTH_DIRECTORY_INFO,
+				      SMB2_CONTINUE_FLAG_SINGLE,
+				      &result, &h);
+	torture_assert_int_equal_goto(tctx, result.count, num_files, ret, done,
+				      "");
+	talloc_free(result.list);
+done:
+	TALLOC_FREE(tree2);
+	smb2_util_close(tree, h);
+	smb2_deltree(tree, DNAME);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
 struct torture_suite *torture_smb2_dir_init(void)
 {
 	struct torture_suite *suite =
@@ -1384,6 +1484,8 @@ struct torture_suite *torture_smb2_dir_init(void)
 	torture_suite_add_1smb2_test(suite, "sorted", test_sorted);
 	torture_suite_add_1smb2_test(suite, "file-index", test_file_index);
 	torture_suite_add_1smb2_test(suite, "large-files", test_large_files);
+	torture_suite_add_1smb2_test(suite, "prefetch-disconnect",
+				     test_prefetch_disconnect);
 	suite->description = talloc_strdup(suite, "SMB2-DIR tests");
 
 	return suite;